@@ -0,0 +1,23 @@
+#pragma once
+
+#include "types.h"
+
+// 分配调用点统计（allocprof）：为 1 时 alloc_page/alloc_page_nozero/alloc_pages 与
+// kmem_cache_alloc 按调用者的返回地址（__builtin_return_address）归类，记录各调用点
+// 现存的页数或对象数、字节数与字节数的最高水位，释放时记到分配它的调用点上。
+// 物理页的调用点编号记在 kalloc 的逐页表中，slab 对象的记在槽位末尾多出的 8 字节里；
+// 共享页（COW、页缓存映射）在最后一个引用放弃时才算释放。slab 的页本身也计为 slab_grow
+// 调用点的页分配，与其中对象的统计是同一块内存的两种视角。
+// 缺省为 0，相关代码全部编译掉；由 Makefile 的 ALLOC_PROF 开启
+#ifndef ALLOC_PROF
+#define ALLOC_PROF 0
+#endif
+
+#define ALLOCPROF_SITES 256   // 调用点登记表的槽数，0 号槽收容登记表满后的调用点
+
+#if ALLOC_PROF
+int allocprof_alloc(uint64 ra, const char *cache, uint64 n, uint64 bytes);   // 返回调用点编号
+void allocprof_free(int site, uint64 bytes);
+#endif
+void allocprof_dump(void);
+void allocprof_reset(void);
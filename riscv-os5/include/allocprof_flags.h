@@ -0,0 +1,4 @@
+#pragma once
+
+// allocprof 系统调用的 flags，内核与用户态共用
+#define ALLOCPROF_RESET 0x1   // 输出后把各调用点的累计分配次数清零、高水位降到当前用量
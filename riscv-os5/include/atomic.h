@@ -0,0 +1,79 @@
+#pragma once
+
+#include "types.h"
+
+// ================= 原子操作与内存序 =================
+// __sync_* 内建函数一律生成带 .aqrl 的 AMO 或 fence rw,rw；锁、环形队列这类只需要
+// 单向顺序的地方改用下面这些按 RISC-V 内存模型写的原语，避免为每次加锁/发布付全屏障的代价。
+//
+// 约定：
+//   load_acquire  之后的访存不会被提到它之前（lw + fence r,rw）
+//   store_release 之前的访存不会被推迟到它之后（fence rw,w + sw）
+//   atomic_fetch_add 等不带后缀的 AMO 只保证原子性，不排序，用于统计计数器
+//   *_acquire / *_release 的 AMO 使用 .aq / .rl 位
+
+// 只排序普通内存访问
+static inline void smp_mb(void)  { asm volatile("fence rw, rw" ::: "memory"); }
+static inline void smp_rmb(void) { asm volatile("fence r, r" ::: "memory"); }
+static inline void smp_wmb(void) { asm volatile("fence w, w" ::: "memory"); }
+
+// 获取/释放屏障：与前面一次读（或后面一次写）配合，效果同 load_acquire / store_release
+static inline void smp_acquire(void) { asm volatile("fence r, rw" ::: "memory"); }
+static inline void smp_release(void) { asm volatile("fence rw, w" ::: "memory"); }
+
+// 内存写入须在随后的设备寄存器（MMIO）写入之前对设备可见，例如 virtio 的 QUEUE_NOTIFY
+static inline void io_wmb(void) { asm volatile("fence w, o" ::: "memory"); }
+
+static inline uint load_acquire(volatile uint *p)
+{
+  uint v;
+  asm volatile("lw %0, 0(%1)\n\tfence r, rw" : "=r" (v) : "r" (p) : "memory");
+  return v;
+}
+
+static inline uint64 load_acquire64(volatile uint64 *p)
+{
+  uint64 v;
+  asm volatile("ld %0, 0(%1)\n\tfence r, rw" : "=r" (v) : "r" (p) : "memory");
+  return v;
+}
+
+static inline void store_release(volatile uint *p, uint v)
+{
+  asm volatile("fence rw, w\n\tsw %1, 0(%0)" : : "r" (p), "r" (v) : "memory");
+}
+
+static inline void store_release64(volatile uint64 *p, uint64 v)
+{
+  asm volatile("fence rw, w\n\tsd %1, 0(%0)" : : "r" (p), "r" (v) : "memory");
+}
+
+// 交换并返回旧值：.aq 用于加锁（之后的访存不会越过它），.rl 用于解锁
+static inline uint atomic_swap_acquire(volatile uint *p, uint v)
+{
+  uint old;
+  asm volatile("amoswap.w.aq %0, %2, (%1)" : "=r" (old) : "r" (p), "r" (v) : "memory");
+  return old;
+}
+
+static inline uint atomic_swap_release(volatile uint *p, uint v)
+{
+  uint old;
+  asm volatile("amoswap.w.rl %0, %2, (%1)" : "=r" (old) : "r" (p), "r" (v) : "memory");
+  return old;
+}
+
+// 加上 v 并返回旧值，不排序
+static inline uint atomic_fetch_add(volatile uint *p, uint v)
+{
+  uint old;
+  asm volatile("amoadd.w %0, %2, (%1)" : "=r" (old) : "r" (p), "r" (v) : "memory");
+  return old;
+}
+
+static inline uint64 atomic_fetch_add64(volatile uint64 *p, uint64 v)
+{
+  uint64 old;
+  asm volatile("amoadd.d %0, %2, (%1)" : "=r" (old) : "r" (p), "r" (v) : "memory");
+  return old;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// bcachestat 系统调用返回的块缓存统计，内核与用户态共用。计数均为启动以来的累计值。
+struct bcachestat {
+    unsigned long nbuf;            // 缓存块总数
+    unsigned long nprotected;      // 当前处于保护队列的块数（其余块在试用队列）
+    unsigned long hits;            // bread 命中缓存的次数
+    unsigned long misses;          // bread 未命中、需要换入的次数
+    unsigned long prefetches;      // 预读换入的块数
+    unsigned long evictions;       // 换出有效块的次数
+    unsigned long evict_protected; // 其中换出保护队列块的次数
+    unsigned long ghost_hits;      // 未命中但块在最近换出记录中、直接进入保护队列的次数
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "types.h"
+#include "benchstat.h"
+
+// 内核微基准框架。BENCH(name, ...) 定义一个基准并登记到 benchtab 段，
+// 框架先预热 BENCH_WARMUP 次，再执行 BENCH_ITERS 次并逐次以 cycle CSR 计时，
+// 报告最小值、中位数、p99 与最大值。setup 为全部 BENCH_WARMUP + BENCH_ITERS 次
+// 迭代准备状态；run(i) 是被测操作；reset(i) 在两次迭代之间收尾，不计时。
+//
+//   BENCH(alloc_page, .run = alloc_run, .reset = alloc_reset);
+//
+// 在 Makefile 中以 BENCH_BOOT=1 构建时，内核测试任务在启动后运行全部基准
+#ifndef BENCH_AT_BOOT
+#define BENCH_AT_BOOT 0
+#endif
+
+#define BENCH_WARMUP 16
+#define BENCH_ITERS 256
+#define BENCH_MAX 16       // 单次 kbench 最多返回的结果数
+
+struct bench {
+    const char *name;
+    int (*setup)(int n);       // 可选，失败返回 -1，此时跳过该基准
+    void (*run)(int i);
+    void (*reset)(int i);      // 可选
+    void (*teardown)(void);    // 可选
+};
+
+#define BENCH(bname, ...) \
+    static const struct bench bench_desc_##bname \
+    __attribute__((used, section("benchtab"), aligned(8))) = { .name = #bname, __VA_ARGS__ }
+
+void bench_init(void);
+// 运行名称为 name 的基准（name 为 0 或空串时运行全部），结果写入 res，至多 max 个。
+// 返回运行的基准个数
+int bench_run(const char *name, struct bench_result *res, int max);
+void bench_report(const struct bench_result *r);
@@ -0,0 +1,17 @@
+#pragma once
+
+// kbench 系统调用返回的内核微基准结果，内核与用户态共用。时间均为 cycle CSR 计数。
+#define BENCH_NAME_LEN 16
+
+struct bench_result {
+    char name[BENCH_NAME_LEN];
+    unsigned long iters;     // 计入统计的迭代次数（不含预热）
+    unsigned long min;
+    unsigned long median;
+    unsigned long p99;
+    unsigned long max;
+};
+
+// 报告格式，每个基准一行，便于脚本解析：
+// [bench] name=<名称> iters=<n> min=<c> median=<c> p99=<c> max=<c> unit=cycles
+#define BENCH_REPORT_FMT "[bench] name=%s iters=%lu min=%lu median=%lu p99=%lu max=%lu unit=cycles\n"
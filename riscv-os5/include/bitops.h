@@ -0,0 +1,18 @@
+#pragma once
+
+#include "types.h"
+
+// 位运算工具。目标为 rv64g，没有 Zbb 扩展时 GCC 把 __builtin_ctz 系列编译成对 libgcc 的调用，
+// 而内核不链接 libgcc，因此这里用 de Bruijn 序列查表实现。
+
+// x 中最低置位的编号，x 须非 0：x & -x 只留最低位，乘以 de Bruijn 常数后高 6 位各不相同
+static inline int ctz64(uint64 x)
+{
+  static const uint8 pos[64] = {
+    0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+    62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+    63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+    46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6,
+  };
+  return pos[((x & -x) * 0x03f79d71b4cb0a89ULL) >> 58];
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+
+// 块设备接口：块缓存（bio.c）按缓存块的 dev 找到对应的驱动提交请求。
+// 驱动在初始化时以 blkdev_register 登记，后登记的覆盖先登记的（RAMDISK=1 时内存盘取代 virtio 磁盘）
+struct buf;
+
+// 一段块号连续的区间
+struct blk_range {
+    uint32 start;
+    uint32 len;
+};
+
+struct blkdev {
+    const char *name;
+    // 提交块号连续的 n 个缓存块（按块号递增排列，至多 VIRTIO_MAX_SEGS 个）。完成时清除 b->disk，
+    // done 非 0 时随后调用 done(b)（可能在中断中，不得睡眠）。调用者在完成前须持有各块的睡眠锁
+    void (*submit)(struct buf **bs, int n, int write, void (*done)(struct buf *));
+    // 等待 done 为 0 的请求完成
+    void (*wait)(struct buf *b);
+    // 告知设备 n 段区间中的块已不再使用（TRIM），同步完成，可能睡眠。可为 0，表示设备不支持
+    void (*discard)(const struct blk_range *r, int n);
+};
+
+#define NBLKDEV 4   // 可登记的设备号 [0, NBLKDEV)
+
+void blkdev_register(uint dev, const struct blkdev *d);
+const struct blkdev *blkdev_get(uint dev);
+// 经 bs[0]->dev 的驱动提交请求 / 等待 b 完成，同时把块数与等待时间计入当前进程的
+// I/O 统计（iostat.h）。块缓存、直接 I/O 与交换区都经这两个函数访问设备
+void blk_submit(struct buf **bs, int n, int write, void (*done)(struct buf *));
+void blk_wait(struct buf *b);
+
+// 块 I/O 调度器（kernel/fs/iosched.c）：包在 dev 的驱动外面，按截止时间与块号重排请求
+void iosched_init(uint dev);
+void iosched_start(void);   // 创建 kblockd，之前的请求直接交给驱动
+
+// 内存盘（kernel/fs/ramdisk.c）：RAMDISK=1 时作为根设备，镜像由 QEMU 的 loader 设备装入 RAMDISK_BASE
+void ramdisk_init(void);
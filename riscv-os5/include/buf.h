@@ -4,26 +4,61 @@
 #include "sleeplock.h"
 #include "fs.h"
 
+struct ioreq;
+
 // 缓存块状态标志
 #define B_VALID 0x2   // 缓存内容有效
 #define B_DIRTY 0x4   // 缓存已被修改，需要写回
 
-// 缓存块结构：复用 xv6 的双向链表组织形式
+// 缓存块结构：描述符与数据页分开分配，数据区单独占一页
 struct buf {
     int flags;                 // 状态标志位（B_VALID/B_DIRTY）
     uint dev;                  // 设备号
     uint blockno;              // 块号
     struct sleeplock lock;     // 保护 data[] 内容
-    uint refcnt;               // 引用计数
-    struct buf *next;          // LRU 双向链表（靠近头部表示最近使用）
-    struct buf *prev;
+    uint refcnt;               // 引用计数，与 referenced 一起由所属哈希桶的锁保护
+    int referenced;            // clock 置换的访问位：释放时置 1，扫描时清 0 给第二次机会
+    int prot;                  // 2Q 队列：1 为保护队列，0 为试用队列
+    int disk;                  // 已提交给磁盘、尚未完成时为 1，由 virtio 驱动维护
+    int vq;                    // 提交所用的 virtio 队列，等待完成时据此找到队列锁
+    struct ioreq *ioreq;       // 经 I/O 调度器提交时所属的请求，直接交给驱动时为 0
     struct buf *hash_next;     // 哈希桶单链表指针，用于按 (dev, blockno) 快速定位缓存块
-    uchar data[BLOCK_SIZE];    // 实际缓存数据，大小等于磁盘块大小
+    uchar *data;               // 实际缓存数据（一页），大小等于磁盘块大小
 };
 
 void bcache_init(void);
 struct buf *bread(uint dev, uint blockno);
+struct buf *bread_meta(uint dev, uint blockno);
+struct buf *bgetblk(uint dev, uint blockno);
+void binvalidate(struct buf *b);
+int bcached(uint dev, uint blockno);
 void bwrite(struct buf *b);
+void bwrite_submit(struct buf *b);
+void bwrite_wait(struct buf *b);
+
+// 块请求队列：调用者先把若干同方向的缓存块加入队列（须持有各自的睡眠锁），
+// blk_plug_flush 按块号排序、把块号相邻的块合并成一个多段 virtio 请求后一并提交。
+// 提交后仍需对每个块等待完成（写入用 bwrite_wait）
+#define BLK_PLUG_MAX 16
+
+struct blk_plug {
+    int write;                        // 1 为写入队列，0 为读取队列
+    void (*done)(struct buf *);       // 各块完成时的回调，blk_plug_init 置为 0
+    int n;
+    struct buf *bufs[BLK_PLUG_MAX];
+};
+
+void blk_plug_init(struct blk_plug *plug, int write);
+void blk_plug_add(struct blk_plug *plug, struct buf *b);
+void blk_plug_flush(struct blk_plug *plug);
+
+// 预读：异步读入尚未缓存的块，不等待完成，读到的块留在缓存中供随后的 bread 命中
+void breadahead(uint dev, const uint *blocks, int n);
 void brelse(struct buf *b);
+void brelse_once(struct buf *b);
 void bpin(struct buf *b);
 void bunpin(struct buf *b);
+struct bcachestat;
+void bcache_getstat(struct bcachestat *st);
+int bcache_nbuf(void);
+int bcache_shrink(int target);   // 内存紧张时归还空闲试用块的数据页
@@ -13,6 +13,12 @@ void goto_xy(int x, int y);
 void clear_line(void);
 void printf_color(int color, const char *fmt, ...);
 
+// 输入中断与初始化
+void consoleinit(void);
+void console_intr(int c);
+
 // 文件系统通过 devsw 表访问的控制台设备读写回调
 int consolewrite(int user_src, uint64 src, int n);
 int consoleread(int user_dst, uint64 dst, int n);
+struct poll_table;
+int consolepoll(struct poll_table *pt);
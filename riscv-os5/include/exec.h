@@ -1,5 +1,13 @@
 #define MAXARG 32 // 最大命令行参数数目
 
+struct proc;
 int kernel_exec(char *path, char **argv);
+int exec_into(struct proc *p, char *path, char **argv);
 int flags2perm(int flags);
-uint64 walkaddr(pagetable_t pagetable, uint64 va);
\ No newline at end of file
+void exec_cache_init(void);
+void exec_cache_invalidate(uint32 dev, uint32 inum);  // 文件内容改变时作废缓存的 ELF 解析结果
+uint64 walkaddr(pagetable_t pagetable, uint64 va);
+struct lazy_region;
+int exec_fault(struct proc *p, struct lazy_region *r, uint64 va0);   // 从可执行文件补上缺页
+void exec_lazy_dup(struct proc *np);    // fork 复制按需加载区间后为子进程增加文件引用
+void exec_lazy_release(struct proc *p); // 放弃按需加载区间持有的文件引用
\ No newline at end of file
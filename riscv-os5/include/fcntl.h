@@ -5,3 +5,12 @@
 #define O_WRONLY  0x001  // 只写模式  
 #define O_RDWR    0x002  // 读写模式
 #define O_CREATE  0x200  // 如果文件不存在则创建
+#define O_DIRECT  0x4000 // 普通文件块对齐的读写绕过块缓存，直接在用户页与磁盘之间传输
+
+// mmap 的保护位与映射类型，同样在内核与用户态之间共享
+#define PROT_READ     0x1   // 可读
+#define PROT_WRITE    0x2   // 可写
+#define PROT_EXEC     0x4   // 可执行
+#define MAP_SHARED    0x01  // 共享映射：fork 后父子进程看到同一组物理页
+#define MAP_PRIVATE   0x02  // 私有映射：fork 后写时复制
+#define MAP_ANONYMOUS 0x20  // 匿名映射：不关联文件，内容初始化为 0
@@ -1,20 +1,30 @@
 #pragma once
 
 #include "types.h"
+#include "spinlock.h"
+#include "sleeplock.h"
 #include "fs.h"
+#include "uio.h"
+#include "getdents.h"
 
-#define NOFILE 16
-#define NFILE  100
+#define NOFILE_INLINE 16   // 进程自带的描述符槽数，用满后扩展
+#define NOFILE 512         // 描述符上限：扩展后的指针数组正好占一页
+#define FD_HELD 4          // 一次系统调用至多借用的描述符数（见 fd_borrow）
 #define NDEV   10
 #define CONSOLE 1
+#define KLOG    2   // 内核日志，每个打开实例按各自的游标读取新日志
 
 struct pipe;
+struct sock;
+struct poll_table;
+struct proc;
 
 // 文件引用类型枚举，用于区分管道、普通文件与设备
 #define FD_NONE   0
 #define FD_PIPE   1
 #define FD_INODE  2
 #define FD_DEVICE 3
+#define FD_SOCKET 4
 
 // 全局文件表项，使用引用计数在进程之间共享
 struct file {
@@ -23,14 +33,35 @@ struct file {
     char readable;       // 是否允许读
     char writable;       // 是否允许写
     struct pipe *pipe;  // FD_PIPE: 指向管道对象
+    struct sock *sock;  // FD_SOCKET: 指向套接字
     struct inode *ip;   // FD_INODE/FD_DEVICE: 指向底层 inode
     uint32 off;         // 当前读写偏移（仅对 inode 生效）
     short major;        // 设备主编号，FD_DEVICE 时用于索引 devsw
+    char direct;        // 以 O_DIRECT 打开：块对齐的部分经 readi_direct/writei_direct 读写，且不预读
+    // 顺序读预读状态（仅对 inode 生效）：本次读取从上次结束处开始即视为顺序读
+    uint32 ra_next;     // 上次读取结束时的偏移
+    uint32 ra_end;      // 已发起预读的块号上界（不含）
+    int ra_window;      // 当前预读窗口（块数），0 表示未处于顺序读
+    uint64 seq;         // FD_DEVICE: 按打开实例记录读位置的设备使用，如 klog 的下一条日志序号
+    struct sleeplock poslock;  // 读取只共享持有 inode 锁，共用本实例的读者靠它串行更新 off 与预读状态
+};
+
+// 进程的打开文件表，线程组共用组长的一张。起初使用内联的 NOFILE_INLINE 个槽，
+// 用满时换成一整页的数组，此后不再改变，因此按描述符查找无需加锁。
+// open 位图记录占用的槽位，最低空闲描述符按 64 位字查找
+struct fdtable {
+    struct spinlock lock;                  // 保护分配、释放与扩展
+    int size;                              // 当前可用的槽数：NOFILE_INLINE 或 NOFILE
+    struct file **fd;                      // 指向 inline_fd 或扩展出的页
+    uint64 open[NOFILE / 64];              // 占用位图
+    struct file *inline_fd[NOFILE_INLINE];
 };
 
 struct devsw {
     int (*read)(int, uint64, int);   // 设备读回调
+    int (*fread)(struct file *, int, uint64, int); // 需要打开实例状态的读回调，设置时取代 read
     int (*write)(int, uint64, int);  // 设备写回调
+    int (*poll)(struct poll_table *); // 就绪查询（POLL*），为 0 时视为总是可读写
 };
 
 // 主设备号到读写函数的映射表，由各设备驱动在启动阶段注册
@@ -44,3 +75,28 @@ void fileclose(struct file *f);
 int filestat(struct file *f, uint64 addr);
 int fileread(struct file *f, uint64 addr, int n);
 int filewrite(struct file *f, uint64 addr, int n);
+int filewrite_intx(struct file *f, uint64 addr, int n);
+int filereadv(struct file *f, int user, const struct iovec *iov, int cnt, long off);
+int filewritev(struct file *f, int user, const struct iovec *iov, int cnt, long off);
+int filesendfile(struct file *out, struct file *in, long off, int n);
+int filegetdents(struct file *f, uint64 addr, int n, int flags);
+int filefallocate(struct file *f, long off, long len);
+int fileclone(struct file *dst, struct file *src);
+
+// 打开文件表
+void fdtable_init(struct fdtable *t);
+int fdtable_copy(struct fdtable *dst, struct fdtable *src);   // fork：复制全部描述符并增加引用
+void fdtable_release(struct fdtable *t);                      // 关闭全部描述符并归还扩展页
+int fd_alloc(struct fdtable *t, struct file *f);              // 绑定到最低空闲描述符，满时返回 -1
+struct file *fd_get(struct fdtable *t, int fd);                // 不增加引用，只能用于独占的表
+struct file *fd_get_ref(struct fdtable *t, int fd);            // 增加一次引用，用完后 fileclose
+struct file *fd_borrow(struct proc *p, int fd);                // 供本次系统调用使用，返回前由 fd_put_borrowed 归还
+void fd_put_borrowed(struct proc *p);
+struct file *fd_remove(struct fdtable *t, int fd);            // 解除绑定并返回原文件（引用转交调用者）
+
+// 预留 nops 个日志操作额度时一次 writei 最多写入的字节数：扣除 inode、位图等
+// 固定开销后，每个数据块最坏还需要一个位图块，公式与 xv6 保持一致。
+// 顺序数据模式下数据块本身不占日志槽，同样的额度可写入两倍的数据
+#define FILEWRITE_BYTES(nops) \
+    ((((nops) * MAX_OP_BLOCKS - 1 - 1 - 2) / (log_ordered() ? 1 : 2)) * BLOCK_SIZE)
+#define FILEWRITE_MAX FILEWRITE_BYTES(1)
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "types.h"
+
+struct proc;
+
+// 用户进程的浮点寄存器现场
+struct fpstate {
+  uint64 f[32];         // f0-f31
+  uint64 fcsr;          // 舍入模式与异常标志
+};
+
+// 惰性浮点上下文：内核中 sstatus.FS 始终为 Off，进程第一次执行浮点指令时
+// 才通过非法指令异常启用 FPU。只有启用过 FPU 的进程才会保存/恢复浮点寄存器，
+// 且仅在寄存器被写过（Dirty）时保存、在硬件寄存器已不属于自己时恢复
+void fpu_trap_entry(struct proc *p, uint64 sstatus);
+int fpu_first_use(struct proc *p);
+uint64 fpu_user_return(struct proc *p);
+void fpu_switch_out(struct proc *p);
+void fpu_fork(struct proc *parent, struct proc *child);
+void fpu_release(struct proc *p);
+
+// fpu_regs.S：调用前需保证 sstatus.FS 不为 Off
+void fpu_save_regs(struct fpstate *st);
+void fpu_load_regs(struct fpstate *st);
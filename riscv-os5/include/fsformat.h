@@ -0,0 +1,174 @@
+#pragma once
+
+#include "types.h"
+
+// ======================== 文件系统磁盘格式 ========================
+// 块设备的布局、超级块、磁盘索引节点与目录项格式。内核（经 fs.h）与主机上的
+// tools/mkfs.c 共用本文件，因此只能依赖 types.h，不得引用内核其他头文件。
+
+// FS_MAGIC: 用于超级块校验的魔数，加载超级块时若不匹配会拒绝挂载。
+#define FS_MAGIC        0x20241031u
+// BLOCK_SIZE: 单个磁盘块大小（字节）。所有块相关计算均依赖该常量。
+#define BLOCK_SIZE      4096
+// BLOCK_SIZE_LOG2: 上述块大小的以 2 为底的对数，用于位移运算优化。
+#define BLOCK_SIZE_LOG2 12
+// 文件系统总块数与 inode 数由 mkfs 决定并记录在超级块中（mkfs -s / -i）。
+// FS_MAX_INODES: 目录项中的 inode 号为 16 位。
+#define FS_MAX_INODES   65535
+
+// 超级块所在的块号及数量，目前固定为单块超级块。
+#define SUPERBLOCK_BLOCKNO 1
+#define SUPERBLOCK_NUM     1
+// 其余布局（日志区、inode 表、位图、数据区）由 mkfs 决定并记录在超级块中，
+// 依次为：日志区紧随超级块，之后是 inode 表、位图，剩余为数据区。
+// 日志区对应 kernel/fs/log.c 的物理 redo 日志，其块数须在 [LOG_MIN, LOG_MAX] 之间：
+// 至少容纳 3 个最大的系统调用操作，且日志头部（序号、校验和、块数 + 块号数组）要放进一个块。
+// 日志区的前 LOG_HDR_BLOCKS 块是轮流写入的两份头部，其后为日志槽。
+#define LOG_MIN            30
+#define LOG_MAX            (BLOCK_SIZE / sizeof(uint32) - 4)
+#define LOG_HDR_BLOCKS     2
+
+// 根 inode 号，mkfs 分配的第一个 inode 即为根目录。
+#define ROOTINO 1
+
+// NDIRECT: inode 中直接块指针数量。
+// NINDIRECT: 单块可存放的间接块指针数量。
+// MAX_FILE_BLOCKS: 单个文件理论上最多引用的块数（直接 + 间接）。
+// MAX_FILE_SIZE: 以字节为单位的最大文件长度。
+#define NDIRECT    12
+#define NINDIRECT  (BLOCK_SIZE / sizeof(uint32))
+#define NDOUBLE    (NINDIRECT * NINDIRECT)
+#define MAX_FILE_BLOCKS (NDIRECT + NINDIRECT + NDOUBLE)
+#define MAX_FILE_SIZE   ((uint64)MAX_FILE_BLOCKS * BLOCK_SIZE)
+
+// 区段格式（dinode.flags 含 DI_EXTENTS）：文件由若干段物理连续的块组成，
+// addrs 的前 NDIRECT 个字存放前 NEXTENT_INLINE 个区段，addrs[NDIRECT] 指向存放
+// 其余区段的区段块，addrs[NDIRECT + 1] 为区段总数。区段按逻辑块号递增且首尾相接，
+// 覆盖文件的全部块；查找至多读一次区段块。
+#define DI_EXTENTS     0x1
+#define NEXTENT_INLINE (NDIRECT * sizeof(uint32) / sizeof(struct extent))
+#define NEXTENT_BLOCK  (BLOCK_SIZE / sizeof(struct extent))
+#define MAX_EXTENTS    (NEXTENT_INLINE + NEXTENT_BLOCK)
+
+// 散列目录格式（dinode.flags 含 DI_HASHDIR）：目录由 DIRHASH_BUCKETS 个桶块组成（均为直接块，
+// 未使用的桶是空洞），目录项按名称散列到桶中，查找通常只读一个块。
+// 每个桶的第 0 个目录项槽位为桶头（inum 恒为 0），name[0] 非 0 表示有目录项顺延到了后面的桶。
+#define DI_HASHDIR      0x2
+#define DIRHASH_BUCKETS NDIRECT
+
+// 内联格式（dinode.flags 含 DI_INLINE）：不超过 INLINE_MAX 字节的普通文件与符号链接把内容
+// 直接存放在 addrs 中，不占数据块；写入超过 INLINE_MAX 时转换为块格式（见 fs.c 的 disk_writei）
+#define DI_INLINE       0x4
+#define INLINE_MAX      ((NDIRECT + 2) * sizeof(uint32))
+
+// 共享块（dinode.flags 含 DI_SHARED）：文件经 clone_file 与其他文件共享数据块，改写某块前
+// 须查引用计数，共享的块先复制到新块（写时复制，见 fs.c 的 disk_writei）。只是提示，
+// 截断到空时清除；其余文件的数据块引用计数总为 0，写入时不必查
+#define DI_SHARED       0x8
+
+// 超级块 features 位：FS_FEAT_EXTENTS 表示新建的普通文件使用区段格式（mkfs -e），
+// FS_FEAT_HASHDIR 表示新建的目录使用散列格式（mkfs -H），
+// FS_FEAT_ASYNC 表示以异步提交模式挂载（mkfs -a，见 log.c），
+// FS_FEAT_GROUPS 表示按块组分配（mkfs -g，几何参数见超级块），
+// FS_FEAT_INLINE 表示新建的普通文件与符号链接先使用内联格式（mkfs -I），
+// FS_FEAT_ORDERED 表示以顺序数据模式挂载：普通文件的数据块不进日志（mkfs -o，见 log.c），
+// FS_FEAT_REFLINK 表示带有块引用计数区，支持 clone_file 共享数据块（mkfs -r）
+#define FS_FEAT_EXTENTS 0x1
+#define FS_FEAT_HASHDIR 0x2
+#define FS_FEAT_ASYNC   0x4
+#define FS_FEAT_GROUPS  0x8
+#define FS_FEAT_INLINE  0x10
+#define FS_FEAT_ORDERED 0x20
+#define FS_FEAT_REFLINK 0x40
+
+// 块引用计数区（FS_FEAT_REFLINK）：mkfs 在数据区开头预留的 nref 块，每个块号一个字节，
+// 记录除第一个拥有者之外还有几个文件引用该块，0 表示未共享。计数至多 REF_MAX，
+// 达到上限的块不能再被克隆。REFBLOCK 把块号映射到存放其计数的块
+#define REF_MAX 255
+#define REFBLOCK(b, sb) ((b) / BLOCK_SIZE + (sb).refstart)
+
+// 块组：inode 号与数据区各自等分成 ngroups 段，第 g 组拥有 inode [g * ipg, (g + 1) * ipg)
+// （inode 表中连续的 ipg / IPB 块）与数据块 [SB_DATASTART + g * bpg, SB_DATASTART + (g + 1) * bpg)
+// （位图中对应的一段）。磁盘布局不变，分组只影响内核挑选 inode 与数据块的位置
+#define FS_MAX_GROUPS 64
+
+// 超级块中孤儿表的槽数：最后一个引用放开时尚未释放的已删除 inode 记录在这里，
+// 由后台线程分批释放，崩溃后下次挂载时继续
+#define FS_NORPHAN 32
+
+// BPB: bitmap 中一个磁盘块能描述的数据块数量；每比特对应一个数据块。
+// IPB: 单个磁盘块能容纳的 dinode 数量。
+#define BPB (BLOCK_SIZE * 8)
+#define IPB (BLOCK_SIZE / sizeof(struct dinode))
+
+// IBLOCK/BBLOCK: 将 inode 号或数据块号映射到对应的磁盘块。
+#define IBLOCK(i, sb) ((i) / IPB + (sb).inodestart)
+#define BBLOCK(b, sb) ((b) / BPB + (sb).bmapstart)
+
+// 磁盘对象的类型定义，用于 dinode->type。
+#define T_DIR   1
+#define T_FILE  2
+#define T_DEV   3
+#define T_SYMLINK 4
+
+// DIRSIZ: 目录项中文件名的最大长度（不含结尾 NULL）。
+#define DIRSIZ 14
+
+// 磁盘上的索引节点结构。该结构直接写入磁盘，因此需要保持紧凑，
+// 并与 kernel/fs/fs.c 中的读写逻辑完全一致。
+struct dinode {
+    short type;                   // 类型：0 表示空闲；T_DIR/T_FILE/T_DEV/T_SYMLINK 表示有效。
+    short major;                  // 设备主编号，仅对 T_DEV 类型有效。
+    short minor;                  // 设备次编号，尚未使用但保留接口一致性。
+    short nlink;                  // 指向该 inode 的目录项数量（硬链接计数）。
+    uint32 size;                  // 文件当前字节长度。
+    uint32 flags;                 // DI_* 标志，决定 addrs 的解释方式。
+    uint32 addrs[NDIRECT + 2];    // 数据块指针：直接块 + 一级间接块 + 二级间接块，或区段。
+};
+
+// 区段：从逻辑块 lblk 起的 len 块依次对应物理块 pblk 起的 len 块。
+struct extent {
+    uint32 lblk;
+    uint32 pblk;
+    uint32 len;
+};
+
+// 超级块记录整体文件系统元数据，fs_init 会将其读入 sb 全局变量。
+struct superblock {
+    uint32 magic;                 // 魔数：校验该磁盘块是否为预期的文件系统。
+    uint32 size;                  // 文件系统包含的磁盘块总数。
+    uint32 nblocks;               // 数据区块数量（不含元数据区）。
+    uint32 ninodes;               // inode 总数，用于越界检查。
+    uint32 nlog;                  // 日志块数量，由 mkfs 决定。
+    uint32 logstart;              // 日志区起始块号。
+    uint32 inodestart;            // inode 表起始块号。
+    uint32 bmapstart;             // 位图区起始块号。
+    uint32 features;              // FS_FEAT_* 可选特性。
+    uint32 ngroups;               // 块组数（FS_FEAT_GROUPS），1 ~ FS_MAX_GROUPS。
+    uint32 ipg;                   // 每组的 inode 数，为 IPB 的倍数。
+    uint32 bpg;                   // 每组的数据块数，最后一组可能不满。
+    uint32 swapstart;             // 交换区起始块号（mkfs -w），紧随文件系统的 size 块之后。
+    uint32 nswap;                 // 交换区块数，0 表示没有交换区。
+    uint32 refstart;              // 块引用计数区起始块号（FS_FEAT_REFLINK），位于数据区开头。
+    uint32 nref;                  // 引用计数区块数，覆盖全部 size 个块号。
+    uint32 orphan[FS_NORPHAN];    // 孤儿表：已删除、等待后台回收的 inode 号，0 表示空槽（见 fs.c 的 iput）。
+};
+
+// 数据区起始块号：紧随位图区，位图块数由总块数决定
+#define SB_DATASTART(sb) ((sb).bmapstart + (sb).size / BPB + 1)
+
+// 目录项：将文件名映射到 inode 号。未使用的目录项 inum 为 0。
+struct dirent {
+    uint16 inum;                  // 目标 inode 号，为 0 表示目录槽位空闲。
+    char name[DIRSIZ];            // 固定长度文件名，若不足 DIRSIZ 以 \0 填充。
+};
+
+// 散列目录的桶号：FNV-1a，至多 DIRSIZ 个字符。mkfs 按它放置根目录的目录项，
+// 因此两边必须使用同一份实现。
+static inline uint32 dirhash(const char *name)
+{
+    uint32 h = 2166136261u;
+    for(int i = 0; i < DIRSIZ && name[i]; i++)
+        h = (h ^ (uchar)name[i]) * 16777619u;
+    return h % DIRHASH_BUCKETS;
+}
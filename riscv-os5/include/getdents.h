@@ -0,0 +1,13 @@
+#pragma once
+
+// getdents 写回的目录项，内核与用户态共用。
+// 每项定长，空闲的目录槽被跳过；type/nlink/size 只在传入 GETDENTS_STAT 时填写，否则为 0
+#define GETDENTS_STAT 0x1   // 顺带取每一项的 inode 类型、链接数与大小
+
+struct dirent_info {
+    unsigned int inum;
+    short type;             // T_DIR/T_FILE/T_DEV/T_SYMLINK
+    short nlink;
+    unsigned int size;
+    char name[16];          // 至多 DIRSIZ 个字符，以 NUL 结尾
+};
@@ -0,0 +1,42 @@
+#ifndef HRTIMER_H
+#define HRTIMER_H
+
+#include "types.h"
+#include "trap.h"
+
+// 高精度定时器：到期时间是 time CSR 的绝对值，而不是 ticks，精度只受时钟中断延迟限制。
+// ktimer 的时间轮按 tick 推进，适合以 tick 计的超时；不足一个 tick 的睡眠与超时用 hrtimer。
+// timer_reprogram 把 stimecmp 设为时间片末尾、最早的 ktimer 与最早的 hrtimer 三者中最早的一个，
+// 因此 tick 记账只是它的一个使用者。用法与 ktimer 相同：结构由调用者提供（可以放在栈上），
+// 回调在时钟中断的下半部中执行，不持有定时器锁，不能睡眠。
+struct hrtimer {
+  uint64 expires;               // 到期的 time 值
+  void (*fn)(void *arg);        // 到期回调
+  void *arg;
+  int pending;                  // 已挂入队列且尚未到期
+  struct hrtimer *next;
+  struct hrtimer **pprev;
+};
+
+#define TIME_PER_US  (TIMEBASE_FREQ / 1000000)          // 每微秒的 time 计数
+#define NS_PER_TIME  (1000000000 / TIMEBASE_FREQ)       // 每个 time 计数的纳秒数
+#define TICK_US      (TICK_INTERVAL / TIME_PER_US)      // 每个 tick 的微秒数
+
+// 相对时长换算为 time 计数，向上取整，保证不会提前到期
+static inline uint64 ns_to_time(uint64 ns)
+{
+  return ns / NS_PER_TIME + (ns % NS_PER_TIME != 0);
+}
+
+static inline uint64 us_to_time(uint64 us)
+{
+  return us * TIME_PER_US;
+}
+
+void hrtimer_init(void);
+void hrtimer_start(struct hrtimer *t, uint64 expires, void (*fn)(void *), void *arg);
+int hrtimer_cancel(struct hrtimer *t);   // 定时器尚未到期时摘除并返回 1，否则返回 0
+void hrtimer_run(uint64 now);            // 时钟中断下半部调用：处理截至 now 的全部到期定时器
+int hrtimer_next(uint64 *expires);       // 最早的到期时间，没有定时器时返回 0
+
+#endif
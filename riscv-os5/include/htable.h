@@ -0,0 +1,70 @@
+#pragma once
+
+#include "types.h"
+#include "spinlock.h"
+
+// 通用散列表：侵入式链表，节点 struct hnode 嵌在被索引的对象中，表本身不分配节点。
+// 桶数组按负载翻倍扩容，桶数始终为 2 的幂。锁按条带划分：散列值的低位选出
+// HTABLE_NLOCKS 把锁之一，由于桶数不小于条带数，同一桶的节点总落在同一把锁下，
+// 扩容前后都是如此；扩容时依次取得全部条带锁，期间所有查找等待。
+//
+// 用法：h = 键的散列值；htable_lock(t, h) 之后遍历 *htable_bucket(t, h)，
+// 按需 htable_add / htable_del，最后 htable_unlock(t, h)。同一时刻只能持有一张表的一把条带锁；
+// htable_unlock 可能扩容（分配内存并取得全部条带锁），调用时不应持有其他自旋锁。
+
+#define HTABLE_NLOCKS 32          // 条带锁个数，2 的幂
+#define HTABLE_MAX_PAGES 16       // 桶数组至多占用的连续页数
+
+struct hnode {
+  struct hnode *next;
+  uint64 hash;                    // 插入时的散列值，扩容时据此重新分桶
+};
+
+struct htable {
+  struct spinlock locks[HTABLE_NLOCKS];
+  struct hnode **buckets;
+  uint64 mask;                    // 桶数 - 1
+  int pages;                      // 桶数组占用的页数
+  int count;                      // 节点数，原子更新
+  int growing;                    // 正在扩容
+  int max_pages;                  // 扩容上限，分配不到连续页后降为当前大小
+};
+
+#define hnode_entry(n, type, member) ((type *)((char *)(n) - __builtin_offsetof(type, member)))
+
+// 64 位整数的散列（murmur3 的 fmix64），低位与高位都充分混合，可以直接按位取桶
+static inline uint64 hash64(uint64 v)
+{
+  v ^= v >> 33;
+  v *= 0xff51afd7ed558ccdULL;
+  v ^= v >> 33;
+  v *= 0xc4ceb9fe1a85ec53ULL;
+  v ^= v >> 33;
+  return v;
+}
+
+static inline uint64 hash_pair(uint64 a, uint64 b)
+{
+  return hash64(a * 0x9e3779b97f4a7c15ULL + b);
+}
+
+// 至多 n 个字符、遇 '\0' 结束的字符串散列（FNV-1a，再经 hash64 混合低位）
+static inline uint64 hash_str(const char *s, int n)
+{
+  uint64 h = 0xcbf29ce484222325ULL;
+  for(int i = 0; i < n && s[i]; i++) {
+    h ^= (uchar)s[i];
+    h *= 0x100000001b3ULL;
+  }
+  return hash64(h);
+}
+
+int htable_init(struct htable *t, char *name);   // 分配一页桶数组，内存不足时返回 -1
+void htable_lock(struct htable *t, uint64 hash);
+void htable_unlock(struct htable *t, uint64 hash);
+// 以下在持有 hash 的条带锁时调用
+struct hnode **htable_bucket(struct htable *t, uint64 hash);
+void htable_add(struct htable *t, uint64 hash, struct hnode *n);
+void htable_del(struct htable *t, struct hnode *n);
+
+void test_htable(void);   // KTEST=1 时由内核测试任务调用
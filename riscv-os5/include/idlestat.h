@@ -0,0 +1,13 @@
+#pragma once
+
+// 空闲统计，内核与用户态共用。时间均为 get_time 单位（time CSR 计数）。
+
+// idlestat 返回的一项，每个 hart 一项。调度器无进程可运行时进入一次空闲：
+// 先在轮询窗口内忙等就绪队列，窗口内等到新进程记为一次命中，否则执行 wfi 直到下一次中断
+struct idle_stat {
+    unsigned long idle_entries;  // 进入空闲的次数
+    unsigned long poll_hits;     // 轮询窗口内等到进程的次数
+    unsigned long wfi_entries;   // 轮询落空后执行 wfi 的次数
+    unsigned long poll_time;     // 累计轮询时间
+    unsigned long wfi_time;      // 累计 wfi 驻留时间（含唤醒它的中断的处理时间）
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+// iostat 返回的进程 I/O 统计，内核与用户态共用。
+// 各项都记在发起操作的进程上：块缓存的命中与换入、提交给块设备的块由当时的 myproc() 承担，
+// 日志提交与检查点写回则计入执行提交的进程（或日志线程），不再按事务中的各个写者拆分
+#define IOSTAT_SELF     0
+#define IOSTAT_CHILDREN (-1)   // 已回收的子进程及其已回收后代的累计
+
+struct proc_iostat {
+    unsigned long rchar;          // 经 read/readv/pread/sendfile 读出的字节数（含管道与设备）
+    unsigned long wchar;          // 经 write/writev/pwrite/sendfile 写入的字节数
+    unsigned long cache_hits;     // 块缓存命中次数
+    unsigned long cache_misses;   // 块缓存未命中、换入缓存块的次数
+    unsigned long read_blocks;    // 提交给块设备读取的块数（含预读、直接 I/O 与换入）
+    unsigned long write_blocks;   // 提交给块设备写入的块数（含日志提交、检查点与换出）
+    unsigned long log_blocks;     // 记入日志的块数，同一事务中重复修改的块只计一次
+    unsigned long iowait;         // 等待块设备完成的时间（get_time 单位）
+};
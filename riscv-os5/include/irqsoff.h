@@ -0,0 +1,24 @@
+#pragma once
+
+#include "types.h"
+
+// 关中断时延跟踪（irqsoff）：为 1 时 push_off/pop_off 记录每段最外层关中断区间
+// （进入前中断是开着的）的长度与两端的调用者地址，每个 hart 保留最长的 IRQSOFF_TOP 段。
+// 缺省为 0，相关代码全部编译掉；由 Makefile 的 IRQSOFF_TRACE 开启
+#ifndef IRQSOFF_TRACE
+#define IRQSOFF_TRACE 0
+#endif
+
+#define IRQSOFF_TOP 8
+
+struct irqsoff_rec {
+  uint64 len;        // 关中断的时长（get_time() 计数）
+  uint64 begin_ra;   // 关中断的调用者（acquire 或 push_off 的返回地址）
+  uint64 end_ra;     // 重新开中断的调用者
+};
+
+#if IRQSOFF_TRACE
+void irqsoff_record(uint64 len, uint64 begin_ra, uint64 end_ra);
+#endif
+void irqsoff_dump(void);
+void irqsoff_reset(void);
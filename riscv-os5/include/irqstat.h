@@ -0,0 +1,16 @@
+#pragma once
+
+// 中断统计，内核与用户态共用。时间均为 get_time 单位（time CSR 计数）。
+
+#define IRQSTAT_NAMELEN 16
+
+// irqstat 返回的一项：CPU 中断（"timer"、"ipi"、"external"）的处理函数耗时，
+// PLIC 各中断源（驱动登记的名称）的处理函数耗时，以及下半部（"softirq" 为中断返回时执行，
+// "ksoftirqd" 为交给内核线程执行）中每个工作项的耗时。
+// 可嵌套中断的耗时包含期间嵌套进来的其他中断；"external" 包含其下各 PLIC 中断源
+struct irq_stat {
+    char name[IRQSTAT_NAMELEN];
+    unsigned long count;       // 次数
+    unsigned long time_total;  // 累计耗时
+    unsigned long time_max;    // 单次最长耗时
+};
@@ -1,8 +1,24 @@
 void pmm_init(void);
 void* alloc_page(void);
+void* alloc_page_nozero(void);
+void* alloc_page_movable(void);          // 只经 rmap 登记的用户映射引用的匿名页，可能借用 CMA 区
+void* alloc_page_movable_nozero(void);
 void free_page(void *page);
+void free_page_bulk(void **pages, int n);   // 批量放弃引用，pages[] 会被改写
 void* alloc_pages(int n);
+void free_pages(void *page, int n);
 void page_incref(void *page);
 int page_decref(void *page);
 int page_refcount(void *page);
+void pmm_stats(void);
+struct meminfo;
+void pmm_meminfo(struct meminfo *mi);
+int pmm_idle_zero(void);
+int pmm_idle_reclaim(void);
+int pmm_low_memory(void);
+unsigned long pmm_alloc_failures(void);
+int pmm_idle_compact(void);
+int pmm_compact(int order);
+void* cma_alloc(int n);                  // 从 CMA 区分配 n 个物理连续的清零页，用于 DMA 缓冲
+void cma_free(void *page, int n);
 
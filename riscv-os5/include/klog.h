@@ -34,8 +34,38 @@ void klog_log(klog_level_t level, const char *fmt, ...);
 // 将当前缓冲区内的日志按时间顺序打印到控制台，便于人工快速查看。
 void klog_dump(void);
 
+// klog 设备的读回调：按打开实例各自的游标增量读取日志文本，注册在 devsw[KLOG]。
+struct file;
+int klogread(struct file *f, int user_dst, uint64 dst, int n);
+
+// 当前的记录阈值，供便捷宏在调用 klog_log 之前判断，级别未开启时不求值参数。
+extern klog_level_t klog_record_level;
+
+// 编译期保留的最低级别（取 KLOG_LEVEL_* 对应的数值）：更低级别的便捷宏展开为空语句，
+// 参数仍参与类型检查但不生成代码。例如 -DKLOG_COMPILE_LEVEL=2 去掉全部 DEBUG 日志。
+#ifndef KLOG_COMPILE_LEVEL
+#define KLOG_COMPILE_LEVEL 3
+#endif
+
+#define KLOG_AT(level, ...) \
+  do { if((level) <= klog_record_level) klog_log((level), __VA_ARGS__); } while(0)
+#define KLOG_OFF(level, ...) \
+  do { if(0) klog_log((level), __VA_ARGS__); } while(0)
+
 // 便捷宏：在代码中直接使用，自动填充日志级别参数。
-#define klog_error(...) klog_log(KLOG_LEVEL_ERROR, __VA_ARGS__)
-#define klog_warn(...)  klog_log(KLOG_LEVEL_WARN,  __VA_ARGS__)
-#define klog_info(...)  klog_log(KLOG_LEVEL_INFO,  __VA_ARGS__)
-#define klog_debug(...) klog_log(KLOG_LEVEL_DEBUG, __VA_ARGS__)
+#define klog_error(...) KLOG_AT(KLOG_LEVEL_ERROR, __VA_ARGS__)
+#if KLOG_COMPILE_LEVEL >= 1
+#define klog_warn(...)  KLOG_AT(KLOG_LEVEL_WARN,  __VA_ARGS__)
+#else
+#define klog_warn(...)  KLOG_OFF(KLOG_LEVEL_WARN,  __VA_ARGS__)
+#endif
+#if KLOG_COMPILE_LEVEL >= 2
+#define klog_info(...)  KLOG_AT(KLOG_LEVEL_INFO,  __VA_ARGS__)
+#else
+#define klog_info(...)  KLOG_OFF(KLOG_LEVEL_INFO,  __VA_ARGS__)
+#endif
+#if KLOG_COMPILE_LEVEL >= 3
+#define klog_debug(...) KLOG_AT(KLOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define klog_debug(...) KLOG_OFF(KLOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
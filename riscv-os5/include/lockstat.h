@@ -0,0 +1,27 @@
+#pragma once
+
+// 锁竞争统计（lock_stat）：为 1 时 acquire/release 与 acquiresleep/releasesleep
+// 记录获取次数、竞争次数、自旋轮数与持有时间，置 0 则相关字段与代码全部编译掉。
+#define LOCKSTAT 1
+
+// 统计按锁名归类：同名的锁（如各个 inode、各个缓冲块的睡眠锁）合并到一类。
+// 计数放在类中而不在锁里，锁本身可以随时消失（栈上的信号量、销毁的 slab 缓存）
+// 而登记表不会留下悬挂指针。时间单位为 get_time()（time CSR 计数）。
+struct lock_class {
+  const char *name;     // 锁名，为 0 表示槽位空闲
+  int sleep;            // 1 表示睡眠锁
+  uint64 acquisitions;  // 获取次数
+  uint64 contended;     // 获取时锁已被占用的次数
+  uint64 spins;         // 自旋锁为等待期间重读票号的轮数，睡眠锁为自适应自旋的轮数
+  uint64 sleeps;        // 睡眠锁因等待而睡眠的次数
+  uint64 hold_total;    // 累计持有时间
+  uint64 hold_max;      // 单次最长持有时间
+};
+
+#if LOCKSTAT
+struct lock_class *lockstat_class(const char *name, int sleep);
+void lockstat_acquired(struct lock_class *c, int contended, uint64 spins);
+void lockstat_released(struct lock_class *c, uint64 held);
+#endif
+void lockstat_dump(void);
+void lockstat_reset(void);
@@ -0,0 +1,5 @@
+#pragma once
+
+// lockstat 系统调用的 flags，内核与用户态共用
+#define LOCKSTAT_RESET   0x1   // 输出后清零对应的统计
+#define LOCKSTAT_IRQSOFF 0x2   // 输出最长的关中断区间（写入 klog），而不是锁竞争统计
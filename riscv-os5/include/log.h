@@ -6,13 +6,28 @@
 
 struct buf;
 
-// 单次事务最多允许保留的块数量，与 LOG_SIZE 配合可粗略估算事务上限
+// 单个操作最多允许写入的块数量，begin_transaction 按此为每个操作预留日志空间
 #define MAX_OP_BLOCKS 10
 
+// unlink 自身最多写入的不同块数：父目录的目录项块与 inode 块、目标 inode 块。
+// 目标随之被释放时由 iput 在操作结束后另行开启操作；重复写入同一块只占一个日志槽
+#define LOG_OP_UNLINK 3
+
 void log_init(int dev, struct superblock *sb);
 void begin_transaction(void);
 void end_transaction(void);
+void begin_transaction_blocks(int blocks);
+void begin_transaction_n(int nops);
+void end_transaction_n(int nops);
+int in_transaction(void);
+int log_max_ops(void);
 void log_block_write(struct buf *bp);
+void log_data_write(struct buf *bp);   // 普通文件的数据块：顺序数据模式下不进日志，提交前写回原位置
+int log_ordered(void);                 // 是否以顺序数据模式挂载（FS_FEAT_ORDERED）
+uint64 log_open_seq(void);             // 调用者所在事务的序号
+int log_seq_durable(uint64 seq);       // 该事务的头部是否已落盘
+void log_force(void);
 void recover_log(void);
+void log_start_flusher(void);
 
 extern int crash_stage;
@@ -0,0 +1,34 @@
+#pragma once
+
+// meminfo 系统调用返回的内存统计信息，内核与用户态共用。
+// 字段均为 unsigned long（即内核的 uint64），页数以 4KB 为单位。
+struct meminfo {
+    unsigned long total_pages;       // 可管理的物理页总数
+    unsigned long free_pages;        // 空闲页（含各 hart 缓存、预清零池与 CMA 区中的空闲页）
+    unsigned long shared_pages;      // 引用计数大于 1 的页（COW 共享、共享映射、共享页表）
+    unsigned long pagetable_pages;   // 当前用作页表的页数（内核与全部用户页表）
+    unsigned long largest_free_run;  // 伙伴系统中最长的连续空闲页数，反映碎片程度
+    unsigned long rss_pages;         // 目标进程已映射的用户页数（大页按 512 页计）
+    unsigned long cow_faults;        // 启动以来处理的写时复制缺页次数（cow_reused + cow_copied）
+    unsigned long cow_reused;        // 其中页面只剩当前映射者、原地恢复写权限而免去拷贝的次数
+    unsigned long cow_copied;        // 其中需要分配新页并拷贝的次数
+    unsigned long lazy_faults;       // 启动以来按需分配（堆/BSS/mmap）的缺页次数
+    unsigned long zero_page_faults;  // 读缺页只映射共享零页、没有分配新页的次数
+    unsigned long alloc_failures;    // alloc_page/alloc_pages 失败次数
+    unsigned long zero_fill_time;    // 分配路径上同步清零耗费的时间（get_time 单位）
+    unsigned long idle_zeroed_pages; // 空闲循环提前清零的页数
+    unsigned long compact_runs;      // 内存规整的次数
+    unsigned long compact_success;   // 其中凑出目标阶空闲块的次数
+    unsigned long compact_moved;     // 规整迁移的用户页数
+    unsigned long compact_time;      // 规整耗费的时间（get_time 单位），期间其他 hart 停顿
+    unsigned long swap_total;        // 交换区槽数（一槽一页），0 表示没有交换区
+    unsigned long swap_free;         // 空闲槽数
+    unsigned long swap_outs;         // 启动以来换出的页数
+    unsigned long swap_ins;          // 启动以来换入的页数
+    unsigned long cma_total;         // 连续内存区（CMA）的页数，0 表示没有预留
+    unsigned long cma_free;          // 其中既未分给设备也未借出的页数
+    unsigned long cma_dma;           // 其中经 cma_alloc 分给设备缓冲的页数
+    unsigned long cma_lent;          // 其中借给可迁移用户页的页数
+    unsigned long cma_migrated;      // cma_alloc 为腾出区间迁走的借出页数
+    unsigned long cma_failures;      // cma_alloc 失败次数
+};
@@ -1,26 +1,73 @@
 #define UART0   0x10000000L
+#define UART0_IRQ   10
 #define VIRTIO0 0x10001000L
+#define VIRTIO0_IRQ 1
+#define VIRTIO1 0x10002000L   // virtio-net（virtio-mmio-bus.1）
+#define VIRTIO1_IRQ 2
+
+// QEMU virt 的 sifive_test 设备：写入 VIRT_TEST_PASS 关机，写入 (code << 16) | VIRT_TEST_FAIL
+// 以退出码 code 结束 QEMU。没有 SBI 固件（-bios none），用它代替 SBI 的系统复位扩展
+#define VIRT_TEST 0x100000L
+#define VIRT_TEST_PASS 0x5555
+#define VIRT_TEST_FAIL 0x3333
+
+// PLIC（平台级中断控制器），QEMU virt 平台的布局。每个 hart 的 S 模式各有一个上下文：
+// 使能位、优先级阈值与 claim/complete 寄存器
+#define PLIC 0x0c000000L
+#define PLIC_SIZE 0x400000L
+#define PLIC_PRIORITY (PLIC + 0x0)
+#define PLIC_PENDING (PLIC + 0x1000)
+#define PLIC_SENABLE(hart) (PLIC + 0x2080 + (hart) * 0x100)
+#define PLIC_SPRIORITY(hart) (PLIC + 0x201000 + (hart) * 0x2000)
+#define PLIC_SCLAIM(hart) (PLIC + 0x201004 + (hart) * 0x2000)
+
+// ACLINT SSWI（QEMU virt 以 aclint=on 启用）：向 hart 对应的 4 字节寄存器写 1，
+// 即在该 hart 上置起 S 态软件中断挂起位 SSIP，用作核间中断
+#define SSWI 0x2F00000L
+#define SSWI_SETSSIP(hart) (SSWI + 4 * (hart))
 
 // 内核预期RAM可用于内核和用户页面
 // 从物理地址0x80000000到PHYSTOP
 #define KERNBASE 0x80000000L // 内核起始物理地址
 #define PHYSTOP (KERNBASE + 128*1024*1024) // 内核可用物理内存上限(假设128MB内存)
 
+// RAMDISK=1 时根文件系统镜像所在的内存：紧接在 PHYSTOP 之上，不归页分配器管理，
+// QEMU 为此多分配内存（见 Makefile）。RAMDISK_BLOCKS 为镜像的块数
+#if RAMDISK
+#define RAMDISK_BASE PHYSTOP
+#define RAMDISK_SIZE ((uint64)RAMDISK_BLOCKS * 4096)
+#endif
+
 // 将 trampoline 页面映射到用户和内核空间的最高虚拟地址处。
 // trampoline 用于用户态和内核态切换（如系统调用返回）。
 #define TRAMPOLINE (MAXVA - PGSIZE)
 
-// 在 trampoline 页面之下为每个进程分配内核栈，
-// 每个内核栈之间用无效的保护页隔开，防止栈溢出。
-// KSTACK(p) 计算第 p 个进程的内核栈虚拟地址。
-#define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
-
 // 用户内存布局（从地址 0 开始）：
 //   - 代码段（text）
 //   - 初始数据和 bss 段
 //   - 固定大小的用户栈
-//   - 可扩展的堆
+//   - 可扩展的堆（不超过 ULIB_TEXT）
+//   - 共享运行库的代码与数据（[ULIB_TEXT, 2GB)，见 ulibrt.h）
 //   - ...
+//   - mmap 映射区（从 MMAP_BASE 向上分配，不超过 MMAP_END）
+//   - 线程陷阱帧槽位（clone 创建的线程各占一页）
 //   - TRAPFRAME（用于保存用户寄存器，供 trampoline 使用）
 //   - TRAMPOLINE（与内核空间共享的 trampoline 页面）
-#define TRAPFRAME (TRAMPOLINE - PGSIZE)
\ No newline at end of file
+#define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// 共享运行库的起点，必须在程序代码 ±2GB 之内（见 ulibrt.h），sbrk 堆不能越过它
+#define ULIB_TEXT (0x80000000UL - 2 * 1024 * 1024)
+
+// mmap 映射区起点：取用户地址空间的中点，sbrk 堆与映射区互不重叠
+#define MMAP_BASE (MAXVA / 2)
+
+// 同一地址空间中的线程各有一页陷阱帧，按线程组内分配的槽位编号 i 放在 TRAPFRAME 之下，
+// 槽位数即每个线程组的线程上限。线程组组长仍使用 TRAPFRAME
+#define NTRAPFRAME_SLOT 64
+#define TRAPFRAME_SLOT(i) (TRAPFRAME - ((uint64)(i) + 1) * PGSIZE)
+
+// 线程陷阱帧槽位之下是两页只读的 vDSO（VDSO_DATA_VA、VDSO_PROC_VA，定义见 vdso.h），
+// 再往下才是 mmap 映射区的上界
+#define VDSO_DATA TRAPFRAME_SLOT(NTRAPFRAME_SLOT)
+#define VDSO_PROC (VDSO_DATA - PGSIZE)
+#define MMAP_END VDSO_PROC
\ No newline at end of file
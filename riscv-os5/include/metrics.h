@@ -0,0 +1,52 @@
+#pragma once
+
+#include "types.h"
+#include "percpu.h"
+#include "metricstat.h"
+
+// 指标登记表：各子系统在初始化时登记命名的计数器、瞬时值与直方图，
+// metrics_read 系统调用按登记顺序一次读出全部指标的快照。
+// 指标的存储为每 hart 一份（pcpu_counter / pcpu_hist），更新不争抢缓存行；
+// 子系统已有的统计不必迁移，登记一个 read 回调在读取时换算即可。
+
+// 每 hart 一行的 log2 直方图，更新与 pcpu_counter 一样用不排序的 amoadd
+struct pcpu_hist {
+  struct {
+    volatile uint64 sum;
+    volatile uint64 b[METRIC_HIST_BUCKETS];
+  } __attribute__((aligned(CACHELINE))) slot[NCPU];
+};
+
+static inline int metric_bucket(uint64 v)
+{
+  int b = 0;
+  while(v > 1 && b < METRIC_HIST_BUCKETS - 1) {
+    v >>= 1;
+    b++;
+  }
+  return b;
+}
+
+static inline void pcpu_hist_add(struct pcpu_hist *h, uint64 v)
+{
+  int cpu = r_tp();
+  atomic_fetch_add64(&h->slot[cpu].b[metric_bucket(v)], 1);
+  atomic_fetch_add64(&h->slot[cpu].sum, v);
+}
+
+// 一个指标。counter、hist、read 三者给出其一：COUNTER/GAUGE 取 counter 各 hart 之和，
+// HIST 汇总 hist 各 hart 的行，都没有时调用 read 填写 value（直方图还要填 sum 与 buckets）
+struct metric {
+  const char *name;
+  int kind;                              // METRIC_COUNTER / METRIC_GAUGE / METRIC_HIST
+  struct pcpu_counter *counter;
+  struct pcpu_hist *hist;
+  void (*read)(struct metric_stat *st);  // 调用时 st 已清零、填好 name 与 kind
+  struct metric *next;                   // 登记表链，由 metrics_register 填写
+};
+
+// 登记 n 个指标，可在任何初始化阶段调用（不依赖锁），指标须一直有效，不支持注销
+void metrics_register(struct metric *m, int n);
+#define METRICS_REGISTER(arr) metrics_register(arr, (int)(sizeof(arr) / sizeof((arr)[0])))
+// 把前至多 n 项指标的快照复制到当前进程的用户地址 addr，返回复制的项数，地址无效时返回 -1
+int metrics_read(uint64 addr, int n);
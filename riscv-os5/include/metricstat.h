@@ -0,0 +1,21 @@
+#pragma once
+
+// 内核指标快照，内核与用户态共用。时间均为 get_time 单位（time CSR 计数）。
+
+#define METRIC_NAMELEN 24
+#define METRIC_HIST_BUCKETS 32
+
+#define METRIC_COUNTER 1   // 只增不减的累计值
+#define METRIC_GAUGE   2   // 读取时刻的瞬时值
+#define METRIC_HIST    3   // log2 分桶的直方图
+
+// metrics_read 返回的一项，按登记顺序排列。名称形如 "子系统.指标"（"bio.hits"、"syscall.latency"）
+struct metric_stat {
+    char name[METRIC_NAMELEN];
+    unsigned int kind;
+    unsigned int pad;
+    unsigned long value;   // 计数器与瞬时值；直方图为样本数
+    unsigned long sum;     // 直方图的样本之和，其他为 0
+    // 直方图第 i 桶为 [2^i, 2^(i+1))，0 号桶包含 0，最后一桶包含更大的样本；其他为全零
+    unsigned long buckets[METRIC_HIST_BUCKETS];
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "types.h"
+
+// ================= 网络协议栈 =================
+// 以太网 + ARP + IPv4 + UDP 的最小实现，地址固定为 QEMU user 网络的默认配置。
+// 接收路径上数据包始终留在接收环提供的页中：协议栈在页尾记下包的元数据后
+// 把页挂到目标套接字的队列上，recvfrom 拷给用户后释放该页。
+// 发往本机地址（NET_IP 或 127.0.0.0/8）的包不经网卡，直接交给本机套接字。
+
+struct file;
+struct poll_table;
+struct sock;
+
+#define NET_IP      0x0a00020f   // 10.0.2.15
+#define NET_GATEWAY 0x0a000202   // 10.0.2.2
+#define NET_MASK    0xffffff00
+
+#define ETH_ALEN     6
+#define ETH_TYPE_IP  0x0800
+#define ETH_TYPE_ARP 0x0806
+#define IP_PROTO_UDP 17
+
+struct eth_hdr {
+    uint8 dst[ETH_ALEN];
+    uint8 src[ETH_ALEN];
+    uint16 type;
+} __attribute__((packed));
+
+struct arp_hdr {
+    uint16 hrd;          // 硬件类型，以太网为 1
+    uint16 pro;          // 协议类型，IPv4 为 0x0800
+    uint8 hln;
+    uint8 pln;
+    uint16 op;           // 1 请求，2 应答
+    uint8 sha[ETH_ALEN];
+    uint32 sip;
+    uint8 tha[ETH_ALEN];
+    uint32 tip;
+} __attribute__((packed));
+
+struct ip_hdr {
+    uint8 vhl;           // 版本（高 4 位）与首部长度（低 4 位，单位 4 字节）
+    uint8 tos;
+    uint16 len;
+    uint16 id;
+    uint16 off;
+    uint8 ttl;
+    uint8 proto;
+    uint16 sum;
+    uint32 src;
+    uint32 dst;
+} __attribute__((packed));
+
+struct udp_hdr {
+    uint16 sport;
+    uint16 dport;
+    uint16 len;
+    uint16 sum;          // IPv4 下可以为 0（不校验）
+} __attribute__((packed));
+
+#define ETH_MTU 1500
+#define UDP_MAX_PAYLOAD (ETH_MTU - sizeof(struct ip_hdr) - sizeof(struct udp_hdr))
+
+// 负载不小于该值且用户页都已驻留时直接发送用户页，否则拷进帧页
+#define NET_TX_ZC_MIN 512
+#define NET_TX_SEGS   2      // 一个 UDP 负载至多跨两页
+
+// virtio 网卡首部（未协商 VIRTIO_NET_F_MRG_RXBUF 与 VERSION_1 时为 10 字节）
+struct virtio_net_hdr {
+    uint8 flags;
+    uint8 gso_type;
+    uint16 hdr_len;
+    uint16 gso_size;
+    uint16 csum_start;
+    uint16 csum_offset;
+} __attribute__((packed));
+#define VIRTIO_NET_F_MAC 5
+
+// 接收缓冲区的可用长度：页尾留给 struct pktbuf
+#define NET_RX_BUFSIZE (4096 - 64)
+
+// 一段发送负载：物理地址与长度
+struct net_seg {
+    uint64 addr;
+    int len;
+};
+
+// 驱动接口（kernel/net/virtio_net.c）
+int virtio_net_init(uint8 *mac);
+int virtio_net_send(char *frame, int off, int len, struct net_seg *seg, int nseg, int nowait);
+void virtio_net_intr(void);
+
+// 协议栈（kernel/net/net.c）
+void net_init(void);
+void net_rx(char *page, int off, int len);   // 驱动交上来的一帧，页的所有权随之转交
+
+// 套接字
+int sockalloc(struct file **f, int domain, int type, int protocol);
+void sockclose(struct sock *so);
+int sockbind(struct sock *so, uint32 addr, uint16 port);
+int socksendto(struct sock *so, int user, uint64 addr, int n, uint32 dst, uint16 dport);
+int sockrecvfrom(struct sock *so, int user, uint64 addr, int n, int flags, uint32 *src, uint16 *sport);
+int sockpoll(struct sock *so, struct poll_table *pt);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "types.h"
+
+// 普通文件的页缓存：以 (dev, inum, 文件块号) 为键缓存整块数据，块大小等于页大小。
+// 写入仍经块缓存与日志落盘，同时直写已缓存的页，因此缓存页始终与文件内容一致、无需写回
+struct cpage {
+    uint32 dev;
+    uint32 inum;
+    uint32 lblk;             // 文件内的块号
+    char *data;              // 一页数据
+    int ref;                 // 正在拷贝或等待插入的使用者数，非 0 时不会被换出
+    int dead;                // 已失效，最后一个使用者放弃时释放
+    struct cpage *hnext;     // 散列链
+    struct cpage *lru_prev;  // LRU 链表，表头为最近使用
+    struct cpage *lru_next;
+};
+
+void pcache_init(void);
+struct cpage *pcache_lookup(uint32 dev, uint32 inum, uint32 lblk);
+struct cpage *pcache_alloc(uint32 dev, uint32 inum, uint32 lblk);
+struct cpage *pcache_insert(struct cpage *cp);
+void pcache_put(struct cpage *cp);
+void pcache_update(uint32 dev, uint32 inum, uint32 lblk, const char *data);
+int pcache_present(uint32 dev, uint32 inum, uint32 lblk);
+void pcache_invalidate(uint32 dev, uint32 inum);
+void pcache_clear(void);
+int pcache_reclaim(int target);
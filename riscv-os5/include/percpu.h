@@ -0,0 +1,46 @@
+#pragma once
+
+#include "types.h"
+#include "riscv.h"
+#include "atomic.h"
+
+#ifndef NCPU
+#define NCPU 1     // 与 proc.h 相同的默认值，实际由 Makefile 传入
+#endif
+
+// ================= 每 hart 计数器 =================
+// 统计计数器更新频繁而读取很少。每个 hart 只加自己那一格（各占一条缓存行，互不争抢），
+// 读取时把各格相加。更新用不排序的 amoadd：同一 hart 上被中断打断、或在进程上下文里读完
+// hart 编号后被迁移，都不会丢失计数。读到的和只是某一时刻附近的近似值。
+#define CACHELINE 64
+
+struct pcpu_counter {
+  struct {
+    volatile uint64 v;
+    char pad[CACHELINE - sizeof(uint64)];
+  } slot[NCPU];
+} __attribute__((aligned(CACHELINE)));
+
+static inline void pcpu_add(struct pcpu_counter *c, long n)
+{
+  atomic_fetch_add64(&c->slot[r_tp()].v, (uint64)n);
+}
+
+static inline void pcpu_inc(struct pcpu_counter *c) { pcpu_add(c, 1); }
+static inline void pcpu_dec(struct pcpu_counter *c) { pcpu_add(c, -1); }
+
+// 各 hart 之和；只做加减的计数器按无符号回绕相加，结果仍然正确
+static inline uint64 pcpu_read(struct pcpu_counter *c)
+{
+  uint64 sum = 0;
+  for(int i = 0; i < NCPU; i++)
+    sum += c->slot[i].v;
+  return sum;
+}
+
+// 清零，仅用于测试：与并发的更新之间没有同步
+static inline void pcpu_reset(struct pcpu_counter *c)
+{
+  for(int i = 0; i < NCPU; i++)
+    c->slot[i].v = 0;
+}
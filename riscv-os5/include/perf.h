@@ -0,0 +1,21 @@
+#pragma once
+
+// perf_read 返回的硬件性能计数，内核与用户态共用。
+// 进程切入时对本 hart 的计数器取样、切出时累加差值，因此也包含内核代该进程执行的部分。
+// hpm[i] 统计的事件由启动时 M 态写入 mhpmevent(3+i) 决定（见 start.c 的 perfinit），
+// 运行中不可更改：内核没有 SBI 固件，S 态无权改写事件选择寄存器
+#define PERF_SELF     0
+#define PERF_CHILDREN (-1)   // 已回收的子进程及其已回收后代的累计
+
+#define PERF_NHPM 3
+// QEMU 的事件编号（SBI PMU 规范的 cache 事件编码），依次对应 hpm[0..2]
+#define PERF_EVENT_DTLB_LOAD_MISS  0x10019
+#define PERF_EVENT_DTLB_STORE_MISS 0x1001B
+#define PERF_EVENT_ITLB_MISS       0x10021
+#define PERF_EVENT_NAMES { "dtlb_load_miss", "dtlb_store_miss", "itlb_miss" }
+
+struct perfcount {
+    unsigned long cycles;
+    unsigned long instret;
+    unsigned long hpm[PERF_NHPM];
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "types.h"
+
+struct file;
+struct pipe;
+struct poll_table;
+
+// 管道缓冲区为一整页的环形队列
+#define PIPESIZE 4096
+
+void pipeinit(void);
+int pipealloc(struct file **rf, struct file **wf);
+void pipeclose(struct pipe *pi, int writable);
+int piperead(struct pipe *pi, int user_dst, uint64 addr, int n);
+int pipewrite(struct pipe *pi, int user_src, uint64 addr, int n);
+int pipe_splice(struct pipe *pi, struct file *in, int n);
+int pipepoll(struct pipe *pi, int writable, struct poll_table *pt);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "types.h"
+
+// PLIC 外部中断控制器。设备驱动用 plic_register 登记自己的中断源，
+// S 模式外部中断到来时由 plic_intr 逐个 claim、分发并 complete
+#define PLIC_NSRC 32   // 支持的中断源个数（QEMU virt 的 UART 与 virtio 均在此范围内）
+
+void plic_init(void);
+void plic_inithart(void);
+void plic_register(int irq, const char *name, void (*handler)(void), int priority);
+void plic_intr(void);
+struct irq_stat;
+int plic_stat(int irq, struct irq_stat *st);   // 中断源 irq 的处理耗时，未登记时返回 -1
+void plic_stat_reset(void);
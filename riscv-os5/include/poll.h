@@ -0,0 +1,16 @@
+#pragma once
+
+// poll 的描述符与事件位（取值与 Linux 相同），内核与用户态共用
+#define NPOLLFD 64   // 单次调用的最大描述符数
+
+#define POLLIN   0x001   // 有数据可读（或读到文件结束）
+#define POLLOUT  0x004   // 可以写入而不阻塞
+#define POLLERR  0x008   // 出错，例如管道读端已全部关闭（只在 revents 中返回）
+#define POLLHUP  0x010   // 对端已关闭（只在 revents 中返回）
+#define POLLNVAL 0x020   // fd 不是打开的描述符（只在 revents 中返回）
+
+struct pollfd {
+    int fd;          // 负数表示忽略该项，revents 置 0
+    short events;    // 关心的事件
+    short revents;   // 内核返回的就绪事件
+};
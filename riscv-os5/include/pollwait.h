@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+
+// 内核中的 poll 等待机制。可等待对象（管道、控制台）各带一个 pollq，
+// poll 在首轮检查时把调用者登记到各对象的队列上，对象状态变化时调用
+// poll_notify 唤醒队列上的全部调用者，被唤醒者重新检查所有描述符。
+
+struct file;
+struct poll_table;
+
+// 对象队列上的一个登记项，位于 poll 调用者分配的页中
+struct poll_entry {
+  struct poll_entry *next;
+  struct poll_entry **pprev;
+  struct poll_table *pt;
+};
+
+// 可等待对象的等待队列，由 poll.c 中的全局锁保护
+struct pollq {
+  struct poll_entry *head;
+};
+
+// 一次 poll 调用的等待状态
+struct poll_table {
+  struct poll_entry *entries;   // 登记项数组
+  int nentries;
+  int max;
+  int ready;                    // 自上次检查以来有对象调用过 poll_notify
+  int expired;                  // 超时定时器已到期
+};
+
+void pollinit(void);
+// 把 pt 登记到 q 上，pt 为 0 时（非首轮检查）什么也不做。
+// 对象的 poll 回调应先登记、再在对象锁下检查状态
+void poll_wait(struct pollq *q, struct poll_table *pt);
+// 唤醒 q 上的全部等待者。调用者须持有保护对象状态的锁，且已完成状态修改
+void poll_notify(struct pollq *q);
+// 文件当前的就绪事件（POLL*），首轮检查时顺带登记到对象队列
+int filepoll(struct file *f, struct poll_table *pt);
+int do_poll(uint64 ufds, int nfds, long timeout_us);
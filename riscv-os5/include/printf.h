@@ -1,2 +1,3 @@
 int printf(char *fmt, ...);
-void panic(char *s);
\ No newline at end of file
+void panic(char *s);
+void poweroff(int code);
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include "spinlock.h"
+#include "fpu.h"
 #include "riscv.h"
 #include "file.h"
+#include "sched.h"
+#include "rusage.h"
+#include "perf.h"
+#include "iostat.h"
 
 // 内核上下文切换时保存的寄存器
 struct context {
@@ -28,10 +33,28 @@ struct cpu {
   struct context context; // 切换到这里以进入调度器
   int noff;               // push_off()嵌套深度，用于中断禁用控制
   int intena;             // 在push_off()之前中断是否启用
+  int preempt_count;      // 非 0 时禁止内核抢占（preempt_disable 嵌套深度），随上下文切换保存恢复
+  struct proc *fpu_owner; // 浮点寄存器中装载的是哪个进程的现场，0 表示无人
+  int nested_level;       // 本 hart 上正在处理的可嵌套中断层数（见 trap.c）
+  int current_priority;   // 本 hart 当前所处中断的优先级
+  volatile uint64 tlb_req;  // 其他 hart 提交的远程 TLB 刷新请求代号（见 vm.c tlb_shootdown）
+  volatile uint64 tlb_done; // 本 hart 已完成的最大请求代号
+  uint64 irqsoff_start;   // 最外层 push_off 关中断的时刻（IRQSOFF_TRACE，见 irqsoff.h）
+  uint64 irqsoff_ra;      // 该 push_off 的调用者
 };
 
-// 单核系统：只有一个CPU
-extern struct cpu cpu;
+// 参与调度的 hart 数量，由 Makefile 的 NCPU 传入（同时用于 QEMU -smp 与 entry.S）。
+// 全部 hart 复位后都从 _entry 进入 start()，hart 0 完成全局初始化后其余 hart 才开始
+// 各自的初始化并进入调度器；编号不小于 NCPU 的 hart 在 entry.S 中停住
+#ifndef NCPU
+#define NCPU 1
+#endif
+#define CPUMASK_ALL ((1ULL << NCPU) - 1)   // 全部 hart 的位图，NCPU 不超过 64
+
+// 进程控制块按需从 slab 分配，数量只受 NPROC_MAX 限制（防止 fork 炸弹耗尽内存）
+#define NPROC_MAX 1024
+#define PID_MAX 32768   // pid 在 [1, PID_MAX) 内循环分配
+extern struct cpu cpus[NCPU];
 
 // 陷阱帧结构，用于在用户空间和内核空间之间切换时保存和恢复寄存器状态
 // 该结构位于用户页表中蹦床页面下方的独立页面中，在内核页表中没有特殊映射
@@ -46,7 +69,7 @@ struct trapframe {
   /*   8 */ uint64 kernel_sp;     // 进程内核栈的栈顶
   /*  16 */ uint64 kernel_trap;   // usertrap()函数地址
   /*  24 */ uint64 epc;           // 保存的用户程序计数器
-  /*  32 */ uint64 kernel_hartid; // （单核暂未使用）内核线程指针占位
+  /*  32 */ uint64 kernel_hartid; // 当前 hart 编号，uservec 将其恢复到 tp
   /*  40 */ uint64 ra;            // 返回地址
   /*  48 */ uint64 sp;            // 栈指针
   /*  56 */ uint64 gp;            // 全局指针
@@ -91,6 +114,42 @@ enum procstate {
 };
 
 // 进程控制块：每个进程的状态信息
+// 按需分配区间：exec 不预先分配、读入程序段，首次访问时在缺页处理中补上。
+// ip 非 0 时 [start, start + filesz) 的内容来自可执行文件的 off 处，其余为全零（BSS）
+#define NLAZY 4
+struct inode;
+struct lazy_region {
+  uint64 start;         // 起始地址（页对齐）
+  uint64 end;           // 结束地址（页对齐，不含）
+  int perm;             // 缺页时建立映射使用的权限
+  struct inode *ip;     // 段内容所在的可执行文件，持有一次引用（线程的副本不持有）
+  uint64 off;           // start 对应的文件偏移
+  uint64 filesz;        // 自 start 起来自文件的字节数
+};
+
+// 返回用户态前最多批量刷新的单页 TLB 条目数，超过则改为刷新整个 ASID
+#define TLB_PENDING_MAX 16
+
+// copyin/copyout 使用的软件地址转换缓存：最近翻译过的用户页 -> 物理页
+#define UVM_XLATE_SLOTS 4
+struct xlate_entry {
+  uint64 va;            // 用户虚拟页（页对齐）
+  uint64 pa;            // 对应物理地址，0 表示条目无效
+  int writable;         // 该映射当前是否可写（COW 页为 0）
+};
+
+// mmap 映射区：end 为 0 表示槽位空闲。exec 用去两个槽映射共享运行库（ulibrt.c），
+// 其余留给 mmap
+#define NVMA 10
+struct vma {
+  uint64 start;         // 起始地址（页对齐）
+  uint64 end;           // 结束地址（页对齐，不含）
+  int perm;             // 映射使用的页表项权限
+  int shared;           // MAP_SHARED 时为 1
+  struct file *file;    // 文件映射对应的文件，匿名映射为 0
+  uint64 off;           // start 对应的文件偏移
+};
+
 struct proc {
   struct spinlock lock;  // 进程锁
 
@@ -100,43 +159,180 @@ struct proc {
   int xstate;            // 退出状态，返回给父进程的wait
   int pid;               // 进程ID
 
-  // 使用parent时必须持有wait_lock：
+  // 使用parent与子进程链表时必须持有wait_lock：
   struct proc *parent;   // 父进程指针
+  struct proc *children;        // 子进程链表头
+  struct proc *sibling_next;    // 同一父进程的子进程链表
+  struct proc **sibling_pprev;  // 指向前驱的 sibling_next（或父进程的 children），便于 O(1) 摘除
+  struct proc *zombies;         // 已退出、等待回收的子进程队列（按退出顺序），经 zombie_next 串联
+  struct proc *zombie_tail;
+  struct proc *zombie_next;
+
+  // 以下由 proc_list_lock 保护
+  struct proc *all_next;        // proc_list：全部已分配的进程
+  struct proc **all_pprev;
+  struct proc *hash_next;       // pid 散列桶内的链表
 
   uint64 kstack;        // 内核栈底部虚拟地址
   uint64 sz;            // 用户空间大小（字节）
+  uint64 heap_base;     // 堆起点：[heap_base, sz) 由 sbrk 预留，按需分配
+  int nlazy;            // lazy[] 中有效区间个数
+  struct lazy_region lazy[NLAZY]; // exec 记录的程序段按需加载区间
+  struct vma vma[NVMA];  // mmap 建立的映射区，位于 [MMAP_BASE, MMAP_END)；另有共享运行库的两个
   pagetable_t pagetable; // 用户页表
+  int asid;             // 地址空间标识符，0 表示硬件不支持 ASID、每次切换都整体刷新 TLB
+  int tlb_flush_all;    // 返回用户态前需刷新本 ASID 的全部 TLB 条目
+  int tlb_npending;     // tlb_pending[] 中待刷新的虚拟页个数
+  uint64 tlb_stale;     // 可能仍缓存本 ASID 旧条目的 hart 位图，在这些 hart 上返回用户态前整体刷新
+  int tlb_batch;        // tlb_batch_begin 嵌套深度，非 0 时远程刷新攒到 tlb_batch_end
+  uint64 tlb_batch_mask; // 批处理期间攒下的、需要远程刷新的 hart
+  uint64 tlb_pending[TLB_PENDING_MAX]; // 页表修改后尚未刷新的虚拟页
+  struct xlate_entry xlate[UVM_XLATE_SLOTS]; // 软件地址转换缓存，任何页表修改都会清空
+  int xlate_next;       // 下一个被替换的缓存槽位（轮转）
   struct trapframe *trapframe; // 陷阱帧页面，用于trampoline.S
+  uint64 trapframe_va;         // 陷阱帧在用户页表中的地址：进程为 TRAPFRAME，线程为各自的 TRAPFRAME_SLOT
+  struct vdso_proc *vdso;      // 映射在 VDSO_PROC_VA 的只读进程页，线程为 0（使用组长的）
+  pagetable_t shell_pagetable; // 取自进程外壳缓存、尚未启用的页表骨架，proc_pagetable 直接取用
+  struct vdso_proc *shell_vdso; // 与 shell_pagetable 一同缓存、已映射在其中的 vDSO 进程页
+  uint64 uring;                // uring_setup 登记的提交环用户地址，0 表示未登记
+  uint64 trace_mask;           // strace 登记的跟踪掩码，第 i 位对应系统调用 i，随 fork 继承
+  int log_ops;                 // 本进程已开始、尚未结束的日志操作数（见 log.c）
+  int log_credit;              // 这些操作预留而尚未用掉的日志块数
+  int shared_locks;            // 以共享方式持有的睡眠锁个数（见 sleeplock.c）
   struct context context;      // 上下文切换结构，swtch()切换到这里来运行进程
-  struct file *ofile[NOFILE];  // 打开文件表
-  struct inode *cwd;           // 当前工作目录
+  volatile int on_cpu;         // 已切入某个 hart、尚未在调度器中切回时为 1。
+                               // 被唤醒的进程可能在原 hart 保存完 context 之前就被别的 hart 选中，
+                               // 切入前须等它变为 0；回收进程前同样要等待
+  struct fdtable *fdt;         // 打开文件表：普通进程指向 fdtab，线程指向组长的表
+  struct fdtable fdtab;
+  struct file *fd_held[FD_HELD]; // 本次系统调用经 fd_borrow 持有引用的文件，返回用户态前放弃
+  int fd_nheld;
+  struct inode *cwd;           // 当前工作目录，线程不持有（使用组长的）
+  // 线程组：clone 出的线程与组长共享页表、打开文件与当前目录，这些资源归组长所有，
+  // 组长退出时先结束全部线程，因此线程借用期间它们始终有效。
+  // sz、heap_base、lazy[]、vma[] 每个成员各存一份，修改后由 tgroup_sync 同步给其他成员。
+  // 以组长的一份为准：sbrk/mmap/munmap 在 tgroup_mm_lock 与 tgroup_mm_unlock 之间读改写
+  struct sleeplock tg_mm_lock; // 组长上：串行化组内对地址空间描述的修改
+  struct proc *tg_leader;      // 所属线程组的组长，普通进程与组长自身为 0
+  int tg_nthreads;             // 组长上记录尚未回收的线程数，修改时持有 wait_lock
+  struct proc *tg_threads;     // 组长上的线程链表（wait_lock 保护），经 tg_next 串联
+  struct proc *tg_next;
+  uint64 tg_slots;             // 组长上已占用的陷阱帧槽位位图（wait_lock 保护）
+  int tg_slot;                 // 线程使用的陷阱帧槽位编号
   char name[16];               // 进程名称（调试用）
+  void (*kthread_fn)(void *);  // 内核线程的入口函数，普通进程为 0
+  void *kthread_arg;           // 传给 kthread_fn 的参数
 
-  int priority_level;          // 当前所在的优先级队列（0为最高优先级）
+  uint64 ready_time;           // 最近一次进入就绪队列时的 get_time()，用于统计调度延迟
+  uint64 run_delay;            // 累计的就绪等待时间
+  uint64 nr_runs;              // 被调度运行的次数
+  uint64 nvcsw;                // 主动让出 CPU 的次数
+  uint64 nivcsw;               // 被迫让出 CPU 的次数
+  // 缺页记账（见 vm.h 的 fault_begin/fault_end）：解析函数把本次缺页的类别记在 fault_kind
+  int fault_kind;
+  uint64 cow_faults;
+  uint64 lazy_faults;
+  uint64 minflt;
+  uint64 majflt;
+  uint64 uaccess_faults;
+  // CPU 时间记账（get_time 单位）：陷入、返回用户态与切换进程时把上次记账以来的时间
+  // 计入用户态或内核态
+  uint64 utime;                // 累计的用户态时间
+  uint64 stime;                // 累计的内核态时间
+  uint64 slptime;              // 累计的睡眠时间
+  uint64 acct_time;            // 最近一次记账的时刻
+  uint64 sleep_start;          // 最近一次进入睡眠的时刻
+  struct rusage cru;           // 已回收子进程（含其已回收后代）的累计，wait_lock 保护
+  struct perfcount perf;       // 累计的硬件计数，切出 CPU 时加上本次运行的差值
+  struct perfcount perf_mark;  // 最近一次切入时本 hart 计数器的取样
+  struct perfcount cperf;      // 已回收子进程的硬件计数累计，wait_lock 保护
+  struct proc_iostat io;       // I/O 统计（见 iostat.h），只由进程自己在内核态更新
+  struct proc_iostat cio;      // 已回收子进程的 I/O 统计累计，wait_lock 保护
+  uint64 level_ticks[SCHED_MLFQ_LEVELS]; // 在 MLFQ 各级队列中消耗的 tick 数
+  int sched_policy;            // 调度类（SCHED_*，见 sched.h），默认 SCHED_MLFQ
+  int rt_priority;             // SCHED_FIFO 的静态优先级，数值越大越优先
+  int nice;                    // SCHED_FAIR 的 nice 值，决定虚拟运行时间的增长速度
+  uint64 vruntime;             // SCHED_FAIR 的虚拟运行时间
+  int priority_level;          // MLFQ 级别（0为最高优先级）
+  int rq_level;                // 实际挂入的队列级别：被优先级继承提升时可能高于 priority_level
+  int pi_level;                // 优先级继承给出的级别，-1 表示未被提升
+  int pi_nlocks;               // 持有的、有更高级别进程在等待的睡眠锁个数
   int ticks_in_level;          // 在当前队列中已消耗的时间片滴答数
+  uint64 mlfq_used;            // MLFQ 在当前级别已用掉的配额（get_time 单位），跨睡眠保留
+  uint64 slice_start;          // 最近一次开始运行或向配额计费的时刻
   uint64 last_ready_tick;      // 最近一次进入就绪队列时的全局时钟值，用于老化判断
   int exhausted_slice;         // 标记本次时间片是否被完整消耗，用于决定是否降级
   int preempt_pending;         // 标记是否有更高优先级任务要求立即抢占
   int in_runqueue;             // 标记进程是否已经挂在就绪队列中，避免重复入队
-  struct proc *mlfq_next;      // 多级反馈队列中的链表指针，维持同一优先级的先后顺序
+  struct proc *rq_next;        // 运行队列中的链表指针，维持同一队列内的先后顺序
+  int rq_cpu;                  // 所在运行队列或最近一次运行的 hart，-1 表示尚未入队过
+  uint64 cpumask;              // 允许运行的 hart 位图，默认 CPUMASK_ALL，fork 时继承
+  struct proc *sleep_next;     // 睡眠桶中的链表指针，同一桶内的进程可能等待不同通道
+
+  // 惰性浮点上下文（fpu.c）：只有执行过浮点指令的进程才保存/恢复浮点寄存器
+  int fp_used;                 // 已启用 FPU，返回用户态时 sstatus.FS 为 Clean
+  int fp_dirty;                // 寄存器自上次保存以来被用户态写过，切换出去前需保存
+  int fp_cpu;                  // 最近一次把 fpstate 装载到哪个 hart，-1 表示未装载
+  struct fpstate fpstate;
 };
 
 void swtch(struct context *old, struct context *new);
 
+// 全部已分配的进程，遍历时持有 proc_list_lock
+extern struct proc *proc_list;
+extern struct spinlock proc_list_lock;
+#define for_each_proc(p) for((p) = proc_list; (p); (p) = (p)->all_next)
+
+// p 所在线程组的组长：打开文件、当前目录等共享资源都从组长上取
+static inline struct proc *proc_group(struct proc *p)
+{
+  return p->tg_leader ? p->tg_leader : p;
+}
+
+// 把 n 计入当前进程 I/O 统计的 field 项，启动阶段没有进程时忽略
+#define IOACCT(field, n) do {                  \
+    struct proc *_iop = myproc();              \
+    if(_iop)                                   \
+      _iop->io.field += (n);                   \
+  } while(0)
+
 // 进程管理相关函数声明：内核态进程生命周期控制接口
 void procinit(void);
+void reaper_init(void);   // 启动退出进程地址空间的回收线程
+int cpuid(void);
 struct cpu* mycpu(void);
 struct proc* myproc(void);
 int allocpid(void);
 struct proc* alloc_process(void);
 void free_process(struct proc *p);
+struct proc* proc_find(int pid);
+int proc_count(void);
 pagetable_t proc_pagetable(struct proc *p);
 void proc_freepagetable(pagetable_t pagetable);
 int create_process(void (*entry)(void));
+int kthread_create(void (*fn)(void *), void *arg, const char *name);
+int kthread_should_stop(void);
+int clone_thread(uint64 fn, uint64 stack, int flags, uint64 arg);
+void tgroup_sync(struct proc *p);
+void tgroup_mm_lock(struct proc *p);     // 取得组的地址空间锁，并从组长刷新 p 的副本
+void tgroup_mm_unlock(struct proc *p);
+struct inode *proc_cwd(struct proc *p);                          // 组的当前目录（增加一次引用），可能为 0
+struct inode *proc_set_cwd(struct proc *p, struct inode *ip);   // 替换组的当前目录，返回旧目录
+void tgroup_each_other(struct proc *p, void (*fn)(struct proc *q, struct proc *p));
+int futex_wait(uint64 uaddr, int val);
+int futex_timedwait(uint64 uaddr, int val, long us);
+int futex_wake(uint64 uaddr, int n);
 int fork_process(void);
+int spawn_process(char *path, char **argv);
 void reparent(struct proc *p);
 void exit_process(int status);
 int wait_process(int *status);
+int waitpid_process(int pid, int *status, int options);
+int wait4_process(int pid, int *status, int options, struct rusage *ru);
+int proc_getrusage(int who, struct rusage *ru);
+int proc_perf_read(int who, struct perfcount *pc);
+int proc_iostat_read(int who, struct proc_iostat *st);
+int proc_snapshot(struct procinfo *buf, int max);
 void scheduler(void);
 void sched(void);
 void yield(void);
@@ -144,11 +340,50 @@ void forkret(void);
 void sleep(void *chan, struct spinlock *lk);
 void wakeup(void *chan);
 int kill_process(int pid);
+int proc_rss(int pid, uint64 *rss);
+int proc_set_trace(int pid, uint64 mask);
 void setkilled(struct proc *p);
 int killed(struct proc *p);
 void userinit(void);
+
+// 用户态只读的 vDSO 数据页（vdso.c）
+void vdso_init(void);
+void vdso_update_ticks(uint64 ticks, uint64 tick_time, uint64 interval);
+int vdso_map(pagetable_t pagetable, struct proc *p);
+void vdso_unmap(pagetable_t pagetable);
+void vdso_release(struct proc *p);
+
+// 映射进每个进程的共享运行库（ulibrt.c）
+void ulib_init(void);
+int ulib_map(pagetable_t pagetable, struct vma v[2]);
+
+// 调度类与运行队列（sched.c）
+void sched_init(void);
+void sched_proc_init(struct proc *p);
+void sched_fork(struct proc *parent, struct proc *child);
+void sched_enqueue(struct proc *p);      // 新建或被唤醒的进程入队
+void sched_requeue(struct proc *p);      // 当前进程让出 CPU 时入队
+void sched_charge(struct proc *p);       // 当前进程睡眠前把本次运行时间计入配额
+int sched_pi_boost(struct proc *owner, struct proc *waiter, int newlock);
+int sched_stop_others(void);              // 让其他 hart 停在调度器中，失败返回 -1
+void sched_resume_others(void);
+void sched_pi_unboost(struct proc *p);
+struct proc *sched_pick_next(void);
+void sched_age(void);
+int sched_idle_hint(int *remote);        // 不持锁估计本 hart 与其他队列的就绪数
+int sched_setattr(int pid, int policy, int priority);
+int sched_getstat(int pid, struct schedstat *st);
+int sched_setaffinity(int pid, uint64 mask);
+int sched_getaffinity(int pid, uint64 *mask);
+// 空闲（idle.c）：调度器无进程可运行时先轮询再 wfi
+struct idle_stat;
+void cpu_idle(int *stop);
+int idle_set_poll(int us);               // us >= 0 时设置轮询窗口（微秒），返回设置后的值
+int idle_stat_read(int cpu, struct idle_stat *st);
+void idle_stat_reset(void);
 // 调度器在每个时钟中断中调用，用于累计时间片并决定是否触发抢占
-void scheduler_tick(void);
+void scheduler_tick(int nticks);
+int scheduler_ticks_left(void);
 
 // 内核自带的测试/演示例程声明
 void test_process_creation(void);
@@ -157,3 +392,9 @@ void test_synchronization(void);
 void debug_proc_table(void);
 int run_kernel_tests(void);
 void schedule_kernel_tests(void);
+
+// 在 Makefile 中以 KTEST=1 构建时，启动后创建内核测试任务运行上面的测试；
+// 默认不运行，启动直接进入 init。BENCH_BOOT=1 同样会创建该任务（只跑微基准）
+#ifndef KTEST_AT_BOOT
+#define KTEST_AT_BOOT 0
+#endif
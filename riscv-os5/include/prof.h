@@ -0,0 +1,17 @@
+#pragma once
+
+// 采样分析器的样本格式，内核与用户态共用。开启后时钟中断按设定的频率在每个 hart 上
+// 记录被中断处的 sepc 与 ra，profread 按 hart 依次取出
+#define PROF_NAME_LEN 16
+#define PROF_HZ_MAX 10000   // 采样频率上限（每秒每 hart）
+
+#define PROF_MODE_USER   0
+#define PROF_MODE_KERNEL 1
+
+struct prof_sample {
+    int pid;                     // 被中断的进程，0 表示空闲的 hart
+    int mode;                    // PROF_MODE_*
+    unsigned long pc;            // 被中断的指令地址（sepc）
+    unsigned long ra;            // 被中断时的 ra，作为调用者的近似
+    char name[PROF_NAME_LEN];    // 进程名（exec 的程序名），用于选择符号表
+};
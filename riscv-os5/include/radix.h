@@ -0,0 +1,31 @@
+#pragma once
+
+#include "types.h"
+
+// 基数树：以 64 位下标索引指针，用于页缓存、文件偏移等稀疏但局部连续的映射。
+// 每个节点 64 个槽，每层消耗下标的 6 位，树高随最大下标增长，只含小下标时只有一层。
+// 全零的 struct radix_tree 即为空树。树本身不加锁，由使用者的锁保护；
+// 插入可能分配节点（从 slab），持有自旋锁时同样可以调用。
+
+#define RADIX_SHIFT 6
+#define RADIX_SLOTS (1 << RADIX_SHIFT)
+
+struct radix_node;
+
+struct radix_tree {
+  struct radix_node *root;
+  int height;            // 0 表示空树
+};
+
+void radix_tree_init(void);   // 创建节点的 slab cache，启动时调用一次
+// 在 index 处放入 item（非 0）。已有项或内存不足时返回 -1；内存不足时已分配的中间节点
+// 留在树中，之后的插入会复用它们，radix_clear 时一并释放
+int radix_insert(struct radix_tree *t, uint64 index, void *item);
+void *radix_lookup(struct radix_tree *t, uint64 index);
+void *radix_delete(struct radix_tree *t, uint64 index);   // 返回删除的项，没有时返回 0
+// 从 first 起按下标升序取出至多 max 个项，下标写入 indices（可为 0），返回取出的个数
+int radix_gang_lookup(struct radix_tree *t, uint64 first, void **items, uint64 *indices, int max);
+// 清空整棵树并释放全部节点，fn 非 0 时对每个项调用一次
+void radix_clear(struct radix_tree *t, void (*fn)(uint64 index, void *item));
+
+void test_radix(void);   // KTEST=1 时由内核测试任务调用
@@ -11,6 +11,15 @@
 #define MSTATUS_MPP_U (0L << 11)    // 异常发生前处于用户模式
 
 // mstatus: 机器模式状态寄存器，控制全局中断使能、权限模式等系统级状态
+// 读取当前 hart 编号（仅 M-mode 可访问）
+static inline uint64
+r_mhartid()
+{
+  uint64 x;
+  asm volatile("csrr %0, mhartid" : "=r" (x) );
+  return x;
+}
+
 static inline uint64
 r_mstatus()
 {
@@ -38,6 +47,13 @@ w_mepc(uint64 x)
 #define SSTATUS_UPIE (1L << 4) // 异常发生前用户模式下的中断使能状态
 #define SSTATUS_SIE (1L << 1)  // 当前监管模式下的中断使能位
 #define SSTATUS_UIE (1L << 0)  // 当前用户模式下的中断使能位
+// sstatus.FS：浮点单元状态。Off 时执行浮点指令触发非法指令异常；
+// 硬件在浮点寄存器被写入后自动置为 Dirty
+#define SSTATUS_FS_MASK    (3L << 13)
+#define SSTATUS_FS_OFF     (0L << 13)
+#define SSTATUS_FS_INITIAL (1L << 13)
+#define SSTATUS_FS_CLEAN   (2L << 13)
+#define SSTATUS_FS_DIRTY   (3L << 13)
 
 // sstatus: 监管模式状态寄存器，监管模式下的状态和控制信息
 static inline uint64
@@ -73,6 +89,7 @@ w_sip(uint64 x)
 #define SIE_SEIE (1L << 9) // 外部中断使能位
 #define SIE_STIE (1L << 5) // 定时器中断使能位
 #define SIE_SSIE (1L << 1) // 软件中断使能位
+#define SIP_SSIP (1L << 1) // 软件中断挂起位
 
 // sie: 监管中断使能寄存器，控制哪些中断在监管模式下可以触发
 static inline uint64
@@ -240,6 +257,12 @@ w_pmpaddr0(uint64 x)
 // 构造 SATP 寄存器的值：高位指定模式，中间是页表物理地址（去掉低12位）
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
 
+// satp 的 ASID 字段位于 [59:44]，带 ASID 的 TLB 条目在切换页表时无需整体清空
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK  0xFFFFL
+#define MAKE_SATP_ASID(pagetable, asid) \
+  (MAKE_SATP(pagetable) | (((uint64)(asid) & SATP_ASID_MASK) << SATP_ASID_SHIFT))
+
 // 写入页表基址寄存器 (satp)
 // satp: 监管地址转换和保护寄存器，控制虚拟内存系统的根页表地址和分页模式
 static inline void 
@@ -298,6 +321,76 @@ r_time()
   return x;
 }
 
+// cycle: 本 hart 执行的时钟周期数，用于微基准计时（须在 mcounteren 中开放）
+static inline uint64
+r_cycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, cycle" : "=r" (x) );
+  return x;
+}
+
+// instret: 本 hart 已退休的指令数
+static inline uint64
+r_instret()
+{
+  uint64 x;
+  asm volatile("csrr %0, instret" : "=r" (x) );
+  return x;
+}
+
+// hpmcounter3..5: 可编程事件计数器，事件由 M 态的 mhpmevent3..5 选择
+#define MCOUNTEREN_HPM(n) (1L << (n))
+
+static inline uint64
+r_hpmcounter3()
+{
+  uint64 x;
+  asm volatile("csrr %0, 0xc03" : "=r" (x) );
+  return x;
+}
+
+static inline uint64
+r_hpmcounter4()
+{
+  uint64 x;
+  asm volatile("csrr %0, 0xc04" : "=r" (x) );
+  return x;
+}
+
+static inline uint64
+r_hpmcounter5()
+{
+  uint64 x;
+  asm volatile("csrr %0, 0xc05" : "=r" (x) );
+  return x;
+}
+
+static inline void
+w_mhpmevent3(uint64 x)
+{
+  asm volatile("csrw 0x323, %0" : : "r" (x));
+}
+
+static inline void
+w_mhpmevent4(uint64 x)
+{
+  asm volatile("csrw 0x324, %0" : : "r" (x));
+}
+
+static inline void
+w_mhpmevent5(uint64 x)
+{
+  asm volatile("csrw 0x325, %0" : : "r" (x));
+}
+
+// mcountinhibit: 置位的计数器停止计数
+static inline void
+w_mcountinhibit(uint64 x)
+{
+  asm volatile("csrw 0x320, %0" : : "r" (x));
+}
+
 // 开启设备中断（设置 SSTATUS_SIE 位）
 static inline void
 intr_on()
@@ -320,6 +413,14 @@ intr_get()
   return (x & SSTATUS_SIE) != 0;
 }
 
+// 自旋等待中的让步提示：Zihintpause 的 pause 指令（编码为 fence w,0），
+// 不认识该扩展的实现按普通 fence 执行
+static inline void
+cpu_relax()
+{
+  asm volatile(".insn i 0x0F, 0, x0, x0, 0x010");
+}
+
 // 读取栈指针寄存器 (sp)
 static inline uint64
 r_sp()
@@ -329,6 +430,21 @@ r_sp()
   return x;
 }
 
+// 读取线程指针寄存器 (tp)，内核用它保存当前 hart 编号
+static inline uint64
+r_tp()
+{
+  uint64 x;
+  asm volatile("mv %0, tp" : "=r" (x) );
+  return x;
+}
+
+static inline void
+w_tp(uint64 x)
+{
+  asm volatile("mv tp, %0" : : "r" (x));
+}
+
 // 读取返回地址寄存器 (ra)
 static inline uint64
 r_ra()
@@ -346,6 +462,20 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// 只刷新指定 ASID 的全部（非全局）TLB 条目
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
+// 只刷新指定 ASID 下映射 va 的 TLB 条目
+static inline void
+sfence_vma_va_asid(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid));
+}
+
 // 类型定义
 typedef uint64 pte_t; // 每个页表项是64位长
 typedef uint64* pagetable_t; // 指向一个页表的指针（一个页表包含512个PTE）
@@ -360,13 +490,25 @@ typedef uint64* pagetable_t; // 指向一个页表的指针（一个页表包含
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1)) // 向上对齐到页面边界
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))           // 向下对齐到页面边界
 
+// Sv39 二级叶子页表项映射的大页（megapage）：2MB
+#define MEGAPGSIZE (PGSIZE * 512)
+
+// 判断页表项是否为叶子（R/W/X 任一置位），非叶子表示指向下一级页表
+#define PTE_LEAF(pte) (((pte) & (PTE_R | PTE_W | PTE_X)) != 0)
+
+// 由第 level 级叶子页表项计算 va 对应的物理地址（大页需要加上页内偏移）
+#define LEAF_PA(pte, va, level) (PTE2PA(pte) + ((uint64)(va) & ((1UL << PXSHIFT(level)) - 1)))
+
 // 页表项（PTE）标志位
 #define PTE_V (1L << 0) // 有效位：指示页表项是否包含有效映射
 #define PTE_R (1L << 1) // 可读权限位
 #define PTE_W (1L << 2) // 可写权限位
 #define PTE_X (1L << 3) // 可执行权限位
 #define PTE_U (1L << 4) // 用户模式可访问位
+#define PTE_A (1L << 6) // 访问位：页面被读写或执行过
+#define PTE_D (1L << 7) // 脏位：页面被写过
 #define PTE_COW (1L << 8) // 写时复制标记位
+#define PTE_SWAP (1L << 9) // 换出标记位：V 为 0，PPN 字段存放交换槽号（见 include/swap.h）
 
 // 将物理地址转换为页表条目格式：右移12位去掉页内偏移，再左移10位为标志位留出空间
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,21 @@
+#ifndef RMAP_H
+#define RMAP_H
+
+#include "types.h"
+#include "riscv.h"
+
+// 反向映射：记录每个物理页被哪些用户页表项（4KB 叶子）引用。
+// 页表项地址本身即可定位映射；被 fork 共享的末级页表中的一项只登记一次，
+// 与该页的引用计数一一对应。2MB 大页叶子（以及由其拆分出的页）不登记。
+
+void rmap_init(void);
+int rmap_add(uint64 pa, pte_t *pte, uint64 va);  // 分配失败返回 -1
+void rmap_remove(uint64 pa, pte_t *pte);
+int rmap_count(uint64 pa);
+int rmap_test_and_clear_young(uint64 pa);        // 任一映射的 A 位置位时返回 1，并清除全部 A 位
+int rmap_unmap_all(uint64 pa);                   // 解除全部映射，返回表项数（引用仍由调用者持有），映射不完整时返回 -1
+int rmap_movable(uint64 pa);                     // 引用全部来自登记的映射时返回 1
+int rmap_migrate(uint64 pa, uint64 newpa);       // 内容与全部映射移到 newpa，返回映射数，不可迁移时返回 -1
+int rmap_swap_out(uint64 pa, pte_t swpte);       // 全部映射改为换出表项 swpte，返回映射数，不可换出时返回 -1
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+// getrusage/wait4/procinfo 返回的资源使用统计，内核与用户态共用。
+// 时间均为 get_time 单位（time CSR 计数，每秒 TIMEBASE_FREQ 次）
+#define RUSAGE_SELF     0
+#define RUSAGE_CHILDREN (-1)   // 已回收的子进程及其已回收后代的累计
+
+struct rusage {
+    unsigned long utime;    // 用户态运行时间：返回用户态到下一次陷入
+    unsigned long stime;    // 内核态运行时间：陷入后到返回用户态或让出 CPU
+    unsigned long wtime;    // 就绪等待时间：进入就绪队列到开始运行
+    unsigned long slptime;  // 睡眠时间：进入睡眠到被唤醒入队
+    unsigned long nvcsw;    // 主动让出 CPU（睡眠或主动 yield）的次数
+    unsigned long nivcsw;   // 时间片用完或被抢占而让出 CPU 的次数
+    // 缺页次数：用户态缺页与内核 copyin/copyout 中的缺页都计入对应类别
+    unsigned long cow_faults;     // 写时复制（含最后一个映射者原地恢复写权限）
+    unsigned long lazy_faults;    // 按需分配的匿名页：堆、BSS、匿名映射，含只读映射共享零页
+    unsigned long minflt;         // 文件页，内容已在内存中（页缓存命中、tmpfs、内联文件）
+    unsigned long majflt;         // 需要读盘：页缓存未命中的文件页与换入
+    unsigned long uaccess_faults; // 以上缺页中发生在 copyin/copyout 里的次数
+};
+
+// procinfo 为每个进程填写的一项
+struct procinfo {
+    int pid;
+    int ppid;               // 父进程，没有时为 0
+    char state;             // R 运行，r 就绪，S 睡眠，Z 僵尸，U 尚未就绪
+    char name[16];
+    struct rusage ru;
+};
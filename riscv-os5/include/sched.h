@@ -0,0 +1,39 @@
+#pragma once
+
+// 调度类编号与 sched_setattr 参数，内核与用户态共用。
+#define SCHED_MLFQ 0   // 默认：多级反馈队列
+#define SCHED_FIFO 1   // 实时 FIFO：priority 为 1~99，数值越大越优先
+#define SCHED_FAIR 2   // 公平类：priority 为 nice 值 -20~19，数值越小权重越大
+
+#define SCHED_FIFO_PRIO_MIN 1
+#define SCHED_FIFO_PRIO_MAX 99
+#define SCHED_NICE_MIN (-20)
+#define SCHED_NICE_MAX 19
+
+#define SCHED_MLFQ_LEVELS 5     // MLFQ 的级数
+#define SCHED_LAT_BUCKETS 32    // 调度延迟直方图的桶数
+
+struct sched_attr {
+    int policy;      // SCHED_*
+    int priority;    // FIFO 的静态优先级或 FAIR 的 nice 值，MLFQ 忽略
+};
+
+// clone 的共享标志（取值与 Linux 相同）。目前只支持三者同时指定，即创建共享地址空间、
+// 打开文件表与当前目录的用户线程
+#define CLONE_VM    0x00000100
+#define CLONE_FS    0x00000200
+#define CLONE_FILES 0x00000400
+#define CLONE_THREAD_FLAGS (CLONE_VM | CLONE_FS | CLONE_FILES)
+
+// schedstat 系统调用返回的调度统计。时间均为 get_time 单位（time CSR 计数）。
+struct schedstat {
+    // 全局：从进入就绪队列到开始运行的延迟分布，第 i 个桶统计 [2^i, 2^(i+1)) 的次数（桶 0 含 0）
+    unsigned long lat_hist[SCHED_LAT_BUCKETS];
+    unsigned long nr_switches;                     // 启动以来调度器选出进程的总次数
+    // 目标进程
+    unsigned long run_delay;                       // 累计的就绪等待时间
+    unsigned long nr_runs;                         // 被调度运行的次数
+    unsigned long nvcsw;                           // 主动让出 CPU（睡眠或主动 yield）的次数
+    unsigned long nivcsw;                          // 时间片用完或被抢占而让出 CPU 的次数
+    unsigned long level_ticks[SCHED_MLFQ_LEVELS];  // 在 MLFQ 各级队列中消耗的 tick 数
+};
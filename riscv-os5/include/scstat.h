@@ -0,0 +1,25 @@
+#pragma once
+
+// 系统调用统计与跟踪，内核与用户态共用。时间均为 get_time 单位（time CSR 计数）。
+
+#define SCSTAT_NAMELEN 20
+#define STRACE_NARGS   6
+
+// scstat 返回的单个系统调用的累计统计，数组下标即系统调用号，未实现的编号 name 为空串
+struct syscall_stat {
+    char name[SCSTAT_NAMELEN];
+    unsigned long calls;       // 调用次数
+    unsigned long errors;      // 返回负值的次数
+    unsigned long time_total;  // 累计耗时（含期间的睡眠）
+    unsigned long time_max;    // 单次最长耗时
+};
+
+// straceread 读出的一条跟踪记录：被跟踪进程每完成一次掩码中的系统调用追加一条
+struct strace_rec {
+    int pid;
+    int num;                    // 系统调用号
+    long args[STRACE_NARGS];    // 前 arg_count 个参数，其余为 0
+    long ret;
+    unsigned long start;        // 进入时间
+    unsigned long dur;          // 耗时
+};
@@ -3,13 +3,27 @@
 
 #include "spinlock.h"
 
+// 等待者节点，位于 sem_wait/sem_timedwait 调用者的栈上
+struct sem_waiter {
+  struct sem_waiter *next;
+  struct semaphore *sem;
+  int granted;   // sem_signal 已把一个计数直接交给该等待者
+  int expired;   // sem_timedwait 的定时器回调已执行完
+};
+
+// 计数信号量：等待者按到达顺序排队，sem_signal 只唤醒队首一个，
+// 并把计数直接交给它（value 不变），被唤醒者无需再与新来者争抢
 struct semaphore {
   struct spinlock lock;
   int value;
+  struct sem_waiter *head;   // 等待队列（FIFO）
+  struct sem_waiter *tail;
 };
 
 void sem_init(struct semaphore *sem, int value, char *name);
 void sem_wait(struct semaphore *sem);
+int sem_timedwait(struct semaphore *sem, int nticks);
+int sem_timedwait_us(struct semaphore *sem, long us);
 void sem_signal(struct semaphore *sem);
 
 #endif
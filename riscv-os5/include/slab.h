@@ -0,0 +1,20 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "types.h"
+
+// slab 对象缓存：在 kalloc 的整页之上切分固定大小的小对象。
+// 每个 cache 管理若干个单页 slab，对象的构造函数只在 slab 新建时调用一次，
+// 因此释放回 cache 的对象应保持“已构造”状态。
+
+struct kmem_cache;
+
+void kmem_cache_init(void);
+struct kmem_cache* kmem_cache_create(const char *name, uint size, void (*ctor)(void *));
+void* kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+int kmem_cache_shrink(struct kmem_cache *cache);
+int kmem_cache_reap(void);
+void kmem_cache_stats(void);
+
+#endif
@@ -6,14 +6,24 @@ struct proc;
 
 // 睡眠锁：结合自旋锁与进程睡眠的高层锁机制
 // 适用于需要在持锁期间执行较长耗时操作的场景，避免忙等浪费 CPU。
+// 除独占持有（acquiresleep）外也可被多个读者共享持有（acquiresleep_shared）。
 struct sleeplock {
     char *name;              // 锁名称，便于调试
     struct spinlock lk;      // 自旋锁，用于保护 sleeplock 自身状态
-    int locked;              // 锁状态：1 表示已上锁，0 表示未上锁
-    struct proc *owner;      // 当前持有锁的进程（仅用于调试）
+    int locked;              // 锁状态：1 表示已独占上锁，0 表示未独占上锁
+    int readers;             // 共享持有者的个数，与 locked 互斥
+    int writers;             // 等待独占持有的进程数，大于 0 时新的共享请求让路，避免写者饿死
+    struct proc *owner;      // 当前持有锁的进程：用于调试断言，也决定等待者先自旋还是直接睡眠
+    int pi_boosted;          // 有等待者把持有者的 MLFQ 级别提升过，释放时撤销
+#if LOCKSTAT
+    struct lock_class *cls;  // 所属统计类，0 表示不统计
+    uint64 acquired_at;      // 本次获得锁的时间
+#endif
 };
 
 void initsleeplock(struct sleeplock *lk, char *name);
 void acquiresleep(struct sleeplock *lk);
 void releasesleep(struct sleeplock *lk);
+void acquiresleep_shared(struct sleeplock *lk);
+void releasesleep_shared(struct sleeplock *lk);
 int holdingsleep(struct sleeplock *lk);
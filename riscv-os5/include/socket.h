@@ -0,0 +1,30 @@
+#pragma once
+
+// 套接字的常量与地址结构（取值与 Linux 相同），内核与用户态共用。目前只支持 UDP/IPv4
+#define AF_INET     2
+#define SOCK_DGRAM  2
+#define IPPROTO_UDP 17
+
+#define MSG_DONTWAIT 0x40   // recvfrom：没有数据时立即返回 -1
+
+#define INADDR_ANY 0
+
+// 端口与地址均为网络字节序
+struct sockaddr_in {
+    unsigned short sin_family;
+    unsigned short sin_port;
+    unsigned int sin_addr;
+    char sin_zero[8];
+};
+
+static inline unsigned short htons(unsigned short x) { return (unsigned short)((x << 8) | (x >> 8)); }
+static inline unsigned short ntohs(unsigned short x) { return htons(x); }
+static inline unsigned int htonl(unsigned int x)
+{
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+static inline unsigned int ntohl(unsigned int x) { return htonl(x); }
+
+// 主机字节序的点分地址 a.b.c.d
+#define IPADDR(a, b, c, d) \
+    (((unsigned int)(a) << 24) | ((unsigned int)(b) << 16) | ((unsigned int)(c) << 8) | (unsigned int)(d))
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "types.h"
+
+// 中断下半部：中断处理函数（上半部）只做确认设备、摘取完成项这类必须立即做的事，
+// 其余工作（唤醒等待者、协议栈处理等）用 softwork_queue 挂到本 hart 的工作链表，
+// 在中断返回前以开中断、禁止抢占的状态执行。一次执行的工作项数与时间超过预算时，
+// 剩余的交给本 hart 的 ksoftirqd 内核线程，与普通进程一起参与调度。
+// 工作项的回调不能睡眠；同一个工作项不会在两个 hart 上同时执行，执行期间再次
+// 挂入的请求在本次返回后补做一次。softwork 结构由调用者提供，挂入期间不得释放。
+struct softwork {
+  void (*fn)(void *arg);
+  void *arg;
+  struct softwork *next;
+  volatile uint state;        // SOFTWORK_PENDING / SOFTWORK_RUNNING（见 softirq.c）
+};
+
+#define SOFTWORK_INIT(f, a) { .fn = (f), .arg = (a) }
+
+struct irq_stat;
+
+// 各中断的处理时长累计，每个 hart 一份，只在本 hart 关中断时更新
+struct irq_acct {
+  uint64 count;
+  uint64 time_total;
+  uint64 time_max;
+};
+
+static inline void irq_account(struct irq_acct *a, uint64 len)
+{
+  a->count++;
+  a->time_total += len;
+  if(len > a->time_max)
+    a->time_max = len;
+}
+
+void irq_acct_read(struct irq_acct *a, int stride, struct irq_stat *st);   // stride 为相邻 hart 两份之间的字节数
+
+void softirq_init(void);
+void softirq_start(void);    // 进程子系统就绪后调用，为每个 hart 创建 ksoftirqd
+int softwork_queue(struct softwork *w);   // 挂入本 hart 的链表，已在等待执行时返回 0
+void softirq_run(void);      // 中断返回前调用（关中断），返回时仍关中断
+int softirq_stat(int i, struct irq_stat *st);
+void softirq_stat_reset(void);
@@ -1,9 +1,20 @@
 #ifndef SPINLOCK_H
 #define SPINLOCK_H
 
+#include "lockstat.h"
+
+struct cpu;
+
+// 票号自旋锁：获取者先领一张票号，按票号先后依次进入临界区，保证多 hart 竞争时的公平性
 struct spinlock {
-  uint locked;       // 锁是否被持有
+  uint next;         // 下一张待发放的票号
+  uint serving;      // 当前允许进入临界区的票号，next != serving 表示锁被持有
+  struct cpu *cpu;   // 持有锁的 hart，用于检测重复加锁
   char *name;        //锁的名称（调试用）
+#if LOCKSTAT
+  struct lock_class *cls;  // 所属统计类，0 表示不统计
+  uint64 acquired_at;      // 本次获得锁的时间，释放时据此累计持有时间
+#endif
 };
 
 void initlock(struct spinlock *lk, char *name);
@@ -12,5 +23,10 @@ void release(struct spinlock *lk);
 int holding(struct spinlock *lk);
 void push_off(void);
 void pop_off(void);
+// 内核抢占：preempt_disable/preempt_enable 之间即使开着中断也不会被切走，
+// preempt_enable 回到 0 时检查一次是否需要让出
+void preempt_disable(void);
+void preempt_enable(void);
+int preempt_point(void);
 
 #endif
@@ -1,5 +1,9 @@
 // 内核最小化字符串/内存操作例程的声明
 void* memset(void*, int, uint);
 void* memmove(void*, const void*, uint);
-void safestrcpy(char *dst, const char *src, int n);
+int memcmp(const void*, const void*, uint);
+char* safestrcpy(char *dst, const char *src, int n);
 int strlen(const char *s);
+
+// 内存操作微基准（对齐/非对齐的 cycles/byte）
+void test_memops_performance(void);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "types.h"
+#include "riscv.h"
+
+// 交换区：mkfs -w 在文件系统之后预留的一段块（超级块的 swapstart/nswap），一块存放一页。
+// 换出的页在页表项中留下换出表项：V 为 0、PTE_SWAP 置位，PPN 字段存放槽号，
+// 原来的 R/W/X/U/COW 位保持不变，换入时据此恢复映射。每个槽记录引用它的表项数，
+// 被 fork 共享的末级页表中的一项只算一次，与页面的引用计数一致。
+
+#define SWAP2PTE(slot)   (((uint64)(slot) << 10) | PTE_SWAP)
+#define PTE2SLOT(pte)    ((uint32)((pte) >> 10))
+#define PTE_IS_SWAP(pte) (((pte) & (PTE_V | PTE_SWAP)) == PTE_SWAP)
+
+struct meminfo;
+
+void swap_init(void);             // 文件系统与进程子系统就绪后调用，有交换区时启动 kswapd
+void swap_wakeup(void);           // 内存回收不足时唤醒 kswapd，不会睡眠
+int swap_reclaim_direct(void);    // 在进程上下文中同步换出一批页，返回换出的页数
+int swap_read(uint32 slot, void *page);   // 读回槽的内容，可能睡眠；持有自旋锁时返回 -1
+void swap_dup(uint32 slot);       // 新增一个引用该槽的表项
+void swap_free(uint32 slot);      // 放弃一个引用，最后一个放弃时槽变为空闲
+void swap_meminfo(struct meminfo *mi);
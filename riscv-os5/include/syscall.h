@@ -26,10 +26,65 @@
 #define SYS_klog_dump 22
 #define SYS_klog_set_threshold 23
 #define SYS_sleep 24
+#define SYS_spawn 25
+#define SYS_mmap 26
+#define SYS_munmap 27
+#define SYS_meminfo 28
+#define SYS_sched_setattr 29
+#define SYS_schedstat 30
+#define SYS_clone 31
+#define SYS_futex_wait 32
+#define SYS_futex_wake 33
+#define SYS_lockstat 34
+#define SYS_waitpid 35
+#define SYS_sched_setaffinity 36
+#define SYS_sched_getaffinity 37
+#define SYS_uring_setup 38
+#define SYS_uring_enter 39
+#define SYS_bcachestat 40
+#define SYS_pipe 41
+#define SYS_splice 42
+#define SYS_fsync 43
+#define SYS_fdatasync 44
+#define SYS_scstat 45
+#define SYS_strace 46
+#define SYS_straceread 47
+#define SYS_readv 48
+#define SYS_writev 49
+#define SYS_pread 50
+#define SYS_pwrite 51
+#define SYS_sendfile 52
+#define SYS_poll 53
+#define SYS_kbench 54
+#define SYS_prof 55
+#define SYS_profread 56
+#define SYS_tracedump 57
+#define SYS_socket 58
+#define SYS_bind 59
+#define SYS_sendto 60
+#define SYS_recvfrom 61
+#define SYS_getrusage 62
+#define SYS_wait4 63
+#define SYS_procinfo 64
+#define SYS_poweroff 65
+#define SYS_perf_read 66
+#define SYS_getdents 67
+#define SYS_fallocate 68
+#define SYS_allocprof 69
+#define SYS_irqstat 70
+#define SYS_idlestat 71
+#define SYS_idlepoll 72
+#define SYS_metrics_read 73
+#define SYS_clone_file 74
+#define SYS_nanosleep 75
+#define SYS_poll_us 76
+#define SYS_futex_timedwait 77
+#define SYS_iostat 78
 
 #ifndef __ASSEMBLER__
 // 系统调用总入口，由内核陷入处理流程调用
 void syscall(void);
+void syscall_init(void);
 #include "types.h"
 int get_syscall_arg(int n, long *arg);
 int argint(int n, int *ip);
@@ -0,0 +1,24 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "types.h"
+
+// 内核定时器：在指定的 tick 到期后，于时钟中断上下文中调用 fn(arg)。
+// ktimer 结构由调用者提供（可以放在栈上），到期或取消前不得释放。
+// 回调执行时不持有定时器锁，可以在回调中重新添加定时器，但不能睡眠。
+struct ktimer {
+  uint64 expires;               // 到期的 ticks 值
+  void (*fn)(void *arg);        // 到期回调
+  void *arg;
+  int pending;                  // 已挂入时间轮且尚未到期
+  struct ktimer *next;
+  struct ktimer **pprev;        // 指向前驱的 next 指针（或桶头），便于 O(1) 取消
+};
+
+void ktimer_init(void);
+void ktimer_add(struct ktimer *t, uint64 expires, void (*fn)(void *), void *arg);
+int ktimer_cancel(struct ktimer *t);   // 定时器尚未到期时摘除并返回 1，否则返回 0
+void ktimer_run(uint64 now);           // 时钟中断调用：处理截至 now 的全部到期定时器
+int ktimer_next(uint64 *expires);      // 最早的到期时间，没有定时器时返回 0
+
+#endif
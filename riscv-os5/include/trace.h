@@ -0,0 +1,57 @@
+#pragma once
+
+#include "types.h"
+
+// ================= 内核跟踪点 =================
+// klog 在写入时格式化文本并持锁，放在调度器和块缓存这类热路径上代价过高。
+// 跟踪点只把定长的二进制记录（事件号、时间戳、当前 pid 与至多 4 个参数）写进
+// 当前 hart 自己的环形缓冲区：关中断保证单写者，无需加锁，也不做格式化；
+// 格式串按事件号放在表中，由 trace_dump 在转储时才使用。环满时覆盖最旧的记录。
+//
+// 编译时以 -DTRACE_ENABLED=0 可去掉全部跟踪点，参数仍参与类型检查但不产生代码。
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+#define TRACE_RING 1024   // 每个 hart 的记录数，须为 2 的幂
+
+// 事件表：名称与转储时使用的格式串（参数均按 64 位传入，使用 %ld/%lu/%lx）
+#define TRACE_EVENTS(X) \
+  X(PROC_ALLOC,   "alloc_process pid=%ld") \
+  X(PROC_FREE,    "free_process pid=%ld") \
+  X(KTHREAD,      "kthread pid=%ld") \
+  X(FORK,         "fork parent=%ld child=%ld") \
+  X(SPAWN,        "spawn parent=%ld child=%ld") \
+  X(CLONE,        "clone pid=%ld thread=%ld") \
+  X(EXIT,         "exit pid=%ld status=%ld") \
+  X(ZOMBIE,       "zombie pid=%ld") \
+  X(WAIT,         "wait pid=%ld child=%ld status=%ld") \
+  X(EXEC,         "exec pid=%ld argc=%ld") \
+  X(SCHED_SWITCH, "sched_switch pid=%ld policy=%ld") \
+  X(BIO_MISS,     "bread_miss dev=%lu block=%lu") \
+  X(PAGE_FAULT,   "page_fault va=%lx sepc=%lx kind=%ld cycles=%lu")
+
+#define TRACE_ENUM(name, fmt) TR_##name,
+enum trace_event { TRACE_EVENTS(TRACE_ENUM) TR_NEVENTS };
+#undef TRACE_ENUM
+
+struct trace_rec {
+  uint64 seq;       // 写完后置为序号 + 1，转储时据此识别正在写或已被覆盖的记录
+  uint64 time;      // get_time()
+  uint32 event;     // enum trace_event
+  int pid;          // 记录时本 hart 上运行的进程，0 表示调度器或空闲
+  uint64 args[4];
+};
+
+void trace_emit(int event, uint64 a0, uint64 a1, uint64 a2, uint64 a3);
+int trace_dump(void);
+
+#define TRACE_ARGS(ev, a0, a1, a2, a3, ...) \
+  trace_emit(TR_##ev, (uint64)(a0), (uint64)(a1), (uint64)(a2), (uint64)(a3))
+
+// TRACE(事件名, 参数...)：至多 4 个参数，不足的补 0
+#if TRACE_ENABLED
+#define TRACE(...) TRACE_ARGS(__VA_ARGS__, 0, 0, 0, 0, 0)
+#else
+#define TRACE(...) do { if(0) TRACE_ARGS(__VA_ARGS__, 0, 0, 0, 0, 0); } while(0)
+#endif
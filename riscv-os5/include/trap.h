@@ -1,16 +1,37 @@
 #include "types.h"
 
+#define TIMEBASE_FREQ 10000000   // QEMU virt 平台 time CSR 为 10MHz
+#define TICK_INTERVAL 1000000    // 每个 tick 对应的 time 计数
+
 // 中断处理相关
 void trap_init(void);
+void trap_inithart(void);
 void usertrap(void);
 void usertrapret(void);
-void register_interrupt(int irq, void (*handler)(void));
+#define IRQF_NESTABLE 0x1   // register_interrupt 标志：处理函数运行期间允许更高优先级的中断嵌套
+void register_interrupt(int irq, void (*handler)(void), int flags);
 void enable_interrupt(int irq);
 void disable_interrupt(int irq);
-void kerneltrap(void);
+void kerneltrap(uint64 *regs);
 void timer_interrupt_handler(void);
+void ipi_send(int hart);
+void ipi_interrupt_handler(void);
+void external_interrupt_handler(void);
 uint64 get_time(void);
 void sbi_set_timer(uint64 time);
+void timer_reprogram(void);
+void ticks_sync(void);
+struct irq_stat;
+int irqstat_read(int i, struct irq_stat *st);   // 第 i 项中断统计，未使用时返回 0，越界返回 -1
+void irqstat_reset(void);
+
+// 采样分析器（prof.c）
+struct prof_sample;
+void prof_init(void);
+int prof_set_rate(int hz);
+int prof_next(uint64 *when);
+void prof_sample(int user, uint64 pc, uint64 ra);
+int prof_drain(struct prof_sample *dst, int max);
 
 //异常相关
 void handle_exception(void);
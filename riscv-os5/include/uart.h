@@ -1,4 +1,9 @@
 void uartinit(void);
+void uart_intr_init(void);
 void uart_putc(char c);
+void uart_write(const char *s, int n, int can_sleep);
+void uart_flush_sync(void);
+void uart_putc_sync(char c);
 void uart_puts(const char *s);
 int uart_getc(void);
+void uart_intr(void);
@@ -0,0 +1,9 @@
+#pragma once
+
+// readv/writev 的缓冲区描述，内核与用户态共用
+#define IOV_MAX 16   // 单次调用的最大段数
+
+struct iovec {
+    void *iov_base;          // 缓冲区起始地址
+    unsigned long iov_len;   // 字节数
+};
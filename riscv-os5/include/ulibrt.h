@@ -0,0 +1,35 @@
+#pragma once
+
+// 共享运行库（ulib.c、printf.c、umalloc.c 与系统调用桩），内核与用户态共用。
+// 库链接成固定地址的镜像（user/ulib.ld）嵌入内核，启动时拷贝一次，exec 把它映射进每个进程：
+//   - 代码页 [ULIB_TEXT_VA, +代码长度)：只读可执行，所有进程映射同一组物理页（page_incref）；
+//   - 数据页 [ULIB_DATA_VA, +数据与 bss 长度)：已初始化部分写时复制自内核保存的模板，其余按需清零。
+// 程序不直接链接库代码，而是调用跳转表的槽位（user/ulib.syms 的第 i 行对应第 i 个槽），
+// 槽中的 tail 指令再跳到库内的实现，库重新编译后旧程序照常可用。
+//
+// 地址放在 2GB 之下：medany 代码模型的调用与取址都是 PC 相对 ±2GB，程序从地址 0 开始，
+// 库必须落在这个范围内。sbrk 堆的上限因此是 ULIB_TEXT_VA（见 memlayout.h）。
+// 本文件也被汇编文件包含，常量不带 C 的整数后缀
+#define ULIB_TEXT_VA   0x7fe00000
+#define ULIB_DATA_VA   0x7ff00000
+#define ULIB_END_VA    0x80000000
+
+#define ULIB_MAGIC     0x42494c55    // "ULIB"
+#define ULIB_HDR_SIZE  32            // 镜像头，之后是跳转表
+#define ULIB_SLOT_SIZE 8             // 每个槽一条 auipc + jalr
+#define ULIB_JUMP_VA   (ULIB_TEXT_VA + ULIB_HDR_SIZE)
+
+// 导出的数据固定放在数据段开头，目前只有 errno
+#define ULIB_ERRNO_VA  ULIB_DATA_VA
+
+#ifndef __ASSEMBLER__
+// 位于代码段开头，由 user/ulibjmp.S 与链接脚本填写，内核载入时据此校验
+struct ulib_header {
+    unsigned int magic;       // ULIB_MAGIC
+    unsigned int nslot;       // 跳转表槽数
+    unsigned int text_size;   // 代码段（含镜像头、跳转表与只读数据）字节数
+    unsigned int data_size;   // 已初始化数据字节数
+    unsigned int mem_size;    // 数据与 bss 合计占用的字节数
+    unsigned int reserved[3];
+};
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+// 批量系统调用提交环，内核与用户态共用。环位于用户内存中（须可写），由 uring_setup 登记，
+// 用户态填写提交项（sqe）并推进 sq_tail，随后调用一次 uring_enter 让内核按顺序批量执行；
+// 内核把结果写入完成项（cqe）并推进 cq_tail，用户态直接读取完成项、推进 cq_head，无需再次陷入。
+// 下标均为自由增长的计数，取模 URING_ENTRIES 得到槽位
+#define URING_ENTRIES 32
+
+#define URING_OP_NOP   0
+#define URING_OP_READ  1   // fd, addr, len：同 read
+#define URING_OP_WRITE 2   // fd, addr, len：同 write
+#define URING_OP_OPEN  3   // addr 为路径，flags 为打开模式：同 open，结果为新 fd
+#define URING_OP_CLOSE 4   // fd：同 close
+#define URING_OP_FSYNC 5   // fd：等待此前的修改提交到日志（见 fsync）
+
+struct uring_sqe {
+    int op;                   // URING_OP_*
+    int fd;
+    unsigned long addr;       // 缓冲区或路径的用户地址
+    int len;
+    int flags;
+    unsigned long user_data;  // 原样带回到对应的完成项
+};
+
+struct uring_cqe {
+    unsigned long user_data;
+    long res;                 // 与对应系统调用的返回值相同，失败为 -1
+};
+
+struct uring {
+    volatile unsigned int sq_head;   // 内核已取走的提交项
+    volatile unsigned int sq_tail;   // 用户已提交的提交项
+    volatile unsigned int cq_head;   // 用户已收割的完成项
+    volatile unsigned int cq_tail;   // 内核已写入的完成项
+    struct uring_sqe sq[URING_ENTRIES];
+    struct uring_cqe cq[URING_ENTRIES];
+};
@@ -3,8 +3,30 @@
 
 #include <stdarg.h>
 #include "fcntl.h"
+#include "meminfo.h"
+#include "sched.h"
+#include "wait.h"
+#include "vdso.h"
+#include "uring.h"
+#include "bcachestat.h"
+#include "rusage.h"
+#include "perf.h"
+#include "iostat.h"
+#include "getdents.h"
+#include "scstat.h"
+#include "uio.h"
+#include "poll.h"
+#include "benchstat.h"
+#include "prof.h"
+#include "socket.h"
+#include "lockstat_flags.h"
+#include "allocprof_flags.h"
+#include "irqstat.h"
+#include "idlestat.h"
+#include "metricstat.h"
 
 #define SBRK_ERROR ((char *)-1)
+#define MAP_FAILED ((void *)-1)
 
 //
 // 用户态标准库最小化声明，提供：
@@ -39,6 +61,29 @@ int fork(void);
 // 等待任意子进程结束，可选地写回其退出码
 int wait(int *status);
 
+// 等待子进程 pid（不大于 0 表示任意子进程）结束；options 含 WNOHANG 时若尚未退出立即返回 0
+int waitpid(int pid, int *status, int options);
+
+// 同 waitpid，ru 不为 0 时写入被回收子进程（含其已回收后代）的资源使用
+int wait4(int pid, int *status, int options, struct rusage *ru);
+
+// 读取资源使用：who 为 RUSAGE_SELF、RUSAGE_CHILDREN 或某个进程的 PID
+int getrusage(int who, struct rusage *ru);
+
+// 读取至多 n 个进程的快照，返回写入的项数
+int procinfo(struct procinfo *buf, int n);
+
+// 关机，code 作为 QEMU 的退出码（0 为正常）；成功时不返回
+int poweroff(int code);
+
+// 读取硬件性能计数：who 为 PERF_SELF、PERF_CHILDREN 或某个进程的 PID
+int perf_read(int who, struct perfcount *pc);
+// 读取 I/O 统计（见 iostat.h）：who 为 IOSTAT_SELF、IOSTAT_CHILDREN 或某个进程的 PID
+int iostat(int who, struct proc_iostat *st);
+
+// 从目录 fd 的当前位置读出至多 n 个目录项，返回项数，读完时为 0；flags 可含 GETDENTS_STAT
+int getdents(int fd, struct dirent_info *buf, int n, int flags);
+
 // 结束指定 PID 的进程
 int kill(int pid);
 
@@ -57,11 +102,106 @@ int mknod(const char *path, int major, int minor, int type);
 int chdir(const char *path);
 
 int exec(const char *path, char *const argv[]);
+// 创建子进程并直接运行 path 指定的程序（等价于 fork+exec，但不复制地址空间），返回子进程 PID
+int spawn(const char *path, char *const argv[]);
 
 void *sbrk(int increment);
+// 建立内存映射（匿名共享/私有区或只读文件映射），失败返回 MAP_FAILED
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+// 解除 [addr, addr+length) 的映射
+int munmap(void *addr, size_t length);
+// 读取内存统计信息，rss_pages 对应 pid 指定的进程（0 表示自身）
+int meminfo(int pid, struct meminfo *info);
+// 设置进程的调度类（SCHED_MLFQ/SCHED_FIFO/SCHED_FAIR）与参数，pid 为 0 表示自身
+int sched_setattr(int pid, const struct sched_attr *attr);
+// 读取调度统计，进程相关字段对应 pid 指定的进程（0 表示自身）
+int schedstat(int pid, struct schedstat *st);
+// 限定进程只在 mask 中的 hart（第 i 位对应 hart i）上运行，pid 为 0 表示自身；不存在的 hart 被忽略
+int sched_setaffinity(int pid, unsigned long mask);
+// 读取进程允许运行的 hart 位图
+int sched_getaffinity(int pid, unsigned long *mask);
+// 创建共享地址空间、打开文件与当前目录的线程（flags 须为 CLONE_THREAD_FLAGS），返回线程 PID。
+// 线程在 stack 上执行 fn(arg)，fn 不能返回，结束时调用 exit
+int clone(void (*fn)(void *), void *stack, int flags, void *arg);
+// *addr 仍等于 val 时睡眠，直到其他线程对同一地址调用 futex_wake；值已改变时返回 -1
+int futex_wait(volatile int *addr, int val);
+// 同 futex_wait，但最多等待 timeout_us 微秒，超时返回 -1；负数表示一直等待
+int futex_timedwait(volatile int *addr, int val, long timeout_us);
+// 唤醒在 addr 上等待的至多 n 个线程，返回唤醒的个数
+int futex_wake(volatile int *addr, int n);
+// 在控制台打印内核锁竞争统计；flags 含 LOCKSTAT_IRQSOFF 时改为把最长的关中断区间写入 klog，
+// 含 LOCKSTAT_RESET 时随后清零
+int lockstat(int flags);
+// 在控制台打印内核各分配调用点的页与 slab 对象用量；flags 含 ALLOCPROF_RESET 时随后重置高水位
+int allocprof(int flags);
+// 读取至多 n 项中断与下半部的耗时统计（见 irqstat.h），返回写入的项数；reset 非 0 时随后清零
+int irqstat(struct irq_stat *st, int n, int reset);
+// 读取至多 n 个 hart 的空闲统计（见 idlestat.h），返回写入的项数；reset 非 0 时随后清零
+int idlestat(struct idle_stat *st, int n, int reset);
+// us >= 0 时把空闲轮询窗口（目标唤醒延迟）设为 us 微秒，0 表示直接 wfi；返回当前窗口
+int idlepoll(int us);
+// 读取至多 n 项内核指标的快照（见 metricstat.h），按登记顺序排列，返回写入的项数
+int metrics_read(struct metric_stat *buf, int n);
+// 登记批量提交环（见 uring.h），清零其下标
+int uring_setup(struct uring *ring);
+// 让内核执行全部已提交的提交项，返回本次处理的个数；完成项直接从环中读取
+int uring_enter(void);
+// 读取块缓存统计（见 bcachestat.h）
+int bcachestat(struct bcachestat *st);
+// 创建管道，fds[0] 为读端，fds[1] 为写端
+int pipe(int fds[2]);
+// 从普通文件 fd_in 的当前偏移搬运至多 n 个字节到管道 fd_out，不经用户缓冲区；返回搬运的字节数，文件结束时返回 0
+int splice(int fd_in, int fd_out, int n);
+// 等待此前的修改提交到日志，返回后可在崩溃后恢复（异步提交模式下才需要，同步模式下立即返回）
+int fsync(int fd);
+// 数据与元数据同在一个日志中，与 fsync 相同
+int fdatasync(int fd);
+// 为 [off, off + len) 预留磁盘块（区段格式下连续），文件大小不变，之后追加写入时不再分配块
+int fallocate(int fd, long off, long len);
+// 截断 dst_fd 后让它与 src_fd 共享全部数据块，任一方之后改写某块时才复制（需 mkfs -r）
+int clone_file(int src_fd, int dst_fd);
+// 读取系统调用号 0~n-1 的累计统计（见 scstat.h），返回写入的个数；reset 非 0 时随后清零
+int scstat(struct syscall_stat *st, int n, int reset);
+// 设置进程 pid（0 表示自身）的系统调用跟踪掩码，第 i 位对应系统调用 i，随 fork/spawn 继承
+int strace(int pid, unsigned long mask);
+// 取出至多 n 条最旧的跟踪记录，返回取出的条数
+int straceread(struct strace_rec *buf, int n);
+// 分散读：依次填充 iov 的 cnt 段（至多 IOV_MAX 段），返回读到的总字节数
+int readv(int fd, const struct iovec *iov, int cnt);
+// 集中写：依次写出 iov 的各段，普通文件在一次事务中完成（过大时分批），返回写入的总字节数
+int writev(int fd, const struct iovec *iov, int cnt);
+// 在偏移 off 处读写普通文件，不改变文件的当前偏移
+int pread(int fd, void *buf, int n, long off);
+int pwrite(int fd, const void *buf, int n, long off);
+// 在内核中把 in_fd 的至多 n 个字节写到 out_fd；off 为 -1 时使用并推进 in_fd 的偏移。返回搬运的字节数
+int sendfile(int out_fd, int in_fd, long off, int n);
+// 等待 fds 中的 nfds 个描述符（至多 NPOLLFD 个）之一就绪，timeout 为最长等待的 tick 数，
+// 0 只检查一次，负数一直等待。返回就绪的描述符个数，超时返回 0
+int poll(struct pollfd *fds, int nfds, int timeout);
+// 同 poll，timeout_us 以微秒计，不受 tick 精度限制
+int poll_us(struct pollfd *fds, int nfds, long timeout_us);
+// 运行名称为 name 的内核微基准（name 为 0 或空串时运行全部），至多 max 个结果写入 res，返回运行的个数
+int kbench(const char *name, struct bench_result *res, int max);
+// 以每秒 hz 次（至多 PROF_HZ_MAX）的频率采样各 hart 被中断处的 pc，0 关闭；返回此前因缓冲区满丢弃的样本数
+int prof(int hz);
+// 取出至多 n 个采样样本，返回取出的个数
+int profread(struct prof_sample *buf, int n);
+// 把内核跟踪点记录按时间顺序打印到控制台，返回打印的条数
+int tracedump(void);
+// 创建套接字，目前只支持 AF_INET/SOCK_DGRAM（UDP）
+int socket(int domain, int type, int protocol);
+// 绑定本地端口，sin_port 为 0 时分配临时端口；未绑定的套接字首次发送时自动绑定
+int bind(int fd, const struct sockaddr_in *addr);
+// 向 to 发送一个数据报，返回发送的字节数
+int sendto(int fd, const void *buf, int n, int flags, const struct sockaddr_in *to);
+// 接收一个数据报（超出 n 的部分丢弃），from 不为 0 时填入来源地址；flags 可含 MSG_DONTWAIT
+int recvfrom(int fd, void *buf, int n, int flags, struct sockaddr_in *from);
 uint64_t get_time(void);
 uint64_t get_ticks(void);
 int sleep(int ticks);
+// 睡眠至少 ns 纳秒 / us 微秒，由内核高精度定时器计时，不必凑整到 tick
+int nanosleep(uint64_t ns);
+int usleep(unsigned int us);
 int get_priority_level(void);
 int set_crash_stage(int stage);
 int recover_log(void);
@@ -73,6 +213,12 @@ int klog_set_threshold(int record_level, int console_level);
 int printf(const char *fmt, ...);
 int fprintf(int fd, const char *fmt, ...);
 int vprintf(int fd, const char *fmt, va_list ap);
+int snprintf(char *buf, int size, const char *fmt, ...);
+int vsnprintf(char *buf, int size, const char *fmt, va_list ap);
+// 输出经由每个描述符的流缓冲：0~2 行缓冲，其余全缓冲。fwrite 写入缓冲，fflush 写出 fd 的
+// 缓冲（fd 为负数时写出全部）；close、fork、exec、exit 前与读取标准输入前自动刷新
+int fwrite(int fd, const void *buf, int n);
+int fflush(int fd);
 
 char* strchr(const char*, char c);
 char* gets(char*, int max);
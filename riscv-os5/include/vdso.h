@@ -0,0 +1,24 @@
+#pragma once
+
+// vDSO 数据页，内核与用户态共用。内核把两页只读（PTE_U、无 PTE_W）映射进每个用户地址空间：
+//   - VDSO_DATA_VA：全体进程共享的一页，由时钟中断更新 ticks；
+//   - VDSO_PROC_VA：每个进程（线程组）一页，存放 pid 等进程内不变的值。
+// 用户态据此把 getpid、ticks、time 变成普通的内存读取（time 直接用 rdtime）。
+//
+// 地址紧挨在 TRAPFRAME 与线程陷阱帧槽位之下：MAXVA = 2^38，顶端依次为
+// TRAMPOLINE、TRAPFRAME、64 个 TRAPFRAME_SLOT，见 memlayout.h
+#define VDSO_DATA_VA ((1UL << 38) - (2 + 64 + 1) * 4096UL)
+#define VDSO_PROC_VA (VDSO_DATA_VA - 4096UL)
+
+struct vdso_data {
+    volatile unsigned long seq;        // 顺序锁：奇数表示内核正在更新，读者需重试
+    volatile unsigned long ticks;      // tick_time 时刻的 ticks
+    volatile unsigned long tick_time;  // 最近一个 tick 边界对应的 time 值
+    unsigned long tick_interval;       // 每个 tick 对应的 time 计数
+    unsigned long timebase_freq;       // time CSR 的频率（Hz）
+};
+
+struct vdso_proc {
+    int pid;        // 进程号
+    int threaded;   // 曾创建过线程：各线程 pid 不同，getpid 须走系统调用
+};
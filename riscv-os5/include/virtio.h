@@ -24,6 +24,13 @@
 #define VIRTIO_MMIO_DRIVER_DESC_HIGH    0x094
 #define VIRTIO_MMIO_DEVICE_DESC_LOW     0x0a0
 #define VIRTIO_MMIO_DEVICE_DESC_HIGH    0x0a4
+#define VIRTIO_MMIO_CONFIG              0x100   // 设备配置空间起始
+
+// virtio-blk 配置空间中 num_queues（uint16）的偏移，VIRTIO_BLK_F_MQ 协商成功时有效
+#define VIRTIO_BLK_CFG_NUM_QUEUES       34
+// VIRTIO_BLK_F_DISCARD 协商成功时有效：单段至多丢弃的扇区数、单个请求至多携带的段数（均为 uint32）
+#define VIRTIO_BLK_CFG_MAX_DISCARD_SECTORS 36
+#define VIRTIO_BLK_CFG_MAX_DISCARD_SEG     40
 
 // 状态寄存器标志位
 #define VIRTIO_CONFIG_S_ACKNOWLEDGE     1
@@ -36,12 +43,19 @@
 #define VIRTIO_BLK_F_SCSI            7
 #define VIRTIO_BLK_F_CONFIG_WCE     11
 #define VIRTIO_BLK_F_MQ             12
+#define VIRTIO_BLK_F_DISCARD        13
 #define VIRTIO_F_ANY_LAYOUT         27
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
 
-// 简化：一次传输最多占用 8 个描述符（需为 2 的幂）
-#define VIRTIO_RING_NUM 8
+// 队列长度（需为 2 的幂）：单块请求占 3 个描述符，64 个描述符可同时在途 21 个请求
+#define VIRTIO_RING_NUM 64
+// 一个请求最多覆盖的连续块数：请求头 + VIRTIO_MAX_SEGS 个数据描述符 + 状态描述符
+#define VIRTIO_MAX_SEGS 8
+// 启用事件索引时，攒够这么多个完成（或在途请求全部完成）才要求设备发中断
+#define VIRTIO_IRQ_BATCH 8
+// 最多启用的虚拟队列数（每个 hart 一个）
+#define VIRTIO_MAX_QUEUES 8
 
 // 描述符结构体定义
 struct virtq_desc {
@@ -58,7 +72,7 @@ struct virtq_avail {
     uint16 flags;
     uint16 idx;
     uint16 ring[VIRTIO_RING_NUM];
-    uint16 unused;
+    uint16 used_event;   // 事件索引：设备在已用环下标越过此值后才发中断
 };
 
 // 已用环：设备写回已完成的描述符编号
@@ -71,11 +85,13 @@ struct virtq_used {
     uint16 flags;
     uint16 idx;
     struct virtq_used_elem ring[VIRTIO_RING_NUM];
+    uint16 avail_event;  // 事件索引：驱动在可用环下标越过此值后才需通知设备
 };
 
 // 块设备请求头（第一个描述符承载）
 #define VIRTIO_BLK_T_IN  0
 #define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_DISCARD 11
 
 struct virtio_blk_req {
     uint32 type;
@@ -83,6 +99,17 @@ struct virtio_blk_req {
     uint64 sector;
 };
 
+// 丢弃请求的数据区是若干段这样的区间（设备只读）
+struct virtio_blk_discard {
+    uint64 sector;
+    uint32 num_sectors;
+    uint32 flags;        // 丢弃请求中须为 0
+};
+
 struct buf;
 void virtio_disk_init(void);
 void virtio_disk_rw(struct buf *b, int write);
+void virtio_disk_submit(struct buf *b, int write, void (*done)(struct buf *));
+void virtio_disk_submit_segs(struct buf **bs, int n, int write, void (*done)(struct buf *));
+void virtio_disk_wait(struct buf *b);
+void virtio_disk_intr(void);
@@ -2,6 +2,15 @@
 #include "riscv.h"
 
 extern pagetable_t kernel_pagetable;
+extern int tlb_use_asid;   // 硬件 ASID 位数足够、进程按需分配独立 ASID 时为 1
+extern void *zero_page;    // 全局共享的全零页，未写过的按需页在读缺页时只读映射它
+
+struct proc;
+struct file;
+
+// 按需分配：为 1 时 sbrk 只扩大地址空间上限、exec 不预先分配纯 BSS 页，
+// 页面在首次访问的缺页（或 copyin/copyout）时才分配；为 0 时退回立即分配。
+#define LAZY_ALLOC 1
 
 void kvminit(void);
 void kvminithart(void);
@@ -9,23 +18,76 @@ void kvminithart(void);
 pagetable_t create_pagetable(void);
 void destroy_pagetable(pagetable_t pt);
 pte_t* walk_lookup(pagetable_t pt, uint64 va);
+pte_t* walk_lookup_level(pagetable_t pt, uint64 va, int *level);
 pte_t* walk_create(pagetable_t pt, uint64 va);
 int map_page(pagetable_t pt, uint64 va, uint64 pa, int perm);
 int map_region(pagetable_t pagetable, uint64 va, uint64 pa,uint64 size, int perm);
-void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free);
+int uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free);
 uint64 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz);
 uint64 uvmalloc_perm(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int perm);
 uint64 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz);
 // 将父进程的页表内容拷贝到子进程
 int uvmcopy(pagetable_t old, pagetable_t newp, uint64 sz);
 int cow_resolve(pagetable_t pagetable, uint64 faultva); // 写时复制缺页处理
+int lazy_resolve(pagetable_t pagetable, uint64 faultva, int write); // 按需分配缺页处理
 // 从用户空间取数据到内核缓冲区
 int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len);
 // 将内核缓冲区写回用户空间
 int copyout(pagetable_t pagetable, uint64 dstva, const char *src, uint64 len);
+int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max);
+uint64 uvm_user_pa(pagetable_t pagetable, uint64 va, int write);
+
+// 缺页记账：缺页入口（usertrap 与 copyin/copyout 的地址转换）先调用 fault_begin，
+// 解析函数成功时以 fault_note 记下类别，入口在缺页解决后调用 fault_end 计入当前进程的
+// rusage。没有记下类别的（如只是补 A 位或刷新陈旧的 TLB 项）不计数。
+// FAULT_TRACE 为 1 时 fault_end 另写一条 PAGE_FAULT 跟踪记录：va、sepc、类别
+// （copyin/copyout 中的再或上 FAULT_UACCESS）与解析耗费的周期数
+#ifndef FAULT_TRACE
+#define FAULT_TRACE 0
+#endif
+#define FAULT_COW     1
+#define FAULT_LAZY    2
+#define FAULT_MINOR   3
+#define FAULT_MAJOR   4
+#define FAULT_UACCESS 8
+uint64 fault_begin(void);
+void fault_note(int kind);
+void fault_end(uint64 va, uint64 sepc, uint64 start, int uaccess);
 
 // 用户地址空间相关辅助函数
 void uvmfirst(pagetable_t pagetable, const uint8 *src, uint64 sz);
 void uvmfree(pagetable_t pagetable, uint64 sz);
+void uvm_reset(pagetable_t pagetable);
+pagetable_t uvm_detach(pagetable_t pagetable);   // 摘下用户映射交给回收线程，内存不足时返回 0
+
+void dump_pagetable(pagetable_t pt, int level);
+
+// 内存统计（meminfo 系统调用）
+struct meminfo;
+uint64 uvm_rss(pagetable_t pagetable);
+void vm_meminfo(struct meminfo *mi);
+
+// TLB 刷新批处理：修改当前进程页表后登记失效的虚拟页，返回用户态前统一刷新
+void tlb_invalidate_page(pagetable_t pagetable, uint64 va);
+void tlb_invalidate_all(pagetable_t pagetable);
+void tlb_upgrade_page(pagetable_t pagetable, uint64 va);   // 只放宽了权限，其他 hart 无需 IPI
+void tlb_sync(struct proc *p);
+void tlb_reset(struct proc *p);
+int uvm_spurious_fault(pagetable_t pagetable, uint64 va, int write);
+
+// 远程 TLB 刷新：页表正被其他 hart 上的同组线程使用时，经核间中断让它们立即刷新
+void tlb_shootdown(uint64 mask);
+void tlb_ipi_service(void);
+void tlb_batch_begin(void);
+void tlb_batch_flush(void);
+void tlb_batch_end(void);
+int asid_alloc(void);
+void asid_free(int asid);
 
-void dump_pagetable(pagetable_t pt, int level);
\ No newline at end of file
+// mmap 映射区管理（kernel/mm/mmap.c）
+uint64 mmap_create(uint64 len, int prot, int flags, struct file *f, uint64 off);
+int mmap_remove(uint64 addr, uint64 len);
+int mmap_resolve(struct proc *p, uint64 faultva);   // 映射区缺页处理
+int mmap_fork(struct proc *p, struct proc *np);
+void mmap_release(struct proc *p);
+int mmap_reclaim(int target);   // 内存紧张时丢弃干净的文件映射页
\ No newline at end of file
@@ -0,0 +1,4 @@
+#pragma once
+
+// waitpid 的选项，需在内核与用户态之间保持一致
+#define WNOHANG 0x1   // 指定的子进程都未退出时立即返回 0，而不是睡眠等待
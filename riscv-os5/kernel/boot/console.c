@@ -4,31 +4,53 @@
 #include "console.h"
 #include "proc.h"
 #include "vm.h"
+#include "spinlock.h"
+#include "memlayout.h"
+#include "plic.h"
+#include "poll.h"
+#include "pollwait.h"
+#include "string.h"
 
 // console.c 负责将文件系统/printf 的输出汇聚到 UART，对上层表现为标准字符设备。
-// 当前仅实现输出路径（write），输入路径返回错误以提醒调用者。未来若接入键盘
-// 或串口接收，只需补齐 consoleread 即可。
+// 内核 printf 按行、用户写入按 128 字节的块整体放进 UART 发送环后立即返回，panic 时才同步输出。
+// 输入由 UART 中断送入 console_intr，在中断路径完成行编辑与回显，
+// 整行就绪后才唤醒在 consoleread 中睡眠的读者与 poll 等待者。
+
+#define INPUT_BUF_SIZE 128
+#define C(x) ((x) - '@')   // Control-x
+
+static struct {
+    struct spinlock lock;
+    char buf[INPUT_BUF_SIZE];
+    uint r;   // 读者的读取位置
+    uint w;   // 已提交（可供读取）的末尾
+    uint e;   // 正在编辑的行的末尾
+    int esc;  // 尚待丢弃的转义序列字节数
+    struct pollq pollq;  // poll 等待者，提交整行时通知
+} cons;
+
+// 登记 UART 中断并打开收发中断，在 PLIC 初始化之后调用
+void consoleinit(void)
+{
+    initlock(&cons.lock, "cons");
+    uart_intr_init();
+    plic_register(UART0_IRQ, "uart", uart_intr, 1);
+}
 
-// 输出单个字符到控制台。当前直接透传到 UART，后续若接入更复杂的输出设备，
-// 该函数是首要替换点。
+// 输出单个字符到控制台。内核输出放入发送环但不睡眠，可在持锁或中断中调用。
 void console_putc(char c) {
-    uart_putc(c);
+    uart_write(&c, 1, 0);
 }
 
-// 输出以 \0 结尾的字符串到控制台。通过逐字节调用 console_putc，保持与底层输出
-// 解耦，并为之后可能的缓冲或流控提供空间。
+// 输出以 \0 结尾的字符串到控制台，整串一次放入发送环。
 void console_puts(const char *s) {
-    while(*s) {
-        console_putc(*s++);
-    }
+    console_write(s, strlen(s));
 }
 
-// 将原始缓冲区内容逐字节写入控制台。相比 printf，这里跳过格式化逻辑，直接
+// 将原始缓冲区内容整体写入控制台。相比 printf，这里跳过格式化逻辑，直接
 // 发送原始字节，供文件系统写入等场景复用。
 void console_write(const char *s, int len) {
-    for(int i = 0; i < len; i++) {
-        console_putc(s[i]);
-    }
+    uart_write(s, len, 0);
 }
 
 // 以下三个辅助函数提供简单的 ANSI 转义控制，便于在调试时清屏、移动光标。
@@ -66,17 +88,61 @@ int consolewrite(int user_src, uint64 src, int n)
         if(user_src) {
             if(p == 0 || copyin(p->pagetable, buf, src + tot, m) < 0)
                 return -1;
-            console_write(buf, m);
+            uart_write(buf, m, 1);
         } else {
-            const char *kptr = (const char *)(src + tot);
-            console_write(kptr, m);
+            uart_write((const char *)(src + tot), m, 1);
         }
         tot += m;
     }
     return n;
 }
 
-// 从控制台设备读取 n 个字符到 dst（用户或内核空间），返回实际读取字节数
+// 回显退格：擦掉终端上的前一个字符
+static void echo_backspace(void)
+{
+    uart_putc_sync('\b');
+    uart_putc_sync(' ');
+    uart_putc_sync('\b');
+}
+
+// UART 接收中断逐字符调用：处理退格、Ctrl-U 删除整行、丢弃方向键等转义序列，
+// 遇到换行、Ctrl-D 或缓冲区满时提交整行并唤醒读者
+void console_intr(int c)
+{
+    acquire(&cons.lock);
+
+    if(cons.esc > 0){
+        cons.esc--;
+    } else if(c == '\033'){           // ESC：丢弃其后的 '[' 与方向字符
+        cons.esc = 2;
+    } else if(c == C('U')){
+        while(cons.e != cons.w && cons.buf[(cons.e - 1) % INPUT_BUF_SIZE] != '\n'){
+            cons.e--;
+            echo_backspace();
+        }
+    } else if(c == '\b' || c == 0x7f){
+        if(cons.e != cons.w){
+            cons.e--;
+            echo_backspace();
+        }
+    } else if(c != 0 && cons.e - cons.r < INPUT_BUF_SIZE){
+        if(c == '\r')                   // 回车符转换为换行符
+            c = '\n';
+        if(c != C('D'))
+            uart_putc_sync(c);
+        cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
+        if(c == '\n' || c == C('D') || cons.e - cons.r == INPUT_BUF_SIZE){
+            cons.w = cons.e;
+            wakeup(&cons.r);
+            poll_notify(&cons.pollq);
+        }
+    }
+
+    release(&cons.lock);
+}
+
+// 从控制台设备读取至多 n 个字符到 dst（用户或内核空间），返回实际读取字节数。
+// 没有完整的输入行时睡眠，直到 console_intr 提交一行；每次最多返回一行
 int consoleread(int user_dst, uint64 dst, int n)
 {
     if(n <= 0)
@@ -85,44 +151,52 @@ int consoleread(int user_dst, uint64 dst, int n)
     struct proc *p = myproc();
     int i = 0; // 已读取字节数
 
+    acquire(&cons.lock);
     while(i < n) {
-        int ch = uart_getc();      // 从 UART 设备获取一个字符（阻塞等待输入）
-        char c = (char)ch;
-
-        if(c == '\033') { // ESC
-            // 读取后续字符，丢弃整个序列
-            uart_getc(); // 可能是 '['
-            uart_getc(); // 可能是 'A'/'B'/'C'/'D'
-            continue;
+        while(cons.r == cons.w) {
+            if(p == 0 || killed(p)) {
+                release(&cons.lock);
+                return -1;
+            }
+            sleep(&cons.r, &cons.lock);
         }
-        if(c == '\r')              // 回车符转换为换行符
-            c = '\n';
 
-        // 处理退格键（\b 或 DEL）
-        if(c == '\b' || c == 0x7f) {
-            if(i > 0) {
-                i--;
-                console_write("\\b \\b", 3);
-            }
-            continue;
+        char c = cons.buf[cons.r++ % INPUT_BUF_SIZE];
+
+        if(c == C('D')) {          // 文件结束
+            if(i > 0)
+                cons.r--;          // 留到下次读取时返回 0
+            break;
         }
 
         // 写入到目标缓冲区
         if(user_dst) {
             // 拷贝到用户空间
-            if(p == 0 || copyout(p->pagetable, dst + i, &c, 1) < 0)
+            if(copyout(p->pagetable, dst + i, &c, 1) < 0)
                 break;             // 拷贝失败则退出
         } else {
             // 拷贝到内核空间
             ((char *)dst)[i] = c;
         }
-        // 回显输入字符到控制台
-        console_putc(c);
         i++;
 
         if(c == '\n')
             break;
     }
+    release(&cons.lock);
 
     return i;
 }
+
+// consolepoll: 有已提交的输入行时可读；输出进入发送环，总是视为可写
+int consolepoll(struct poll_table *pt)
+{
+    int mask = POLLOUT;
+
+    poll_wait(&cons.pollq, pt);
+    acquire(&cons.lock);
+    if(cons.r != cons.w)
+        mask |= POLLIN;
+    release(&cons.lock);
+    return mask;
+}
@@ -1,34 +1,138 @@
 #include "uart.h"
 #include "kalloc.h"
+#include "slab.h"
+#include "rmap.h"
+#include "radix.h"
 #include "vm.h"
 #include "printf.h"
 #include "buf.h"
 #include "virtio.h"
+#include "blkdev.h"
 #include "fs.h"
+#include "log.h"
 #include "file.h"
+#include "pipe.h"
+#include "pollwait.h"
+#include "net.h"
+#include "pcache.h"
+#include "exec.h"
+#include "swap.h"
 #include "console.h"
 #include "klog.h"
 
 #include "trap.h"
+#include "plic.h"
+#include "softirq.h"
 #include "proc.h"
+#include "syscall.h"
+#include "bench.h"
+
+// 启动各阶段结束时的 time CSR 读数。klog 初始化之前的阶段也先记在这里，
+// 进入调度器前统一写入 klog，用 klog 设备或 klog_dump 即可查看启动耗时分布
+#define BOOT_STAGES_MAX 16
+
+static struct {
+    const char *name;
+    uint64 time;
+} boot_stages[BOOT_STAGES_MAX];
+static int nboot_stages;
+static uint64 boot_start;
+
+static void boot_mark(const char *name) {
+    if (nboot_stages < BOOT_STAGES_MAX) {
+        boot_stages[nboot_stages].name = name;
+        boot_stages[nboot_stages].time = get_time();
+        nboot_stages++;
+    }
+}
+
+static void boot_report(void) {
+    uint64 prev = boot_start;
+    for (int i = 0; i < nboot_stages; i++) {
+        uint64 t = boot_stages[i].time;
+        klog_info("启动阶段 %s: %u us（累计 %u us）", boot_stages[i].name,
+                  (uint)((t - prev) / (TIMEBASE_FREQ / 1000000)),
+                  (uint)((t - boot_start) / (TIMEBASE_FREQ / 1000000)));
+        prev = t;
+    }
+}
+
+// hart 0 完成全局初始化后置 1，其余 hart 在此之前停在 main 开头等待
+static volatile int started = 0;
+
+// 非 0 号 hart：等待全局初始化完成，再做本 hart 私有的设置并进入调度器。
+// 没有 SBI 固件（QEMU -bios none），各 hart 复位后同时从 _entry 启动，
+// start() 已在 M 态为每个 hart 设置好委托、PMP 与 sstc 定时器
+static void secondary_main(void) {
+    while (__atomic_load_n(&started, __ATOMIC_ACQUIRE) == 0)
+        ;
+    kvminithart();
+    trap_inithart();
+    plic_inithart();
+    klog_info("hart %d 启动", cpuid());
+    scheduler();
+}
 
 int main() {
+    if (cpuid() != 0)
+        secondary_main();
+
+    boot_start = get_time();
     uartinit();
+    boot_mark("uart");
     pmm_init();
+    boot_mark("pmm");
+    kmem_cache_init();
+    radix_tree_init();
+    rmap_init();
+    boot_mark("slab");
     kvminit();
     kvminithart();
+    boot_mark("kvm");
+    vdso_init();
+    ulib_init();
+    plic_init();
+    plic_inithart();
     trap_init();
+    prof_init();
+    syscall_init();
+    bench_init();
+    consoleinit();
+    boot_mark("trap");
     virtio_disk_init();
+    iosched_init(ROOTDEV);
+    ramdisk_init();          // RAMDISK=1 时以内存盘取代 virtio 磁盘作为根设备
+    boot_mark("virtio");
     bcache_init();
+    pcache_init();
+    exec_cache_init();
+    boot_mark("cache");
     klog_init();
     klog_info("内核日志框架初始化完成");
     fs_init();
+    boot_mark("fs");
     fileinit();
+    pipeinit();
+    pollinit();
+    net_init();
     devsw[CONSOLE].write = consolewrite;
     devsw[CONSOLE].read = consoleread;
+    devsw[CONSOLE].poll = consolepoll;
+    devsw[KLOG].fread = klogread;
     procinit();
     userinit();
+    iosched_start();
+    log_start_flusher();
+    fs_reclaim_orphans();
+    swap_init();
+    reaper_init();
+    softirq_start();
+    boot_mark("proc");
+#if KTEST_AT_BOOT || BENCH_AT_BOOT
     schedule_kernel_tests();
+#endif
+    boot_report();
+    __atomic_store_n(&started, 1, __ATOMIC_RELEASE);
     
     printf("Starting scheduler...\n");
     //klog_dump();
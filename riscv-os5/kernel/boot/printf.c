@@ -1,19 +1,56 @@
 #include <stdarg.h>
 #include "types.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "uart.h"
 #include "console.h"
+#include "memlayout.h"
+
+// 内核 printf 先在关中断期间格式化到本 hart 的行缓冲，遇到换行、缓冲写满或调用结束时
+// 把整段一次放进 UART 发送环，同一行不会与其他 hart 或进程的输出交错。
+// panic 之后改为逐字节同步输出，不再依赖发送锁与发送中断。
+
+#define PRINTF_LINE 256
+
+struct printbuf {
+  int n;
+  char buf[PRINTF_LINE];
+};
+
+static struct printbuf pbufs[NCPU];
+static volatile int panicking;
 
 static char digits[] = "0123456789abcdef";
 
-static void print_number(int num, int base, int sign) {
+static void pflush(struct printbuf *pb)
+{
+  if(pb->n == 0)
+    return;
+  if(panicking) {
+    for(int i = 0; i < pb->n; i++)
+      uart_putc_sync(pb->buf[i]);
+  } else {
+    uart_write(pb->buf, pb->n, 0);
+  }
+  pb->n = 0;
+}
+
+static void pputc(struct printbuf *pb, char c)
+{
+  pb->buf[pb->n++] = c;
+  if(c == '\n' || pb->n == PRINTF_LINE)
+    pflush(pb);
+}
+
+static void print_number(struct printbuf *pb, long long num, int base, int sign) {
     char buf[32];
     int i;
-    unsigned int x;
+    unsigned long long x;
 
-    // 处理 INT_MIN
-    if(sign && (sign=(num < 0))) {
-        x = (unsigned int)(-(long long)num); // 防止溢出
+    if(sign && (sign = (num < 0))) {
+        x = -(unsigned long long)num; // 对最小负数同样成立
     } else {
-        x = (unsigned int)num;
+        x = (unsigned long long)num;
     }
 
     i=0;
@@ -28,16 +65,16 @@ static void print_number(int num, int base, int sign) {
 
     // 逆序输出
     while(--i >= 0)
-        console_putc(buf[i]);
+        pputc(pb, buf[i]);
 }
 
-static void printptr(uint64 x)
+static void printptr(struct printbuf *pb, uint64 x)
 {
   int i;
-  console_putc('0');
-  console_putc('x');
+  pputc(pb, '0');
+  pputc(pb, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    console_putc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    pputc(pb, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 int printf(const char *fmt, ...)
@@ -46,10 +83,13 @@ int printf(const char *fmt, ...)
   int i, cx, c0, c1, c2;
   char *s;
 
+  push_off();           // 格式化期间不被中断或迁移，行缓冲只属于当前 hart
+  struct printbuf *pb = &pbufs[cpuid()];
+
   va_start(ap, fmt); //初始化可变参数列表
   for(i = 0; (cx = fmt[i] & 0xff) != 0; i++){
     if(cx != '%'){
-      console_putc(cx);
+      pputc(pb, cx);
       continue;
     }
     i++;
@@ -58,49 +98,51 @@ int printf(const char *fmt, ...)
     if(c0) c1 = fmt[i+1] & 0xff;
     if(c1) c2 = fmt[i+2] & 0xff;
     if(c0 == 'd'){
-      print_number(va_arg(ap, int), 10, 1); //有符号十进制
+      print_number(pb, va_arg(ap, int), 10, 1); //有符号十进制
     } else if(c0 == 'l' && c1 == 'd'){
-      print_number(va_arg(ap, uint64), 10, 1); //长整型
+      print_number(pb, va_arg(ap, uint64), 10, 1); //长整型
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'd'){
-      print_number(va_arg(ap, uint64), 10, 1); //长长整型
+      print_number(pb, va_arg(ap, uint64), 10, 1); //长长整型
       i += 2;
     } else if(c0 == 'u'){
-      print_number(va_arg(ap, uint32), 10, 0); //无符号
+      print_number(pb, va_arg(ap, uint32), 10, 0); //无符号
     } else if(c0 == 'l' && c1 == 'u'){
-      print_number(va_arg(ap, uint64), 10, 0); 
+      print_number(pb, va_arg(ap, uint64), 10, 0); 
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'u'){
-      print_number(va_arg(ap, uint64), 10, 0);
+      print_number(pb, va_arg(ap, uint64), 10, 0);
       i += 2;
     } else if(c0 == 'x'){
-      print_number(va_arg(ap, uint32), 16, 0); //十六进制
+      print_number(pb, va_arg(ap, uint32), 16, 0); //十六进制
     } else if(c0 == 'l' && c1 == 'x'){
-      print_number(va_arg(ap, uint64), 16, 0);
+      print_number(pb, va_arg(ap, uint64), 16, 0);
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'x'){
-      print_number(va_arg(ap, uint64), 16, 0);
+      print_number(pb, va_arg(ap, uint64), 16, 0);
       i += 2;
     } else if(c0 == 'p'){
-      printptr(va_arg(ap, uint64)); //指针地址
+      printptr(pb, va_arg(ap, uint64)); //指针地址
     } else if(c0 == 'c'){
-      console_putc(va_arg(ap, uint)); //直接输出字符
+      pputc(pb, va_arg(ap, uint)); //直接输出字符
     } else if(c0 == 's'){ //字符串
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        console_putc(*s);
+        pputc(pb, *s);
     } else if(c0 == '%'){ //特别的，输出%
-      console_putc('%');
+      pputc(pb, '%');
     } else if(c0 == 0){ //结束
       break;
     } else {
-      console_putc('%');
-      console_putc(c0);
+      pputc(pb, '%');
+      pputc(pb, c0);
     }
 
   }
   va_end(ap);
+  pflush(pb);
+  pop_off();
   return 0;
 }
 
@@ -114,8 +156,22 @@ void printf_color(int color, const char *fmt, ...) {
     printf("\033[0m");        // 恢复默认颜色
 }
 
+// 送出控制台中剩余的输出后关闭机器，code 非 0 时作为 QEMU 的退出码
+void poweroff(int code)
+{
+  uart_flush_sync();
+  if(code == 0)
+    *(volatile uint32 *)VIRT_TEST = VIRT_TEST_PASS;
+  else
+    *(volatile uint32 *)VIRT_TEST = ((uint32)code << 16) | VIRT_TEST_FAIL;
+  for(;;)
+    ;
+}
+
 void panic(char *s)
 {
+  panicking = 1;
+  uart_flush_sync();    // 先送出发送环中已有的输出
   printf("panic: ");
   printf("%s\n", s);
   for(;;)
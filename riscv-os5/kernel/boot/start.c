@@ -4,11 +4,15 @@
 #include "kalloc.h"
 #include "vm.h"
 #include "assert.h"
+#include "proc.h"
+#include "perf.h"
 
 void main();
 void timerinit();
+void perfinit();
 
-__attribute__ ((aligned (16))) char stack0[4096];
+// 每个 hart 一个 4KB 启动栈，entry.S 按 mhartid 选取
+__attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 void start()
 {
@@ -37,6 +41,12 @@ void start()
   //设置定时器中断
   timerinit();
 
+  //选择性能计数器统计的事件
+  perfinit();
+
+  //把 hart 编号保存在 tp 中，供 cpuid() 使用
+  w_tp(r_mhartid());
+
   //切换到 S-mode 并跳转 main
   asm volatile("mret");
 }
@@ -49,9 +59,21 @@ void timerinit()
   // 2. 使能 sstc 扩展（允许使用 stimecmp）
   w_menvcfg(r_menvcfg() | (1L << 63));
 
-  // 3. 允许 S-mode 访问 stimecmp 和 time 寄存器
-  w_mcounteren(r_mcounteren() | 2);
+  // 3. 允许 S-mode 访问 stimecmp 和 time 寄存器，以及微基准使用的 cycle/instret；
+  //    hpmcounter3..5 见 perfinit
+  w_mcounteren(r_mcounteren() | 7);
 
   // 4. 设置下一个定时器中断的时间点
   w_stimecmp(r_time() + 1000000);
-}
\ No newline at end of file
+}
+
+// 为 hpmcounter3..5 选择事件（perf.h 中 hpm[] 的顺序）并开放给 S-mode 读取。
+// 只有 M-mode 能写 mhpmevent，之后不再改动；未实现的计数器读出恒为 0
+void perfinit()
+{
+  w_mhpmevent3(PERF_EVENT_DTLB_LOAD_MISS);
+  w_mhpmevent4(PERF_EVENT_DTLB_STORE_MISS);
+  w_mhpmevent5(PERF_EVENT_ITLB_MISS);
+  w_mcountinhibit(0);
+  w_mcounteren(r_mcounteren() | MCOUNTEREN_HPM(3) | MCOUNTEREN_HPM(4) | MCOUNTEREN_HPM(5));
+}
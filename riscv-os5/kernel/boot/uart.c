@@ -1,4 +1,9 @@
+#include "types.h"
 #include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "uart.h"
+#include "console.h"
 
 //寄存器操作的宏
 #define Reg(reg) ((volatile unsigned char *)(UART0 + (reg)))
@@ -37,24 +42,104 @@ void uartinit(void)
   // 启用并清空FIFO
   WriteReg(FCR, FCR_FIFO_ENABLE | FCR_FIFO_CLEAR);
 
-  // 启用中断
+  // 中断在 uart_intr_init 中、PLIC 登记好处理函数之后才打开
+}
+
+// 发送环：consolewrite 与内核 printf 写入后立即返回，由 THR 空中断逐字节送出。
+// 一次写入在持锁期间整体放入环中，不同写者的输出不会在中途交错
+#define UART_TX_BUF_SIZE 1024
+static struct spinlock uart_tx_lock;
+static char uart_tx_buf[UART_TX_BUF_SIZE];
+static uint64 uart_tx_w;   // 下一个写入位置，uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
+static uint64 uart_tx_r;   // 下一个发送位置
+static int uart_tx_ready;  // 发送环与发送中断已就绪，此前的输出只能走同步路径
+
+void uart_intr_init(void)
+{
+  initlock(&uart_tx_lock, "uart_tx");
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
+  uart_tx_ready = 1;
+}
+
+// 在 THR 空闲时把发送环中的字节交给硬件。调用者持有 uart_tx_lock。
+// 这里不唤醒等待空间的写者：printf 可能在持有进程锁时调用到这里，唤醒统一交给发送中断
+static void uart_start(void)
+{
+  while(uart_tx_w != uart_tx_r && (ReadReg(LSR) & LSR_THRE)){
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+    uart_tx_r++;
+  }
+}
+
+// 把 n 个字节整体放入发送环并返回。环满时 can_sleep 且有进程上下文则睡眠等待发送中断
+// 腾出空间，否则持锁轮询 THR（内核 printf 可能在持锁或中断中调用，不能睡眠）。
+// 发送环尚未就绪或本 hart 已持有发送锁（在发送路径中 panic）时退回同步输出
+void uart_write(const char *s, int n, int can_sleep)
+{
+    if(!uart_tx_ready || holding(&uart_tx_lock)){
+        for(int i = 0; i < n; i++)
+            uart_putc_sync(s[i]);
+        return;
+    }
+
+    acquire(&uart_tx_lock);
+    for(int i = 0; i < n; i++){
+        while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+            if(can_sleep && myproc())
+                sleep(&uart_tx_r, &uart_tx_lock);
+            else
+                uart_start();
+        }
+        uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = s[i];
+        uart_tx_w++;
+    }
+    uart_start();
+    release(&uart_tx_lock);
 }
 
-// 输出一个字符到串口
+// 把一个字符放入发送环，可能睡眠
 void uart_putc(char c) {
+    uart_write(&c, 1, 1);
+}
+
+// panic 时调用：不取锁，把发送环中尚未送出的字节同步写完，保证此前的输出先于 panic 信息出现
+void uart_flush_sync(void)
+{
+    while(uart_tx_r != uart_tx_w)
+        uart_putc_sync(uart_tx_buf[uart_tx_r++ % UART_TX_BUF_SIZE]);
+}
+
+// 同步输出一个字符：供 printf、panic 与中断中的回显使用，不睡眠也不依赖中断
+void uart_putc_sync(char c) {
+    push_off();
     // 等待THR空
     while (!(ReadReg(LSR) & LSR_THRE));
     WriteReg(THR,c);
+    pop_off();
 }
 
 // 输出字符串到串口
 void uart_puts(const char *s) {
-    while (*s) uart_putc(*s++);
+    while (*s) uart_putc_sync(*s++);
 }
 
+// 读取一个已到达的字符，没有输入时返回 -1
 int uart_getc(void) {
-    while(!(ReadReg(LSR) & LSR_RX_READY))
-        ;
+    if(!(ReadReg(LSR) & LSR_RX_READY))
+        return -1;
     return ReadReg(RHR);
 }
+
+// UART 中断：收下所有到达的字符交给控制台做行编辑，再继续发送环中的数据
+void uart_intr(void)
+{
+  int c;
+  while((c = uart_getc()) >= 0)
+    console_intr(c);
+
+  acquire(&uart_tx_lock);
+  uart_start();
+  if(uart_tx_w != uart_tx_r + UART_TX_BUF_SIZE)
+    wakeup(&uart_tx_r);    // 发送环有空间，唤醒等待的写者
+  release(&uart_tx_lock);
+}
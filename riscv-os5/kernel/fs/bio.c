@@ -1,28 +1,126 @@
 #include "types.h"
+#include "riscv.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "buf.h"
 #include "printf.h"
 #include "string.h"
 #include "virtio.h"
+#include "blkdev.h"
+#include "kalloc.h"
+#include "meminfo.h"
+#include "bcachestat.h"
+#include "metrics.h"
+#include "proc.h"
+#include "pcache.h"
+#include "trace.h"
 
 // buffer cache (bio.c) 为文件系统提供按块缓存，负责低层块设备读写调度。
-// 通过 virtio_disk.c 驱动与 QEMU 虚拟磁盘交互，实现真实的块设备读写。
+// 读写经 blkdev 接口交给按设备号登记的驱动：QEMU 虚拟磁盘（virtio_disk.c）或内存盘（ramdisk.c）。
 
-// 缓存块数量：单核环境下 32 足以支撑简单文件操作。
-#define NBUF 32
-// 哈希桶数量：选取质数以降低冲突概率，简单场景下 37 足够覆盖所有缓冲块。
-#define BUF_HASH_SIZE 37
+// 缓存容量：启动时取空闲物理内存的 1/2^BCACHE_RAM_SHIFT（128MB 内存下约一千块），
+// 并限制在 [NBUF_MIN, NBUF_MAX] 之间。日志至多使用缓存的 1/4（见 log_init），
+// 其余留给批量提交的日志写入与普通文件操作。
+#define BCACHE_RAM_SHIFT 5
+#define NBUF_MIN 128
+#define NBUF_MAX 4096
+// 哈希桶数量：选取质数以降低冲突概率，每个桶有独立的锁。
+#define BUF_HASH_SIZE 251
+// 换出记录（2Q 的 A1out）的槽数，须为 2 的幂。直接映射，冲突时覆盖旧记录
+#define GHOST_SIZE 1024
+// bcache_shrink 一次至多归还的数据页数
+#define BSHRINK_MAX 32
 
+struct bucket {
+    struct spinlock lock;      // 保护桶内链表，以及 (dev, blockno) 散列到本桶的缓存块的 refcnt/referenced
+    struct buf *head;
+};
+
+// 置换策略为建立在 clock 上的 2Q：新换入的块进入试用队列，其间的再次访问不提升
+// （一次扫描内的重复访问大多是相关访问）；块从试用队列换出后记入换出记录，
+// 之后若被再次换入则说明确有复用，直接进入保护队列。元数据块（inode、位图、间接块）
+// 由 bread_meta 读入，一律放入保护队列。clock 扫描优先换出试用队列的块，
+// 试用队列不足总数的 1/4 时保护队列的块才参与置换，
+// 因此大文件的顺序扫描只会在试用队列内部轮转，不会冲掉热的元数据块。
+//
+// 锁的层次：clock_lock 先于桶锁获取，任何时候至多持有一个桶锁。
+// 查找命中只需目标桶的锁；换入（改变缓存块身份并挂入新桶）一律在 clock_lock 下进行，
+// 因此同一块不会被重复换入。
 struct {
-    struct spinlock lock;      // 保护缓存链表以及引用计数。
-    struct buf buf[NBUF];      // 实际的缓存块数组，每个元素维护元数据和数据区。
-    struct buf head;           // LRU 双向链表的哨兵节点。
-    struct buf *hash[BUF_HASH_SIZE]; // 哈希桶数组，每个桶串联同一哈希值的缓存块
+    struct buf *buf;           // 缓存块描述符数组，数据区各占一页，均在 bcache_init 中从页分配器取得
+    int nbuf;
+    int nempty;                // 数据页已被 bcache_shrink 归还的块数，由 clock_lock 保护
+    struct bucket bucket[BUF_HASH_SIZE];
+    struct spinlock clock_lock; // 保护 hand，并串行化换入
+    int hand;                  // clock 置换指针
+    int nwait;                 // 在 bget 中等待空闲块的进程数
+    uint free_gen;             // 每有缓存块的引用计数降为 0 就加一，用于避免丢失唤醒
+    int nprotected;            // 保护队列中的块数
+    struct {
+        uint dev;
+        uint blockno;
+    } ghost[GHOST_SIZE];       // 最近从试用队列换出的块，由 clock_lock 保护
+    struct {
+        struct pcpu_counter hits, misses, prefetches, evictions, evict_protected, ghost_hits, shrinks;
+    } stat;                    // 统计计数，命中路径在各 hart 上并发更新，每 hart 一格
 } bcache;
 
+#define BSTAT_INC(field) pcpu_inc(&bcache.stat.field)
+
+static void metric_nprotected(struct metric_stat *st)
+{
+    st->value = __atomic_load_n(&bcache.nprotected, __ATOMIC_RELAXED);
+}
+
+static struct metric bio_metrics[] = {
+    { .name = "bio.hits", .kind = METRIC_COUNTER, .counter = &bcache.stat.hits },
+    { .name = "bio.misses", .kind = METRIC_COUNTER, .counter = &bcache.stat.misses },
+    { .name = "bio.prefetches", .kind = METRIC_COUNTER, .counter = &bcache.stat.prefetches },
+    { .name = "bio.evictions", .kind = METRIC_COUNTER, .counter = &bcache.stat.evictions },
+    { .name = "bio.evict_protected", .kind = METRIC_COUNTER, .counter = &bcache.stat.evict_protected },
+    { .name = "bio.ghost_hits", .kind = METRIC_COUNTER, .counter = &bcache.stat.ghost_hits },
+    { .name = "bio.shrinks", .kind = METRIC_COUNTER, .counter = &bcache.stat.shrinks },
+    { .name = "bio.nprotected", .kind = METRIC_GAUGE, .read = metric_nprotected },
+};
+
 static struct buf *bget(uint dev, uint blockno);
 static void disk_rw(struct buf *b, int write);
+static void buf_unref(struct buf *b);
+static void buf_unref_touch(struct buf *b, int touch);
+static struct buf *buf_alloc(uint dev, uint blockno, int wait);
+
+static const struct blkdev *blkdevs[NBLKDEV];
+
+// blkdev_register: 登记设备号 dev 的驱动，在文件系统初始化之前调用
+void blkdev_register(uint dev, const struct blkdev *d)
+{
+    if(dev >= NBLKDEV)
+        panic("blkdev_register");
+    blkdevs[dev] = d;
+}
+
+void blk_submit(struct buf **bs, int n, int write, void (*done)(struct buf *))
+{
+    if(write)
+        IOACCT(write_blocks, n);
+    else
+        IOACCT(read_blocks, n);
+    blkdev_get(bs[0]->dev)->submit(bs, n, write, done);
+}
+
+void blk_wait(struct buf *b)
+{
+    uint64 start = r_time();
+    blkdev_get(b->dev)->wait(b);
+    IOACCT(iowait, r_time() - start);
+}
+
+const struct blkdev *blkdev_get(uint dev)
+{
+    if(dev >= NBLKDEV || blkdevs[dev] == 0)
+        panic("blkdev_get: no device");
+    return blkdevs[dev];
+}
 
 static inline uint buf_hash(uint dev, uint blockno)
 {
@@ -30,19 +128,23 @@ static inline uint buf_hash(uint dev, uint blockno)
     return (dev ^ blockno) % BUF_HASH_SIZE;
 }
 
-static void hash_insert(struct buf *b)
+// 缓存块当前身份所属的桶。尚未使用过的块身份为 (0, 0)，不在任何链表中，但同样归 0 号桶的锁保护
+static inline struct bucket *buf_bucket(struct buf *b)
+{
+    return &bcache.bucket[buf_hash(b->dev, b->blockno)];
+}
+
+static void hash_insert(struct bucket *bk, struct buf *b)
 {
     // 将缓存块挂入对应哈希桶，便于后续 O(1) 命中查找。
-    uint idx = buf_hash(b->dev, b->blockno);
-    b->hash_next = bcache.hash[idx];
-    bcache.hash[idx] = b;
+    b->hash_next = bk->head;
+    bk->head = b;
 }
 
-static void hash_remove(struct buf *b)
+static void hash_remove(struct bucket *bk, struct buf *b)
 {
     // 从哈希桶中摘除缓存块，复用缓存块前需要先清理旧映射。
-    uint idx = buf_hash(b->dev, b->blockno);
-    struct buf **pp = &bcache.hash[idx];
+    struct buf **pp = &bk->head;
     while(*pp){
         if(*pp == b){
             *pp = b->hash_next;
@@ -53,30 +155,47 @@ static void hash_remove(struct buf *b)
     }
 }
 
-// 初始化缓冲池：
-//   - 初始化自旋锁；
-//   - 将 head 构建成空链表；
-//   - 将所有 buf 节点插入 head 后方并初始化睡眠锁。
-// 链表头部代表最近使用，尾部代表最久未使用，便于实现 LRU 淘汰。
+// 初始化缓冲池：按空闲内存确定容量，分配描述符数组与各块的数据页，
+// 初始化各桶的锁与每个缓存块的睡眠锁。
 void bcache_init(void)
 {
-    struct buf *b;
+    struct meminfo mi;
     int i;
 
-    initlock(&bcache.lock, "bcache");
-    for(i = 0; i < BUF_HASH_SIZE; i++)
-        bcache.hash[i] = 0;    // 初始化哈希桶头指针，确保启动时为空
-    bcache.head.prev = &bcache.head;
-    bcache.head.next = &bcache.head;
+    pmm_meminfo(&mi);
+    bcache.nbuf = mi.free_pages >> BCACHE_RAM_SHIFT;
+    if(bcache.nbuf < NBUF_MIN)
+        bcache.nbuf = NBUF_MIN;
+    if(bcache.nbuf > NBUF_MAX)
+        bcache.nbuf = NBUF_MAX;
 
-    for(b = bcache.buf; b < bcache.buf + NBUF; b++){
-        b->next = bcache.head.next;
-        b->prev = &bcache.head;
-        bcache.head.next->prev = b;
-        bcache.head.next = b;
+    int npages = ((uint64)bcache.nbuf * sizeof(struct buf) + PGSIZE - 1) / PGSIZE;
+    bcache.buf = alloc_pages(npages);
+    if(bcache.buf == 0)
+        panic("bcache_init: no memory");
 
+    initlock(&bcache.clock_lock, "bcache.clock");
+    for(i = 0; i < BUF_HASH_SIZE; i++){
+        initlock(&bcache.bucket[i].lock, "bcache.bucket");
+        bcache.bucket[i].head = 0;    // 初始化哈希桶头指针，确保启动时为空
+    }
+    bcache.hand = 0;
+    bcache.nwait = 0;
+    bcache.free_gen = 0;
+    bcache.nprotected = 0;
+    bcache.nempty = 0;
+    METRICS_REGISTER(bio_metrics);
+
+    for(i = 0; i < bcache.nbuf; i++){
+        struct buf *b = &bcache.buf[i];
+        b->data = alloc_page_nozero();
+        if(b->data == 0)
+            panic("bcache_init: no memory");
         b->refcnt = 0;
+        b->referenced = 0;
+        b->prot = 0;
         b->flags = 0;
+        b->disk = 0;
         b->hash_next = 0;   // 初始状态下未挂入任何哈希桶
         b->dev = 0;          // 清零设备号，便于后续调试时辨识
         b->blockno = 0;      // 清零块号，防止意外读取旧值
@@ -85,10 +204,12 @@ void bcache_init(void)
 }
 
 // bread 返回 dev:blockno 对应的缓存块。
-// 若缓存中已有，会直接命中；否则通过 bget 选取 LRU 空闲块并从磁盘读入。
+// 若缓存中已有，会直接命中；否则通过 bget 换入一个空闲块并从磁盘读入。
 struct buf *bread(uint dev, uint blockno)
 {
     struct buf *b = bget(dev, blockno);
+    if(!(b->flags & B_VALID) && b->disk)
+        blk_wait(b);             // 预读请求仍在途：等它完成即可
     if(!(b->flags & B_VALID)){
         disk_rw(b, 0);           // 触发一次实际磁盘读取并填充 buf->data。
         b->flags |= B_VALID;
@@ -96,6 +217,90 @@ struct buf *bread(uint dev, uint blockno)
     return b;
 }
 
+// 将缓存块移入保护队列，调用者持有该块的引用
+static void buf_protect(struct buf *b)
+{
+    struct bucket *bk = buf_bucket(b);
+
+    acquire(&bk->lock);
+    if(!b->prot){
+        b->prot = 1;
+        __atomic_fetch_add(&bcache.nprotected, 1, __ATOMIC_RELAXED);
+    }
+    release(&bk->lock);
+}
+
+// bread_meta 用于读取元数据块：与 bread 相同，并把块放入保护队列，
+// 使其不会被普通数据的顺序扫描换出
+struct buf *bread_meta(uint dev, uint blockno)
+{
+    struct buf *b = bread(dev, blockno);
+    buf_protect(b);
+    return b;
+}
+
+// bgetblk 返回 dev:blockno 对应的缓存块但不从磁盘读取，供随后覆盖整块内容的调用者使用
+// （如写入日志区）。返回时持有睡眠锁，内容有效与否由调用者负责
+struct buf *bgetblk(uint dev, uint blockno)
+{
+    struct buf *b = bget(dev, blockno);
+    if(!(b->flags & B_VALID) && b->disk)
+        blk_wait(b);             // 在途的预读完成前不能改写数据区
+    b->flags |= B_VALID;
+    return b;
+}
+
+// binvalidate: 放弃调用者持有的缓存块中未写入日志的内容，下次 bread 重新从磁盘读入。
+// 已记入日志（B_DIRTY）的块比磁盘新，保持不变
+void binvalidate(struct buf *b)
+{
+    if(!holdingsleep(&b->lock))
+        panic("binvalidate: not holding lock");
+    if(!(b->flags & B_DIRTY))
+        b->flags &= ~B_VALID;
+}
+
+// 预读完成回调（中断上下文）：标记数据有效，并放弃预读时持有的引用
+static void readahead_done(struct buf *b)
+{
+    b->flags |= B_VALID;
+    buf_unref(b);
+}
+
+// 为预读取得一个空闲缓存块：块已在缓存中（有效或正在读入）或没有空闲块时返回 0。
+// 与 bget 不同，这里从不 panic 也不等待
+static struct buf *bget_prefetch(uint dev, uint blockno)
+{
+    struct buf *b = buf_alloc(dev, blockno, 0);
+    if(b)
+        acquiresleep(&b->lock);   // 刚换入的块无人持有，不会阻塞
+    return b;
+}
+
+// 预读 blocks[0..n) 中尚未缓存的块：合并相邻块后异步提交。提交后立即释放睡眠锁，
+// 引用保留到完成回调中再放弃，期间缓存块不会被复用；bread 命中在途块时等待其完成
+void breadahead(uint dev, const uint *blocks, int n)
+{
+    struct blk_plug plug;
+    struct buf *bs[BLK_PLUG_MAX];
+    int cnt = 0;
+
+    blk_plug_init(&plug, 0);
+    plug.done = readahead_done;
+    for(int i = 0; i < n && cnt < BLK_PLUG_MAX; i++){
+        struct buf *b = bget_prefetch(dev, blocks[i]);
+        if(b == 0)
+            continue;
+        bs[cnt++] = b;
+        blk_plug_add(&plug, b);
+    }
+    if(cnt == 0)
+        return;
+    blk_plug_flush(&plug);
+    for(int i = 0; i < cnt; i++)
+        releasesleep(&bs[i]->lock);
+}
+
 // bwrite 将缓存块写回磁盘，并保留 B_DIRTY 标记清空的副作用。
 // 调用者必须已经持有睡眠锁，否则写回期间可能出现数据竞争。
 void bwrite(struct buf *b)
@@ -107,104 +312,386 @@ void bwrite(struct buf *b)
     disk_rw(b, 1);
 }
 
-// brelse 在调用者完成对缓存块的访问后释放睡眠锁，并尝试将其移回 LRU 头部。
-// refcnt 递减为 0 时，该块代表“空闲可复用”，会被移动到链表头方便下次命中。
+// bwrite_submit/bwrite_wait 把一次写回拆成提交与等待两步：调用者可以先提交多个块，
+// 让它们同时在磁盘队列中，再依次等待。两步之间须一直持有睡眠锁且不得修改数据
+void bwrite_submit(struct buf *b)
+{
+    if(!holdingsleep(&b->lock))
+        panic("bwrite_submit: not holding lock");
+
+    b->flags |= B_DIRTY;
+    blk_submit(&b, 1, 1, 0);
+}
+
+void bwrite_wait(struct buf *b)
+{
+    blk_wait(b);
+    b->flags &= ~B_DIRTY;
+}
+
+void blk_plug_init(struct blk_plug *plug, int write)
+{
+    plug->write = write;
+    plug->done = 0;
+    plug->n = 0;
+}
+
+// 加入队列，队列满时先提交已积累的请求
+void blk_plug_add(struct blk_plug *plug, struct buf *b)
+{
+    if(!holdingsleep(&b->lock))
+        panic("blk_plug_add: not holding lock");
+    if(plug->n == BLK_PLUG_MAX)
+        blk_plug_flush(plug);
+    if(plug->write)
+        b->flags |= B_DIRTY;
+    plug->bufs[plug->n++] = b;
+}
+
+// 按块号排序后把相邻块合并提交，每个请求至多 VIRTIO_MAX_SEGS 块
+void blk_plug_flush(struct blk_plug *plug)
+{
+    struct buf **bs = plug->bufs;
+    int n = plug->n;
+
+    // 队列很短，插入排序即可
+    for(int i = 1; i < n; i++){
+        struct buf *b = bs[i];
+        int j = i - 1;
+        while(j >= 0 && (bs[j]->dev > b->dev ||
+              (bs[j]->dev == b->dev && bs[j]->blockno > b->blockno))){
+            bs[j + 1] = bs[j];
+            j--;
+        }
+        bs[j + 1] = b;
+    }
+
+    for(int i = 0; i < n; ){
+        int run = 1;
+        while(i + run < n && run < VIRTIO_MAX_SEGS &&
+              bs[i + run]->dev == bs[i]->dev &&
+              bs[i + run]->blockno == bs[i]->blockno + run)
+            run++;
+        blk_submit(&bs[i], run, plug->write, plug->done);
+        i += run;
+    }
+    plug->n = 0;
+}
+
+// brelse 在调用者完成对缓存块的访问后释放睡眠锁并放弃引用。
+// refcnt 递减为 0 时，该块代表“空闲可复用”，置上访问位，clock 扫到时会先给它第二次机会。
 void brelse(struct buf *b)
 {
     if(!holdingsleep(&b->lock))
         panic("brelse: not holding lock");
 
     releasesleep(&b->lock);
+    buf_unref(b);
+}
+
+// brelse_once 与 brelse 相同，但不置访问位：内容已复制到页缓存的文件数据块，
+// 块缓存中的副本应当最先被换出
+void brelse_once(struct buf *b)
+{
+    if(!holdingsleep(&b->lock))
+        panic("brelse_once: not holding lock");
+
+    releasesleep(&b->lock);
+    buf_unref_touch(b, 0);
+}
+
+static void buf_unref(struct buf *b)
+{
+    buf_unref_touch(b, 1);
+}
 
-    acquire(&bcache.lock);
+// 放弃一个引用，touch 非 0 时引用计数降为 0 的块置上访问位。引用计数降为 0 且有进程在
+// 等待空闲块时唤醒它们；free_gen 与 nwait 的先增后读保证等待者要么看到 free_gen 变化，
+// 要么被这里唤醒
+static void buf_unref_touch(struct buf *b, int touch)
+{
+    struct bucket *bk = buf_bucket(b);
+    int freed;
+
+    acquire(&bk->lock);
     b->refcnt--;
-    if(b->refcnt == 0){
-        // 先从当前位置摘除，再插入到头部实现最近最少使用策略。
-        b->next->prev = b->prev;
-        b->prev->next = b->next;
+    freed = b->refcnt == 0;
+    if(freed && touch)
+        b->referenced = 1;
+    release(&bk->lock);
 
-        b->next = bcache.head.next;
-        b->prev = &bcache.head;
-        bcache.head.next->prev = b;
-        bcache.head.next = b;
+    if(!freed)
+        return;
+    __atomic_fetch_add(&bcache.free_gen, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&bcache.nwait, __ATOMIC_SEQ_CST) > 0){
+        acquire(&bcache.clock_lock);
+        wakeup(&bcache.nwait);
+        release(&bcache.clock_lock);
     }
-    release(&bcache.lock);
 }
 
-// bpin/bunpin 在日志或其他场景需要阻止缓存被 LRU 淘汰时使用。
+// bpin/bunpin 在日志或其他场景需要阻止缓存被淘汰时使用。
 void bpin(struct buf *b)
 {
-    acquire(&bcache.lock);
+    struct bucket *bk = buf_bucket(b);
+
+    acquire(&bk->lock);
     b->refcnt++;
-    release(&bcache.lock);
+    release(&bk->lock);
 }
 
 void bunpin(struct buf *b)
 {
-    acquire(&bcache.lock);
-    b->refcnt--;
-    release(&bcache.lock);
+    buf_unref(b);
 }
 
-// bget 是缓存查找与分配的核心：
-//   1) 通过哈希桶快速定位是否命中已有缓存块；
-//   2) 若未命中，则从 LRU 链表尾部挑选 refcnt==0 的空闲块并复用；
-//   3) 若仍无法命中或复用，说明缓存容量不足，直接 panic（开发期便于发现问题）。
-static struct buf *bget(uint dev, uint blockno)
+// 在 (dev, blockno) 所属的桶中查找缓存块，命中且 ref 非 0 时增加引用
+static struct buf *buf_lookup(uint dev, uint blockno, int ref)
 {
+    struct bucket *bk = &bcache.bucket[buf_hash(dev, blockno)];
     struct buf *b;
-    uint idx;
 
-    acquire(&bcache.lock);
+    acquire(&bk->lock);
+    for(b = bk->head; b != 0; b = b->hash_next){
+        if(b->dev == dev && b->blockno == blockno){
+            if(ref){
+                b->refcnt++;
+                BSTAT_INC(hits);
+                IOACCT(cache_hits, 1);
+            }
+            break;
+        }
+    }
+    release(&bk->lock);
+    return b;
+}
+
+// bcached: dev:blockno 当前是否在块缓存中（含正在预读的块）。不增加引用，结果只是提示，
+// 调用者须另有保证该块不会在此之后才被读入缓存（如持有所属 inode 的锁）
+int bcached(uint dev, uint blockno)
+{
+    return buf_lookup(dev, blockno, 0) != 0;
+}
 
-    idx = buf_hash(dev, blockno);
+static inline uint ghost_slot(uint dev, uint blockno)
+{
+    return (dev * 0x9e3779b1u ^ blockno) & (GHOST_SIZE - 1);
+}
 
-    // 先按哈希桶扫描，命中后即可避免遍历整个 LRU 链表。
-    for(b = bcache.hash[idx]; b != 0; b = b->hash_next){
-        if(b->dev == dev && b->blockno == blockno){
-            b->refcnt++;
-            release(&bcache.lock);
-            acquiresleep(&b->lock);
-            return b;
+// clock 置换：从 hand 起循环扫描，跳过仍被引用的块；访问位已置上的空闲块清除访问位后
+// 跳过（第二次机会），遇到访问位为 0 的空闲块即选中。第一遍只考虑试用队列
+// （试用队列不足 1/4 时保护队列也参与），仍找不到时第二遍不区分队列。每遍至多扫描两圈，
+// 调用者持有 clock_lock。选中的块已从旧桶摘除且 refcnt 置为 1，不会再被其他路径找到。
+// 数据页已被归还的块只在 allow_empty 非 0（调用者备好了一页）时才可选中
+static struct buf *clock_evict(int allow_empty)
+{
+    for(int pass = 0; pass < 2; pass++){
+        int allow_prot = pass == 1 ||
+            bcache.nbuf - __atomic_load_n(&bcache.nprotected, __ATOMIC_RELAXED) < bcache.nbuf / 4;
+
+        for(int i = 0; i < 2 * bcache.nbuf; i++){
+            struct buf *b = &bcache.buf[bcache.hand];
+            struct bucket *bk = buf_bucket(b);
+
+            bcache.hand = (bcache.hand + 1) % bcache.nbuf;
+            acquire(&bk->lock);
+            if(b->refcnt == 0 && (allow_prot || !b->prot) && (allow_empty || b->data)){
+                if(b->referenced){
+                    b->referenced = 0;
+                } else {
+                    hash_remove(bk, b);
+                    b->refcnt = 1;
+                    release(&bk->lock);
+                    if(b->flags & B_VALID){
+                        BSTAT_INC(evictions);
+                        if(b->prot){
+                            BSTAT_INC(evict_protected);
+                        } else {
+                            uint g = ghost_slot(b->dev, b->blockno);
+                            bcache.ghost[g].dev = b->dev;
+                            bcache.ghost[g].blockno = b->blockno;
+                        }
+                    }
+                    if(b->prot){
+                        b->prot = 0;
+                        __atomic_fetch_sub(&bcache.nprotected, 1, __ATOMIC_RELAXED);
+                    }
+                    return b;
+                }
+            }
+            release(&bk->lock);
+        }
+    }
+    return 0;
+}
+
+// buf_alloc 为未命中的 (dev, blockno) 换入一个缓存块，返回时持有一个引用（尚未持有睡眠锁）。
+// 等待 clock_lock 期间其他进程可能已换入同一块，因此先在锁内重新查找：
+// wait 非 0 时直接返回该块，否则（预读）返回 0。没有空闲块时，wait 非 0 则睡眠等待
+// brelse 释放出空闲块，否则返回 0。空闲块的数据页都已被回收时，先在 clock_lock 之外
+// 取得一页再重试（分配可能触发回收，回收会进入 bcache_shrink）
+static struct buf *buf_alloc(uint dev, uint blockno, int wait)
+{
+    struct buf *b;
+    uchar *spare = 0;
+
+    acquire(&bcache.clock_lock);
+    for(;;){
+        if((b = buf_lookup(dev, blockno, wait)) != 0){
+            release(&bcache.clock_lock);
+            if(spare)
+                free_page(spare);
+            return wait ? b : 0;
         }
+
+        uint gen = __atomic_load_n(&bcache.free_gen, __ATOMIC_SEQ_CST);
+        if((b = clock_evict(spare != 0)) != 0)
+            break;
+        if(spare == 0 && bcache.nempty > 0){
+            release(&bcache.clock_lock);
+            spare = alloc_page_nozero();
+            acquire(&bcache.clock_lock);
+            if(spare)
+                continue;
+        }
+        if(!wait){
+            release(&bcache.clock_lock);
+            if(spare)
+                free_page(spare);
+            return 0;
+        }
+        if(myproc() == 0)
+            panic("bget: no buffers");   // 启动阶段没有可睡眠的进程
+        __atomic_fetch_add(&bcache.nwait, 1, __ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&bcache.free_gen, __ATOMIC_SEQ_CST) == gen)
+            sleep(&bcache.nwait, &bcache.clock_lock);
+        __atomic_fetch_sub(&bcache.nwait, 1, __ATOMIC_SEQ_CST);
+    }
+
+    if(b->data == 0){
+        b->data = spare;
+        spare = 0;
+        bcache.nempty--;
     }
+    b->dev = dev;
+    b->blockno = blockno;
+    b->flags = 0;
+    b->referenced = 0;
+
+    // 最近从试用队列换出过的块再次被需要：直接进入保护队列
+    uint g = ghost_slot(dev, blockno);
+    if(bcache.ghost[g].dev == dev && bcache.ghost[g].blockno == blockno){
+        bcache.ghost[g].dev = 0;
+        b->prot = 1;
+        __atomic_fetch_add(&bcache.nprotected, 1, __ATOMIC_RELAXED);
+        BSTAT_INC(ghost_hits);
+    }
+    if(wait){
+        BSTAT_INC(misses);
+        IOACCT(cache_misses, 1);
+        TRACE(BIO_MISS, dev, blockno);
+    } else
+        BSTAT_INC(prefetches);
+
+    struct bucket *bk = buf_bucket(b);
+    acquire(&bk->lock);
+    hash_insert(bk, b);      // 将新映射挂入对应哈希桶
+    release(&bk->lock);
+    release(&bcache.clock_lock);
+    if(spare)
+        free_page(spare);
+    return b;
+}
+
+// bcache_shrink: 内存紧张时由 kalloc 调用，归还至多 target 个缓存块的数据页。
+// 只考虑试用队列中无人引用（含未被 bpin 固定）、内容已在磁盘上且没有在途请求的块，
+// 访问位已置上的块清除访问位后跳过。选中的块从桶中摘除并作废，描述符留在数组中，
+// 之后被 clock 置换选中时由 buf_alloc 重新配上数据页。返回归还的页数
+int bcache_shrink(int target)
+{
+    void *pages[BSHRINK_MAX];
+    int n = 0;
+
+    if(target > BSHRINK_MAX)
+        target = BSHRINK_MAX;
+    acquire(&bcache.clock_lock);
+    for(int i = 0; i < bcache.nbuf && n < target; i++){
+        struct buf *b = &bcache.buf[i];
+        struct bucket *bk = buf_bucket(b);
 
-    // 未命中：从链表尾部起寻找 refcnt==0 的空闲块进行复用。
-    for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-        if(b->refcnt == 0){
-            hash_remove(b);      // 复用前先从旧桶摘除，避免残留映射
-            b->dev = dev;
-            b->blockno = blockno;
-            b->flags = 0;
-            b->refcnt = 1;
-            hash_insert(b);      // 将新映射挂入对应哈希桶
-            release(&bcache.lock);
-            acquiresleep(&b->lock);
-            return b;
+        acquire(&bk->lock);
+        if(b->refcnt == 0 && !b->prot && b->data && !(b->flags & B_DIRTY) && !b->disk){
+            if(b->referenced){
+                b->referenced = 0;
+            } else {
+                hash_remove(bk, b);
+                b->flags = 0;
+                pages[n++] = b->data;
+                b->data = 0;
+                bcache.nempty++;
+            }
         }
+        release(&bk->lock);
     }
+    release(&bcache.clock_lock);
+
+    pcpu_add(&bcache.stat.shrinks, n);
+    free_page_bulk(pages, n);
+    return n;
+}
+
+// bget 是缓存查找与分配的核心：
+//   1) 只持有目标桶的锁查找，命中即返回；
+//   2) 未命中时由 buf_alloc 通过 clock 置换换入一个空闲块；
+//   3) 缓存块全部被引用时睡眠等待，直到有块被释放。
+static struct buf *bget(uint dev, uint blockno)
+{
+    struct buf *b = buf_lookup(dev, blockno, 1);
 
-    panic("bget: no buffers");
-    return 0; // 不会执行到此，避免编译器警告。
+    if(b == 0)
+        b = buf_alloc(dev, blockno, 1);
+    acquiresleep(&b->lock);
+    return b;
 }
 
-// disk_rw 使用 virtio 磁盘驱动与 QEMU 模拟块设备交互。
+// disk_rw 经块设备驱动同步读写一块。
 //  - read: 将磁盘块拷贝进 buf->data；
 //  - write: 将 buf->data 写回磁盘，并清除脏页标记。
 static void disk_rw(struct buf *b, int write)
 {
-    virtio_disk_rw(b, write);
+    blk_submit(&b, 1, write, 0);
+    blk_wait(b);
     if(write)
         b->flags &= ~B_DIRTY;
 }
 
-// clear_cache: 清空块缓存，仅供测试使用，会丢失未写磁盘的数据
+int bcache_nbuf(void)
+{
+    return bcache.nbuf;
+}
+
+// bcache_getstat: 复制块缓存统计
+void bcache_getstat(struct bcachestat *st)
+{
+    st->nbuf = bcache.nbuf;
+    st->hits = pcpu_read(&bcache.stat.hits);
+    st->misses = pcpu_read(&bcache.stat.misses);
+    st->prefetches = pcpu_read(&bcache.stat.prefetches);
+    st->evictions = pcpu_read(&bcache.stat.evictions);
+    st->evict_protected = pcpu_read(&bcache.stat.evict_protected);
+    st->ghost_hits = pcpu_read(&bcache.stat.ghost_hits);
+    st->nprotected = __atomic_load_n(&bcache.nprotected, __ATOMIC_RELAXED);
+}
+
+// clear_cache: 清空块缓存与页缓存，仅供测试使用，会丢失未写磁盘的数据
 void clear_cache(void) {
-    acquire(&bcache.lock);
-    for(int i = 0; i < NBUF; i++) {
+    pcache_clear();
+    for(int i = 0; i < bcache.nbuf; i++) {
         struct buf *b = &bcache.buf[i];
+        struct bucket *bk = buf_bucket(b);
+        acquire(&bk->lock);
         b->flags &= ~(B_VALID | B_DIRTY);
         b->refcnt = 0;
+        release(&bk->lock);
     }
-    release(&bcache.lock);
 }
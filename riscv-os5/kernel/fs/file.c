@@ -1,48 +1,73 @@
 #include "types.h"
 #include "spinlock.h"
+#include "buf.h"
 #include "file.h"
 #include "fs.h"
 #include "log.h"
 #include "printf.h"
+#include "string.h"
+#include "slab.h"
+#include "pipe.h"
+#include "kalloc.h"
+#include "riscv.h"
+#include "poll.h"
+#include "pollwait.h"
+#include "net.h"
+#include "vm.h"
+#include "proc.h"
+#include "bitops.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 // file.c 管理内核态的“打开文件表”。每个 struct file 代表一个打开的对象，
-// 可以是普通文件、设备或管道。进程的 ofile[NOFILE] 数组仅保存指针。
+// 可以是普通文件、设备或管道。进程的 struct fdtable 仅保存指针。
 
 // devsw: 设备主编号到读写回调的映射表。设备驱动在启动阶段注册。
 struct devsw devsw[NDEV];
 
 static struct {
-    struct spinlock lock;    // 保护 file[] 的自旋锁，避免并发分配冲突。
-    struct file file[NFILE]; // 全局文件表，容量由 include/file.h 中定义。
+    struct spinlock lock;       // 保护引用计数与 nopen 的自旋锁。
+    struct kmem_cache *cache;   // struct file 的 slab cache，打开文件数随负载增长。
+    int nopen;                  // 当前已分配的 struct file 个数
 } ftable;
 
-// 初始化全局文件表，仅需配置自旋锁。file 数组默认全零。
+// 初始化全局文件表：配置自旋锁并创建 struct file 的对象缓存。
 void fileinit(void)
 {
     initlock(&ftable.lock, "ftable");
+    ftable.cache = kmem_cache_create("file", sizeof(struct file), 0);
+    if(ftable.cache == 0)
+        panic("fileinit: kmem_cache_create");
 }
 
-// filealloc: 在全局表中找一个 ref==0 的槽位并返回，引用计数预设为 1。
+// filealloc: 从 slab cache 取一个 struct file，引用计数预设为 1。
 // 返回的文件表项已清理核心字段，调用者只需进一步填充类型/权限等信息。
+// 仅在物理内存耗尽时返回 0。
 struct file *filealloc(void)
 {
+    struct file *f = kmem_cache_alloc(ftable.cache);
+    if(f == 0)
+        return 0;
+
+    f->ref = 1;
+    f->type = FD_NONE;
+    f->readable = 0;
+    f->writable = 0;
+    f->pipe = 0;
+    f->ip = 0;
+    f->off = 0;
+    f->major = 0;
+    f->direct = 0;
+    f->ra_next = 0;
+    f->ra_end = 0;
+    f->ra_window = 0;
+    f->seq = 0;
+    initsleeplock(&f->poslock, "filepos");
+
     acquire(&ftable.lock);
-    for(struct file *f = ftable.file; f < ftable.file + NFILE; f++) {
-        if(f->ref == 0) {
-            f->ref = 1;
-            f->type = FD_NONE;
-            f->readable = 0;
-            f->writable = 0;
-            f->pipe = 0;
-            f->ip = 0;
-            f->off = 0;
-            f->major = 0;
-            release(&ftable.lock);
-            return f;
-        }
-    }
+    ftable.nopen++;
     release(&ftable.lock);
-    return 0;
+    return f;
 }
 
 // filedup: 提升引用计数，供 fork/dup 等场景共享同一个 struct file。
@@ -57,7 +82,7 @@ struct file *filedup(struct file *f)
 }
 
 // fileclose: 当引用计数降为 0 时，根据文件类型执行收尾逻辑。
-//  - FD_PIPE: 未来可在此实现管道资源回收；
+//  - FD_PIPE: 关闭管道的一端，两端都关闭后释放管道；
 //  - FD_DEVICE: 设备不需要额外操作；
 //  - FD_INODE: 通过 iput 归还 inode。
 void fileclose(struct file *f)
@@ -73,19 +98,18 @@ void fileclose(struct file *f)
         return;
     }
 
-    // 将内容复制一份放到栈上，随后把槽位清零，避免释放路径中再次访问。
+    // 将内容复制一份放到栈上，随后把对象还给 slab，避免释放路径中再次访问。
     ff = *f;
-    f->type = FD_NONE;
-    f->pipe = 0;
-    f->ip = 0;
-    f->readable = 0;
-    f->writable = 0;
-    f->off = 0;
+    ftable.nopen--;
     release(&ftable.lock);
+    kmem_cache_free(ftable.cache, f);
 
     switch(ff.type) {
     case FD_PIPE:
-        // 管道尚未实现，占位以明确后续扩展位置。
+        pipeclose(ff.pipe, ff.writable);
+        break;
+    case FD_SOCKET:
+        sockclose(ff.sock);
         break;
     case FD_DEVICE:
         // 设备文件无需额外处理，大多数驱动在 devsw 中拥有共享状态。
@@ -107,71 +131,409 @@ int filestat(struct file *f, uint64 addr)
     return -1;
 }
 
-// fileread 根据文件类型分派读逻辑。
-//  - FD_PIPE: 未实现，直接返回错误；
-//  - FD_DEVICE: 调用 devsw 中注册的 read 回调；
-//  - FD_INODE: 需获得 inode 睡眠锁，调用 readi，并更新文件偏移。
-int fileread(struct file *f, uint64 addr, int n)
+// 预读窗口：首次检测到顺序读时为 RA_MIN 块，之后每次顺序读翻倍，至多 RA_MAX 块
+#define RA_MIN 4
+#define RA_MAX BLK_PLUG_MAX
+
+// file_readahead: 顺序读时在同步读取之前，异步预读本次请求覆盖的块以及其后一个窗口的块，
+// 使这些块的磁盘请求同时在途；已发起过预读的块不再重复提交。随机访问时关闭预读
+static void file_readahead(struct file *f, int n)
+{
+    struct inode *ip = f->ip;
+
+    if(n <= 0 || f->off >= ip->size)
+        return;
+    if(f->off != f->ra_next) {
+        f->ra_window = 0;
+        f->ra_end = 0;
+        return;
+    }
+    f->ra_window = f->ra_window ? f->ra_window * 2 : RA_MIN;
+    if(f->ra_window > RA_MAX)
+        f->ra_window = RA_MAX;
+
+    uint32 first = f->off / BLOCK_SIZE;
+    uint32 last = (f->off + n - 1) / BLOCK_SIZE + f->ra_window;
+    if(first < f->ra_end)
+        first = f->ra_end;
+    // 窗口内剩余未预读的块不足一半时才补充，避免每次小块读取都发起请求
+    if(last < first + f->ra_window / 2)
+        return;
+    ireadahead(ip, first, last - first + 1);
+    f->ra_end = last + 1;
+}
+
+// ========== 进程的打开文件表 ==========
+
+void fdtable_init(struct fdtable *t)
+{
+    initlock(&t->lock, "fdtable");
+    t->size = NOFILE_INLINE;
+    t->fd = t->inline_fd;
+    memset(t->open, 0, sizeof(t->open));
+    memset(t->inline_fd, 0, sizeof(t->inline_fd));
+}
+
+// 把内联表换成一整页的数组，调用者持有 t->lock。页只在表释放时归还，
+// 未加锁的 fd_get 即使读到旧指针，旧数组也仍然有效
+static int fdtable_grow(struct fdtable *t)
+{
+    struct file **fd = alloc_page();
+    if(fd == 0)
+        return -1;
+    memmove(fd, t->inline_fd, sizeof(t->inline_fd));
+    t->fd = fd;
+    __sync_synchronize();
+    t->size = NOFILE;
+    return 0;
+}
+
+// 最低的空闲描述符，没有时返回 -1。调用者持有 t->lock
+static int fd_lowest_free(struct fdtable *t)
+{
+    for(int w = 0; w * 64 < t->size; w++) {
+        uint64 free = ~t->open[w];
+        if(t->size - w * 64 < 64)
+            free &= (1ULL << (t->size - w * 64)) - 1;
+        if(free)
+            return w * 64 + ctz64(free);
+    }
+    return -1;
+}
+
+int fd_alloc(struct fdtable *t, struct file *f)
+{
+    acquire(&t->lock);
+    int fd = fd_lowest_free(t);
+    if(fd < 0 && t->size < NOFILE && fdtable_grow(t) == 0)
+        fd = fd_lowest_free(t);
+    if(fd >= 0) {
+        t->fd[fd] = f;
+        t->open[fd / 64] |= 1ULL << (fd % 64);
+    }
+    release(&t->lock);
+    return fd;
+}
+
+struct file *fd_get(struct fdtable *t, int fd)
+{
+    if(fd < 0 || fd >= t->size)
+        return 0;
+    return t->fd[fd];
+}
+
+// 与 fd_remove 在同一把锁下取指针并增加引用：close 要么发生在之前（取不到），
+// 要么在之后（只放弃描述符表的那一份引用），文件不会在使用中被释放
+struct file *fd_get_ref(struct fdtable *t, int fd)
+{
+    struct file *f = 0;
+
+    acquire(&t->lock);
+    if(fd >= 0 && fd < t->size && (f = t->fd[fd]) != 0)
+        filedup(f);
+    release(&t->lock);
+    return f;
+}
+
+// fd_borrow: 取得 p 的 fd 对应的文件，在本次系统调用期间有效。
+// 线程组共用描述符表时，其他线程可能在调用中途 close 该描述符，因此持有一个引用，
+// 由 syscall_dispatch 在返回前调用 fd_put_borrowed 放弃。独占的表只有 p 自己会修改，
+// 直接借用表中的指针。tg_nthreads 只有组内成员 clone 时才会增加，这里不加锁读取
+struct file *fd_borrow(struct proc *p, int fd)
+{
+    if(p->fdt == &p->fdtab && p->tg_nthreads == 0)
+        return fd_get(p->fdt, fd);
+    struct file *f = fd_get_ref(p->fdt, fd);
+    if(f) {
+        if(p->fd_nheld == FD_HELD)
+            panic("fd_borrow: too many");
+        p->fd_held[p->fd_nheld++] = f;
+    }
+    return f;
+}
+
+void fd_put_borrowed(struct proc *p)
+{
+    while(p->fd_nheld > 0)
+        fileclose(p->fd_held[--p->fd_nheld]);
+}
+
+struct file *fd_remove(struct fdtable *t, int fd)
+{
+    struct file *f = 0;
+
+    acquire(&t->lock);
+    if(fd >= 0 && fd < t->size && (f = t->fd[fd]) != 0) {
+        t->fd[fd] = 0;
+        t->open[fd / 64] &= ~(1ULL << (fd % 64));
+    }
+    release(&t->lock);
+    return f;
+}
+
+// fdtable_copy: dst 为新进程刚初始化的表。按位图一次遍历源表的占用槽位，
+// 描述符编号保持不变；源表已扩展时先扩展 dst。内存不足时返回 -1，dst 保持为空
+int fdtable_copy(struct fdtable *dst, struct fdtable *src)
+{
+    acquire(&src->lock);
+    if(src->size > dst->size && fdtable_grow(dst) < 0) {
+        release(&src->lock);
+        return -1;
+    }
+    memmove(dst->open, src->open, sizeof(dst->open));
+    for(int w = 0; w * 64 < src->size; w++) {
+        for(uint64 bits = src->open[w]; bits; bits &= bits - 1) {
+            int fd = w * 64 + ctz64(bits);
+            dst->fd[fd] = filedup(src->fd[fd]);
+        }
+    }
+    release(&src->lock);
+    return 0;
+}
+
+// fdtable_release: 关闭全部描述符并恢复为内联表，可重复调用。
+// fileclose 可能睡眠（iput），逐个在锁外关闭
+void fdtable_release(struct fdtable *t)
+{
+    for(int w = 0; w * 64 < t->size; w++) {
+        while(t->open[w]) {
+            struct file *f = fd_remove(t, w * 64 + ctz64(t->open[w]));
+            if(f)
+                fileclose(f);
+        }
+    }
+    if(t->fd != t->inline_fd) {
+        struct file **fd = t->fd;
+        t->size = NOFILE_INLINE;
+        t->fd = t->inline_fd;
+        memset(t->inline_fd, 0, sizeof(t->inline_fd));
+        free_page(fd);
+    }
+}
+
+// filepoll: 管道、套接字与提供 poll 回调的设备按实际状态返回，普通文件总是可读写
+int filepoll(struct file *f, struct poll_table *pt)
+{
+    int mask = POLLIN | POLLOUT;
+
+    if(f->type == FD_PIPE)
+        mask = pipepoll(f->pipe, f->writable, pt);
+    else if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV && devsw[f->major].poll)
+        mask = devsw[f->major].poll(pt);
+    else if(f->type == FD_SOCKET)
+        mask = sockpoll(f->sock, pt);
+    if(!f->readable)
+        mask &= ~POLLIN;
+    if(!f->writable)
+        mask &= ~POLLOUT;
+    return mask;
+}
+
+// iov 各段的总字节数，调用者已保证其不超过 int 范围
+static int iov_total(const struct iovec *iov, int cnt)
+{
+    long tot = 0;
+    for(int i = 0; i < cnt; i++)
+        tot += iov[i].iov_len;
+    return (int)tot;
+}
+
+// 读写 inode 的一段：O_DIRECT 的打开实例先直接传输对齐的整块，余下部分照常经 readi/writei。
+// 返回值的语义与 readi/writei 相同
+static int file_readi(struct file *f, int user, uint64 addr, uint32 pos, int n)
+{
+    int r = f->direct && user ? readi_direct(f->ip, addr, pos, n) : 0;
+    if(r == n)
+        return r;
+    int s = readi(f->ip, user, addr + r, pos + r, n - r);
+    if(s < 0)
+        return r ? r : -1;
+    return r + s;
+}
+
+static int file_writei(struct file *f, int user, uint64 addr, uint32 pos, int n)
 {
-    if(f->readable == 0)
+    int r = f->direct && user ? writei_direct(f->ip, addr, pos, n) : 0;
+    if(r == n)
+        return r;
+    int s = writei(f->ip, user, addr + r, pos + r, n - r);
+    if(s < 0)
+        return r ? r : -1;
+    return r + s;
+}
+
+// filereadv: 依次将数据读入 iov 的各段。user 为 1 时各段是用户地址，否则为内核地址。
+// off 为 -1 时从文件当前偏移读取并推进偏移，否则从 off 处读取、不改变偏移（仅普通文件）。
+//  - FD_PIPE/FD_DEVICE: 逐段调用 piperead 或 devsw 的 read 回调，读到数据的段之后即返回，
+//    以免在已有数据时再次等待；
+//  - FD_SOCKET: 把一个数据报读入第一段，超出该段的部分丢弃；
+//  - FD_INODE: 整个请求只加一次 inode 锁，遇到短读（文件结束）即停止。
+// 返回读到的总字节数，一个字节都未读到时出错返回 -1
+static int file_readv(struct file *f, int user, const struct iovec *iov, int cnt, long off)
+{
+    int tot = 0;
+
+    if(f->readable == 0 || cnt < 0)
         return -1;
+    if(off >= 0 && f->type != FD_INODE)
+        return -1;   // 管道与设备没有位置
 
     switch(f->type) {
     case FD_PIPE:
-        return -1;
     case FD_DEVICE:
-        if(f->major < 0 || f->major >= NDEV || devsw[f->major].read == 0)
+        if(f->type == FD_DEVICE && (f->major < 0 || f->major >= NDEV ||
+                                    (devsw[f->major].read == 0 && devsw[f->major].fread == 0)))
             return -1;
-        return devsw[f->major].read(1, addr, n);
+        for(int i = 0; i < cnt; i++) {
+            uint64 addr = (uint64)iov[i].iov_base;
+            int n = iov[i].iov_len;
+            int r;
+            if(f->type == FD_PIPE)
+                r = piperead(f->pipe, user, addr, n);
+            else if(devsw[f->major].fread)
+                r = devsw[f->major].fread(f, user, addr, n);
+            else
+                r = devsw[f->major].read(user, addr, n);
+            if(r < 0)
+                return tot ? tot : -1;
+            tot += r;
+            if(r > 0 || n > 0)
+                break;
+        }
+        return tot;
+    case FD_SOCKET:
+        if(cnt == 0)
+            return 0;
+        return sockrecvfrom(f->sock, user, (uint64)iov[0].iov_base, iov[0].iov_len, 0, 0, 0);
     case FD_INODE: {
-        ilock(f->ip);
-        int r = readi(f->ip, 1, addr, f->off, n);
-        if(r > 0)
-            f->off += r;   // 仅在 read 成功时推进文件偏移。
-        iunlock(f->ip);
-        return r;
+        // 共享持有 inode 锁，多个读者可同时读同一文件；使用并推进 off 时先串行于本打开实例
+        if(off < 0)
+            acquiresleep(&f->poslock);
+        ilock_shared(f->ip);
+        uint32 pos = off < 0 ? f->off : (uint32)off;
+        if(off < 0 && !f->direct)
+            file_readahead(f, iov_total(iov, cnt));
+        for(int i = 0; i < cnt; i++) {
+            int n = iov[i].iov_len;
+            int r = file_readi(f, user, (uint64)iov[i].iov_base, pos, n);
+            if(r < 0) {
+                if(tot == 0)
+                    tot = -1;
+                break;
+            }
+            pos += r;
+            tot += r;
+            if(r < n)
+                break;
+        }
+        if(off < 0) {
+            f->off = pos;   // 仅推进成功读取的部分。
+            f->ra_next = f->off;
+        }
+        iunlock_shared(f->ip);
+        if(off < 0)
+            releasesleep(&f->poslock);
+        return tot;
     }
     default:
         return -1;
     }
 }
 
-// filewrite 与 fileread 类似，但针对写路径。
-//  - 对 inode：writei 负责分配块、复制数据，并在成功后更新 off。
-int filewrite(struct file *f, uint64 addr, int n)
+// filewritev 与 filereadv 类似，但针对写路径。
+//  - 对管道：空间不足时等待读者，读端全部关闭后返回错误；
+//  - 对 inode：writei 负责分配块、复制数据。各段连续写入，请求能放进一个事务时
+//    只开一次事务、加一次 inode 锁；更大的请求按日志容量分批。
+// 返回写入的总字节数，任何一段未能写完时返回 -1
+static int file_writev(struct file *f, int user, const struct iovec *iov, int cnt, long off)
 {
-    if(f->writable == 0)
+    if(f->writable == 0 || cnt < 0)
+        return -1;
+    if(off >= 0 && f->type != FD_INODE)
         return -1;
 
+    int n = iov_total(iov, cnt);
     switch(f->type) {
     case FD_PIPE:
-        return -1;
-    case FD_DEVICE:
-        if(f->major < 0 || f->major >= NDEV || devsw[f->major].write == 0)
+    case FD_DEVICE: {
+        if(f->type == FD_DEVICE && (f->major < 0 || f->major >= NDEV || devsw[f->major].write == 0))
             return -1;
-        return devsw[f->major].write(1, addr, n);
+        int tot = 0;
+        for(int i = 0; i < cnt; i++) {
+            uint64 addr = (uint64)iov[i].iov_base;
+            int m = iov[i].iov_len;
+            int r = f->type == FD_PIPE ? pipewrite(f->pipe, user, addr, m)
+                                       : devsw[f->major].write(user, addr, m);
+            if(r < 0)
+                return tot ? tot : -1;
+            tot += r;
+            if(r < m)
+                break;
+        }
+        return tot;
+    }
     case FD_INODE: {
-        // 分批写入以避免单次事务占用过多日志块，公式与 xv6 保持一致。
-        int max = ((MAX_OP_BLOCKS - 1 - 1 - 2) / 2) * BLOCK_SIZE;
+        if(!f->ip->ops->logged) {
+            // tmpfs 不经日志：整个请求加一次 inode 锁直接写入
+            ilock(f->ip);
+            uint32 pos = off < 0 ? f->off : (uint32)off;
+            int tot = 0;
+            for(int i = 0; i < cnt; i++) {
+                int r = writei(f->ip, user, (uint64)iov[i].iov_base, pos, iov[i].iov_len);
+                if(r > 0) {
+                    pos += r;
+                    tot += r;
+                }
+                if(r != (int)iov[i].iov_len)
+                    break;
+            }
+            if(off < 0)
+                f->off = pos;
+            iunlock(f->ip);
+            return tot == n ? n : -1;
+        }
+        // 分批写入以避免单次事务占用过多日志块：每批按需预留若干个操作的额度，
+        // 至多 log_max_ops() 个，大块写入因此只需少数几次提交
         int written = 0;
+        int seg = 0;          // 当前段
+        uint64 segoff = 0;    // 当前段内已写入的字节数
         while(written < n) {
             int chunk = n - written;
-            if(chunk > max)
-                chunk = max;
+            int nops = (chunk + FILEWRITE_MAX - 1) / FILEWRITE_MAX;
+            if(nops > log_max_ops())
+                nops = log_max_ops();
+            if(chunk > FILEWRITE_BYTES(nops))
+                chunk = FILEWRITE_BYTES(nops);
+            // 共享块的文件改写一块还可能改动一个引用计数块（写时复制），同样的额度只写一半
+            if((f->ip->flags & DI_SHARED) && chunk > FILEWRITE_BYTES(nops) / 2)
+                chunk = FILEWRITE_BYTES(nops) / 2;
 
-            begin_transaction();
+            begin_transaction_n(nops);
             ilock(f->ip);
-            int r = writei(f->ip, 1, addr + written, f->off, chunk);
-            if(r > 0)
-                f->off += r;
+            uint32 pos = off < 0 ? f->off : (uint32)off + written;
+            int left = chunk;
+            while(left > 0) {
+                int m = MIN(iov[seg].iov_len - segoff, (uint64)left);
+                int r = file_writei(f, user, (uint64)iov[seg].iov_base + segoff, pos, m);
+                if(r > 0)
+                    pos += r;
+                if(r != m)
+                    break;
+                left -= m;
+                segoff += m;
+                if(segoff == iov[seg].iov_len) {
+                    seg++;
+                    segoff = 0;
+                }
+            }
+            if(off < 0)
+                f->off = pos;
             iunlock(f->ip);
-            end_transaction();
+            end_transaction_n(nops);
 
-            if(r < 0)
-                return -1;
-            if(r != chunk)
+            if(left > 0)
                 return -1;
-            written += r;
+            written += chunk;
         }
         return written;
     }
@@ -179,3 +541,262 @@ int filewrite(struct file *f, uint64 addr, int n)
         return -1;
     }
 }
+
+// 读写的字节数计入当前进程的 rchar/wchar（iostat.h）
+int filereadv(struct file *f, int user, const struct iovec *iov, int cnt, long off)
+{
+    int r = file_readv(f, user, iov, cnt, off);
+    if(r > 0)
+        IOACCT(rchar, r);
+    return r;
+}
+
+int filewritev(struct file *f, int user, const struct iovec *iov, int cnt, long off)
+{
+    int r = file_writev(f, user, iov, cnt, off);
+    if(r > 0)
+        IOACCT(wchar, r);
+    return r;
+}
+
+int fileread(struct file *f, uint64 addr, int n)
+{
+    struct iovec iov = { (void *)addr, n };
+    if(n < 0)
+        return -1;
+    return filereadv(f, 1, &iov, 1, -1);
+}
+
+int filewrite(struct file *f, uint64 addr, int n)
+{
+    struct iovec iov = { (void *)addr, n };
+    if(n < 0)
+        return -1;
+    return filewritev(f, 1, &iov, 1, -1);
+}
+
+// filefallocate: 为普通文件预留覆盖 [0, off + len) 的磁盘块，不改变文件大小（见 ifallocate）。
+// 从文件末尾所在的块起分批分配，每批在各自的事务中至多 FALLOC_BATCH 块，
+// 涉及的位图块、间接块与区段块不超过一个操作的日志额度
+#define FALLOC_BATCH 256
+
+int filefallocate(struct file *f, long off, long len)
+{
+    if(f->type != FD_INODE || f->writable == 0 || off < 0 || len <= 0 ||
+       off + len > MAX_FILE_SIZE || f->ip->ops->fallocate == 0)
+        return -1;
+
+    struct inode *ip = f->ip;
+    uint32 nblocks = (off + len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    ilock(ip);
+    uint32 done = ip->size / BLOCK_SIZE;
+    iunlock(ip);
+
+    while(done < nblocks) {
+        uint32 want = MIN(nblocks, done + FALLOC_BATCH);
+        begin_transaction();
+        ilock(ip);
+        int r = ifallocate(ip, want);
+        iunlock(ip);
+        end_transaction();
+        if(r < 0)
+            return -1;
+        done = want;
+    }
+    return 0;
+}
+
+// fileclone: 截断 dst 后让它与 src 共享全部数据块（见 iclone），任一方之后改写某块时才复制，
+// 复制大文件只需改动元数据。两个 inode 按 inode 号顺序加锁，分批在各自的事务中进行，
+// 中途失败时 dst 被截断为空。成功返回 0
+int fileclone(struct file *dst, struct file *src)
+{
+    if(dst->type != FD_INODE || src->type != FD_INODE || dst->writable == 0 || src->readable == 0 ||
+       dst->ip == src->ip || dst->ip->dev != src->ip->dev || dst->ip->dev == TMPDEV ||
+       dst->ip->type != T_FILE || src->ip->type != T_FILE ||
+       !(fs_superblock()->features & FS_FEAT_REFLINK))
+        return -1;
+
+    struct inode *first = src->ip, *second = dst->ip;
+    if(second->inum < first->inum) {
+        first = dst->ip;
+        second = src->ip;
+    }
+
+    begin_transaction_blocks(ifree_log_blocks());
+    ilock(dst->ip);
+    itrunc(dst->ip, 1);
+    iunlock(dst->ip);
+    end_transaction();
+
+    uint32 bn = 0;
+    int r;
+    do {
+        begin_transaction();
+        ilock(first);
+        ilock(second);
+        r = iclone(dst->ip, src->ip, &bn);
+        iunlock(second);
+        iunlock(first);
+        end_transaction();
+    } while(r > 0);
+
+    if(r < 0) {
+        begin_transaction_blocks(ifree_log_blocks());
+        ilock(dst->ip);
+        itrunc(dst->ip, 1);
+        iunlock(dst->ip);
+        end_transaction();
+        return -1;
+    }
+    return 0;
+}
+
+// filegetdents: 从 f 的当前偏移起读出至多 n 个目录项，以 struct dirent_info 写入用户地址 addr，
+// 返回写入的项数，到达目录末尾时为 0。每批在持有目录锁时按块读入目录内容、攒满一页记录
+// 并推进偏移；GETDENTS_STAT 要取的子 inode 在放开目录锁之后再逐个加锁——
+// "." 与 ".." 就是目录自身和它的父目录，持着目录锁去锁它们会自锁或与路径解析的加锁顺序相反
+#define DIRENT_BATCH ((int)(PGSIZE / sizeof(struct dirent_info)))
+
+int filegetdents(struct file *f, uint64 addr, int n, int flags)
+{
+    if(f->type != FD_INODE || f->readable == 0 || n < 0)
+        return -1;
+
+    struct inode *ip = f->ip;
+    char *blk = alloc_pages(2);          // 一页目录块缓冲，一页记录
+    if(blk == 0)
+        return -1;
+    struct dirent_info *rec = (struct dirent_info *)(blk + PGSIZE);
+    int done = 0, err = 0;
+
+    acquiresleep(&f->poslock);
+    while(done < n && !err) {
+        int cnt = 0, max = MIN(n - done, DIRENT_BATCH);
+        ilock_shared(ip);
+        if(ip->type != T_DIR) {
+            iunlock_shared(ip);
+            err = 1;
+            break;
+        }
+        // 偏移不在目录项边界上（之前用 read 读过目录）时从下一项开始
+        uint32 off = (f->off + sizeof(struct dirent) - 1) / sizeof(struct dirent) * sizeof(struct dirent);
+        while(cnt < max && off < ip->size) {
+            uint32 end = MIN(ip->size, (off / BLOCK_SIZE + 1) * BLOCK_SIZE);
+            if(readi(ip, 0, (uint64)blk + off % BLOCK_SIZE, off, end - off) != (int)(end - off)) {
+                err = 1;
+                break;
+            }
+            for(; off + sizeof(struct dirent) <= end && cnt < max; off += sizeof(struct dirent)) {
+                struct dirent *de = (struct dirent *)(blk + off % BLOCK_SIZE);
+                if(de->inum == 0)
+                    continue;
+                struct dirent_info *di = &rec[cnt++];
+                memset(di, 0, sizeof(*di));
+                di->inum = de->inum;
+                memmove(di->name, de->name, DIRSIZ);
+            }
+        }
+        f->off = off;
+        uint32 dev = ip->dev;
+        iunlock_shared(ip);
+
+        if(flags & GETDENTS_STAT) {
+            for(int i = 0; i < cnt; i++) {
+                struct inode *cp = iget(dev, rec[i].inum);
+                ilock_shared(cp);
+                rec[i].type = cp->type;
+                rec[i].nlink = cp->nlink;
+                rec[i].size = cp->size;
+                iunlock_shared(cp);
+                iput(cp);
+            }
+        }
+        if(cnt == 0)
+            break;
+        if(copyout(myproc()->pagetable, addr + done * sizeof(struct dirent_info),
+                   (const char *)rec, cnt * sizeof(struct dirent_info)) < 0) {
+            err = 1;
+            break;
+        }
+        done += cnt;
+    }
+    releasesleep(&f->poslock);
+    free_pages(blk, 2);
+    return done ? done : (err ? -1 : 0);
+}
+
+// filesendfile: 在内核中把 in 的至多 n 个字节搬到 out 的当前偏移，返回搬运的字节数。
+// off 为 -1 时从 in 的当前偏移读取并推进它，否则从 off 处读取（仅普通文件）。
+// 普通文件到管道直接读入管道环（pipe_splice），其余组合经一块多页的内核缓冲区中转，
+// 每批只有一次读与一次写，不经用户态拷贝
+#define SENDFILE_PAGES 8
+
+int filesendfile(struct file *out, struct file *in, long off, int n)
+{
+    if(in->readable == 0 || out->writable == 0 || n < 0)
+        return -1;
+    if(off >= 0 && in->type != FD_INODE)
+        return -1;
+
+    int done = 0;
+    if(in->type == FD_INODE && out->type == FD_PIPE && off < 0) {
+        while(done < n) {
+            int r = pipe_splice(out->pipe, in, n - done);
+            if(r <= 0)
+                return done ? done : r;
+            IOACCT(rchar, r);
+            IOACCT(wchar, r);
+            done += r;
+        }
+        return done;
+    }
+
+    int bufsize = SENDFILE_PAGES * PGSIZE;
+    char *buf = alloc_pages(SENDFILE_PAGES);
+    if(buf == 0) {
+        bufsize = PGSIZE;
+        if((buf = alloc_page_nozero()) == 0)
+            return -1;
+    }
+    while(done < n) {
+        struct iovec iov = { buf, MIN(n - done, bufsize) };
+        int r = filereadv(in, 0, &iov, 1, off < 0 ? -1 : off + done);
+        if(r <= 0) {
+            if(r < 0 && done == 0)
+                done = -1;
+            break;
+        }
+        iov.iov_len = r;
+        if(filewritev(out, 0, &iov, 1, -1) != r) {
+            if(done == 0)
+                done = -1;
+            break;
+        }
+        done += r;
+        if(r < bufsize && in->type != FD_INODE)
+            break;   // 管道或设备暂时没有更多数据，不再等待
+    }
+    if(bufsize == PGSIZE)
+        free_page(buf);
+    else
+        free_pages(buf, SENDFILE_PAGES);
+    return done;
+}
+
+// filewrite_intx: 向普通文件写入不超过 FILEWRITE_MAX 的数据，不自行开启事务。
+// 调用者已通过 begin_transaction_n 为本次写入预留了一个操作的日志额度
+int filewrite_intx(struct file *f, uint64 addr, int n)
+{
+    if(f->writable == 0 || f->type != FD_INODE || n < 0 || n > FILEWRITE_MAX)
+        return -1;
+
+    ilock(f->ip);
+    int r = writei(f->ip, 1, addr, f->off, n);
+    if(r > 0) {
+        f->off += r;
+        IOACCT(wchar, r);
+    }
+    iunlock(f->ip);
+    return r == n ? r : -1;
+}
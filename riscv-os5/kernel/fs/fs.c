@@ -9,6 +9,12 @@
 #include "proc.h"
 #include "vm.h"
 #include "klog.h"
+#include "slab.h"
+#include "kalloc.h"
+#include "pcache.h"
+#include "exec.h"
+#include "blkdev.h"
+#include "bitops.h"
 
 // fs.c 实现文件系统的核心逻辑：超级块初始化、inode 缓存、块分配、目录遍历
 // 以及 read/write 等操作。整体设计与 xv6 类似，通过 bio.c 的缓冲层
@@ -22,22 +28,144 @@
 static struct superblock sb;  // 全局超级块缓存，由 fs_init() 读取并常驻内存。
 
 // itable 维护内存中的 inode 缓存：
-//   - lock: 保护 inode 表的自旋锁；
-//   - inode[]: 内存inode的缓存表，固定大小的缓存槽，每个槽附带睡眠锁。
-struct {
-    struct spinlock lock;
-    struct inode inode[NINODE];
+//   - hash: 按 (dev, inum) 散列的表（htable.h），条带锁保护桶内链表与其中 inode 的 ref，
+//     不同条带上的路径解析互不阻塞；桶数随 inode 个数翻倍，链长保持在常数；
+//   - cache: struct inode 的 slab cache，构造函数初始化睡眠锁。引用计数降为 0 的 inode
+//     立即摘出并交还，内存中的 inode 个数随负载增长，只受物理内存限制。
+static struct {
+    struct htable hash;
+    struct kmem_cache *cache;
 } itable;
 
-static uint32 balloc(uint32 dev);
+static inline uint64 ihash(uint32 dev, uint32 inum)
+{
+    return hash_pair(dev, inum);
+}
+
+// slab 构造函数：对象交还时睡眠锁处于未持有状态，复用时无需重新初始化
+static void inode_ctor(void *obj)
+{
+    initsleeplock(&((struct inode *)obj)->lock, "inode");
+}
+
+// 分配摘要：各位图块中的空闲块数与各 inode 块中的空闲 inode 数，以及块与 inode 的
+// 轮转游标。挂载时扫描位图与 inode 表建立，之后随分配与释放维护，只驻留内存；
+// 两个计数数组按超级块记录的布局从页分配器取得。
+// 分配时跳过计数为 0 的块，位图按 64 位字查找空闲位。
+// 按块组分配（FS_FEAT_GROUPS）时另记各组的空闲数与数据块游标：新文件的 inode 放在父目录
+// 所在的组，新目录放在空闲 inode 不少于平均值的组中空闲块最多的一个（仿 ext2），
+// 数据块从 inode 所在组的游标处分配。组满时查找自然延续到后面的组
+#define NBMAP_BLOCKS(sb)  ((sb).size / BPB + 1)
+#define NINODE_BLOCKS(sb) (((sb).ninodes + IPB - 1) / IPB)
+
+static struct {
+    struct spinlock lock;              // 保护下列计数与游标
+    uint32 *bfree;                     // 每个位图块描述的空闲数据块数
+    uint32 *ifree;                     // 每个 inode 块中的空闲 inode 数
+    uint32 bcursor;                    // 下一次无目标分配从此块号开始查找
+    uint32 icursor;                    // 最近分配过 inode 的 inode 块
+    uint32 ngroups;                    // 块组数，未启用块组时为 0
+    uint32 gifree[FS_MAX_GROUPS];      // 各组的空闲 inode 数
+    uint32 gbfree[FS_MAX_GROUPS];      // 各组的空闲数据块数
+    uint32 gcursor[FS_MAX_GROUPS];     // 各组下一次分配数据块的起点
+    uchar *bpend;                      // 顺序数据模式：各位图块中已释放、释放尚未落盘的块（见 bpend_get）
+    uint64 *bpend_seq;                 // 各位图块最近一次释放所在的事务序号，0 表示没有待落盘的释放
+} fsalloc;
+
+static void fsalloc_init(uint32 dev);
+
+// 孤儿 inode：已没有目录项（nlink 为 0）、最后一个引用也已放开，等待回收线程释放数据块与 inode。
+// 第 i 个槽对应超级块孤儿表的 orphan[i]：iput 在放开引用的日志操作中记入，回收线程在释放 inode
+// 的同一个操作中清除，因此崩溃后下次挂载时按表继续。挂载时还扫描 inode 表，把 unlink 提交后、
+// 最后一个引用放开前崩溃留下的 nlink 为 0 的 inode 补进空槽（只在内存中，再次崩溃时会再被扫到）。
+// inum 为 0 表示空槽；ip 为 0 表示挂载时发现、尚未取得内存 inode 的槽
+static struct {
+    struct spinlock lock;
+    uint32 inum[FS_NORPHAN];
+    struct inode *ip[FS_NORPHAN];   // iput 交出的最后一个引用
+    int running;                    // 回收线程已启动，iput 才把 inode 交给它
+} orphans;
+static void orphan_load(uint32 dev);
+static void orphan_found(uint32 inum);
+static uint32 balloc_nfree(void);
+
+// 待丢弃（TRIM）的块区间：bfree 释放的块记在这里，按块号排序，块号相邻的合并成一段。
+// 写回式日志下释放块的事务提交后，缓存中钉住的脏块仍可能在检查点时写到这些块上，
+// 所以由检查点在写回之后调用 bdiscard_flush 交给设备；块在此之前被重新分配时从区间中剔除。
+// 丢弃只是提示，区间表满时新释放的块不再记录。设备不支持丢弃时不做任何记录
+#define NDISCARD 64
+
+static struct {
+    struct spinlock lock;
+    int enabled;
+    uint32 dev;
+    int n;
+    struct blk_range r[NDISCARD];
+    struct blk_range out[NDISCARD];    // 交给设备的副本，只在检查点中使用
+} discard;
+static uint32 balloc(struct inode *ip);
+static uint32 balloc_nozero(struct inode *ip, int zero);
+static uint32 balloc_range(uint32 dev, uint32 goal, uint32 want, uint32 *got, uint32 nozero);
 static void bfree(uint32 dev, uint32 b);
+static void bfree_range(uint32 dev, uint32 b, uint32 n);
+static void bfree_many(uint32 dev, uint32 *b, uint32 n);
+static void discard_cancel(uint32 bno, uint32 n);
 static uint32 bmap(struct inode *ip, uint32 bn);
+static uint32 bmap_alloc(struct inode *ip, uint32 bn, int zero);
+static uint32 bmap_peek(struct inode *ip, uint32 bn);
+static int bmap_set(struct inode *ip, uint32 bn, uint32 addr);
+static int bref_get(uint32 dev, uint32 b);
+static int bref_inc(uint32 dev, uint32 b);
+static int bref_put(uint32 dev, uint32 b);
+static uint32 bref_put_many(uint32 dev, uint32 *b, uint32 n);
+static void bfree_range_shared(uint32 dev, uint32 b, uint32 n);
+#define DIR_NOFREE 0xffffffffu   // dirscan 未找到空闲槽
+static uint32 dirfind(struct inode *dp, const char *name, uint32 *poff);
+static uint32 dirscan(struct inode *dp, const char *name, uint32 from, uint32 to,
+                      uint32 *poff, uint32 *pfree, int *overflow);
+static uint32 dirhash_slot(struct inode *dp, const char *name);
+static uint32 ext_nblocks(struct inode *ip);
+static uint32 ext_bmap(struct inode *ip, uint32 bn);
+static int ext_grow(struct inode *ip, uint32 nblocks, uint32 fullend);
+static int ext_set(struct inode *ip, uint32 bn, uint32 addr);
+struct trunc;
+static void ext_trunc(struct trunc *ts);
 static int namecmp(const char *s, const char *t);
+static void dcache_init(void);
+static int dcache_lookup(struct inode *dp, const char *name, uint32 *inum, uint32 *off);
+static void dcache_enter(struct inode *dp, const char *name, uint32 inum, uint32 off);
+static void dcache_purge(uint32 dev, uint32 dir);
 static char *skipelem(char *path, char *name);
 static int build_symlink_path(char *dst, const char *target, const char *rest);
 static struct inode *namex_from(struct inode *start, char *path, int nameiparent, char *name, int depth);
 static struct inode *namex(char *path, int nameiparent, char *name);
 
+// 磁盘文件系统的 inode 操作
+static void disk_load(struct inode *ip);
+static void disk_update(struct inode *ip);
+static void disk_trunc(struct inode *ip, int split);
+static void disk_free(struct inode *ip);
+static int disk_readi(struct inode *ip, int user_dst, uint64 dst, uint32 off, uint32 n);
+static int disk_writei(struct inode *ip, int user_src, uint64 src, uint32 off, uint32 n);
+static struct inode *disk_dirlookup(struct inode *dp, char *name, uint32 *poff);
+static int disk_dirlink(struct inode *dp, char *name, uint32 inum);
+static int disk_dirempty(struct inode *dp);
+static int disk_fallocate(struct inode *ip, uint32 nblocks);
+
+static const struct inode_ops disk_ops = {
+    .logged = 1,
+    .load = disk_load,
+    .update = disk_update,
+    .trunc = disk_trunc,
+    .free = disk_free,
+    .read = disk_readi,
+    .write = disk_writei,
+    .lookup = disk_dirlookup,
+    .link = disk_dirlink,
+    .empty = disk_dirempty,
+    .fallocate = disk_fallocate,
+};
+
 // 向外暴露超级块只读指针，方便系统调用等模块查询布局信息。
 const struct superblock *fs_superblock(void)
 {
@@ -45,55 +173,287 @@ const struct superblock *fs_superblock(void)
 }
 
 // fs_init 完成以下工作：
-//   1) 构造超级块并写入根设备预设布局；
-//   2) 初始化内存 inode 缓存和其睡眠锁；
-//   3) 打印布局信息以便调试。
+//   1) 从根设备读取 mkfs 写入的超级块并校验；
+//   2) 初始化日志并执行崩溃恢复；
+//   3) 初始化内存 inode 缓存和其睡眠锁；
+//   4) 打印布局信息以便调试。
 void fs_init(void)
 {
-    memset(&sb, 0, sizeof(sb));
-    sb.magic = FS_MAGIC;
-    sb.size = FS_TOTAL_BLOCKS;
-    sb.nlog = LOG_SIZE;
-    sb.logstart = LOG_START;
-    sb.inodestart = INODE_START;
-    sb.bmapstart = BMAP_START;
-    sb.ninodes = INODE_BLOCKS * IPB;
-    sb.nblocks = FS_TOTAL_BLOCKS - DATA_START;
+    struct buf *bp = bread(ROOTDEV, SUPERBLOCK_BLOCKNO);
+    memmove(&sb, bp->data, sizeof(sb));
+    brelse(bp);
+    if(sb.magic != FS_MAGIC)
+        panic("fs_init: bad magic");
+    if(sb.nlog < LOG_MIN || sb.nlog > LOG_MAX || sb.ninodes < 2 || sb.ninodes > FS_MAX_INODES ||
+       sb.logstart + sb.nlog > sb.inodestart ||
+       sb.inodestart + NINODE_BLOCKS(sb) > sb.bmapstart || SB_DATASTART(sb) >= sb.size)
+        panic("fs_init: bad layout");
+    if((sb.features & FS_FEAT_GROUPS) &&
+       (sb.ngroups < 1 || sb.ngroups > FS_MAX_GROUPS || sb.ipg == 0 || sb.ipg % IPB != 0 || sb.bpg == 0))
+        panic("fs_init: bad block groups");
+    if((sb.features & FS_FEAT_REFLINK) &&
+       (sb.refstart < SB_DATASTART(sb) || sb.refstart + sb.nref > sb.size ||
+        (uint64)sb.nref * BLOCK_SIZE < sb.size))
+        panic("fs_init: bad refcount area");
 
     log_init(ROOTDEV, &sb);
+    orphan_load(ROOTDEV);
+    fsalloc_init(ROOTDEV);
+    dcache_init();
+
+    if(htable_init(&itable.hash, "itable") < 0)
+        panic("fs_init: itable");
+    itable.cache = kmem_cache_create("inode", sizeof(struct inode), inode_ctor);
+    if(itable.cache == 0)
+        panic("fs_init: kmem_cache_create");
+    tmpfs_init();
+
+    klog_info("fs: superblock total=%u data=%u ninodes=%u features=%x",
+              sb.size, sb.nblocks, sb.ninodes, sb.features);
+    klog_info("fs: layout super=%d log[%d~%d) inode[%d~%d) bmap=%d data=%d",
+              SUPERBLOCK_BLOCKNO,
+              sb.logstart, sb.logstart + sb.nlog,
+              sb.inodestart, sb.bmapstart,
+              sb.bmapstart, SB_DATASTART(sb));
+    if(fsalloc.ngroups)
+        klog_info("fs: %u block groups, %u inodes / %u blocks each",
+                  sb.ngroups, sb.ipg, sb.bpg);
+    if(sb.features & FS_FEAT_REFLINK)
+        klog_info("fs: block refcounts [%u~%u)", sb.refstart, sb.refstart + sb.nref);
+}
+
+// 日志恢复之后读取超级块中的孤儿表（挂载时读入的 sb 可能早于日志中较新的超级块）
+static void orphan_load(uint32 dev)
+{
+    initlock(&orphans.lock, "orphans");
+    struct buf *bp = bread(dev, SUPERBLOCK_BLOCKNO);
+    struct superblock *dsb = (struct superblock *)bp->data;
+    for(int i = 0; i < FS_NORPHAN; i++) {
+        uint32 inum = dsb->orphan[i];
+        orphans.inum[i] = inum > ROOTINO && inum < sb.ninodes ? inum : 0;
+    }
+    brelse(bp);
+}
 
-    initlock(&itable.lock, "itable");
-    for(int i = 0; i < NINODE; i++) {
-        itable.inode[i].ref = 0;
-        itable.inode[i].valid = 0;
-        initsleeplock(&itable.inode[i].lock, "inode");
+// 挂载时扫描到的 nlink 为 0 的 inode，不在孤儿表中时补进一个空槽；没有空槽就留给下次挂载
+static void orphan_found(uint32 inum)
+{
+    int free = -1;
+    for(int i = FS_NORPHAN - 1; i >= 0; i--) {
+        if(orphans.inum[i] == inum)
+            return;
+        if(orphans.inum[i] == 0)
+            free = i;
     }
+    if(free >= 0)
+        orphans.inum[free] = inum;
+}
 
-    klog_info("fs: superblock total=%u data=%u ninodes=%u", sb.size, sb.nblocks, sb.ninodes);
-    klog_info("fs: layout super=%d log[%d~%d) inode[%d~%d) bmap=%d",
-              SUPERBLOCK_BLOCKNO,
-              LOG_START, LOG_START + LOG_SIZE,
-              INODE_START, INODE_START + INODE_BLOCKS,
-              BMAP_START);
+// orphan_add: 把放开最后一个引用的已删除 inode 连同这个引用交给回收线程，只改写超级块一块，
+// 不在日志操作中时自行开启一个。回收线程未启动或孤儿表已满时返回 -1，由调用者当场释放
+static int orphan_add(struct inode *ip)
+{
+    if(!orphans.running)
+        return -1;
+    int own_tx = !in_transaction();
+    if(own_tx)
+        begin_transaction_blocks(1);
+    // 持有超级块缓冲区期间占用槽位：回收线程即使马上取走，清除这一项也在记入之后
+    struct buf *bp = bread_meta(ip->dev, SUPERBLOCK_BLOCKNO);
+    acquire(&orphans.lock);
+    int i = 0;
+    while(i < FS_NORPHAN && orphans.inum[i] != 0)
+        i++;
+    if(i < FS_NORPHAN) {
+        orphans.inum[i] = ip->inum;
+        orphans.ip[i] = ip;
+    }
+    release(&orphans.lock);
+    if(i < FS_NORPHAN) {
+        ((struct superblock *)bp->data)->orphan[i] = ip->inum;
+        log_block_write(bp);
+    }
+    brelse(bp);
+    if(own_tx)
+        end_transaction();
+    if(i == FS_NORPHAN)
+        return -1;
+    wakeup(&orphans);
+    return 0;
+}
+
+// 回收线程：逐个释放孤儿 inode。每个 inode 自行开启可分批提交的日志操作，
+// 超级块中的槽在最后一批里与 inode 一起清除
+static void orphan_reclaim(void *arg)
+{
+    (void)arg;
+    for(;;) {
+        acquire(&orphans.lock);
+        int i;
+        for(;;) {
+            for(i = 0; i < FS_NORPHAN && orphans.inum[i] == 0; i++)
+                ;
+            if(i < FS_NORPHAN)
+                break;
+            sleep(&orphans, &orphans.lock);
+        }
+        uint32 inum = orphans.inum[i];
+        struct inode *ip = orphans.ip[i];
+        release(&orphans.lock);
+        if(ip == 0)
+            ip = iget(ROOTDEV, inum);
+
+        begin_transaction_blocks(ifree_log_blocks());
+        acquiresleep(&ip->lock);   // 不用 ilock：容忍孤儿表中已释放（type 为 0）的过时项
+        if(ip->valid == 0) {
+            ip->ops->load(ip);
+            ip->map_n = 0;
+            ip->valid = ip->type != 0;
+        }
+        if(ip->valid && ip->nlink == 0) {
+            itrunc(ip, 1);
+            if(ip->type == T_DIR)
+                dcache_purge(ip->dev, ip->inum);
+            ip->ops->free(ip);
+            ip->valid = 0;
+        }
+        struct buf *bp = bread_meta(ip->dev, SUPERBLOCK_BLOCKNO);
+        ((struct superblock *)bp->data)->orphan[i] = 0;
+        log_block_write(bp);
+        brelse(bp);
+        acquire(&orphans.lock);
+        orphans.inum[i] = 0;
+        orphans.ip[i] = 0;
+        release(&orphans.lock);
+        releasesleep(&ip->lock);
+        end_transaction();
+        iput(ip);
+    }
+}
+
+// fs_reclaim_orphans: 启动孤儿 inode 回收线程，须在进程子系统就绪后调用。
+// 启动之前（或启动失败时）iput 仍当场释放已删除的 inode
+void fs_reclaim_orphans(void)
+{
+    if(kthread_create(orphan_reclaim, 0, "orphan") < 0) {
+        klog_warn("fs: 无法启动孤儿 inode 回收线程");
+        return;
+    }
+    acquire(&orphans.lock);
+    orphans.running = 1;
+    int n = 0;
+    for(int i = 0; i < FS_NORPHAN; i++)
+        n += orphans.inum[i] != 0;
+    release(&orphans.lock);
+    if(n > 0) {
+        klog_info("fs: 回收上次运行遗留的 %d 个孤儿 inode", n);
+        wakeup(&orphans);
+    }
+}
+
+// inode 号与数据块号所在的块组，越过最后一组的部分归入最后一组
+static uint32 inode_group(uint32 inum)
+{
+    uint32 g = inum / sb.ipg;
+    return g < fsalloc.ngroups ? g : fsalloc.ngroups - 1;
+}
+
+static uint32 block_group(uint32 b)
+{
+    uint32 start = SB_DATASTART(sb);
+    uint32 g = b < start ? 0 : (b - start) / sb.bpg;
+    return g < fsalloc.ngroups ? g : fsalloc.ngroups - 1;
+}
+
+// 为新 inode 挑选块组，调用者持有 fsalloc.lock。目录分散到各组，其余放在父目录所在的组
+static uint32 ialloc_group(short type, uint32 parent)
+{
+    if(type != T_DIR)
+        return parent ? inode_group(parent) : 0;
+
+    uint32 total = 0;
+    for(uint32 g = 0; g < fsalloc.ngroups; g++)
+        total += fsalloc.gifree[g];
+    uint32 avg = total / fsalloc.ngroups;
+    int best = -1;
+    for(uint32 g = 0; g < fsalloc.ngroups; g++) {
+        if(fsalloc.gifree[g] == 0 || fsalloc.gifree[g] < avg)
+            continue;
+        if(best < 0 || fsalloc.gbfree[g] > fsalloc.gbfree[best])
+            best = g;
+    }
+    return best < 0 ? 0 : best;
+}
+
+// 给 ip 分配数据块时的起点：所在块组的游标；未启用块组时为 0，即使用全局轮转游标
+static uint32 balloc_goal(struct inode *ip)
+{
+    if(fsalloc.ngroups == 0)
+        return 0;
+    acquire(&fsalloc.lock);
+    uint32 goal = fsalloc.gcursor[inode_group(ip->inum)];
+    release(&fsalloc.lock);
+    return goal;
 }
 
-// ialloc 遍历磁盘上的 dinode，寻找 type==0 的槽位，将其清空后分配给调用者。
-// 返回值是带引用计数的内存 inode，调用者需要持有睡眠锁。
-struct inode *ialloc(uint32 dev, short type)
+// ialloc 从游标所在的 inode 块起查找 type==0 的槽位，跳过没有空闲 inode 的块，
+// 将其清空后分配给调用者。返回值是带引用计数的内存 inode，调用者需要持有睡眠锁。
+// parent 为新 inode 所在目录的 inode 号，启用块组时据此从所选块组的第一个 inode 块起查找
+struct inode *ialloc(uint32 dev, short type, uint32 parent)
 {
-    for(uint32 inum = 1; inum < sb.ninodes; inum++) {
-        struct buf *bp = bread(dev, IBLOCK(inum, sb));
-        struct dinode *dip = (struct dinode *)bp->data + (inum % IPB);
-        if(dip->type == 0) {
+    uint32 nblk = NINODE_BLOCKS(sb);
+
+    if(dev == TMPDEV)
+        return tmpfs_ialloc(type);
+
+    acquire(&fsalloc.lock);
+    uint32 first = fsalloc.icursor;
+    if(fsalloc.ngroups)
+        first = ialloc_group(type, parent) * (sb.ipg / IPB);
+    release(&fsalloc.lock);
+
+    for(uint32 k = 0; k < nblk; k++) {
+        uint32 blk = (first + k) % nblk;
+        if(fsalloc.ifree[blk] == 0)
+            continue;
+        struct buf *bp = bread_meta(dev, sb.inodestart + blk);
+        for(uint32 slot = 0; slot < IPB; slot++) {
+            uint32 inum = blk * IPB + slot;
+            if(inum == 0)
+                continue;              // 0 号 inode 不使用
+            if(inum >= sb.ninodes)
+                break;
+            struct dinode *dip = (struct dinode *)bp->data + slot;
+            if(dip->type != 0)
+                continue;
             memset(dip, 0, sizeof(*dip));
             dip->type = type;
+            // 区段格式只用于普通文件：目录与符号链接很小，直接块已足够
+            if(type == T_FILE && (sb.features & FS_FEAT_EXTENTS))
+                dip->flags = DI_EXTENTS;
+            // 内联格式：内容先放在 addrs 中，长大后再转换为上面的格式
+            if((type == T_FILE || type == T_SYMLINK) && (sb.features & FS_FEAT_INLINE))
+                dip->flags = DI_INLINE;
+            // 散列目录的大小固定为全部桶，未使用的桶是空洞
+            if(type == T_DIR && (sb.features & FS_FEAT_HASHDIR)) {
+                dip->flags = DI_HASHDIR;
+                dip->size = DIRHASH_BUCKETS * BLOCK_SIZE;
+            }
             log_block_write(bp);          // 通过日志立即持久化，确保崩溃后不会重复分配。
             brelse(bp);
 
+            acquire(&fsalloc.lock);
+            fsalloc.ifree[blk]--;
+            fsalloc.icursor = blk;
+            if(fsalloc.ngroups)
+                fsalloc.gifree[inode_group(inum)]--;
+            release(&fsalloc.lock);
+
             struct inode *ip = iget(dev, inum);
             ip->type = type;
             ip->nlink = 0;
-            ip->size = 0;
+            ip->size = dip->size;
+            ip->flags = dip->flags;
             memset(ip->addrs, 0, sizeof(ip->addrs));
             return ip;
         }
@@ -104,45 +464,47 @@ struct inode *ialloc(uint32 dev, short type)
 }
 
 // iget 在内存 inode 缓存中查找指定 dev/inum。若命中，增加引用计数；
-// 若未命中，则选择 ref==0 的空槽并初始化元数据（valid=0 表示懒加载）。
+// 若未命中，则从 slab 取一个新 inode 挂入散列表（valid=0 表示懒加载）。
+// 新 inode 在条带锁内挂入，两个同时未命中的查找者不会各自建出同一个 inode。
 struct inode *iget(uint32 dev, uint32 inum)
 {
-    struct inode *ip, *empty = 0;
+    uint64 h = ihash(dev, inum);
+    struct inode *ip;
 
-    acquire(&itable.lock);
-    for(ip = itable.inode; ip < itable.inode + NINODE; ip++) {
-        if(ip->ref > 0 && ip->dev == dev && ip->inum == inum) {
+    htable_lock(&itable.hash, h);
+    for(struct hnode *n = *htable_bucket(&itable.hash, h); n; n = n->next) {
+        ip = hnode_entry(n, struct inode, hnode);
+        if(ip->dev == dev && ip->inum == inum) {
             ip->ref++;
-            release(&itable.lock);
+            htable_unlock(&itable.hash, h);
             return ip;
         }
-        if(empty == 0 && ip->ref == 0)
-            empty = ip;
     }
 
-    if(empty == 0)
+    if((ip = kmem_cache_alloc(itable.cache)) == 0)
         panic("iget: no inodes");
-
-    ip = empty;
     ip->dev = dev;
     ip->inum = inum;
     ip->ref = 1;
     ip->valid = 0;
-    release(&itable.lock);
-
+    ip->ops = dev == TMPDEV ? &tmpfs_ops : &disk_ops;
+    htable_add(&itable.hash, h, &ip->hnode);
+    htable_unlock(&itable.hash, h);
     return ip;
 }
 
 // idup 简化接口：对 inode 的引用计数 +1，保持结构复用与 iget 一致。
 struct inode *idup(struct inode *ip)
 {
-    acquire(&itable.lock);
+    uint64 h = ihash(ip->dev, ip->inum);
+
+    htable_lock(&itable.hash, h);
     ip->ref++;
-    release(&itable.lock);
+    htable_unlock(&itable.hash, h);
     return ip;
 }
 
-// ilock: 加睡眠锁并在必要时从磁盘加载 dinode 内容。该函数保障返回后
+// ilock: 加睡眠锁并在必要时经所属文件系统加载 inode 内容。该函数保障返回后
 // inode 数据字段有效，调用者必须在使用完毕后调用 iunlock。
 void ilock(struct inode *ip)
 {
@@ -151,21 +513,29 @@ void ilock(struct inode *ip)
 
     acquiresleep(&ip->lock);
     if(ip->valid == 0) {
-        struct buf *bp = bread(ip->dev, IBLOCK(ip->inum, sb));
-        struct dinode *dip = (struct dinode *)bp->data + (ip->inum % IPB);
-        ip->type = dip->type;
-        ip->major = dip->major;
-        ip->minor = dip->minor;
-        ip->nlink = dip->nlink;
-        ip->size = dip->size;
-        memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
-        brelse(bp);
+        ip->ops->load(ip);
+        ip->map_n = 0;
         ip->valid = 1;
         if(ip->type == 0)
             panic("ilock: no type");
     }
 }
 
+// 从磁盘 inode 表读入 dinode
+static void disk_load(struct inode *ip)
+{
+    struct buf *bp = bread_meta(ip->dev, IBLOCK(ip->inum, sb));
+    struct dinode *dip = (struct dinode *)bp->data + (ip->inum % IPB);
+    ip->type = dip->type;
+    ip->major = dip->major;
+    ip->minor = dip->minor;
+    ip->nlink = dip->nlink;
+    ip->size = dip->size;
+    ip->flags = dip->flags;
+    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    brelse(bp);
+}
+
 // iunlock: 在调用者完成 inode 数据访问后释放睡眠锁。
 void iunlock(struct inode *ip)
 {
@@ -174,16 +544,49 @@ void iunlock(struct inode *ip)
     releasesleep(&ip->lock);
 }
 
-// iupdate: 将内存 inode 的数据写回磁盘 dinode，保证持久化。
+// ilock_shared: 共享加锁，供只读取 inode 的路径使用（readi、dirlookup、路径解析、exec），
+// 多个读者可同时持有；修改 inode 或其内容的路径（writei、itrunc、dirlink 等）仍用 ilock 独占。
+// 共享持有期间不得修改 inode 字段：块映射缓存只在独占持有时填写（见 imap_fill），
+// 页缓存允许同一块被并发填充（见 pcache_insert）。尚未加载时先独占加锁完成加载
+void ilock_shared(struct inode *ip)
+{
+    if(ip == 0 || ip->ref < 1)
+        panic("ilock_shared");
+
+    for(;;) {
+        acquiresleep_shared(&ip->lock);
+        if(ip->valid)
+            return;
+        releasesleep_shared(&ip->lock);
+        ilock(ip);
+        iunlock(ip);
+    }
+}
+
+void iunlock_shared(struct inode *ip)
+{
+    if(ip == 0 || ip->ref < 1)
+        panic("iunlock_shared");
+    releasesleep_shared(&ip->lock);
+}
+
+// iupdate: 将内存 inode 的元数据写回所属文件系统。
 void iupdate(struct inode *ip)
 {
-    struct buf *bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+    ip->ops->update(ip);
+}
+
+// 将内存 inode 写回磁盘 dinode，经日志持久化
+static void disk_update(struct inode *ip)
+{
+    struct buf *bp = bread_meta(ip->dev, IBLOCK(ip->inum, sb));
     struct dinode *dip = (struct dinode *)bp->data + (ip->inum % IPB);
     dip->type = ip->type;
     dip->major = ip->major;
     dip->minor = ip->minor;
     dip->nlink = ip->nlink;
     dip->size = ip->size;
+    dip->flags = ip->flags;
     memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
     log_block_write(bp);
     brelse(bp);
@@ -191,21 +594,47 @@ void iupdate(struct inode *ip)
 
 // iput: 将引用计数减一。当满足 ref==1、valid==1、nlink==0 时，说明当前
 // 已经没有目录项指向该 inode，需回收磁盘块并将 type 置零。
+// 引用计数降为 0 时把 inode 摘出散列桶并交还 slab。
 void iput(struct inode *ip)
 {
-    acquire(&itable.lock);
+    uint64 h = ihash(ip->dev, ip->inum);
+
+    htable_lock(&itable.hash, h);
     if(ip->ref == 1 && ip->valid && ip->nlink == 0) {
-        release(&itable.lock);
+        htable_unlock(&itable.hash, h);
+        // 通常交给回收线程：这里只在超级块的孤儿表中记一项，关闭或退出的耗时与文件大小无关
+        if(ip->ops->logged && orphan_add(ip) == 0)
+            return;
+        // 当场释放。关闭已删除文件等路径不在事务中，此时自行开启一个只够释放 inode 的操作
+        int own_tx = ip->ops->logged && !in_transaction();
+        if(own_tx)
+            begin_transaction_blocks(ifree_log_blocks());
         ilock(ip);
-        itrunc(ip);       // 释放所有数据块并更新 size。
-        ip->type = 0;
-        iupdate(ip);
+        itrunc(ip, own_tx);   // 释放所有数据块并更新 size，自行开启的操作可分批提交
+        if(ip->type == T_DIR)
+            dcache_purge(ip->dev, ip->inum);
+        ip->ops->free(ip);
         ip->valid = 0;
         releasesleep(&ip->lock);
-        acquire(&itable.lock);
+        if(own_tx)
+            end_transaction();
+        htable_lock(&itable.hash, h);
+    }
+    if(--ip->ref > 0) {
+        htable_unlock(&itable.hash, h);
+        return;
     }
-    ip->ref--;
-    release(&itable.lock);
+    htable_del(&itable.hash, &ip->hnode);
+    htable_unlock(&itable.hash, h);
+
+    kmem_cache_free(itable.cache, ip);
+}
+
+// ifree_log_blocks: inode 块加上 itrunc 可能改动的全部位图块与引用计数块，不超过单个操作的上限
+int ifree_log_blocks(void)
+{
+    int n = 1 + NBMAP_BLOCKS(sb) + sb.nref;
+    return n < MAX_OP_BLOCKS ? n : MAX_OP_BLOCKS;
 }
 
 // iunlockput = iunlock + iput 的组合版本，常用于目录遍历中确保不会遗忘释放锁。
@@ -215,30 +644,82 @@ void iunlockput(struct inode *ip)
     iput(ip);
 }
 
+// 将 dinode 标记为空闲并归还分配摘要中的计数
+static void disk_free(struct inode *ip)
+{
+    ip->type = 0;
+    disk_update(ip);
+    acquire(&fsalloc.lock);
+    fsalloc.ifree[ip->inum / IPB]++;
+    if(fsalloc.ngroups)
+        fsalloc.gifree[inode_group(ip->inum)]++;
+    release(&fsalloc.lock);
+}
+
+// 命中块映射缓存时将逻辑块 bn 的物理块号存入 *addr（可能为 0，表示未分配）并返回 1
+static int imap_lookup(struct inode *ip, uint32 bn, uint32 *addr)
+{
+    uint32 i = bn - ip->map_base;
+    if(i >= ip->map_n)
+        return 0;
+    *addr = ip->map[i];
+    return 1;
+}
+
+// 把间接表 a 自第 idx 项起的一段映射载入块映射缓存，lbase 为 a[0] 对应的逻辑块号。
+// 共享持有 inode 锁的读者可能同时走到这里，只有独占持有者才填写
+static void imap_fill(struct inode *ip, uint32 lbase, const uint32 *a, uint32 idx)
+{
+    if(!holdingsleep(&ip->lock))
+        return;
+    uint32 n = MIN(IMAP_WINDOW, NINDIRECT - idx);
+    memmove(ip->map, a + idx, n * sizeof(uint32));
+    ip->map_base = lbase + idx;
+    ip->map_n = n;
+}
+
 // bmap: 将逻辑块号 (bn) 映射到磁盘块号，必要时分配新块。
 //  - 直接块：直接返回 ip->addrs[bn]；
 //  - 一级间接块：ip->addrs[NDIRECT] 指向含有数据块编号的表；
 //  - 二级间接块：ip->addrs[NDIRECT + 1] 指向一级间接表，该表再指向真实数据块。
+// 区段格式的 inode 转 ext_bmap，未映射的块先经 ext_grow 分配。
 static uint32 bmap(struct inode *ip, uint32 bn)
 {
+    return bmap_alloc(ip, bn, 1);
+}
+
+// bmap_alloc: 同 bmap；zero 为 0 时新分配的数据块不清零，调用者须在同一事务中整块覆盖它
+static uint32 bmap_alloc(struct inode *ip, uint32 bn, int zero)
+{
+    if(ip->flags & DI_EXTENTS) {
+        if(bn >= ext_nblocks(ip) && ext_grow(ip, bn + 1, zero ? 0 : bn + 1) < 0)
+            panic("bmap: too many extents");
+        return ext_bmap(ip, bn);
+    }
+
     if(bn < NDIRECT) {
         if(ip->addrs[bn] == 0)
-            ip->addrs[bn] = balloc(ip->dev);
+            ip->addrs[bn] = balloc_nozero(ip, zero);
         return ip->addrs[bn];
     }
 
+    uint32 addr;
+    if(imap_lookup(ip, bn, &addr) && addr)
+        return addr;   // 已分配的映射不必再读间接块
+
     bn -= NDIRECT;
     if(bn < NINDIRECT) {
         if(ip->addrs[NDIRECT] == 0)
-            ip->addrs[NDIRECT] = balloc(ip->dev);   // 延迟分配一级间接块。
+            ip->addrs[NDIRECT] = balloc(ip);   // 延迟分配一级间接块。
 
-        struct buf *bp = bread(ip->dev, ip->addrs[NDIRECT]);
+        struct buf *bp = bread_meta(ip->dev, ip->addrs[NDIRECT]);
         uint32 *a = (uint32 *)bp->data;
         if(a[bn] == 0) {
-            a[bn] = balloc(ip->dev);
+            a[bn] = balloc_nozero(ip, zero);
             log_block_write(bp);                  // 仅在新增映射时记录日志，避免重复写入。
         }
-        uint32 addr = a[bn];
+        addr = a[bn];
+        imap_fill(ip, NDIRECT, a, bn);
         brelse(bp);
         return addr;
     }
@@ -248,86 +729,370 @@ static uint32 bmap(struct inode *ip, uint32 bn)
         panic("bmap: out of range");
 
     if(ip->addrs[NDIRECT + 1] == 0)
-        ip->addrs[NDIRECT + 1] = balloc(ip->dev);   // 延迟分配二级间接块。
+        ip->addrs[NDIRECT + 1] = balloc(ip);   // 延迟分配二级间接块。
 
-    struct buf *dbp = bread(ip->dev, ip->addrs[NDIRECT + 1]);
+    struct buf *dbp = bread_meta(ip->dev, ip->addrs[NDIRECT + 1]);
     uint32 *d = (uint32 *)dbp->data;
     uint32 first = bn / NINDIRECT;                 // 一级间接索引。
     uint32 second = bn % NINDIRECT;                // 二级间接表内的偏移。
 
     if(d[first] == 0) {
-        d[first] = balloc(ip->dev);               // 分配新的一级间接表。
+        d[first] = balloc(ip);               // 分配新的一级间接表。
         log_block_write(dbp);                     // 记录指针更新。
     }
-    struct buf *sbp = bread(ip->dev, d[first]);
+    struct buf *sbp = bread_meta(ip->dev, d[first]);
     uint32 *a = (uint32 *)sbp->data;
     if(a[second] == 0) {
-        a[second] = balloc(ip->dev);              // 分配最终数据块。
+        a[second] = balloc_nozero(ip, zero); // 分配最终数据块。
         log_block_write(sbp);                     // 记录二级表的更新。
     }
-    uint32 addr = a[second];
+    addr = a[second];
+    imap_fill(ip, NDIRECT + NINDIRECT + first * NINDIRECT, a, second);
     brelse(sbp);
     brelse(dbp);
     return addr;
 }
 
-// itrunc: 释放 inode 关联的所有数据块，包括直接块、一级间接块与二级间接块。
-// 调用方必须已经持有 inode 锁。
-void itrunc(struct inode *ip)
+// bmap_peek: 只查找、不分配，逻辑块 bn 尚未分配时返回 0。
+// 普通文件没有空洞，只有散列目录中尚未使用的桶会返回 0
+static uint32 bmap_peek(struct inode *ip, uint32 bn)
 {
-    // 释放直接块。
-    for(int i = 0; i < NDIRECT; i++) {
-        if(ip->addrs[i]) {
-            bfree(ip->dev, ip->addrs[i]);
-            ip->addrs[i] = 0;
-        }
+    if(ip->flags & DI_EXTENTS)
+        return bn < ext_nblocks(ip) ? ext_bmap(ip, bn) : 0;
+
+    if(bn < NDIRECT)
+        return ip->addrs[bn];
+
+    uint32 addr;
+    if(imap_lookup(ip, bn, &addr))
+        return addr;
+
+    bn -= NDIRECT;
+    if(bn < NINDIRECT) {
+        if(ip->addrs[NDIRECT] == 0)
+            return 0;
+        struct buf *bp = bread_meta(ip->dev, ip->addrs[NDIRECT]);
+        addr = ((uint32 *)bp->data)[bn];
+        imap_fill(ip, NDIRECT, (uint32 *)bp->data, bn);
+        brelse(bp);
+        return addr;
     }
 
-    // 释放一级间接块引用的所有数据块，并回收该间接块。
-    if(ip->addrs[NDIRECT]) {
-        struct buf *bp = bread(ip->dev, ip->addrs[NDIRECT]);
-        uint32 *a = (uint32 *)bp->data;
-        for(uint32 j = 0; j < NINDIRECT; j++) {
-            if(a[j]) {
-                bfree(ip->dev, a[j]);
-                a[j] = 0;
-            }
+    bn -= NINDIRECT;
+    if(bn >= NDOUBLE || ip->addrs[NDIRECT + 1] == 0)
+        return 0;
+    struct buf *dbp = bread_meta(ip->dev, ip->addrs[NDIRECT + 1]);
+    uint32 first = ((uint32 *)dbp->data)[bn / NINDIRECT];
+    brelse(dbp);
+    if(first == 0)
+        return 0;
+    struct buf *sbp = bread_meta(ip->dev, first);
+    addr = ((uint32 *)sbp->data)[bn % NINDIRECT];
+    imap_fill(ip, NDIRECT + NINDIRECT + bn / NINDIRECT * NINDIRECT, (uint32 *)sbp->data, bn % NINDIRECT);
+    brelse(sbp);
+    return addr;
+}
+
+// bmap_set: 把逻辑块 bn 改为映射到 addr，供写时复制换块与 clone_file 建立映射使用。
+// 缺少的间接表就地分配，改动的表记入日志；区段格式转 ext_set，区段数超出上限时返回 -1。
+// 不改变原来映射的块的引用，调用者随后 iupdate
+static int bmap_set(struct inode *ip, uint32 bn, uint32 addr)
+{
+    if(ip->flags & DI_EXTENTS)
+        return ext_set(ip, bn, addr);
+
+    ip->map_n = 0;
+    if(bn < NDIRECT) {
+        ip->addrs[bn] = addr;
+        return 0;
+    }
+
+    uint32 t;
+    bn -= NDIRECT;
+    if(bn < NINDIRECT) {
+        if(ip->addrs[NDIRECT] == 0)
+            ip->addrs[NDIRECT] = balloc(ip);
+        t = ip->addrs[NDIRECT];
+    } else {
+        bn -= NINDIRECT;
+        if(bn >= NDOUBLE)
+            panic("bmap_set: out of range");
+        if(ip->addrs[NDIRECT + 1] == 0)
+            ip->addrs[NDIRECT + 1] = balloc(ip);
+        struct buf *dbp = bread_meta(ip->dev, ip->addrs[NDIRECT + 1]);
+        uint32 *d = (uint32 *)dbp->data;
+        if(d[bn / NINDIRECT] == 0) {
+            d[bn / NINDIRECT] = balloc(ip);
+            log_block_write(dbp);
         }
-        brelse(bp);
-        bfree(ip->dev, ip->addrs[NDIRECT]);
-        ip->addrs[NDIRECT] = 0;
+        t = d[bn / NINDIRECT];
+        brelse(dbp);
+        bn %= NINDIRECT;
+    }
+    struct buf *bp = bread_meta(ip->dev, t);
+    ((uint32 *)bp->data)[bn] = addr;
+    log_block_write(bp);
+    brelse(bp);
+    return 0;
+}
+
+// itrunc: 释放 inode 的全部数据并将长度清零。调用方必须已经持有 inode 锁。
+// split 为 1 表示调用者独占当前日志操作，大文件可以分成多个操作提交
+void itrunc(struct inode *ip, int split)
+{
+    exec_cache_invalidate(ip->dev, ip->inum);
+    ip->ops->trunc(ip, split);
+}
+
+// 截断状态：一个单元（直接块、一张间接表或一个区段在同一位图块中的一段）的块先收集到 b 中，
+// 按块号排序后按位图块成批清位。split 时各批在各自的日志操作中提交：单元开始释放之前，
+// 若它要改动的位图块加上本批已改动的超出 budget，先提交此前的单元。
+// 每个单元先释放块、再清除指向它们的引用，两者落在同一次提交中，崩溃后不会引用已释放的块。
+// 共享块的文件（DI_SHARED）中仍被其他文件引用的块只放弃一个引用，不清位；
+// 为此改动的引用计数块与位图块一起计入每批的额度（bmap 中记的都是实际块号）
+#define TRUNC_BATCH (2 * PGSIZE / sizeof(uint32))   // 一张间接表的全部项加上表本身
+
+struct trunc {
+    struct inode *ip;
+    int split;                     // 调用者独占当前日志操作，可以中途提交
+    int shared;                    // 文件带 DI_SHARED，释放前先查引用计数
+    int budget;                    // 每批至多改动的位图块与引用计数块数
+    int nbmap;
+    uint32 bmap[MAX_OP_BLOCKS];    // 本批已改动的位图块与引用计数块
+    uint32 *b;                     // 收集的块号，内存不足时为 0（逐块释放，不分批）
+    uint32 n;
+};
+
+// 收集待释放的块 b
+static void trunc_collect(struct trunc *ts, uint32 b)
+{
+    if(ts->b == 0) {
+        if(!ts->shared || !bref_put(ts->ip->dev, b))
+            bfree(ts->ip->dev, b);
+        return;
+    }
+    if(ts->n == TRUNC_BATCH)
+        panic("trunc_collect: batch full");
+    ts->b[ts->n++] = b;
+}
+
+// 收集间接表 t 引用的全部块与 t 本身
+static void trunc_table(struct trunc *ts, uint32 t)
+{
+    struct buf *bp = bread_meta(ts->ip->dev, t);
+    uint32 *a = (uint32 *)bp->data;
+    for(uint32 j = 0; j < NINDIRECT; j++)
+        if(a[j])
+            trunc_collect(ts, a[j]);
+    brelse(bp);
+    trunc_collect(ts, t);
+}
+
+static int trunc_has_bmap(struct trunc *ts, uint32 bb)
+{
+    for(int i = 0; i < ts->nbmap; i++)
+        if(ts->bmap[i] == bb)
+            return 1;
+    return 0;
+}
+
+// 即将释放的单元要改动位图块（与引用计数块）bbs[0..nbb)：超出本批余量时先提交此前的单元，
+// 再开始新的操作。调用时不得持有任何块缓存（提交要读取记入日志的块）
+static void trunc_reserve_bmaps(struct trunc *ts, const uint32 *bbs, int nbb)
+{
+    if(!ts->split)
+        return;
+    int fresh = 0;
+    for(int i = 0; i < nbb; i++)
+        fresh += !trunc_has_bmap(ts, bbs[i]);
+    if(ts->nbmap > 0 && ts->nbmap + fresh > ts->budget) {
+        iupdate(ts->ip);
+        end_transaction();
+        begin_transaction_blocks(ifree_log_blocks());
+        ts->nbmap = 0;
+    }
+    for(int i = 0; i < nbb; i++)
+        if(!trunc_has_bmap(ts, bbs[i]) && ts->nbmap < MAX_OP_BLOCKS)
+            ts->bmap[ts->nbmap++] = bbs[i];
+}
+
+static void sort_blocks(uint32 *b, uint32 n)
+{
+    for(uint32 i = 1; i < n; i++) {
+        uint32 v = b[i];
+        uint32 j = i;
+        for(; j > 0 && b[j - 1] > v; j--)
+            b[j] = b[j - 1];
+        b[j] = v;
+    }
+}
+
+// 收集完一个单元：排序并按需提交此前的单元。之后调用者清除对这些块的引用，再 trunc_release
+static void trunc_reserve(struct trunc *ts)
+{
+    uint32 bbs[MAX_OP_BLOCKS];
+    int nbb = 0;
+    uint32 lastbb = 0, lastrb = 0;
+
+    // 块号已排序，位图块与引用计数块各自只需与上一个比较
+    sort_blocks(ts->b, ts->n);
+    for(uint32 i = 0; i < ts->n && nbb < MAX_OP_BLOCKS; i++) {
+        uint32 bb = BBLOCK(ts->b[i], sb);
+        if(bb != lastbb)
+            bbs[nbb++] = lastbb = bb;
+        uint32 rb = REFBLOCK(ts->b[i], sb);
+        if(ts->shared && rb != lastrb && nbb < MAX_OP_BLOCKS)
+            bbs[nbb++] = lastrb = rb;
+    }
+    // 单元本身超出一批上限的部分不再计入，无论如何都要整体释放
+    trunc_reserve_bmaps(ts, bbs, nbb);
+}
+
+static void trunc_release(struct trunc *ts)
+{
+    if(ts->shared)
+        ts->n = bref_put_many(ts->ip->dev, ts->b, ts->n);
+    if(ts->n > 0)
+        bfree_many(ts->ip->dev, ts->b, ts->n);
+    ts->n = 0;
+}
+
+// 释放磁盘 inode 关联的所有数据块，包括直接块、一级间接块与二级间接块。
+// 块号先收集起来成批释放（见 struct trunc），每个位图块只读一次、记一次日志；
+// split 时大文件分成多个日志操作提交，修改的块不超过每个操作的额度
+static void disk_trunc(struct inode *ip, int split)
+{
+    struct trunc ts = { .ip = ip, .split = split, .shared = (ip->flags & DI_SHARED) != 0 };
+
+    pcache_invalidate(ip->dev, ip->inum);
+    ip->map_n = 0;
+    if(ip->flags & DI_INLINE) {
+        memset(ip->addrs, 0, sizeof(ip->addrs));
+        ip->size = 0;
+        iupdate(ip);
+        return;
+    }
+
+    ts.b = alloc_pages(2);
+    if(ts.b == 0)
+        ts.split = 0;    // 逐块释放时块与其引用的清除不在同一单元内，不能中途提交
+    ts.budget = ifree_log_blocks() - 2;    // 另有 inode 块与二级间接表（或区段块）
+    if(ts.budget < 1)
+        ts.budget = 1;
+    ip->size = 0;
+
+    if(ip->flags & DI_EXTENTS) {
+        ext_trunc(&ts);
+        goto out;
     }
 
-    // 释放二级间接块：先释放所有一级间接表及其下的实际数据块，再回收顶层指针块。
+    // 二级间接块：每张一级间接表连同它引用的数据块为一个单元，最后释放顶层指针块。
+    // 中途提交时顶层块里已清零的项须记入日志
     if(ip->addrs[NDIRECT + 1]) {
-        struct buf *dbp = bread(ip->dev, ip->addrs[NDIRECT + 1]);
-        uint32 *d = (uint32 *)dbp->data;
         for(uint32 i = 0; i < NINDIRECT; i++) {
-            if(d[i]) {
-                struct buf *sbp = bread(ip->dev, d[i]);
-                uint32 *a = (uint32 *)sbp->data;
-                for(uint32 j = 0; j < NINDIRECT; j++) {
-                    if(a[j]) {
-                        bfree(ip->dev, a[j]);
-                        a[j] = 0;
-                    }
-                }
-                brelse(sbp);
-                bfree(ip->dev, d[i]);
-                d[i] = 0;
-            }
+            struct buf *dbp = bread_meta(ip->dev, ip->addrs[NDIRECT + 1]);
+            uint32 t = ((uint32 *)dbp->data)[i];
+            brelse(dbp);
+            if(t == 0)
+                continue;
+            trunc_table(&ts, t);
+            trunc_reserve(&ts);
+            dbp = bread_meta(ip->dev, ip->addrs[NDIRECT + 1]);
+            ((uint32 *)dbp->data)[i] = 0;
+            if(ts.split)
+                log_block_write(dbp);
+            brelse(dbp);
+            trunc_release(&ts);
         }
-        brelse(dbp);
-        bfree(ip->dev, ip->addrs[NDIRECT + 1]);
+        trunc_collect(&ts, ip->addrs[NDIRECT + 1]);
+        trunc_reserve(&ts);
         ip->addrs[NDIRECT + 1] = 0;
+        trunc_release(&ts);
     }
 
-    ip->size = 0;
+    // 一级间接块及其引用的数据块。
+    if(ip->addrs[NDIRECT]) {
+        trunc_table(&ts, ip->addrs[NDIRECT]);
+        trunc_reserve(&ts);
+        ip->addrs[NDIRECT] = 0;
+        trunc_release(&ts);
+    }
+
+    // 直接块。
+    for(int i = 0; i < NDIRECT; i++)
+        if(ip->addrs[i])
+            trunc_collect(&ts, ip->addrs[i]);
+    trunc_reserve(&ts);
+    memset(ip->addrs, 0, NDIRECT * sizeof(uint32));
+    trunc_release(&ts);
+
+out:
+    if(ts.b)
+        free_pages(ts.b, 2);
+    ip->flags &= ~DI_SHARED;   // 已不再引用任何块
     iupdate(ip);
 }
 
+// file_page: 取得普通文件第 bn 块的缓存页（已钉住），未命中时经 bmap 与块缓存读入并插入页缓存。
+// 空洞读出全零。内存不足时返回 0，调用者直接读块缓存。调用者持有 ip 的锁
+static struct cpage *file_page(struct inode *ip, uint32 bn)
+{
+    struct cpage *cp = pcache_lookup(ip->dev, ip->inum, bn);
+    if(cp)
+        return cp;
+    if((cp = pcache_alloc(ip->dev, ip->inum, bn)) == 0)
+        return 0;
+
+    if(ip->flags & DI_INLINE) {
+        memset(cp->data, 0, BLOCK_SIZE);
+        if(bn == 0)
+            memmove(cp->data, ip->addrs, ip->size);
+        return pcache_insert(cp);
+    }
+    // 文件末尾之后的块可能是预分配而从未写过的，内容无意义，同样直接读出全零
+    uint32 addr = (uint64)bn * BLOCK_SIZE < ip->size ? bmap_peek(ip, bn) : 0;
+    if(addr == 0) {
+        memset(cp->data, 0, BLOCK_SIZE);
+    } else {
+        struct buf *bp = bread(ip->dev, addr);
+        memmove(cp->data, bp->data, BLOCK_SIZE);
+        brelse_once(bp);
+    }
+    return pcache_insert(cp);
+}
+
+// ipage_map: 取得普通文件第 bn 块的缓存页并增加其物理页引用，供文件映射直接映射到用户空间，
+// 映射解除时以 free_page 放弃该引用。非普通文件或内存不足时返回 0。调用者持有 ip 的锁
+void *ipage_map(struct inode *ip, uint32 bn)
+{
+    if(ip->type != T_FILE || ip->ops != &disk_ops)
+        return 0;
+    struct cpage *cp = file_page(ip, bn);
+    if(cp == 0)
+        return 0;
+    void *pa = cp->data;
+    page_incref(pa);
+    pcache_put(cp);
+    return pa;
+}
+
+// ipage_cached: 读取普通文件第 bn 块是否无需读盘：已在页缓存中，或内容本就在内存里
+// （tmpfs、内联文件）。用于把文件页缺页区分为 minor 与 major，只是提示
+int ipage_cached(struct inode *ip, uint32 bn)
+{
+    if(ip->ops != &disk_ops || (ip->flags & DI_INLINE))
+        return 1;
+    return pcache_present(ip->dev, ip->inum, bn);
+}
+
 // readi: 从 inode 中读取数据到 dst。支持用户态/内核态缓冲区，通过 user_dst 参数区分。
 int readi(struct inode *ip, int user_dst, uint64 dst, uint32 off, uint32 n)
+{
+    return ip->ops->read(ip, user_dst, dst, off, n);
+}
+
+// 普通文件从页缓存读取，命中时不经 bmap 与块缓存。
+static int disk_readi(struct inode *ip, int user_dst, uint64 dst, uint32 off, uint32 n)
 {
     if(off > ip->size || off + n < off)
         return -1;
@@ -337,12 +1102,50 @@ int readi(struct inode *ip, int user_dst, uint64 dst, uint32 off, uint32 n)
     uint32 tot = 0;
     char *kdst = (char *)dst;
 
+    // 内联内容随 inode 一起读入，不经页缓存与块缓存
+    if(ip->flags & DI_INLINE) {
+        const char *from = (const char *)ip->addrs + off;
+        if(user_dst)
+            return copyout(myproc()->pagetable, dst, from, n) < 0 ? -1 : (int)n;
+        memmove(kdst, from, n);
+        return n;
+    }
+
     while(tot < n) {
         uint32 bn = (off + tot) / BLOCK_SIZE;
-        struct buf *bp = bread(ip->dev, bmap(ip, bn));
         uint32 block_off = (off + tot) % BLOCK_SIZE;
         uint32 m = MIN(n - tot, BLOCK_SIZE - block_off);
+        struct cpage *cp = ip->type == T_FILE ? file_page(ip, bn) : 0;
+
+        if(cp) {
+            if(user_dst) {
+                if(copyout(myproc()->pagetable, dst + tot, cp->data + block_off, m) < 0) {
+                    pcache_put(cp);
+                    return -1;
+                }
+            } else {
+                memmove(kdst + tot, cp->data + block_off, m);
+            }
+            pcache_put(cp);
+            tot += m;
+            continue;
+        }
+
+        uint32 addr = bmap_peek(ip, bn);
+        if(addr == 0) {
+            // 空洞（散列目录中未使用的桶）读出全零
+            static const char zero_block[BLOCK_SIZE];
+            if(user_dst) {
+                if(copyout(myproc()->pagetable, dst + tot, zero_block, m) < 0)
+                    return -1;
+            } else {
+                memset(kdst + tot, 0, m);
+            }
+            tot += m;
+            continue;
+        }
 
+        struct buf *bp = bread(ip->dev, addr);
         if(user_dst) {
             if(copyout(myproc()->pagetable, dst + tot, (const char *)(bp->data + block_off), m) < 0) {
                 brelse(bp);
@@ -357,98 +1160,816 @@ int readi(struct inode *ip, int user_dst, uint64 dst, uint32 off, uint32 n)
     return n;
 }
 
-// writei: 将 src 缓冲区的数据写入 inode。必要时分配新块并更新文件大小。
+// ireadahead: 异步预读文件的第 bn 块起的 n 块（截断到文件末尾），调用者持有 ip 的锁
+void ireadahead(struct inode *ip, uint32 bn, int n)
+{
+    uint blocks[BLK_PLUG_MAX];
+    uint32 nblocks = (ip->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    if(ip->ops != &disk_ops || (ip->flags & DI_INLINE))
+        return;
+    if(n > BLK_PLUG_MAX)
+        n = BLK_PLUG_MAX;
+    if(bn >= nblocks)
+        return;
+    if(bn + n > nblocks)
+        n = nblocks - bn;
+    int cnt = 0;
+    for(int i = 0; i < n; i++) {
+        if(ip->type == T_FILE && pcache_present(ip->dev, ip->inum, bn + i))
+            continue;                   // 已在页缓存中，无需读盘
+        uint32 addr = bmap_peek(ip, bn + i);
+        if(addr)                        // 跳过散列目录中的空洞
+            blocks[cnt++] = addr;
+    }
+    breadahead(ip->dev, blocks, cnt);
+}
+
+// 写入 inode 的内容块：普通文件的是数据块，顺序数据模式下不进日志；目录与符号链接的块是元数据
+static void iwrite_block(struct inode *ip, struct buf *bp)
+{
+    if(ip->type == T_FILE)
+        log_data_write(bp);
+    else
+        log_block_write(bp);
+}
+
+// 整块覆盖第 bn 块时从用户态拷贝失败：写入前已存在的块丢弃缓存内容，下次重新读入；
+// 未清零的新块（本块以及区段格式为本次写入预先分配、尚未写到的块）补写零，
+// 防止文件末尾之后露出旧数据。释放 bp
+
+static void writei_abort(struct inode *ip, struct buf *bp, uint32 bn, uint32 mapped, uint32 fullend)
+{
+    if(bn < mapped) {
+        binvalidate(bp);
+        brelse(bp);
+        return;
+    }
+    memset(bp->data, 0, BLOCK_SIZE);
+    iwrite_block(ip, bp);
+    brelse(bp);
+    if(!(ip->flags & DI_EXTENTS))
+        return;
+    for(uint32 b = bn + 1; b < fullend; b++) {
+        bp = bgetblk(ip->dev, ext_bmap(ip, b));
+        memset(bp->data, 0, BLOCK_SIZE);
+        iwrite_block(ip, bp);
+        brelse(bp);
+    }
+}
+
+// writei: 将 src 缓冲区的数据写入 inode，必要时扩展文件长度。
 int writei(struct inode *ip, int user_src, uint64 src, uint32 off, uint32 n)
 {
     if(off > ip->size || off + n < off)
         return -1;
-    if(off + n > MAX_FILE_SIZE)
-        return -1;
-
-    uint32 tot = 0;
-    char *ksrc = (char *)src;
+    if(ip->type == T_FILE && n > 0)
+        exec_cache_invalidate(ip->dev, ip->inum);   // 程序头可能被改写
+    return ip->ops->write(ip, user_src, src, off, n);
+}
+
+// 写入内联内容，随后 iupdate 把它与 inode 一起记入日志。已缓存的页同步更新，
+// 文件映射看到的内容因此保持一致
+static int inline_write(struct inode *ip, int user_src, uint64 src, uint32 off, uint32 n)
+{
+    char *to = (char *)ip->addrs + off;
+    if(user_src) {
+        if(copyin(myproc()->pagetable, to, src, n) < 0)
+            return -1;
+    } else {
+        memmove(to, (char *)src, n);
+    }
+    if(ip->type == T_FILE) {
+        struct cpage *cp = pcache_lookup(ip->dev, ip->inum, 0);
+        if(cp) {
+            memmove(cp->data + off, to, n);
+            pcache_put(cp);
+        }
+    }
+    if(off + n > ip->size)
+        ip->size = off + n;
+    iupdate(ip);
+    return n;
+}
+
+// 内联文件即将超过 INLINE_MAX：清空 addrs 并换成新建文件本应使用的格式，
+// 再把原内容作为第 0 块的开头重新写入。在同一事务中完成，崩溃后要么仍是内联文件，要么已转换
+static void inline_convert(struct inode *ip)
+{
+    char old[INLINE_MAX];
+    uint32 size = ip->size;
+
+    memmove(old, ip->addrs, size);
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->flags &= ~DI_INLINE;
+    if(ip->type == T_FILE && (sb.features & FS_FEAT_EXTENTS))
+        ip->flags |= DI_EXTENTS;
+    ip->size = 0;
+    if(size > 0)
+        disk_writei(ip, 0, (uint64)old, 0, size);
+    else
+        iupdate(ip);
+}
+
+// 写时复制：共享块的文件的第 bn 块当前映射到 old，old 仍被其他文件引用时改为映射到新块，
+// 放弃对 old 的引用后返回新块号；old 未被共享时原样返回。新块不清零，由调用者写满
+// （部分写入先经 cow_copy 复制 old 的内容）。区段已无法再拆分时返回 0
+static uint32 cow_block(struct inode *ip, uint32 bn, uint32 old)
+{
+    if(bref_get(ip->dev, old) == 0)
+        return old;
+
+    // 紧接前一块分配，顺序改写时新块连成一段
+    uint32 goal = bn > 0 ? bmap_peek(ip, bn - 1) + 1 : balloc_goal(ip);
+    uint32 got;
+    uint32 nb = balloc_range(ip->dev, goal, 1, &got, 1);
+    if(bmap_set(ip, bn, nb) < 0) {
+        bfree(ip->dev, nb);
+        return 0;
+    }
+    bref_put(ip->dev, old);
+    return nb;
+}
+
+// 把共享块 old 的内容复制到换入的新块 bp
+static void cow_copy(struct buf *bp, uint32 old)
+{
+    struct buf *obp = bread(bp->dev, old);
+    memmove(bp->data, obp->data, BLOCK_SIZE);
+    brelse(obp);
+}
+
+// 必要时分配新块并更新文件大小。
+// 覆盖整块的写入不读入原内容；其中新分配的块也不先清零，由本次写入直接填满。
+// 整个位于原文件末尾之后的块（新分配的，或 fallocate 预分配的）没有有效内容，
+// 部分写入时也不读盘，在缓冲中清零后写入，因此文件末尾之后的字节总是零。
+// 共享块的文件（DI_SHARED）改写已有的块前先经 cow_block 换成独占的新块；
+// 区段数达到上限、无法再换块时写到此为止，返回已写入的字节数
+static int disk_writei(struct inode *ip, int user_src, uint64 src, uint32 off, uint32 n)
+{
+    if(off + n > MAX_FILE_SIZE)
+        return -1;
+    if(ip->flags & DI_INLINE) {
+        if(off + n <= INLINE_MAX)
+            return inline_write(ip, user_src, src, off, n);
+        inline_convert(ip);
+    }
+
+    uint32 tot = 0;
+    char *ksrc = (char *)src;
+    // 写入前已映射的块数，以及本次写入整块覆盖的新块的上界
+    uint32 mapped = (ip->flags & DI_EXTENTS) ? ext_nblocks(ip) : (ip->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32 fullend = (off + n) / BLOCK_SIZE;
+
+    // 区段格式：一次为本次写入涉及的全部新块申请连续空间，而不是逐块分配
+    if((ip->flags & DI_EXTENTS) && n > 0 &&
+       ext_grow(ip, (off + n + BLOCK_SIZE - 1) / BLOCK_SIZE, fullend) < 0)
+        return -1;
 
     while(tot < n) {
         uint32 bn = (off + tot) / BLOCK_SIZE;
-        struct buf *bp = bread(ip->dev, bmap(ip, bn));
         uint32 block_off = (off + tot) % BLOCK_SIZE;
         uint32 m = MIN(n - tot, BLOCK_SIZE - block_off);
+        int full = m == BLOCK_SIZE;
+        int fresh = (uint64)bn * BLOCK_SIZE >= ip->size;
+        uint32 addr = bmap_alloc(ip, bn, !full && !fresh);
+        uint32 old = 0;     // 换块前的共享块
+        if((ip->flags & DI_SHARED) && bn < mapped) {
+            uint32 nb = cow_block(ip, bn, addr);
+            if(nb == 0)
+                break;
+            if(nb != addr) {
+                old = addr;
+                addr = nb;
+            }
+        }
+        struct buf *bp = full || fresh || old ? bgetblk(ip->dev, addr) : bread(ip->dev, addr);
+        if(fresh && !full)
+            memset(bp->data, 0, BLOCK_SIZE);
+        else if(old && !full)
+            cow_copy(bp, old);
 
         if(user_src) {
             if(copyin(myproc()->pagetable, (char *)(bp->data + block_off), src + tot, m) < 0) {
-                brelse(bp);
+                if(old) {
+                    // 映射已换到新块：整块写入时补上原内容，新块照常写出
+                    if(full)
+                        cow_copy(bp, old);
+                    iwrite_block(ip, bp);
+                    brelse(bp);
+                    iupdate(ip);
+                } else if(full) {
+                    writei_abort(ip, bp, bn, mapped, fullend);
+                } else {
+                    brelse(bp);
+                }
                 return -1;
             }
         } else {
             memmove(bp->data + block_off, ksrc + tot, m);
         }
-        log_block_write(bp);
+        iwrite_block(ip, bp);
+        if(ip->type == T_FILE)
+            pcache_update(ip->dev, ip->inum, bn, (const char *)bp->data);   // 直写已缓存的页
         brelse(bp);
         tot += m;
     }
 
-    if(off + n > ip->size)
-        ip->size = off + n;
+    if(off + tot > ip->size)
+        ip->size = off + tot;
     iupdate(ip);
+    if(tot < n)
+        return tot ? (int)tot : -1;
     return n;
 }
 
+// O_DIRECT：块对齐的整块读写在用户页与磁盘之间直接传输，不经块缓存与 copyin/copyout。
+// 临时的缓存块描述符不挂入块缓存，data 指向钉住的用户页（内核恒等映射物理内存，
+// 物理地址即可交给设备），经请求队列合并相邻块后提交。已在块缓存中的块仍经缓存读写：
+// 缓存中的内容可能比磁盘新（已记入日志、尚未写回），绕过它读到的是旧数据，写入则会在
+// 之后被写回的旧内容覆盖。每批至多 BLK_PLUG_MAX 块，临时描述符合占一页
+static int direct_ok(struct inode *ip, uint64 va, uint32 off)
+{
+    return ip->ops == &disk_ops && ip->type == T_FILE && !(ip->flags & DI_INLINE) &&
+           off % BLOCK_SIZE == 0 && va % PGSIZE == 0;
+}
+
+// 钉住从页对齐的用户地址 va 起的 n 页，物理地址记入 pa[]。to_user 为 1 时设备要写入这些页，
+// 与 copyout 一样先补上按需页并完成写时复制。返回钉住的页数，遇到无效地址时提前停止
+static int direct_pin(uint64 va, int n, int to_user, uint64 *pa)
+{
+    pagetable_t pt = myproc()->pagetable;
+    int i;
+
+    for(i = 0; i < n; i++) {
+        uint64 p = uvm_user_pa(pt, va + (uint64)i * PGSIZE, to_user);
+        if(p == 0 || page_refcount((void *)p) == 0)
+            break;
+        page_incref((void *)p);
+        pa[i] = p;
+    }
+    return i;
+}
+
+static void direct_unpin(const uint64 *pa, int n)
+{
+    for(int i = 0; i < n; i++)
+        free_page((void *)pa[i]);
+}
+
+static void direct_buf(struct buf *b, uint32 dev, uint32 addr, uint64 pa)
+{
+    memset(b, 0, sizeof(*b));
+    b->dev = dev;
+    b->blockno = addr;
+    b->data = (uchar *)pa;
+    initsleeplock(&b->lock, "direct");
+    acquiresleep(&b->lock);
+}
+
+// 提交 nb 个临时描述符并等待全部完成
+static void direct_io(struct buf *tb, int nb, int write)
+{
+    struct blk_plug plug;
+
+    if(nb == 0)
+        return;
+    blk_plug_init(&plug, write);
+    for(int i = 0; i < nb; i++)
+        blk_plug_add(&plug, &tb[i]);
+    blk_plug_flush(&plug);
+    for(int i = 0; i < nb; i++) {
+        blk_wait(&tb[i]);
+        releasesleep(&tb[i].lock);
+    }
+}
+
+// readi_direct: 从块对齐的 off 起把文件末尾之前的整块读入页对齐的用户地址 dst。
+// 页缓存或块缓存中已有的块照常拷贝，其余块由设备直接写入用户页。
+// 返回读取的字节数，遇到无效用户地址时提前停止；不满足对齐要求或不是磁盘上的普通文件时返回 0，
+// 余下部分由调用者照常读取。调用者至少共享持有 ip 的锁
+int readi_direct(struct inode *ip, uint64 dst, uint32 off, uint32 n)
+{
+    if(!direct_ok(ip, dst, off) || off >= ip->size)
+        return 0;
+    if(n > ip->size - off)
+        n = ip->size - off;
+    uint32 nblk = n / BLOCK_SIZE;
+    struct buf *tb;
+    if(nblk == 0 || (tb = alloc_page()) == 0)
+        return 0;
+
+    uint32 done = 0;
+    while(done < nblk) {
+        uint64 pa[BLK_PLUG_MAX];
+        int want = MIN(nblk - done, BLK_PLUG_MAX);
+        int np = direct_pin(dst + (uint64)done * BLOCK_SIZE, want, 1, pa);
+        int nb = 0;
+
+        for(int i = 0; i < np; i++) {
+            uint32 bn = off / BLOCK_SIZE + done + i;
+            struct cpage *cp = pcache_lookup(ip->dev, ip->inum, bn);
+            if(cp) {
+                memmove((char *)pa[i], cp->data, BLOCK_SIZE);
+                pcache_put(cp);
+                continue;
+            }
+            uint32 addr = bmap_peek(ip, bn);
+            if(addr == 0) {
+                memset((char *)pa[i], 0, BLOCK_SIZE);
+            } else if(bcached(ip->dev, addr)) {
+                struct buf *bp = bread(ip->dev, addr);
+                memmove((char *)pa[i], bp->data, BLOCK_SIZE);
+                brelse_once(bp);
+            } else {
+                direct_buf(&tb[nb++], ip->dev, addr, pa[i]);
+            }
+        }
+        direct_io(tb, nb, 0);
+        direct_unpin(pa, np);
+        done += np;
+        if(np < want)
+            break;
+    }
+    free_page(tb);
+    return done * BLOCK_SIZE;
+}
+
+// writei_direct: 从块对齐的 off 起把页对齐的用户地址 src 处的整块写入文件，必要时扩展文件长度。
+// 块缓存中已有的块经缓存照常写入，其余块由设备直接从用户页写入磁盘，返回前完成；
+// 新块的映射随调用者的事务提交，崩溃后的效果与顺序数据模式相同。已缓存的页同步更新。
+// 返回写入的字节数，遇到无效用户地址或空间不足时提前停止；不足一块的尾部以及不满足条件的请求
+// （返回 0）由调用者照常写入。共享块的文件改写前要换块，同样交给调用者。
+// 调用者持有 ip 的锁，并已开启事务
+int writei_direct(struct inode *ip, uint64 src, uint32 off, uint32 n)
+{
+    if(!direct_ok(ip, src, off) || (ip->flags & DI_SHARED) || off > ip->size || off + n < off || off + n > MAX_FILE_SIZE)
+        return 0;
+    uint32 nblk = n / BLOCK_SIZE;
+    struct buf *tb;
+    if(nblk == 0 || (tb = alloc_page()) == 0)
+        return 0;
+    exec_cache_invalidate(ip->dev, ip->inum);
+
+    uint32 done = 0;
+    while(done < nblk) {
+        uint64 pa[BLK_PLUG_MAX];
+        int want = MIN(nblk - done, BLK_PLUG_MAX);
+        int np = direct_pin(src + (uint64)done * BLOCK_SIZE, want, 0, pa);
+        uint32 bn0 = off / BLOCK_SIZE + done;
+        int nb = 0;
+
+        // 先钉住再分配：分配出的新块本批一定整块写满，不必清零
+        if(np > 0 && (ip->flags & DI_EXTENTS) && ext_grow(ip, bn0 + np, bn0 + np) < 0) {
+            direct_unpin(pa, np);
+            break;
+        }
+        for(int i = 0; i < np; i++) {
+            uint32 addr = bmap_alloc(ip, bn0 + i, 0);
+            if(bcached(ip->dev, addr)) {
+                struct buf *bp = bgetblk(ip->dev, addr);
+                memmove(bp->data, (char *)pa[i], BLOCK_SIZE);
+                iwrite_block(ip, bp);
+                brelse(bp);
+            } else {
+                direct_buf(&tb[nb++], ip->dev, addr, pa[i]);
+            }
+            pcache_update(ip->dev, ip->inum, bn0 + i, (const char *)pa[i]);
+        }
+        direct_io(tb, nb, 1);
+        direct_unpin(pa, np);
+        done += np;
+        if(off + done * BLOCK_SIZE > ip->size)
+            ip->size = off + done * BLOCK_SIZE;
+        if(np < want)
+            break;
+    }
+    free_page(tb);
+    if(done > 0)
+        iupdate(ip);
+    return done * BLOCK_SIZE;
+}
+
+// ifallocate: 为 inode 预留覆盖前 nblocks 块的映射，不改变文件大小。
+// 文件系统不支持预分配时返回 -1。调用者持有 ip 的锁，并已开启事务（若经日志）
+int ifallocate(struct inode *ip, uint32 nblocks)
+{
+    if(ip->ops->fallocate == 0)
+        return -1;
+    return ip->ops->fallocate(ip, nblocks);
+}
+
+// 把普通文件的块映射扩展到至少 nblocks 块。新块只在位图中标记为已分配，不清零也不写盘：
+// 它们整个位于文件末尾之后，file_page 与 disk_writei 都把它们当作未写过的块。
+// 区段格式一次申请连续空间，之后追加写入这些块时只需更新 inode 的大小。
+// 空闲块不足或区段数达到上限时返回 -1（已分配的部分保留）
+static int disk_fallocate(struct inode *ip, uint32 nblocks)
+{
+    if(ip->type != T_FILE || nblocks > MAX_FILE_BLOCKS)
+        return -1;
+    if(nblocks == 0)
+        return 0;
+    if(ip->flags & DI_INLINE)
+        inline_convert(ip);
+
+    uint32 mapped = (ip->flags & DI_EXTENTS) ? ext_nblocks(ip) : (ip->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if(nblocks <= mapped)
+        return 0;
+    // 另为间接块或区段块留出余量
+    if(balloc_nfree() < nblocks - mapped + nblocks / NINDIRECT + 2)
+        return -1;
+
+    int r = 0;
+    if(ip->flags & DI_EXTENTS) {
+        r = ext_grow(ip, nblocks, nblocks);
+    } else {
+        for(uint32 bn = mapped; bn < nblocks; bn++)
+            bmap_alloc(ip, bn, 0);   // 已预分配过的块直接返回
+    }
+    iupdate(ip);
+    return r;
+}
+
+// iclone 每批至多改动的引用计数块数：连同两个 inode、间接表（或区段块）及其位图块不超过一个操作的额度
+#define CLONE_REF_BLOCKS 4
+
+// iclone: 让 dst 自第 *bn 块起与 src 共享数据块，每次只处理一批：直到下一张间接表覆盖的范围为止，
+// 且改动的引用计数块不超过 CLONE_REF_BLOCKS。一批中的映射与引用计数在同一事务中修改，崩溃后两者一致。
+// *bn 为 0 时 dst 须为空（调用者已截断），格式设为与 src 相同；内联的 src 直接复制内容。
+// 完成后推进 *bn，并把 dst 的大小设为已共享的部分。全部完成返回 0，仍有剩余返回 1，
+// 没有引用计数区、不是同一设备上的普通文件或块的引用数已达 REF_MAX 时返回 -1。
+// 批与批之间 src 可能被改写或截断，之后的批以当时的内容为准；dst 若被改写到尚未共享的部分
+// （大小或映射越过了 *bn），到此为止，dst 保留已共享的前缀。调用者持有两者的锁，并已开启事务
+int iclone(struct inode *dst, struct inode *src, uint32 *bn)
+{
+    if(!(sb.features & FS_FEAT_REFLINK) || src->ops != &disk_ops || dst->ops != &disk_ops ||
+       src->type != T_FILE || dst->type != T_FILE || src->dev != dst->dev)
+        return -1;
+
+    uint32 b = *bn;
+    if(b == 0) {
+        if(dst->size != 0)
+            return -1;      // 截断之后又被写入
+        for(int i = 0; i < NDIRECT + 2 && !(dst->flags & DI_INLINE); i++)
+            if(dst->addrs[i])
+                return -1;  // 或又预分配了块
+        dst->map_n = 0;
+        if(src->flags & DI_INLINE) {
+            memmove(dst->addrs, src->addrs, src->size);
+            dst->flags = DI_INLINE;
+            dst->size = src->size;
+            iupdate(dst);
+            return 0;
+        }
+        dst->flags = (src->flags & DI_EXTENTS) | DI_SHARED;
+    } else if(((src->flags ^ dst->flags) & (DI_INLINE | DI_EXTENTS)) ||
+              dst->size != (uint64)b * BLOCK_SIZE) {
+        return 0;     // src 已被截断并以另一种格式重写，或 dst 已被写到后面
+    }
+    if(!(src->flags & DI_SHARED)) {
+        src->flags |= DI_SHARED;
+        iupdate(src);
+    }
+
+    uint32 nblocks = (src->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32 end = b < NDIRECT ? NDIRECT : NDIRECT + ((b - NDIRECT) / NINDIRECT + 1) * NINDIRECT;
+    uint32 rbs[CLONE_REF_BLOCKS];
+    int nrb = 0, r = 0, stop = 0;
+
+    for(; b < nblocks && b < end; b++) {
+        uint32 addr = bmap_peek(src, b);
+        if(addr == 0)
+            continue;       // 空洞在 dst 中同样是空洞
+        if(bmap_peek(dst, b)) {
+            stop = 1;       // dst 在文件末尾之后预分配过块
+            break;
+        }
+        uint32 rb = REFBLOCK(addr, sb);
+        int k = 0;
+        while(k < nrb && rbs[k] != rb)
+            k++;
+        if(k == nrb) {
+            if(nrb == CLONE_REF_BLOCKS)
+                break;
+            rbs[nrb++] = rb;
+        }
+        if(bref_inc(src->dev, addr) < 0) {
+            r = -1;
+            break;
+        }
+        if(bmap_set(dst, b, addr) < 0) {
+            bref_put(src->dev, addr);
+            r = -1;
+            break;
+        }
+    }
+    *bn = b;
+    dst->size = MIN(src->size, (uint64)b * BLOCK_SIZE);
+    iupdate(dst);
+    if(r < 0)
+        return -1;
+    return !stop && b < nblocks;
+}
+
 // dirlookup: 在目录 dp 中查找 name，对应目录项存在则返回 inode。poff 若非空
 // 会记录目录项偏移，便于删除/覆盖。
 struct inode *dirlookup(struct inode *dp, char *name, uint32 *poff)
 {
     if(dp->type != T_DIR)
         panic("dirlookup not DIR");
+    return dp->ops->lookup(dp, name, poff);
+}
 
-    struct dirent de;
-    // 线性扫描整个目录文件
-    for(uint32 off = 0; off < dp->size; off += sizeof(de)) {
-        // 读取目录项
-        if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-            panic("dirlookup read");
-        if(de.inum == 0)  // 跳过空闲槽位
-            continue;
-        // 名称比较
-        if(namecmp(name, de.name) == 0) {
-            if(poff)
-                *poff = off;  // 记录目录项偏移
-            return iget(dp->dev, de.inum);  // 返回目标inode
-        }
+// 先查目录项缓存，未命中时按块扫描目录
+static struct inode *disk_dirlookup(struct inode *dp, char *name, uint32 *poff)
+{
+    uint32 inum, hoff;
+    if(dcache_lookup(dp, name, &inum, &hoff)) {
+        if(inum == 0)
+            return 0;         // 负项：确知不存在
+        if(poff)
+            *poff = hoff;
+        return iget(dp->dev, inum);
+    }
+
+    // 按块扫描目录（散列目录只看名称所在的桶）
+    if((inum = dirfind(dp, name, &hoff)) == 0) {
+        dcache_enter(dp, name, 0, 0);
+        return 0;  // 未找到
     }
-    return 0;  // 未找到
+    dcache_enter(dp, name, inum, hoff);
+    if(poff)
+        *poff = hoff;  // 记录目录项偏移
+    return iget(dp->dev, inum);  // 返回目标inode
 }
 
 // dirlink: 在目录 dp 中插入 name -> inum 的条目。若 name 已存在直接返回 -1。
 int dirlink(struct inode *dp, char *name, uint32 inum)
 {
-    // 检查名称是否已存在
-    if(dirlookup(dp, name, 0) != 0)
-        return -1;
+    return dp->ops->link(dp, name, inum);
+}
 
+// 普通目录一次扫描同时完成重名检查与空闲槽查找；散列目录只访问名称所在的桶。
+static int disk_dirlink(struct inode *dp, char *name, uint32 inum)
+{
     struct dirent de;
-    uint32 off;
-    // 寻找空闲槽位或文件末尾
-    for(off = 0; off < dp->size; off += sizeof(de)) {
-        if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-            panic("dirlink read");
-        if(de.inum == 0)  // 找到空闲槽位
-            break;
-    }
+    uint32 off, cinum, coff;
 
-    // 构建新目录项
+    // 构建新目录项，复制文件名（最多13个字符 + 终止符）
     memset(&de, 0, sizeof(de));
     de.inum = inum;
-    // 复制文件名（最多13个字符 + 终止符）
     for(int i = 0; i < DIRSIZ - 1 && name[i]; i++) {
         de.name[i] = name[i];
     }
 
+    // 检查名称是否已存在：目录项缓存中的负项说明无需再比较名称
+    int cached = dcache_lookup(dp, name, &cinum, &coff);
+    if(cached && cinum)
+        return -1;
+    if(dp->flags & DI_HASHDIR) {
+        if(!cached && dirfind(dp, name, &coff))
+            return -1;
+        if((off = dirhash_slot(dp, de.name)) == DIR_NOFREE)
+            return -1;   // 全部桶已满
+    } else {
+        uint32 free = DIR_NOFREE;
+        if(dirscan(dp, cached ? 0 : name, 0, dp->size, &coff, &free, 0))
+            return -1;
+        off = free != DIR_NOFREE ? free : dp->size;   // 没有空闲槽时追加到末尾
+    }
+
     // 写入目录项
     if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
         panic("dirlink write");
+    dcache_enter(dp, de.name, inum, off);
+    return 0;
+}
+
+// ===================== 目录扫描 =====================
+// 目录项按块扫描：每个目录块只 bread 一次，在缓存块中逐项比较。
+// 散列目录（DI_HASHDIR）由 DIRHASH_BUCKETS 个桶块组成，名称散列到一个桶；
+// 桶满时顺延到下一个桶，并在原桶的头部（第 0 个目录项槽位，inum 恒为 0）
+// 记下溢出标志，查找遇到未溢出的桶即可停止。尚未使用的桶是空洞，不占磁盘块。
+
+// 按块扫描 dp 中 [from, to) 字节范围内的目录项。name 非空时查找该名称，找到后返回
+// inode 号并写 *poff；*pfree 为 DIR_NOFREE 时记录遇到的第一个空闲槽（不含桶头）。
+// 散列目录的桶头溢出标志写入 *overflow（可为空）。未找到返回 0
+static uint32 dirscan(struct inode *dp, const char *name, uint32 from, uint32 to,
+                      uint32 *poff, uint32 *pfree, int *overflow)
+{
+    int hashed = (dp->flags & DI_HASHDIR) != 0;
+
+    for(uint32 off = from; off < to; ) {
+        uint32 bn = off / BLOCK_SIZE;
+        uint32 end = MIN(to, (bn + 1) * BLOCK_SIZE);
+        uint32 addr = bmap_peek(dp, bn);
+        if(addr == 0) {
+            // 空洞：整块都是空闲槽，桶头没有溢出标志
+            if(pfree && *pfree == DIR_NOFREE)
+                *pfree = (hashed && off % BLOCK_SIZE == 0) ? off + sizeof(struct dirent) : off;
+            if(overflow)
+                *overflow = 0;
+            off = end;
+            continue;
+        }
+        struct buf *bp = bread(dp->dev, addr);
+        for(; off < end; off += sizeof(struct dirent)) {
+            struct dirent *de = (struct dirent *)(bp->data + off % BLOCK_SIZE);
+            if(hashed && off % BLOCK_SIZE == 0) {
+                if(overflow)
+                    *overflow = de->name[0] != 0;
+                continue;
+            }
+            if(de->inum == 0) {
+                if(pfree && *pfree == DIR_NOFREE)
+                    *pfree = off;
+                continue;
+            }
+            if(name && namecmp(name, de->name) == 0) {
+                uint32 inum = de->inum;
+                brelse(bp);
+                *poff = off;
+                return inum;
+            }
+        }
+        brelse(bp);
+    }
+    return 0;
+}
+
+// 在目录中查找 name（不经过目录项缓存），返回 inode 号，不存在时返回 0
+static uint32 dirfind(struct inode *dp, const char *name, uint32 *poff)
+{
+    if(!(dp->flags & DI_HASHDIR))
+        return dirscan(dp, name, 0, dp->size, poff, 0, 0);
+
+    uint32 h = dirhash(name);
+    for(uint32 i = 0; i < DIRHASH_BUCKETS; i++) {
+        uint32 b = (h + i) % DIRHASH_BUCKETS;
+        int overflow = 0;
+        uint32 inum = dirscan(dp, name, b * BLOCK_SIZE, (b + 1) * BLOCK_SIZE, poff, 0, &overflow);
+        if(inum || !overflow)
+            return inum;
+    }
     return 0;
 }
 
+// 散列目录中为 name 找一个空闲槽：从其散列桶起查找，途经的满桶记下溢出标志
+static uint32 dirhash_slot(struct inode *dp, const char *name)
+{
+    uint32 h = dirhash(name);
+    for(uint32 i = 0; i < DIRHASH_BUCKETS; i++) {
+        uint32 b = (h + i) % DIRHASH_BUCKETS;
+        uint32 free = DIR_NOFREE;
+        int overflow = 0;
+        dirscan(dp, 0, b * BLOCK_SIZE, (b + 1) * BLOCK_SIZE, 0, &free, &overflow);
+        if(free != DIR_NOFREE)
+            return free;
+        if(!overflow) {
+            struct buf *bp = bread(dp->dev, bmap(dp, b));
+            ((struct dirent *)bp->data)->name[0] = 1;
+            log_block_write(bp);
+            brelse(bp);
+        }
+    }
+    return DIR_NOFREE;
+}
+
+// dirempty: 目录中除 '.' 与 '..' 外没有其他目录项时返回 1，调用者持有 dp 的锁
+int dirempty(struct inode *dp)
+{
+    return dp->ops->empty(dp);
+}
+
+static int disk_dirempty(struct inode *dp)
+{
+    int hashed = (dp->flags & DI_HASHDIR) != 0;
+
+    for(uint32 off = 0; off < dp->size; ) {
+        uint32 bn = off / BLOCK_SIZE;
+        uint32 end = MIN(dp->size, (bn + 1) * BLOCK_SIZE);
+        uint32 addr = bmap_peek(dp, bn);
+        if(addr == 0) {
+            off = end;
+            continue;
+        }
+        struct buf *bp = bread(dp->dev, addr);
+        for(; off < end; off += sizeof(struct dirent)) {
+            struct dirent *de = (struct dirent *)(bp->data + off % BLOCK_SIZE);
+            if((hashed && off % BLOCK_SIZE == 0) || de->inum == 0)
+                continue;
+            if(namecmp(de->name, ".") != 0 && namecmp(de->name, "..") != 0) {
+                brelse(bp);
+                return 0;
+            }
+        }
+        brelse(bp);
+    }
+    return 1;
+}
+
+// ===================== 目录项缓存 =====================
+// dcache 缓存 (目录 inode, 名称) -> (inode 号, 目录项偏移)，inum 为 0 的项表示该名称
+// 不存在（负项）。查找与更新都在持有目录 inode 睡眠锁时进行，与目录内容的修改串行：
+// dirlink 写入正项，sys_unlink 经 dcache_forget 改为负项，目录 inode 回收时清除其全部项。
+// 组相联：每个名称散列到一组 DCACHE_WAYS 项，组内按轮转替换。
+#define DCACHE_SETS 128
+#define DCACHE_WAYS 4
+
+struct dentry {
+    uint32 dev;
+    uint32 dir;                // 所在目录的 inode 号，0 表示空闲
+    uint32 inum;               // 目标 inode 号，0 表示负项
+    uint32 off;                // 目录项在目录中的偏移
+    char name[DIRSIZ];
+};
+
+static struct {
+    struct spinlock lock;
+    struct dentry set[DCACHE_SETS][DCACHE_WAYS];
+    uint8 next[DCACHE_SETS];   // 各组下一个替换的位置
+} dcache;
+
+static void dcache_init(void)
+{
+    initlock(&dcache.lock, "dcache");
+}
+
+static uint32 dcache_hash(uint32 dev, uint32 dir, const char *name)
+{
+    uint32 h = dev * 31 + dir;
+    for(int i = 0; i < DIRSIZ && name[i]; i++)
+        h = h * 31 + (uchar)name[i];
+    return h % DCACHE_SETS;
+}
+
+// 在组中查找匹配项，调用者持有 dcache.lock
+static struct dentry *dcache_find(struct dentry *set, uint32 dev, uint32 dir, const char *name)
+{
+    for(int w = 0; w < DCACHE_WAYS; w++) {
+        if(set[w].dir == dir && set[w].dev == dev && namecmp(set[w].name, name) == 0)
+            return &set[w];
+    }
+    return 0;
+}
+
+// 查找 dp 中的 name：命中返回 1 并填写 *inum（负项为 0）与 *off，未命中返回 0
+static int dcache_lookup(struct inode *dp, const char *name, uint32 *inum, uint32 *off)
+{
+    struct dentry *set = dcache.set[dcache_hash(dp->dev, dp->inum, name)];
+    acquire(&dcache.lock);
+    struct dentry *e = dcache_find(set, dp->dev, dp->inum, name);
+    if(e) {
+        *inum = e->inum;
+        *off = e->off;
+    }
+    release(&dcache.lock);
+    return e != 0;
+}
+
+// 记录 dp 中 name 的查找结果，inum 为 0 表示不存在
+static void dcache_enter(struct inode *dp, const char *name, uint32 inum, uint32 off)
+{
+    uint32 h = dcache_hash(dp->dev, dp->inum, name);
+    struct dentry *set = dcache.set[h];
+
+    acquire(&dcache.lock);
+    struct dentry *e = dcache_find(set, dp->dev, dp->inum, name);
+    if(e == 0) {
+        e = &set[dcache.next[h]];
+        dcache.next[h] = (dcache.next[h] + 1) % DCACHE_WAYS;
+        e->dev = dp->dev;
+        e->dir = dp->inum;
+        memset(e->name, 0, DIRSIZ);
+        for(int i = 0; i < DIRSIZ && name[i]; i++)
+            e->name[i] = name[i];
+    }
+    e->inum = inum;
+    e->off = off;
+    release(&dcache.lock);
+}
+
+// dcache_forget: 目录项 name 已从 dp 中删除，调用者持有 dp 的锁
+void dcache_forget(struct inode *dp, char *name)
+{
+    if(dp->ops != &disk_ops)
+        return;   // tmpfs 目录不经过目录项缓存
+    dcache_enter(dp, name, 0, 0);
+}
+
+// 目录 inode 被回收：清除以它为父目录的全部项，inode 号复用后不会命中旧内容
+static void dcache_purge(uint32 dev, uint32 dir)
+{
+    acquire(&dcache.lock);
+    for(int s = 0; s < DCACHE_SETS; s++) {
+        for(int w = 0; w < DCACHE_WAYS; w++) {
+            if(dcache.set[s][w].dir == dir && dcache.set[s][w].dev == dev)
+                dcache.set[s][w].dir = 0;
+        }
+    }
+    release(&dcache.lock);
+}
+
 struct inode *namei(char *path)
 {
     return namex(path, 0, 0);
@@ -531,11 +2052,12 @@ static struct inode *namex_from(struct inode *ip, char *path, int nameiparent, c
     char elem[DIRSIZ];
     // 逐级解析路径组件
     while((path = skipelem(path, elem)) != 0) {
-        ilock(ip);
+        ilock_shared(ip);   // 只查找目录项，经过同一目录的路径解析可以并行
         
         // 路径中间组件必须是目录
         if(ip->type != T_DIR) {
-            iunlockput(ip);
+            iunlock_shared(ip);
+            iput(ip);
             return 0;
         }
         
@@ -545,17 +2067,22 @@ static struct inode *namex_from(struct inode *ip, char *path, int nameiparent, c
                 memset(name, 0, DIRSIZ);
                 memmove(name, elem, DIRSIZ);
             }
-            iunlock(ip);
+            iunlock_shared(ip);
             return ip;  // 返回父目录（已加锁）
         }
 
         struct inode *parent = ip;
-        if((next = dirlookup(ip, elem, 0)) == 0) {
-            iunlockput(ip);
+        if(ip->dev == ROOTDEV && ip->inum == ROOTINO && namecmp(elem, TMPFS_MOUNT) == 0)
+            next = iget(TMPDEV, ROOTINO);    // 进入挂载在根目录下的 tmpfs
+        else if(ip->dev == TMPDEV && ip->inum == ROOTINO && namecmp(elem, "..") == 0)
+            next = iget(ROOTDEV, ROOTINO);   // 从 tmpfs 的根目录回到挂载点所在的根目录
+        else if((next = dirlookup(ip, elem, 0)) == 0) {
+            iunlock_shared(ip);
+            iput(ip);
             return 0;  // 路径组件不存在
         }
         
-        iunlock(ip);
+        iunlock_shared(ip);
         ip = next;
 
         // 如果当前 inode 是符号链接，并且不是在 nameiparent 模式下处理最后一个分量，则需要解析符号链接。
@@ -568,22 +2095,18 @@ static struct inode *namex_from(struct inode *ip, char *path, int nameiparent, c
             }
 
             char target[MAXPATH];
-            ilock(ip); // 加锁以安全读取符号链接内容
+            ilock_shared(ip); // 加锁以安全读取符号链接内容
             uint32 stored = ip->size;
-            // 检查符号链接内容长度是否合法
-            if(stored == 0 || stored > MAXPATH) {
-                iunlockput(ip);
-                iput(parent);
-                return 0;
-            }
-            // 读取符号链接目标路径字符串
-            if(readi(ip, 0, (uint64)target, 0, stored) != stored) {
-                iunlockput(ip);
+            // 检查符号链接内容长度是否合法，读取符号链接目标路径字符串
+            if(stored == 0 || stored > MAXPATH ||
+               readi(ip, 0, (uint64)target, 0, stored) != stored) {
+                iunlock_shared(ip);
+                iput(ip);
                 iput(parent);
                 return 0;
             }
             target[stored - 1] = '\0'; // 确保字符串结尾
-            iunlock(ip);
+            iunlock_shared(ip);
             iput(ip);
 
             char combined[MAXPATH];
@@ -628,51 +2151,704 @@ static struct inode *namex_from(struct inode *ip, char *path, int nameiparent, c
 static struct inode *namex(char *path, int nameiparent, char *name)
 {
     struct proc *p = myproc();
-    struct inode *start;
+    struct inode *start = 0;
 
     if(path == 0 || *path == '\0')
         return 0;
 
-    if(*path == '/' || p == 0 || p->cwd == 0)
+    if(*path != '/' && p)
+        start = proc_cwd(p);   // 线程使用组长的当前目录，与 chdir 的替换互斥
+    if(start == 0)
         start = iget(ROOTDEV, ROOTINO);
-    else
-        start = idup(p->cwd);
 
     return namex_from(start, path, nameiparent, name, 0);
 }
 
 
-// balloc: 在 bitmap 中找到第一个空闲数据块，标记为已用并清零内容。
-static uint32 balloc(uint32 dev)
+// 在位图块 map 的 [from, limit) 位中找第一个空闲位，按 64 位字跳过全满的部分。没有时返回 -1。
+// busy 非 0 时其中置位的块同样视为已用
+static int bitmap_find_zero(const uchar *map, const uchar *busy, uint32 from, uint32 limit)
 {
-    for(uint32 b = 0; b < sb.nblocks; b++) {
-        uint32 bno = b + DATA_START;
-        struct buf *bp = bread(dev, BBLOCK(bno, sb));
-        uint32 bi = bno % BPB;
-        uint8 mask = 1 << (bi % 8);
-        if((bp->data[bi / 8] & mask) == 0) {
-            bp->data[bi / 8] |= mask;
-            log_block_write(bp);
+    const uint64 *w = (const uint64 *)map, *bw = (const uint64 *)busy;
+    for(uint32 i = from / 64; i * 64 < limit; i++) {
+        uint64 v = ~(w[i] | (bw ? bw[i] : 0));
+        if(i == from / 64)
+            v &= ~0ULL << (from % 64);
+        if(v == 0)
+            continue;
+        uint32 bit = i * 64 + ctz64(v);
+        return bit < limit ? (int)bit : -1;
+    }
+    return -1;
+}
+
+// 统计位图块 map 的 [from, limit) 位中的空闲位数
+static uint32 bitmap_count_zero(const uchar *map, uint32 from, uint32 limit)
+{
+    uint32 n = 0;
+    for(uint32 bit = from; bit < limit; bit++) {
+        if((map[bit / 8] & (1 << (bit % 8))) == 0)
+            n++;
+    }
+    return n;
+}
+
+// 挂载时建立分配摘要：统计各位图块中数据区范围内的空闲位与各 inode 块中的空闲 inode
+static void fsalloc_init(uint32 dev)
+{
+    uint32 start = SB_DATASTART(sb);
+
+    initlock(&fsalloc.lock, "fsalloc");
+    initlock(&discard.lock, "discard");
+    discard.dev = dev;
+    discard.enabled = blkdev_get(dev)->discard != 0;
+    int bpages = (NBMAP_BLOCKS(sb) * sizeof(uint32) + PGSIZE - 1) / PGSIZE;
+    int ipages = (NINODE_BLOCKS(sb) * sizeof(uint32) + PGSIZE - 1) / PGSIZE;
+    fsalloc.bfree = alloc_pages(bpages);
+    fsalloc.ifree = alloc_pages(ipages);
+    if(fsalloc.bfree == 0 || fsalloc.ifree == 0)
+        panic("fsalloc_init: out of memory");
+    for(uint32 b = 0; b < NBMAP_BLOCKS(sb); b++) {
+        uint32 base = b * BPB;
+        uint32 limit = sb.size - base < BPB ? sb.size - base : BPB;
+        if(base >= sb.size)
+            break;
+        struct buf *bp = bread_meta(dev, sb.bmapstart + b);
+        fsalloc.bfree[b] = bitmap_count_zero(bp->data, start > base ? start - base : 0, limit);
+        brelse(bp);
+    }
+    if(sb.features & FS_FEAT_GROUPS)
+        fsalloc.ngroups = sb.ngroups;
+    for(uint32 blk = 0; blk < NINODE_BLOCKS(sb); blk++) {
+        struct buf *bp = bread_meta(dev, sb.inodestart + blk);
+        fsalloc.ifree[blk] = 0;
+        for(uint32 slot = 0; slot < IPB; slot++) {
+            uint32 inum = blk * IPB + slot;
+            struct dinode *dip = (struct dinode *)bp->data + slot;
+            if(inum != 0 && inum < sb.ninodes && dip->type == 0) {
+                fsalloc.ifree[blk]++;
+                if(fsalloc.ngroups)
+                    fsalloc.gifree[inode_group(inum)]++;
+            } else if(inum != 0 && inum < sb.ninodes && dip->nlink == 0) {
+                orphan_found(inum);
+            }
+        }
+        brelse(bp);
+    }
+    // 各组的空闲块数：逐段统计组的数据区落在各位图块中的部分
+    for(uint32 g = 0; g < fsalloc.ngroups; g++) {
+        uint32 lo = start + g * sb.bpg;
+        uint32 hi = g == fsalloc.ngroups - 1 || lo + sb.bpg > sb.size ? sb.size : lo + sb.bpg;
+        fsalloc.gcursor[g] = lo < sb.size ? lo : start;
+        for(uint32 b = lo; b < hi; ) {
+            uint32 base = b / BPB * BPB;
+            uint32 end = base + BPB < hi ? base + BPB : hi;
+            struct buf *bp = bread_meta(dev, BBLOCK(b, sb));
+            fsalloc.gbfree[g] += bitmap_count_zero(bp->data, b - base, end - base);
             brelse(bp);
+            b = end;
+        }
+    }
+    fsalloc.bcursor = start;
+    fsalloc.icursor = 0;
+    if(log_ordered()) {
+        fsalloc.bpend = alloc_pages(NBMAP_BLOCKS(sb) * BLOCK_SIZE / PGSIZE);
+        fsalloc.bpend_seq = alloc_pages((NBMAP_BLOCKS(sb) * sizeof(uint64) + PGSIZE - 1) / PGSIZE);
+        if(fsalloc.bpend == 0 || fsalloc.bpend_seq == 0)
+            panic("fsalloc_init: out of memory");
+    }
+}
 
-            bp = bread(dev, bno);
-            memset(bp->data, 0, BLOCK_SIZE);  // 新分配块必须清零，防止泄露旧数据。
-            log_block_write(bp);
+// 顺序数据模式下，事务中释放的块在该事务的头部落盘前不能重新分配：新拥有者的数据块在头部之前
+// 写回原位置，此时崩溃，恢复出的旧拥有者就指向了别人的数据。释放时在 bpend 中记下这些块，
+// 分配时要求块在位图与 bpend 中都空闲，相当于 ext3 按已提交的位图分配。
+// 一个位图块的记录在其最近一次释放的事务落盘后整体清空，之前的释放因此可能多等几次提交。
+// 读写都在持有该位图块缓冲区的睡眠锁时进行
+
+// 位图块 bb 中释放尚未落盘的块，没有时返回 0
+static uchar *bpend_get(uint32 bb)
+{
+    if(fsalloc.bpend == 0 || fsalloc.bpend_seq[bb] == 0)
+        return 0;
+    uchar *map = fsalloc.bpend + (uint64)bb * BLOCK_SIZE;
+    if(!log_seq_durable(fsalloc.bpend_seq[bb]))
+        return map;
+    memset(map, 0, BLOCK_SIZE);
+    fsalloc.bpend_seq[bb] = 0;
+    return 0;
+}
+
+// 即将在当前事务中释放位图块 bb 中的块：返回用于记录的位图，未启用时返回 0
+static uchar *bpend_begin(uint32 bb)
+{
+    if(fsalloc.bpend == 0)
+        return 0;
+    bpend_get(bb);   // 先清掉已落盘的记录
+    fsalloc.bpend_seq[bb] = log_open_seq();
+    return fsalloc.bpend + (uint64)bb * BLOCK_SIZE;
+}
+
+// 当前的空闲数据块总数
+static uint32 balloc_nfree(void)
+{
+    uint32 n = 0;
+
+    acquire(&fsalloc.lock);
+    for(uint32 b = 0; b < NBMAP_BLOCKS(sb); b++)
+        n += fsalloc.bfree[b];
+    release(&fsalloc.lock);
+    return n;
+}
+
+// balloc: 为 ip 找到第一个空闲数据块（从所在块组或轮转游标处起），标记为已用并清零内容。
+static uint32 balloc(struct inode *ip)
+{
+    return balloc_nozero(ip, 1);
+}
+
+// balloc_nozero: 同 balloc；zero 为 0 时不清零，供随后整块覆盖新块的写入使用
+static uint32 balloc_nozero(struct inode *ip, int zero)
+{
+    uint32 got;
+    return balloc_range(ip->dev, balloc_goal(ip), 1, &got, zero ? 0 : 1);
+}
+
+// balloc_range: 从 goal 起（到末尾后回绕到数据区起点）找到第一个空闲块，
+// 并从它开始连续分配至多 want 个空闲块，*got 返回实际块数（不跨位图块）。
+// 前 nozero 个新块留给调用者在同一事务中整块覆盖，不清零；其余新块清零。
+// goal 不在数据区内时从轮转游标处查找。
+static uint32 balloc_range(uint32 dev, uint32 goal, uint32 want, uint32 *got, uint32 nozero)
+{
+    uint32 start = SB_DATASTART(sb);
+    uint32 nbmap = NBMAP_BLOCKS(sb);
+
+    acquire(&fsalloc.lock);
+    if(goal < start || goal >= sb.size)
+        goal = fsalloc.bcursor;
+    release(&fsalloc.lock);
+
+    // 从 goal 所在的位图块起依次查找，最后回到该块查找 goal 之前的部分
+    for(uint32 k = 0; k <= nbmap; k++) {
+        uint32 b = (goal / BPB + k) % nbmap;
+        uint32 base = b * BPB;
+        if(base >= sb.size || fsalloc.bfree[b] == 0)
+            continue;
+        uint32 from = k == 0 ? goal % BPB : 0;
+        uint32 limit = sb.size - base < BPB ? sb.size - base : BPB;
+        if(k == nbmap)
+            limit = goal % BPB;
+        if(base + from < start)
+            from = start - base;
+
+        struct buf *bp = bread_meta(dev, sb.bmapstart + b);
+        uchar *pend = bpend_get(b);
+        int bit = bitmap_find_zero(bp->data, pend, from, limit);
+        if(bit < 0) {
             brelse(bp);
-            return bno;
+            continue;
         }
+
+        uint32 n = 0;
+        uint32 end = sb.size - base < BPB ? sb.size - base : BPB;
+        while(n < want && bit + n < end &&
+              ((bp->data[(bit + n) / 8] | (pend ? pend[(bit + n) / 8] : 0)) & (1 << ((bit + n) % 8))) == 0) {
+            bp->data[(bit + n) / 8] |= 1 << ((bit + n) % 8);
+            n++;
+        }
+        log_block_write(bp);
         brelse(bp);
+
+        uint32 bno = base + bit;
+        acquire(&fsalloc.lock);
+        fsalloc.bfree[b] -= n;
+        fsalloc.bcursor = bno + n < sb.size ? bno + n : start;
+        if(fsalloc.ngroups) {
+            for(uint32 i = 0; i < n; i++)
+                fsalloc.gbfree[block_group(bno + i)]--;
+            fsalloc.gcursor[block_group(bno)] = fsalloc.bcursor;
+        }
+        release(&fsalloc.lock);
+        if(discard.enabled)
+            discard_cancel(bno, n);
+
+        for(uint32 i = nozero; i < n; i++) {
+            bp = bgetblk(dev, bno + i);           // 整块覆盖，不必先读盘
+            memset(bp->data, 0, BLOCK_SIZE);      // 新分配块必须清零，防止泄露旧数据。
+            log_block_write(bp);
+            brelse(bp);
+        }
+        *got = n;
+        return bno;
     }
     panic("balloc: out of blocks");
     return 0;
 }
 
+// 把刚释放的 [b, b + n) 并入待丢弃区间
+static void discard_add(uint32 b, uint32 n)
+{
+    acquire(&discard.lock);
+    int i = 0;
+    while(i < discard.n && discard.r[i].start + discard.r[i].len < b)
+        i++;
+    struct blk_range *r = &discard.r[i];
+    if(i < discard.n && r->start + r->len == b) {
+        r->len += n;
+        if(i + 1 < discard.n && r[1].start == b + n) {   // 填上了两段之间的空隙
+            r->len += r[1].len;
+            memmove(&r[1], &r[2], (discard.n - i - 2) * sizeof(*r));
+            discard.n--;
+        }
+    } else if(i < discard.n && r->start == b + n) {
+        r->start = b;
+        r->len += n;
+    } else if((i == discard.n || r->start > b) && discard.n < NDISCARD) {
+        memmove(&r[1], &r[0], (discard.n - i) * sizeof(*r));
+        r->start = b;
+        r->len = n;
+        discard.n++;
+    }
+    release(&discard.lock);
+}
+
+// 从待丢弃区间中剔除刚分配的 [bno, bno + n)
+static void discard_cancel(uint32 bno, uint32 n)
+{
+    uint32 end = bno + n;
+
+    acquire(&discard.lock);
+    for(int i = 0; i < discard.n; i++) {
+        struct blk_range *r = &discard.r[i];
+        uint32 rend = r->start + r->len;
+        if(rend <= bno || r->start >= end)
+            continue;
+        if(r->start < bno && rend > end) {
+            // 落在一段中间：拆成两段，表满时放弃后一段
+            if(discard.n < NDISCARD) {
+                memmove(&r[2], &r[1], (discard.n - i - 1) * sizeof(*r));
+                r[1].start = end;
+                r[1].len = rend - end;
+                discard.n++;
+            }
+            r->len = bno - r->start;
+            break;
+        }
+        if(r->start < bno) {
+            r->len = bno - r->start;
+        } else if(rend > end) {
+            r->len = rend - end;
+            r->start = end;
+        } else {
+            memmove(r, &r[1], (discard.n - i - 1) * sizeof(*r));
+            discard.n--;
+            i--;
+        }
+    }
+    release(&discard.lock);
+}
+
+// bdiscard_flush: 把待丢弃的区间交给设备。由检查点在已提交的修改全部写回原位置后调用，
+// 此时没有进行中的事务，区间中的块在磁盘位图中都已是空闲的
+void bdiscard_flush(void)
+{
+    if(!discard.enabled)
+        return;
+    acquire(&discard.lock);
+    int n = discard.n;
+    memmove(discard.out, discard.r, n * sizeof(discard.r[0]));
+    discard.n = 0;
+    release(&discard.lock);
+    if(n > 0)
+        blkdev_get(discard.dev)->discard(discard.out, n);
+}
+
 // bfree: 清除 bitmap 中的位，表示数据块重新可用。调用者需确保该块确实闲置。
 static void bfree(uint32 dev, uint32 b)
 {
-    struct buf *bp = bread(dev, BBLOCK(b, sb));
-    uint32 bi = b % BPB;
-    bp->data[bi / 8] &= ~(1 << (bi % 8));
-    log_block_write(bp);
+    bfree_range(dev, b, 1);
+}
+
+// bfree_many: 释放已按块号排序的 n 个块，同一位图块中的块只读一次位图、记一次日志，
+// 块号相邻的合并成一段丢弃区间
+static void bfree_many(uint32 dev, uint32 *b, uint32 n)
+{
+    for(uint32 i = 0; i < n; ) {
+        uint32 bb = b[i] / BPB;
+        struct buf *bp = bread_meta(dev, sb.bmapstart + bb);
+        uchar *pend = bpend_begin(bb);
+        uint32 j = i;
+        for(; j < n && b[j] / BPB == bb; j++) {
+            uint32 bi = b[j] % BPB;
+            bp->data[bi / 8] &= ~(1 << (bi % 8));
+            if(pend)
+                pend[bi / 8] |= 1 << (bi % 8);
+        }
+        log_block_write(bp);
+        brelse(bp);
+
+        acquire(&fsalloc.lock);
+        fsalloc.bfree[bb] += j - i;
+        if(fsalloc.ngroups)
+            for(uint32 k = i; k < j; k++)
+                fsalloc.gbfree[block_group(b[k])]++;
+        release(&fsalloc.lock);
+
+        for(uint32 k = i; discard.enabled && k < j; ) {
+            uint32 e = k + 1;
+            while(e < j && b[e] == b[e - 1] + 1)
+                e++;
+            discard_add(b[k], e - k);
+            k = e;
+        }
+        i = j;
+    }
+}
+
+// bfree_range: 释放连续的 [b, b + n)，按位图块分段
+static void bfree_range(uint32 dev, uint32 b, uint32 n)
+{
+    while(n > 0) {
+        uint32 cnt = MIN(n, BPB - b % BPB);
+        struct buf *bp = bread_meta(dev, BBLOCK(b, sb));
+        uchar *pend = bpend_begin(b / BPB);
+        for(uint32 bi = b % BPB; bi < b % BPB + cnt; bi++) {
+            bp->data[bi / 8] &= ~(1 << (bi % 8));
+            if(pend)
+                pend[bi / 8] |= 1 << (bi % 8);
+        }
+        log_block_write(bp);
+        brelse(bp);
+
+        acquire(&fsalloc.lock);
+        fsalloc.bfree[b / BPB] += cnt;
+        if(fsalloc.ngroups)
+            for(uint32 i = 0; i < cnt; i++)
+                fsalloc.gbfree[block_group(b + i)]++;
+        release(&fsalloc.lock);
+        if(discard.enabled)
+            discard_add(b, cnt);
+        b += cnt;
+        n -= cnt;
+    }
+}
+
+// ===================== 块引用计数 =====================
+// 引用计数区（FS_FEAT_REFLINK）中每个块号一个字节，记录除第一个拥有者之外的引用数，经日志修改。
+// 只有 DI_SHARED 的文件会引用计数非 0 的块；放弃引用时计数非 0 就只减一，减到 0 后
+// 剩下的唯一拥有者释放它时才清位图
+
+// 块 b 的额外引用数
+static int bref_get(uint32 dev, uint32 b)
+{
+    struct buf *bp = bread_meta(dev, REFBLOCK(b, sb));
+    int n = bp->data[b % BLOCK_SIZE];
+    brelse(bp);
+    return n;
+}
+
+// 为块 b 增加一个引用，计数已达 REF_MAX 时返回 -1
+static int bref_inc(uint32 dev, uint32 b)
+{
+    struct buf *bp = bread_meta(dev, REFBLOCK(b, sb));
+    uchar *c = &bp->data[b % BLOCK_SIZE];
+    int r = -1;
+    if(*c < REF_MAX) {
+        (*c)++;
+        log_block_write(bp);
+        r = 0;
+    }
+    brelse(bp);
+    return r;
+}
+
+// 放弃块 b 的一个引用：块仍被其他文件引用时计数减一并返回 1，调用者不得释放它；否则返回 0
+static int bref_put(uint32 dev, uint32 b)
+{
+    struct buf *bp = bread_meta(dev, REFBLOCK(b, sb));
+    uchar *c = &bp->data[b % BLOCK_SIZE];
+    int shared = *c > 0;
+    if(shared) {
+        (*c)--;
+        log_block_write(bp);
+    }
     brelse(bp);
+    return shared;
+}
+
+// 对已按块号排序的 b[0..n) 各放弃一个引用，并从中剔除仍被其他文件引用的块，
+// 返回剩下的（可以释放的）块数。同一引用计数块只读一次、记一次日志
+static uint32 bref_put_many(uint32 dev, uint32 *b, uint32 n)
+{
+    uint32 k = 0;
+
+    for(uint32 i = 0; i < n; ) {
+        uint32 rb = REFBLOCK(b[i], sb);
+        struct buf *bp = bread_meta(dev, rb);
+        int dirty = 0;
+        for(; i < n && REFBLOCK(b[i], sb) == rb; i++) {
+            uchar *c = &bp->data[b[i] % BLOCK_SIZE];
+            if(*c > 0) {
+                (*c)--;
+                dirty = 1;
+            } else {
+                b[k++] = b[i];
+            }
+        }
+        if(dirty)
+            log_block_write(bp);
+        brelse(bp);
+    }
+    return k;
+}
+
+// 释放 [b, b + n) 中没有其他引用的块，仍被共享的各放弃一个引用。区间不跨引用计数块
+static void bfree_range_shared(uint32 dev, uint32 b, uint32 n)
+{
+    uint32 run = b;   // 尚未释放的一段未共享块的起点
+
+    for(uint32 i = b; i < b + n; i++) {
+        if(!bref_put(dev, i))
+            continue;
+        if(i > run)
+            bfree_range(dev, run, i - run);
+        run = i + 1;
+    }
+    if(b + n > run)
+        bfree_range(dev, run, b + n - run);
+}
+
+// ===================== 区段格式 =====================
+
+// 取第 i 个区段的位置：内联区段直接指向 ip->addrs，其余区段位于区段块中，
+// 此时 *bpp 返回持有的区段块，调用者修改后须 log_block_write 并 brelse
+static struct extent *ext_slot(struct inode *ip, uint32 i, struct buf **bpp)
+{
+    *bpp = 0;
+    if(i < NEXTENT_INLINE)
+        return (struct extent *)ip->addrs + i;
+    *bpp = bread_meta(ip->dev, ip->addrs[NDIRECT]);
+    return (struct extent *)(*bpp)->data + (i - NEXTENT_INLINE);
+}
+
+// 区段已映射的块数：最后一个区段的末尾
+static uint32 ext_nblocks(struct inode *ip)
+{
+    uint32 n = ip->addrs[NDIRECT + 1];
+    struct buf *bp;
+    if(n == 0)
+        return 0;
+    struct extent *e = ext_slot(ip, n - 1, &bp);
+    uint32 end = e->lblk + e->len;
+    if(bp)
+        brelse(bp);
+    return end;
+}
+
+// ext_bmap: 查找逻辑块 bn 对应的物理块，bn 须已映射。内联区段无需读盘，
+// 其余区段在区段块中按 lblk 二分查找
+static uint32 ext_bmap(struct inode *ip, uint32 bn)
+{
+    uint32 n = ip->addrs[NDIRECT + 1];
+    struct extent *e = (struct extent *)ip->addrs;
+
+    for(uint32 i = 0; i < n && i < NEXTENT_INLINE; i++) {
+        if(bn < e[i].lblk + e[i].len)
+            return e[i].pblk + (bn - e[i].lblk);
+    }
+    if(n > NEXTENT_INLINE) {
+        struct buf *bp = bread_meta(ip->dev, ip->addrs[NDIRECT]);
+        e = (struct extent *)bp->data;
+        uint32 lo = 0, hi = n - NEXTENT_INLINE;
+        while(lo < hi) {
+            uint32 mid = (lo + hi) / 2;
+            if(bn < e[mid].lblk)
+                hi = mid;
+            else if(bn >= e[mid].lblk + e[mid].len)
+                lo = mid + 1;
+            else {
+                uint32 addr = e[mid].pblk + (bn - e[mid].lblk);
+                brelse(bp);
+                return addr;
+            }
+        }
+        brelse(bp);
+    }
+    panic("ext_bmap: unmapped block");
+    return 0;
+}
+
+// ext_grow: 把区段映射扩展到覆盖前 nblocks 个逻辑块。缺少的块用 balloc_range
+// 一次申请，优先紧接最后一个区段分配，从而直接延长该区段。逻辑块号小于 fullend 的新块
+// 由调用者在同一事务中整块覆盖，不清零。区段数达到上限时返回 -1，已分配的块保留在映射中
+// （位于文件末尾之后，与预分配的块相同）。调用者随后 iupdate
+static int ext_grow(struct inode *ip, uint32 nblocks, uint32 fullend)
+{
+    uint32 mapped = ext_nblocks(ip);
+
+    while(mapped < nblocks) {
+        uint32 n = ip->addrs[NDIRECT + 1];
+        struct buf *bp = 0;
+        struct extent *last = 0;
+        uint32 goal = balloc_goal(ip), got;
+
+        if(n > 0) {
+            last = ext_slot(ip, n - 1, &bp);
+            goal = last->pblk + last->len;
+        }
+        uint32 nozero = fullend > mapped ? fullend - mapped : 0;
+        uint32 pb = balloc_range(ip->dev, goal, nblocks - mapped, &got, nozero);
+        if(last && pb == goal) {
+            last->len += got;
+        } else {
+            if(bp)
+                brelse(bp);
+            if(n == MAX_EXTENTS) {
+                for(uint32 k = 0; k < got; k++)
+                    bfree(ip->dev, pb + k);
+                return -1;
+            }
+            if(n == NEXTENT_INLINE)
+                ip->addrs[NDIRECT] = balloc(ip);   // 首次溢出时分配区段块
+            struct extent *e = ext_slot(ip, n, &bp);
+            e->lblk = mapped;
+            e->pblk = pb;
+            e->len = got;
+            ip->addrs[NDIRECT + 1] = n + 1;
+        }
+        if(bp) {
+            log_block_write(bp);
+            brelse(bp);
+        }
+        mapped += got;
+    }
+    return 0;
+}
+
+// 第 i 个区段：前 NEXTENT_INLINE 个在 ip->addrs 中，其余在调用者持有的区段块 bp 中
+static struct extent *ext_at(struct inode *ip, struct buf *bp, uint32 i)
+{
+    if(i < NEXTENT_INLINE)
+        return (struct extent *)ip->addrs + i;
+    return (struct extent *)bp->data + (i - NEXTENT_INLINE);
+}
+
+// 把第 i 个起的 del 个区段换成 ins[0..nins)，其后的区段随之移动。*bpp 为持有的区段块（可为 0），
+// 区段数首次超出内联槽位时分配并取得区段块，回落到内联槽位以内时释放它。
+// 区段数超出上限时返回 -1，不做任何改动
+static int ext_splice(struct inode *ip, struct buf **bpp, uint32 i, uint32 del,
+                      const struct extent *ins, uint32 nins)
+{
+    uint32 n = ip->addrs[NDIRECT + 1];
+    uint32 nn = n - del + nins;
+
+    if(nn > MAX_EXTENTS)
+        return -1;
+    if(nn > NEXTENT_INLINE && *bpp == 0) {
+        if(ip->addrs[NDIRECT] == 0)
+            ip->addrs[NDIRECT] = balloc(ip);
+        *bpp = bread_meta(ip->dev, ip->addrs[NDIRECT]);
+    }
+    if(nins > del) {
+        for(uint32 k = n; k-- > i + del; )
+            *ext_at(ip, *bpp, k + nins - del) = *ext_at(ip, *bpp, k);
+    } else if(nins < del) {
+        for(uint32 k = i + del; k < n; k++)
+            *ext_at(ip, *bpp, k - (del - nins)) = *ext_at(ip, *bpp, k);
+    }
+    for(uint32 k = 0; k < nins; k++)
+        *ext_at(ip, *bpp, i + k) = ins[k];
+    ip->addrs[NDIRECT + 1] = nn;
+
+    if(nn <= NEXTENT_INLINE && ip->addrs[NDIRECT]) {
+        if(*bpp)
+            brelse(*bpp);
+        *bpp = 0;
+        bfree(ip->dev, ip->addrs[NDIRECT]);
+        ip->addrs[NDIRECT] = 0;
+    }
+    return 0;
+}
+
+// ext_set: 区段格式的 bmap_set。bn 等于已映射的块数时追加在末尾，否则把 bn 所在的区段
+// 拆成至多三段（前段、bn 自己、后段）。bn 是所在区段的第一块且 addr 紧接前一个区段时
+// 直接并入前一个区段，顺序改写共享文件时新块因此仍连成一段。区段数超出上限时返回 -1
+static int ext_set(struct inode *ip, uint32 bn, uint32 addr)
+{
+    uint32 n = ip->addrs[NDIRECT + 1];
+    struct buf *bp = n > NEXTENT_INLINE ? bread_meta(ip->dev, ip->addrs[NDIRECT]) : 0;
+    struct extent piece[3];
+    uint32 np = 0, i = 0;
+
+    if(n > 0) {
+        struct extent *l = ext_at(ip, bp, n - 1);
+        if(bn >= l->lblk + l->len)
+            i = n;            // 追加：clone_file 逐块建立映射时总是这种情况
+    }
+    while(i < n && bn >= ext_at(ip, bp, i)->lblk + ext_at(ip, bp, i)->len)
+        i++;
+    struct extent *e = i < n ? ext_at(ip, bp, i) : 0;
+    struct extent *prev = i > 0 ? ext_at(ip, bp, i - 1) : 0;
+    uint32 end = e ? e->lblk + e->len : 0;
+
+    if(e && bn > e->lblk)
+        piece[np++] = (struct extent){ e->lblk, e->pblk, bn - e->lblk };
+    if(np == 0 && prev && prev->lblk + prev->len == bn && prev->pblk + prev->len == addr)
+        prev->len++;          // 区段数不增加，下面的替换不会失败
+    else
+        piece[np++] = (struct extent){ bn, addr, 1 };
+    if(e && bn + 1 < end)
+        piece[np++] = (struct extent){ bn + 1, e->pblk + (bn + 1 - e->lblk), end - bn - 1 };
+
+    int r = ext_splice(ip, &bp, i, e ? 1 : 0, piece, np);
+    if(bp) {
+        if(r == 0)
+            log_block_write(bp);
+        brelse(bp);
+    }
+    return r;
+}
+
+// ext_trunc: 释放全部区段引用的块与区段块。从最后一个区段起释放，每次只释放落在同一位图块中的尾部，超长区段分多次缩短。
+// 共享块的文件每次只释放落在同一引用计数块中的尾部（一个引用计数块描述的块落在同一位图块内）
+static void ext_trunc(struct trunc *ts)
+{
+    struct inode *ip = ts->ip;
+    uint32 unit = ts->shared ? BLOCK_SIZE : BPB;
+    uint32 n;
+
+    while((n = ip->addrs[NDIRECT + 1]) > 0) {
+        struct buf *bp;
+        struct extent *e = ext_slot(ip, n - 1, &bp);
+        uint32 pblk = e->pblk, last = e->pblk + e->len - 1;
+        if(bp)
+            brelse(bp);
+        uint32 from = last / unit * unit > pblk ? last / unit * unit : pblk;
+        uint32 bbs[2] = { BBLOCK(from, sb), REFBLOCK(from, sb) };
+
+        trunc_reserve_bmaps(ts, bbs, ts->shared ? 2 : 1);
+        if(from == pblk) {
+            ip->addrs[NDIRECT + 1] = n - 1;
+        } else {
+            e = ext_slot(ip, n - 1, &bp);
+            e->len = from - pblk;
+            if(bp) {
+                if(ts->split)
+                    log_block_write(bp);
+                brelse(bp);
+            }
+        }
+        if(ts->shared)
+            bfree_range_shared(ip->dev, from, last - from + 1);
+        else
+            bfree_range(ip->dev, from, last - from + 1);
+
+        if(n - 1 == NEXTENT_INLINE && from == pblk) {
+            // 区段块中已没有区段
+            trunc_collect(ts, ip->addrs[NDIRECT]);
+            trunc_reserve(ts);
+            ip->addrs[NDIRECT] = 0;
+            trunc_release(ts);
+        }
+    }
+    memset(ip->addrs, 0, sizeof(ip->addrs));
 }
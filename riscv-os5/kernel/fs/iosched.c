@@ -0,0 +1,318 @@
+// iosched.c: 块 I/O 调度器，位于块缓存（bio.c）与磁盘驱动之间。
+// 以 blkdev 的形式包在原驱动外面：提交的请求先进入读、写两个队列，每个队列各有一条
+// 按截止时间排序的 FIFO 与一条按块号排序的链表；同时交给驱动的请求不超过 IOSCHED_DEPTH 个，
+// 其余留在队列中由调度器决定次序：
+//   - 读优先：等待读的通常是正在运行的进程，写多半是日志与回写，读队列非空时先派发读，
+//     写连续让出 IOSCHED_WRITE_STARVE 批或写队列头部已过期时才轮到写；
+//   - 一批之内按块号单向扫描，从上次派发的位置继续，减少磁头（或宿主机文件）的来回移动；
+//   - 新的一批若 FIFO 头部已过期，先派发最早到期的请求，保证每个请求的等待有上限。
+// 截止时间 = 提交时刻 + 所在方向的期限 + 提交者 MLFQ 级别的惩罚，交互进程（高优先级）的
+// 请求更早到期，在拥挤时先于批处理进程的请求得到服务。
+//
+// 驱动的完成回调经 iosched_complete 转发：调用原回调、唤醒等待者、记录延迟，
+// 并在队列非空时唤醒 kblockd 派发下一批（完成回调运行在中断中且持有驱动的锁，不能直接提交）。
+// 提交者自己也会在入队后尝试派发，设备空闲时请求不必经过 kblockd。
+// kblockd 启动之前（启动阶段没有可睡眠的进程）请求直接交给驱动。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "buf.h"
+#include "blkdev.h"
+#include "virtio.h"
+#include "trap.h"
+#include "printf.h"
+#include "klog.h"
+#include "metrics.h"
+
+#define IOSCHED_NREQ 64          // 请求池
+// 交给驱动的请求数上限：每个请求至多占 VIRTIO_MAX_SEGS + 2 个描述符，
+// 不超过 VIRTIO_RING_NUM / (VIRTIO_MAX_SEGS + 2) 时驱动提交永远不必等描述符
+#define IOSCHED_DEPTH (VIRTIO_RING_NUM / (VIRTIO_MAX_SEGS + 2))
+#define IOSCHED_BATCH 8          // 同一方向连续派发的请求数
+#define IOSCHED_WRITE_STARVE 2   // 读优先时写至多连续让出的批数
+
+#define READ_EXPIRE  (TIMEBASE_FREQ / 20)   // 读请求的期限 50ms
+#define WRITE_EXPIRE (TIMEBASE_FREQ / 2)    // 写请求的期限 500ms
+#define PRIO_PENALTY (TIMEBASE_FREQ / 100)  // MLFQ 每低一级，期限延长 10ms
+
+struct ioreq {
+    struct buf *bs[VIRTIO_MAX_SEGS];
+    int n;
+    int write;
+    void (*done)(struct buf *);
+    uint dev;
+    uint blockno;
+    int pending;                 // 派发后尚未完成的块数
+    uint64 start;                // 提交时刻
+    uint64 deadline;
+    struct ioreq *fifo_next;     // 队列中按截止时间排序，空闲时串成空闲链
+    struct ioreq *sort_next;     // 队列中按 (dev, blockno) 排序
+};
+
+struct ioqueue {
+    struct ioreq *fifo;
+    struct ioreq *sorted;
+    int n;
+};
+
+static struct {
+    struct spinlock lock;
+    const struct blkdev *lower;  // 被包装的驱动
+    struct blkdev dev;
+    struct ioreq req[IOSCHED_NREQ];
+    struct ioreq *free;
+    struct ioqueue q[2];         // [0] 读，[1] 写
+    int inflight;                // 已交给驱动、尚未完成的请求数
+    int dir;                     // 当前批次的方向
+    int batch;                   // 当前批次已派发的请求数
+    int starved;                 // 读优先而让出的写批次数
+    uint dev_pos;                // 上次派发请求之后的位置
+    uint blk_pos;
+    int pid;                     // kblockd，尚未创建时为 0
+} iosched;
+
+static struct pcpu_hist read_latency;    // 提交到完成的耗时
+static struct pcpu_hist write_latency;
+static struct pcpu_counter expired;      // 因截止时间到期而越过块号顺序派发的请求数
+
+static void metric_queued(struct metric_stat *st)
+{
+    st->value = __atomic_load_n(&iosched.q[0].n, __ATOMIC_RELAXED) +
+                __atomic_load_n(&iosched.q[1].n, __ATOMIC_RELAXED);
+}
+
+static struct metric iosched_metrics[] = {
+    { .name = "iosched.read_latency", .kind = METRIC_HIST, .hist = &read_latency },
+    { .name = "iosched.write_latency", .kind = METRIC_HIST, .hist = &write_latency },
+    { .name = "iosched.expired", .kind = METRIC_COUNTER, .counter = &expired },
+    { .name = "iosched.queued", .kind = METRIC_GAUGE, .read = metric_queued },
+};
+
+static void iosched_complete(struct buf *b);
+
+// 按 (dev, blockno) 比较请求 r 与位置 dev:blockno
+static int blk_cmp(struct ioreq *r, uint dev, uint blockno)
+{
+    if(r->dev != dev)
+        return r->dev < dev ? -1 : 1;
+    if(r->blockno != blockno)
+        return r->blockno < blockno ? -1 : 1;
+    return 0;
+}
+
+static void queue_insert(struct ioqueue *q, struct ioreq *r)
+{
+    struct ioreq **pp = &q->fifo;
+    while(*pp && (*pp)->deadline <= r->deadline)
+        pp = &(*pp)->fifo_next;
+    r->fifo_next = *pp;
+    *pp = r;
+
+    pp = &q->sorted;
+    while(*pp && blk_cmp(*pp, r->dev, r->blockno) <= 0)
+        pp = &(*pp)->sort_next;
+    r->sort_next = *pp;
+    *pp = r;
+    q->n++;
+}
+
+static void queue_remove(struct ioqueue *q, struct ioreq *r)
+{
+    struct ioreq **pp;
+    for(pp = &q->fifo; *pp != r; pp = &(*pp)->fifo_next)
+        ;
+    *pp = r->fifo_next;
+    for(pp = &q->sorted; *pp != r; pp = &(*pp)->sort_next)
+        ;
+    *pp = r->sort_next;
+    q->n--;
+}
+
+static int queue_expired(struct ioqueue *q, uint64 now)
+{
+    return q->fifo && (long)(now - q->fifo->deadline) >= 0;
+}
+
+// 选出下一个派发的请求并移出队列，没有可派发的请求时返回 0。调用者持有 iosched.lock
+static struct ioreq *iosched_pick(void)
+{
+    struct ioqueue *rq = &iosched.q[0], *wq = &iosched.q[1];
+    uint64 now = r_time();
+    struct ioreq *r = 0;
+
+    if(iosched.inflight >= IOSCHED_DEPTH || rq->n + wq->n == 0)
+        return 0;
+
+    if(iosched.batch == 0 || iosched.batch >= IOSCHED_BATCH || iosched.q[iosched.dir].n == 0) {
+        // 开始新的一批：选方向，头部已过期时从最早到期的请求开始
+        int dir = 0;
+        if(rq->n == 0 ||
+           (wq->n && (iosched.starved >= IOSCHED_WRITE_STARVE || queue_expired(wq, now))))
+            dir = 1;
+        if(dir == 0 && wq->n)
+            iosched.starved++;
+        else if(dir == 1)
+            iosched.starved = 0;
+        iosched.dir = dir;
+        iosched.batch = 0;
+        if(queue_expired(&iosched.q[dir], now)) {
+            r = iosched.q[dir].fifo;
+            pcpu_inc(&expired);
+        }
+    }
+
+    struct ioqueue *q = &iosched.q[iosched.dir];
+    if(r == 0) {
+        // 按块号单向扫描：取上次位置之后的第一个请求，到末尾后回到开头
+        for(r = q->sorted; r && blk_cmp(r, iosched.dev_pos, iosched.blk_pos) < 0; r = r->sort_next)
+            ;
+        if(r == 0)
+            r = q->sorted;
+    }
+    queue_remove(q, r);
+    iosched.batch++;
+    iosched.inflight++;
+    r->pending = r->n;
+    iosched.dev_pos = r->dev;
+    iosched.blk_pos = r->blockno + r->n;
+    return r;
+}
+
+// 在不持有 iosched.lock 的情况下把可派发的请求依次交给驱动，可能睡眠
+static void iosched_dispatch(void)
+{
+    for(;;) {
+        acquire(&iosched.lock);
+        struct ioreq *r = iosched_pick();
+        release(&iosched.lock);
+        if(r == 0)
+            return;
+        // 驱动在完成之前就已读完 r->bs，之后 r 可能随时完成并被回收
+        iosched.lower->submit(r->bs, r->n, r->write, iosched_complete);
+    }
+}
+
+// 驱动的完成回调（可能在中断中，持有驱动的锁）：此时 b->disk 已清零
+static void iosched_complete(struct buf *b)
+{
+    struct ioreq *r = b->ioreq;
+    if(r->done)
+        r->done(b);   // 可能放弃 b 的引用，之后只用作唤醒的通道
+
+    acquire(&iosched.lock);
+    wakeup(b);        // 等待者在 iosched.lock 下检查 b->disk，不会错过
+    if(--r->pending == 0) {
+        pcpu_hist_add(r->write ? &write_latency : &read_latency, r_time() - r->start);
+        iosched.inflight--;
+        r->fifo_next = iosched.free;
+        iosched.free = r;
+        wakeup(&iosched.free);
+        if(iosched.q[0].n + iosched.q[1].n)
+            wakeup(&iosched.pid);
+    }
+    release(&iosched.lock);
+}
+
+// 截止时间：所在方向的期限加上提交者 MLFQ 级别的惩罚
+static uint64 iosched_deadline(int write, uint64 now)
+{
+    struct proc *p = myproc();
+    int level = p ? p->priority_level : 0;
+    return now + (write ? WRITE_EXPIRE : READ_EXPIRE) + (uint64)level * PRIO_PENALTY;
+}
+
+static void iosched_submit(struct buf **bs, int n, int write, void (*done)(struct buf *))
+{
+    if(iosched.pid == 0 || myproc() == 0) {
+        for(int i = 0; i < n; i++)
+            bs[i]->ioreq = 0;
+        iosched.lower->submit(bs, n, write, done);
+        return;
+    }
+    if(n < 1 || n > VIRTIO_MAX_SEGS)
+        panic("iosched: bad segment count");
+
+    acquire(&iosched.lock);
+    while(iosched.free == 0)
+        sleep(&iosched.free, &iosched.lock);
+    struct ioreq *r = iosched.free;
+    iosched.free = r->fifo_next;
+
+    for(int i = 0; i < n; i++) {
+        r->bs[i] = bs[i];
+        bs[i]->ioreq = r;
+        bs[i]->disk = 1;   // 排队期间同样视为在途，bread 据此等待而不是重新读
+    }
+    r->n = n;
+    r->write = write;
+    r->done = done;
+    r->dev = bs[0]->dev;
+    r->blockno = bs[0]->blockno;
+    r->start = r_time();
+    r->deadline = iosched_deadline(write, r->start);
+    queue_insert(&iosched.q[write != 0], r);
+    release(&iosched.lock);
+
+    iosched_dispatch();
+}
+
+static void iosched_wait(struct buf *b)
+{
+    if(b->ioreq == 0) {
+        iosched.lower->wait(b);   // 未经调度器排队的请求
+        return;
+    }
+    acquire(&iosched.lock);
+    while(b->disk)
+        sleep(b, &iosched.lock);
+    release(&iosched.lock);
+}
+
+// kblockd：完成回调不能提交新请求，由它在设备让出空位后继续派发
+static void kblockd(void *arg)
+{
+    (void)arg;
+    for(;;) {
+        acquire(&iosched.lock);
+        while((iosched.inflight >= IOSCHED_DEPTH || iosched.q[0].n + iosched.q[1].n == 0) &&
+              !kthread_should_stop())
+            sleep(&iosched.pid, &iosched.lock);
+        release(&iosched.lock);
+        if(kthread_should_stop())
+            return;
+        iosched_dispatch();
+    }
+}
+
+// iosched_init: 在设备号 dev 已登记的驱动外包上调度器，在文件系统初始化之前调用
+void iosched_init(uint dev)
+{
+    initlock(&iosched.lock, "iosched");
+    for(int i = 0; i < IOSCHED_NREQ; i++) {
+        iosched.req[i].fifo_next = iosched.free;
+        iosched.free = &iosched.req[i];
+    }
+    iosched.lower = blkdev_get(dev);
+    iosched.dev.name = "iosched";
+    iosched.dev.submit = iosched_submit;
+    iosched.dev.wait = iosched_wait;
+    iosched.dev.discard = iosched.lower->discard;   // 丢弃请求同步完成，不经队列
+    blkdev_register(dev, &iosched.dev);
+    METRICS_REGISTER(iosched_metrics);
+}
+
+// 进程子系统就绪后创建 kblockd，此后的请求才进入队列
+void iosched_start(void)
+{
+    if(iosched.lower == 0 || blkdev_get(ROOTDEV) != &iosched.dev)
+        return;   // RAMDISK=1 时内存盘取代了被包装的驱动，请求同步完成，无需调度
+    int pid = kthread_create(kblockd, 0, "kblockd");
+    if(pid < 0) {
+        klog_warn("iosched: 创建 kblockd 失败，请求直接交给 %s", iosched.lower->name);
+        return;
+    }
+    iosched.pid = pid;
+    klog_info("iosched: %s 之上的截止时间调度器，在途请求至多 %d 个", iosched.lower->name, IOSCHED_DEPTH);
+}
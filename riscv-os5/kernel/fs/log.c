@@ -5,34 +5,123 @@
 #include "log.h"
 #include "string.h"
 #include "printf.h"
+#include "timer.h"
+#include "trap.h"
+#include "klog.h"
+#include "metrics.h"
 
 // ===================== 日志子系统实现 =====================
 // 设计遵循 xv6 的写前日志思路：所有对磁盘块的修改都先写入日志区，
 // 当事务提交时再一次性复制到目标块，确保崩溃前后数据具有原子性。
+//
+// 写回模式：提交只把本次修改的块写入日志区并写回头部，头部落盘即完成持久化；
+// 目标块以脏块形式钉在缓存中，多次提交在日志中累积，由检查点（checkpoint）
+// 统一按块号排序写回原位置后再清空日志。同一热块（位图、目录块）在检查点之间
+// 的多次修改只产生一次原位置写入。已提交的日志槽在检查点前不得覆盖，
+// 因此提交后再次修改的块在日志中追加新槽，恢复时同一块只安装最后一个槽。
+// 检查点由后台 flusher 线程按脏块年龄与日志占用比例触发；日志空间不足以开始新事务时，
+// begin_transaction 直接就地执行检查点。
+//
+// 组提交与双缓冲：一个事务的操作全部结束后由最后一个结束者提交。提交分两步：
+// 先在阻止新事务开始（freezing）的情况下把各块内容复制进日志缓冲并提交写请求，
+// 随即放开，下一个事务在其后的槽中开始累积，同时上一个事务的日志写入与头部写入在途；
+// 期间结束的操作等上一次提交完成后合并成一次提交。每个操作在 end_transaction 返回前
+// 都已提交，语义与逐个提交相同。
+//
+// 提交记录：头部带有递增的序号与校验和（覆盖头部各项与其描述的全部日志槽内容），
+// 两份头部块轮流写入。头部因此可以与日志槽放进同一批请求一起下发，不必等日志槽落盘后
+// 再单独写头部：写入不完整时新头部校验失败，恢复时退回另一份仍然有效的旧头部，
+// 其描述的槽都在新槽之前，不会被本次提交覆盖。
+//
+// 空间预留：每个操作开始时声明至多写入多少个不同的块（begin_transaction_blocks，
+// 缺省为 MAX_OP_BLOCKS），记在进程的 log_credit 与全局的 reserved 中。操作每占用一个
+// 新槽就从二者中扣除一块，吸收进已有槽的重复写入不扣；操作结束时归还剩余额度。
+// 准入条件因此是“已用槽 + 进行中操作的剩余额度 + 新操作的额度”不超过日志容量，
+// 只改少数元数据块的操作不再按最坏情况占位。
+//
+// 异步提交模式（超级块 FS_FEAT_ASYNC）：end_transaction 不再等待提交，修改留在内存中的
+// 当前事务里继续累积，由 flusher 每 FLUSH_INTERVAL 提交一次，或在日志空间不足以开始
+// 新操作时由 begin_transaction 就地提交。崩溃至多丢失最近一个间隔内的修改，但不会破坏
+// 一致性；需要持久化的调用者用 log_force（fsync）等待提交完成。
+//
+// 顺序数据模式（超级块 FS_FEAT_ORDERED）：普通文件的数据块经 log_data_write 记在当前事务的
+// 数据块表中而不占日志槽，提交时先写回原位置，等它们落盘后才下发头部，因此提交后元数据
+// 引用的块内容都已在盘上，数据只写一次。块号仍在日志中的块（作为元数据释放后又分配给文件）
+// 照常记入日志，否则恢复时旧槽会盖住新写的数据；数据块表满时当场写回，仍早于提交。
+// 事务中释放的块在该事务的头部落盘前不会重新分配（见 fs.c 的 bpend），
+// 否则新拥有者的数据先于头部写回原位置，崩溃后已提交的旧拥有者会指向别人的数据。
+
+#define LOG_MAGIC 0x4c4f4731       // "LOG1"
+#define LOG_SUM_INIT 2166136261u   // FNV-1a 的初值
 
 struct log_header {
+    uint64 seq;                // 头部序号，恢复时取校验通过且序号最大的一份
+    uint32 magic;              // LOG_MAGIC，全零的日志区视为空
     int n;                     // 日志中有效块的数量
-    int block[LOG_SIZE];       // 每个被记录的数据块号
+    uint32 sum;                // 头部各项与前 n 个日志槽内容的校验和
+    int block[LOG_MAX - LOG_HDR_BLOCKS]; // 每个被记录的数据块号
 };
 
 struct log_state {
     struct spinlock lock;      // 保护日志状态、支持 begin/end 并发控制
     int start;                 // 日志区起始块号（来自超级块）
-    int size;                  // 日志区总块数，用于越界检查
-    int outstanding;           // 当前仍在执行的事务数量
-    int committing;            // 是否正在提交（提交期间新的 begin 需要等待）
+    int nslots;                // 日志区中的槽数（来自超级块），恢复时据此检查头部
+    int size;                  // 可用的日志块数，用于越界检查
+    int outstanding;           // 当前事务中仍在执行的操作数量
+    int reserved;              // 进行中的操作预留而尚未用掉的日志块数
+    int committing;            // 是否有提交的 I/O 在途或正在执行检查点，期间不能开始新的提交
+    int freezing;              // 提交正在复制块内容或正在执行检查点，期间新的 begin 需要等待
+    int draining;              // flusher 等待当前事务结束以执行检查点，期间新的 begin 需要等待
+    int committed;             // header 中已提交（头部已落盘）的项数
+    int open_start;            // 当前事务的第一个槽，之前的槽已提交或正在提交
+    uint64 open_seq;           // 当前事务的序号
+    uint64 done_seq;           // 已完成提交的最大事务序号
+    uint64 disk_seq;           // 头部已落盘的最大事务序号（crash_stage 2 模拟的提交不算）
+    uint64 dirty_since;        // 日志从空变为非空时的 ticks，用于按年龄触发检查点
+    uint64 hdr_seq;            // 最近写入的头部序号，下一份头部写到另一个头部块
+    uint32 slot_sum;           // 已复制进日志缓冲的槽（open_start 之前）的累计校验和
     int dev;                   // 目标设备号
+    int async;                 // 异步提交模式
+    int ordered;               // 顺序数据模式
+    int ndata;                 // 当前事务数据块表中的块数，每块持有一次 pin
+    int data_max;              // 数据块表的容量，与日志共用缓存的配额
+    struct buf *data[LOG_MAX]; // 当前事务中待写回原位置的数据块
     struct log_header header;  // 内存中的日志头部镜像
 };
 
 static struct log_state g_log; // 全局日志状态，仅在本文件内部可见
+
+static struct pcpu_hist commit_blocks;   // 每次提交写出的块数（日志槽、头部与顺序模式的数据块）
+static struct pcpu_hist commit_time;     // 每次提交从开始复制到全部落盘的耗时
+static struct pcpu_counter checkpoints;
+
+static void metric_log_used(struct metric_stat *st)
+{
+    st->value = __atomic_load_n(&g_log.header.n, __ATOMIC_RELAXED);
+}
+
+static struct metric log_metrics[] = {
+    { .name = "log.commit_blocks", .kind = METRIC_HIST, .hist = &commit_blocks },
+    { .name = "log.commit_time", .kind = METRIC_HIST, .hist = &commit_time },
+    { .name = "log.checkpoints", .kind = METRIC_COUNTER, .counter = &checkpoints },
+    { .name = "log.used", .kind = METRIC_GAUGE, .read = metric_log_used },
+};
 int crash_stage = 0; // 用于测试崩溃恢复的阶段控制变量
 
 static void read_log_header(void);
-static void write_log_header(void);
-static void install_transaction(int recovering);
-static void commit_transaction(void);
-static void write_log_blocks(void);
+static void write_log_header(int n);
+static struct buf *fill_log_header(int n);
+static void install_transaction(void);
+static int checkpoint_ready(void);
+static void checkpoint_locked(void);
+static void commit_locked(void);
+
+extern volatile uint64 ticks;
+
+// flusher 线程每 FLUSH_INTERVAL 个 tick（约 1 秒）检查一次：最早的已提交修改超过
+// FLUSH_AGE 个 tick，或已提交的项占到日志的一半以上时执行检查点
+#define FLUSH_INTERVAL 10
+#define FLUSH_AGE 30
 
 // ===================== 公共接口 =====================
 
@@ -44,62 +133,154 @@ void log_init(int dev, struct superblock *sb)
 
     initlock(&g_log.lock, "log");
     g_log.start = sb->logstart;
-    g_log.size = sb->nlog;
+    g_log.nslots = sb->nlog - LOG_HDR_BLOCKS;
+    // 日志中的块在检查点前一直钉在缓存中，至多使用缓存的 1/4
+    g_log.size = g_log.nslots;
+    if(g_log.size > bcache_nbuf() / 4)
+        g_log.size = bcache_nbuf() / 4;
+    if(g_log.size + LOG_HDR_BLOCKS < LOG_MIN)
+        panic("log_init: log too small");
     g_log.outstanding = 0;
+    g_log.reserved = 0;
     g_log.committing = 0;
+    g_log.freezing = 0;
+    g_log.draining = 0;
+    g_log.committed = 0;
+    g_log.open_start = 0;
+    g_log.open_seq = 1;
+    g_log.done_seq = 0;
+    g_log.slot_sum = LOG_SUM_INIT;
     g_log.dev = dev;
+    g_log.async = (sb->features & FS_FEAT_ASYNC) != 0;
+    g_log.ordered = (sb->features & FS_FEAT_ORDERED) != 0;
+    g_log.ndata = 0;
+    g_log.data_max = g_log.size;
     g_log.header.n = 0;
+    METRICS_REGISTER(log_metrics);
 
     recover_log();
 }
 
-// begin_transaction: 文件系统系统调用入口调用，标记事务开始。
+// begin_transaction: 文件系统系统调用入口调用，标记事务开始，按最坏情况预留 MAX_OP_BLOCKS 块。
 void begin_transaction(void)
 {
+    begin_transaction_n(1);
+}
+
+// 为 nops 个操作预留共 blocks 个日志块，空间不足时提交或执行检查点，必要时等待
+static void log_admit(int nops, int blocks)
+{
+    struct proc *p = myproc();
+
+    if(nops < 1 || blocks < 0 || blocks > g_log.size)
+        panic("begin_transaction_n");
+    if(p->log_ops)
+        panic("begin_transaction: nested");
     acquire(&g_log.lock);
     for(;;) {
-        if(g_log.committing) {
-            sleep(&g_log, &g_log.lock); // 正在提交时需要等待
-        } else if(g_log.header.n + (g_log.outstanding + 1) * MAX_OP_BLOCKS > g_log.size) {
-            // 预估本事务可能写入的块数，若不足则等待提交释放空间
-            sleep(&g_log, &g_log.lock);
+        if(g_log.freezing || g_log.draining) {
+            sleep(&g_log, &g_log.lock); // 正在复制提交内容或等待检查点时需要等待
+        } else if(g_log.header.n + g_log.reserved + blocks > g_log.size) {
+            // 预估本事务可能写入的块数，若不足则释放已提交的日志空间：
+            // 没有进行中的操作与提交时就地执行检查点（异步模式下先提交累积的事务），
+            // 否则等待它们结束
+            if(g_log.outstanding == 0 && !g_log.committing && g_log.open_start < g_log.header.n)
+                commit_locked();
+            else if(g_log.outstanding == 0 && !g_log.committing && checkpoint_ready())
+                checkpoint_locked();
+            else
+                sleep(&g_log, &g_log.lock);
         } else {
-            g_log.outstanding++;
+            g_log.outstanding += nops;
+            g_log.reserved += blocks;
             release(&g_log.lock);
             break;
         }
     }
+    p->log_ops = nops;
+    p->log_credit = blocks;
+}
+
+// begin_transaction_blocks: 开始一个至多写入 blocks 个不同块的操作（见 log.h 的 LOG_OP_*），
+// 以 end_transaction 结束
+void begin_transaction_blocks(int blocks)
+{
+    log_admit(1, blocks);
+}
+
+// begin_transaction_n: 一次为 nops 个操作预留日志额度，各操作共用同一次提交。
+// 期间不能再嵌套调用 begin_transaction（额度已计入 outstanding，嵌套等待可能永远等不到提交）
+void begin_transaction_n(int nops)
+{
+    log_admit(nops, nops * MAX_OP_BLOCKS);
+}
+
+// in_transaction: 当前进程是否处于某个操作之中
+int in_transaction(void)
+{
+    struct proc *p = myproc();
+    return p && p->log_ops > 0;
 }
 
-// end_transaction: 系统调用结束时调用，若是最后一个事务则触发提交。
+// end_transaction: 系统调用结束时调用，返回前本操作所在的事务已提交。
 void end_transaction(void)
 {
-    int do_commit = 0;
+    end_transaction_n(1);
+}
+
+// end_transaction_n: 归还 begin_transaction_n 预留的 nops 份额度，并等待所在事务提交。
+// 事务的最后一个操作结束时，若上一次提交仍在途则先等它完成；等待期间新加入又结束的操作
+// 由最先醒来的一个一并提交。异步模式下不等待，提交留给 flusher 或 log_force
+void end_transaction_n(int nops)
+{
+    struct proc *p = myproc();
 
     acquire(&g_log.lock);
-    if(g_log.outstanding < 1)
+    if(g_log.outstanding < nops || p->log_ops != nops)
         panic("end_transaction: no outstanding");
 
-    g_log.outstanding--;
-    if(g_log.committing)
-        panic("end_transaction: already committing");
+    g_log.outstanding -= nops;
+    g_log.reserved -= p->log_credit;   // 归还未用掉的额度
+    p->log_ops = 0;
+    p->log_credit = 0;
+    uint64 seq = g_log.open_seq;
+    if(g_log.outstanding > 0 || g_log.async)
+        wakeup(&g_log);            // 归还的额度可能让等待 begin_transaction、flusher 或 log_force 的进程继续
+    if(g_log.async) {
+        release(&g_log.lock);
+        return;
+    }
 
-    if(g_log.outstanding == 0) {
-        do_commit = 1;
-        g_log.committing = 1;
-    } else {
-        // 释放等待 begin_transaction 的进程
-        wakeup(&g_log);
+    while(g_log.done_seq < seq) {
+        if(g_log.open_seq == seq && g_log.outstanding == 0 && !g_log.committing)
+            commit_locked();
+        else
+            sleep(&g_log, &g_log.lock);
     }
     release(&g_log.lock);
+}
 
-    if(do_commit) {
-        commit_transaction();
-        acquire(&g_log.lock);
-        g_log.committing = 0;
-        wakeup(&g_log);
-        release(&g_log.lock);
+// log_force: 等待此前结束的全部操作提交到日志，返回时它们的修改在崩溃后可以恢复。
+// 同步模式下 end_transaction 返回前已提交，这里通常立即返回
+void log_force(void)
+{
+    acquire(&g_log.lock);
+    // 当前事务中已有修改时要等它提交，否则等上一次提交完成即可
+    uint64 seq = g_log.open_start < g_log.header.n ? g_log.open_seq : g_log.open_seq - 1;
+    while(g_log.done_seq < seq) {
+        if(g_log.open_seq == seq && g_log.outstanding == 0 && !g_log.committing)
+            commit_locked();
+        else
+            sleep(&g_log, &g_log.lock);
     }
+    release(&g_log.lock);
+}
+
+// log_max_ops: 一个调用者一次最多预留的操作数（占日志的一半），供大块写入合并事务
+int log_max_ops(void)
+{
+    int n = g_log.size / MAX_OP_BLOCKS / 2;
+    return n > 0 ? n : 1;
 }
 
 // log_block_write: 取代直接的 bwrite 调用，将缓存块加入当前事务。
@@ -110,111 +291,515 @@ void log_block_write(struct buf *bp)
     acquire(&g_log.lock);
     if(g_log.header.n >= g_log.size)
         panic("log_block_write: log full");
-    if(g_log.header.n >= LOG_SIZE)
-        panic("log_block_write: header overflow");
     if(g_log.outstanding < 1)
         panic("log_block_write outside transaction");
 
-    for(idx = 0; idx < g_log.header.n; idx++) {
+    // 吸收重复写：同一块在当前事务中只记录一次。已提交或正在提交的槽不能再改写，
+    // 之后再次修改的块追加新槽
+    for(idx = g_log.open_start; idx < g_log.header.n; idx++) {
         if(g_log.header.block[idx] == (int)bp->blockno)
-            break; // 吸收重复写：同一块只记录一次
+            break;
     }
 
     g_log.header.block[idx] = bp->blockno;
     if(idx == g_log.header.n) {
-        bpin(bp);                 // 提交结束前不允许缓存驱逐
+        bpin(bp);                 // 检查点写回前不允许缓存驱逐，每个槽持有一次 pin
         g_log.header.n++;
+        // 新槽用掉所在操作的一块额度；超出声明的写入直接占用空闲空间
+        struct proc *p = myproc();
+        if(p)
+            p->io.log_blocks++;
+        if(p && p->log_credit > 0) {
+            p->log_credit--;
+            g_log.reserved--;
+        }
+    }
+    bp->flags |= B_DIRTY;         // 原位置的写回推迟到检查点
+    // 当前事务中先作为数据写过、又改作元数据的块（文件删除后块被重新分配）：
+    // 不能再在提交前写回原位置
+    for(int i = 0; i < g_log.ndata; i++) {
+        if(g_log.data[i] == bp) {
+            g_log.data[i] = g_log.data[--g_log.ndata];
+            bunpin(bp);
+            break;
+        }
     }
     release(&g_log.lock);
 }
 
+// log_data_write: 普通文件数据块的写入。顺序数据模式下加入当前事务的数据块表，
+// 提交时在头部之前写回原位置；否则与 log_block_write 相同。调用者持有 bp 的睡眠锁
+void log_data_write(struct buf *bp)
+{
+    if(!g_log.ordered) {
+        log_block_write(bp);
+        return;
+    }
+
+    acquire(&g_log.lock);
+    if(g_log.outstanding < 1)
+        panic("log_data_write outside transaction");
+    for(int i = 0; i < g_log.header.n; i++) {
+        if(g_log.header.block[i] == (int)bp->blockno) {
+            release(&g_log.lock);
+            log_block_write(bp);  // 日志中还有这个块号的旧槽
+            return;
+        }
+    }
+    int i = 0;
+    while(i < g_log.ndata && g_log.data[i] != bp)
+        i++;
+    if(i == g_log.ndata && g_log.ndata == g_log.data_max) {
+        release(&g_log.lock);
+        bwrite(bp);               // 表满：当场写回
+        return;
+    }
+    if(i == g_log.ndata) {
+        bpin(bp);                 // 写回前不允许缓存驱逐
+        g_log.data[g_log.ndata++] = bp;
+    }
+    bp->flags |= B_DIRTY;
+    release(&g_log.lock);
+}
+
+// log_open_seq: 调用者所在事务的序号，调用者处于事务中
+uint64 log_open_seq(void)
+{
+    acquire(&g_log.lock);
+    uint64 seq = g_log.open_seq;
+    release(&g_log.lock);
+    return seq;
+}
+
+// log_seq_durable: 序号为 seq 的事务是否已提交且头部已落盘，崩溃后其修改一定会被恢复
+int log_seq_durable(uint64 seq)
+{
+    acquire(&g_log.lock);
+    int ok = g_log.disk_seq >= seq;
+    release(&g_log.lock);
+    return ok;
+}
+
+// log_ordered: 是否以顺序数据模式挂载
+int log_ordered(void)
+{
+    return g_log.ordered;
+}
+
 // recover_log: 启动时从日志块恢复可能未完成的事务。
+// 日志槽的读取与原位置的写回都成批进行，耗时记入 klog
 void recover_log(void)
 {
+    uint64 t0 = get_time();
     read_log_header();
-    install_transaction(1); // recovering=1 表示来自启动恢复
+    int n = g_log.header.n;
+    install_transaction();
     g_log.header.n = 0;
-    write_log_header();
+    g_log.committed = 0;
+    g_log.open_start = 0;
+    g_log.slot_sum = LOG_SUM_INIT;
+    write_log_header(0);
+    if(n > 0)
+        klog_info("log: 恢复 %d 个日志槽，耗时 %u us", n,
+                  (uint)((get_time() - t0) / (TIMEBASE_FREQ / 1000000)));
+}
+
+static void flusher_timer_expired(void *arg)
+{
+    (void)arg;
+    acquire(&g_log.lock);
+    wakeup(&g_log.committed);
+    release(&g_log.lock);
+}
+
+// 让当前事务中已结束的操作得以提交：先置 draining 阻止新操作开始，等进行中的操作结束。
+// 同步模式下由最后一个结束者提交，异步模式下没有人会自行提交，就地提交
+static void drain_locked(void)
+{
+    g_log.draining = 1;
+    while(g_log.outstanding > 0 || g_log.committing || g_log.open_start < g_log.header.n) {
+        if(g_log.outstanding == 0 && !g_log.committing)
+            commit_locked();
+        else
+            sleep(&g_log, &g_log.lock);
+    }
+    g_log.draining = 0;
+}
+
+// 后台 flusher：异步模式下每次醒来先提交累积的事务；再按年龄与日志占用触发检查点，
+// 执行前等当前事务的操作全部结束并提交
+static void log_flusher(void *arg)
+{
+    struct ktimer timer = {0};
+    (void)arg;
+
+    acquire(&g_log.lock);
+    while(!kthread_should_stop()) {
+        ticks_sync();
+        ktimer_add(&timer, ticks + FLUSH_INTERVAL, flusher_timer_expired, 0);
+        sleep(&g_log.committed, &g_log.lock);
+        ktimer_cancel(&timer);
+
+        ticks_sync();
+        if(g_log.async && g_log.open_start < g_log.header.n) {
+            drain_locked();
+            wakeup(&g_log);
+        }
+        if(!checkpoint_ready())
+            continue;
+        if(g_log.committed * 2 < g_log.size && ticks - g_log.dirty_since < FLUSH_AGE)
+            continue;
+
+        drain_locked();
+        if(checkpoint_ready())
+            checkpoint_locked();
+        wakeup(&g_log);
+    }
+    release(&g_log.lock);
+}
+
+// log_start_flusher: 进程子系统就绪后由 main 调用，创建后台写回线程
+void log_start_flusher(void)
+{
+    if(kthread_create(log_flusher, 0, "log_flusher") < 0)
+        panic("log_start_flusher");
 }
 
 // ===================== 内部工具函数 =====================
 
-static void write_log_blocks(void)
+// 日志写入与安装时同时提交给磁盘的块数。各块互不依赖，经块请求队列排序合并后
+// 一并提交再统一等待：日志区的块号连续，通常合并成少数几个多段请求
+#define LOG_IO_BATCH BLK_PLUG_MAX
+
+// 第 i 个日志槽的块号
+#define LOG_SLOT(i) (g_log.start + LOG_HDR_BLOCKS + (i))
+
+// 正在提交的日志缓冲（末尾一项留给头部）与检查点的排序缓冲。
+// 同一时刻至多一个提交或检查点（committing）
+static struct buf *commit_bufs[LOG_MAX];
+static struct buf *commit_data[LOG_MAX];
+static int ckpt_blocks[LOG_MAX];
+
+// 32 位 FNV-1a，按字累加，可在上一次结果的基础上继续
+static uint32 log_sum(uint32 h, const void *data, int len)
 {
-    for(int i = 0; i < g_log.header.n; i++) {
-        // 读取日志数据块
-        struct buf *to = bread(g_log.dev, g_log.start + i + 1);
-        // 读取原始数据块（包含最新修改）
-        struct buf *from = bread(g_log.dev, g_log.header.block[i]);
-        // 复制数据到日志区域
-        memmove(to->data, from->data, BLOCK_SIZE);
-        bwrite(to);  // 写入磁盘日志区域
-        brelse(from);
-        brelse(to);
+    const uint32 *w = data;
+    for(int i = 0; i < len / 4; i++)
+        h = (h ^ w[i]) * 16777619u;
+    return h;
+}
+
+// 头部校验和：从日志槽内容的累计值出发，再覆盖头部的序号、块数与块号数组
+static uint32 header_sum(uint32 slots, const struct log_header *h)
+{
+    uint32 sum = log_sum(slots, &h->seq, sizeof(h->seq));
+    sum = log_sum(sum, &h->n, sizeof(h->n));
+    return log_sum(sum, h->block, h->n * sizeof(h->block[0]));
+}
+
+// 恢复时顺序读日志槽：每读到一批的开头就预读下一批（开头时先预读前两批），
+// 总有一批读请求在途；breadahead 把块号相邻的槽合成多段请求
+static void log_slot_prefetch(int i, int n)
+{
+    uint blocks[LOG_IO_BATCH];
+
+    if(i % LOG_IO_BATCH != 0)
+        return;
+    int from = i == 0 ? 0 : i + LOG_IO_BATCH;
+    for(; from <= i + LOG_IO_BATCH && from < n; from += LOG_IO_BATCH) {
+        int cnt = 0;
+        for(int k = from; k < n && cnt < LOG_IO_BATCH; k++)
+            blocks[cnt++] = LOG_SLOT(k);
+        breadahead(g_log.dev, blocks, cnt);
     }
 }
 
-static void install_transaction(int recovering)
+// 恢复时把日志中已提交的各槽安装到原位置。同一块可能有多个槽，只安装最后一个。
+// 先按目标块号排序（块号相同时槽号大的在前），再按块号递增成批写出，
+// 相邻的目标块合并成多段请求；目标块整块覆盖，不必先读
+static void install_transaction(void)
 {
-    for(int i = 0; i < g_log.header.n; i++) {
-        // 从日志区域读取数据
-        struct buf *log_bp = bread(g_log.dev, g_log.start + i + 1);
-        // 读取目标数据块
-        struct buf *dst_bp = bread(g_log.dev, g_log.header.block[i]);
-        // 将日志数据复制到目标位置
-        memmove(dst_bp->data, log_bp->data, BLOCK_SIZE);
-        bwrite(dst_bp);  // 写入实际数据块
-        
-        if(!recovering)
-            bunpin(dst_bp);  // 正常提交：释放pin
-        
+    int *slots = ckpt_blocks;
+    int n = g_log.header.n;
+    struct buf *dst[LOG_IO_BATCH];
+    struct blk_plug plug;
+    int cnt = 0;
+
+    // 日志很短，插入排序即可
+    for(int i = 0; i < n; i++) {
+        int b = g_log.header.block[i];
+        int j = i - 1;
+        while(j >= 0 && g_log.header.block[slots[j]] >= b) {
+            slots[j + 1] = slots[j];
+            j--;
+        }
+        slots[j + 1] = i;
+    }
+
+    blk_plug_init(&plug, 1);
+    for(int i = 0; i < n; i++) {
+        int slot = slots[i];
+        int home = g_log.header.block[slot];
+        if(i > 0 && g_log.header.block[slots[i - 1]] == home)
+            continue;   // 已安装同一块更晚的槽
+
+        // 槽的内容在校验头部时已读入缓存，这里通常命中
+        struct buf *log_bp = bread(g_log.dev, LOG_SLOT(slot));
+        dst[cnt] = bgetblk(g_log.dev, home);
+        memmove(dst[cnt]->data, log_bp->data, BLOCK_SIZE);
         brelse(log_bp);
-        brelse(dst_bp);
+        blk_plug_add(&plug, dst[cnt]);  // 加入写入实际数据块的队列
+        if(++cnt == LOG_IO_BATCH) {
+            blk_plug_flush(&plug);
+            for(int k = 0; k < cnt; k++) {
+                bwrite_wait(dst[k]);
+                brelse(dst[k]);
+            }
+            cnt = 0;
+        }
+    }
+    blk_plug_flush(&plug);
+    for(int k = 0; k < cnt; k++) {
+        bwrite_wait(dst[k]);
+        brelse(dst[k]);
+    }
+}
+
+// 检查点：把日志中各块在缓存中的最新内容按块号排序、去重后成批写回原位置，
+// 放弃每个槽持有的 pin，最后清空日志头部。调用时没有进行中的事务，
+// 缓存中的内容正是全部已提交修改的结果，无需再从日志区读
+static void checkpoint(void)
+{
+    int *blocks = ckpt_blocks;
+    int n = g_log.header.n;
+    struct buf *dst[LOG_IO_BATCH];
+    struct blk_plug plug;
+
+    // 日志很短，插入排序即可
+    for(int i = 0; i < n; i++) {
+        int b = g_log.header.block[i];
+        int j = i - 1;
+        while(j >= 0 && blocks[j] > b) {
+            blocks[j + 1] = blocks[j];
+            j--;
+        }
+        blocks[j + 1] = b;
+    }
+
+    blk_plug_init(&plug, 1);
+    for(int i = 0; i < n; ) {
+        int cnt = 0;
+        for(; i < n; i++) {
+            if(cnt > 0 && (int)dst[cnt - 1]->blockno == blocks[i]) {
+                bunpin(dst[cnt - 1]);    // 同一块的后续槽：只需放弃其 pin
+                continue;
+            }
+            if(cnt == LOG_IO_BATCH)
+                break;
+            dst[cnt] = bread(g_log.dev, blocks[i]);
+            blk_plug_add(&plug, dst[cnt]);
+            bunpin(dst[cnt]);            // bread 持有的引用保证写完前不会被换出
+            cnt++;
+        }
+        blk_plug_flush(&plug);
+        for(int k = 0; k < cnt; k++) {
+            bwrite_wait(dst[k]);
+            brelse(dst[k]);
+        }
+    }
+
+    g_log.header.n = 0;
+    g_log.slot_sum = LOG_SUM_INIT;
+    // 写入一份序号更大的空头部，表示日志可复用。须在日志槽被新事务覆盖前落盘，
+    // 否则旧头部在其部分槽被覆盖后恢复时会退回更早的那份头部
+    write_log_header(0);
+
+    // 释放块的事务此时才算真正落到原位置上，可以让设备丢弃这些块
+    bdiscard_flush();
+}
+
+// 日志中有已提交的项且没有未提交的项时才能执行检查点（调用者持有 g_log.lock）。
+// 没有进行中的事务却仍有未提交的项，只会出现在 crash_stage 2 模拟的崩溃之后：
+// 此时缓存中含有未提交的修改，必须等 recover_log 丢弃它们
+static int checkpoint_ready(void)
+{
+    return g_log.committed > 0 && g_log.header.n == g_log.committed;
+}
+
+// 调用者持有 g_log.lock，且没有进行中的操作与提交；执行检查点期间阻止新事务开始
+static void checkpoint_locked(void)
+{
+    g_log.committing = 1;
+    g_log.freezing = 1;
+    release(&g_log.lock);
+    checkpoint();
+    pcpu_inc(&checkpoints);
+    acquire(&g_log.lock);
+    g_log.committed = 0;
+    g_log.open_start = 0;
+    g_log.committing = 0;
+    g_log.freezing = 0;
+    wakeup(&g_log);
+}
+
+// 校验一份磁盘头部：魔数、块数与校验和都正确时返回 1。需要读出它描述的全部日志槽
+static int log_header_valid(const struct log_header *h)
+{
+    if(h->magic != LOG_MAGIC || h->n < 0 || h->n > g_log.nslots)
+        return 0;
+    uint32 sum = LOG_SUM_INIT;
+    for(int i = 0; i < h->n; i++) {
+        log_slot_prefetch(i, h->n);
+        struct buf *bp = bread(g_log.dev, LOG_SLOT(i));
+        sum = log_sum(sum, bp->data, BLOCK_SIZE);
+        brelse(bp);
     }
+    return header_sum(sum, h) == h->sum;
 }
 
+// 读入两份头部，取校验通过且序号最大的一份；都无效时日志视为空
 static void read_log_header(void)
 {
-    struct buf *bp = bread(g_log.dev, g_log.start);
-    struct log_header *disk_header = (struct log_header *)bp->data;
-    g_log.header.n = disk_header->n;
-    if(g_log.header.n < 0 || g_log.header.n > LOG_SIZE)
-        panic("read_log_header: invalid n");
+    static struct log_header disk[LOG_HDR_BLOCKS];
+    int best = -1;
+
+    g_log.header.n = 0;
+    g_log.hdr_seq = 0;
+    for(int i = 0; i < LOG_HDR_BLOCKS; i++) {
+        struct buf *bp = bread(g_log.dev, g_log.start + i);
+        memmove(&disk[i], bp->data, sizeof(disk[i]));
+        brelse(bp);
+        // 新头部的序号大于磁盘上出现过的任何序号，包括校验失败的
+        if(disk[i].magic == LOG_MAGIC && disk[i].seq > g_log.hdr_seq)
+            g_log.hdr_seq = disk[i].seq;
+    }
+    for(int i = 0; i < LOG_HDR_BLOCKS; i++) {
+        if(best >= 0 && disk[i].seq <= disk[best].seq)
+            continue;
+        if(log_header_valid(&disk[i]))
+            best = i;
+    }
+    if(best < 0)
+        return;
+    g_log.header.n = disk[best].n;
     for(int i = 0; i < g_log.header.n; i++)
-        g_log.header.block[i] = disk_header->block[i];
-    brelse(bp);
+        g_log.header.block[i] = disk[best].block[i];
 }
 
-static void write_log_header(void)
+// 在下一个头部块中填好描述前 n 个槽的新头部并返回（持有睡眠锁），由调用者写出。
+// slot_sum 此时须恰好覆盖前 n 个槽
+static struct buf *fill_log_header(int n)
 {
-    struct buf *bp = bread(g_log.dev, g_log.start);
+    g_log.hdr_seq++;
+    struct buf *bp = bgetblk(g_log.dev, g_log.start + g_log.hdr_seq % LOG_HDR_BLOCKS);
     struct log_header *disk_header = (struct log_header *)bp->data;
-    // 同步内存日志头到磁盘
-    disk_header->n = g_log.header.n;
-    for(int i = 0; i < g_log.header.n; i++)
+    memset(bp->data, 0, BLOCK_SIZE);
+    disk_header->seq = g_log.hdr_seq;
+    disk_header->magic = LOG_MAGIC;
+    disk_header->n = n;
+    for(int i = 0; i < n; i++)
         disk_header->block[i] = g_log.header.block[i];
+    disk_header->sum = header_sum(g_log.slot_sum, disk_header);
+    return bp;
+}
+
+// 同步写出描述前 n 个槽的新头部。n 之后的槽属于正在累积的事务，不写入
+static void write_log_header(int n)
+{
+    struct buf *bp = fill_log_header(n);
     bwrite(bp);
     brelse(bp);
 }
 
-static void commit_transaction(void)
+// 提交当前事务，调用者持有 g_log.lock，且事务中没有进行中的操作、没有在途的提交。
+// 先阻止新事务开始并把各槽的块内容复制进日志缓冲、与新头部一起提交写请求，随后放开，
+// 下一个事务即可在后面的槽中累积；再等待这批写入完成。返回时仍持有锁。
+// 事务带有数据块（顺序数据模式）时，数据块与日志槽一同下发，头部等数据块落盘后再下发
+static void commit_locked(void)
 {
-    if(g_log.header.n == 0)
-        return; // 没有实际修改需要提交
+    uint64 seq = g_log.open_seq;
+    int start = g_log.open_start;
+    int end = g_log.header.n;
+    int ndata = g_log.ndata;
+    struct blk_plug plug;
 
-    write_log_blocks();       // 先把修改写入日志区
-    if(crash_stage == 2) {
-        // 模拟在事务提交前崩溃：日志尚未写入磁盘，数据丢失
+    g_log.open_seq++;
+    g_log.open_start = end;
+    memmove(commit_data, g_log.data, ndata * sizeof(commit_data[0]));
+    g_log.ndata = 0;
+    if(start == end && ndata == 0) {
+        g_log.done_seq = seq;      // 没有实际修改需要提交
+        wakeup(&g_log);
         return;
     }
-    write_log_header();       // 将头部写回磁盘，标记为已提交
-    
-    if(crash_stage == 1) {
-        // 模拟在日志写入后、安装前崩溃：日志已写入但未安装到原位置
-        return;
+    g_log.committing = 1;
+    g_log.freezing = 1;
+    release(&g_log.lock);
+    uint64 t0 = get_time();
+
+    // 数据块已钉在缓存中，bread 只是取得睡眠锁；表中持有的 pin 由这次 bread 的引用接替
+    blk_plug_init(&plug, 1);
+    for(int i = 0; i < ndata; i++) {
+        struct buf *b = bread(g_log.dev, commit_data[i]->blockno);
+        bunpin(b);
+        commit_data[i] = b;
+        blk_plug_add(&plug, b);
     }
 
-    install_transaction(0);   // 将日志内容复制回原数据块
-    g_log.header.n = 0;
-    write_log_header();       // 清空头部，表示日志可复用
+    // 日志槽随后整块覆盖，不必先从磁盘读入
+    int nbufs = 0;
+    for(int i = start; i < end; i++) {
+        struct buf *to = bgetblk(g_log.dev, LOG_SLOT(i));
+        // 读取原始数据块（包含最新修改）
+        struct buf *from = bread(g_log.dev, g_log.header.block[i]);
+        memmove(to->data, from->data, BLOCK_SIZE);
+        brelse(from);
+        g_log.slot_sum = log_sum(g_log.slot_sum, to->data, BLOCK_SIZE);
+        commit_bufs[nbufs++] = to;
+        blk_plug_add(&plug, to);   // 队列满时自动提交已积累的请求
+    }
+    // crash_stage 2 模拟在事务提交前崩溃：日志头部未写入，数据丢失。
+    // 否则头部与日志槽一同下发，全部落盘即完成提交；原位置的写回留给检查点，
+    // crash_stage 1（日志已写入、未安装）因此正是提交后的常态
+    if(crash_stage != 2 && start < end && ndata == 0) {
+        commit_bufs[nbufs] = fill_log_header(end);
+        blk_plug_add(&plug, commit_bufs[nbufs++]);
+    }
+    blk_plug_flush(&plug);
+
+    acquire(&g_log.lock);
+    g_log.freezing = 0;
+    wakeup(&g_log);                // 内容已复制，下一个事务可以开始累积
+    release(&g_log.lock);
+
+    for(int i = 0; i < ndata; i++) {
+        bwrite_wait(commit_data[i]);
+        brelse(commit_data[i]);
+    }
+    // 头部描述的前 end 个槽在提交期间不会改变，放开 freezing 后填写也安全
+    if(crash_stage != 2 && start < end && ndata > 0) {
+        commit_bufs[nbufs] = fill_log_header(end);
+        bwrite_submit(commit_bufs[nbufs++]);
+    }
+    for(int i = 0; i < nbufs; i++) {
+        bwrite_wait(commit_bufs[i]);
+        brelse(commit_bufs[i]);
+    }
+    pcpu_hist_add(&commit_blocks, nbufs + ndata);
+    pcpu_hist_add(&commit_time, get_time() - t0);
+
+    acquire(&g_log.lock);
+    if(crash_stage != 2) {
+        if(g_log.committed == 0) {
+            ticks_sync();
+            g_log.dirty_since = ticks;
+        }
+        g_log.committed = end;
+        g_log.disk_seq = seq;
+    }
+    g_log.done_seq = seq;
+    g_log.committing = 0;
+    wakeup(&g_log);
+    if(g_log.committed * 2 >= g_log.size)
+        wakeup(&g_log.committed);  // 日志占用过半：让 flusher 尽快执行检查点
 }
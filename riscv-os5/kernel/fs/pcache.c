@@ -0,0 +1,285 @@
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "pcache.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "string.h"
+#include "printf.h"
+#include "meminfo.h"
+
+// pcache.c 实现普通文件的页缓存。块缓存（bio.c）按磁盘块号缓存，服务于元数据与日志；
+// 文件数据的读取命中这里时既不经 bmap 翻译，也不占用块缓存。缺页由 fs.c 通过 bmap 与
+// bread 填充（读完即让出块缓存中的副本），写入由 writei 在写日志块之后直写已缓存的页。
+// 换出采用 LRU，只换出没有使用者的页；容量按启动时的空闲内存确定，内存紧张时由
+// kalloc 的回收路径收缩。
+//
+// 锁：pcache.lock 保护散列链、LRU 链表与各页的 ref/dead。页数据本身由所属 inode 的
+// 睡眠锁保护（填充、读取与直写都在 ilock 下进行），拷贝期间页以 ref 钉住，不持有自旋锁。
+// 持有 pcache.lock 时不分配内存，回收路径因此可以直接获取它。
+
+#define PCACHE_HASH 257
+#define PCACHE_RAM_SHIFT 3    // 至多使用空闲内存的 1/8
+#define PCACHE_MIN 64
+
+static struct {
+    struct spinlock lock;
+    struct kmem_cache *cache;          // struct cpage 的对象缓存
+    struct cpage *hash[PCACHE_HASH];
+    struct cpage *lru_head;            // 最近使用
+    struct cpage *lru_tail;            // 最久未用，换出从这里开始
+    int npages;                        // 散列表中的页数
+    int maxpages;
+} pcache;
+
+static inline uint32 pcache_hash(uint32 dev, uint32 inum, uint32 lblk)
+{
+    return ((dev * 0x9e3779b1u) ^ (inum * 0x85ebca6bu) ^ lblk) % PCACHE_HASH;
+}
+
+void pcache_init(void)
+{
+    struct meminfo mi;
+
+    initlock(&pcache.lock, "pcache");
+    pcache.cache = kmem_cache_create("cpage", sizeof(struct cpage), 0);
+    if(pcache.cache == 0)
+        panic("pcache_init: kmem_cache_create");
+    pmm_meminfo(&mi);
+    pcache.maxpages = mi.free_pages >> PCACHE_RAM_SHIFT;
+    if(pcache.maxpages < PCACHE_MIN)
+        pcache.maxpages = PCACHE_MIN;
+}
+
+static void lru_unlink(struct cpage *cp)
+{
+    if(cp->lru_prev)
+        cp->lru_prev->lru_next = cp->lru_next;
+    else
+        pcache.lru_head = cp->lru_next;
+    if(cp->lru_next)
+        cp->lru_next->lru_prev = cp->lru_prev;
+    else
+        pcache.lru_tail = cp->lru_prev;
+    cp->lru_prev = cp->lru_next = 0;
+}
+
+static void lru_push(struct cpage *cp)
+{
+    cp->lru_prev = 0;
+    cp->lru_next = pcache.lru_head;
+    if(pcache.lru_head)
+        pcache.lru_head->lru_prev = cp;
+    else
+        pcache.lru_tail = cp;
+    pcache.lru_head = cp;
+}
+
+// 在持有锁的前提下查找，不改变引用
+static struct cpage *find_locked(uint32 dev, uint32 inum, uint32 lblk)
+{
+    struct cpage *cp;
+    for(cp = pcache.hash[pcache_hash(dev, inum, lblk)]; cp; cp = cp->hnext) {
+        if(cp->dev == dev && cp->inum == inum && cp->lblk == lblk)
+            break;
+    }
+    return cp;
+}
+
+// 把 cp 摘出散列表与 LRU 链表：没有使用者时返回 1，由调用者在锁外释放；
+// 否则标记为失效，由最后一个使用者释放
+static int remove_locked(struct cpage *cp)
+{
+    for(struct cpage **pp = &pcache.hash[pcache_hash(cp->dev, cp->inum, cp->lblk)]; *pp; pp = &(*pp)->hnext) {
+        if(*pp == cp) {
+            *pp = cp->hnext;
+            break;
+        }
+    }
+    lru_unlink(cp);
+    pcache.npages--;
+    cp->dead = 1;
+    return cp->ref == 0;
+}
+
+static void cpage_free(struct cpage *cp)
+{
+    free_page(cp->data);
+    kmem_cache_free(pcache.cache, cp);
+}
+
+// pcache_lookup: 命中时钉住并返回缓存页，调用者用完后调用 pcache_put
+struct cpage *pcache_lookup(uint32 dev, uint32 inum, uint32 lblk)
+{
+    acquire(&pcache.lock);
+    struct cpage *cp = find_locked(dev, inum, lblk);
+    if(cp) {
+        cp->ref++;
+        lru_unlink(cp);
+        lru_push(cp);
+    }
+    release(&pcache.lock);
+    return cp;
+}
+
+// pcache_alloc: 为未命中的块准备一个尚未插入的页（已钉住），内容由调用者填充后
+// 经 pcache_insert 发布。内存不足时返回 0，调用者退回不经页缓存的路径
+struct cpage *pcache_alloc(uint32 dev, uint32 inum, uint32 lblk)
+{
+    struct cpage *cp = kmem_cache_alloc(pcache.cache);
+    if(cp == 0)
+        return 0;
+    if((cp->data = alloc_page_nozero()) == 0) {
+        kmem_cache_free(pcache.cache, cp);
+        return 0;
+    }
+    cp->dev = dev;
+    cp->inum = inum;
+    cp->lblk = lblk;
+    cp->ref = 1;
+    cp->dead = 0;
+    cp->hnext = 0;
+    cp->lru_prev = cp->lru_next = 0;
+    return cp;
+}
+
+// pcache_insert: 发布填充好的页并返回调用者应使用的页（仍钉住），容量已满时先换出
+// 最久未用且没有使用者的页。共享持有 inode 锁的读者可能同时填充同一块：
+// 后发布的一方放弃自己的页，改用已发布的那一页
+struct cpage *pcache_insert(struct cpage *cp)
+{
+    struct cpage *victim = 0;
+
+    acquire(&pcache.lock);
+    struct cpage *old = find_locked(cp->dev, cp->inum, cp->lblk);
+    if(old) {
+        old->ref++;
+        lru_unlink(old);
+        lru_push(old);
+        release(&pcache.lock);
+        cpage_free(cp);
+        return old;
+    }
+    if(pcache.npages >= pcache.maxpages) {
+        for(struct cpage *v = pcache.lru_tail; v; v = v->lru_prev) {
+            if(v->ref == 0) {
+                remove_locked(v);
+                victim = v;
+                break;
+            }
+        }
+    }
+    uint32 h = pcache_hash(cp->dev, cp->inum, cp->lblk);
+    cp->hnext = pcache.hash[h];
+    pcache.hash[h] = cp;
+    lru_push(cp);
+    pcache.npages++;
+    release(&pcache.lock);
+
+    if(victim)
+        cpage_free(victim);
+    return cp;
+}
+
+// pcache_put: 放弃 pcache_lookup/pcache_alloc 取得的引用
+void pcache_put(struct cpage *cp)
+{
+    acquire(&pcache.lock);
+    int last = --cp->ref == 0 && cp->dead;
+    release(&pcache.lock);
+    if(last)
+        cpage_free(cp);
+}
+
+// pcache_update: 写入后直写：块已缓存时用 data 中的整块新内容覆盖。调用者持有 inode 锁
+void pcache_update(uint32 dev, uint32 inum, uint32 lblk, const char *data)
+{
+    struct cpage *cp = pcache_lookup(dev, inum, lblk);
+    if(cp == 0)
+        return;
+    memmove(cp->data, data, BLOCK_SIZE);
+    pcache_put(cp);
+}
+
+// pcache_present: 块是否已缓存，供预读跳过无需读盘的块
+int pcache_present(uint32 dev, uint32 inum, uint32 lblk)
+{
+    acquire(&pcache.lock);
+    int r = find_locked(dev, inum, lblk) != 0;
+    release(&pcache.lock);
+    return r;
+}
+
+// 摘下满足条件的页并释放没有使用者的那些。inum 为 0 表示全部
+static void drop_matching(uint32 dev, uint32 inum)
+{
+    struct cpage *freelist = 0;
+
+    acquire(&pcache.lock);
+    for(int h = 0; h < PCACHE_HASH; h++) {
+        struct cpage *cp = pcache.hash[h];
+        while(cp) {
+            struct cpage *next = cp->hnext;
+            if(inum == 0 || (cp->dev == dev && cp->inum == inum)) {
+                if(remove_locked(cp)) {
+                    cp->hnext = freelist;
+                    freelist = cp;
+                }
+            }
+            cp = next;
+        }
+    }
+    release(&pcache.lock);
+
+    while(freelist) {
+        struct cpage *next = freelist->hnext;
+        cpage_free(freelist);
+        freelist = next;
+    }
+}
+
+// pcache_invalidate: 文件被截断或释放时丢弃它的全部缓存页。截断并不频繁，直接扫描整个散列表
+void pcache_invalidate(uint32 dev, uint32 inum)
+{
+    acquire(&pcache.lock);
+    int empty = pcache.npages == 0;
+    release(&pcache.lock);
+    if(!empty)
+        drop_matching(dev, inum);
+}
+
+// pcache_clear: 丢弃全部缓存页，随 clear_cache 一起模拟崩溃，使之后的读取反映磁盘与日志的状态
+void pcache_clear(void)
+{
+    drop_matching(0, 0);
+}
+
+// pcache_reclaim: 内存紧张时由 kalloc 调用，从 LRU 尾部释放至多 target 个没有使用者的页
+int pcache_reclaim(int target)
+{
+    struct cpage *freelist = 0;
+    int freed = 0;
+
+    acquire(&pcache.lock);
+    struct cpage *cp = pcache.lru_tail;
+    while(cp && freed < target) {
+        struct cpage *prev = cp->lru_prev;
+        // 同时被 mmap 映射的页释放后仍不归还，留给 mmap_reclaim
+        if(cp->ref == 0 && page_refcount(cp->data) == 1) {
+            remove_locked(cp);
+            cp->hnext = freelist;
+            freelist = cp;
+            freed++;
+        }
+        cp = prev;
+    }
+    release(&pcache.lock);
+
+    while(freelist) {
+        struct cpage *next = freelist->hnext;
+        cpage_free(freelist);
+        freelist = next;
+    }
+    return freed;
+}
@@ -0,0 +1,267 @@
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "pipe.h"
+#include "proc.h"
+#include "vm.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "printf.h"
+#include "string.h"
+#include "poll.h"
+#include "pollwait.h"
+
+// pipe.c 实现匿名管道：一页大小的环形缓冲区，读写两端各自以睡眠锁串行化。
+// 写者只向 [nwrite, nread + PIPESIZE) 写入，读者只从 [nread, nwrite) 读出，
+// 两段互不重叠，因此数据可以在不持自旋锁的情况下整段 copyin/copyout
+// （拷贝期间可能缺页睡眠），自旋锁只保护下标与两端的打开状态。
+// 读者在 &nread 上等待数据，写者在 &nwrite 上等待空间，唤醒只遍历对应通道的睡眠桶。
+// 两端的 poll 调用者共用 pollq，下标或打开状态变化时在自旋锁内通知。
+
+struct pipe {
+    struct spinlock lock;     // 保护 nread/nwrite/readopen/writeopen
+    struct sleeplock rlock;   // 串行化读者，一次 read 读出的数据连续
+    struct sleeplock wlock;   // 串行化写者，一次 write 的数据不与其他写者交错
+    char *data;               // PIPESIZE 字节的环形缓冲区（一页）
+    uint32 nread;             // 已读出的字节总数
+    uint32 nwrite;            // 已写入的字节总数
+    int readopen;             // 读端是否仍有打开的文件
+    int writeopen;            // 写端是否仍有打开的文件
+    struct pollq pollq;       // 两端 poll 调用者的等待队列
+};
+
+static struct kmem_cache *pipe_cache;
+
+// pipeinit: 创建 struct pipe 的对象缓存
+void pipeinit(void)
+{
+    pipe_cache = kmem_cache_create("pipe", sizeof(struct pipe), 0);
+    if(pipe_cache == 0)
+        panic("pipeinit: kmem_cache_create");
+}
+
+// pipealloc: 创建管道并分配读写两端的文件对象，失败时返回 -1 且不留下任何分配
+int pipealloc(struct file **rf, struct file **wf)
+{
+    struct pipe *pi = 0;
+
+    *rf = *wf = 0;
+    if((pi = kmem_cache_alloc(pipe_cache)) == 0)
+        return -1;
+    if((pi->data = alloc_page_nozero()) == 0)
+        goto bad;
+    if((*rf = filealloc()) == 0 || (*wf = filealloc()) == 0)
+        goto bad;
+
+    initlock(&pi->lock, "pipe");
+    initsleeplock(&pi->rlock, "pipe_r");
+    initsleeplock(&pi->wlock, "pipe_w");
+    pi->nread = 0;
+    pi->nwrite = 0;
+    pi->readopen = 1;
+    pi->writeopen = 1;
+    pi->pollq.head = 0;
+
+    (*rf)->type = FD_PIPE;
+    (*rf)->readable = 1;
+    (*rf)->pipe = pi;
+    (*wf)->type = FD_PIPE;
+    (*wf)->writable = 1;
+    (*wf)->pipe = pi;
+    return 0;
+
+bad:
+    if(pi->data)
+        free_page(pi->data);
+    kmem_cache_free(pipe_cache, pi);
+    if(*rf)
+        fileclose(*rf);
+    if(*wf)
+        fileclose(*wf);
+    *rf = *wf = 0;
+    return -1;
+}
+
+// pipeclose: 关闭管道的一端并唤醒另一端的等待者，两端都关闭后释放管道
+void pipeclose(struct pipe *pi, int writable)
+{
+    acquire(&pi->lock);
+    if(writable) {
+        pi->writeopen = 0;
+        wakeup(&pi->nread);
+    } else {
+        pi->readopen = 0;
+        wakeup(&pi->nwrite);
+    }
+    poll_notify(&pi->pollq);
+    if(pi->readopen || pi->writeopen) {
+        release(&pi->lock);
+        return;
+    }
+    release(&pi->lock);
+    free_page(pi->data);
+    kmem_cache_free(pipe_cache, pi);
+}
+
+// pipe_wait_space: 等待缓冲区至少有一个空闲字节，返回可连续写入的字节数（至多 n），
+// 读端已全部关闭或进程被杀死时返回 -1。调用者持有写锁
+static int pipe_wait_space(struct pipe *pi, int n)
+{
+    struct proc *p = myproc();
+
+    acquire(&pi->lock);
+    while(pi->nwrite == pi->nread + PIPESIZE) {
+        if(pi->readopen == 0 || killed(p)) {
+            release(&pi->lock);
+            return -1;
+        }
+        sleep(&pi->nwrite, &pi->lock);
+    }
+    if(pi->readopen == 0) {
+        release(&pi->lock);
+        return -1;
+    }
+    uint32 space = pi->nread + PIPESIZE - pi->nwrite;
+    release(&pi->lock);
+
+    // 只写到环尾，绕回部分留给下一轮
+    uint32 tail = PIPESIZE - pi->nwrite % PIPESIZE;
+    if(space > tail)
+        space = tail;
+    return n < (int)space ? n : (int)space;
+}
+
+// pipe_publish: 发布写入的 m 个字节并唤醒读者
+static void pipe_publish(struct pipe *pi, int m)
+{
+    acquire(&pi->lock);
+    pi->nwrite += m;
+    wakeup(&pi->nread);
+    poll_notify(&pi->pollq);
+    release(&pi->lock);
+}
+
+// pipewrite: 把缓冲区 addr 处的 n 个字节写入管道，空间不足时等待读者取走数据。
+// user_src 为 1 时 addr 是用户地址，否则为内核地址（sendfile 的中转缓冲区）。
+// 返回写入的字节数；一个字节都未写入时读端已关闭或进程被杀死则返回 -1
+int pipewrite(struct pipe *pi, int user_src, uint64 addr, int n)
+{
+    struct proc *p = myproc();
+    int done = 0;
+
+    acquiresleep(&pi->wlock);
+    while(done < n) {
+        int m = pipe_wait_space(pi, n - done);
+        if(m < 0)
+            break;
+        char *dst = pi->data + pi->nwrite % PIPESIZE;
+        if(!user_src)
+            memmove(dst, (char *)addr + done, m);
+        else if(copyin(p->pagetable, dst, addr + done, m) < 0)
+            break;
+        pipe_publish(pi, m);
+        done += m;
+    }
+    releasesleep(&pi->wlock);
+    return done > 0 || n == 0 ? done : -1;
+}
+
+// pipe_splice: 从普通文件 in 的当前偏移读取至多 n 个字节，直接经 readi 写入管道环，
+// 不经用户缓冲区中转。返回搬运的字节数，到达文件末尾时返回 0，出错返回 -1
+int pipe_splice(struct pipe *pi, struct file *in, int n)
+{
+    int done = 0;
+
+    acquiresleep(&pi->wlock);
+    while(done < n) {
+        int m = pipe_wait_space(pi, n - done);
+        if(m < 0)
+            break;
+        ilock(in->ip);
+        int r = readi(in->ip, 0, (uint64)(pi->data + pi->nwrite % PIPESIZE), in->off, m);
+        if(r > 0)
+            in->off += r;
+        iunlock(in->ip);
+        if(r <= 0) {
+            if(r < 0 && done == 0)
+                done = -1;
+            break;
+        }
+        pipe_publish(pi, r);
+        done += r;
+        if(r < m)
+            break;   // 文件已读完
+    }
+    releasesleep(&pi->wlock);
+    return done;
+}
+
+// piperead: 从管道读出至多 n 个字节到缓冲区 addr（user_dst 含义同 pipewrite）。缓冲区为空时等待，
+// 只要读到数据就返回，不凑满 n；写端已全部关闭且无数据时返回 0（文件结束）
+int piperead(struct pipe *pi, int user_dst, uint64 addr, int n)
+{
+    struct proc *p = myproc();
+    int done = 0;
+
+    acquiresleep(&pi->rlock);
+    acquire(&pi->lock);
+    while(pi->nread == pi->nwrite && pi->writeopen) {
+        if(killed(p)) {
+            release(&pi->lock);
+            releasesleep(&pi->rlock);
+            return -1;
+        }
+        sleep(&pi->nread, &pi->lock);
+    }
+    uint32 avail = pi->nwrite - pi->nread;
+    release(&pi->lock);
+
+    // 有效数据至多分为环尾与环头两段，各用一次 copyout
+    while(done < n && avail > 0) {
+        uint32 m = PIPESIZE - pi->nread % PIPESIZE;
+        if(m > avail)
+            m = avail;
+        if(m > (uint32)(n - done))
+            m = n - done;
+        char *src = pi->data + pi->nread % PIPESIZE;
+        if(!user_dst)
+            memmove((char *)addr + done, src, m);
+        else if(copyout(p->pagetable, addr + done, src, m) < 0)
+            break;
+        acquire(&pi->lock);
+        pi->nread += m;
+        wakeup(&pi->nwrite);
+        poll_notify(&pi->pollq);
+        release(&pi->lock);
+        done += m;
+        avail -= m;
+    }
+    releasesleep(&pi->rlock);
+    return done > 0 || n == 0 ? done : (avail ? -1 : 0);
+}
+
+// pipepoll: 读端有数据时可读，写端全部关闭时报告 POLLHUP（此后 read 返回 0）；
+// 写端有空闲空间时可写，读端全部关闭时报告 POLLERR
+int pipepoll(struct pipe *pi, int writable, struct poll_table *pt)
+{
+    int mask = 0;
+
+    poll_wait(&pi->pollq, pt);
+    acquire(&pi->lock);
+    if(writable) {
+        if(pi->readopen == 0)
+            mask |= POLLERR;
+        else if(pi->nwrite != pi->nread + PIPESIZE)
+            mask |= POLLOUT;
+    } else {
+        if(pi->nread != pi->nwrite)
+            mask |= POLLIN;
+        if(pi->writeopen == 0)
+            mask |= POLLHUP;
+    }
+    release(&pi->lock);
+    return mask;
+}
@@ -0,0 +1,171 @@
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "file.h"
+#include "proc.h"
+#include "vm.h"
+#include "kalloc.h"
+#include "trap.h"
+#include "hrtimer.h"
+#include "poll.h"
+#include "pollwait.h"
+
+// poll.c 实现 poll 系统调用。全部等待队列与 poll_table 的 ready/expired 共用一把
+// poll_lock：对象在自身锁内修改状态后调用 poll_notify，而 poll 总是先登记到队列、
+// 再取对象锁检查状态，因此两者之间的唤醒不会丢失。没有人登记的队列在
+// poll_notify 中只读一次队头，不取 poll_lock，管道读写的常规路径几乎没有额外开销。
+
+static struct spinlock poll_lock;
+
+// 一次 poll 调用的全部状态放在一页中，内核栈上只留 poll_table
+struct poll_frame {
+  struct pollfd fds[NPOLLFD];
+  struct file *files[NPOLLFD];
+  struct poll_entry entries[NPOLLFD];
+};
+
+void pollinit(void)
+{
+  initlock(&poll_lock, "poll");
+}
+
+void poll_wait(struct pollq *q, struct poll_table *pt)
+{
+  if(pt == 0 || pt->nentries == pt->max)
+    return;
+  struct poll_entry *e = &pt->entries[pt->nentries++];
+  e->pt = pt;
+  acquire(&poll_lock);
+  e->next = q->head;
+  if(q->head)
+    q->head->pprev = &e->next;
+  q->head = e;
+  e->pprev = &q->head;
+  release(&poll_lock);
+}
+
+void poll_notify(struct pollq *q)
+{
+  // 登记发生在检查对象状态之前，调用者又持有对象锁，这里读到空队头说明
+  // 此后登记的调用者必然能看到本次状态变化
+  if(q->head == 0)
+    return;
+  acquire(&poll_lock);
+  for(struct poll_entry *e = q->head; e; e = e->next) {
+    e->pt->ready = 1;
+    wakeup(e->pt);
+  }
+  release(&poll_lock);
+}
+
+// 从各对象的队列上摘除 pt 的全部登记项
+static void poll_unregister(struct poll_table *pt)
+{
+  acquire(&poll_lock);
+  for(int i = 0; i < pt->nentries; i++) {
+    struct poll_entry *e = &pt->entries[i];
+    *e->pprev = e->next;
+    if(e->next)
+      e->next->pprev = e->pprev;
+  }
+  pt->nentries = 0;
+  release(&poll_lock);
+}
+
+static void poll_timer_expired(void *arg)
+{
+  struct poll_table *pt = arg;
+
+  acquire(&poll_lock);
+  pt->expired = 1;
+  wakeup(pt);
+  release(&poll_lock);
+}
+
+// 检查全部描述符并填写 revents，返回就绪的描述符个数
+static int poll_scan(struct poll_frame *fr, int nfds, struct poll_table *pt)
+{
+  int nready = 0;
+
+  for(int i = 0; i < nfds; i++) {
+    struct pollfd *pfd = &fr->fds[i];
+    if(pfd->fd < 0)
+      pfd->revents = 0;
+    else if(fr->files[i] == 0)
+      pfd->revents = POLLNVAL;
+    else
+      pfd->revents = filepoll(fr->files[i], pt) & (pfd->events | POLLERR | POLLHUP);
+    if(pfd->revents)
+      nready++;
+  }
+  return nready;
+}
+
+// do_poll: 等待 ufds 中的 nfds 个描述符之一就绪，timeout_us 为最长等待的微秒数（hrtimer 计时），
+// 0 表示只检查一次，负数表示一直等待。返回就绪的描述符个数（超时为 0），
+// 参数非法或进程被杀死时返回 -1
+int do_poll(uint64 ufds, int nfds, long timeout_us)
+{
+  struct proc *p = myproc();
+  struct poll_frame *fr;
+  int nready;
+
+  if(nfds < 0 || nfds > NPOLLFD)
+    return -1;
+  if((fr = alloc_page_nozero()) == 0)
+    return -1;
+  if(copyin(p->pagetable, (char *)fr->fds, ufds, nfds * sizeof(struct pollfd)) < 0) {
+    free_page(fr);
+    return -1;
+  }
+  // 持有引用，等待期间其他线程关闭描述符也不会释放文件与管道
+  for(int i = 0; i < nfds; i++) {
+    fr->files[i] = fr->fds[i].fd >= 0 ? fd_get_ref(p->fdt, fr->fds[i].fd) : 0;
+  }
+
+  struct poll_table pt = { .entries = fr->entries, .max = NPOLLFD };
+  struct poll_table *reg = &pt;     // 只在首轮检查时登记
+  struct hrtimer timer = {0};
+
+  if(timeout_us > 0)
+    hrtimer_start(&timer, get_time() + us_to_time(timeout_us), poll_timer_expired, &pt);
+
+  for(;;) {
+    acquire(&poll_lock);
+    pt.ready = 0;
+    int expired = pt.expired;
+    release(&poll_lock);
+
+    nready = poll_scan(fr, nfds, reg);
+    reg = 0;
+    if(nready > 0 || timeout_us == 0 || expired)
+      break;
+
+    acquire(&poll_lock);
+    while(!pt.ready && !pt.expired && !killed(p))
+      sleep(&pt, &poll_lock);
+    release(&poll_lock);
+    if(killed(p)) {
+      nready = -1;
+      break;
+    }
+  }
+
+  // 定时器已被摘下时回调可能仍在其他 hart 上执行，等它置位 expired 后 pt 才能出栈
+  if(timeout_us > 0 && !hrtimer_cancel(&timer)) {
+    acquire(&poll_lock);
+    while(!pt.expired)
+      sleep(&pt, &poll_lock);
+    release(&poll_lock);
+  }
+  poll_unregister(&pt);
+
+  if(nready >= 0 && copyout(p->pagetable, ufds, (char *)fr->fds, nfds * sizeof(struct pollfd)) < 0)
+    nready = -1;
+  for(int i = 0; i < nfds; i++) {
+    if(fr->files[i])
+      fileclose(fr->files[i]);
+  }
+  free_page(fr);
+  return nready;
+}
@@ -0,0 +1,59 @@
+#include "types.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "sleeplock.h"
+#include "buf.h"
+#include "blkdev.h"
+#include "string.h"
+#include "printf.h"
+
+// ramdisk.c：以一段物理内存作为根设备。启动前 QEMU 的 loader 设备把 fs.img 原样装入
+// RAMDISK_BASE（位于内核管理的内存 PHYSTOP 之上，见 Makefile 的 RAMDISK 选项），
+// 读写即整块 memmove，在提交时同步完成，因此 wait 无事可做。
+// 用于在没有磁盘模拟与中断开销的情况下测量文件系统自身（bmap、目录查找、日志）的 CPU 代价。
+// 同一块的读写由缓存块的睡眠锁串行化，不同块互不重叠，驱动本身不需要锁
+
+#if RAMDISK
+
+static void ramdisk_submit(struct buf **bs, int n, int write, void (*done)(struct buf *))
+{
+    for(int i = 0; i < n; i++){
+        struct buf *b = bs[i];
+        if(b->blockno >= RAMDISK_BLOCKS)
+            panic("ramdisk: block out of range");
+        char *blk = (char *)RAMDISK_BASE + (uint64)b->blockno * BLOCK_SIZE;
+        if(write)
+            memmove(blk, b->data, BLOCK_SIZE);
+        else
+            memmove(b->data, blk, BLOCK_SIZE);
+        b->disk = 0;
+        if(done)
+            done(b);
+    }
+}
+
+static void ramdisk_wait(struct buf *b)
+{
+    (void)b;
+}
+
+static const struct blkdev ramdisk = {
+    .name = "ramdisk",
+    .submit = ramdisk_submit,
+    .wait = ramdisk_wait,
+};
+
+void ramdisk_init(void)
+{
+    blkdev_register(ROOTDEV, &ramdisk);
+    printf("ramdisk: 根设备使用内存盘 [%p, %p)，%d 块\n", (void *)RAMDISK_BASE,
+           (void *)(RAMDISK_BASE + RAMDISK_SIZE), RAMDISK_BLOCKS);
+}
+
+#else
+
+void ramdisk_init(void)
+{
+}
+
+#endif
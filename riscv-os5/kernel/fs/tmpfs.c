@@ -0,0 +1,280 @@
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "proc.h"
+#include "vm.h"
+#include "kalloc.h"
+#include "string.h"
+#include "printf.h"
+#include "klog.h"
+#include "radix.h"
+
+// tmpfs.c 实现只存在于内存中的文件系统，挂载在 /tmp（见 fs.c 的 namex_from）。
+// 每个 inode 的内容是一组按需分配的物理页，按页号挂在基数树上；目录的内容同样是
+// struct dirent 数组，因此 sys_unlink 等按偏移改写目录项的代码无需区分文件系统。
+// 修改不经日志、块缓存与磁盘，重启后全部丢失。
+// tnode 的内容由对应内存 inode 的睡眠锁保护（同一 inode 号只有一个内存 inode）；
+// tmpfs.lock 只保护 tnode 槽位的分配与释放。
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define TMPFS_NINODE 256                            // inode 个数上限（含 0 号不用的槽）
+#define TMPFS_MAX_SIZE (1UL << 30)                  // 单个文件的大小上限，实际受物理内存限制
+#define DIR_NOFREE 0xffffffffu                      // 目录中没有空闲槽
+
+struct tnode {
+    short type;          // 0 表示空闲
+    short major;
+    short minor;
+    short nlink;
+    uint32 size;
+    struct radix_tree pages;   // 页号 -> 数据页，空洞不在树中
+};
+
+static struct {
+    struct spinlock lock;
+    struct tnode node[TMPFS_NINODE];
+} tmpfs;
+
+static struct tnode *tnode(struct inode *ip)
+{
+    return &tmpfs.node[ip->inum];
+}
+
+// 取得第 pn 页，alloc 为 1 时按需分配数据页（新页为全零）。不存在或内存不足时返回 0
+static char *tnode_page(struct tnode *t, uint32 pn, int alloc)
+{
+    char *page = radix_lookup(&t->pages, pn);
+    if(page || !alloc)
+        return page;
+    if((page = alloc_page()) == 0)
+        return 0;
+    if(radix_insert(&t->pages, pn, page) < 0) {
+        free_page(page);
+        return 0;
+    }
+    return page;
+}
+
+static void tnode_free_page(uint64 pn, void *page)
+{
+    (void)pn;
+    free_page(page);
+}
+
+// 比较目录项名称，至多 DIRSIZ 个字符
+static int namecmp(const char *s, const char *t)
+{
+    for(int i = 0; i < DIRSIZ; i++) {
+        if(s[i] != t[i])
+            return (unsigned char)s[i] - (unsigned char)t[i];
+        if(s[i] == '\0')
+            return 0;
+    }
+    return 0;
+}
+
+static void tmpfs_load(struct inode *ip)
+{
+    struct tnode *t = tnode(ip);
+    ip->type = t->type;
+    ip->major = t->major;
+    ip->minor = t->minor;
+    ip->nlink = t->nlink;
+    ip->size = t->size;
+    ip->flags = 0;
+}
+
+static void tmpfs_update(struct inode *ip)
+{
+    struct tnode *t = tnode(ip);
+    t->type = ip->type;
+    t->major = ip->major;
+    t->minor = ip->minor;
+    t->nlink = ip->nlink;
+    t->size = ip->size;
+}
+
+static void tmpfs_trunc(struct inode *ip, int split)
+{
+    (void)split;   // 不经日志
+    radix_clear(&tnode(ip)->pages, tnode_free_page);
+    ip->size = 0;
+    tmpfs_update(ip);
+}
+
+static void tmpfs_free(struct inode *ip)
+{
+    ip->type = 0;
+    acquire(&tmpfs.lock);
+    tnode(ip)->type = 0;
+    release(&tmpfs.lock);
+}
+
+static int tmpfs_read(struct inode *ip, int user_dst, uint64 dst, uint32 off, uint32 n)
+{
+    struct tnode *t = tnode(ip);
+    static const char zero_page[PGSIZE];
+
+    if(off + n > ip->size)
+        n = ip->size - off;
+    for(uint32 tot = 0; tot < n; ) {
+        uint32 pn = (off + tot) / PGSIZE;
+        uint32 poff = (off + tot) % PGSIZE;
+        uint32 m = MIN(n - tot, PGSIZE - poff);
+        char *page = tnode_page(t, pn, 0);
+        const char *from = page ? page + poff : zero_page;   // 空洞读出全零
+        if(user_dst) {
+            if(copyout(myproc()->pagetable, dst + tot, from, m) < 0)
+                return -1;
+        } else {
+            memmove((char *)dst + tot, from, m);
+        }
+        tot += m;
+    }
+    return n;
+}
+
+// 页分配失败或用户地址无效时返回已写入的字节数（一个字节都没写入时为 -1），与磁盘文件系统的短写语义一致
+static int tmpfs_write(struct inode *ip, int user_src, uint64 src, uint32 off, uint32 n)
+{
+    struct tnode *t = tnode(ip);
+    uint32 tot = 0;
+
+    if((uint64)off + n > TMPFS_MAX_SIZE)
+        return -1;
+    while(tot < n) {
+        uint32 pn = (off + tot) / PGSIZE;
+        uint32 poff = (off + tot) % PGSIZE;
+        uint32 m = MIN(n - tot, PGSIZE - poff);
+        char *page = tnode_page(t, pn, 1);
+        if(page == 0)
+            break;
+        if(user_src) {
+            if(copyin(myproc()->pagetable, page + poff, src + tot, m) < 0)
+                break;
+        } else {
+            memmove(page + poff, (char *)src + tot, m);
+        }
+        tot += m;
+    }
+    if(off + tot > ip->size)
+        ip->size = off + tot;
+    tmpfs_update(ip);
+    if(tot < n)
+        return tot ? (int)tot : -1;
+    return n;
+}
+
+// 逐项扫描目录，name 非空时查找该名称并返回 inode 号；*pfree 记录第一个空闲槽
+static uint32 tmpfs_dirscan(struct inode *dp, const char *name, uint32 *poff, uint32 *pfree)
+{
+    struct tnode *t = tnode(dp);
+
+    for(uint32 off = 0; off < dp->size; off += sizeof(struct dirent)) {
+        char *page = tnode_page(t, off / PGSIZE, 0);
+        struct dirent *de = page ? (struct dirent *)(page + off % PGSIZE) : 0;
+        if(de == 0 || de->inum == 0) {
+            if(pfree && *pfree == DIR_NOFREE)
+                *pfree = off;
+            continue;
+        }
+        if(name && namecmp(name, de->name) == 0) {
+            if(poff)
+                *poff = off;
+            return de->inum;
+        }
+    }
+    return 0;
+}
+
+static struct inode *tmpfs_lookup(struct inode *dp, char *name, uint32 *poff)
+{
+    uint32 inum = tmpfs_dirscan(dp, name, poff, 0);
+    return inum ? iget(TMPDEV, inum) : 0;
+}
+
+static int tmpfs_link(struct inode *dp, char *name, uint32 inum)
+{
+    struct dirent de;
+    uint32 free = DIR_NOFREE;
+
+    if(tmpfs_dirscan(dp, name, 0, &free))
+        return -1;
+    memset(&de, 0, sizeof(de));
+    de.inum = inum;
+    for(int i = 0; i < DIRSIZ - 1 && name[i]; i++)
+        de.name[i] = name[i];
+    uint32 off = free != DIR_NOFREE ? free : dp->size;
+    if(tmpfs_write(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        return -1;
+    return 0;
+}
+
+static int tmpfs_empty(struct inode *dp)
+{
+    struct tnode *t = tnode(dp);
+
+    for(uint32 off = 0; off < dp->size; off += sizeof(struct dirent)) {
+        char *page = tnode_page(t, off / PGSIZE, 0);
+        struct dirent *de = page ? (struct dirent *)(page + off % PGSIZE) : 0;
+        if(de == 0 || de->inum == 0)
+            continue;
+        if(namecmp(de->name, ".") != 0 && namecmp(de->name, "..") != 0)
+            return 0;
+    }
+    return 1;
+}
+
+const struct inode_ops tmpfs_ops = {
+    .logged = 0,
+    .load = tmpfs_load,
+    .update = tmpfs_update,
+    .trunc = tmpfs_trunc,
+    .free = tmpfs_free,
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .lookup = tmpfs_lookup,
+    .link = tmpfs_link,
+    .empty = tmpfs_empty,
+};
+
+// tmpfs_ialloc: 取一个空闲 tnode 并返回其内存 inode（未加锁），inode 用尽时返回 0
+struct inode *tmpfs_ialloc(short type)
+{
+    acquire(&tmpfs.lock);
+    for(uint32 inum = ROOTINO + 1; inum < TMPFS_NINODE; inum++) {
+        struct tnode *t = &tmpfs.node[inum];
+        if(t->type != 0)
+            continue;
+        memset(t, 0, sizeof(*t));
+        t->type = type;
+        release(&tmpfs.lock);
+
+        struct inode *ip = iget(TMPDEV, inum);
+        ip->type = type;
+        ip->nlink = 0;
+        ip->size = 0;
+        ip->flags = 0;
+        return ip;
+    }
+    release(&tmpfs.lock);
+    return 0;
+}
+
+// tmpfs_init: 建立根目录，其 ".." 指向自身，越过挂载点由路径解析处理
+void tmpfs_init(void)
+{
+    initlock(&tmpfs.lock, "tmpfs");
+    tmpfs.node[ROOTINO].type = T_DIR;
+    tmpfs.node[ROOTINO].nlink = 1;
+
+    struct inode *root = iget(TMPDEV, ROOTINO);
+    ilock(root);
+    if(tmpfs_link(root, ".", ROOTINO) < 0 || tmpfs_link(root, "..", ROOTINO) < 0)
+        panic("tmpfs_init");
+    iunlockput(root);
+    klog_info("tmpfs: 挂载于 /%s，至多 %d 个 inode", TMPFS_MOUNT, TMPFS_NINODE - 1);
+}
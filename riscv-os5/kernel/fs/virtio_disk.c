@@ -7,117 +7,300 @@
 #include "virtio.h"
 #include "kalloc.h"
 #include "riscv.h"
+#include "proc.h"
+#include "plic.h"
+#include "atomic.h"
+#include "blkdev.h"
 
 // VirtIO 磁盘驱动：通过 virtio-mmio 接口与 QEMU 提供的块设备通信。
-// 实现思路与 xv6 一致，但精简为忙等轮询模式，便于在尚未接入中断控制器时使用。
+// 实现思路与 xv6 一致：请求提交后调用者在缓存块上睡眠，设备完成时经 PLIC 触发中断，
+// 由 virtio_disk_intr 回收已用环并唤醒对应的缓存块持有者。
+// 调度器启动前（如 fs_init 读超级块、恢复日志）没有可睡眠的进程，此时退化为轮询已用环。
+// virtio_disk_submit 只提交不等待，调用者可一次提交多个请求再逐个等待，队列深度取决于描述符数。
+//
+// 设备支持 VIRTIO_BLK_F_MQ 时每个 hart 使用自己的虚拟队列（队列数少于 hart 数时按编号取模共用），
+// 各队列有独立的描述符表、空闲标记、请求信息与锁，提交路径上各 hart 互不争抢。
+// virtio-mmio 只有一根中断线，完成中断由 PLIC 投递到的 hart 依次回收各队列。
+//
+// 协商到 VIRTIO_RING_F_EVENT_IDX 时两个方向都按事件索引抑制通知：设备在 avail_event 中
+// 写明希望在哪个可用环下标之后被通知，仍在处理前面的请求时提交无需写 QUEUE_NOTIFY；
+// 驱动在 used_event 中要求攒够 VIRTIO_IRQ_BATCH 个完成、或在途请求全部完成时才发中断。
+//
+// 协商到 VIRTIO_BLK_F_DISCARD 时向块设备层提供 discard：文件系统在释放块的事务落盘后
+// 把合并好的区间交给设备，镜像文件（或宿主机上的 SSD）可以回收这些块占用的空间。
 
 // 定义 VirtIO MMIO 寄存器访问宏：将寄存器偏移映射到 VIRTIO0 基地址
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
-// 全局磁盘数据结构
-struct {
+// 一个虚拟队列
+struct virtq {
     struct virtq_desc *desc;          // DMA 描述符表：定义数据传输的缓冲区
     struct virtq_avail *avail;        // 可用环：驱动向设备提交请求的队列
     struct virtq_used *used;          // 已用环：设备完成请求后的返回队列
     struct spinlock lock;             // 保护上述结构及 free/used_idx 的自旋锁
+    int id;                           // 队列编号，通知设备时写入 QUEUE_NOTIFY
     char free[VIRTIO_RING_NUM];       // 描述符空闲标记：1=空闲，0=使用中
     uint16 used_idx;                  // 我们已处理到的 used->idx 下标（驱动视角）
+    int inflight;                     // 已提交尚未回收的请求数
     struct {
-        struct buf *b;                // 回写时需要唤醒的缓存块指针
+        struct buf *b[VIRTIO_MAX_SEGS]; // 请求覆盖的缓存块（块号连续），完成时逐个唤醒
+        int nseg;                     // b[] 中的块数，0 表示描述符不是在途请求的头部
+        void (*done)(struct buf *);   // 完成回调（可为 0），之后总会唤醒在缓存块上睡眠的等待者
         char status;                  // 设备写入的完成状态：0=成功，其他=错误
     } info[VIRTIO_RING_NUM];          // 每个描述符的附加信息
     struct virtio_blk_req ops[VIRTIO_RING_NUM]; // 请求头数组，每个描述符独占一个
+};
+
+// 全局磁盘数据结构
+struct {
+    int nqueue;                       // 实际启用的队列数，1 ~ VIRTIO_MAX_QUEUES
+    int event_idx;                    // 是否协商到 VIRTIO_RING_F_EVENT_IDX
+    int discard;                      // 是否协商到 VIRTIO_BLK_F_DISCARD
+    uint32 max_discard_sectors;       // 单段至多丢弃的扇区数
+    uint32 max_discard_seg;           // 单个丢弃请求至多携带的段数
+    struct virtq q[VIRTIO_MAX_QUEUES];
 } disk;
 
+static void disk_reap(struct virtq *q);
+static void virtq_push(struct virtq *q, int head);
+static void virtio_disk_discard(const struct blk_range *r, int n);
+
+// 当前 hart 提交请求使用的队列
+static struct virtq *my_queue(void)
+{
+    push_off();
+    int id = cpuid() % disk.nqueue;
+    pop_off();
+    return &disk.q[id];
+}
+
 // 分配一个空闲描述符
-static int alloc_desc(void)
+static int alloc_desc(struct virtq *q)
 {
     // 线性扫描查找第一个空闲描述符
     for(int i = 0; i < VIRTIO_RING_NUM; i++){
-        if(disk.free[i]){
-            disk.free[i] = 0;  // 标记为使用中
-            return i;          // 返回描述符索引
+        if(q->free[i]){
+            q->free[i] = 0;  // 标记为使用中
+            return i;        // 返回描述符索引
         }
     }
     return -1;  // 无空闲描述符
 }
 
 // 释放单个描述符
-static void free_desc(int i)
+static void free_desc(struct virtq *q, int i)
 {
     // 参数检查
     if(i < 0 || i >= VIRTIO_RING_NUM)
         panic("virtio: free_desc index");
-    if(disk.free[i])
+    if(q->free[i])
         panic("virtio: free_desc double");
 
     // 清空描述符内容
-    disk.desc[i].addr = 0;
-    disk.desc[i].len = 0;
-    disk.desc[i].flags = 0;
-    disk.desc[i].next = 0;
-    disk.free[i] = 1;  // 标记为空闲
+    q->desc[i].addr = 0;
+    q->desc[i].len = 0;
+    q->desc[i].flags = 0;
+    q->desc[i].next = 0;
+    q->free[i] = 1;  // 标记为空闲
 }
 
 // 释放描述符链（处理链式描述符）
-static void free_chain(int i)
+static void free_chain(struct virtq *q, int i)
 {
     while(1){
-        int flag = disk.desc[i].flags;  // 获取当前描述符标志
-        int next = disk.desc[i].next;   // 获取下一个描述符索引
-        free_desc(i);                   // 释放当前描述符
-        if(flag & VRING_DESC_F_NEXT)    // 检查是否有后续描述符
-            i = next;                   // 继续释放下一个
+        int flag = q->desc[i].flags;  // 获取当前描述符标志
+        int next = q->desc[i].next;   // 获取下一个描述符索引
+        free_desc(q, i);              // 释放当前描述符
+        if(flag & VRING_DESC_F_NEXT)  // 检查是否有后续描述符
+            i = next;                 // 继续释放下一个
         else
-            break;                      // 链结束
+            break;                    // 链结束
     }
+    wakeup(&q->free[0]);              // 唤醒等待描述符的请求者
 }
 
-// 分配3个连续描述符（用于一个完整的块请求）
-static int alloc3_desc(int *idx)
+// 分配 n 个描述符（用于一个完整的块请求）
+static int alloc_descs(struct virtq *q, int *idx, int n)
 {
-    for(int i = 0; i < 3; i++){
-        idx[i] = alloc_desc();          // 分配描述符
+    for(int i = 0; i < n; i++){
+        idx[i] = alloc_desc(q);       // 分配描述符
         if(idx[i] < 0){
             // 分配失败，回滚已分配的描述符
             for(int j = 0; j < i; j++)
-                free_desc(idx[j]);
+                free_desc(q, idx[j]);
             return -1;
         }
     }
-    return 0;  // 成功分配3个描述符
+    return 0;  // 成功分配 n 个描述符
+}
+
+// 分配 n 个描述符，用尽时睡眠等待在途请求完成后释放（无进程上下文时直接回收）。调用者持有 q->lock
+static void alloc_descs_wait(struct virtq *q, int *idx, int n)
+{
+    while(alloc_descs(q, idx, n) < 0){
+        if(myproc())
+            sleep(&q->free[0], &q->lock);
+        else
+            disk_reap(q);
+    }
+}
+
+// 处理已用环中的新完成项：清除缓存块的 disk 标记并唤醒等待者。
+// 多个请求可同时在途，设备不保证按提交顺序完成，因此按已用环中的 id 逐个处理
+static void disk_reap_ring(struct virtq *q)
+{
+    while(q->used_idx != *(volatile uint16 *)&q->used->idx){
+        smp_rmb();             // 先读到 used->idx，再读设备随之写好的已用环项与状态
+        int id = q->used->ring[q->used_idx % VIRTIO_RING_NUM].id;
+
+        // 检查操作状态
+        if(q->info[id].status != 0)
+            panic("virtio: io error");  // I/O操作失败
+
+        int nseg = q->info[id].nseg;
+        void (*done)(struct buf *) = q->info[id].done;
+        if(nseg == 0)
+            panic("virtio: unexpected completion");
+        q->info[id].nseg = 0;
+        q->info[id].done = 0;
+        q->used_idx += 1;      // 更新已处理索引
+        q->inflight--;
+        free_chain(q, id);     // 描述符随完成立即回收，供后续请求使用
+        for(int i = 0; i < nseg; i++){
+            struct buf *b = q->info[id].b[i];
+            b->disk = 0;       // 请求完成，缓存块可以交还给调用者
+            if(done)
+                done(b);
+            wakeup(b);
+        }
+    }
+}
+
+// 事件索引的判定（virtio 规范 2.7.10）：下标从 old 推进到 new 时是否越过了对方要求的 event
+static int need_event(uint16 event, uint16 new, uint16 old)
+{
+    return (uint16)(new - event - 1) < (uint16)(new - old);
+}
+
+// 要求设备再完成 min(在途请求数, VIRTIO_IRQ_BATCH) 个请求后才发中断
+static void arm_used_event(struct virtq *q)
+{
+    int k = q->inflight < VIRTIO_IRQ_BATCH ? q->inflight : VIRTIO_IRQ_BATCH;
+    if(k < 1)
+        k = 1;
+    q->avail->used_event = q->used_idx + k - 1;
+}
+
+// 回收队列中设备已完成的请求，调用者持有 q->lock。启用事件索引时随后重设 used_event；
+// 设备可能在新值生效前就已越过它，这样的完成不会再触发中断，所以设置后要再检查一次已用环
+static void disk_reap(struct virtq *q)
+{
+    for(;;){
+        disk_reap_ring(q);
+        if(!disk.event_idx)
+            return;
+        arm_used_event(q);
+        smp_mb();
+        if(q->used_idx == *(volatile uint16 *)&q->used->idx)
+            return;
+    }
+}
+
+// 等待请求完成：有当前进程时睡眠等待中断，否则轮询已用环。调用者持有 q->lock
+static void wait_for_completion(struct virtq *q, struct buf *b)
+{
+    while(b->disk){
+        if(myproc())
+            sleep(b, &q->lock);
+        else
+            disk_reap(q);
+    }
+}
+
+// 设备中断处理：应答中断后回收各队列已完成的请求。
+// 没有新完成项的队列只读一次 used->idx，不取它的锁
+void virtio_disk_intr(void)
+{
+    // 应答后设备才会为之后完成的请求再次发出中断；
+    // 应答与读取 used->idx 之间完成的请求会在本次一并回收
+    *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+
+    for(int i = 0; i < disk.nqueue; i++){
+        struct virtq *q = &disk.q[i];
+        if(q->used_idx == *(volatile uint16 *)&q->used->idx)
+            continue;
+        acquire(&q->lock);
+        disk_reap(q);
+        release(&q->lock);
+    }
 }
 
-// 等待请求完成（轮询模式）
-static void wait_for_completion(int head_idx)
+// 配置并启用第 id 个虚拟队列
+static void virtq_init(struct virtq *q, int id)
 {
-    // 忙等待：直到设备处理了我们的请求
-    while(disk.used_idx == disk.used->idx)
-        __sync_synchronize();  // 内存屏障，确保读取最新的 used->idx
-    
-    __sync_synchronize();      // 再次内存屏障
-
-    // 获取已完成的请求ID
-    int id = disk.used->ring[disk.used_idx % VIRTIO_RING_NUM].id;
-    if(id != head_idx)
-        panic("virtio: unexpected completion");  // 完成顺序错误
-
-    // 检查操作状态
-    if(disk.info[id].status != 0)
-        panic("virtio: io error");  // I/O操作失败
-
-    // 清理完成信息
-    disk.info[id].b = 0;
-    disk.used_idx += 1;  // 更新已处理索引
+    initlock(&q->lock, "virtio_disk");
+    q->id = id;
+
+    *R(VIRTIO_MMIO_QUEUE_SEL) = id;
+
+    if(*R(VIRTIO_MMIO_QUEUE_READY))
+        panic("virtio: queue in use");  // 队列已就绪，不应发生
+
+    // 检查队列大小
+    uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+    if(max == 0)
+        panic("virtio: no queue");
+    if(max < VIRTIO_RING_NUM)
+        panic("virtio: queue too short");
+
+    // 分配虚拟队列内存（DMA区域）：描述符表、可用环、已用环各占一页，从 CMA 区取连续的三页，
+    // 没有预留 CMA 区时退回伙伴系统。两者返回的页都已清零
+    char *ring = cma_alloc(3);
+    if(ring == 0)
+        ring = alloc_pages(3);
+    if(ring == 0)
+        panic("virtio: alloc ring");
+    q->desc = (struct virtq_desc *)ring;                    // 描述符表
+    q->avail = (struct virtq_avail *)(ring + PGSIZE);       // 可用环
+    q->used = (struct virtq_used *)(ring + 2 * PGSIZE);     // 已用环
+
+    // 设置队列大小
+    *R(VIRTIO_MMIO_QUEUE_NUM) = VIRTIO_RING_NUM;
+
+    // 配置DMA地址（将虚拟队列地址告知设备）
+    uint64 desc_pa = (uint64)q->desc;
+    uint64 avail_pa = (uint64)q->avail;
+    uint64 used_pa = (uint64)q->used;
+    *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint32)desc_pa;
+    *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint32)(desc_pa >> 32);
+    *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint32)avail_pa;
+    *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint32)(avail_pa >> 32);
+    *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint32)used_pa;
+    *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint32)(used_pa >> 32);
+
+    // 激活队列
+    *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
+
+    // 初始化描述符状态
+    for(int i = 0; i < VIRTIO_RING_NUM; i++)
+        q->free[i] = 1;  // 所有描述符初始为空闲
+    q->used_idx = 0;     // 已用环处理索引初始为0
+    q->inflight = 0;
 }
 
+// 根设备的驱动，提交与等待即下面的 virtio_disk_submit_segs/virtio_disk_wait；
+// 设备支持丢弃时初始化过程再填上 discard
+static struct blkdev virtio_blk = {
+    .name = "virtio-blk",
+    .submit = virtio_disk_submit_segs,
+    .wait = virtio_disk_wait,
+};
+
 // VirtIO 磁盘初始化
 void virtio_disk_init(void)
 {
     uint32 status = 0;
 
-    initlock(&disk.lock, "virtio_disk");  // 初始化自旋锁
-
     // 读取设备标识寄存器
     uint32 magic = *R(VIRTIO_MMIO_MAGIC_VALUE);
     uint32 version = *R(VIRTIO_MMIO_VERSION);
@@ -150,11 +333,11 @@ void virtio_disk_init(void)
     features &= ~(1 << VIRTIO_BLK_F_RO);           // 只读
     features &= ~(1 << VIRTIO_BLK_F_SCSI);         // SCSI命令
     features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);   // 写回缓存配置
-    features &= ~(1 << VIRTIO_BLK_F_MQ);           // 多队列
     features &= ~(1 << VIRTIO_F_ANY_LAYOUT);       // 任意布局
-    features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);   // 事件索引
     features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC); // 间接描述符
     *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;    // 设置驱动支持的特性
+    disk.event_idx = (features & (1 << VIRTIO_RING_F_EVENT_IDX)) != 0;
+    disk.discard = (features & (1 << VIRTIO_BLK_F_DISCARD)) != 0;
 
     status |= VIRTIO_CONFIG_S_FEATURES_OK;         // 特性协商完成
     *R(VIRTIO_MMIO_STATUS) = status;
@@ -164,113 +347,230 @@ void virtio_disk_init(void)
     if(!(status & VIRTIO_CONFIG_S_FEATURES_OK))
         panic("virtio: FEATURES_OK not set");
 
-    // 配置队列0
-    *R(VIRTIO_MMIO_QUEUE_SEL) = 0;  // 选择队列0
-
-    if(*R(VIRTIO_MMIO_QUEUE_READY))
-        panic("virtio: queue in use");  // 队列已就绪，不应发生
-
-    // 检查队列大小
-    uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
-    if(max == 0)
-        panic("virtio: no queue 0");
-    if(max < VIRTIO_RING_NUM)
-        panic("virtio: queue too short");
-
-    // 分配虚拟队列内存（DMA区域）
-    disk.desc = (struct virtq_desc *)alloc_page();   // 描述符表
-    disk.avail = (struct virtq_avail *)alloc_page(); // 可用环
-    disk.used = (struct virtq_used *)alloc_page();   // 已用环
-    if(!disk.desc || !disk.avail || !disk.used)
-        panic("virtio: alloc ring");
-    
-    // 清零分配的内存
-    memset(disk.desc, 0, PGSIZE);
-    memset(disk.avail, 0, PGSIZE);
-    memset(disk.used, 0, PGSIZE);
-
-    // 设置队列大小
-    *R(VIRTIO_MMIO_QUEUE_NUM) = VIRTIO_RING_NUM;
-
-    // 配置DMA地址（将虚拟队列地址告知设备）
-    uint64 desc_pa = (uint64)disk.desc;
-    uint64 avail_pa = (uint64)disk.avail;
-    uint64 used_pa = (uint64)disk.used;
-    *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint32)desc_pa;
-    *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint32)(desc_pa >> 32);
-    *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint32)avail_pa;
-    *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint32)(avail_pa >> 32);
-    *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint32)used_pa;
-    *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint32)(used_pa >> 32);
-
-    // 激活队列
-    *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
-
-    // 初始化描述符状态
-    for(int i = 0; i < VIRTIO_RING_NUM; i++)
-        disk.free[i] = 1;  // 所有描述符初始为空闲
-    disk.used_idx = 0;     // 已用环处理索引初始为0
+    // 多队列：设备在配置空间报告可用的队列数，每个 hart 至多用一个
+    int nq = 1;
+    if(features & (1 << VIRTIO_BLK_F_MQ))
+        nq = *(volatile uint16 *)(VIRTIO0 + VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CFG_NUM_QUEUES);
+    if(nq > NCPU)
+        nq = NCPU;
+    if(nq > VIRTIO_MAX_QUEUES)
+        nq = VIRTIO_MAX_QUEUES;
+    if(nq < 1)
+        nq = 1;
+    for(int i = 0; i < nq; i++)
+        virtq_init(&disk.q[i], i);
+    disk.nqueue = nq;
+
+    if(disk.discard){
+        disk.max_discard_sectors = *(volatile uint32 *)(VIRTIO0 + VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CFG_MAX_DISCARD_SECTORS);
+        disk.max_discard_seg = *(volatile uint32 *)(VIRTIO0 + VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CFG_MAX_DISCARD_SEG);
+        // 单段不足一块时无法按块丢弃，放弃这一特性
+        if(disk.max_discard_sectors < BLOCK_SIZE / 512 || disk.max_discard_seg == 0)
+            disk.discard = 0;
+        else
+            virtio_blk.discard = virtio_disk_discard;
+    }
 
     // 驱动完全就绪
     status |= VIRTIO_CONFIG_S_DRIVER_OK;
     *R(VIRTIO_MMIO_STATUS) = status;
+
+    printf("virtio: 启用 %d 个请求队列（设备%s多队列，%s事件索引，%s丢弃）\n", nq,
+           (features & (1 << VIRTIO_BLK_F_MQ)) ? "支持" : "不支持",
+           disk.event_idx ? "启用" : "未启用",
+           disk.discard ? "支持" : "不支持");
+    plic_register(VIRTIO0_IRQ, "virtio-disk", virtio_disk_intr, 1);
+    blkdev_register(ROOTDEV, &virtio_blk);
 }
 
-// VirtIO 磁盘读写操作
-void virtio_disk_rw(struct buf *b, int write)
+// 异步提交一次读写：描述符填好并通知设备后立即返回，不等待完成。
+// 请求完成时在中断中清除 b->disk；done 非 0 时随后调用 done(b)（持有队列锁，不得睡眠），
+// 再唤醒在 virtio_disk_wait 中等待的进程。调用者在完成前须持有 b 的睡眠锁且不得修改 b->data。
+// 多个请求可同时在途，设备可按任意顺序完成
+void virtio_disk_submit(struct buf *b, int write, void (*done)(struct buf *))
+{
+    virtio_disk_submit_segs(&b, 1, write, done);
+}
+
+// 把块号连续的 n 个缓存块（按块号递增排列，n 不超过 VIRTIO_MAX_SEGS）合成一个请求：
+// 一个请求头、n 个数据描述符与一个状态描述符，设备一次完成整段传输。语义同 virtio_disk_submit
+void virtio_disk_submit_segs(struct buf **bs, int n, int write, void (*done)(struct buf *))
 {
+    if(n < 1 || n > VIRTIO_MAX_SEGS)
+        panic("virtio: bad segment count");
+    for(int i = 1; i < n; i++)
+        if(bs[i]->dev != bs[0]->dev || bs[i]->blockno != bs[0]->blockno + i)
+            panic("virtio: segments not contiguous");
+
     // 计算磁盘扇区号（块设备以512字节扇区为单位）
-    uint64 sector = ((uint64)b->blockno) * (BLOCK_SIZE / 512);
+    uint64 sector = ((uint64)bs[0]->blockno) * (BLOCK_SIZE / 512);
 
-    acquire(&disk.lock);  // 获取磁盘锁
-    
-    // 分配3个描述符：请求头 + 数据缓冲区 + 状态区
-    int idx[3];
-    while(alloc3_desc(idx) < 0)
-        ;  // 忙等待直到分配到描述符
+    struct virtq *q = my_queue();
+    acquire(&q->lock);    // 获取本队列的锁
+
+    // 分配描述符：请求头 + n 个数据缓冲区 + 状态区
+    int idx[VIRTIO_MAX_SEGS + 2];
+    int ndesc = n + 2;
+    alloc_descs_wait(q, idx, ndesc);
 
     // 设置请求头（描述符0）
-    struct virtio_blk_req *req = &disk.ops[idx[0]];
+    struct virtio_blk_req *req = &q->ops[idx[0]];
     req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;  // 操作类型
     req->reserved = 0;
     req->sector = sector;  // 目标扇区
 
     // 配置描述符0：指向请求头
-    disk.desc[idx[0]].addr = (uint64)req;
-    disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-    disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;  // 有下一个描述符
-    disk.desc[idx[0]].next = idx[1];              // 下一个是数据描述符
-
-    // 配置描述符1：指向数据缓冲区
-    disk.desc[idx[1]].addr = (uint64)b->data;
-    disk.desc[idx[1]].len = BLOCK_SIZE;
-    // 设置标志：写操作不需要WRITE（设备→内存），读操作需要WRITE（内存←设备）
-    disk.desc[idx[1]].flags = write ? 0 : VRING_DESC_F_WRITE;
-    disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;  // 有下一个描述符
-    disk.desc[idx[1]].next = idx[2];               // 下一个是状态描述符
-
-    // 配置描述符2：指向状态字节
-    disk.info[idx[0]].status = 0xff;  // 初始状态（非0表示未完成）
-    disk.desc[idx[2]].addr = (uint64)&disk.info[idx[0]].status;
-    disk.desc[idx[2]].len = 1;
-    disk.desc[idx[2]].flags = VRING_DESC_F_WRITE;  // 设备写入状态
-    disk.desc[idx[2]].next = 0;                    // 链结束
+    q->desc[idx[0]].addr = (uint64)req;
+    q->desc[idx[0]].len = sizeof(struct virtio_blk_req);
+    q->desc[idx[0]].flags = VRING_DESC_F_NEXT;  // 有下一个描述符
+    q->desc[idx[0]].next = idx[1];              // 下一个是数据描述符
+
+    // 配置数据描述符：依次指向各缓存块
+    for(int i = 0; i < n; i++){
+        int d = idx[i + 1];
+        q->desc[d].addr = (uint64)bs[i]->data;
+        q->desc[d].len = BLOCK_SIZE;
+        // 设置标志：写操作不需要WRITE（设备→内存），读操作需要WRITE（内存←设备）
+        q->desc[d].flags = write ? 0 : VRING_DESC_F_WRITE;
+        q->desc[d].flags |= VRING_DESC_F_NEXT;  // 有下一个描述符
+        q->desc[d].next = idx[i + 2];
+    }
+
+    // 配置最后一个描述符：指向状态字节
+    int st = idx[ndesc - 1];
+    q->info[idx[0]].status = 0xff;  // 初始状态（非0表示未完成）
+    q->desc[st].addr = (uint64)&q->info[idx[0]].status;
+    q->desc[st].len = 1;
+    q->desc[st].flags = VRING_DESC_F_WRITE;  // 设备写入状态
+    q->desc[st].next = 0;                    // 链结束
 
     // 记录缓冲区信息（用于完成时唤醒）
-    disk.info[idx[0]].b = b;
+    for(int i = 0; i < n; i++){
+        bs[i]->disk = 1;
+        bs[i]->vq = q->id;
+        q->info[idx[0]].b[i] = bs[i];
+    }
+    q->info[idx[0]].nseg = n;
+    q->info[idx[0]].done = done;
 
-    // 将请求提交到可用环
-    disk.avail->ring[disk.avail->idx % VIRTIO_RING_NUM] = idx[0];  // 放入可用环
-    __sync_synchronize();  // 内存屏障，确保描述符设置对设备可见
-    disk.avail->idx += 1;  // 更新可用环索引
-    __sync_synchronize();  // 再次内存屏障
-    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0;  // 通知设备有新请求
+    virtq_push(q, idx[0]);
+    release(&q->lock);    // 释放队列锁
+}
 
-    // 等待请求完成
-    wait_for_completion(idx[0]);
+// 把以 head 开头的描述符链放入可用环，按需通知设备。调用者持有 q->lock
+static void virtq_push(struct virtq *q, int head)
+{
+    q->avail->ring[q->avail->idx % VIRTIO_RING_NUM] = head;  // 放入可用环
+    q->inflight++;
+    if(disk.event_idx)
+        disk_reap(q);      // 按新的在途请求数重设 used_event，顺带回收已完成的请求
+    smp_wmb();             // 描述符与可用环项须先于新的 avail->idx 对设备可见
+    uint16 old = q->avail->idx;
+    q->avail->idx = old + 1;  // 更新可用环索引
+
+    // 设备还没处理到它要求被通知的位置时会继续自己取新请求，无需通知
+    int kick = 1;
+    if(disk.event_idx){
+        smp_mb();          // 先写出 avail->idx，再读设备写的 avail_event
+        kick = need_event(*(volatile uint16 *)&q->used->avail_event, old + 1, old);
+    }
+    if(kick){
+        io_wmb();          // 可用环索引须先于通知寄存器的写入
+        *R(VIRTIO_MMIO_QUEUE_NOTIFY) = q->id;  // 通知设备该队列有新请求
+    }
+}
 
-    // 释放描述符链
-    free_chain(idx[0]);
+// 等待 virtio_disk_submit（done 为 0）提交的请求完成
+void virtio_disk_wait(struct buf *b)
+{
+    struct virtq *q = &disk.q[b->vq];   // 提交后可能已迁移到其他 hart，按提交时的队列等待
+    acquire(&q->lock);
+    wait_for_completion(q, b);
+    release(&q->lock);
+}
+
+// 同步读写：提交后等待完成
+void virtio_disk_rw(struct buf *b, int write)
+{
+    virtio_disk_submit(b, write, 0);
+    virtio_disk_wait(b);
+}
+// 提交一个携带 nseg 段的丢弃请求并等待完成。请求不对应任何缓存块，
+// 用栈上的 token 充当完成标记与睡眠通道
+static void disk_discard_submit(struct virtio_blk_discard *seg, int nseg)
+{
+    struct buf token;
+    memset(&token, 0, sizeof(token));
+
+    struct virtq *q = my_queue();
+    acquire(&q->lock);
+
+    // 请求头 + 段数组 + 状态区
+    int idx[3];
+    alloc_descs_wait(q, idx, 3);
+
+    struct virtio_blk_req *req = &q->ops[idx[0]];
+    req->type = VIRTIO_BLK_T_DISCARD;
+    req->reserved = 0;
+    req->sector = 0;
+    q->desc[idx[0]].addr = (uint64)req;
+    q->desc[idx[0]].len = sizeof(struct virtio_blk_req);
+    q->desc[idx[0]].flags = VRING_DESC_F_NEXT;
+    q->desc[idx[0]].next = idx[1];
+
+    q->desc[idx[1]].addr = (uint64)seg;
+    q->desc[idx[1]].len = nseg * sizeof(struct virtio_blk_discard);
+    q->desc[idx[1]].flags = VRING_DESC_F_NEXT;   // 段数组由设备读取
+    q->desc[idx[1]].next = idx[2];
+
+    q->info[idx[0]].status = 0xff;
+    q->desc[idx[2]].addr = (uint64)&q->info[idx[0]].status;
+    q->desc[idx[2]].len = 1;
+    q->desc[idx[2]].flags = VRING_DESC_F_WRITE;
+    q->desc[idx[2]].next = 0;
+
+    token.disk = 1;
+    token.vq = q->id;
+    q->info[idx[0]].b[0] = &token;
+    q->info[idx[0]].nseg = 1;
+    q->info[idx[0]].done = 0;
+
+    virtq_push(q, idx[0]);
+    wait_for_completion(q, &token);
+    release(&q->lock);
+}
 
-    release(&disk.lock);  // 释放磁盘锁
-}
\ No newline at end of file
+// 丢弃 n 段块区间：按 max_discard_sectors 切分成段，每 max_discard_seg 段合成一个请求。
+// 段数组须是设备可以 DMA 的内核页，而不是内核栈；丢弃只是提示，取不到页时直接放弃
+static void virtio_disk_discard(const struct blk_range *r, int n)
+{
+    struct virtio_blk_discard *seg = alloc_page();
+    if(seg == 0)
+        return;
+    uint32 maxseg = PGSIZE / sizeof(struct virtio_blk_discard);
+    if(maxseg > disk.max_discard_seg)
+        maxseg = disk.max_discard_seg;
+    // 每段的扇区数保持为整块
+    uint32 maxsec = disk.max_discard_sectors / (BLOCK_SIZE / 512) * (BLOCK_SIZE / 512);
+
+    uint32 nseg = 0;
+    for(int i = 0; i < n; i++){
+        uint64 sector = (uint64)r[i].start * (BLOCK_SIZE / 512);
+        uint64 left = (uint64)r[i].len * (BLOCK_SIZE / 512);
+        while(left > 0){
+            uint32 m = left < maxsec ? left : maxsec;
+            seg[nseg].sector = sector;
+            seg[nseg].num_sectors = m;
+            seg[nseg].flags = 0;
+            sector += m;
+            left -= m;
+            if(++nseg == maxseg){
+                disk_discard_submit(seg, nseg);
+                nseg = 0;
+            }
+        }
+    }
+    if(nseg > 0)
+        disk_discard_submit(seg, nseg);
+    free_page(seg);
+}
@@ -0,0 +1,247 @@
+// htable.c: 条带锁保护、按负载扩容的侵入式散列表，见 htable.h。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "kalloc.h"
+#include "htable.h"
+
+#define HTABLE_LOAD 2    // 平均每桶节点数超过它时扩容
+
+static struct spinlock *htable_stripe(struct htable *t, uint64 hash)
+{
+  return &t->locks[hash & (HTABLE_NLOCKS - 1)];
+}
+
+int htable_init(struct htable *t, char *name)
+{
+  for(int i = 0; i < HTABLE_NLOCKS; i++)
+    initlock(&t->locks[i], name);
+  if((t->buckets = alloc_page()) == 0)
+    return -1;
+  t->pages = 1;
+  t->mask = PGSIZE / sizeof(t->buckets[0]) - 1;
+  t->count = 0;
+  t->growing = 0;
+  t->max_pages = HTABLE_MAX_PAGES;
+  return 0;
+}
+
+void htable_lock(struct htable *t, uint64 hash)
+{
+  acquire(htable_stripe(t, hash));
+}
+
+struct hnode **htable_bucket(struct htable *t, uint64 hash)
+{
+  return &t->buckets[hash & t->mask];
+}
+
+void htable_add(struct htable *t, uint64 hash, struct hnode *n)
+{
+  struct hnode **b = htable_bucket(t, hash);
+  n->hash = hash;
+  n->next = *b;
+  *b = n;
+  __atomic_fetch_add(&t->count, 1, __ATOMIC_RELAXED);
+}
+
+void htable_del(struct htable *t, struct hnode *n)
+{
+  for(struct hnode **pp = htable_bucket(t, n->hash); *pp; pp = &(*pp)->next) {
+    if(*pp == n) {
+      *pp = n->next;
+      n->next = 0;
+      __atomic_fetch_sub(&t->count, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+}
+
+// 桶数翻倍。取得全部条带锁后逐个节点按保存的散列值重新分桶，旧数组在放锁后交还
+static void htable_grow(struct htable *t)
+{
+  if(__atomic_exchange_n(&t->growing, 1, __ATOMIC_ACQUIRE))
+    return;   // 其他 hart 正在扩容
+
+  int np = t->pages * 2;
+  struct hnode **nb = alloc_pages(np);
+  if(nb == 0) {
+    t->max_pages = t->pages;
+    __atomic_store_n(&t->growing, 0, __ATOMIC_RELEASE);
+    return;
+  }
+  uint64 nmask = (uint64)np * PGSIZE / sizeof(nb[0]) - 1;
+
+  for(int i = 0; i < HTABLE_NLOCKS; i++)
+    acquire(&t->locks[i]);
+  struct hnode **old = t->buckets;
+  int oldpages = t->pages;
+  for(uint64 b = 0; b <= t->mask; b++) {
+    for(struct hnode *n = old[b], *next; n; n = next) {
+      next = n->next;
+      n->next = nb[n->hash & nmask];
+      nb[n->hash & nmask] = n;
+    }
+  }
+  t->buckets = nb;
+  t->mask = nmask;
+  t->pages = np;
+  for(int i = HTABLE_NLOCKS - 1; i >= 0; i--)
+    release(&t->locks[i]);
+
+  free_pages(old, oldpages);
+  __atomic_store_n(&t->growing, 0, __ATOMIC_RELEASE);
+}
+
+// 插入使负载超标时在放锁后扩容；mask 与 count 的读取不加锁，只作为触发条件
+void htable_unlock(struct htable *t, uint64 hash)
+{
+  release(htable_stripe(t, hash));
+  if(__atomic_load_n(&t->count, __ATOMIC_RELAXED) > HTABLE_LOAD * (t->mask + 1) &&
+     t->pages < t->max_pages)
+    htable_grow(t);
+}
+
+#if KTEST_AT_BOOT
+#include "printf.h"
+#include "assert.h"
+#include "proc.h"
+
+#define HT_TEST_WORKERS 4
+#define HT_TEST_KEYS 1024   // 每个工作进程的键数，合计超过两页桶数组的负载上限，并发阶段还会扩容
+
+struct ht_item {
+  struct hnode node;
+  uint64 key;
+};
+
+static struct htable ht_test;
+static struct ht_item ht_items[HT_TEST_WORKERS * HT_TEST_KEYS];
+static int ht_next_worker;
+
+// 在持有 key 的条带锁时查找
+static struct ht_item *ht_find(uint64 key)
+{
+  for(struct hnode *n = *htable_bucket(&ht_test, hash64(key)); n; n = n->next) {
+    struct ht_item *it = hnode_entry(n, struct ht_item, node);
+    if(it->key == key)
+      return it;
+  }
+  return 0;
+}
+
+static void ht_insert(uint64 key)
+{
+  uint64 h = hash64(key);
+  struct ht_item *it = &ht_items[key];
+  htable_lock(&ht_test, h);
+  assert(ht_find(key) == 0);
+  it->key = key;
+  htable_add(&ht_test, h, &it->node);
+  htable_unlock(&ht_test, h);
+}
+
+static void ht_remove(uint64 key)
+{
+  uint64 h = hash64(key);
+  htable_lock(&ht_test, h);
+  struct ht_item *it = ht_find(key);
+  assert(it == &ht_items[key]);
+  htable_del(&ht_test, &it->node);
+  htable_unlock(&ht_test, h);
+}
+
+static int ht_present(uint64 key)
+{
+  uint64 h = hash64(key);
+  htable_lock(&ht_test, h);
+  // 只持有 key 所在的条带锁
+  for(int i = 0; i < HTABLE_NLOCKS; i++)
+    assert(holding(&ht_test.locks[i]) == (i == (h & (HTABLE_NLOCKS - 1))));
+  int found = ht_find(key) != 0;
+  htable_unlock(&ht_test, h);
+  return found;
+}
+
+// 取得全部条带锁后检查：每个节点都在按当前掩码算出的桶里，同一桶的节点落在同一把条带锁下，
+// 节点总数与 count 一致
+static void ht_check_buckets(void)
+{
+  int count = 0;
+
+  for(int i = 0; i < HTABLE_NLOCKS; i++)
+    acquire(&ht_test.locks[i]);
+  assert(ht_test.mask >= HTABLE_NLOCKS - 1);
+  for(uint64 b = 0; b <= ht_test.mask; b++) {
+    for(struct hnode *n = ht_test.buckets[b]; n; n = n->next) {
+      assert((n->hash & ht_test.mask) == b);
+      assert((n->hash & (HTABLE_NLOCKS - 1)) == (b & (HTABLE_NLOCKS - 1)));
+      count++;
+    }
+  }
+  assert(count == ht_test.count);
+  for(int i = HTABLE_NLOCKS - 1; i >= 0; i--)
+    release(&ht_test.locks[i]);
+}
+
+// 各工作进程对自己的一段键并发插入、检查、删除，插入期间桶数组被其他进程扩容
+static void ht_worker(void)
+{
+  intr_on();
+  uint64 base = (uint64)__atomic_fetch_add(&ht_next_worker, 1, __ATOMIC_RELAXED) * HT_TEST_KEYS;
+
+  for(uint64 k = base; k < base + HT_TEST_KEYS; k++)
+    ht_insert(k);
+  for(uint64 k = base; k < base + HT_TEST_KEYS; k++)
+    assert(ht_present(k));
+  for(uint64 k = base; k < base + HT_TEST_KEYS; k += 2)
+    ht_remove(k);
+  for(uint64 k = base; k < base + HT_TEST_KEYS; k++)
+    assert(ht_present(k) == (k % 2));
+  for(uint64 k = base + 1; k < base + HT_TEST_KEYS; k += 2)
+    ht_remove(k);
+  exit_process(0);
+}
+
+// 散列表测试：单进程下跨越一次扩容的插入与删除，再由多个进程并发操作各自的键
+void test_htable(void)
+{
+  printf("[htable] begin\n");
+  assert(htable_init(&ht_test, "htable.test") == 0);
+  uint64 nbuckets = ht_test.mask + 1;
+  assert(2 * HTABLE_LOAD * nbuckets <= HT_TEST_WORKERS * HT_TEST_KEYS);
+
+  // 恰好达到负载上限时不扩容
+  for(uint64 k = 0; k < HTABLE_LOAD * nbuckets; k++)
+    ht_insert(k);
+  assert(ht_test.pages == 1);
+  for(uint64 k = 0; k < HTABLE_LOAD * nbuckets; k += 4)
+    ht_remove(k);
+  // 再插入一批，越过上限触发扩容；扩容前删除的键不应重新出现
+  for(uint64 k = HTABLE_LOAD * nbuckets; k < 2 * HTABLE_LOAD * nbuckets; k++)
+    ht_insert(k);
+  assert(ht_test.pages == 2 && ht_test.mask + 1 == 2 * nbuckets);
+  ht_check_buckets();
+  for(uint64 k = 0; k < 2 * HTABLE_LOAD * nbuckets; k++)
+    assert(ht_present(k) == (k >= HTABLE_LOAD * nbuckets || k % 4 != 0));
+  for(uint64 k = 0; k < 2 * HTABLE_LOAD * nbuckets; k++)
+    if(k >= HTABLE_LOAD * nbuckets || k % 4 != 0)
+      ht_remove(k);
+  assert(ht_test.count == 0);
+  ht_check_buckets();
+  printf("[htable] resize ok (%lu -> %lu buckets)\n", nbuckets, ht_test.mask + 1);
+
+  ht_next_worker = 0;
+  for(int i = 0; i < HT_TEST_WORKERS; i++)
+    assert(create_process(ht_worker) > 0);
+  for(int i = 0; i < HT_TEST_WORKERS; i++)
+    wait_process(0);
+  assert(ht_test.count == 0);
+  ht_check_buckets();
+  printf("[htable] %d workers ok (%lu buckets)\n", HT_TEST_WORKERS, ht_test.mask + 1);
+
+  free_pages(ht_test.buckets, ht_test.pages);
+  printf("[htable] end\n");
+}
+#endif
@@ -0,0 +1,326 @@
+// radix.c: 64 叉基数树，见 radix.h。
+// 节点的 count 记录非空槽数，删除使其降为 0 时释放该节点并向上传递；
+// 根节点只有 0 号槽非空时降低树高，树的高度始终与当前最大下标相称。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "slab.h"
+#include "printf.h"
+#include "string.h"
+#include "radix.h"
+
+#define RADIX_MASK (RADIX_SLOTS - 1)
+#define RADIX_MAX_HEIGHT ((64 + RADIX_SHIFT - 1) / RADIX_SHIFT)
+
+struct radix_node {
+  void *slots[RADIX_SLOTS];   // 最底层为项，其余层为子节点
+  int count;                  // 非空槽数
+};
+
+static struct kmem_cache *radix_cache;
+
+void radix_tree_init(void)
+{
+  radix_cache = kmem_cache_create("radix_node", sizeof(struct radix_node), 0);
+  if(radix_cache == 0)
+    panic("radix_tree_init");
+}
+
+static struct radix_node *node_alloc(void)
+{
+  struct radix_node *n = kmem_cache_alloc(radix_cache);
+  if(n)
+    memset(n, 0, sizeof(*n));
+  return n;
+}
+
+// 高度为 h 的树能容纳的最大下标
+static uint64 height_max(int h)
+{
+  if(h * RADIX_SHIFT >= 64)
+    return ~0UL;
+  return (1UL << (h * RADIX_SHIFT)) - 1;
+}
+
+static int slot_of(uint64 index, int level)
+{
+  return (index >> (level * RADIX_SHIFT)) & RADIX_MASK;
+}
+
+int radix_insert(struct radix_tree *t, uint64 index, void *item)
+{
+  if(item == 0)
+    return -1;
+
+  // 长高：原有的根成为新根的 0 号子节点，空树直接长到所需高度
+  int need = 1;
+  while(index > height_max(need))
+    need++;
+  if(t->root == 0) {
+    if((t->root = node_alloc()) == 0)
+      return -1;
+    t->height = need;
+  }
+  while(t->height < need) {
+    struct radix_node *n = node_alloc();
+    if(n == 0)
+      return -1;
+    n->slots[0] = t->root;
+    n->count = 1;
+    t->root = n;
+    t->height++;
+  }
+
+  struct radix_node *n = t->root;
+  for(int level = t->height - 1; level > 0; level--) {
+    void **slot = &n->slots[slot_of(index, level)];
+    if(*slot == 0) {
+      if((*slot = node_alloc()) == 0)
+        return -1;
+      n->count++;
+    }
+    n = *slot;
+  }
+  void **slot = &n->slots[slot_of(index, 0)];
+  if(*slot)
+    return -1;
+  *slot = item;
+  n->count++;
+  return 0;
+}
+
+void *radix_lookup(struct radix_tree *t, uint64 index)
+{
+  if(t->root == 0 || index > height_max(t->height))
+    return 0;
+  struct radix_node *n = t->root;
+  for(int level = t->height - 1; level > 0 && n; level--)
+    n = n->slots[slot_of(index, level)];
+  return n ? n->slots[slot_of(index, 0)] : 0;
+}
+
+// 根只剩 0 号子节点时去掉一层，空树释放根
+static void radix_shrink(struct radix_tree *t)
+{
+  while(t->height > 1 && t->root->count == 1 && t->root->slots[0]) {
+    struct radix_node *n = t->root;
+    t->root = n->slots[0];
+    t->height--;
+    kmem_cache_free(radix_cache, n);
+  }
+  if(t->root->count == 0) {
+    kmem_cache_free(radix_cache, t->root);
+    t->root = 0;
+    t->height = 0;
+  }
+}
+
+void *radix_delete(struct radix_tree *t, uint64 index)
+{
+  if(t->root == 0 || index > height_max(t->height))
+    return 0;
+
+  struct radix_node *path[RADIX_MAX_HEIGHT];
+  struct radix_node *n = t->root;
+  for(int level = t->height - 1; level > 0; level--) {
+    path[level] = n;
+    if((n = n->slots[slot_of(index, level)]) == 0)
+      return 0;
+  }
+  void *item = n->slots[slot_of(index, 0)];
+  if(item == 0)
+    return 0;
+  n->slots[slot_of(index, 0)] = 0;
+  n->count--;
+
+  // 自下而上释放变空的节点，根留给 radix_shrink
+  for(int level = 1; level < t->height && n->count == 0; level++) {
+    kmem_cache_free(radix_cache, n);
+    n = path[level];
+    n->slots[slot_of(index, level)] = 0;
+    n->count--;
+  }
+  radix_shrink(t);
+  return item;
+}
+
+// 在以 n 为根、位于 level 层、覆盖下标 base 起的子树中收集下标不小于 first 的项
+static int gang_walk(struct radix_node *n, int level, uint64 base, uint64 first,
+                     void **items, uint64 *indices, int got, int max)
+{
+  int shift = level * RADIX_SHIFT;
+  int start = 0;
+  if(first > base)
+    start = slot_of(first, level);   // first 落在本子树内
+  for(int i = start; i < RADIX_SLOTS && got < max; i++) {
+    if(n->slots[i] == 0)
+      continue;
+    uint64 idx = base + ((uint64)i << shift);
+    if(level == 0) {
+      items[got] = n->slots[i];
+      if(indices)
+        indices[got] = idx;
+      got++;
+    } else {
+      got = gang_walk(n->slots[i], level - 1, idx, i == start ? first : idx, items, indices, got, max);
+    }
+  }
+  return got;
+}
+
+int radix_gang_lookup(struct radix_tree *t, uint64 first, void **items, uint64 *indices, int max)
+{
+  if(t->root == 0 || max <= 0 || first > height_max(t->height))
+    return 0;
+  return gang_walk(t->root, t->height - 1, 0, first, items, indices, 0, max);
+}
+
+static void clear_walk(struct radix_node *n, int level, uint64 base,
+                       void (*fn)(uint64 index, void *item))
+{
+  for(int i = 0; i < RADIX_SLOTS; i++) {
+    if(n->slots[i] == 0)
+      continue;
+    uint64 idx = base + ((uint64)i << (level * RADIX_SHIFT));
+    if(level == 0) {
+      if(fn)
+        fn(idx, n->slots[i]);
+    } else {
+      clear_walk(n->slots[i], level - 1, idx, fn);
+    }
+  }
+  kmem_cache_free(radix_cache, n);
+}
+
+void radix_clear(struct radix_tree *t, void (*fn)(uint64 index, void *item))
+{
+  if(t->root)
+    clear_walk(t->root, t->height - 1, 0, fn);
+  t->root = 0;
+  t->height = 0;
+}
+
+#if KTEST_AT_BOOT
+#include "assert.h"
+
+#define RX_TOP (~0UL)
+
+static void *rx_item(uint64 index)
+{
+  return (void *)((index << 1) | 1);   // 非 0，且与下标一一对应
+}
+
+// 统计子树的节点数，同时检查每个节点的 count 等于非空槽数、没有留下空节点
+static int rx_nodes(struct radix_node *n, int level)
+{
+  int used = 0, nodes = 1;
+  for(int i = 0; i < RADIX_SLOTS; i++) {
+    if(n->slots[i] == 0)
+      continue;
+    used++;
+    if(level > 0)
+      nodes += rx_nodes(n->slots[i], level - 1);
+  }
+  assert(used == n->count && used > 0);
+  return nodes;
+}
+
+static int rx_tree_nodes(struct radix_tree *t)
+{
+  if(t->root == 0) {
+    assert(t->height == 0);
+    return 0;
+  }
+  return rx_nodes(t->root, t->height - 1);
+}
+
+static void rx_insert(struct radix_tree *t, uint64 index, int height)
+{
+  assert(radix_insert(t, index, rx_item(index)) == 0);
+  assert(radix_lookup(t, index) == rx_item(index));
+  assert(t->height == height);
+}
+
+static void rx_delete(struct radix_tree *t, uint64 index, int height)
+{
+  assert(radix_delete(t, index) == rx_item(index));
+  assert(radix_lookup(t, index) == 0);
+  assert(t->height == height);
+}
+
+// 从 first 起取至多 max 项，应恰好得到 want[0..n)
+static void rx_gang(struct radix_tree *t, uint64 first, int max, const uint64 *want, int n)
+{
+  void *items[8];
+  uint64 idx[8];
+  assert(radix_gang_lookup(t, first, items, idx, max) == n);
+  for(int i = 0; i < n; i++)
+    assert(idx[i] == want[i] && items[i] == rx_item(want[i]));
+}
+
+// 基数树测试：树高随最大下标增长与降低、删除释放变空的中间节点、跨节点边界的有序批量查找
+void test_radix(void)
+{
+  struct radix_tree t = {0};
+
+  printf("[radix] begin\n");
+  rx_insert(&t, 5, 1);
+  rx_insert(&t, RADIX_SLOTS, 2);                    // 64：首个需要两层的下标
+  rx_insert(&t, RADIX_SLOTS - 1, 2);
+  rx_insert(&t, (1UL << (2 * RADIX_SHIFT)) - 1, 2); // 4095：两层的最大下标
+  rx_insert(&t, 1UL << (2 * RADIX_SHIFT), 3);
+  assert(radix_insert(&t, 5, rx_item(5)) == -1);    // 已有项
+  assert(radix_insert(&t, 6, 0) == -1);
+  assert(rx_tree_nodes(&t) == 7);   // 三层的根、两个二层节点、四个叶节点
+  rx_insert(&t, RX_TOP - 1, RADIX_MAX_HEIGHT);
+  rx_insert(&t, RX_TOP, RADIX_MAX_HEIGHT);
+  // 长高只在 0 号槽一侧叠加根，RX_TOP 另占一条到底的路径
+  assert(rx_tree_nodes(&t) == 7 + (RADIX_MAX_HEIGHT - 3) + (RADIX_MAX_HEIGHT - 1));
+
+  uint64 w0[] = {5, 63, 64};
+  rx_gang(&t, 0, 3, w0, 3);
+  uint64 w1[] = {63, 64, 4095, 4096};
+  rx_gang(&t, 63, 4, w1, 4);
+  uint64 w2[] = {4095, 4096, RX_TOP - 1, RX_TOP};
+  rx_gang(&t, 65, 8, w2, 4);
+  uint64 w3[] = {RX_TOP - 1, RX_TOP};
+  rx_gang(&t, 4097, 8, w3, 2);
+  uint64 w4[] = {RX_TOP};
+  rx_gang(&t, RX_TOP, 8, w4, 1);
+  rx_gang(&t, 6, 0, 0, 0);
+
+  // 叶节点中还有 RX_TOP - 1，不释放节点
+  int before = rx_tree_nodes(&t);
+  rx_delete(&t, RX_TOP, RADIX_MAX_HEIGHT);
+  assert(rx_tree_nodes(&t) == before);
+  rx_gang(&t, 4097, 8, w3, 1);
+  // 整条路径变空后逐层释放，根只剩 0 号子树，降回三层
+  rx_delete(&t, RX_TOP - 1, 3);
+  assert(rx_tree_nodes(&t) == 7);
+  rx_gang(&t, 4097, 8, 0, 0);
+  rx_delete(&t, 4096, 2);
+  assert(rx_tree_nodes(&t) == 4);
+  rx_delete(&t, RADIX_SLOTS, 2);    // 只释放 64 独占的叶节点，根仍有 0 号与 63 号子节点
+  assert(rx_tree_nodes(&t) == 3);
+  rx_delete(&t, 4095, 1);
+  assert(rx_tree_nodes(&t) == 1);
+  rx_delete(&t, RADIX_SLOTS - 1, 1);
+  rx_delete(&t, 5, 0);
+  assert(t.root == 0 && radix_delete(&t, 5) == 0);
+
+  // 共享中间节点的两个下标：删除其一只释放它独占的叶节点，删除另一个时中间节点随之释放
+  rx_insert(&t, 0, 1);
+  rx_insert(&t, 3UL << (3 * RADIX_SHIFT), 4);
+  before = rx_tree_nodes(&t);
+  rx_insert(&t, (3UL << (3 * RADIX_SHIFT)) + (1UL << RADIX_SHIFT), 4);
+  assert(rx_tree_nodes(&t) == before + 1);
+  rx_delete(&t, (3UL << (3 * RADIX_SHIFT)) + (1UL << RADIX_SHIFT), 4);
+  assert(rx_tree_nodes(&t) == before);
+  rx_delete(&t, 3UL << (3 * RADIX_SHIFT), 1);
+  assert(rx_tree_nodes(&t) == 1);
+  radix_clear(&t, 0);
+  assert(t.root == 0 && t.height == 0);
+  printf("[radix] end\n");
+}
+#endif
@@ -0,0 +1,137 @@
+// allocprof.c: 分配调用点统计的登记表与输出。
+// 调用点按 (返回地址, slab cache 名) 散列到登记表，线性探测；表满后的调用点一律记到 0 号槽。
+// 分配路径可能在中断中运行（如网卡收包补充缓冲页），登记与计数在关中断下用自旋标志串行，
+// 不能用 spinlock：它本身会登记锁统计，且 kalloc 在锁初始化之前就已开始分配。
+// 输出时不持有标志，并发分配时可能看到不一致的一行，作为诊断数据可以接受。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "allocprof.h"
+#include "string.h"
+#include "printf.h"
+
+#if ALLOC_PROF
+struct alloc_site {
+  uint64 ra;           // 调用者的返回地址，0 表示空槽
+  const char *cache;   // slab 对象所属 cache 的名称，页分配为 0
+  uint64 allocs;       // 累计分配次数
+  uint64 live;         // 现存的页数（页分配）或对象数（slab）
+  uint64 live_bytes;   // 现存的字节数
+  uint64 peak_bytes;   // live_bytes 的最高水位
+};
+
+static struct alloc_site sites[ALLOCPROF_SITES];
+static uint site_busy;
+
+static void site_lock(void)
+{
+  push_off();
+  while(__sync_lock_test_and_set(&site_busy, 1) != 0)
+    cpu_relax();
+}
+
+static void site_unlock(void)
+{
+  __sync_lock_release(&site_busy);
+  pop_off();
+}
+
+// 查找或登记调用点，调用者持有 site_busy
+static int site_find(uint64 ra, const char *cache)
+{
+  uint h = (uint)((ra >> 2) ^ ((uint64)cache >> 3)) % (ALLOCPROF_SITES - 1);
+
+  for(int probe = 0; probe < ALLOCPROF_SITES - 1; probe++) {
+    int i = 1 + (h + probe) % (ALLOCPROF_SITES - 1);
+    struct alloc_site *s = &sites[i];
+    if(s->ra == 0) {
+      s->ra = ra;
+      s->cache = cache;
+      return i;
+    }
+    if(s->ra == ra && s->cache == cache)
+      return i;
+  }
+  return 0;
+}
+
+// 记录一次分配：n 个页或对象，共 bytes 字节。返回调用点编号，释放时交回 allocprof_free
+int allocprof_alloc(uint64 ra, const char *cache, uint64 n, uint64 bytes)
+{
+  site_lock();
+  int i = site_find(ra, cache);
+  struct alloc_site *s = &sites[i];
+  s->allocs++;
+  s->live += n;
+  s->live_bytes += bytes;
+  if(s->live_bytes > s->peak_bytes)
+    s->peak_bytes = s->live_bytes;
+  site_unlock();
+  return i;
+}
+
+// 释放调用点 site 分配的一个页或对象
+void allocprof_free(int site, uint64 bytes)
+{
+  if(site < 0 || site >= ALLOCPROF_SITES)
+    return;
+  site_lock();
+  struct alloc_site *s = &sites[site];
+  if(s->live > 0) {
+    s->live--;
+    s->live_bytes -= bytes < s->live_bytes ? bytes : s->live_bytes;
+  }
+  site_unlock();
+}
+#endif
+
+// 按现存字节数从多到少打印各调用点，地址可用 addr2line 对照 kernel.elf
+void allocprof_dump(void)
+{
+#if ALLOC_PROF
+  int order[ALLOCPROF_SITES], n = 0;
+
+  for(int i = 0; i < ALLOCPROF_SITES; i++) {
+    if(sites[i].allocs || sites[i].live)
+      order[n++] = i;
+  }
+  for(int i = 1; i < n; i++) {
+    int k = order[i], j = i;
+    while(j > 0 && sites[order[j - 1]].live_bytes < sites[k].live_bytes) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = k;
+  }
+
+  uint64 total = 0;
+  printf("allocprof: caller kind allocs live live-bytes peak-bytes\n");
+  for(int i = 0; i < n; i++) {
+    struct alloc_site *s = &sites[order[i]];
+    printf("%p %s %lu %lu %lu %lu\n", (void *)s->ra, s->cache ? s->cache : "page",
+           s->allocs, s->live, s->live_bytes, s->peak_bytes);
+    if(s->cache == 0)
+      total += s->live_bytes;
+  }
+  printf("allocprof: 页分配共 %lu 字节", total);
+  if(sites[0].allocs)
+    printf("，登记表已满，%lu 次分配记入 0 号槽", sites[0].allocs);
+  printf("\n");
+#else
+  printf("allocprof: 内核未启用 ALLOC_PROF\n");
+#endif
+}
+
+// 累计分配次数清零，高水位降到当前用量；现存的计数保留，之后的释放仍能对上
+void allocprof_reset(void)
+{
+#if ALLOC_PROF
+  site_lock();
+  for(struct alloc_site *s = sites; s < &sites[ALLOCPROF_SITES]; s++) {
+    s->allocs = 0;
+    s->peak_bytes = s->live_bytes;
+  }
+  site_unlock();
+#endif
+}
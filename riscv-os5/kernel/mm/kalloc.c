@@ -3,9 +3,23 @@
 #include "types.h"
 #include "riscv.h"
 #include "string.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "kalloc.h"
+#include "slab.h"
+#include "vm.h"
+#include "trap.h"
+#include "meminfo.h"
+#include "pcache.h"
+#include "buf.h"
+#include "rmap.h"
+#include "swap.h"
+#include "allocprof.h"
+#include "metrics.h"
+#include "bitops.h"
 
 extern char end[];
+extern volatile uint64 ticks;
 
 #define NPAGES ((PHYSTOP - (uint64)KERNBASE) / PGSIZE)
 
@@ -13,10 +27,89 @@ extern char end[];
 #define BITS_PER_WORD (sizeof(uint64) * 8)
 #define BITMAP_WORDS ((NPAGES + BITS_PER_WORD - 1) / BITS_PER_WORD) //向上取整
 
+// 伙伴系统参数：最大阶 MAX_ORDER 对应 2^MAX_ORDER 个连续页（4MB）
+#define MAX_ORDER 10
+
+// 每个 hart 的页面缓存（magazine）容量与批量迁移数量
+#define PCP_CAPACITY 64
+#define PCP_BATCH    16
+// 每个 hart 预清零页池的目标容量，以及空闲循环每次最多清零的页数
+#define ZERO_POOL_TARGET 32
+#define ZERO_BATCH       4
+// 回收水位：空闲页低于 LOW_WATERMARK 时标记需要回收，空闲循环回收到 HIGH_WATERMARK 为止；
+// 分配失败时直接同步回收 RECLAIM_BATCH 页后重试一次
+#define LOW_WATERMARK  256
+#define HIGH_WATERMARK 512
+#define RECLAIM_BATCH  32
+// 内存规整：空闲页不少于 COMPACT_FREE_MIN 却凑不出 COMPACT_ORDER 阶（一个 2MB 大页）的空闲块，
+// 或 alloc_pages 因缺少连续页失败时，由空闲循环迁移用户页拼出空闲块。
+// 两次尝试至少间隔 COMPACT_INTERVAL 个 tick，每次最多试 COMPACT_TRIES 个候选区间
+#define COMPACT_ORDER    9
+#define COMPACT_FREE_MIN (4 << COMPACT_ORDER)
+#define COMPACT_INTERVAL 100
+#define COMPACT_TRIES    3
+// 连续内存区（CMA）：启动时在物理内存顶端预留 CMA_PAGES 页，只有 cma_alloc 能从中取连续页，
+// 供 virtio 环等需要物理连续的 DMA 缓冲使用；设备未占用的页借给可迁移的匿名用户页，
+// cma_alloc 需要时再迁走。区间按 2^MAX_ORDER 对齐，其中的页从不进入伙伴系统。
+// 由 Makefile 的 CMA_PAGES 设定，必须是 2^MAX_ORDER 的整数倍，0 表示不预留
+#ifndef CMA_PAGES
+#define CMA_PAGES 1024
+#endif
+#define CMA_WORDS (CMA_PAGES / BITS_PER_WORD)
+#define CMA_TRIES 3
+_Static_assert(CMA_PAGES % (1 << MAX_ORDER) == 0, "CMA_PAGES must be a multiple of 2^MAX_ORDER");
+
+// 空闲块链表节点，直接存放在空闲块首页中，无需额外元数据内存
+struct free_block {
+    struct free_block *next;
+    struct free_block *prev;
+};
+
 static uint64 bitmap[BITMAP_WORDS];  // 0=空闲, 1=已分配
 static int free_pages_count = 0;     // 空闲页面计数
 static int refcount[NPAGES];         // 每页的引用计数
 
+// 每一阶的空闲块双向链表；block_order[i] 记录以第 i 页开头的空闲块阶数，-1 表示不是空闲块首页
+static struct free_block *free_area[MAX_ORDER + 1];
+static signed char block_order[NPAGES];
+
+// 全局伙伴系统由 kmem_lock 保护；bitmap/free_area/block_order/free_pages_count 只在持锁时修改
+static struct spinlock kmem_lock;
+
+// 每个 hart 私有的页面缓存：最近释放的单页先放在这里，分配时优先取用。
+// 仅在关中断（push_off）状态下由所属 hart 访问，因此无需加锁。
+// 缓存中的页在伙伴系统看来仍处于已分配状态，refcount 为 0 表示“缓存中空闲”。
+// pages[] 中的页内容未定义；zeroed[] 中的页已由空闲循环提前清零，可直接交给 alloc_page。
+struct page_magazine {
+    int count;
+    void *pages[PCP_CAPACITY];
+    int nzeroed;
+    void *zeroed[ZERO_POOL_TARGET];
+};
+static struct page_magazine magazines[NCPU];
+
+// 供 meminfo 使用的累计计数，只增不减
+static uint64 alloc_failures;     // 单页分配失败次数
+static uint64 zero_fill_time;     // 分配路径上同步清零的耗时
+static uint64 idle_zeroed_pages;  // 空闲循环清零的页数
+static int reclaim_wanted;        // 空闲页跌破低水位，等待空闲循环回收
+static int in_reclaim;            // 防止回收路径中的分配再次触发回收
+static int compact_wanted = -1;   // alloc_pages 失败时请求的阶，-1 表示没有
+static uint64 compact_last;       // 最近一次规整时的 ticks
+static uint64 compact_runs, compact_success, compact_moved, compact_time;
+
+// CMA 区的页状态：dma 位表示已分给 cma_alloc 的调用者（或正为其腾空），lent 位表示借给了
+// 可迁移页，两位都清零的页空闲。区内页在全局位示图中始终为已分配，由 cma.lock 保护
+static struct {
+    struct spinlock lock;
+    int base;                   // 区间首页下标
+    int nfree, ndma, nlent;
+    uint64 dma[CMA_WORDS];
+    uint64 lent[CMA_WORDS];
+    uint64 migrated;            // cma_alloc 迁走的借出页数
+    uint64 failures;            // cma_alloc 失败次数
+} cma;
+
 // 获取物理页对应的下标
 static inline int page_index(void *page) {
     return ((char*)page - (char*)KERNBASE) / PGSIZE;
@@ -24,7 +117,52 @@ static inline int page_index(void *page) {
 
 // 获取下标对应的物理页地址
 static inline void* index_to_page(int index) {
-    return (char*)KERNBASE + index * PGSIZE;
+    return (char*)KERNBASE + (uint64)index * PGSIZE;
+}
+
+#if ALLOC_PROF
+// 每个已分配页的分配调用点编号（见 allocprof.h），最后一个引用放弃时据此记账
+static ushort page_site[NPAGES];
+
+static void prof_pages(void *page, int n, uint64 ra) {
+    if (page == 0)
+        return;
+    int site = allocprof_alloc(ra, 0, n, (uint64)n * PGSIZE);
+    for (int i = 0; i < n; i++)
+        page_site[page_index(page) + i] = site;
+}
+#define PROF_PAGES(page, n) prof_pages((page), (n), (uint64)__builtin_return_address(0))
+#else
+#define PROF_PAGES(page, n) do { } while (0)
+#endif
+
+static inline int cma_contains(int idx) {
+    return idx >= cma.base && idx < cma.base + CMA_PAGES;
+}
+
+static inline void cma_set(uint64 *map, int off) {
+    map[off / BITS_PER_WORD] |= 1UL << (off % BITS_PER_WORD);
+}
+
+static inline void cma_clear(uint64 *map, int off) {
+    map[off / BITS_PER_WORD] &= ~(1UL << (off % BITS_PER_WORD));
+}
+
+static inline int cma_test(const uint64 *map, int off) {
+    return (map[off / BITS_PER_WORD] >> (off % BITS_PER_WORD)) & 1;
+}
+
+// 借出的页最后一个引用放弃：正在为 cma_alloc 腾空的区间中的页留给它，其余的回到空闲状态
+static void cma_put(int idx) {
+    int off = idx - cma.base;
+    acquire(&cma.lock);
+    if (!cma_test(cma.lent, off))
+        panic("cma_put: page not lent");
+    cma_clear(cma.lent, off);
+    cma.nlent--;
+    if (!cma_test(cma.dma, off))
+        cma.nfree++;
+    release(&cma.lock);
 }
 
 // 位示图操作函数
@@ -40,94 +178,387 @@ static inline int bitmap_test(int index) {
     return (bitmap[index / BITS_PER_WORD] >> (index % BITS_PER_WORD)) & 1;
 }
 
-// 在位示图中查找第一个空闲页
-static int find_first_free_page(void) {
-    for (int i = 0; i < BITMAP_WORDS; i++) {
-        if (bitmap[i] != ~0UL) {  // 如果这个字不是全1
-            for (int j = 0; j < BITS_PER_WORD; j++) {
-                int index = i * BITS_PER_WORD + j;
-                if (index < NPAGES && !bitmap_test(index)) {
-                    return index;
-                }
-            }
-        }
+// 将以 idx 开头、阶为 order 的空闲块挂入对应链表头部
+static void free_list_push(int idx, int order) {
+    struct free_block *blk = (struct free_block *)index_to_page(idx);
+    blk->prev = 0;
+    blk->next = free_area[order];
+    if (free_area[order])
+        free_area[order]->prev = blk;
+    free_area[order] = blk;
+    block_order[idx] = order;
+}
+
+// 从对应阶的链表中摘除指定空闲块
+static void free_list_remove(int idx, int order) {
+    struct free_block *blk = (struct free_block *)index_to_page(idx);
+    if (blk->prev)
+        blk->prev->next = blk->next;
+    else
+        free_area[order] = blk->next;
+    if (blk->next)
+        blk->next->prev = blk->prev;
+    block_order[idx] = -1;
+}
+
+// 从伙伴系统中取出一个阶为 order 的块：自底向上寻找第一个非空链表，
+// 再逐级对半拆分，把多余的后半部分挂回低一阶链表。返回首页下标，失败返回 -1。
+static int buddy_alloc(int order) {
+    int k = order;
+    while (k <= MAX_ORDER && free_area[k] == 0)
+        k++;
+    if (k > MAX_ORDER)
+        return -1;
+
+    int idx = page_index(free_area[k]);
+    free_list_remove(idx, k);
+
+    while (k > order) {
+        k--;
+        free_list_push(idx + (1 << k), k);
     }
-    return -1;
+
+    for (int i = 0; i < (1 << order); i++)
+        bitmap_set(idx + i);
+    free_pages_count -= (1 << order);
+    return idx;
 }
 
-// 在位示图中查找连续的n个空闲页
-static int find_contiguous_free_pages(int n) {
-    int start = 0, count = 0;
-    
-    for (int i = 0; i < NPAGES; i++) {
-        if (!bitmap_test(i)) {
-            if (count == 0) start = i;
-            count++;
-            if (count == n) return start;
-        } else {
-            count = 0;
-        }
+// 将以 idx 开头、阶为 order 的块归还伙伴系统，并尽可能与伙伴块合并
+static void buddy_free(int idx, int order) {
+    for (int i = 0; i < (1 << order); i++)
+        bitmap_clear(idx + i);
+    free_pages_count += (1 << order);
+
+    while (order < MAX_ORDER) {
+        int buddy = idx ^ (1 << order);
+        if (buddy >= NPAGES || block_order[buddy] != order)
+            break;  // 伙伴不完整空闲，停止合并
+        free_list_remove(buddy, order);
+        if (buddy < idx)
+            idx = buddy;
+        order++;
+    }
+    free_list_push(idx, order);
+}
+
+// 计算容纳 n 个页面所需的最小阶
+static int pages_to_order(int n) {
+    int order = 0;
+    while ((1 << order) < n)
+        order++;
+    return order;
+}
+
+// 从全局伙伴系统批量取页补充当前 hart 的缓存，调用者需已关中断
+static void pcp_refill(struct page_magazine *mag) {
+    acquire(&kmem_lock);
+    while (mag->count < PCP_BATCH) {
+        int idx = buddy_alloc(0);
+        if (idx == -1)
+            break;
+        mag->pages[mag->count++] = index_to_page(idx);
+    }
+    release(&kmem_lock);
+}
+
+// 将当前 hart 缓存中最早放入的 n 个页面批量归还全局伙伴系统，调用者需已关中断
+static void pcp_drain(struct page_magazine *mag, int n) {
+    if (n > mag->count)
+        n = mag->count;
+    acquire(&kmem_lock);
+    for (int i = 0; i < n; i++)
+        buddy_free(page_index(mag->pages[i]), 0);
+    release(&kmem_lock);
+    for (int i = n; i < mag->count; i++)
+        mag->pages[i - n] = mag->pages[i];
+    mag->count -= n;
+}
+
+// 当前空闲页数（含各 hart 缓存与预清零池），仅用于水位判断，不加锁
+static int free_estimate(void) {
+    int n = free_pages_count;
+    for (int i = 0; i < NCPU; i++)
+        n += magazines[i].count + magazines[i].nzeroed;
+    return n;
+}
+
+static void metric_free_pages(struct metric_stat *st) { st->value = free_estimate(); }
+static void metric_alloc_failures(struct metric_stat *st) { st->value = alloc_failures; }
+static void metric_zero_fill_time(struct metric_stat *st) { st->value = zero_fill_time; }
+static void metric_compact_runs(struct metric_stat *st) { st->value = compact_runs; }
+static void metric_cma_free(struct metric_stat *st) { st->value = cma.nfree; }
+static void metric_cma_dma(struct metric_stat *st) { st->value = cma.ndma; }
+static void metric_cma_lent(struct metric_stat *st) { st->value = cma.nlent; }
+static void metric_cma_migrated(struct metric_stat *st) { st->value = cma.migrated; }
+static void metric_cma_failures(struct metric_stat *st) { st->value = cma.failures; }
+
+static struct metric kalloc_metrics[] = {
+    { .name = "kalloc.free_pages", .kind = METRIC_GAUGE, .read = metric_free_pages },
+    { .name = "kalloc.alloc_failures", .kind = METRIC_COUNTER, .read = metric_alloc_failures },
+    { .name = "kalloc.zero_fill_time", .kind = METRIC_COUNTER, .read = metric_zero_fill_time },
+    { .name = "kalloc.compact_runs", .kind = METRIC_COUNTER, .read = metric_compact_runs },
+    { .name = "cma.free_pages", .kind = METRIC_GAUGE, .read = metric_cma_free },
+    { .name = "cma.dma_pages", .kind = METRIC_GAUGE, .read = metric_cma_dma },
+    { .name = "cma.lent_pages", .kind = METRIC_GAUGE, .read = metric_cma_lent },
+    { .name = "cma.migrated", .kind = METRIC_COUNTER, .read = metric_cma_migrated },
+    { .name = "cma.alloc_failures", .kind = METRIC_COUNTER, .read = metric_cma_failures },
+};
+
+// 把 [lo, hi) 按对齐情况切分为尽可能大的块挂入空闲链表。这样切出的块的伙伴要么在内核区
+// 或 CMA 区内，要么越过区间末尾，要么阶更小，不会出现可合并的伙伴，因此直接入链而不走 buddy_free
+static void free_range(int lo, int hi) {
+    int idx = lo;
+    while (idx < hi) {
+        int order = MAX_ORDER;
+        while (order > 0 && ((idx & ((1 << order) - 1)) != 0 || idx + (1 << order) > hi))
+            order--;
+        free_list_push(idx, order);
+        idx += (1 << order);
     }
-    return -1;
 }
 
 // 初始化物理内存管理器
 void pmm_init(void) {
-    // 计算位示图占用的内存大小并标记为已分配
-    uint64 bitmap_size = BITMAP_WORDS * sizeof(uint64);
-    char *bitmap_start = (char*)PGROUNDUP((uint64)end);
-    char *bitmap_end = (char*)PGROUNDUP((uint64)bitmap_start + bitmap_size);
-    
-    // 初始化位示图：全部标记为空闲
+    initlock(&kmem_lock, "kmem");
+    initlock(&cma.lock, "cma");
+    for (int i = 0; i < NCPU; i++) {
+        magazines[i].count = 0;
+        magazines[i].nzeroed = 0;
+    }
+
+    // 内核代码与数据区域（从KERNBASE到end）保持已分配，其余页面交给伙伴系统。
+    // 位示图与计数数组都按整字/整块填充，不逐页设置
+    int first_free = page_index((void*)PGROUNDUP((uint64)end));
     memset(bitmap, 0, sizeof(bitmap));
-    
-    // 标记位示图自身占用的页面为已分配
-    char *p = bitmap_start;
-    while (p < bitmap_end) {
-        int idx = page_index(p);
-        bitmap_set(idx);
-        refcount[idx] = 1;
-        p += PGSIZE;
-    }
-    
-    // 标记内核代码区域为已分配（从KERNBASE到end）
-    p = (char*)KERNBASE;
-    while (p < end) {
-        int idx = page_index(p);
-        bitmap_set(idx);
-        refcount[idx] = 1;
-        p += PGSIZE;
-    }
-    
-    // 计算总空闲页数
-    free_pages_count = 0;
-    for (int i = 0; i < NPAGES; i++) {
-        if (!bitmap_test(i)) {
-            free_pages_count++;
-        }
+    for (int w = 0; w < first_free / BITS_PER_WORD; w++)
+        bitmap[w] = ~0UL;
+    if (first_free % BITS_PER_WORD)
+        bitmap[first_free / BITS_PER_WORD] = (1UL << (first_free % BITS_PER_WORD)) - 1;
+    if (NPAGES % BITS_PER_WORD)
+        bitmap[BITMAP_WORDS - 1] |= ~0UL << (NPAGES % BITS_PER_WORD);   // 末尾不存在的页
+    memset(block_order, -1, sizeof(block_order));
+    memset(refcount, 0, sizeof(refcount));
+    for (int i = 0; i < first_free; i++)
+        refcount[i] = 1;
+    for (int order = 0; order <= MAX_ORDER; order++)
+        free_area[order] = 0;
+
+    // CMA 区取物理内存顶端按 2^MAX_ORDER 对齐的一段，在位示图中标记为已分配
+    cma.base = (NPAGES - CMA_PAGES) & ~((1 << MAX_ORDER) - 1);
+    if (cma.base < first_free)
+        panic("pmm_init: CMA region overlaps kernel");
+    for (int i = cma.base; i < cma.base + CMA_PAGES; i++)
+        bitmap_set(i);
+    cma.nfree = CMA_PAGES;
+    free_pages_count = NPAGES - first_free - CMA_PAGES;
+
+    free_range(first_free, cma.base);
+    free_range(cma.base + CMA_PAGES, NPAGES);
+    METRICS_REGISTER(kalloc_metrics);
+}
+
+// 回收至多 target 页：先收缩 slab 中的空闲 slab，再丢弃页缓存中最久未用的页与
+// 块缓存试用队列中干净空闲块的数据页，不够再丢弃干净的文件映射页，
+// 仍不够时唤醒 kswapd 换出匿名页（写盘要睡眠，不能在这里做）。
+static int pmm_reclaim(int target) {
+    if (in_reclaim)
+        return 0;
+    in_reclaim = 1;
+    int freed = kmem_cache_reap();
+    if (freed < target)
+        freed += pcache_reclaim(target - freed);
+    if (freed < target)
+        freed += bcache_shrink(target - freed);
+    if (freed < target)
+        freed += mmap_reclaim(target - freed);
+    if (freed < target)
+        swap_wakeup();
+    in_reclaim = 0;
+    return freed;
+}
+
+// 空闲页是否低于高水位（kswapd 据此决定是否继续换出）
+int pmm_low_memory(void) {
+    return free_estimate() < HIGH_WATERMARK;
+}
+
+// 启动以来的分配失败次数，缺页处理据此判断失败是否因为内存不足
+unsigned long pmm_alloc_failures(void) {
+    return alloc_failures;
+}
+
+// 从本 hart 缓存（必要时从伙伴系统）取出一页，失败返回 0
+static void* take_page(void) {
+    void *page = 0;
+
+    push_off();
+    struct page_magazine *mag = &magazines[cpuid()];
+    if (mag->count == 0)
+        pcp_refill(mag);
+    if (mag->count > 0)
+        page = mag->pages[--mag->count];
+    else if (mag->nzeroed > 0)
+        page = mag->zeroed[--mag->nzeroed];
+    pop_off();
+    return page;
+}
+
+// 分配一个内容未定义的物理页：调用者保证会完整覆盖页面内容（如 COW 拷贝、内核栈）。
+// 优先命中本 hart 缓存，缓存为空时才批量访问全局伙伴系统，最后才动用预清零页。
+// 没有空闲页时先同步回收一批再重试，跌破低水位时通知空闲循环提前回收。
+// 对外的 alloc_page_nozero/alloc_page 包装 page_alloc_nozero/page_alloc，另外记录调用点
+static void* page_alloc_nozero(void) {
+    void *page = take_page();
+
+    if (page == 0 && pmm_reclaim(RECLAIM_BATCH) > 0)
+        page = take_page();
+    if (page == 0) {
+        alloc_failures++;
+        return 0;  // 内存不足
+    }
+    if (free_estimate() < LOW_WATERMARK)
+        reclaim_wanted = 1;
+    refcount[page_index(page)] = 1;
+    return page;
+}
+
+// 空闲循环调用：空闲页跌破低水位后，回收到高水位为止。返回本次回收的页数。
+int pmm_idle_reclaim(void) {
+    if (!reclaim_wanted)
+        return 0;
+    int want = HIGH_WATERMARK - free_estimate();
+    int freed = want > 0 ? pmm_reclaim(want < RECLAIM_BATCH ? want : RECLAIM_BATCH) : 0;
+    if (freed == 0 || free_estimate() >= HIGH_WATERMARK)
+        reclaim_wanted = 0;   // 已达高水位或无页可回收，等待下次跌破低水位
+    return freed;
+}
+
+void* alloc_page_nozero(void) {
+    void *page = page_alloc_nozero();
+    PROF_PAGES(page, 1);
+    return page;
+}
+
+// 分配一个清零的物理页：命中预清零池时无需同步 memset
+static void* page_alloc(void) {
+    void *page = 0;
+
+    push_off();
+    struct page_magazine *mag = &magazines[cpuid()];
+    if (mag->nzeroed > 0)
+        page = mag->zeroed[--mag->nzeroed];
+    pop_off();
+
+    if (page) {
+        refcount[page_index(page)] = 1;
+        return page;
     }
+
+    page = page_alloc_nozero();
+    if (page) {
+        uint64 start = get_time();
+        memset(page, 0, PGSIZE);  // 预清零池为空，退回同步清零
+        zero_fill_time += get_time() - start;
+    }
+    return page;
 }
 
-// 分配一个物理页
 void* alloc_page(void) {
-    if (free_pages_count <= 0) {
-        return 0;  // 内存不足
+    void *page = page_alloc();
+    PROF_PAGES(page, 1);
+    return page;
+}
+
+// 从 CMA 区借出下标最小的空闲页，没有时返回 0。cma_alloc 从高端找区间，两者尽量错开
+static void* cma_lend(void) {
+    void *page = 0;
+    acquire(&cma.lock);
+    for (int w = 0; w < CMA_WORDS; w++) {
+        uint64 busy = cma.dma[w] | cma.lent[w];
+        if (busy == ~0UL)
+            continue;
+        int off = w * BITS_PER_WORD + ctz64(~busy);
+        cma_set(cma.lent, off);
+        cma.nfree--;
+        cma.nlent++;
+        page = index_to_page(cma.base + off);
+        break;
     }
-    
-    int idx = find_first_free_page();
-    if (idx == -1) {
-        return 0;  // 没有找到空闲页
-    }
-    
-    void *page = index_to_page(idx);
-    bitmap_set(idx);
-    free_pages_count--;
-    refcount[idx] = 1;
-    
-    memset(page, 0, PGSIZE);  // 清零页面
+    release(&cma.lock);
+    return page;
+}
+
+// 为可迁移的匿名用户页分配一页：调用者保证该页只经 rmap 登记的用户映射引用。
+// 伙伴系统的空闲页不多于 CMA 区的空闲页时先借 CMA 页，让预留区在设备不用时也能承担负载；
+// 平时仍走伙伴系统，CMA 区留给 cma_alloc，免去迁移
+static void* page_alloc_movable(int zero) {
+    void *page = 0;
+    if (free_estimate() <= cma.nfree)
+        page = cma_lend();
+    if (page == 0)
+        return zero ? page_alloc() : page_alloc_nozero();
+    refcount[page_index(page)] = 1;
+    if (zero) {
+        uint64 start = get_time();
+        memset(page, 0, PGSIZE);
+        zero_fill_time += get_time() - start;
+    }
+    return page;
+}
+
+void* alloc_page_movable(void) {
+    void *page = page_alloc_movable(1);
+    PROF_PAGES(page, 1);
     return page;
 }
 
+void* alloc_page_movable_nozero(void) {
+    void *page = page_alloc_movable(0);
+    PROF_PAGES(page, 1);
+    return page;
+}
+
+// 空闲循环调用：从本 hart 缓存取页清零后放入预清零池，返回本次清零的页数。
+// 清零过程保持中断开启，池已满或无空闲页时返回 0，调度器随即进入 wfi。
+int pmm_idle_zero(void) {
+    int done = 0;
+
+    while (done < ZERO_BATCH) {
+        void *page = 0;
+
+        push_off();
+        struct page_magazine *mag = &magazines[cpuid()];
+        if (mag->nzeroed < ZERO_POOL_TARGET) {
+            if (mag->count == 0)
+                pcp_refill(mag);
+            if (mag->count > 0)
+                page = mag->pages[--mag->count];
+        }
+        pop_off();
+
+        if (page == 0)
+            break;
+
+        memset(page, 0, PGSIZE);
+
+        push_off();
+        mag = &magazines[cpuid()];
+        if (mag->nzeroed < ZERO_POOL_TARGET) {
+            mag->zeroed[mag->nzeroed++] = page;
+        } else {
+            // 清零期间池被填满（例如中断路径释放页面），退回普通缓存
+            if (mag->count == PCP_CAPACITY)
+                pcp_drain(mag, PCP_BATCH);
+            mag->pages[mag->count++] = page;
+        }
+        pop_off();
+        done++;
+    }
+    idle_zeroed_pages += done;
+    return done;
+}
+
 // 释放一个物理页
 void free_page(void *page) {
     if (((uint64)page % PGSIZE) != 0 ||
@@ -135,24 +566,82 @@ void free_page(void *page) {
         (uint64)page >= PHYSTOP) {
         panic("free_page: invalid page address");
     }
-    
+
     int idx = page_index(page);
     if (!bitmap_test(idx)) {
         panic("free_page: double free detected");
     }
 
-    if (refcount[idx] <= 0) {
+    // 引用计数可能被多个地址空间共享（COW），使用原子减保证并发安全
+    int left = __sync_sub_and_fetch(&refcount[idx], 1);
+    if (left < 0) {
         panic("free_page: invalid refcount");
     }
-
-    refcount[idx]--;
-    if (refcount[idx] > 0) {
+    if (left > 0) {
         return;
     }
+#if ALLOC_PROF
+    allocprof_free(page_site[idx], PGSIZE);
+#endif
+    if (cma_contains(idx)) {
+        cma_put(idx);   // 借出的 CMA 页回到 CMA 区，不进 hart 缓存
+        return;
+    }
+
+    // 释放时不再清零：alloc_page 取页时保证清零，空闲循环会提前完成这部分工作
+    // 放回本 hart 缓存，满了先把最早的 PCP_BATCH 个页面批量归还全局池
+    push_off();
+    struct page_magazine *mag = &magazines[cpuid()];
+    if (mag->count == PCP_CAPACITY)
+        pcp_drain(mag, PCP_BATCH);
+    mag->pages[mag->count++] = page;
+    pop_off();
+}
+
+// 批量放弃 n 个单页的引用，用于拆除整段地址空间。引用降到 0 的页先补满本 hart 的缓存，
+// 其余的在一次持锁中直接归还伙伴系统，而不是逐页放入缓存、满了再整批归还。
+// pages[] 的内容会被改写
+void free_page_bulk(void **pages, int n) {
+    int nfree = 0;
+
+    for (int i = 0; i < n; i++) {
+        void *page = pages[i];
+        if (((uint64)page % PGSIZE) != 0 ||
+            (char*)page < (char*)KERNBASE ||
+            (uint64)page >= PHYSTOP) {
+            panic("free_page_bulk: invalid page address");
+        }
+        int idx = page_index(page);
+        if (!bitmap_test(idx)) {
+            panic("free_page_bulk: double free detected");
+        }
+        int left = __sync_sub_and_fetch(&refcount[idx], 1);
+        if (left < 0) {
+            panic("free_page_bulk: invalid refcount");
+        }
+        if (left > 0)
+            continue;
+#if ALLOC_PROF
+        allocprof_free(page_site[idx], PGSIZE);
+#endif
+        if (cma_contains(idx)) {
+            cma_put(idx);
+            continue;
+        }
+        pages[nfree++] = page;
+    }
 
-    bitmap_clear(idx);
-    free_pages_count++;
-    memset(page, 0, PGSIZE);  // 清零页面（可选，安全考虑）
+    push_off();
+    struct page_magazine *mag = &magazines[cpuid()];
+    while (nfree > 0 && mag->count < PCP_CAPACITY)
+        mag->pages[mag->count++] = pages[--nfree];
+    if (nfree > 0) {
+        acquire(&kmem_lock);
+        for (int i = 0; i < nfree; i++)
+            buddy_free(page_index(pages[i]), 0);
+        release(&kmem_lock);
+    }
+    pop_off();
 }
 
 // 引用计数辅助函数
@@ -164,10 +653,10 @@ void page_incref(void *page) {
     }
 
     int idx = page_index(page);
-    if (!bitmap_test(idx)) {
+    if (!bitmap_test(idx) || refcount[idx] <= 0) {
         panic("page_incref: page not allocated");
     }
-    refcount[idx]++;
+    __sync_fetch_and_add(&refcount[idx], 1);
 }
 
 int page_decref(void *page) {
@@ -189,34 +678,416 @@ int page_refcount(void *page) {
     return refcount[idx];
 }
 
+// ================= 内存规整 =================
+// 在一个按 2^order 对齐的区间内，先把其中的空闲块从伙伴系统摘出（“隔离”），再把其余的页
+// 逐个迁移到区间外（rmap_migrate 改写全部映射），最后把整个区间还给伙伴系统合并成一块。
+// 只有引用全部来自用户映射的页可以迁移；区间内有内核页、页缓存页、被固定的页或其他 hart
+// 缓存中的页时该区间不可用。迁移期间其他 hart 都停在调度器中（sched_stop_others），
+// 没有进程运行，表项与页面内容都不会并发修改
+
+static uint64 compact_isolated[(1 << MAX_ORDER) / BITS_PER_WORD];   // 区间内已隔离的页
+
+static int largest_free_order(void) {
+    for (int k = MAX_ORDER; k >= 0; k--)
+        if (free_area[k])
+            return k;
+    return -1;
+}
+
+// 区间 [w, w + 2^order) 中需要迁移的页数，区间不可规整时返回 -1
+static int compact_cost(int w, int order) {
+    int used = 0;
+    for (int i = w; i < w + (1 << order); i++) {
+        if (i >= NPAGES)
+            return -1;
+        if (bitmap_test(i))
+            used++;
+    }
+    return used;
+}
+
+static int compact_window_movable(int w, int order) {
+    for (int i = w; i < w + (1 << order); i++) {
+        if (block_order[i] >= 0) {
+            i += (1 << block_order[i]) - 1;   // 跳过整个空闲块
+            continue;
+        }
+        if (bitmap_test(i) && !rmap_movable((uint64)index_to_page(i)))
+            return 0;
+    }
+    return 1;
+}
+
+// 挑选需要迁移的页最少、且全部可迁移的区间，跳过已经试过的 tried[0..ntried)
+static int compact_pick(int order, const int *tried, int ntried) {
+    int best = -1, best_cost = 1 << order;
+    for (int w = 0; w < NPAGES; w += (1 << order)) {
+        int skip = 0;
+        for (int t = 0; t < ntried; t++)
+            if (tried[t] == w)
+                skip = 1;
+        if (skip || cma_contains(w))
+            continue;   // CMA 区按 2^MAX_ORDER 对齐，区间要么整个在区内要么整个在区外
+        int cost = compact_cost(w, order);
+        if (cost <= 0 || cost >= best_cost)
+            continue;   // 越界、已经全空（不会出现在需要规整时）或不比当前最优更好
+        if (!compact_window_movable(w, order))
+            continue;
+        best = w;
+        best_cost = cost;
+    }
+    return best;
+}
+
+static inline void isolated_set(int off) {
+    compact_isolated[off / BITS_PER_WORD] |= 1UL << (off % BITS_PER_WORD);
+}
+
+static inline int isolated_test(int off) {
+    return (compact_isolated[off / BITS_PER_WORD] >> (off % BITS_PER_WORD)) & 1;
+}
+
+// 规整区间 w，成功（整个区间已成为空闲块）时返回迁移的页数，否则返回 -1。
+// 失败前已迁移的页留在新位置，不影响正确性
+static int compact_window(int w, int order, int *moved_out) {
+    int npg = 1 << order, moved = 0, failed = 0;
+    memset(compact_isolated, 0, sizeof(compact_isolated));
+
+    acquire(&kmem_lock);
+    for (int i = w; i < w + npg; ) {
+        int o = block_order[i];
+        if (o < 0) {
+            i++;
+            continue;
+        }
+        free_list_remove(i, o);
+        for (int j = 0; j < (1 << o); j++) {
+            bitmap_set(i + j);
+            isolated_set(i + j - w);
+        }
+        free_pages_count -= 1 << o;
+        i += 1 << o;
+    }
+    release(&kmem_lock);
+
+    for (int off = 0; off < npg && !failed; off++) {
+        if (isolated_test(off))
+            continue;
+        uint64 pa = (uint64)index_to_page(w + off);
+        acquire(&kmem_lock);
+        int nidx = buddy_alloc(0);   // 区间内的空闲页都已隔离，取到的一定在区间外
+        release(&kmem_lock);
+        if (nidx < 0) {
+            failed = 1;
+            break;
+        }
+        int n = rmap_migrate(pa, (uint64)index_to_page(nidx));
+        if (n < 0) {
+            acquire(&kmem_lock);
+            buddy_free(nidx, 0);
+            release(&kmem_lock);
+            failed = 1;
+            break;
+        }
+        refcount[nidx] = n;
+        refcount[w + off] = 0;
+#if ALLOC_PROF
+        page_site[nidx] = page_site[w + off];   // 迁移后的页仍记在原调用点上
+#endif
+        isolated_set(off);
+        moved++;
+    }
+
+    // 隔离的页（原空闲页与迁走的页）全部还给伙伴系统，区间完整时自动合并为一块
+    acquire(&kmem_lock);
+    for (int off = 0; off < npg; off++)
+        if (isolated_test(off))
+            buddy_free(w + off, 0);
+    release(&kmem_lock);
+
+    *moved_out = moved;
+    return failed ? -1 : moved;
+}
+
+// 规整出一个至少 order 阶的空闲块，成功返回 0。只能在调度器（空闲循环）中调用
+int pmm_compact(int order) {
+    if (order <= 0 || order > MAX_ORDER)
+        return -1;
+    if (sched_stop_others() < 0)
+        return -1;
+
+    uint64 start = get_time();
+    push_off();
+    pcp_drain(&magazines[cpuid()], PCP_CAPACITY);   // 本 hart 缓存中的页先还给伙伴系统
+    pop_off();
+
+    int tried[COMPACT_TRIES], ok = 0, moved = 0;
+    for (int t = 0; t < COMPACT_TRIES && !ok && largest_free_order() < order; t++) {
+        int w = compact_pick(order, tried, t);
+        if (w < 0)
+            break;
+        tried[t] = w;
+        int m = 0;
+        ok = compact_window(w, order, &m) >= 0;
+        moved += m;
+    }
+    if (largest_free_order() >= order)
+        ok = 1;
+
+    // 迁移改写的表项可能属于任何进程：各进程下次返回用户态前整体刷新 TLB 与翻译缓存。
+    // 其他 hart 上没有进程在运行，不需要核间中断
+    if (moved) {
+        struct proc *p;
+        acquire(&proc_list_lock);
+        for_each_proc(p)
+            tlb_reset(p);
+        release(&proc_list_lock);
+    }
+    sched_resume_others();
+
+    compact_runs++;
+    compact_moved += moved;
+    if (ok)
+        compact_success++;
+    compact_time += get_time() - start;
+    return ok ? 0 : -1;
+}
+
+// 空闲循环调用：alloc_pages 请求过规整或碎片化超过阈值时尝试一次。返回迁移后是否成功
+int pmm_idle_compact(void) {
+    if (ticks - compact_last < COMPACT_INTERVAL)
+        return 0;
+    int order = compact_wanted >= 0 ? compact_wanted : COMPACT_ORDER;
+    if (largest_free_order() >= order) {
+        compact_wanted = -1;
+        return 0;
+    }
+    if (compact_wanted < 0 && free_estimate() < COMPACT_FREE_MIN)
+        return 0;   // 空闲页本来就不多，凑不出大块不算碎片化
+    compact_last = ticks;
+    compact_wanted = -1;
+    return pmm_compact(order) == 0;
+}
+
+// ================= 连续内存区（CMA） =================
+// cma_alloc 先找完全空闲的区间；找不到时选借出页最少的区间，先把整段标记为 dma（其中的页
+// 释放后不再借出，也不回到空闲状态），再在全局停顿中把借出页逐个迁移到伙伴系统的页上。
+// 迁移失败（伙伴系统没有空闲页，或页已被固定、不再可迁移）时撤销标记，换下一个候选区间
+
+// 在 [0, CMA_PAGES - n] 中从高端向下找不含 dma 页、借出页最少的区间，跳过 tried[0..ntried)。
+// 返回区间起点，*lent 为其中的借出页数；没有候选时返回 -1。调用者持有 cma.lock
+static int cma_pick(int n, const int *tried, int ntried, int *lent) {
+    int best = -1, best_lent = n + 1;
+    for (int s = CMA_PAGES - n; s >= 0 && best_lent > 0; s--) {
+        int skip = 0;
+        for (int t = 0; t < ntried; t++)
+            if (tried[t] == s)
+                skip = 1;
+        if (skip)
+            continue;
+        int used = 0;
+        for (int off = s; off < s + n && used < best_lent; off++) {
+            if (cma_test(cma.dma, off)) {
+                used = n + 1;
+                break;
+            }
+            used += cma_test(cma.lent, off);
+        }
+        if (used < best_lent) {
+            best = s;
+            best_lent = used;
+        }
+    }
+    *lent = best_lent;
+    return best;
+}
+
+// 撤销区间 [s, s + n) 的 dma 标记，其间被释放的借出页回到空闲状态
+static void cma_unreserve(int s, int n) {
+    acquire(&cma.lock);
+    for (int off = s; off < s + n; off++) {
+        cma_clear(cma.dma, off);
+        if (!cma_test(cma.lent, off))
+            cma.nfree++;
+    }
+    cma.ndma -= n;
+    release(&cma.lock);
+}
+
+// 把已标记 dma 的区间 [s, s + n) 中仍借出的页迁到伙伴系统的页上，全部迁走返回 0。
+// 其他 hart 停在调度器中，期间本 hart 不能让出 CPU（见 swap_out）
+static int cma_evacuate(int s, int n) {
+    preempt_disable();
+    if (sched_stop_others() < 0) {
+        preempt_enable();
+        return -1;
+    }
+    push_off();
+    pcp_drain(&magazines[cpuid()], PCP_CAPACITY);   // 本 hart 缓存中的页先还给伙伴系统
+    pop_off();
+
+    int moved = 0, failed = 0;
+    for (int off = s; off < s + n && !failed; off++) {
+        acquire(&cma.lock);
+        int lent = cma_test(cma.lent, off);
+        release(&cma.lock);
+        if (!lent)
+            continue;
+        int idx = cma.base + off;
+        acquire(&kmem_lock);
+        int nidx = buddy_alloc(0);
+        release(&kmem_lock);
+        if (nidx < 0) {
+            failed = 1;
+            break;
+        }
+        int r = rmap_migrate((uint64)index_to_page(idx), (uint64)index_to_page(nidx));
+        if (r < 0) {
+            acquire(&kmem_lock);
+            buddy_free(nidx, 0);
+            release(&kmem_lock);
+            failed = 1;
+            break;
+        }
+        refcount[nidx] = r;
+        refcount[idx] = 0;
+#if ALLOC_PROF
+        page_site[nidx] = page_site[idx];
+#endif
+        acquire(&cma.lock);
+        cma_clear(cma.lent, off);
+        cma.nlent--;
+        release(&cma.lock);
+        moved++;
+    }
+
+    // 与 pmm_compact 相同：改写过的表项可能属于任何进程，整体刷新
+    if (moved) {
+        struct proc *p;
+        acquire(&proc_list_lock);
+        for_each_proc(p)
+            tlb_reset(p);
+        release(&proc_list_lock);
+    }
+    sched_resume_others();
+    preempt_enable();
+    cma.migrated += moved;
+    return failed ? -1 : 0;
+}
+
+// 从 CMA 区分配 n 个物理连续、清零的页，失败返回 0。需要迁移借出页时会停顿其他 hart，
+// 只能在进程上下文或启动阶段（此时还没有借出页）调用，不能持有自旋锁
+void* cma_alloc(int n) {
+    if (n <= 0 || n > CMA_PAGES)
+        return 0;
+
+    int tried[CMA_TRIES];
+    for (int t = 0; t < CMA_TRIES; t++) {
+        int lent;
+        acquire(&cma.lock);
+        int s = cma_pick(n, tried, t, &lent);
+        if (s >= 0) {
+            for (int off = s; off < s + n; off++) {
+                if (!cma_test(cma.lent, off))
+                    cma.nfree--;
+                cma_set(cma.dma, off);
+            }
+            cma.ndma += n;
+        }
+        release(&cma.lock);
+        if (s < 0)
+            break;
+        tried[t] = s;
+
+        if (lent > 0 && cma_evacuate(s, n) < 0) {
+            cma_unreserve(s, n);
+            continue;
+        }
+        for (int i = 0; i < n; i++)
+            refcount[cma.base + s + i] = 1;
+        void *start_page = index_to_page(cma.base + s);
+        memset(start_page, 0, (uint64)n * PGSIZE);
+        PROF_PAGES(start_page, n);
+        return start_page;
+    }
+    cma.failures++;
+    return 0;
+}
+
+// 归还 cma_alloc 得到的 n 个页
+void cma_free(void *page, int n) {
+    int idx = page_index(page);
+    if (((uint64)page % PGSIZE) != 0 || n <= 0 ||
+        !cma_contains(idx) || !cma_contains(idx + n - 1))
+        panic("cma_free: not a CMA range");
+
+    acquire(&cma.lock);
+    for (int i = idx; i < idx + n; i++) {
+        int off = i - cma.base;
+        if (!cma_test(cma.dma, off) || refcount[i] != 1)
+            panic("cma_free: page not allocated");
+        cma_clear(cma.dma, off);
+        refcount[i] = 0;
+#if ALLOC_PROF
+        allocprof_free(page_site[i], PGSIZE);
+#endif
+    }
+    cma.nfree += n;
+    cma.ndma -= n;
+    release(&cma.lock);
+}
+
 // 分配连续的n个页面
+// 按 2 的幂向上取整申请一个伙伴块，尾部多出的页面立即归还，保证只占用 n 页
 void* alloc_pages(int n) {
     if (n <= 0) return 0;
-    if (n == 1) return alloc_page();
+    if (n == 1) {
+        void *page = page_alloc();
+        PROF_PAGES(page, 1);
+        return page;
+    }
 
-    if (free_pages_count < n) {
-        return 0;  // 内存不足
+    int order = pages_to_order(n);
+    if (order > MAX_ORDER) {
+        return 0;  // 超出最大块
     }
 
-    int start_idx = find_contiguous_free_pages(n);
+    acquire(&kmem_lock);
+    int start_idx = buddy_alloc(order);
+    release(&kmem_lock);
     if (start_idx == -1) {
-        return 0;  // 没有足够的连续页面
+        // 缓存中的零散页可能阻碍合并，先把本 hart 缓存全部归还再重试一次
+        push_off();
+        pcp_drain(&magazines[cpuid()], PCP_CAPACITY);
+        pop_off();
+        acquire(&kmem_lock);
+        start_idx = buddy_alloc(order);
+        release(&kmem_lock);
+        if (start_idx == -1) {
+            // 没有足够的连续页面：请空闲循环规整，本次由调用者退回单页分配
+            if (order > compact_wanted)
+                compact_wanted = order;
+            return 0;
+        }
+    }
+
+    // 归还尾部多余页面，buddy_free 会自动与相邻空闲块合并
+    acquire(&kmem_lock);
+    for (int i = n; i < (1 << order); i++) {
+        buddy_free(start_idx + i, 0);
     }
+    release(&kmem_lock);
 
-    // 标记这些页面为已分配
     for (int i = 0; i < n; i++) {
-        int idx = start_idx + i;
-        if (bitmap_test(idx)) {
-            panic("alloc_pages: page already allocated");
-        }
-        bitmap_set(idx);
-        refcount[idx] = 1;
+        refcount[start_idx + i] = 1;
     }
 
-    free_pages_count -= n;
     void *start_page = index_to_page(start_idx);
-    memset(start_page, 0, n * PGSIZE);  // 清零所有页面
+    uint64 start = get_time();
+    memset(start_page, 0, (uint64)n * PGSIZE);  // 清零所有页面
+    zero_fill_time += get_time() - start;
 
+    PROF_PAGES(start_page, n);
     return start_page;
 }
 
@@ -230,8 +1101,67 @@ void free_pages(void *page, int n) {
     }
 }
 
+// 填写 meminfo 中由物理页分配器负责的部分：页数、共享页、碎片程度与分配计数
+void pmm_meminfo(struct meminfo *mi) {
+    uint64 cached = 0, zeroed = 0;
+    for (int i = 0; i < NCPU; i++) {
+        cached += magazines[i].count;
+        zeroed += magazines[i].nzeroed;
+    }
+
+    uint64 shared = 0;
+    for (int i = 0; i < NPAGES; i++)
+        if (refcount[i] > 1)
+            shared++;
+
+    // 最长连续空闲区间以伙伴系统位示图为准，hart 缓存中的页不计入
+    uint64 run = 0, longest = 0;
+    acquire(&kmem_lock);
+    mi->free_pages = free_pages_count + cached + zeroed + cma.nfree;
+    for (int i = 0; i < NPAGES; i++) {
+        if (bitmap_test(i)) {
+            run = 0;
+        } else if (++run > longest) {
+            longest = run;
+        }
+    }
+    release(&kmem_lock);
+
+    mi->total_pages = NPAGES;
+    mi->shared_pages = shared;
+    mi->largest_free_run = longest;
+    mi->alloc_failures = alloc_failures;
+    mi->zero_fill_time = zero_fill_time;
+    mi->idle_zeroed_pages = idle_zeroed_pages;
+    mi->compact_runs = compact_runs;
+    mi->compact_success = compact_success;
+    mi->compact_moved = compact_moved;
+    mi->compact_time = compact_time;
+    mi->cma_total = CMA_PAGES;
+    mi->cma_free = cma.nfree;
+    mi->cma_dma = cma.ndma;
+    mi->cma_lent = cma.nlent;
+    mi->cma_migrated = cma.migrated;
+    mi->cma_failures = cma.failures;
+}
+
 // 获取内存统计信息
 void pmm_stats(void) {
-    printf("Memory stats: total=%d, free=%d, allocated=%d\n", 
-           NPAGES, free_pages_count, NPAGES - free_pages_count);
-}
\ No newline at end of file
+    int cached = 0, zeroed = 0;
+    for (int i = 0; i < NCPU; i++) {
+        cached += magazines[i].count;
+        zeroed += magazines[i].nzeroed;
+    }
+    int free = free_pages_count + cached + zeroed;
+    printf("Memory stats: total=%d, free=%d (cached=%d, zeroed=%d), allocated=%d\n",
+           NPAGES, free, cached, zeroed, NPAGES - free);
+    printf("  cma: %d pages, free=%d, dma=%d, lent=%d\n",
+           CMA_PAGES, cma.nfree, cma.ndma, cma.nlent);
+    for (int order = 0; order <= MAX_ORDER; order++) {
+        int blocks = 0;
+        for (struct free_block *b = free_area[order]; b; b = b->next)
+            blocks++;
+        if (blocks)
+            printf("  order %d: %d free blocks\n", order, blocks);
+    }
+}
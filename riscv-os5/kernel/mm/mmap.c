@@ -0,0 +1,369 @@
+// mmap.c: 进程映射区（mmap/munmap）管理。
+// 映射区位于 [MMAP_BASE, MMAP_END) 之间，与 sbrk 堆互不重叠，每个进程最多 NVMA 个区域。
+// exec 另把共享运行库的代码与数据作为两个映射区放在堆之上（见 ulibrt.c），按同样的规则 fork 与回收。
+//   - 匿名共享区（MAP_SHARED|MAP_ANONYMOUS）：建立时立即分配清零页，fork 后父子映射同一组物理页，
+//     借助页引用计数在最后一个映射者解除映射时释放，可用于父子进程间零拷贝通信；
+//   - 匿名私有区（MAP_PRIVATE|MAP_ANONYMOUS）：首次访问时分配清零页，fork 后按写时复制共享；
+//   - 文件映射（只读）：首次访问时直接映射普通文件的页缓存页（内存不足时退回 readi 拷贝一份），
+//     fork 后父子共享只读页。
+// 文件映射页始终是干净的，内存紧张时 mmap_reclaim 可直接丢弃，再次访问时重新从文件读入。
+
+#include "types.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "kalloc.h"
+#include "vm.h"
+#include "proc.h"
+#include "file.h"
+#include "fcntl.h"
+#include "string.h"
+#include "printf.h"
+#include "rmap.h"
+
+// mmap_reclaim 的时钟指针：上一次扫描到的进程 pid，下一次从它在 proc_list 中的后继开始
+static int reclaim_pid;
+
+// PROT_* 转换为用户页表项权限
+static int prot2perm(int prot)
+{
+    int perm = PTE_U;
+    if(prot & PROT_READ)
+        perm |= PTE_R;
+    if(prot & PROT_WRITE)
+        perm |= PTE_W;
+    if(prot & PROT_EXEC)
+        perm |= PTE_X;
+    return perm;
+}
+
+// 查找包含 va 的映射区，不存在返回 0
+static struct vma* vma_find(struct proc *p, uint64 va)
+{
+    for(int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vma[i];
+        if(v->end && va >= v->start && va < v->end)
+            return v;
+    }
+    return 0;
+}
+
+static struct vma* vma_alloc(struct proc *p)
+{
+    for(int i = 0; i < NVMA; i++) {
+        if(p->vma[i].end == 0)
+            return &p->vma[i];
+    }
+    return 0;
+}
+
+// 在映射区中首次适配一段长度为 len 的空闲虚拟地址，失败返回 0
+static uint64 vma_place(struct proc *p, uint64 len)
+{
+    uint64 addr = MMAP_BASE;
+    int moved;
+    do {
+        moved = 0;
+        for(int i = 0; i < NVMA; i++) {
+            struct vma *v = &p->vma[i];
+            if(v->end && addr < v->end && addr + len > v->start) {
+                addr = v->end;
+                moved = 1;
+            }
+        }
+    } while(moved);
+    if(addr + len < addr || addr + len > MMAP_END)
+        return 0;
+    return addr;
+}
+
+// mmap_create: 在当前进程中建立一个映射区，返回起始地址，失败返回 -1。
+// f 非空时为文件映射（调用者已校验可读），映射区持有该文件的一个引用。
+uint64 mmap_create(uint64 len, int prot, int flags, struct file *f, uint64 off)
+{
+    struct proc *p = myproc();
+    int shared = (flags & MAP_SHARED) != 0;
+
+    if(len == 0 || shared == ((flags & MAP_PRIVATE) != 0))
+        return -1;   // 长度为 0，或 SHARED/PRIVATE 未指定恰好一个
+    if(f == 0 && !(flags & MAP_ANONYMOUS))
+        return -1;
+    if(f && (prot & PROT_WRITE))
+        return -1;   // 不支持写回，文件只能只读映射
+    if(off % PGSIZE)
+        return -1;
+
+    len = PGROUNDUP(len);
+    struct vma *v = vma_alloc(p);
+    uint64 start = vma_place(p, len);
+    if(v == 0 || start == 0)
+        return -1;
+
+    v->start = start;
+    v->end = start + len;
+    v->perm = prot2perm(prot);
+    v->shared = shared;
+    v->file = f ? filedup(f) : 0;
+    v->off = off;
+
+    // 共享匿名页必须在 fork 之前存在，否则父子会各自按需分配出不同的页
+    if(shared && f == 0) {
+        for(uint64 va = start; va < v->end; va += PGSIZE) {
+            void *mem = alloc_page();
+            if(mem == 0 || map_page(p->pagetable, va, (uint64)mem, v->perm) < 0) {
+                if(mem)
+                    free_page(mem);
+                mmap_remove(start, len);
+                return -1;
+            }
+        }
+    }
+    tgroup_sync(p);
+    return start;
+}
+
+// 解除 [start, end) 的页映射，同时释放（或减少引用）对应的物理页。内存不足时返回 -1
+static int vma_unmap(struct proc *p, uint64 start, uint64 end)
+{
+    if(p->pagetable && end > start)
+        return uvmunmap(p->pagetable, start, (end - start) / PGSIZE, 1);
+    return 0;
+}
+
+// mmap_remove: 解除当前进程 [addr, addr+len) 范围内的映射。
+// 区间可以覆盖映射区的首部、尾部或中间一段，中间解除时把原区域拆成两个。
+int mmap_remove(uint64 addr, uint64 len)
+{
+    struct proc *p = myproc();
+
+    if(addr % PGSIZE || len == 0)
+        return -1;
+    uint64 end = addr + PGROUNDUP(len);
+    if(end < addr)
+        return -1;
+
+    for(int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vma[i];
+        if(v->end == 0 || end <= v->start || addr >= v->end)
+            continue;
+
+        uint64 lo = addr > v->start ? addr : v->start;
+        uint64 hi = end < v->end ? end : v->end;
+
+        // 先备好拆分所需的槽位并解除映射，失败时该区域的记录保持不变
+        struct vma *tail = 0;
+        if(lo > v->start && hi < v->end)
+            tail = vma_alloc(p);
+        if((lo > v->start && hi < v->end && tail == 0) || vma_unmap(p, lo, hi) < 0) {
+            tgroup_sync(p);
+            return -1;
+        }
+
+        if(tail) {
+            // 从中间挖去一段：后半部分放入新的槽位
+            *tail = *v;
+            tail->start = hi;
+            tail->off = v->off + (hi - v->start);
+            if(tail->file)
+                filedup(tail->file);
+            v->end = lo;
+        } else if(lo > v->start) {
+            v->end = lo;
+        } else if(hi < v->end) {
+            v->off += hi - v->start;
+            v->start = hi;
+        } else {
+            v->end = 0;
+        }
+
+        if(v->end == 0 && v->file) {
+            fileclose(v->file);
+            v->file = 0;
+        }
+    }
+    tgroup_sync(p);
+    return 0;
+}
+
+// mmap_resolve: faultva 落在映射区内且尚未映射时补上对应页。成功返回 0。
+// 文件映射从 inode 读取整页内容，超出文件末尾的部分保持为 0。
+int mmap_resolve(struct proc *p, uint64 faultva)
+{
+    uint64 va0 = PGROUNDDOWN(faultva);
+    struct vma *v = vma_find(p, va0);
+    if(v == 0)
+        return -1;
+
+    pte_t *pte = walk_lookup(p->pagetable, va0);
+    if(pte && (*pte & PTE_V)) {
+        // 回收扫描清除了 A 位：不会自动置位 A 的硬件在此触发缺页，补上 A 位即可
+        if(v->file && !(*pte & PTE_A)) {
+            *pte |= PTE_A;
+            tlb_invalidate_page(p->pagetable, va0);
+            return 0;
+        }
+        return -1;   // 已有映射，属于权限错误
+    }
+
+    void *mem = 0;
+    int kind = FAULT_LAZY;
+    if(v->file) {
+        struct inode *ip = v->file->ip;
+        uint32 off = v->off + (va0 - v->start);
+        ilock(ip);
+        kind = ipage_cached(ip, off / PGSIZE) ? FAULT_MINOR : FAULT_MAJOR;
+        if((mem = ipage_map(ip, off / PGSIZE)) == 0 && (mem = alloc_page()) != 0 &&
+           readi(ip, 0, (uint64)mem, off, PGSIZE) < 0) {
+            free_page(mem);
+            mem = 0;
+        }
+        iunlock(ip);
+    } else {
+        mem = alloc_page();
+    }
+    if(mem == 0)
+        return -1;
+
+    if(map_page(p->pagetable, va0, (uint64)mem, v->perm) < 0) {
+        free_page(mem);
+        return -1;
+    }
+    fault_note(kind);
+    return 0;
+}
+
+// mmap_fork: 把父进程 p 的映射区复制到子进程 np。
+// 共享区与只读页直接映射同一物理页；私有可写页在父子两侧都改为只读 COW。
+int mmap_fork(struct proc *p, struct proc *np)
+{
+    int cow = 0;
+
+    for(int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vma[i];
+        if(v->end == 0)
+            continue;
+
+        np->vma[i] = *v;
+        if(v->file)
+            filedup(v->file);
+
+        for(uint64 va = v->start; va < v->end; va += PGSIZE) {
+            pte_t *pte = walk_lookup(p->pagetable, va);
+            if(pte == 0 || (*pte & PTE_V) == 0)
+                continue;   // 尚未访问的页，子进程同样按需填充
+
+            if(!v->shared && (*pte & PTE_W)) {
+                *pte = (*pte & ~PTE_W) | PTE_COW;
+                cow = 1;
+            }
+            uint64 pa = PTE2PA(*pte);
+            // 先加引用再建映射：map_page 分配页表时可能触发回收，引用计数大于 1 的页不会被丢弃
+            page_incref((void *)pa);
+            if(map_page(np->pagetable, va, pa, PTE_FLAGS(*pte) & ~PTE_V) < 0) {
+                page_decref((void *)pa);
+                return -1;   // 调用者通过 free_process 回收子进程已建立的部分
+            }
+        }
+    }
+
+    if(cow)
+        tlb_invalidate_all(p->pagetable);
+    return 0;
+}
+
+// 一次 mmap_reclaim 最多回收的页数：解除映射的页先记在栈上，TLB 刷新完成后再释放
+#define RECLAIM_MAX 32
+
+struct reclaimed {
+    int n;
+    uint64 pa[RECLAIM_MAX];
+    int refs[RECLAIM_MAX];    // 解除的映射数，即要放弃的引用数
+};
+
+// 对进程 p 的文件映射页执行一轮二次机会扫描：通过反向映射检查该物理页的全部映射者，
+// 任一映射者的 A 位置位则统一清除后保留，否则一次解除所有映射（含 fork 出的子进程）并释放。
+// 解除映射的页记入 r，最多 target 页；*touched 记录是否修改过页表。
+static void reclaim_proc(struct proc *p, int target, int *touched, struct reclaimed *r)
+{
+    int freed = 0;
+
+    for(int i = 0; i < NVMA && freed < target; i++) {
+        struct vma *v = &p->vma[i];
+        if(v->end == 0 || v->file == 0)
+            continue;
+        for(uint64 va = v->start; va < v->end && freed < target; va += PGSIZE) {
+            pte_t *pte = walk_lookup(p->pagetable, va);
+            if(pte == 0 || (*pte & PTE_V) == 0)
+                continue;
+            uint64 pa = PTE2PA(*pte);
+            if(rmap_test_and_clear_young(pa)) {
+                *touched = 1;     // 给予第二次机会
+                continue;
+            }
+            int refs = rmap_unmap_all(pa);
+            if(refs > 0) {
+                *touched = 1;
+                r->pa[r->n] = pa;
+                r->refs[r->n] = refs;
+                r->n++;
+                freed++;
+            }
+        }
+    }
+}
+
+// mmap_reclaim: 内存不足时由 kalloc 调用，按时钟顺序扫描各进程的文件映射页，
+// 最多转两圈（第一圈清 A 位，第二圈回收仍未被访问的页）。返回释放的页数。
+// 扫描期间持有 proc_list_lock，进程不会被释放；分配进程控制块时不持有该锁，不会在此重入
+int mmap_reclaim(int target)
+{
+    int freed = 0, touched = 0;
+    struct proc *p;
+    struct reclaimed r;
+
+    r.n = 0;
+    if(target > RECLAIM_MAX)
+        target = RECLAIM_MAX;
+
+    acquire(&proc_list_lock);
+    int n = 2 * proc_count();
+    for(p = proc_find(reclaim_pid); n > 0 && freed < target; n--) {
+        p = (p && p->all_next) ? p->all_next : proc_list;
+        if(p == 0)
+            break;
+        reclaim_pid = p->pid;
+        if(p->state == UNUSED || p->state == ZOMBIE || p->pagetable == 0)
+            continue;
+        reclaim_proc(p, target - freed, &touched, &r);
+        freed = r.n;
+    }
+
+    // 经反向映射修改的表项可能属于任何进程，让所有进程返回用户态前整体刷新各自的 ASID
+    if(touched) {
+        for_each_proc(p)
+            tlb_reset(p);
+    }
+    release(&proc_list_lock);
+    // 正在其他 hart 上运行的进程不会经过 tlb_sync，立即让这些 hart 刷新；
+    // 须在释放 proc_list_lock 之后，否则等锁（关中断）的 hart 无法响应核间中断
+    if(touched)
+        tlb_shootdown(CPUMASK_ALL);
+    // 所有 hart 都已丢弃旧条目，此时才放弃页面引用
+    for(int i = 0; i < r.n; i++)
+        for(int k = 0; k < r.refs[i]; k++)
+            free_page((void *)r.pa[i]);
+    return freed;
+}
+
+// mmap_release: 解除进程的全部映射区，并放弃映射文件的引用（exec 与进程回收时调用）
+void mmap_release(struct proc *p)
+{
+    for(int i = 0; i < NVMA; i++) {
+        struct vma *v = &p->vma[i];
+        if(v->end == 0)
+            continue;
+        vma_unmap(p, v->start, v->end);   // 失败时残留的映射随之后的整表回收一并释放
+        if(v->file)
+            fileclose(v->file);
+        memset(v, 0, sizeof(*v));
+    }
+}
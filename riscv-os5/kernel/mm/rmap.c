@@ -0,0 +1,218 @@
+#include "types.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "printf.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "rmap.h"
+#include "string.h"
+#include "vm.h"
+
+// 反向映射表：rmap_heads[i] 串起引用第 i 个物理页的全部用户页表项。
+// 表项节点来自 slab，每个 4KB 用户映射一个；链表通常只有 1~2 个节点，查找直接线性扫描。
+
+#define RMAP_NPAGES ((PHYSTOP - (uint64)KERNBASE) / PGSIZE)
+
+struct rmap_entry {
+    pte_t *pte;                 // 引用该页的叶子页表项
+    uint64 va;                  // 建立映射时的用户虚拟地址（调试与统计用）
+    struct rmap_entry *next;
+};
+
+static struct rmap_entry *rmap_heads[RMAP_NPAGES];
+static struct kmem_cache *rmap_cache;
+static struct spinlock rmap_lock;
+
+// 物理页对应的链表头，不在 RAM 范围内的地址返回 0
+static struct rmap_entry **rmap_slot(uint64 pa) {
+    if (pa < KERNBASE || pa >= PHYSTOP)
+        return 0;
+    if (pa == (uint64)zero_page)
+        return 0;   // 共享零页可能被成千上万个表项映射，它既不迁移也不回收，不必登记
+    return &rmap_heads[(pa - KERNBASE) / PGSIZE];
+}
+
+void rmap_init(void) {
+    initlock(&rmap_lock, "rmap");
+    rmap_cache = kmem_cache_create("rmap", sizeof(struct rmap_entry), 0);
+    if (rmap_cache == 0)
+        panic("rmap_init");
+}
+
+int rmap_add(uint64 pa, pte_t *pte, uint64 va) {
+    struct rmap_entry **slot = rmap_slot(PGROUNDDOWN(pa));
+    if (slot == 0)
+        return 0;   // 设备等非 RAM 页不参与引用计数，也无需登记
+
+    // 先分配节点再加锁：分配过程中可能触发回收，回收会调用 rmap_remove
+    struct rmap_entry *e = kmem_cache_alloc(rmap_cache);
+    if (e == 0)
+        return -1;
+    e->pte = pte;
+    e->va = va;
+
+    acquire(&rmap_lock);
+    e->next = *slot;
+    *slot = e;
+    release(&rmap_lock);
+    return 0;
+}
+
+// 删除 pa 上 pte 对应的记录；未登记的映射（如来自大页）直接忽略
+void rmap_remove(uint64 pa, pte_t *pte) {
+    struct rmap_entry **slot = rmap_slot(PGROUNDDOWN(pa));
+    if (slot == 0)
+        return;
+
+    acquire(&rmap_lock);
+    struct rmap_entry *e = 0;
+    for (struct rmap_entry **pp = slot; *pp; pp = &(*pp)->next) {
+        if ((*pp)->pte == pte) {
+            e = *pp;
+            *pp = e->next;
+            break;
+        }
+    }
+    release(&rmap_lock);
+
+    if (e)
+        kmem_cache_free(rmap_cache, e);
+}
+
+int rmap_count(uint64 pa) {
+    struct rmap_entry **slot = rmap_slot(PGROUNDDOWN(pa));
+    if (slot == 0)
+        return 0;
+
+    int n = 0;
+    acquire(&rmap_lock);
+    for (struct rmap_entry *e = *slot; e; e = e->next)
+        n++;
+    release(&rmap_lock);
+    return n;
+}
+
+// 回收扫描使用：检查所有映射者的 A 位，并统一清除，实现按物理页的二次机会。
+// 调用者负责随后刷新相关进程的 TLB。
+int rmap_test_and_clear_young(uint64 pa) {
+    struct rmap_entry **slot = rmap_slot(PGROUNDDOWN(pa));
+    if (slot == 0)
+        return 0;
+
+    int young = 0;
+    acquire(&rmap_lock);
+    for (struct rmap_entry *e = *slot; e; e = e->next) {
+        if (*e->pte & PTE_A) {
+            young = 1;
+            *e->pte &= ~PTE_A;
+        }
+    }
+    release(&rmap_lock);
+    return young;
+}
+
+// 清除所有引用 pa 的页表项，返回清除的表项数 n。
+// 登记数与引用计数不符（存在大页或内核持有的引用）时不做任何修改，返回 -1。
+// 页面上的 n 个引用留给调用者：其他 hart 的 TLB 可能仍缓存着这些表项，
+// 须在刷新完成后再放弃引用，否则页面可能在被旧条目访问时已另作他用。
+int rmap_unmap_all(uint64 pa) {
+    pa = PGROUNDDOWN(pa);
+    struct rmap_entry **slot = rmap_slot(pa);
+    if (slot == 0)
+        return -1;
+
+    acquire(&rmap_lock);
+    int n = 0;
+    for (struct rmap_entry *e = *slot; e; e = e->next)
+        n++;
+    if (n == 0 || n != page_refcount((void *)pa)) {
+        release(&rmap_lock);
+        return -1;
+    }
+    struct rmap_entry *list = *slot;
+    *slot = 0;
+    for (struct rmap_entry *e = list; e; e = e->next)
+        *e->pte = 0;
+    release(&rmap_lock);
+
+    while (list) {
+        struct rmap_entry *next = list->next;
+        kmem_cache_free(rmap_cache, list);
+        list = next;
+    }
+    return n;
+}
+
+// 可迁移：有登记的映射，且引用全部来自这些映射（没有页缓存、网络发送或 futex 等待者持有的引用）
+int rmap_movable(uint64 pa) {
+    struct rmap_entry **slot = rmap_slot(PGROUNDDOWN(pa));
+    if (slot == 0)
+        return 0;
+
+    int n = 0;
+    acquire(&rmap_lock);
+    for (struct rmap_entry *e = *slot; e; e = e->next)
+        n++;
+    int ok = n > 0 && n == page_refcount((void *)PGROUNDDOWN(pa));
+    release(&rmap_lock);
+    return ok;
+}
+
+// 页面迁移（内存规整使用）：把 pa 的内容拷到 newpa，全部映射改指 newpa 并保留权限位，
+// 链表随之移到 newpa 名下。调用者保证此时没有进程在运行（不会有人同时修改这些表项或
+// 写该页），并在之后让各进程刷新 TLB；pa 上的引用计数与 newpa 的新计数由调用者调整。
+// 返回迁移的映射数，pa 已不可迁移时返回 -1
+int rmap_migrate(uint64 pa, uint64 newpa) {
+    struct rmap_entry **slot = rmap_slot(pa), **nslot = rmap_slot(newpa);
+    if (slot == 0 || nslot == 0)
+        return -1;
+
+    acquire(&rmap_lock);
+    int n = 0;
+    for (struct rmap_entry *e = *slot; e; e = e->next)
+        n++;
+    if (n == 0 || n != page_refcount((void *)pa) || *nslot) {
+        release(&rmap_lock);
+        return -1;
+    }
+    memmove((void *)newpa, (void *)pa, PGSIZE);
+    for (struct rmap_entry *e = *slot; e; e = e->next)
+        *e->pte = PA2PTE(newpa) | PTE_FLAGS(*e->pte);
+    // 节点记录的是表项地址，表项本身不动，整条链表直接移到新页名下
+    *nslot = *slot;
+    *slot = 0;
+    release(&rmap_lock);
+    return n;
+}
+
+// 换出（swap.c 使用）：把引用 pa 的全部表项改为换出表项 swpte，各表项保留自己的
+// R/W/X/U/COW 位，换入时据此恢复权限。节点随之释放，页面上的引用计数留给调用者在
+// 写盘完成后放弃。与 rmap_migrate 一样要求此时没有进程在运行，TLB 由调用者刷新。
+// 返回改写的表项数，pa 不可换出时返回 -1
+int rmap_swap_out(uint64 pa, pte_t swpte) {
+    struct rmap_entry **slot = rmap_slot(pa);
+    if (slot == 0)
+        return -1;
+
+    acquire(&rmap_lock);
+    int n = 0;
+    for (struct rmap_entry *e = *slot; e; e = e->next)
+        n++;
+    if (n == 0 || n != page_refcount((void *)pa)) {
+        release(&rmap_lock);
+        return -1;
+    }
+    struct rmap_entry *list = *slot;
+    *slot = 0;
+    for (struct rmap_entry *e = list; e; e = e->next)
+        *e->pte = swpte | (*e->pte & (PTE_R | PTE_W | PTE_X | PTE_U | PTE_COW));
+    release(&rmap_lock);
+
+    while (list) {
+        struct rmap_entry *next = list->next;
+        kmem_cache_free(rmap_cache, list);
+        list = next;
+    }
+    return n;
+}
@@ -0,0 +1,297 @@
+#include "types.h"
+#include "riscv.h"
+#include "printf.h"
+#include "string.h"
+#include "spinlock.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "allocprof.h"
+
+// slab 分配器：每个 slab 占一页，页首放 slab 头，其后是等长的对象槽位。
+// 对象地址按页向下取整即可找到所属 slab，因此释放时无需额外查表。
+//
+// 空闲对象通过嵌入在对象内部的单链表串起来。若 cache 带构造函数，
+// 链表指针放在对象之后的额外 8 字节里，避免覆盖已构造的内容。
+// ALLOC_PROF 为 1 时槽位末尾再多 8 字节，记录分配该对象的调用点编号。
+
+#define NKMEM_CACHE 16   // 系统中最多可创建的 cache 数量
+#define SLAB_ALIGN  8    // 对象最小对齐
+
+struct slab {
+    struct slab *next;        // 所在链表（partial/full/empty）中的链接
+    struct slab *prev;
+    struct kmem_cache *cache; // 所属 cache，用于释放时校验
+    int inuse;                // 已分配对象个数
+    void *freelist;           // 本 slab 内的空闲对象链表
+};
+
+struct kmem_cache {
+    char name[16];
+    uint size;                // 调用者请求的对象大小
+    uint stride;              // 槽位步长（含对齐与空闲指针）
+    uint free_offset;         // 空闲链表指针在对象内的偏移
+    int objs_per_slab;
+    void (*ctor)(void *);
+    struct spinlock lock;
+    struct slab *partial;     // 部分空闲的 slab，分配优先从这里取
+    struct slab *full;        // 已满的 slab
+    struct slab *empty;       // 全空的 slab，保留一个以避免抖动，其余还给 kalloc
+    int nempty;
+    int nslabs;
+    int nactive;              // 已分配出去的对象数
+#if ALLOC_PROF
+    uint tag_offset;          // 调用点编号在槽位内的偏移
+#endif
+    int used;                 // cache 描述符本身是否已占用
+};
+
+static struct kmem_cache caches[NKMEM_CACHE];
+static struct spinlock cache_table_lock;
+
+#define SLAB_HDR_SIZE ((sizeof(struct slab) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+static inline void **free_ptr(struct kmem_cache *c, void *obj)
+{
+    return (void **)((char *)obj + c->free_offset);
+}
+
+static inline struct slab *obj_to_slab(void *obj)
+{
+    return (struct slab *)PGROUNDDOWN((uint64)obj);
+}
+
+static void slab_list_push(struct slab **head, struct slab *s)
+{
+    s->prev = 0;
+    s->next = *head;
+    if(*head)
+        (*head)->prev = s;
+    *head = s;
+}
+
+static void slab_list_remove(struct slab **head, struct slab *s)
+{
+    if(s->prev)
+        s->prev->next = s->next;
+    else
+        *head = s->next;
+    if(s->next)
+        s->next->prev = s->prev;
+    s->next = s->prev = 0;
+}
+
+void kmem_cache_init(void)
+{
+    initlock(&cache_table_lock, "kmem_cache");
+    memset(caches, 0, sizeof(caches));
+}
+
+// 创建一个对象大小为 size 的 cache。ctor 可为空；非空时在 slab 新建时对每个对象调用一次。
+// 对象过大（单页放不下一个）或 cache 表已满时返回 0。
+struct kmem_cache* kmem_cache_create(const char *name, uint size, void (*ctor)(void *))
+{
+    struct kmem_cache *c = 0;
+    uint stride, free_offset;
+
+    if(size == 0)
+        return 0;
+
+    stride = (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+    if(ctor) {
+        free_offset = stride;
+        stride += sizeof(void *);
+    } else {
+        free_offset = 0;
+        if(stride < sizeof(void *))
+            stride = sizeof(void *);
+    }
+#if ALLOC_PROF
+    uint tag_offset = stride;
+    stride += sizeof(uint64);
+#endif
+    if(SLAB_HDR_SIZE + stride > PGSIZE)
+        return 0;
+
+    acquire(&cache_table_lock);
+    for(int i = 0; i < NKMEM_CACHE; i++) {
+        if(!caches[i].used) {
+            c = &caches[i];
+            c->used = 1;
+            break;
+        }
+    }
+    release(&cache_table_lock);
+    if(c == 0)
+        return 0;
+
+    safestrcpy(c->name, name, sizeof(c->name));
+    c->size = size;
+    c->stride = stride;
+    c->free_offset = free_offset;
+    c->objs_per_slab = (PGSIZE - SLAB_HDR_SIZE) / stride;
+    c->ctor = ctor;
+#if ALLOC_PROF
+    c->tag_offset = tag_offset;
+#endif
+    c->partial = c->full = c->empty = 0;
+    c->nempty = c->nslabs = c->nactive = 0;
+    initlock(&c->lock, c->name);
+    return c;
+}
+
+// 从 kalloc 取一页，切分成对象并串成空闲链表；调用者不持有 cache 锁
+static struct slab *slab_grow(struct kmem_cache *c)
+{
+    struct slab *s = alloc_page_nozero();
+    if(s == 0)
+        return 0;
+
+    s->cache = c;
+    s->inuse = 0;
+    s->next = s->prev = 0;
+    s->freelist = 0;
+
+    char *base = (char *)s + SLAB_HDR_SIZE;
+    for(int i = c->objs_per_slab - 1; i >= 0; i--) {
+        void *obj = base + (uint64)i * c->stride;
+        if(c->ctor)
+            c->ctor(obj);
+        *free_ptr(c, obj) = s->freelist;
+        s->freelist = obj;
+    }
+    return s;
+}
+
+void* kmem_cache_alloc(struct kmem_cache *c)
+{
+    struct slab *s;
+    void *obj;
+
+    acquire(&c->lock);
+    s = c->partial;
+    if(s == 0 && c->empty) {
+        s = c->empty;
+        slab_list_remove(&c->empty, s);
+        c->nempty--;
+        slab_list_push(&c->partial, s);
+    }
+    if(s == 0) {
+        // 新建 slab 时释放锁，构造函数可能较慢
+        release(&c->lock);
+        s = slab_grow(c);
+        if(s == 0)
+            return 0;
+        acquire(&c->lock);
+        c->nslabs++;
+        slab_list_push(&c->partial, s);
+    }
+
+    obj = s->freelist;
+    s->freelist = *free_ptr(c, obj);
+    s->inuse++;
+    c->nactive++;
+    if(s->inuse == c->objs_per_slab) {
+        slab_list_remove(&c->partial, s);
+        slab_list_push(&c->full, s);
+    }
+    release(&c->lock);
+#if ALLOC_PROF
+    *(int *)((char *)obj + c->tag_offset) =
+        allocprof_alloc((uint64)__builtin_return_address(0), c->name, 1, c->size);
+#endif
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+    struct slab *s;
+
+    if(obj == 0)
+        return;
+    s = obj_to_slab(obj);
+    if(s->cache != c)
+        panic("kmem_cache_free: object not from this cache");
+    if(((char *)obj - ((char *)s + SLAB_HDR_SIZE)) % c->stride != 0)
+        panic("kmem_cache_free: misaligned object");
+
+#if ALLOC_PROF
+    allocprof_free(*(int *)((char *)obj + c->tag_offset), c->size);
+#endif
+    acquire(&c->lock);
+    if(s->inuse <= 0)
+        panic("kmem_cache_free: slab underflow");
+
+    if(s->inuse == c->objs_per_slab) {
+        slab_list_remove(&c->full, s);
+        slab_list_push(&c->partial, s);
+    }
+    *free_ptr(c, obj) = s->freelist;
+    s->freelist = obj;
+    s->inuse--;
+    c->nactive--;
+
+    if(s->inuse == 0) {
+        slab_list_remove(&c->partial, s);
+        if(c->nempty == 0) {
+            slab_list_push(&c->empty, s);
+            c->nempty++;
+            s = 0;
+        } else {
+            c->nslabs--;
+        }
+    } else {
+        s = 0;
+    }
+    release(&c->lock);
+
+    if(s) {
+        s->cache = 0;
+        free_page(s);
+    }
+}
+
+// 把 cache 中全部空闲 slab 归还给 kalloc，返回释放的页数
+int kmem_cache_shrink(struct kmem_cache *c)
+{
+    struct slab *list;
+    int n = 0;
+
+    acquire(&c->lock);
+    list = c->empty;
+    c->empty = 0;
+    c->nslabs -= c->nempty;
+    c->nempty = 0;
+    release(&c->lock);
+
+    while(list) {
+        struct slab *next = list->next;
+        list->cache = 0;
+        free_page(list);
+        list = next;
+        n++;
+    }
+    return n;
+}
+
+// 内存紧张时调用：收缩所有 cache，返回归还给 kalloc 的页数
+int kmem_cache_reap(void)
+{
+    int n = 0;
+    for(int i = 0; i < NKMEM_CACHE; i++) {
+        if(caches[i].used)
+            n += kmem_cache_shrink(&caches[i]);
+    }
+    return n;
+}
+
+void kmem_cache_stats(void)
+{
+    printf("=== Slab Caches ===\n");
+    for(int i = 0; i < NKMEM_CACHE; i++) {
+        struct kmem_cache *c = &caches[i];
+        if(!c->used)
+            continue;
+        printf("%s: objsize=%d stride=%d per_slab=%d slabs=%d active=%d\n",
+               c->name, c->size, c->stride, c->objs_per_slab, c->nslabs, c->nactive);
+    }
+}
@@ -1,13 +1,104 @@
 #include "types.h"
+#include "printf.h"
+#include "string.h"
+#include "trap.h"
 
-void* memset(void *dst, int c, uint n)
+// 内存操作例程：按 8 字节字宽 + 8 路展开处理对齐的主体部分，头尾不对齐部分逐字节处理。
+// 若编译参数 -march 含 V 扩展（编译器定义 __riscv_vector），memset/memmove 的主体改走 RVV 向量路径。
+
+#define WORD_SIZE  sizeof(uint64)
+#define WORD_MASK  (WORD_SIZE - 1)
+#define BLOCK_BYTES (8 * WORD_SIZE)   // 8 路展开一次处理 64 字节
+
+// 禁止 GCC 把下面的循环识别为 memset/memcpy 调用，否则会生成对自身的递归调用
+#define NO_LIBCALL __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+#ifdef __riscv_vector
+// RVV 向量填充：每轮 vsetvli 取得本轮可处理的字节数，vse8 一次写出整组向量寄存器
+static void rvv_fill(char *d, int c, uint64 n)
+{
+  uint64 vl;
+  asm volatile(
+    "vsetvli %0, %2, e8, m8, ta, ma\n"
+    "vmv.v.x v0, %3\n"
+    "1:\n"
+    "vsetvli %0, %2, e8, m8, ta, ma\n"
+    "vse8.v v0, (%1)\n"
+    "add %1, %1, %0\n"
+    "sub %2, %2, %0\n"
+    "bnez %2, 1b\n"
+    : "=&r"(vl), "+r"(d), "+r"(n)
+    : "r"(c)
+    : "memory", "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7");
+}
+
+// RVV 向量正向拷贝，仅用于不重叠或目标位于源之前的情形
+static void rvv_copy_forward(char *d, const char *s, uint64 n)
+{
+  uint64 vl;
+  asm volatile(
+    "1:\n"
+    "vsetvli %0, %3, e8, m8, ta, ma\n"
+    "vle8.v v0, (%2)\n"
+    "vse8.v v0, (%1)\n"
+    "add %1, %1, %0\n"
+    "add %2, %2, %0\n"
+    "sub %3, %3, %0\n"
+    "bnez %3, 1b\n"
+    : "=&r"(vl), "+r"(d), "+r"(s), "+r"(n)
+    :
+    : "memory", "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7");
+}
+#endif
+
+NO_LIBCALL void* memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 len = n;
+
+  if(len == 0)
+    return dst;
+
+#ifdef __riscv_vector
+  rvv_fill(cdst, c & 0xff, len);
+  return dst;
+#else
+  // 头部：逐字节直到 8 字节对齐
+  while(len > 0 && ((uint64)cdst & WORD_MASK)) {
+    *cdst++ = c;
+    len--;
   }
+
+  // 主体：构造 8 字节填充字，每轮写 64 字节
+  uint64 pattern = (uint8)c;
+  pattern |= pattern << 8;
+  pattern |= pattern << 16;
+  pattern |= pattern << 32;
+
+  uint64 *wdst = (uint64 *)cdst;
+  while(len >= BLOCK_BYTES) {
+    wdst[0] = pattern;
+    wdst[1] = pattern;
+    wdst[2] = pattern;
+    wdst[3] = pattern;
+    wdst[4] = pattern;
+    wdst[5] = pattern;
+    wdst[6] = pattern;
+    wdst[7] = pattern;
+    wdst += 8;
+    len -= BLOCK_BYTES;
+  }
+  while(len >= WORD_SIZE) {
+    *wdst++ = pattern;
+    len -= WORD_SIZE;
+  }
+
+  // 尾部：剩余不足 8 字节的部分
+  cdst = (char *)wdst;
+  while(len-- > 0)
+    *cdst++ = c;
   return dst;
+#endif
 }
 
 char* safestrcpy(char *s, const char *t, int n)
@@ -23,27 +114,115 @@ char* safestrcpy(char *s, const char *t, int n)
   return os;
 }
 
-void*memmove(void *dst, const void *src, uint n)
+// 正向拷贝：源和目标对 8 取模相同时走字宽拷贝，否则只能逐字节
+NO_LIBCALL static void copy_forward(char *d, const char *s, uint64 n)
+{
+#ifdef __riscv_vector
+  rvv_copy_forward(d, s, n);
+#else
+  if((((uint64)d ^ (uint64)s) & WORD_MASK) == 0) {
+    while(n > 0 && ((uint64)d & WORD_MASK)) {
+      *d++ = *s++;
+      n--;
+    }
+    uint64 *wd = (uint64 *)d;
+    const uint64 *ws = (const uint64 *)s;
+    while(n >= BLOCK_BYTES) {
+      uint64 w0 = ws[0], w1 = ws[1], w2 = ws[2], w3 = ws[3];
+      uint64 w4 = ws[4], w5 = ws[5], w6 = ws[6], w7 = ws[7];
+      wd[0] = w0; wd[1] = w1; wd[2] = w2; wd[3] = w3;
+      wd[4] = w4; wd[5] = w5; wd[6] = w6; wd[7] = w7;
+      wd += 8;
+      ws += 8;
+      n -= BLOCK_BYTES;
+    }
+    while(n >= WORD_SIZE) {
+      *wd++ = *ws++;
+      n -= WORD_SIZE;
+    }
+    d = (char *)wd;
+    s = (const char *)ws;
+  }
+  while(n-- > 0)
+    *d++ = *s++;
+#endif
+}
+
+// 反向拷贝：用于目标区间与源区间重叠且目标在后的情形，d/s 指向区间末尾
+NO_LIBCALL static void copy_backward(char *d, const char *s, uint64 n)
+{
+  if((((uint64)d ^ (uint64)s) & WORD_MASK) == 0) {
+    while(n > 0 && ((uint64)d & WORD_MASK)) {
+      *--d = *--s;
+      n--;
+    }
+    uint64 *wd = (uint64 *)d;
+    const uint64 *ws = (const uint64 *)s;
+    while(n >= BLOCK_BYTES) {
+      wd -= 8;
+      ws -= 8;
+      uint64 w0 = ws[0], w1 = ws[1], w2 = ws[2], w3 = ws[3];
+      uint64 w4 = ws[4], w5 = ws[5], w6 = ws[6], w7 = ws[7];
+      wd[7] = w7; wd[6] = w6; wd[5] = w5; wd[4] = w4;
+      wd[3] = w3; wd[2] = w2; wd[1] = w1; wd[0] = w0;
+      n -= BLOCK_BYTES;
+    }
+    while(n >= WORD_SIZE) {
+      *--wd = *--ws;
+      n -= WORD_SIZE;
+    }
+    d = (char *)wd;
+    s = (const char *)ws;
+  }
+  while(n-- > 0)
+    *--d = *--s;
+}
+
+void* memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
 
   if(n == 0)
     return dst;
-  
+
   s = src;
   d = dst;
-  if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+  if(s < d && s + n > d)
+    copy_backward(d + n, s + n, n);
+  else
+    copy_forward(d, s, n);
 
   return dst;
 }
+
+// memcmp: 对齐情况相同时先按 8 字节比较，找到不同的字后再逐字节定位差异
+NO_LIBCALL int memcmp(const void *v1, const void *v2, uint n)
+{
+  const uchar *s1 = v1;
+  const uchar *s2 = v2;
+  uint64 len = n;
+
+  if((((uint64)s1 ^ (uint64)s2) & WORD_MASK) == 0) {
+    while(len > 0 && ((uint64)s1 & WORD_MASK)) {
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, len--;
+    }
+    while(len >= WORD_SIZE && *(const uint64 *)s1 == *(const uint64 *)s2) {
+      s1 += WORD_SIZE;
+      s2 += WORD_SIZE;
+      len -= WORD_SIZE;
+    }
+  }
+  while(len-- > 0) {
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+  return 0;
+}
+
 // strlen: 计算以 '\0' 结尾的字符串长度，若指针为空则返回 0，避免异常。
 int strlen(const char *s)
 {
@@ -54,3 +233,51 @@ int strlen(const char *s)
     n++;
   return n;
 }
+
+// 打印 total 个时间单位处理 bytes 字节的平均开销，保留三位小数
+static void report_cost(const char *name, const char *layout, uint64 total, uint64 bytes)
+{
+  uint64 milli = total * 1000 / bytes;
+  printf("[memops] %s %s: %lu cycles/%lu bytes = %lu.%lu%lu%lu cycles/byte\n",
+         name, layout, total, bytes, milli / 1000,
+         (milli / 100) % 10, (milli / 10) % 10, milli % 10);
+}
+
+// 内存操作微基准：分别测量对齐/非对齐情形下 memset、memmove、memcmp 的单字节开销。
+// 时间来自 get_time()，结果格式固定便于多次运行对比。
+void test_memops_performance(void)
+{
+  static char bench_src[2 * 4096 + 64] __attribute__((aligned(64)));
+  static char bench_dst[2 * 4096 + 64] __attribute__((aligned(64)));
+  const uint64 len = 2 * 4096;
+  const int rounds = 64;
+  const int offsets[2] = {0, 3};
+  const char *layouts[2] = {"aligned", "unaligned"};
+
+  printf("[memops] begin (len=%lu, rounds=%d)\n", len, rounds);
+  for(int k = 0; k < 2; k++) {
+    char *d = bench_dst + offsets[k];
+    char *s = bench_src;
+    uint64 start, total;
+
+    start = get_time();
+    for(int r = 0; r < rounds; r++)
+      memset(d, r, len);
+    total = get_time() - start;
+    report_cost("memset ", layouts[k], total, len * rounds);
+
+    start = get_time();
+    for(int r = 0; r < rounds; r++)
+      memmove(d, s, len);
+    total = get_time() - start;
+    report_cost("memmove", layouts[k], total, len * rounds);
+
+    start = get_time();
+    for(int r = 0; r < rounds; r++)
+      if(memcmp(d, s, len) != 0)
+        panic("test_memops_performance: memcmp mismatch");
+    total = get_time() - start;
+    report_cost("memcmp ", layouts[k], total, len * rounds);
+  }
+  printf("[memops] end\n");
+}
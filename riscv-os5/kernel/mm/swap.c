@@ -0,0 +1,342 @@
+// swap.c: 匿名页的换出与换入。
+// 交换区是根设备上紧随文件系统的一段块（mkfs -w），一个槽对应一块、存放一页。
+// 页缓存与文件映射的回收（pmm_reclaim）不够时唤醒 kswapd，或由缺页失败的进程直接换出一批：
+//   1. 全局停顿（sched_stop_others）中按时钟顺序扫描各进程 [0, sz) 内的 4KB 用户页，
+//      A 位置位的给第二次机会，引用全部来自登记映射的页（rmap_movable）分到一个空闲槽，
+//      经反向映射把全部表项一次改成换出表项；
+//   2. 恢复其他 hart 后把这一批页按槽号连续的段合成多段请求异步写出，等全部完成再释放页面。
+// 写盘期间槽标记为 SWAP_BUSY，访问到该页的进程在 swap_read 中等写完再读回。
+// 换入不做预读：相邻槽不一定属于同一进程，读回的页又无处暂存。
+
+#include "types.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "kalloc.h"
+#include "vm.h"
+#include "rmap.h"
+#include "fs.h"
+#include "buf.h"
+#include "blkdev.h"
+#include "virtio.h"
+#include "meminfo.h"
+#include "string.h"
+#include "printf.h"
+#include "klog.h"
+#include "swap.h"
+
+#define SWAP_MAX_SLOTS 16384              // 至多使用 64MB 交换区，多出的块不用
+#define SWAP_CLUSTER   VIRTIO_MAX_SEGS    // 一批换出的页数，槽号连续时正好是一个请求
+#define SWAP_SCAN_MAX  2048               // 一批至多检查的表项数，限制停顿时间
+#define SWAP_BUSY      0x8000             // 槽的内容正在写盘
+
+struct swap_out {
+    uint64 pa;
+    uint32 slot;
+    int nmap;                             // 换出前的映射数（即页面的引用计数）
+};
+
+static struct {
+    struct spinlock lock;                 // 保护 map、nfree、hint、wanted 与计数
+    struct sleeplock out_lock;            // 同一时刻只有一批换出，out[] 与 bufs[] 归持有者使用
+    uint32 start;                         // 交换区起始块号
+    uint32 nslots;                        // 0 表示没有交换区
+    uint32 nfree;
+    uint32 hint;                          // 下一次从这里找空闲槽，连续换出的页落在相邻槽中
+    int wanted;                           // kswapd 已被唤醒或正在换出
+    int pid;                              // 时钟指针：上次扫描到的进程与地址
+    uint64 va;
+    uint64 outs, ins;
+    ushort map[SWAP_MAX_SLOTS];           // 各槽被引用的表项数，0 为空闲
+    struct swap_out out[SWAP_CLUSTER];
+    struct buf bufs[SWAP_CLUSTER];
+} swap;
+
+// 取一个空闲槽，引用数先记为 1，交换区已满时返回 -1。调用者持有 swap.lock
+static int slot_alloc(void)
+{
+    for(uint32 i = 0; i < swap.nslots; i++) {
+        uint32 s = (swap.hint + i) % swap.nslots;
+        if(swap.map[s] == 0) {
+            swap.map[s] = 1;
+            swap.hint = s + 1;
+            swap.nfree--;
+            return s;
+        }
+    }
+    return -1;
+}
+
+// 放弃一个引用。调用者持有 swap.lock
+static void slot_put(uint32 slot)
+{
+    if((swap.map[slot] & ~SWAP_BUSY) == 0)
+        panic("swap: free unused slot");
+    if(--swap.map[slot] == 0)
+        swap.nfree++;
+}
+
+void swap_dup(uint32 slot)
+{
+    acquire(&swap.lock);
+    if((swap.map[slot] & ~SWAP_BUSY) == 0)
+        panic("swap_dup");
+    swap.map[slot]++;
+    release(&swap.lock);
+}
+
+void swap_free(uint32 slot)
+{
+    acquire(&swap.lock);
+    slot_put(slot);
+    release(&swap.lock);
+}
+
+// 扫描进程 p 从时钟指针起的用户页，换出的页记入 swap.out[*n]。
+// 返回 0 表示 p 已扫描完，1 表示这一批已满或检查数用完，指针停在 p 中
+static int swap_scan(struct proc *p, int *n, int *budget, int *touched)
+{
+    pagetable_t pt = p->pagetable;
+    uint64 va = swap.va;
+
+    while(va < p->sz) {
+        if(*n == SWAP_CLUSTER || *budget <= 0) {
+            swap.va = va;
+            return 1;
+        }
+        pte_t *l2 = &pt[PX(2, va)];
+        if((*l2 & PTE_V) == 0 || PTE_LEAF(*l2)) {
+            va = (va + (1UL << PXSHIFT(2))) & ~((1UL << PXSHIFT(2)) - 1);
+            continue;
+        }
+        pte_t *l1 = &((pagetable_t)PTE2PA(*l2))[PX(1, va)];
+        if((*l1 & PTE_V) == 0 || PTE_LEAF(*l1)) {
+            va = (va + MEGAPGSIZE) & ~((uint64)MEGAPGSIZE - 1);   // 大页不换出
+            continue;
+        }
+        pte_t *pte = &((pagetable_t)PTE2PA(*l1))[PX(0, va)];
+        va += PGSIZE;
+        (*budget)--;
+        if((*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U))
+            continue;
+
+        uint64 pa = PTE2PA(*pte);
+        if(rmap_test_and_clear_young(pa)) {
+            *touched = 1;
+            continue;
+        }
+        if(!rmap_movable(pa))
+            continue;   // 共享零页、页缓存页，或有内核持有的引用
+
+        acquire(&swap.lock);
+        int slot = slot_alloc();
+        release(&swap.lock);
+        if(slot < 0) {
+            swap.va = va;
+            *budget = 0;   // 交换区已满
+            return 1;
+        }
+        int nmap = rmap_swap_out(pa, SWAP2PTE(slot));
+        acquire(&swap.lock);
+        if(nmap < 0) {
+            slot_put(slot);
+        } else {
+            swap.map[slot] = nmap | SWAP_BUSY;
+            swap.out[*n].pa = pa;
+            swap.out[*n].slot = slot;
+            swap.out[*n].nmap = nmap;
+            (*n)++;
+            *touched = 1;
+        }
+        release(&swap.lock);
+    }
+    return 0;
+}
+
+// 在全局停顿中挑出一批页并改写它们的表项，返回页数
+static int swap_collect(void)
+{
+    int n = 0, budget = SWAP_SCAN_MAX, touched = 0;
+    struct proc *p;
+
+    acquire(&proc_list_lock);
+    p = proc_find(swap.pid);
+    if(p == 0) {
+        p = proc_list;
+        swap.va = 0;
+    }
+    // 至多转两圈：第一圈清 A 位，第二圈换出仍未被访问的页
+    for(int left = 2 * proc_count(); p && left > 0; left--) {
+        if(p->state != UNUSED && p->state != ZOMBIE && p->pagetable != 0 &&
+           swap_scan(p, &n, &budget, &touched))
+            break;
+        p = p->all_next ? p->all_next : proc_list;
+        swap.va = 0;
+    }
+    swap.pid = p ? p->pid : 0;
+
+    // 改写的表项可能属于任何进程：各进程下次返回用户态前整体刷新 TLB 与翻译缓存。
+    // 其他 hart 都停在调度器中，不需要核间中断
+    if(touched) {
+        for_each_proc(p)
+            tlb_reset(p);
+    }
+    release(&proc_list_lock);
+    return n;
+}
+
+// 把 swap.out[0, n) 写入各自的槽：槽号相邻的页合成一个多段请求，全部提交后再逐个等待
+static void swap_write(int n)
+{
+    struct buf *bs[SWAP_CLUSTER];
+
+    for(int i = 0; i < n; i++) {
+        struct buf *b = &swap.bufs[i];
+        b->dev = ROOTDEV;
+        b->blockno = swap.start + swap.out[i].slot;
+        b->data = (uchar *)swap.out[i].pa;
+        b->disk = 0;
+        bs[i] = b;
+    }
+    for(int i = 0; i < n; ) {
+        int j = i + 1;
+        while(j < n && bs[j]->blockno == bs[j - 1]->blockno + 1)
+            j++;
+        blk_submit(&bs[i], j - i, 1, 0);
+        i = j;
+    }
+    for(int i = 0; i < n; i++)
+        blk_wait(bs[i]);
+}
+
+// 换出一批页，返回换出的页数。调用者处于进程上下文、不持有自旋锁
+static int swap_out_batch(void)
+{
+    acquiresleep(&swap.out_lock);
+    // 停顿期间不能让出 CPU：本 hart 一旦回到调度器也会停下，没有人再恢复其他 hart
+    preempt_disable();
+    if(sched_stop_others() < 0) {
+        preempt_enable();
+        releasesleep(&swap.out_lock);
+        return 0;
+    }
+    int n = swap_collect();
+    sched_resume_others();
+    preempt_enable();
+
+    swap_write(n);
+    for(int i = 0; i < n; i++) {
+        struct swap_out *o = &swap.out[i];
+        acquire(&swap.lock);
+        swap.map[o->slot] &= ~SWAP_BUSY;
+        if(swap.map[o->slot] == 0)
+            swap.nfree++;   // 写盘期间所有映射者都已解除映射
+        swap.outs++;
+        wakeup(&swap.map[o->slot]);
+        release(&swap.lock);
+        for(int k = 0; k < o->nmap; k++)
+            page_decref((void *)o->pa);
+    }
+    releasesleep(&swap.out_lock);
+    return n;
+}
+
+int swap_reclaim_direct(void)
+{
+    if(swap.nslots == 0)
+        return 0;
+    return swap_out_batch();
+}
+
+int swap_read(uint32 slot, void *page)
+{
+    push_off();
+    int atomic = mycpu()->noff > 1;
+    pop_off();
+    if(atomic || myproc() == 0 || slot >= swap.nslots)
+        return -1;   // 持有自旋锁时不能等磁盘，由调用者在锁外重试
+
+    acquire(&swap.lock);
+    while(swap.map[slot] & SWAP_BUSY)
+        sleep(&swap.map[slot], &swap.lock);
+    swap.ins++;
+    release(&swap.lock);
+
+    // 请求不经块缓存，栈上的描述符直接指向目标页
+    struct buf b, *bp = &b;
+    memset(&b, 0, sizeof(b));
+    b.dev = ROOTDEV;
+    b.blockno = swap.start + slot;
+    b.data = page;
+    blk_submit(&bp, 1, 0, 0);
+    blk_wait(&b);
+    return 0;
+}
+
+void swap_wakeup(void)
+{
+    if(swap.nslots == 0 || __atomic_load_n(&swap.wanted, __ATOMIC_ACQUIRE))
+        return;
+    acquire(&swap.lock);
+    if(!swap.wanted) {
+        swap.wanted = 1;
+        wakeup(&swap.wanted);
+    }
+    release(&swap.lock);
+}
+
+// kswapd：被唤醒后换出到空闲页回到高水位，或没有可换出的页为止
+static void kswapd(void *arg)
+{
+    (void)arg;
+    for(;;) {
+        while(pmm_low_memory() && swap_out_batch() > 0)
+            ;
+        acquire(&swap.lock);
+        swap.wanted = 0;
+        while(!swap.wanted && !kthread_should_stop())
+            sleep(&swap.wanted, &swap.lock);
+        release(&swap.lock);
+        if(kthread_should_stop())
+            return;
+    }
+}
+
+void swap_init(void)
+{
+    const struct superblock *sb = fs_superblock();
+
+    initlock(&swap.lock, "swap");
+    initsleeplock(&swap.out_lock, "swapout");
+#if RAMDISK
+    klog_info("swap: 根设备是内存盘，不启用交换区");
+    (void)sb;
+#else
+    if(sb->nswap == 0) {
+        klog_info("swap: 镜像没有交换区");
+        return;
+    }
+    if(sb->swapstart < sb->size) {
+        klog_warn("swap: 交换区 %u 与文件系统重叠，不启用", sb->swapstart);
+        return;
+    }
+    swap.start = sb->swapstart;
+    swap.nslots = sb->nswap < SWAP_MAX_SLOTS ? sb->nswap : SWAP_MAX_SLOTS;
+    swap.nfree = swap.nslots;
+    if(kthread_create(kswapd, 0, "kswapd") < 0)
+        panic("swap_init");
+    klog_info("swap: 交换区 [%u~%u)，%u 个槽", swap.start, swap.start + swap.nslots, swap.nslots);
+#endif
+}
+
+void swap_meminfo(struct meminfo *mi)
+{
+    acquire(&swap.lock);
+    mi->swap_total = swap.nslots;
+    mi->swap_free = swap.nfree;
+    mi->swap_outs = swap.outs;
+    mi->swap_ins = swap.ins;
+    release(&swap.lock);
+}
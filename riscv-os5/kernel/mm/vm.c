@@ -4,13 +4,117 @@
 #include "string.h"
 #include "printf.h"
 #include "riscv.h"
+#include "proc.h"
+#include "meminfo.h"
+#include "rmap.h"
+#include "trap.h"
+#include "percpu.h"
+#include "metrics.h"
+#include "exec.h"
+#include "swap.h"
+#include "trace.h"
+#include "bitops.h"
 
 //内核页表
 pagetable_t kernel_pagetable;
 
+// 供 meminfo 使用的统计：当前页表页数，以及累计的写时复制/按需分配缺页次数。
+// 写时复制缺页分为原地复用（最后一个映射者，只恢复写权限）与实际拷贝两类。
+// 缺页路径上各 hart 只更新自己的那一格
+static struct pcpu_counter pt_pages;
+static struct pcpu_counter cow_reused;
+static struct pcpu_counter cow_copied;
+static struct pcpu_counter lazy_faults;
+static struct pcpu_counter zero_page_faults;
+
+static struct metric vm_metrics[] = {
+    { .name = "vm.pt_pages", .kind = METRIC_GAUGE, .counter = &pt_pages },
+    { .name = "vm.cow_reused", .kind = METRIC_COUNTER, .counter = &cow_reused },
+    { .name = "vm.cow_copied", .kind = METRIC_COUNTER, .counter = &cow_copied },
+    { .name = "vm.lazy_faults", .kind = METRIC_COUNTER, .counter = &lazy_faults },
+    { .name = "vm.zero_page_faults", .kind = METRIC_COUNTER, .counter = &zero_page_faults },
+};
+
+// 共享零页：启动时分配，分配时的那次引用永不归还，引用计数总大于 1，
+// cow_clone_page 因此总会为写入者另分配新页，而不会原地放开零页的写权限
+void *zero_page;
+
+// 进程创建时从位图分配 ASID（1 ~ NASID-1），内核使用 ASID 0。硬件 ASID 位数不足时全部进程
+// 退回整体刷新；ASID 分完后新进程同样使用 0，每次进出用户态由 trampoline 整体刷新 TLB
+#define NASID 1024
+int tlb_use_asid = 0;
+static uint64 asid_map[NASID / 64];
+static struct spinlock asid_lock;
+
 extern char etext[]; 
 extern char trampoline[];
 
+static pte_t* walk_create_level(pagetable_t pt, uint64 va, int leaf_level);
+
+// 共享末级页表：fork 时父子进程的二级页表项指向同一张末级页表，页表页自身的引用计数
+// 即共享者个数。共享期间表内可写用户页都已改为只读 COW；任何一方修改表项前
+// 先用 unshare_l0 复制出私有副本，副本中每个有效叶子项都让对应数据页多一次引用，
+// 并在反向映射中登记副本里的表项，换出表项则让交换槽多一次引用。va 为该末级页表覆盖区间内的任一地址；
+// copy 为调用者预先分配的页表页，为 0 时就地分配，失败时该页一并释放。
+static pagetable_t unshare_l0(pte_t *l1pte, uint64 va, pagetable_t copy) {
+    pagetable_t old = (pagetable_t)PTE2PA(*l1pte);
+    if (copy == 0)
+        copy = (pagetable_t)alloc_page_nozero();   // 512 项会全部写满
+    if (copy == 0)
+        return 0;
+    pcpu_inc(&pt_pages);
+
+    uint64 base = va & ~((uint64)MEGAPGSIZE - 1);
+    for (int i = 0; i < 512; i++) {
+        copy[i] = old[i];
+        if (PTE_IS_SWAP(old[i]))
+            swap_dup(PTE2SLOT(old[i]));
+        if ((old[i] & PTE_V) == 0)
+            continue;
+        uint64 pa = PTE2PA(old[i]);
+        if ((old[i] & PTE_U) && rmap_add(pa, &copy[i], base + (uint64)i * PGSIZE) < 0) {
+            // 登记失败：撤销已处理的表项，旧页表保持共享
+            while (--i >= 0) {
+                if (copy[i] & PTE_V) {
+                    rmap_remove(PTE2PA(copy[i]), &copy[i]);
+                    page_decref((void *)PTE2PA(copy[i]));
+                } else if (PTE_IS_SWAP(copy[i])) {
+                    swap_free(PTE2SLOT(copy[i]));
+                }
+            }
+            free_page(copy);
+            pcpu_dec(&pt_pages);
+            return 0;
+        }
+        page_incref((void *)pa);
+    }
+    *l1pte = PA2PTE(copy) | PTE_V;
+    if (page_decref(old) == 0)
+        pcpu_dec(&pt_pages);
+    return copy;
+}
+
+// 与 walk_lookup_level 相同，但途经被共享的末级页表时先将其私有化，返回的表项可安全修改
+static pte_t* walk_private_level(pagetable_t pt, uint64 va, int *level) {
+    for (int l = 2; l > 0; l--) {
+        pte_t *pte = &pt[PX(l, va)];
+        if (!(*pte & PTE_V))
+            return 0;
+        if (PTE_LEAF(*pte)) {
+            *level = l;
+            return pte;
+        }
+        if (l == 1 && page_refcount((void *)PTE2PA(*pte)) > 1) {
+            if (unshare_l0(pte, va, 0) == 0)
+                return 0;
+        }
+        pt = (pagetable_t)PTE2PA(*pte);
+    }
+    *level = 0;
+    return &pt[PX(0, va)];
+}
+
+// 调用者需保证 va0 所在的末级页表已私有化（见 cow_resolve）
 static int cow_clone_page(pagetable_t pagetable, uint64 va0) {
     // 查找虚拟地址 va0 对应的页表项
     pte_t *pte = walk_lookup(pagetable, va0);
@@ -26,31 +130,169 @@ static int cow_clone_page(pagetable_t pagetable, uint64 va0) {
     // 获取原物理页地址
     uint64 pa = PTE2PA(*pte);
 
-    // 分配一个新的物理页
-    void *mem = alloc_page();
+    // 其他共享者都已放弃该页（复制或退出），无需拷贝，直接恢复写权限
+    if (page_refcount((void *)pa) == 1) {
+        *pte = (*pte | PTE_W) & ~PTE_COW;
+        tlb_upgrade_page(pagetable, va0);
+        pcpu_inc(&cow_reused);
+        return 0;
+    }
+
+    // 分配一个新的物理页，随后会被整页覆盖，无需清零；共享零页的写入者直接取清零页（常有预清零的现成页）。
+    // 新页只经 rmap 登记的映射引用，可以借用 CMA 区
+    int from_zero = pa == (uint64)zero_page;
+    void *mem = from_zero ? alloc_page_movable() : alloc_page_movable_nozero();
     if (mem == 0)
         return -1;
+    if (rmap_add((uint64)mem, pte, va0) < 0) {
+        free_page(mem);
+        return -1;
+    }
 
     // 拷贝原页内容到新物理页，实现真正写时复制
-    memmove(mem, (void *)pa, PGSIZE);
+    if (!from_zero)
+        memmove(mem, (void *)pa, PGSIZE);
 
     // 更新页表项：指向新物理页，去掉 COW 标记，加上写权限
     uint flags = PTE_FLAGS(*pte);
     flags = (flags | PTE_W) & ~PTE_COW;
     *pte = PA2PTE(mem) | flags;
 
-    sfence_vma();
+    tlb_invalidate_page(pagetable, va0);
 
+    rmap_remove(pa, pte);
     page_decref((void *)pa);
+    pcpu_inc(&cow_copied);
+    return 0;
+}
+
+// 2MB 大页中的每个 4KB 物理页都各自计数，大页叶子项视为对其中每一页的一次引用
+static void huge_incref(uint64 pa) {
+    for (int i = 0; i < MEGAPGSIZE / PGSIZE; i++)
+        page_incref((void *)(pa + (uint64)i * PGSIZE));
+}
+
+// 分段批量放弃，免得 512 页逐个进出 hart 缓存
+#define HUGE_FREE_CHUNK 64
+
+static void huge_decref(uint64 pa) {
+    void *pages[HUGE_FREE_CHUNK];
+    for (int i = 0; i < MEGAPGSIZE / PGSIZE; i += HUGE_FREE_CHUNK) {
+        for (int j = 0; j < HUGE_FREE_CHUNK; j++)
+            pages[j] = (void *)(pa + (uint64)(i + j) * PGSIZE);
+        free_page_bulk(pages, HUGE_FREE_CHUNK);
+    }
+}
+
+// 大页中所有物理页都只被当前映射引用时返回 1
+static int huge_exclusive(uint64 pa) {
+    for (int i = 0; i < MEGAPGSIZE / PGSIZE; i++)
+        if (page_refcount((void *)(pa + (uint64)i * PGSIZE)) != 1)
+            return 0;
+    return 1;
+}
+
+// 将 va 所在的二级大页叶子项拆分为 512 个权限相同的 4KB 叶子项，引用计数保持不变。
+// l0 为调用者预先分配的页表页，为 0 时就地分配
+static int split_huge(pagetable_t pagetable, uint64 va, pte_t *pte, pagetable_t l0) {
+    if (l0 == 0)
+        l0 = (pagetable_t)alloc_page_nozero();   // 512 项会全部写满，无需清零
+    if (l0 == 0)
+        return -1;
+    pcpu_inc(&pt_pages);
+
+    uint64 pa = PTE2PA(*pte);
+    uint64 flags = PTE_FLAGS(*pte);
+    for (int i = 0; i < 512; i++)
+        l0[i] = PA2PTE(pa + (uint64)i * PGSIZE) | flags;
+    *pte = PA2PTE(l0) | PTE_V;
+    tlb_invalidate_page(pagetable, va);
     return 0;
 }
 
+// 在 va 处建立一个 2MB 用户大页映射；该区间已有下级页表时返回 -1，调用者退回 4KB 映射
+static int map_huge(pagetable_t pagetable, uint64 va, uint64 pa, int perm) {
+    pte_t *pte = walk_create_level(pagetable, va, 1);
+    if (pte == 0 || (*pte & PTE_V))
+        return -1;
+    *pte = PA2PTE(pa) | perm | PTE_V;
+    return 0;
+}
+
+uint64 fault_begin(void) {
+    struct proc *p = myproc();
+    if (p)
+        p->fault_kind = 0;
+#if FAULT_TRACE
+    return r_cycle();
+#else
+    return 0;
+#endif
+}
+
+void fault_note(int kind) {
+    struct proc *p = myproc();
+    if (p)
+        p->fault_kind = kind;
+}
+
+void fault_end(uint64 va, uint64 sepc, uint64 start, int uaccess) {
+    struct proc *p = myproc();
+    if (p == 0 || p->fault_kind == 0)
+        return;
+    switch (p->fault_kind) {
+    case FAULT_COW:   p->cow_faults++;  break;
+    case FAULT_LAZY:  p->lazy_faults++; break;
+    case FAULT_MINOR: p->minflt++;      break;
+    case FAULT_MAJOR: p->majflt++;      break;
+    }
+    if (uaccess)
+        p->uaccess_faults++;
+#if FAULT_TRACE
+    TRACE(PAGE_FAULT, va, sepc, p->fault_kind | (uaccess ? FAULT_UACCESS : 0), r_cycle() - start);
+#else
+    (void)va;
+    (void)sepc;
+    (void)start;
+#endif
+}
+
 int cow_resolve(pagetable_t pagetable, uint64 faultva) {
     uint64 va0 = PGROUNDDOWN(faultva);
-    return cow_clone_page(pagetable, va0);
+    int level;
+    if (va0 >= MAXVA)
+        return -1;
+    // 末级页表若仍与其他进程共享，先复制出私有副本再修改表项
+    pte_t *pte = walk_private_level(pagetable, va0, &level);
+    if (pte == 0)
+        return -1;
+
+    if (level == 1 && (*pte & PTE_V) && (*pte & PTE_U) && (*pte & PTE_COW)) {
+        uint64 pa = PTE2PA(*pte);
+        if (huge_exclusive(pa)) {
+            // 其他进程已放弃共享，直接恢复整块大页的写权限
+            *pte = (*pte | PTE_W) & ~PTE_COW;
+            tlb_upgrade_page(pagetable, va0);
+            pcpu_inc(&cow_reused);
+            fault_note(FAULT_COW);
+            return 0;
+        }
+        // 仍被共享：拆成 4KB 项，只复制实际写入的那一页
+        if (split_huge(pagetable, va0, pte, 0) < 0)
+            return -1;
+    }
+    int r = cow_clone_page(pagetable, va0);
+    if (r == 0)
+        fault_note(FAULT_COW);
+    return r;
 }
 
 void kvminit(void) {
+    initlock(&asid_lock, "asid");
+    if ((zero_page = alloc_page()) == 0)
+        panic("kvminit: zero page");
+    METRICS_REGISTER(vm_metrics);
+    asid_map[0] = 1;   // ASID 0 留给内核
     // 1. 创建内核页表
     kernel_pagetable = create_pagetable();
     // 2. 映射内核代码段（R+X权限）
@@ -62,54 +304,438 @@ void kvminit(void) {
     // 4. 映射设备（UART等）
     map_region(kernel_pagetable, UART0, UART0, PGSIZE, PTE_R | PTE_W);
     map_region(kernel_pagetable, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
+    map_region(kernel_pagetable, VIRTIO1, VIRTIO1, PGSIZE, PTE_R | PTE_W);
+#if RAMDISK
+    map_region(kernel_pagetable, RAMDISK_BASE, RAMDISK_BASE, RAMDISK_SIZE, PTE_R | PTE_W);
+#endif
+    map_region(kernel_pagetable, PLIC, PLIC, PLIC_SIZE, PTE_R | PTE_W);
+    map_region(kernel_pagetable, SSWI, SSWI, PGSIZE, PTE_R | PTE_W);
+    map_region(kernel_pagetable, VIRT_TEST, VIRT_TEST, PGSIZE, PTE_R | PTE_W);
     // 5. 映射 trampoline ，方便内核调用抢占代码
     map_region(kernel_pagetable, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 }
 
 void kvminithart(void) { 
+    // 探测硬件实现的 ASID 位数：ASID 字段为 WARL，写入全 1 后读回即为可用的最大值
+    w_satp(MAKE_SATP_ASID(kernel_pagetable, SATP_ASID_MASK));
+    uint64 asid_max = (r_satp() >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+    tlb_use_asid = (asid_max >= NASID - 1);
+
     // 将内核页表的根地址写入 satp 寄存器，激活虚拟内存，并刷新 TLB。
     w_satp(MAKE_SATP(kernel_pagetable)); 
     sfence_vma(); 
  }
 
+// 为新进程分配 ASID，不支持或已分完时返回 0。ASID 可能刚被其他进程用过，
+// 调用者须随后 tlb_reset，使首次返回用户态前整体刷新该 ASID
+int asid_alloc(void) {
+    if (!tlb_use_asid)
+        return 0;
+    int asid = 0;
+    acquire(&asid_lock);
+    for (int i = 0; i < NASID / 64 && asid == 0; i++) {
+        if (asid_map[i] == ~0ULL)
+            continue;
+        int bit = ctz64(~asid_map[i]);
+        asid_map[i] |= 1ULL << bit;
+        asid = i * 64 + bit;
+    }
+    release(&asid_lock);
+    return asid;
+}
+
+void asid_free(int asid) {
+    if (asid <= 0)
+        return;
+    acquire(&asid_lock);
+    asid_map[asid / 64] &= ~(1ULL << (asid % 64));
+    release(&asid_lock);
+}
+
+// 清空进程的软件地址转换缓存（copyin/copyout 使用）
+static void xlate_flush(struct proc *p) {
+    for (int i = 0; i < UVM_XLATE_SLOTS; i++)
+        p->xlate[i].pa = 0;
+}
+
+// 进程换用全新页表（槽位复用或 exec）时调用：丢弃全部缓存的地址转换。
+// 该 ASID 以前可能在任一 hart 上用过，每个 hart 首次为它返回用户态前都要整体刷新一次
+void tlb_reset(struct proc *p) {
+    xlate_flush(p);
+    p->tlb_flush_all = 1;
+    p->tlb_npending = 0;
+    __atomic_store_n(&p->tlb_stale, CPUMASK_ALL, __ATOMIC_RELEASE);
+}
+
+// ================= 远程 TLB 刷新 =================
+// 每个 hart 的 struct cpu 中有一对请求代号：发起方把 tlb_req 加一并发核间中断，
+// 目标 hart 在中断里整体刷新 TLB 后把 tlb_done 追到 tlb_req，发起方等到 tlb_done
+// 不小于自己拿到的代号即可确认。多个发起方同时请求同一 hart 时只需刷新一次。
+
+// 处理发往本 hart 的刷新请求，须在关中断时调用
+void tlb_ipi_service(void) {
+    struct cpu *c = mycpu();
+    uint64 g = __atomic_load_n(&c->tlb_req, __ATOMIC_ACQUIRE);
+    if (g != c->tlb_done) {
+        sfence_vma();
+        __atomic_store_n(&c->tlb_done, g, __ATOMIC_RELEASE);
+    }
+}
+
+// 让 mask 中的其他 hart 丢弃全部 TLB 条目并等待完成。等待期间继续处理发给自己的请求，
+// 两个 hart 互相发起刷新时不会互等
+void tlb_shootdown(uint64 mask) {
+    uint64 gen[NCPU];
+    push_off();
+    int self = cpuid();
+    mask &= ~(1UL << self);
+    for (int i = 0; i < NCPU; i++) {
+        if (mask & (1UL << i)) {
+            gen[i] = __atomic_add_fetch(&cpus[i].tlb_req, 1, __ATOMIC_ACQ_REL);
+            ipi_send(i);
+        }
+    }
+    for (int i = 0; i < NCPU; i++) {
+        if (!(mask & (1UL << i)))
+            continue;
+        while (__atomic_load_n(&cpus[i].tlb_done, __ATOMIC_ACQUIRE) < gen[i])
+            tlb_ipi_service();
+    }
+    pop_off();
+}
+
+// 此刻正在其他 hart 上使用该页表的 hart。之后才被调度上去的线程会在 tlb_sync 中看到
+// 已经置起的刷新标记，不需要核间中断
+static uint64 tlb_remote_harts(pagetable_t pagetable) {
+    uint64 mask = 0;
+    __sync_synchronize();
+    int self = cpuid();
+    for (int i = 0; i < NCPU; i++) {
+        struct proc *q = cpus[i].proc;
+        if (i != self && q && q->pagetable == pagetable)
+            mask |= 1UL << i;
+    }
+    return mask;
+}
+
+// 修改页表后通知其他 hart：它们以后为当前进程返回用户态前整体刷新，正在运行同组线程的
+// hart 立即刷新（处于批处理中时攒到 tlb_batch_flush）
+static void tlb_remote_invalidate(struct proc *p) {
+    push_off();
+    uint64 others = CPUMASK_ALL & ~(1UL << cpuid());
+    __atomic_fetch_or(&p->tlb_stale, others, __ATOMIC_RELEASE);
+    uint64 remote = NCPU > 1 ? tlb_remote_harts(p->pagetable) : 0;
+    pop_off();
+    if (remote == 0)
+        return;
+    if (p->tlb_batch)
+        p->tlb_batch_mask |= remote;
+    else
+        tlb_shootdown(remote);
+}
+
+// 批量修改页表（如 uvmunmap）时把远程刷新合并为一次：begin 与 end 可嵌套，
+// 中途需要先确认刷新完成（例如释放物理页之前）时调用 tlb_batch_flush
+void tlb_batch_begin(void) {
+    struct proc *p = myproc();
+    if (p)
+        p->tlb_batch++;
+}
+
+void tlb_batch_flush(void) {
+    struct proc *p = myproc();
+    if (p == 0 || p->tlb_batch_mask == 0)
+        return;
+    uint64 mask = p->tlb_batch_mask;
+    p->tlb_batch_mask = 0;
+    tlb_shootdown(mask);
+}
+
+void tlb_batch_end(void) {
+    struct proc *p = myproc();
+    if (p && --p->tlb_batch == 0)
+        tlb_batch_flush();
+}
+
+// 线程组共享页表但各用各的 ASID：当前线程修改页表后，同组其他成员返回用户态前整体刷新
+static void tlb_reset_member(struct proc *q, struct proc *p) {
+    (void)p;
+    tlb_reset(q);
+}
+
+static void tlb_reset_siblings(struct proc *p) {
+    tgroup_each_other(p, tlb_reset_member);
+}
+
+// 登记当前进程页表中 va 的映射已变化。只跟踪当前进程（及共享页表的同组线程）：新建或换下的页表
+// 会在 alloc_process/exec 中通过 tlb_reset 整体作废，因此不属于当前进程的页表可以忽略。
+// 软件转换缓存很小，任何修改都直接整体清空，无需区分大页与小页。
+void tlb_invalidate_page(pagetable_t pagetable, uint64 va) {
+    struct proc *p = myproc();
+    if (p == 0 || p->pagetable != pagetable)
+        return;
+    tlb_reset_siblings(p);
+    xlate_flush(p);
+    tlb_remote_invalidate(p);
+    if (p->tlb_flush_all)
+        return;
+    if (p->tlb_npending == TLB_PENDING_MAX) {
+        p->tlb_flush_all = 1;   // 修改过多，不如整体刷新该 ASID
+        return;
+    }
+    p->tlb_pending[p->tlb_npending++] = PGROUNDDOWN(va);
+}
+
+void tlb_invalidate_all(pagetable_t pagetable) {
+    struct proc *p = myproc();
+    if (p && p->pagetable == pagetable) {
+        tlb_reset_siblings(p);
+        xlate_flush(p);
+        tlb_remote_invalidate(p);
+        p->tlb_flush_all = 1;
+    }
+}
+
+// 只放宽了权限（写时复制复用原页）：其他 hart 上残留的只读条目至多引发一次多余的缺页，
+// 由 uvm_spurious_fault 在那里就地刷新，因此不发核间中断
+void tlb_upgrade_page(pagetable_t pagetable, uint64 va) {
+    struct proc *p = myproc();
+    if (p == 0 || p->pagetable != pagetable)
+        return;
+    xlate_flush(p);
+    if (p->tlb_flush_all)
+        return;
+    if (p->tlb_npending == TLB_PENDING_MAX) {
+        p->tlb_flush_all = 1;
+        return;
+    }
+    p->tlb_pending[p->tlb_npending++] = PGROUNDDOWN(va);
+}
+
+// 页表项已允许本次访问却仍然缺页：本 hart 的 TLB 里还留着放宽权限前的旧条目。
+// 刷新该页后返回 0 让用户程序重试；要求 A（写时还有 D）已置位，否则缺页可能来自硬件不自动设置 A/D
+int uvm_spurious_fault(pagetable_t pagetable, uint64 va, int write) {
+    struct proc *p = myproc();
+    uint64 va0 = PGROUNDDOWN(va);
+    if (p == 0 || va0 >= MAXVA)
+        return -1;
+    pte_t *pte = walk_lookup(pagetable, va0);
+    if (pte == 0 || (*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U))
+        return -1;
+    uint64 need = write ? (PTE_W | PTE_A | PTE_D) : (PTE_R | PTE_A);
+    if ((*pte & need) != need)
+        return -1;
+    if (tlb_use_asid)
+        sfence_vma_va_asid(va0, p->asid);
+    else
+        sfence_vma();
+    return 0;
+}
+
+// 返回用户态前执行累计的刷新。未启用 ASID 时 trampoline 会整体清空 TLB，这里只需清除记录。
+// 该 ASID 在本 hart 上可能还有其他 hart 修改页表之前留下的条目，此时整体刷新
+void tlb_sync(struct proc *p) {
+    uint64 self = 1UL << cpuid();
+    __sync_synchronize();
+    if (__atomic_load_n(&p->tlb_stale, __ATOMIC_ACQUIRE) & self) {
+        __atomic_fetch_and(&p->tlb_stale, ~self, __ATOMIC_ACQ_REL);
+        p->tlb_flush_all = 1;
+    }
+    if (tlb_use_asid) {
+        if (p->tlb_flush_all) {
+            sfence_vma_asid(p->asid);
+        } else {
+            for (int i = 0; i < p->tlb_npending; i++)
+                sfence_vma_va_asid(p->tlb_pending[i], p->asid);
+        }
+    }
+    p->tlb_flush_all = 0;
+    p->tlb_npending = 0;
+}
+
  // 创建空页表
 pagetable_t create_pagetable(void)
 {
     pagetable_t pagetable;
-    pagetable = (pagetable_t) alloc_page();
+    pagetable = (pagetable_t) alloc_page();   // alloc_page 保证返回清零页
     if(pagetable == 0)
         return 0;
-    memset(pagetable, 0, PGSIZE);
+    pcpu_inc(&pt_pages);
     return pagetable;
 }
 
-// 查找页表项（不创建新页表）
-pte_t* walk_lookup(pagetable_t pt, uint64 va)
+// 按需分配缺页处理：faultva 位于当前进程的堆或 BSS 预留区间且尚未映射时，分配清零页并建立映射。
+// 整个 2MB 对齐块都在堆内且还没有下级页表时，优先直接补一个大页。sz 以上的地址交给 mmap 映射区处理。
+// 读缺页（write 为 0）不分配：只读映射共享零页并标记 COW，第一次写入时再由 cow_resolve 换成新页。
+// 成功返回 0。
+// 换出页的缺页：读回交换槽的内容后按换出表项中保留的权限重新映射。
+// 读盘期间会睡眠，醒来后表项可能已被同一地址空间的其他线程换入或解除，
+// 此时放弃读到的页，由重新执行的访问决定结果。不是换出表项时返回 1
+static int swap_resolve(pagetable_t pagetable, uint64 va0) {
+    pte_t *pte = walk_lookup(pagetable, va0);
+    if (pte == 0 || !PTE_IS_SWAP(*pte))
+        return 1;
+    pte_t old = *pte;
+
+    void *mem = alloc_page_movable_nozero();   // 整页由磁盘内容覆盖
+    if (mem == 0)
+        return -1;
+    if (swap_read(PTE2SLOT(old), mem) < 0) {
+        free_page(mem);
+        return -1;
+    }
+
+    int level;
+    pte = walk_private_level(pagetable, va0, &level);   // 表项位于共享末级页表时先私有化
+    if (pte == 0 || level != 0 || *pte != old) {
+        free_page(mem);
+        return (pte && level == 0) ? 0 : -1;
+    }
+    if (rmap_add((uint64)mem, pte, va0) < 0) {
+        free_page(mem);
+        return -1;
+    }
+    *pte = PA2PTE(mem) | (PTE_FLAGS(old) & ~PTE_SWAP) | PTE_V;
+    swap_free(PTE2SLOT(old));
+    fault_note(FAULT_MAJOR);
+    return 0;
+}
+
+int lazy_resolve(pagetable_t pagetable, uint64 faultva, int write) {
+    struct proc *p = myproc();
+    if (p == 0 || p->pagetable != pagetable)
+        return -1;
+    if (faultva >= p->sz) {
+        if (mmap_resolve(p, faultva) < 0)
+            return -1;
+        pcpu_inc(&lazy_faults);
+        return 0;
+    }
+
+    uint64 va0 = PGROUNDDOWN(faultva);
+    int ret = swap_resolve(pagetable, va0);
+    if (ret <= 0)
+        return ret;   // 换出的页（不论来自哪个区间）读回后照原权限映射，失败时不能再当作未分配的页
+
+    int perm = -1;
+    struct lazy_region *r = 0;
+    if (va0 >= p->heap_base) {
+        perm = PTE_R | PTE_W | PTE_U;
+    } else {
+        for (int i = 0; i < p->nlazy; i++) {
+            if (va0 >= p->lazy[i].start && va0 < p->lazy[i].end) {
+                r = &p->lazy[i];
+                perm = r->perm | PTE_U;
+                break;
+            }
+        }
+    }
+    if (perm < 0)
+        return -1;
+
+    pte_t *pte = walk_lookup(pagetable, va0);
+    if (pte && (*pte & PTE_V))
+        return -1;  // 已有映射，不是按需分配缺页
+
+    // 含文件内容的程序段页从可执行文件读入，纯 BSS 页（返回 1）照常分配清零页
+    if (r && r->ip) {
+        int ret = exec_fault(p, r, va0);
+        if (ret <= 0) {
+            if (ret == 0)
+                pcpu_inc(&lazy_faults);
+            return ret;
+        }
+    }
+
+    if (!write) {
+        // 只读区间保持只读，不加 COW：之后的写入仍是权限错误
+        int zperm = (perm & PTE_W) ? ((perm & ~PTE_W) | PTE_COW) : perm;
+        page_incref(zero_page);
+        if (map_page(pagetable, va0, (uint64)zero_page, zperm) < 0) {
+            page_decref(zero_page);
+            return -1;
+        }
+        pcpu_inc(&zero_page_faults);
+        fault_note(FAULT_LAZY);
+        return 0;
+    }
+
+    uint64 huge_va = va0 & ~((uint64)MEGAPGSIZE - 1);
+    if (pte == 0 && huge_va >= p->heap_base && huge_va + MEGAPGSIZE <= p->sz) {
+        void *huge = alloc_pages(MEGAPGSIZE / PGSIZE);
+        if (huge) {
+            if (((uint64)huge % MEGAPGSIZE) == 0 &&
+                map_huge(pagetable, huge_va, (uint64)huge, perm) == 0) {
+                pcpu_inc(&lazy_faults);
+                fault_note(FAULT_LAZY);
+                return 0;
+            }
+            free_pages(huge, MEGAPGSIZE / PGSIZE);
+        }
+    }
+
+    void *mem = alloc_page_movable();
+    if (mem == 0)
+        return -1;
+    if (map_page(pagetable, va0, (uint64)mem, perm) < 0) {
+        free_page(mem);
+        return -1;
+    }
+    pcpu_inc(&lazy_faults);
+    fault_note(FAULT_LAZY);
+    return 0;
+}
+
+// 查找页表项（不创建新页表），level 非空时返回叶子项所在层级（0 为 4KB，1 为 2MB）
+pte_t* walk_lookup_level(pagetable_t pt, uint64 va, int *level)
  {
     if (va >= MAXVA) 
         panic("walk");
         
-    for (int level = 2; level > 0; level--) {
-        pte_t* pte = &pt[PX(level, va)];
+    for (int l = 2; l > 0; l--) {
+        pte_t* pte = &pt[PX(l, va)];
         if (!(*pte & PTE_V)) {
             return 0;  // 中间页表不存在
         }
+        // 大页映射在上层即为叶子，直接返回该页表项
+        if (PTE_LEAF(*pte)) {
+            if (level)
+                *level = l;
+            return pte;
+        }
         // 进入下一级页表
         pt = (pagetable_t)PTE2PA(*pte);
     }
     // 返回叶子页表项
+    if (level)
+        *level = 0;
     return &pt[PX(0, va)];
 }
 
-// 查找或创建页表项（需要时创建中间页表）
-pte_t* walk_create(pagetable_t pt, uint64 va) 
+// 查找页表项（不创建新页表）
+pte_t* walk_lookup(pagetable_t pt, uint64 va)
+{
+    return walk_lookup_level(pt, va, 0);
+}
+
+// 查找或创建第 leaf_level 级的页表项（需要时创建中间页表）。
+// leaf_level 为 0 时返回 4KB 叶子项，为 1 时返回可用于 2MB 大页的二级项。
+static pte_t* walk_create_level(pagetable_t pt, uint64 va, int leaf_level)
 {
     if (va >= MAXVA) 
         panic("walk");
     
-    for (int level = 2; level > 0; level--) {
+    for (int level = 2; level > leaf_level; level--) {
         pte_t* pte = &pt[PX(level, va)];
         if (*pte & PTE_V) {
+            // 已被大页覆盖的区域不能再细分映射
+            if (PTE_LEAF(*pte))
+                panic("walk_create: superpage");
+            // 即将修改的末级页表若与其他进程共享，先私有化
+            if (level == 1 && page_refcount((void *)PTE2PA(*pte)) > 1) {
+                if (unshare_l0(pte, va, 0) == 0)
+                    return 0;
+            }
             // 页表已存在，进入下一级
             pt = (pagetable_t)PTE2PA(*pte);
         } else {
@@ -118,14 +744,28 @@ pte_t* walk_create(pagetable_t pt, uint64 va)
             if (pt == 0) {
                 return 0;  // 内存分配失败
             }
-            
-            // 初始化新页表
-            memset(pt, 0, PGSIZE);
-            // 设置页表项
+            pcpu_inc(&pt_pages);
+            // 新页表已由 alloc_page 清零，直接设置页表项
             *pte = PA2PTE(pt) | PTE_V;
         }
     }
-    return &pt[PX(0, va)];
+    return &pt[PX(leaf_level, va)];
+}
+
+// 查找或创建页表项（需要时创建中间页表）
+pte_t* walk_create(pagetable_t pt, uint64 va)
+{
+    return walk_create_level(pt, va, 0);
+}
+
+// 按末级页表分段遍历 [va, end)：返回 va 的 4KB 表项（需要时创建中间页表），*next 置为
+// 这张末级页表覆盖的 2MB 区间末端与 end 中较小者。同一张表内的表项是连续的，
+// 调用者对 [va, *next) 依次访问返回值之后的表项即可，每 512 页只从根走一次
+static pte_t* walk_create_range(pagetable_t pt, uint64 va, uint64 end, uint64 *next)
+{
+    uint64 boundary = (va + MEGAPGSIZE) & ~((uint64)MEGAPGSIZE - 1);
+    *next = boundary < end ? boundary : end;
+    return walk_create_level(pt, va, 0);
 }
 
 // 建立虚拟地址到物理地址的映射
@@ -146,15 +786,21 @@ int map_page(pagetable_t pt, uint64 va, uint64 pa, int perm) {
         panic("mappages: remap");
     }
     
+    // 用户映射登记到反向映射中，登记失败时不建立映射
+    if ((perm & PTE_U) && rmap_add(pa, pte, va) < 0)
+        return -1;
+
     // 设置页表项：物理地址 + 权限位 + 有效位
     *pte = PA2PTE(pa) | perm | PTE_V;
     return 0;
 }
 
-//批量映射一段连续的虚拟地址区间
+//批量映射一段连续的虚拟地址区间。
+//va/pa 同时 2MB 对齐且剩余长度不少于 2MB 时，直接写二级叶子项映射大页，
+//可大幅减少内核直接映射所需的页表项与 TLB 条目；其余部分仍按 4KB 映射。
 int map_region(pagetable_t pagetable, uint64 va, uint64 pa, uint64 size, int perm)
 {
-  uint64 a, last;
+  uint64 a, end, next;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
@@ -166,117 +812,344 @@ int map_region(pagetable_t pagetable, uint64 va, uint64 pa, uint64 size, int per
   if(size == 0)
     panic("mapregions: size");
   
-  a = va;
-  last = va + size - PGSIZE;
-  for(;;){
-    if((pte = walk_create(pagetable, a)) == 0)
+  end = va + size;
+  for(a = va; a < end; ){
+    if((a % MEGAPGSIZE) == 0 && (pa % MEGAPGSIZE) == 0 && end - a >= MEGAPGSIZE){
+      if((pte = walk_create_level(pagetable, a, 1)) == 0)
+        return -1;
+      if(*pte & PTE_V)
+        panic("mapregions: remap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      a += MEGAPGSIZE;
+      pa += MEGAPGSIZE;
+      continue;
+    }
+    // 按 4KB 映射到这张末级页表的末尾；下一个可用大页的位置只会出现在 2MB 边界上
+    if((pte = walk_create_range(pagetable, a, end, &next)) == 0)
       return -1;
-    if(*pte & PTE_V)
-      panic("mapregions: remap");
-    *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
-      break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    for(; a < next; a += PGSIZE, pa += PGSIZE, pte++){
+      if(*pte & PTE_V)
+        panic("mapregions: remap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+    }
   }
   return 0;
 }
 
 //解除一段虚拟地址的映射，并可选释放对应物理页。
-void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+//整块落在区间内的 2MB 大页一次解除；只覆盖一部分时先拆分再逐页处理。
+//整张被共享的末级页表落在区间内时只放弃对页表页的引用；未建立上层页表的区间整段跳过。
+//其余情况下每张末级页表只定位一次，表内连续的表项逐个处理。
+// uvmunmap 攒一批待释放的物理页，确认其他 hart 都已丢弃相应 TLB 条目后再释放
+#define UNMAP_BATCH 16
+
+struct unmap_batch {
+  int n;
+  uint64 pa[UNMAP_BATCH];
+  char huge[UNMAP_BATCH];
+};
+
+static void unmap_batch_drain(struct unmap_batch *b)
+{
+  void *pages[UNMAP_BATCH];
+  int n = 0;
+
+  tlb_batch_flush();
+  for(int i = 0; i < b->n; i++){
+    if(b->huge[i])
+      huge_decref(b->pa[i]);
+    else
+      pages[n++] = (void *)b->pa[i];
+  }
+  free_page_bulk(pages, n);
+  b->n = 0;
+}
+
+static void unmap_batch_add(struct unmap_batch *b, uint64 pa, int huge)
+{
+  if(b->n == UNMAP_BATCH)
+    unmap_batch_drain(b);
+  b->pa[b->n] = pa;
+  b->huge[b->n] = huge;
+  b->n++;
+}
+
+// va 所在 2MB 区间只被部分解除时，是否要先为它准备一张新的末级页表
+static int unmap_needs_table(pagetable_t pagetable, uint64 va)
+{
+  pte_t *l2 = &pagetable[PX(2, va)];
+  if((*l2 & PTE_V) == 0 || PTE_LEAF(*l2))
+    return 0;
+  pte_t *l1 = &((pagetable_t)PTE2PA(*l2))[PX(1, va)];
+  if((*l1 & PTE_V) == 0)
+    return 0;
+  // 大页须先拆分，共享的末级页表须先复制出私有副本
+  return PTE_LEAF(*l1) || page_refcount((void *)PTE2PA(*l1)) > 1;
+}
+
+// 解除 [va, va+npages*PGSIZE) 的映射，成功返回 0。
+// 只有首尾两个 2MB 区间可能被部分解除，它们需要的页表页先行分配；
+// 分配失败时返回 -1，页表保持原样。私有化共享页表时反向映射登记失败也返回 -1，
+// 此前的区间已经解除
+int uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end;
   pte_t *pte;
+  struct unmap_batch batch;
+  pagetable_t spare[2];
+  int nspare = 0, need = 0, err = 0;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk_lookup(pagetable, a)) == 0) 
-      continue;   // 页表项不存在，跳过
-    if((*pte & PTE_V) == 0)  
-      continue;  // 页表项无效，跳过
-    if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      page_decref((void*)pa);  // COW 模式下降引用计数
+  end = va + npages*PGSIZE;
+  uint64 head = va & ~((uint64)MEGAPGSIZE - 1);
+  uint64 tail = end & ~((uint64)MEGAPGSIZE - 1);
+  if(end > va && ((va % MEGAPGSIZE) != 0 || end - va < MEGAPGSIZE) && unmap_needs_table(pagetable, va))
+    need++;
+  if((end % MEGAPGSIZE) != 0 && tail != head && unmap_needs_table(pagetable, tail))
+    need++;
+  for(; nspare < need; nspare++){
+    if((spare[nspare] = (pagetable_t)alloc_page_nozero()) == 0){
+      while(nspare > 0)
+        free_page(spare[--nspare]);
+      return -1;
+    }
+  }
+
+  batch.n = 0;
+  tlb_batch_begin();
+
+  for(a = va; a < end; ){
+    uint64 next_l1 = (a + MEGAPGSIZE) & ~((uint64)MEGAPGSIZE - 1);
+    uint64 next_l2 = (a + (1UL << PXSHIFT(2))) & ~((1UL << PXSHIFT(2)) - 1);
+    int whole = (a % MEGAPGSIZE) == 0 && end - a >= MEGAPGSIZE;
+
+    pte_t *l2 = &pagetable[PX(2, a)];
+    if((*l2 & PTE_V) == 0){
+      a = next_l2;   // 整个 1GB 区间都没有映射
+      continue;
+    }
+    if(PTE_LEAF(*l2))
+      panic("uvmunmap: gigapage");
+
+    pte_t *l1 = &((pagetable_t)PTE2PA(*l2))[PX(1, a)];
+    if((*l1 & PTE_V) == 0){
+      a = next_l1;   // 整个 2MB 区间都没有映射
+      continue;
+    }
+    if(PTE_LEAF(*l1)){
+      if(whole){
+        if(do_free)
+          unmap_batch_add(&batch, PTE2PA(*l1), 1);
+        *l1 = 0;
+        tlb_invalidate_page(pagetable, a);   // 一次 sfence.vma va 即可清除整个大页条目
+        a = next_l1;
+        continue;
+      }
+      // 预分配之后才出现的大页（例如并发缺页）退回就地分配
+      if(split_huge(pagetable, a, l1, nspare > 0 ? spare[--nspare] : 0) < 0){
+        err = -1;
+        break;
+      }
+    } else if(page_refcount((void *)PTE2PA(*l1)) > 1){
+      if(whole){
+        // 数据页仍由其他共享者通过同一张页表持有，这里只放弃页表页的引用
+        page_decref((void *)PTE2PA(*l1));
+        *l1 = 0;
+        tlb_invalidate_all(pagetable);
+        a = next_l1;
+        continue;
+      }
+      if(unshare_l0(l1, a, nspare > 0 ? spare[--nspare] : 0) == 0){
+        err = -1;
+        break;
+      }
+    }
+
+    uint64 next = next_l1 < end ? next_l1 : end;
+    pte = &((pagetable_t)PTE2PA(*l1))[PX(0, a)];
+    for(; a < next; a += PGSIZE, pte++){
+      if(*pte & PTE_V){
+        uint64 pa = PTE2PA(*pte);
+        rmap_remove(pa, pte);
+        if(do_free)
+          unmap_batch_add(&batch, pa, 0);  // COW 模式下降引用计数
+        *pte = 0;
+        tlb_invalidate_page(pagetable, a);
+      } else if(PTE_IS_SWAP(*pte)){
+        if(do_free)
+          swap_free(PTE2SLOT(*pte));   // 换出的页只剩交换槽，不在 TLB 中
+        *pte = 0;
+      }
     }
-    *pte = 0;
   }
+  unmap_batch_drain(&batch);
+  tlb_batch_end();
+  while(nspare > 0)
+    free_page(spare[--nspare]);
+  return err;
 }
 
-// 复制父进程的用户地址空间到子进程
+// 取得 va 所在位置的二级页表项，上层页表不存在时返回 0
+static pte_t* walk_l1(pagetable_t pagetable, uint64 va)
+{
+    pte_t *l2 = &pagetable[PX(2, va)];
+    if((*l2 & PTE_V) == 0 || PTE_LEAF(*l2))
+        return 0;
+    return &((pagetable_t)PTE2PA(*l2))[PX(1, va)];
+}
+
+// 复制父进程的用户地址空间到子进程。
+// 以一张末级页表覆盖的 2MB 为单位处理：末级页表本身由父子共享，只增加页表页的引用计数；
+// 2MB 大页整体共享。两种情况下可写用户页都改为只读 COW，fork 的开销与页表页数量而非页数成正比。
 int uvmcopy(pagetable_t old, pagetable_t newp, uint64 sz)
 {
     uint64 sz_rounded = PGROUNDUP(sz);
-    uint64 pages_mapped = 0;           // 记录已成功映射的页数
-
-    // 遍历每一页
-    for(uint64 va = 0; va < sz_rounded; va += PGSIZE){
-        pte_t *pte = walk_lookup(old, va); // 查找父进程页表项
-        if(pte == 0 || (*pte & PTE_V) == 0)
-            goto err; // 页表项不存在或无效，跳转到错误处理
-
-        uint64 pa = PTE2PA(*pte);         // 获取物理页地址
-        uint flags = PTE_FLAGS(*pte);     // 获取权限标志
-        int cow_candidate = ((*pte & PTE_W) && (*pte & PTE_U)); // 可写且用户页，适合 COW
+    uint64 va;                         // [0, va) 已处理完毕，出错时据此回退
 
-        page_incref((void*)pa);
+    for(va = 0; va < sz_rounded; va += MEGAPGSIZE){
+        pte_t *l1 = walk_l1(old, va);
+        if(l1 == 0 || (*l1 & PTE_V) == 0)
+            continue; // 尚未分配的按需区间，子进程同样在首次访问时分配
 
-        uint new_flags = flags;
-        if(cow_candidate){
-            // 对可写用户页，去掉写权限，加上 COW 标记
-            new_flags = (flags & ~PTE_W) | PTE_COW;
-        }
-
-        // 在子进程页表中建立映射，权限包括 COW 标记
-        if(map_page(newp, va, pa, new_flags & (PTE_R | PTE_W | PTE_X | PTE_U | PTE_COW)) < 0){
-            page_decref((void*)pa); // 映射失败，回退引用计数
+        pte_t *child = walk_create_level(newp, va, 1);
+        if(child == 0 || (*child & PTE_V))
             goto err;
-        }
 
-        if(cow_candidate){
-            // 父进程页表也去掉写权限，加上 COW 标记，实现共享只读
-            *pte = PA2PTE(pa) | (new_flags | PTE_V);
+        uint64 pa = PTE2PA(*l1);
+        if(PTE_LEAF(*l1)){
+            huge_incref(pa);
+            if((*l1 & PTE_W) && (*l1 & PTE_U))
+                *l1 = (*l1 & ~PTE_W) | PTE_COW;   // 可写大页改为共享只读
+            *child = *l1;
+        } else {
+            pagetable_t l0 = (pagetable_t)pa;
+            // 首次共享时把表内可写用户页改为只读 COW；已共享的页表在先前的 fork 中处理过
+            if(page_refcount(l0) == 1){
+                for(int i = 0; i < 512; i++){
+                    if((l0[i] & PTE_V) && (l0[i] & PTE_W) && (l0[i] & PTE_U))
+                        l0[i] = (l0[i] & ~PTE_W) | PTE_COW;
+                }
+            }
+            page_incref(l0);
+            *child = PA2PTE(l0) | PTE_V;
         }
-
-        pages_mapped++; // 记录成功映射的页数
     }
 
-    sfence_vma();
+    tlb_invalidate_all(old);   // 父进程可写页已改为只读 COW，返回用户态前刷新其 ASID
     return 0;
 
 err:
-    // 错误处理：回退子进程已映射的页面
-    if(pages_mapped > 0)
-        uvmunmap(newp, 0, pages_mapped, 1);
-
-    // 回退父进程页表的 COW 标记（只对引用计数为1的页恢复写权限）
-    uint64 revert_end = pages_mapped * PGSIZE;
-    for(uint64 va = 0; va < revert_end; va += PGSIZE){
-        pte_t *pte = walk_lookup(old, va);
-        if(pte == 0)
+    // 错误处理：回退子进程已建立的共享，页表页与数据页的引用计数随之恢复
+    if(va > 0)
+        uvmunmap(newp, 0, va / PGSIZE, 1);
+
+    // 回退父进程页表的 COW 标记：仅对不再共享的页表中、只被父进程引用的页恢复写权限
+    uint64 revert_end = va;
+    for(va = 0; va < revert_end; va += MEGAPGSIZE){
+        pte_t *l1 = walk_l1(old, va);
+        if(l1 == 0 || (*l1 & PTE_V) == 0)
             continue;
-        if((*pte & PTE_COW) == 0)
+        if(PTE_LEAF(*l1)){
+            if((*l1 & PTE_COW) && huge_exclusive(PTE2PA(*l1)))
+                *l1 = (*l1 | PTE_W) & ~PTE_COW;
             continue;
-        uint64 pa = PTE2PA(*pte);
-        if(page_refcount((void*)pa) == 1){
-            *pte = (*pte | PTE_W) & ~PTE_COW;
+        }
+        pagetable_t l0 = (pagetable_t)PTE2PA(*l1);
+        if(page_refcount(l0) != 1)
+            continue;
+        for(int i = 0; i < 512; i++){
+            if((l0[i] & PTE_V) && (l0[i] & PTE_COW) &&
+               page_refcount((void *)PTE2PA(l0[i])) == 1)
+                l0[i] = (l0[i] | PTE_W) & ~PTE_COW;
         }
     }
-    sfence_vma();
+    tlb_invalidate_all(old);
     return -1;
 }
 
+// 把用户虚拟页 va0 翻译为可供内核直接访问的物理页地址，失败返回 0。
+// 当前进程的翻译结果缓存在 p->xlate[] 中，readi/consolewrite 等按块或按字节反复
+// 调用 copyin/copyout 时无需每次重走三级页表。write 为 1 时要求可写：
+// 未分配的按需页先补上，写时复制页先完成克隆。
+// 这是用户指针唯一的校验点：越界、未映射、非用户页或写只读页都返回 0，
+// 系统调用无需事先另做一遍 check_user_ptr。
+static uint64 uvm_translate(pagetable_t pagetable, uint64 va0, int write)
+{
+    if(va0 >= MAXVA)
+        return 0;
+
+    struct proc *p = myproc();
+    if(p && p->pagetable != pagetable)
+        p = 0;
+
+    if(p){
+        for(int i = 0; i < UVM_XLATE_SLOTS; i++){
+            struct xlate_entry *e = &p->xlate[i];
+            if(e->pa && e->va == va0 && (!write || e->writable))
+                return e->pa;
+        }
+    }
+
+    int level;
+    pte_t *pte = walk_lookup_level(pagetable, va0, &level);
+    if(pte == 0 || (*pte & PTE_V) == 0){
+        uint64 start = fault_begin();
+        if(lazy_resolve(pagetable, va0, write) == 0){
+            if(p)
+                fault_end(va0, p->trapframe ? p->trapframe->epc : 0, start, 1);
+            pte = walk_lookup_level(pagetable, va0, &level);
+        }
+    }
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+        return 0;
+
+    if(write && (*pte & PTE_COW)){
+        uint64 start = fault_begin();
+        if(cow_resolve(pagetable, va0) < 0)
+            return 0;
+        if(p)
+            fault_end(va0, p->trapframe ? p->trapframe->epc : 0, start, 1);
+        // COW 处理后页表项可能已替换（大页也可能已被拆分），重新查找
+        pte = walk_lookup_level(pagetable, va0, &level);
+        if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+            return 0;
+    }
+    if(write && (*pte & PTE_W) == 0)
+        return 0;
+
+    uint64 pa0 = LEAF_PA(*pte, va0, level);
+    if(p){
+        struct xlate_entry *e = &p->xlate[p->xlate_next];
+        p->xlate_next = (p->xlate_next + 1) % UVM_XLATE_SLOTS;
+        e->va = va0;
+        e->pa = pa0;
+        e->writable = (*pte & PTE_W) != 0;
+    }
+    return pa0;
+}
+
+// 返回用户地址 va 对应的物理地址（含页内偏移），失败返回 0。
+// write 为 1 时与 copyout 一样先补上按需页并完成写时复制
+uint64 uvm_user_pa(pagetable_t pagetable, uint64 va, int write)
+{
+    uint64 va0 = PGROUNDDOWN(va);
+    uint64 pa0 = uvm_translate(pagetable, va0, write);
+    if(pa0 == 0)
+        return 0;
+    return pa0 + (va - va0);
+}
+
  // 将用户空间数据拷贝到内核缓冲区
 int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
     while(len > 0){
         uint64 va0 = PGROUNDDOWN(srcva);
-        pte_t *pte = walk_lookup(pagetable, va0);
-        if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+        uint64 pa0 = uvm_translate(pagetable, va0, 0);
+        if(pa0 == 0)
             return -1;
 
-        uint64 pa0 = PTE2PA(*pte);
         uint64 offset = srcva - va0;
         uint64 n = PGSIZE - offset;
         if(n > len)
@@ -295,22 +1168,10 @@ int copyout(pagetable_t pagetable, uint64 dstva, const char *src, uint64 len)
 {
     while(len > 0){
         uint64 va0 = PGROUNDDOWN(dstva);
-        pte_t *pte = walk_lookup(pagetable, va0);
-        if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
-            return -1;
-
-        // 命中写时复制页时，先完成物理页克隆
-        if((*pte & PTE_COW) && cow_resolve(pagetable, va0) < 0)
-            return -1;
-
-        // 再次查找页表项，确保 COW 处理后页表项有效
-        pte = walk_lookup(pagetable, va0);
-        if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
-            return -1;
-        if((*pte & PTE_W) == 0)
+        uint64 pa0 = uvm_translate(pagetable, va0, 1);
+        if(pa0 == 0)
             return -1;
 
-        uint64 pa0 = PTE2PA(*pte);
         uint64 offset = dstva - va0;
         uint64 n = PGSIZE - offset;
         if(n > len)
@@ -324,6 +1185,35 @@ int copyout(pagetable_t pagetable, uint64 dstva, const char *src, uint64 len)
     return 0;
 }
 
+// 将用户空间以 '\0' 结尾的字符串拷贝到 dst，至多 max 字节（含结尾）。
+// 按页翻译一次后在页内查找结尾，返回字符串长度；地址非法或 max 字节内没有结尾时返回 -1
+int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
+{
+    uint64 got = 0;
+
+    while(got < max){
+        uint64 va0 = PGROUNDDOWN(srcva);
+        uint64 pa0 = uvm_translate(pagetable, va0, 0);
+        if(pa0 == 0)
+            return -1;
+
+        uint64 offset = srcva - va0;
+        uint64 n = PGSIZE - offset;
+        if(n > max - got)
+            n = max - got;
+
+        const char *s = (const char *)(pa0 + offset);
+        for(uint64 i = 0; i < n; i++){
+            dst[got + i] = s[i];
+            if(s[i] == '\0')
+                return got + i;
+        }
+        got += n;
+        srcva += n;
+    }
+    return -1;
+}
+
 // 递归释放页表（内部辅助函数）
 static void freewalk(pagetable_t pt) {
     // 遍历页表所有条目
@@ -341,6 +1231,41 @@ static void freewalk(pagetable_t pt) {
     }
     // 释放页表本身占用的页面
     free_page((void*)pt);
+    pcpu_dec(&pt_pages);
+}
+
+// 统计页表中已映射的用户页数（带 PTE_U 的叶子，大页按其包含的 4KB 页数计）
+static uint64 rss_walk(pagetable_t pt, int level) {
+    uint64 n = 0;
+    for (int i = 0; i < 512; i++) {
+        pte_t pte = pt[i];
+        if ((pte & PTE_V) == 0)
+            continue;
+        if (PTE_LEAF(pte)) {
+            if (pte & PTE_U)
+                n += 1UL << (9 * level);
+        } else if (level > 0) {
+            n += rss_walk((pagetable_t)PTE2PA(pte), level - 1);
+        }
+    }
+    return n;
+}
+
+// 进程常驻集大小：用户页表中实际映射的页数，共享页在每个映射者中各计一次
+uint64 uvm_rss(pagetable_t pagetable) {
+    if (pagetable == 0)
+        return 0;
+    return rss_walk(pagetable, 2);
+}
+
+// 填写 meminfo 中由虚拟内存层负责的部分
+void vm_meminfo(struct meminfo *mi) {
+    mi->cow_reused = pcpu_read(&cow_reused);
+    mi->cow_copied = pcpu_read(&cow_copied);
+    mi->pagetable_pages = pcpu_read(&pt_pages);
+    mi->cow_faults = mi->cow_reused + mi->cow_copied;
+    mi->lazy_faults = pcpu_read(&lazy_faults);
+    mi->zero_page_faults = pcpu_read(&zero_page_faults);
 }
 
 // 销毁整个页表
@@ -354,12 +1279,85 @@ void destroy_pagetable(pagetable_t pt) {
     freewalk(pt);
 }
 
-// 递归打印页表内容（调试用）
+// 回收进程外壳时调用：释放 VDSO_PROC 之下的全部用户映射与只服务于它们的页表页，
+// 只留下顶端 2MB 中 trampoline、陷阱帧与 vDSO 所在的那条页表路径。
+// 之后用户区间内没有任何有效的 L1 表项，uvmcopy 可以像对待新页表一样向其中复制
+void uvm_reset(pagetable_t pagetable) {
+    uvmunmap(pagetable, 0, VDSO_PROC / PGSIZE, 1);
+
+    for (int i = 0; i < 512; i++) {
+        if ((pagetable[i] & PTE_V) == 0)
+            continue;
+        pagetable_t l1 = (pagetable_t)PTE2PA(pagetable[i]);
+        if (i != PX(2, TRAMPOLINE)) {
+            freewalk(l1);
+            pagetable[i] = 0;
+            continue;
+        }
+        for (int j = 0; j < 512; j++) {
+            if (j != PX(1, TRAMPOLINE) && (l1[j] & PTE_V)) {
+                freewalk((pagetable_t)PTE2PA(l1[j]));
+                l1[j] = 0;
+            }
+        }
+    }
+}
+
+// 进程退出时调用：把用户映射连同所在的页表页整体移到一张新的根页表上并返回它，
+// 由回收线程用 destroy_pagetable 释放。原页表只剩顶端 2MB 的那张末级页表
+// （trampoline、陷阱帧、vDSO 以及与它们同表的少量映射），留给 free_process 处理。
+// 只搬动上两级的表项，末级表项的地址不变，反向映射无需修改。内存不足时返回 0，页表保持原样
+pagetable_t uvm_detach(pagetable_t pagetable) {
+    int top = PX(2, TRAMPOLINE), keep = PX(1, TRAMPOLINE);
+    pagetable_t l1 = (pagetable_t)PTE2PA(pagetable[top]);
+    pagetable_t det, det_l1 = 0;
+
+    if ((det = (pagetable_t)alloc_page()) == 0)
+        return 0;
+    pcpu_inc(&pt_pages);
+    for (int j = 0; j < 512; j++) {
+        if (j != keep && (l1[j] & PTE_V)) {
+            if ((det_l1 = (pagetable_t)alloc_page()) == 0) {
+                free_page(det);
+                pcpu_dec(&pt_pages);
+                return 0;
+            }
+            pcpu_inc(&pt_pages);
+            break;
+        }
+    }
+
+    for (int i = 0; i < 512; i++) {
+        if (i != top && (pagetable[i] & PTE_V)) {
+            det[i] = pagetable[i];
+            pagetable[i] = 0;
+        }
+    }
+    if (det_l1) {
+        for (int j = 0; j < 512; j++) {
+            if (j != keep && (l1[j] & PTE_V)) {
+                det_l1[j] = l1[j];
+                l1[j] = 0;
+            }
+        }
+        det[top] = PA2PTE(det_l1) | PTE_V;
+    }
+    // 进程不会再回到用户态；ASID 被重新分配时整体刷新，这里只丢弃翻译缓存
+    tlb_invalidate_all(pagetable);
+    return det;
+}
+
+// 递归打印页表内容（调试用）。顶层调用结束时汇总各尺寸叶子映射的数量。
 void dump_pagetable(pagetable_t pt, int level) {
     if (pt == 0) return;
     
     static const char* level_names[] = {"L2", "L1", "L0"};
+    static const char* leaf_sizes[] = {"1GB", "2MB", "4KB"};
+    static int leaf_count[3];
     if (level < 0 || level > 2) return;
+    if (level == 0) {
+        leaf_count[0] = leaf_count[1] = leaf_count[2] = 0;
+    }
     
     printf("=== %s Page Table at 0x%p ===\n", level_names[level], pt);
     
@@ -377,7 +1375,8 @@ void dump_pagetable(pagetable_t pt, int level) {
                 }
             } else {
                 // 叶子映射
-                printf("PA: 0x%lx | Perm: ", PTE2PA(pte));
+                leaf_count[level]++;
+                printf("PA: 0x%lx | %s | Perm: ", PTE2PA(pte), leaf_sizes[level]);
                 if (pte & PTE_R) printf("R");
                 if (pte & PTE_W) printf("W"); 
                 if (pte & PTE_X) printf("X");
@@ -388,6 +1387,8 @@ void dump_pagetable(pagetable_t pt, int level) {
     }
     
     if (level == 0) {
+        printf("Leaf mappings: 1GB=%d 2MB=%d 4KB=%d\n",
+               leaf_count[0], leaf_count[1], leaf_count[2]);
         printf("=== End of Page Table Dump ===\n");
     }
 }
@@ -404,7 +1405,6 @@ void uvmfirst(pagetable_t pagetable, const uint8 *src, uint64 sz)
         if(pa == 0)
             panic("uvmfirst: alloc_page");
 
-        memset((void *)pa, 0, PGSIZE);
         if(map_page(pagetable, off, pa, PTE_R | PTE_W | PTE_X | PTE_U) < 0)
             panic("uvmfirst: map_page");
 
@@ -417,8 +1417,12 @@ void uvmfirst(pagetable_t pagetable, const uint8 *src, uint64 sz)
 }
 
 // uvmalloc_perm: 扩大用户地址空间 [oldsz, newsz)，按权限逐页分配并清零。
+// 遇到 2MB 对齐且剩余不少于 2MB 的区间时，尝试用 alloc_pages 取连续 512 页建立大页映射，
+// 失败（无连续内存或该区间已有下级页表）则退回逐页分配，每张末级页表只定位一次。
 uint64 uvmalloc_perm(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int perm)
 {
+    uint64 a, next;
+
     if(newsz < oldsz)
         return oldsz;
 
@@ -430,23 +1434,42 @@ uint64 uvmalloc_perm(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int perm
 
     perm |= PTE_U; // always require user access for user mappings
 
-    for(uint64 a = start; a < end; a += PGSIZE) {
-        void *mem = alloc_page();
-        if(mem == 0) {
-            if(a > start)
-                uvmdealloc(pagetable, a, oldsz);
-            return 0;
+    for(a = start; a < end; ) {
+        if((a % MEGAPGSIZE) == 0 && end - a >= MEGAPGSIZE) {
+            void *huge = alloc_pages(MEGAPGSIZE / PGSIZE);
+            if(huge) {
+                if(((uint64)huge % MEGAPGSIZE) == 0 &&
+                   map_huge(pagetable, a, (uint64)huge, perm) == 0) {
+                    a += MEGAPGSIZE;
+                    continue;
+                }
+                free_pages(huge, MEGAPGSIZE / PGSIZE);
+            }
         }
-        memset(mem, 0, PGSIZE);
-        if(map_page(pagetable, a, (uint64)mem, perm) < 0) {
-            free_page(mem);
-            if(a > start)
-                uvmdealloc(pagetable, a, oldsz);
-            return 0;
+
+        pte_t *pte = walk_create_range(pagetable, a, end, &next);
+        if(pte == 0)
+            goto fail;
+        for(; a < next; a += PGSIZE, pte++) {
+            if(*pte & PTE_V)
+                panic("uvmalloc: remap");
+            void *mem = alloc_page();
+            if(mem == 0)
+                goto fail;
+            if(rmap_add((uint64)mem, pte, a) < 0) {
+                free_page(mem);
+                goto fail;
+            }
+            *pte = PA2PTE(mem) | perm | PTE_V;
         }
     }
-
     return newsz;
+
+fail:
+    // [start, a) 已经映射，逐页回退
+    if(a > start)
+        uvmdealloc(pagetable, a, oldsz);
+    return 0;
 }
 
 uint64 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
@@ -455,6 +1478,7 @@ uint64 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 }
 
 // uvmdealloc: 收缩用户地址空间至 newsz，释放多余页面。
+// 拆分页表时内存不足则返回 oldsz，调用者据此保留原大小。
 uint64 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
     if(newsz >= oldsz)
@@ -463,8 +1487,8 @@ uint64 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
     uint64 start = PGROUNDUP(newsz);
     uint64 end = PGROUNDUP(oldsz);
 
-    if(end > start)
-        uvmunmap(pagetable, start, (end - start) / PGSIZE, 1);
+    if(end > start && uvmunmap(pagetable, start, (end - start) / PGSIZE, 1) < 0)
+        return oldsz;
 
     return newsz;
 }
@@ -0,0 +1,555 @@
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "string.h"
+#include "printf.h"
+#include "vm.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "pollwait.h"
+#include "timer.h"
+#include "socket.h"
+#include "net.h"
+
+// net.c: 以太网/ARP/IPv4/UDP 与数据报套接字。
+// 接收：net_rx 在驱动交上来的页尾写入 struct pktbuf，把整页挂到目标套接字的接收队列，
+// sockrecvfrom 把负载拷给用户后释放该页；目标端口没有套接字或队列已满时丢弃。
+// 发送：socksendto 在新页中构造以太网/IP/UDP 首部。负载足够大且用户页都已驻留时
+// 直接把这些页固定后交给网卡（驱动等设备取走后返回），否则把负载拷在首部之后。
+// 发往本机地址的包不经过网卡，拷进新页后直接投递。
+// 锁顺序：sock_lock -> so->lock；arp_lock 与二者都不嵌套。
+
+extern volatile uint64 ticks;
+
+#define ARP_ENTRIES 16
+#define ARP_TRIES   3
+#define ARP_WAIT    10        // 每次 ARP 请求后等待应答的 tick 数
+#define SOCK_RXQ_MAX 64       // 每个套接字最多排队的数据报
+#define PORT_EPHEMERAL 49152  // 自动分配端口的起点
+
+// 页尾记录的数据包元数据，接收缓冲区不会写到这里（见 NET_RX_BUFSIZE）
+struct pktbuf {
+    struct pktbuf *next;
+    char *page;
+    int off;                  // 负载在页中的偏移
+    int len;                  // 负载长度
+    uint32 src;               // 源地址与端口，主机字节序
+    uint16 sport;
+};
+#define PKTBUF(page) ((struct pktbuf *)((page) + PGSIZE - sizeof(struct pktbuf)))
+
+struct sock {
+    struct spinlock lock;     // 保护接收队列
+    uint16 lport;             // 绑定的本地端口（主机字节序），0 表示尚未绑定
+    struct pktbuf *head;      // 接收队列
+    struct pktbuf *tail;
+    int nrx;
+    struct pollq pollq;
+    struct sock *next;        // 全局套接字链表，由 sock_lock 保护
+};
+
+static struct kmem_cache *sock_cache;
+static struct spinlock sock_lock;     // 保护 socks 链表与端口分配
+static struct sock *socks;
+static uint16 next_port = PORT_EPHEMERAL;
+
+struct arp_entry {
+    uint32 ip;
+    uint8 mac[ETH_ALEN];
+    int valid;
+};
+static struct spinlock arp_lock;
+static struct arp_entry arp_table[ARP_ENTRIES];
+static int arp_next;                  // 表满时轮流替换
+
+static int have_nic;
+static uint8 local_mac[ETH_ALEN];
+static const uint8 bcast_mac[ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+static uint16 ip_id;
+
+void net_init(void)
+{
+    initlock(&sock_lock, "sock");
+    initlock(&arp_lock, "arp");
+    sock_cache = kmem_cache_create("sock", sizeof(struct sock), 0);
+    if(sock_cache == 0)
+        panic("net_init: kmem_cache_create");
+    have_nic = virtio_net_init(local_mac);
+}
+
+// ---------------- ARP ----------------
+
+static int arp_lookup(uint32 ip, uint8 *mac)
+{
+    int found = 0;
+    acquire(&arp_lock);
+    for(int i = 0; i < ARP_ENTRIES; i++){
+        if(arp_table[i].valid && arp_table[i].ip == ip){
+            memmove(mac, arp_table[i].mac, ETH_ALEN);
+            found = 1;
+            break;
+        }
+    }
+    release(&arp_lock);
+    return found;
+}
+
+// 记下 ip 对应的 MAC 并唤醒等待解析的发送者
+static void arp_learn(uint32 ip, const uint8 *mac)
+{
+    acquire(&arp_lock);
+    int slot = -1;
+    for(int i = 0; i < ARP_ENTRIES && slot < 0; i++)
+        if(arp_table[i].valid && arp_table[i].ip == ip)
+            slot = i;
+    for(int i = 0; i < ARP_ENTRIES && slot < 0; i++)
+        if(!arp_table[i].valid)
+            slot = i;
+    if(slot < 0){
+        slot = arp_next;
+        arp_next = (arp_next + 1) % ARP_ENTRIES;
+    }
+    arp_table[slot].ip = ip;
+    memmove(arp_table[slot].mac, mac, ETH_ALEN);
+    arp_table[slot].valid = 1;
+    wakeup(arp_table);
+    release(&arp_lock);
+}
+
+static void arp_send(int op, const uint8 *tha, uint32 tip, int nowait)
+{
+    char *frame = alloc_page_nozero();
+    if(frame == 0)
+        return;
+    struct eth_hdr *eh = (struct eth_hdr *)frame;
+    struct arp_hdr *ah = (struct arp_hdr *)(eh + 1);
+    memmove(eh->dst, op == 1 ? bcast_mac : tha, ETH_ALEN);
+    memmove(eh->src, local_mac, ETH_ALEN);
+    eh->type = htons(ETH_TYPE_ARP);
+    ah->hrd = htons(1);
+    ah->pro = htons(ETH_TYPE_IP);
+    ah->hln = ETH_ALEN;
+    ah->pln = 4;
+    ah->op = htons(op);
+    memmove(ah->sha, local_mac, ETH_ALEN);
+    ah->sip = htonl(NET_IP);
+    memset(ah->tha, 0, ETH_ALEN);
+    if(op == 2)
+        memmove(ah->tha, tha, ETH_ALEN);
+    ah->tip = htonl(tip);
+    virtio_net_send(frame, 0, sizeof(*eh) + sizeof(*ah), 0, 0, nowait);
+}
+
+static void arp_input(struct arp_hdr *ah)
+{
+    if(ntohs(ah->hrd) != 1 || ntohs(ah->pro) != ETH_TYPE_IP)
+        return;
+    uint32 sip = ntohl(ah->sip);
+    if(ntohl(ah->tip) != NET_IP)
+        return;
+    arp_learn(sip, ah->sha);
+    if(ntohs(ah->op) == 1)
+        arp_send(2, ah->sha, sip, 1);   // 在中断下半部中应答，不能等待描述符
+}
+
+static void arp_timer_expired(void *arg)
+{
+    (void)arg;
+    acquire(&arp_lock);
+    wakeup(arp_table);
+    release(&arp_lock);
+}
+
+// 解析下一跳的 MAC：先查表，查不到时广播请求并等待应答，重试 ARP_TRIES 次
+static int arp_resolve(uint32 ip, uint8 *mac)
+{
+    if(ip == 0xffffffff){
+        memmove(mac, bcast_mac, ETH_ALEN);
+        return 0;
+    }
+    for(int t = 0; t < ARP_TRIES; t++){
+        if(arp_lookup(ip, mac))
+            return 0;
+        arp_send(1, 0, ip, 0);
+
+        struct ktimer timer = {0};
+        acquire(&arp_lock);
+        uint64 deadline = ticks + ARP_WAIT;
+        ktimer_add(&timer, deadline, arp_timer_expired, 0);
+        int found = 0;
+        while(!found && ticks < deadline && !killed(myproc())){
+            for(int i = 0; i < ARP_ENTRIES; i++)
+                if(arp_table[i].valid && arp_table[i].ip == ip)
+                    found = 1;
+            if(!found)
+                sleep(arp_table, &arp_lock);
+        }
+        release(&arp_lock);
+        ktimer_cancel(&timer);
+        if(killed(myproc()))
+            return -1;
+    }
+    return arp_lookup(ip, mac) ? 0 : -1;
+}
+
+// ---------------- IPv4 / UDP ----------------
+
+static uint16 ip_checksum(void *data, int len)
+{
+    uint8 *p = data;
+    uint32 sum = 0;
+    for(int i = 0; i + 1 < len; i += 2)
+        sum += (p[i] << 8) | p[i + 1];
+    if(len & 1)
+        sum += p[len - 1] << 8;
+    while(sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return htons(~sum & 0xffff);
+}
+
+static int is_local(uint32 ip)
+{
+    return ip == NET_IP || (ip >> 24) == 127;
+}
+
+// 把负载位于 page + off 的数据报交给绑定 dport 的套接字，页的所有权随之转交
+static void udp_deliver(char *page, int off, int len, uint32 src, uint16 sport, uint16 dport)
+{
+    struct sock *so;
+
+    acquire(&sock_lock);
+    for(so = socks; so; so = so->next)
+        if(so->lport == dport)
+            break;
+    if(so == 0){
+        release(&sock_lock);
+        free_page(page);
+        return;
+    }
+    acquire(&so->lock);
+    release(&sock_lock);
+    if(so->nrx >= SOCK_RXQ_MAX){
+        release(&so->lock);
+        free_page(page);
+        return;
+    }
+    struct pktbuf *pb = PKTBUF(page);
+    pb->next = 0;
+    pb->page = page;
+    pb->off = off;
+    pb->len = len;
+    pb->src = src;
+    pb->sport = sport;
+    if(so->tail)
+        so->tail->next = pb;
+    else
+        so->head = pb;
+    so->tail = pb;
+    so->nrx++;
+    wakeup(&so->nrx);
+    poll_notify(&so->pollq);
+    release(&so->lock);
+}
+
+void net_rx(char *page, int off, int len)
+{
+    char *p = page + off;
+    if(len < (int)sizeof(struct eth_hdr))
+        goto drop;
+    struct eth_hdr *eh = (struct eth_hdr *)p;
+    p += sizeof(*eh);
+    len -= sizeof(*eh);
+
+    if(ntohs(eh->type) == ETH_TYPE_ARP){
+        if(len >= (int)sizeof(struct arp_hdr))
+            arp_input((struct arp_hdr *)p);
+        goto drop;
+    }
+    if(ntohs(eh->type) != ETH_TYPE_IP || len < (int)sizeof(struct ip_hdr))
+        goto drop;
+
+    struct ip_hdr *ip = (struct ip_hdr *)p;
+    int hlen = (ip->vhl & 0xf) * 4;
+    int tot = ntohs(ip->len);
+    if((ip->vhl >> 4) != 4 || hlen < (int)sizeof(*ip) || tot < hlen || tot > len)
+        goto drop;
+    if(ntohl(ip->dst) != NET_IP && ip->dst != 0xffffffff)
+        goto drop;
+    if(ntohs(ip->off) & 0x3fff)
+        goto drop;   // 不支持分片
+    if(ip->proto != IP_PROTO_UDP || tot - hlen < (int)sizeof(struct udp_hdr))
+        goto drop;
+
+    uint32 src = ntohl(ip->src);
+    if((src & NET_MASK) == (NET_IP & NET_MASK))
+        arp_learn(src, eh->src);
+
+    struct udp_hdr *uh = (struct udp_hdr *)(p + hlen);
+    int ulen = ntohs(uh->len);
+    if(ulen < (int)sizeof(*uh) || ulen > tot - hlen)
+        goto drop;
+    int poff = (char *)(uh + 1) - page;
+    udp_deliver(page, poff, ulen - sizeof(*uh), src, ntohs(uh->sport), ntohs(uh->dport));
+    return;
+
+drop:
+    free_page(page);
+}
+
+// 固定用户缓冲区 [addr, addr+n) 所在的页并填写负载段，有页未驻留或不属于页分配器时返回 -1
+static int pin_user(uint64 addr, int n, struct net_seg *seg)
+{
+    struct proc *p = myproc();
+    int nseg = 0;
+
+    while(n > 0){
+        uint64 pa = uvm_user_pa(p->pagetable, addr, 0);
+        int m = PGSIZE - (addr % PGSIZE);
+        if(m > n)
+            m = n;
+        if(pa == 0 || nseg == NET_TX_SEGS || page_refcount((void *)PGROUNDDOWN(pa)) == 0)
+            goto fail;
+        page_incref((void *)PGROUNDDOWN(pa));
+        seg[nseg].addr = pa;
+        seg[nseg].len = m;
+        nseg++;
+        addr += m;
+        n -= m;
+    }
+    return nseg;
+
+fail:
+    for(int i = 0; i < nseg; i++)
+        page_decref((void *)PGROUNDDOWN(seg[i].addr));
+    return -1;
+}
+
+static int copy_payload(char *dst, int user, uint64 addr, int n)
+{
+    if(!user){
+        memmove(dst, (char *)addr, n);
+        return 0;
+    }
+    return copyin(myproc()->pagetable, dst, addr, n);
+}
+
+static int udp_output(struct sock *so, int user, uint64 addr, int n, uint32 dst, uint16 dport)
+{
+    if(is_local(dst)){
+        char *page = alloc_page_nozero();
+        if(page == 0)
+            return -1;
+        if(copy_payload(page, user, addr, n) < 0){
+            free_page(page);
+            return -1;
+        }
+        udp_deliver(page, 0, n, dst, so->lport, dport);
+        return n;
+    }
+    if(!have_nic)
+        return -1;
+
+    uint32 hop = (dst & NET_MASK) == (NET_IP & NET_MASK) || dst == 0xffffffff ? dst : NET_GATEWAY;
+    uint8 mac[ETH_ALEN];
+    if(arp_resolve(hop, mac) < 0)
+        return -1;
+
+    char *frame = alloc_page_nozero();
+    if(frame == 0)
+        return -1;
+    struct eth_hdr *eh = (struct eth_hdr *)frame;
+    struct ip_hdr *ip = (struct ip_hdr *)(eh + 1);
+    struct udp_hdr *uh = (struct udp_hdr *)(ip + 1);
+    int hdrlen = sizeof(*eh) + sizeof(*ip) + sizeof(*uh);
+
+    memmove(eh->dst, mac, ETH_ALEN);
+    memmove(eh->src, local_mac, ETH_ALEN);
+    eh->type = htons(ETH_TYPE_IP);
+    ip->vhl = (4 << 4) | (sizeof(*ip) / 4);
+    ip->tos = 0;
+    ip->len = htons(sizeof(*ip) + sizeof(*uh) + n);
+    ip->id = htons(__atomic_fetch_add(&ip_id, 1, __ATOMIC_RELAXED));
+    ip->off = 0;
+    ip->ttl = 64;
+    ip->proto = IP_PROTO_UDP;
+    ip->sum = 0;
+    ip->src = htonl(NET_IP);
+    ip->dst = htonl(dst);
+    ip->sum = ip_checksum(ip, sizeof(*ip));
+    uh->sport = htons(so->lport);
+    uh->dport = htons(dport);
+    uh->len = htons(sizeof(*uh) + n);
+    uh->sum = 0;
+
+    struct net_seg seg[NET_TX_SEGS];
+    int nseg = -1;
+    if(user && n >= NET_TX_ZC_MIN)
+        nseg = pin_user(addr, n, seg);
+    if(nseg < 0){
+        if(copy_payload(frame + hdrlen, user, addr, n) < 0){
+            free_page(frame);
+            return -1;
+        }
+        hdrlen += n;
+        nseg = 0;
+    }
+    if(virtio_net_send(frame, 0, hdrlen, seg, nseg, 0) < 0)
+        return -1;
+    return n;
+}
+
+// ---------------- 套接字 ----------------
+
+// 给尚未绑定的套接字分配一个空闲的临时端口，调用者持有 sock_lock
+static int port_in_use(uint16 port)
+{
+    for(struct sock *s = socks; s; s = s->next)
+        if(s->lport == port)
+            return 1;
+    return 0;
+}
+
+static int sock_autobind(struct sock *so)
+{
+    acquire(&sock_lock);
+    if(so->lport == 0){
+        for(int i = 0; i < 65536 - PORT_EPHEMERAL; i++){
+            uint16 port = next_port;
+            next_port = next_port == 65535 ? PORT_EPHEMERAL : next_port + 1;
+            if(!port_in_use(port)){
+                so->lport = port;
+                break;
+            }
+        }
+    }
+    release(&sock_lock);
+    return so->lport ? 0 : -1;
+}
+
+int sockalloc(struct file **f, int domain, int type, int protocol)
+{
+    if(domain != AF_INET || type != SOCK_DGRAM || (protocol != 0 && protocol != IPPROTO_UDP))
+        return -1;
+    struct sock *so = kmem_cache_alloc(sock_cache);
+    if(so == 0)
+        return -1;
+    if((*f = filealloc()) == 0){
+        kmem_cache_free(sock_cache, so);
+        return -1;
+    }
+    initlock(&so->lock, "sock");
+    so->lport = 0;
+    so->head = so->tail = 0;
+    so->nrx = 0;
+    so->pollq.head = 0;
+
+    acquire(&sock_lock);
+    so->next = socks;
+    socks = so;
+    release(&sock_lock);
+
+    (*f)->type = FD_SOCKET;
+    (*f)->readable = 1;
+    (*f)->writable = 1;
+    (*f)->sock = so;
+    return 0;
+}
+
+void sockclose(struct sock *so)
+{
+    acquire(&sock_lock);
+    for(struct sock **pp = &socks; *pp; pp = &(*pp)->next){
+        if(*pp == so){
+            *pp = so->next;
+            break;
+        }
+    }
+    release(&sock_lock);
+
+    // 已从链表摘下，不会再有新的数据报入队；加一次锁等正在投递的中断处理完
+    acquire(&so->lock);
+    release(&so->lock);
+    while(so->head){
+        struct pktbuf *pb = so->head;
+        so->head = pb->next;
+        free_page(pb->page);
+    }
+    kmem_cache_free(sock_cache, so);
+}
+
+// 绑定本地端口（主机字节序），port 为 0 时分配临时端口。只有一个本机地址，addr 只能是
+// INADDR_ANY 或本机地址
+int sockbind(struct sock *so, uint32 addr, uint16 port)
+{
+    if(addr != INADDR_ANY && !is_local(addr))
+        return -1;
+    if(so->lport != 0)
+        return -1;
+    if(port == 0)
+        return sock_autobind(so);
+    acquire(&sock_lock);
+    int busy = port_in_use(port);
+    if(!busy)
+        so->lport = port;
+    release(&sock_lock);
+    return busy ? -1 : 0;
+}
+
+// 发送一个数据报，返回发送的字节数；负载超过一个以太网帧能容纳的长度时返回 -1
+int socksendto(struct sock *so, int user, uint64 addr, int n, uint32 dst, uint16 dport)
+{
+    if(n < 0 || n > (int)UDP_MAX_PAYLOAD || dport == 0)
+        return -1;
+    if(so->lport == 0 && sock_autobind(so) < 0)
+        return -1;
+    return udp_output(so, user, addr, n, dst, dport);
+}
+
+// 接收一个数据报，超出 n 的部分丢弃。没有数据时等待，flags 含 MSG_DONTWAIT 时返回 -1
+int sockrecvfrom(struct sock *so, int user, uint64 addr, int n, int flags, uint32 *src, uint16 *sport)
+{
+    struct proc *p = myproc();
+
+    acquire(&so->lock);
+    while(so->head == 0){
+        if((flags & MSG_DONTWAIT) || killed(p)){
+            release(&so->lock);
+            return -1;
+        }
+        sleep(&so->nrx, &so->lock);
+    }
+    struct pktbuf *pb = so->head;
+    so->head = pb->next;
+    if(so->head == 0)
+        so->tail = 0;
+    so->nrx--;
+    release(&so->lock);
+
+    int m = n < pb->len ? n : pb->len;
+    int r = 0;
+    if(m < 0)
+        m = 0;
+    if(user)
+        r = copyout(p->pagetable, addr, pb->page + pb->off, m);
+    else
+        memmove((char *)addr, pb->page + pb->off, m);
+    if(src)
+        *src = pb->src;
+    if(sport)
+        *sport = pb->sport;
+    free_page(pb->page);
+    return r < 0 ? -1 : m;
+}
+
+int sockpoll(struct sock *so, struct poll_table *pt)
+{
+    poll_wait(&so->pollq, pt);
+    acquire(&so->lock);
+    int mask = POLLOUT | (so->head ? POLLIN : 0);
+    release(&so->lock);
+    return mask;
+}
@@ -0,0 +1,338 @@
+#include "types.h"
+#include "memlayout.h"
+#include "printf.h"
+#include "string.h"
+#include "spinlock.h"
+#include "virtio.h"
+#include "kalloc.h"
+#include "riscv.h"
+#include "proc.h"
+#include "plic.h"
+#include "atomic.h"
+#include "net.h"
+#include "softirq.h"
+
+// VirtIO 网卡驱动：探测与队列配置照搬 virtio_disk.c，队列 0 接收、队列 1 发送。
+// 接收环上预先挂满整页缓冲区，设备把 virtio_net_hdr 与以太网帧写在页首；收到的页
+// 原样交给协议栈（net_rx），再从页分配器取一张新页补回环上，数据在拷给用户之前不做复制。
+// 发送的每个包是一条描述符链：共用的全零 virtio_net_hdr、协议栈构造的帧页，
+// 以及至多 NET_TX_SEGS 段直接指向用户页的负载。帧页与固定的用户页在设备取走后释放。
+
+#define R(r) ((volatile uint32 *)(VIRTIO1 + (r)))
+
+#define RXQ 0
+#define TXQ 1
+
+struct netq {
+    struct virtq_desc *desc;
+    struct virtq_avail *avail;
+    struct virtq_used *used;
+    uint16 used_idx;
+};
+
+static struct {
+    int present;                        // 探测到设备并完成初始化
+    struct spinlock rxlock;             // 保护接收队列
+    struct netq rx;
+    char *rxpage[VIRTIO_RING_NUM];      // 每个接收描述符挂的页
+
+    struct spinlock txlock;             // 保护发送队列与下列各项
+    struct netq tx;
+    char free[VIRTIO_RING_NUM];         // 发送描述符空闲标记
+    struct {
+        char *frame;                    // 帧页，完成后释放
+        uint64 pin[NET_TX_SEGS];        // 固定住的用户物理页，完成后放弃引用
+        int npin;
+        int done;                       // 设备已取走，等待者据此返回
+        int waited;                     // 有进程在等待完成，由等待者负责回收
+    } info[VIRTIO_RING_NUM];
+} net;
+
+// 所有发送包共用的首部：不使用校验和卸载与分段卸载，设备只读不写
+static struct virtio_net_hdr tx_hdr;
+
+static void setup_queue(int id, struct netq *q)
+{
+    *R(VIRTIO_MMIO_QUEUE_SEL) = id;
+    if(*R(VIRTIO_MMIO_QUEUE_READY))
+        panic("virtio_net: queue in use");
+    uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+    if(max == 0)
+        panic("virtio_net: no queue");
+    if(max < VIRTIO_RING_NUM)
+        panic("virtio_net: queue too short");
+
+    // 与 virtio_disk 相同：三个环从 CMA 区取连续的三页
+    char *ring = cma_alloc(3);
+    if(ring == 0)
+        ring = alloc_pages(3);
+    if(ring == 0)
+        panic("virtio_net: alloc ring");
+    q->desc = (struct virtq_desc *)ring;
+    q->avail = (struct virtq_avail *)(ring + PGSIZE);
+    q->used = (struct virtq_used *)(ring + 2 * PGSIZE);
+    q->used_idx = 0;
+
+    *R(VIRTIO_MMIO_QUEUE_NUM) = VIRTIO_RING_NUM;
+    uint64 desc_pa = (uint64)q->desc;
+    uint64 avail_pa = (uint64)q->avail;
+    uint64 used_pa = (uint64)q->used;
+    *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint32)desc_pa;
+    *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint32)(desc_pa >> 32);
+    *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint32)avail_pa;
+    *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint32)(avail_pa >> 32);
+    *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint32)used_pa;
+    *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint32)(used_pa >> 32);
+    *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
+}
+
+// 把第 i 个接收描述符（挂着 net.rxpage[i]）放回可用环，调用者持有 rxlock
+static void rx_post(int i)
+{
+    net.rx.desc[i].addr = (uint64)net.rxpage[i];
+    net.rx.desc[i].len = NET_RX_BUFSIZE;
+    net.rx.desc[i].flags = VRING_DESC_F_WRITE;
+    net.rx.desc[i].next = 0;
+    net.rx.avail->ring[net.rx.avail->idx % VIRTIO_RING_NUM] = i;
+    smp_wmb();
+    net.rx.avail->idx += 1;
+}
+
+// 回收接收环：收满的页换成新页补回环上，旧页在释放锁之后交给协议栈
+static void rx_reap(void)
+{
+    char *pages[VIRTIO_RING_NUM];
+    int lens[VIRTIO_RING_NUM];
+    int n = 0;
+
+    acquire(&net.rxlock);
+    while(net.rx.used_idx != *(volatile uint16 *)&net.rx.used->idx){
+        smp_rmb();
+        struct virtq_used_elem *e = &net.rx.used->ring[net.rx.used_idx % VIRTIO_RING_NUM];
+        int id = e->id;
+        int len = e->len;
+        net.rx.used_idx += 1;
+
+        char *fresh = alloc_page_nozero();
+        if(fresh && len > (int)sizeof(struct virtio_net_hdr)){
+            pages[n] = net.rxpage[id];
+            lens[n] = len - sizeof(struct virtio_net_hdr);
+            n++;
+            net.rxpage[id] = fresh;
+        } else if(fresh) {
+            free_page(fresh);
+        }
+        // 没有新页可换时丢弃这个包，原页直接重新挂回
+        rx_post(id);
+    }
+    if(n > 0){
+        io_wmb();
+        *R(VIRTIO_MMIO_QUEUE_NOTIFY) = RXQ;
+    }
+    release(&net.rxlock);
+
+    for(int i = 0; i < n; i++)
+        net_rx(pages[i], sizeof(struct virtio_net_hdr), lens[i]);
+}
+
+// 释放发送链的描述符与帧页、放弃固定的用户页，调用者持有 txlock
+static void tx_free(int head)
+{
+    int i = head;
+    for(;;){
+        int flags = net.tx.desc[i].flags;
+        int next = net.tx.desc[i].next;
+        net.free[i] = 1;
+        if(!(flags & VRING_DESC_F_NEXT))
+            break;
+        i = next;
+    }
+    free_page(net.info[head].frame);
+    for(int k = 0; k < net.info[head].npin; k++)
+        page_decref((void *)net.info[head].pin[k]);
+    net.info[head].frame = 0;
+    net.info[head].npin = 0;
+    wakeup(&net.free[0]);
+}
+
+// 回收发送环，调用者持有 txlock。有人等待的包只标记完成，由等待者自己回收
+static void tx_reap(void)
+{
+    while(net.tx.used_idx != *(volatile uint16 *)&net.tx.used->idx){
+        smp_rmb();
+        int id = net.tx.used->ring[net.tx.used_idx % VIRTIO_RING_NUM].id;
+        net.tx.used_idx += 1;
+        net.info[id].done = 1;
+        if(net.info[id].waited)
+            wakeup(&net.info[id]);
+        else
+            tx_free(id);
+    }
+}
+
+// 下半部：收包交给协议栈、回收发送环，在开中断的状态下进行
+static void virtio_net_work(void *arg)
+{
+    (void)arg;
+    rx_reap();
+    acquire(&net.txlock);
+    tx_reap();
+    release(&net.txlock);
+}
+
+static struct softwork net_work = SOFTWORK_INIT(virtio_net_work, 0);
+
+// 上半部只确认中断；两个环的处理合并到一个工作项，不会在两个 hart 上同时进行
+void virtio_net_intr(void)
+{
+    *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+    softwork_queue(&net_work);
+}
+
+static int tx_alloc(void)
+{
+    for(int i = 0; i < VIRTIO_RING_NUM; i++){
+        if(net.free[i]){
+            net.free[i] = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 发送一帧：frame 为帧页（从页首 off 字节起的 len 字节，所有权交给驱动），
+// 其后接 nseg 段负载。seg[i].addr 为物理地址，所在页已由调用者 page_incref 固定，
+// 完成后由驱动放弃；有负载段时等待设备取走再返回，调用者返回后用户即可改写缓冲区。
+// nowait 为 1 时（中断上下文，如应答 ARP）不睡眠：描述符用尽直接丢弃，且不得带负载段。
+// 设备不存在或丢弃时返回 -1，帧页与固定的页同样会被释放
+int virtio_net_send(char *frame, int off, int len, struct net_seg *seg, int nseg, int nowait)
+{
+    int ndesc = 2 + nseg;
+    int idx[2 + NET_TX_SEGS];
+
+    if(!net.present){
+        free_page(frame);
+        for(int i = 0; i < nseg; i++)
+            page_decref((void *)PGROUNDDOWN(seg[i].addr));
+        return -1;
+    }
+
+    acquire(&net.txlock);
+    for(;;){
+        int got = 0;
+        while(got < ndesc && (idx[got] = tx_alloc()) >= 0)
+            got++;
+        if(got == ndesc)
+            break;
+        for(int i = 0; i < got; i++)
+            net.free[idx[i]] = 1;
+        // 描述符用尽：先回收已完成的发送，仍然没有进展时等待设备
+        uint16 before = net.tx.used_idx;
+        tx_reap();
+        if(net.tx.used_idx != before)
+            continue;
+        if(nowait || myproc() == 0){
+            release(&net.txlock);
+            free_page(frame);
+            for(int i = 0; i < nseg; i++)
+                page_decref((void *)PGROUNDDOWN(seg[i].addr));
+            return -1;
+        }
+        sleep(&net.free[0], &net.txlock);
+    }
+
+    net.tx.desc[idx[0]].addr = (uint64)&tx_hdr;
+    net.tx.desc[idx[0]].len = sizeof(tx_hdr);
+    net.tx.desc[idx[0]].flags = VRING_DESC_F_NEXT;
+    net.tx.desc[idx[0]].next = idx[1];
+    net.tx.desc[idx[1]].addr = (uint64)frame + off;
+    net.tx.desc[idx[1]].len = len;
+    net.tx.desc[idx[1]].flags = nseg ? VRING_DESC_F_NEXT : 0;
+    net.tx.desc[idx[1]].next = nseg ? idx[2] : 0;
+    for(int i = 0; i < nseg; i++){
+        int d = idx[2 + i];
+        net.tx.desc[d].addr = seg[i].addr;
+        net.tx.desc[d].len = seg[i].len;
+        net.tx.desc[d].flags = i + 1 < nseg ? VRING_DESC_F_NEXT : 0;
+        net.tx.desc[d].next = i + 1 < nseg ? idx[3 + i] : 0;
+        net.info[idx[0]].pin[i] = PGROUNDDOWN(seg[i].addr);
+    }
+    net.info[idx[0]].frame = frame;
+    net.info[idx[0]].npin = nseg;
+    net.info[idx[0]].done = 0;
+    net.info[idx[0]].waited = nseg > 0;
+
+    net.tx.avail->ring[net.tx.avail->idx % VIRTIO_RING_NUM] = idx[0];
+    smp_wmb();
+    net.tx.avail->idx += 1;
+    io_wmb();
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = TXQ;
+
+    if(net.info[idx[0]].waited){
+        while(!net.info[idx[0]].done)
+            sleep(&net.info[idx[0]], &net.txlock);
+        net.info[idx[0]].waited = 0;
+        tx_free(idx[0]);
+    }
+    release(&net.txlock);
+    return 0;
+}
+
+// 设备存在时返回 1，并把 MAC 地址写入 mac
+int virtio_net_init(uint8 *mac)
+{
+    uint32 status = 0;
+
+    initlock(&net.rxlock, "virtio_net_rx");
+    initlock(&net.txlock, "virtio_net_tx");
+
+    if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+       (*R(VIRTIO_MMIO_VERSION) != 1 && *R(VIRTIO_MMIO_VERSION) != 2) ||
+       *R(VIRTIO_MMIO_DEVICE_ID) != 1 ||
+       *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+        printf("virtio_net: 未发现网卡，仅提供本地回环\n");
+        return 0;
+    }
+
+    *R(VIRTIO_MMIO_STATUS) = status;
+    status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
+    *R(VIRTIO_MMIO_STATUS) = status;
+    status |= VIRTIO_CONFIG_S_DRIVER;
+    *R(VIRTIO_MMIO_STATUS) = status;
+
+    // 只要 MAC 地址：不协商校验和/分段卸载，也不合并接收缓冲区，首部固定为 10 字节
+    uint32 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+    features &= (1 << VIRTIO_NET_F_MAC);
+    *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+    status |= VIRTIO_CONFIG_S_FEATURES_OK;
+    *R(VIRTIO_MMIO_STATUS) = status;
+    if(!(*R(VIRTIO_MMIO_STATUS) & VIRTIO_CONFIG_S_FEATURES_OK))
+        panic("virtio_net: FEATURES_OK not set");
+
+    setup_queue(RXQ, &net.rx);
+    setup_queue(TXQ, &net.tx);
+
+    for(int i = 0; i < VIRTIO_RING_NUM; i++){
+        if((net.rxpage[i] = alloc_page_nozero()) == 0)
+            panic("virtio_net: alloc rx page");
+        rx_post(i);
+        net.free[i] = 1;
+    }
+
+    if(features & (1 << VIRTIO_NET_F_MAC)){
+        for(int i = 0; i < 6; i++)
+            mac[i] = *(volatile uint8 *)(VIRTIO1 + VIRTIO_MMIO_CONFIG + i);
+    } else {
+        uint8 def[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };   // QEMU 的默认地址
+        memmove(mac, def, 6);
+    }
+
+    status |= VIRTIO_CONFIG_S_DRIVER_OK;
+    *R(VIRTIO_MMIO_STATUS) = status;
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = RXQ;
+
+    net.present = 1;
+    plic_register(VIRTIO1_IRQ, "virtio-net", virtio_net_intr, 1);
+    printf("virtio_net: MAC %x:%x:%x:%x:%x:%x\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return 1;
+}
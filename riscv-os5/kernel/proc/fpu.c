@@ -0,0 +1,88 @@
+#include "types.h"
+#include "riscv.h"
+#include "proc.h"
+#include "fpu.h"
+#include "string.h"
+
+// 临时打开 FPU 访问浮点寄存器，结束后恢复原来的 sstatus.FS
+static void fpu_access(void (*fn)(struct fpstate *), struct fpstate *st)
+{
+  uint64 sstatus = r_sstatus();
+  w_sstatus((sstatus & ~SSTATUS_FS_MASK) | SSTATUS_FS_CLEAN);
+  fn(st);
+  w_sstatus(sstatus);
+}
+
+// 用户态陷入时调用：记录本次运行期间是否写过浮点寄存器，并在内核中关闭 FPU，
+// 内核代码误用浮点指令会立即陷入而不是悄悄破坏用户现场
+void fpu_trap_entry(struct proc *p, uint64 sstatus)
+{
+  if((sstatus & SSTATUS_FS_MASK) == SSTATUS_FS_DIRTY)
+    p->fp_dirty = 1;
+  if(sstatus & SSTATUS_FS_MASK)
+    w_sstatus(r_sstatus() & ~SSTATUS_FS_MASK);
+}
+
+// 用户态非法指令异常：进程尚未启用 FPU 时视为首次使用浮点指令，
+// 以全零的浮点现场启用 FPU 并重新执行该指令，返回 0；已启用过则返回 -1，按普通异常处理
+int fpu_first_use(struct proc *p)
+{
+  if(p->fp_used)
+    return -1;
+  memset(&p->fpstate, 0, sizeof(p->fpstate));
+  p->fp_used = 1;
+  p->fp_dirty = 0;
+  p->fp_cpu = -1;   // 硬件寄存器中可能是 exec 前旧映像的值，返回前必须装载
+  return 0;
+}
+
+// usertrapret 调用：返回用户态时 sstatus.FS 应取的值。
+// 未用过浮点的进程保持 Off；否则仅当本 hart 的浮点寄存器已不属于该进程时才装载
+uint64 fpu_user_return(struct proc *p)
+{
+  if(!p->fp_used)
+    return SSTATUS_FS_OFF;
+  struct cpu *c = mycpu();
+  if(c->fpu_owner != p || p->fp_cpu != cpuid()) {
+    fpu_access(fpu_load_regs, &p->fpstate);
+    c->fpu_owner = p;
+    p->fp_cpu = cpuid();
+  }
+  return SSTATUS_FS_CLEAN;
+}
+
+// sched 切换出 p 之前调用：寄存器被写过才保存。保存后寄存器内容仍然有效，
+// 若下次回到同一 hart 且期间无其他进程使用 FPU，则无需重新装载
+void fpu_switch_out(struct proc *p)
+{
+  if(!p->fp_dirty)
+    return;
+  fpu_access(fpu_save_regs, &p->fpstate);
+  p->fp_dirty = 0;
+}
+
+// fork/clone：子进程继承父进程当前的浮点现场。父进程是当前进程，
+// 写过的寄存器尚未保存，先写回 fpstate 再复制
+void fpu_fork(struct proc *parent, struct proc *child)
+{
+  child->fp_used = parent->fp_used;
+  child->fp_dirty = 0;
+  child->fp_cpu = -1;
+  if(!parent->fp_used)
+    return;
+  fpu_switch_out(parent);
+  child->fpstate = parent->fpstate;
+}
+
+// 进程槽位释放或重新映像（exec）时放弃浮点现场，并解除各 hart 上的归属记录，
+// 以免复用同一槽位的新进程误以为寄存器仍属于自己
+void fpu_release(struct proc *p)
+{
+  p->fp_used = 0;
+  p->fp_dirty = 0;
+  p->fp_cpu = -1;
+  for(int i = 0; i < NCPU; i++) {
+    if(cpus[i].fpu_owner == p)
+      cpus[i].fpu_owner = 0;
+  }
+}
@@ -0,0 +1,95 @@
+// idle.c: 调度器无进程可运行时的空闲处理。
+// 直接 wfi 时，被其他 hart 唤醒的进程要等本 hart 的下一次中断才会被挑走，
+// 唤醒延迟可达一个时钟周期以上；先在一个短窗口内开中断忙等，期间入队的进程立刻被发现，
+// 设备中断照常处理，其下半部唤醒的进程同样在窗口内被拾取。窗口内没有等到才 wfi 省电。
+// 窗口即目标唤醒延迟，可在运行时通过 idlepoll 系统调用调整，0 表示不轮询、直接 wfi。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "percpu.h"
+#include "string.h"
+#include "trap.h"
+#include "idlestat.h"
+
+#ifndef IDLE_POLL_US
+#define IDLE_POLL_US 20          // 缺省轮询窗口（微秒）
+#endif
+#define IDLE_POLL_MAX_US 10000   // 窗口上限，再长就与不睡眠没有区别
+
+#define US2TIME(us) ((uint64)(us) * (TIMEBASE_FREQ / 1000000))
+
+static int poll_us = IDLE_POLL_US;
+
+struct idle_cpu {
+  struct idle_stat st;   // 只由本 hart 的调度器更新
+} __attribute__((aligned(CACHELINE)));
+
+static struct idle_cpu idle_cpus[NCPU];
+
+// 轮询窗口内是否出现了可运行的进程：本地队列非空，或其他队列的就绪数比进入时多。
+// 其他队列中进入前就已排着的进程可能不允许在本 hart 运行（调度器刚挑选失败），不算命中；
+// 它们被取走后基线随之下降，之后新入队的进程仍能被发现
+static int idle_poll(uint64 window, int *stop)
+{
+  int base, remote;
+  sched_idle_hint(&base);
+
+  uint64 start = r_time();
+  do {
+    if(sched_idle_hint(&remote) > 0 || remote > base || __atomic_load_n(stop, __ATOMIC_ACQUIRE))
+      return 1;
+    if(remote < base)
+      base = remote;
+    cpu_relax();
+  } while(r_time() - start < window);
+  return 0;
+}
+
+// 调度器在没有可运行进程时调用，中断已开启。stop 置位（其他 hart 请求停机）时立即结束轮询
+void cpu_idle(int *stop)
+{
+  struct idle_stat *st = &idle_cpus[cpuid()].st;
+  uint64 window = US2TIME(__atomic_load_n(&poll_us, __ATOMIC_RELAXED));
+
+  st->idle_entries++;
+  uint64 start = r_time();
+  int hit = window > 0 && idle_poll(window, stop);
+  uint64 now = r_time();
+  st->poll_time += now - start;
+  if(hit) {
+    st->poll_hits++;
+    return;
+  }
+
+  st->wfi_entries++;
+  timer_reprogram();         // 无滴答空闲：时钟只在下一个定时器到期时才触发
+  asm volatile("wfi");
+  st->wfi_time += r_time() - now;
+}
+
+int idle_set_poll(int us)
+{
+  if(us > IDLE_POLL_MAX_US)
+    us = IDLE_POLL_MAX_US;
+  if(us >= 0)
+    __atomic_store_n(&poll_us, us, __ATOMIC_RELAXED);
+  return __atomic_load_n(&poll_us, __ATOMIC_RELAXED);
+}
+
+// 读出 hart cpu 的空闲统计，cpu 越界时返回 -1
+int idle_stat_read(int cpu, struct idle_stat *st)
+{
+  if(cpu < 0 || cpu >= NCPU)
+    return -1;
+  *st = idle_cpus[cpu].st;
+  return 0;
+}
+
+// 清零，与并发的更新之间没有同步，仅用于测量前
+void idle_stat_reset(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    memset(&idle_cpus[i].st, 0, sizeof(idle_cpus[i].st));
+}
@@ -0,0 +1,61 @@
+// irqsoff.c: 关中断时延跟踪的记录表与输出。
+// 每个 hart 只写自己的表，写入时中断是关着的，不需要加锁；
+// 输出与清零会读写其他 hart 的表，并发时可能看到半条记录，作为诊断数据可以接受。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "trap.h"
+#include "irqsoff.h"
+#include "string.h"
+#include "klog.h"
+
+#define TIME_PER_US (TIMEBASE_FREQ / 1000000)
+
+#if IRQSOFF_TRACE
+static struct irqsoff_rec worst[NCPU][IRQSOFF_TOP];   // 按时长从大到小
+static uint64 sections[NCPU];                         // 记录过的关中断区间数
+
+// pop_off 重新开中断时调用，中断仍是关着的
+void irqsoff_record(uint64 len, uint64 begin_ra, uint64 end_ra)
+{
+  int id = cpuid();
+  struct irqsoff_rec *w = worst[id];
+
+  sections[id]++;
+  if(len <= w[IRQSOFF_TOP - 1].len)
+    return;
+  int i = IRQSOFF_TOP - 1;
+  for(; i > 0 && w[i - 1].len < len; i--)
+    w[i] = w[i - 1];
+  w[i].len = len;
+  w[i].begin_ra = begin_ra;
+  w[i].end_ra = end_ra;
+}
+#endif
+
+// 把各 hart 最长的关中断区间写入 klog，地址可用 addr2line 对照 kernel.elf
+void irqsoff_dump(void)
+{
+#if IRQSOFF_TRACE
+  for(int id = 0; id < NCPU; id++) {
+    klog_info("irqsoff: hart %d 共 %d 段", id, (int)sections[id]);
+    for(int i = 0; i < IRQSOFF_TOP && worst[id][i].len; i++) {
+      struct irqsoff_rec *r = &worst[id][i];
+      klog_info("irqsoff: hart %d #%d %u us 关于 %p 开于 %p", id, i + 1,
+                (uint)(r->len / TIME_PER_US), r->begin_ra, r->end_ra);
+    }
+  }
+#else
+  klog_info("irqsoff: 内核未启用 IRQSOFF_TRACE");
+#endif
+}
+
+void irqsoff_reset(void)
+{
+#if IRQSOFF_TRACE
+  memset(worst, 0, sizeof(worst));
+  memset(sections, 0, sizeof(sections));
+#endif
+}
@@ -0,0 +1,125 @@
+// lockstat.c: 锁竞争统计的登记表与输出。
+// initlock/initsleeplock 按 (锁名, 类型) 找到或登记一个 lock_class，之后该锁的
+// 获取与释放都累加到这个类上。不同 hart 可能同时更新同一类（同名的不同锁），
+// 计数用原子加；hold_max 的比较与写入不是原子的，并发时偶尔少记一次最大值，可以接受。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "lockstat.h"
+#include "string.h"
+#include "printf.h"
+
+#define LOCKSTAT_CLASSES 64
+
+static struct lock_class classes[LOCKSTAT_CLASSES];
+
+#if LOCKSTAT
+// 保护登记过程。initlock 可能在任何锁可用之前调用，这里不能用 spinlock 本身
+static uint class_busy;
+static uint64 dropped;   // 登记表已满而未能统计的锁个数
+
+static int name_eq(const char *a, const char *b)
+{
+  int n = strlen(a);
+  return n == strlen(b) && memcmp(a, b, n) == 0;
+}
+
+// 查找或登记名为 name 的锁类，登记表已满时返回 0（该锁不参与统计）
+struct lock_class *lockstat_class(const char *name, int sleep)
+{
+  struct lock_class *c, *found = 0;
+
+  if(name == 0)
+    name = "?";
+  while(__sync_lock_test_and_set(&class_busy, 1) != 0)
+    cpu_relax();
+  for(c = classes; c < &classes[LOCKSTAT_CLASSES]; c++) {
+    if(c->name == 0) {
+      c->name = name;
+      c->sleep = sleep;
+      found = c;
+      break;
+    }
+    if(c->sleep == sleep && name_eq(c->name, name)) {
+      found = c;
+      break;
+    }
+  }
+  if(found == 0)
+    dropped++;
+  __sync_lock_release(&class_busy);
+  return found;
+}
+
+void lockstat_acquired(struct lock_class *c, int contended, uint64 spins)
+{
+  if(c == 0)
+    return;
+  __sync_fetch_and_add(&c->acquisitions, 1);
+  if(contended) {
+    __sync_fetch_and_add(&c->contended, 1);
+    __sync_fetch_and_add(&c->spins, spins);
+  }
+}
+
+void lockstat_released(struct lock_class *c, uint64 held)
+{
+  if(c == 0)
+    return;
+  __sync_fetch_and_add(&c->hold_total, held);
+  if(held > c->hold_max)
+    c->hold_max = held;
+}
+#endif
+
+// 按竞争次数从高到低打印各锁类，竞争相同时按累计持有时间排序；未被获取过的类不打印
+void lockstat_dump(void)
+{
+#if LOCKSTAT
+  int order[LOCKSTAT_CLASSES], n = 0;
+
+  for(int i = 0; i < LOCKSTAT_CLASSES; i++) {
+    if(classes[i].name && classes[i].acquisitions)
+      order[n++] = i;
+  }
+  for(int i = 1; i < n; i++) {
+    int k = order[i], j = i;
+    struct lock_class *c = &classes[k];
+    while(j > 0) {
+      struct lock_class *prev = &classes[order[j - 1]];
+      if(prev->contended > c->contended ||
+         (prev->contended == c->contended && prev->hold_total >= c->hold_total))
+        break;
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = k;
+  }
+
+  printf("lockstat: name type acquire contended spins sleeps hold-total hold-avg hold-max\n");
+  for(int i = 0; i < n; i++) {
+    struct lock_class *c = &classes[order[i]];
+    printf("%s %s %lu %lu %lu %lu %lu %lu %lu\n", c->name, c->sleep ? "sleep" : "spin",
+           c->acquisitions, c->contended, c->spins, c->sleeps,
+           c->hold_total, c->hold_total / c->acquisitions, c->hold_max);
+  }
+  if(dropped)
+    printf("lockstat: 登记表已满，%lu 个锁未统计\n", dropped);
+#else
+  printf("lockstat: 内核未启用 LOCKSTAT\n");
+#endif
+}
+
+// 清零全部计数，保留已登记的类
+void lockstat_reset(void)
+{
+  for(struct lock_class *c = classes; c < &classes[LOCKSTAT_CLASSES]; c++) {
+    c->acquisitions = 0;
+    c->contended = 0;
+    c->spins = 0;
+    c->sleeps = 0;
+    c->hold_total = 0;
+    c->hold_max = 0;
+  }
+}
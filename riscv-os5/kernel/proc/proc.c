@@ -6,39 +6,60 @@
 #include "vm.h"
 #include "trap.h"
 #include "proc.h"
+#include "exec.h"
 #include "file.h"
 #include "printf.h"
 #include "assert.h"
 #include "string.h"
 #include "spinlock.h"
 #include "semaphore.h"
+#include "slab.h"
+#include "wait.h"
 #include "klog.h"
-
-#define NPROC 64
-
-struct cpu cpu;                    // 单核CPU
-struct proc proc[NPROC];           // 进程表（数组实现）
+#include "vdso.h"
+#include "bench.h"
+#include "trace.h"
+#include "hrtimer.h"
+#include "htable.h"
+#include "radix.h"
+#include "bitops.h"
+
+struct cpu cpus[NCPU];             // 每个 hart 一个，按 cpuid() 索引
 struct proc *initproc;             // 初始进程
-int nextpid = 1;                   // 下一个可用的PID
-
-extern volatile uint64 ticks;      // 计时器滴答，由时钟中断更新
-struct spinlock wait_lock;         // 等待子进程时的锁
 
-// 多级反馈队列参数配置
-#define MLFQ_LEVELS 5                            // 队列数量：0~4共五级优先级
-static const int mlfq_time_slices[MLFQ_LEVELS] = {1, 2, 4, 8, 16}; // 各级队列对应的时间片长度（单位：时钟滴答）
-#define MLFQ_AGING_TICKS 50                      // 队列老化阈值，超过该滴答数未运行则向上提升
+// 进程控制块从 slab 按需分配。已分配的进程全部挂在 proc_list 上，并按 pid 散列到 pidhash，
+// kill/wait/sched_setattr 等按 pid 查找只需遍历一个桶。
+// proc_list_lock 保护 proc_list、pidhash、nproc 与 nextpid；持有期间不得分配内存
+// （内存不足时 mmap_reclaim 会获取该锁遍历进程）
+#define NPIDHASH 64
+static struct kmem_cache *proc_cache;
+struct proc *proc_list;
+struct spinlock proc_list_lock;
+static struct proc *pidhash[NPIDHASH];
+static int nproc;                  // 已分配的进程数
+static int nextpid = 1;            // 下一个尝试分配的PID
+static struct spinlock shell_lock; // 保护进程外壳缓存（见 alloc_slot 之前）
+
+// 地址空间回收：退出的进程把用户内存从页表上摘下（uvm_detach）放入队列，由 kreaper
+// 逐个释放，父进程的 wait 不必等待成千上万个页逐一归还。回收线程尚未启动、
+// 队列已满或内存不足摘不下来时，仍按原来的方式在 free_process 或退出者中同步释放
+#define REAP_QUEUE_MAX 64
+static struct {
+  struct spinlock lock;
+  pagetable_t queue[REAP_QUEUE_MAX];
+  int head;
+  int n;
+  int started;
+} reap;
 
-// 多级反馈队列的链表头尾指针，单核系统无需额外锁，仅依靠关中断保护即可
-static struct proc *mlfq_head[MLFQ_LEVELS];
-static struct proc *mlfq_tail[MLFQ_LEVELS];
+extern volatile uint64 ticks;      // 计时器滴答，由时钟中断更新
+struct spinlock wait_lock;         // 等待子进程时的锁，也保护线程组的 tg_nthreads
+static struct spinlock futex_lock; // 检查 futex 字的值与挂入睡眠之间不能插入 futex_wake
 
-// 多级反馈队列内部工具函数声明
-static void mlfq_init(void);
-static void mlfq_enqueue(struct proc *p, int level, int reset_ticks);
-static struct proc *mlfq_pick_next(void);
-static void mlfq_promote_aged(void);
-static void mlfq_enqueue_locked(struct proc *p, int level, int reset_ticks);
+// 睡眠进程按等待通道散列到若干桶中，wakeup 只需遍历对应桶，而不是整个进程表
+#define NSLEEPQ 32
+static struct proc *sleepq[NSLEEPQ];
+static struct spinlock sleepq_lock;
 
 // 蹦床页面引用
 extern char trampoline[];
@@ -48,243 +69,292 @@ extern uint64 initcode_size;
 // 初始化进程管理系统
 void procinit(void)
 {
-  // 初始化所有进程控制块
-  struct proc *p;
-  for(p = proc; p < &proc[NPROC]; p++) {
-      p->state = UNUSED;                           // 初始状态为未使用
-      p->kstack = 0;
-      p->pagetable = 0;
-      p->trapframe = 0;
-      p->sz = 0;
-      p->cwd = 0;
-      for(int i = 0; i < NOFILE; i++) {
-          p->ofile[i] = 0;
-      }
-      p->priority_level = 0;
-      p->ticks_in_level = 0;
-      p->last_ready_tick = 0;
-      p->exhausted_slice = 0;
-      p->preempt_pending = 0;
-      p->in_runqueue = 0;
-      p->mlfq_next = 0;
-  }
-
-  mlfq_init();
+  proc_cache = kmem_cache_create("proc", sizeof(struct proc), 0);
+  if(proc_cache == 0)
+    panic("procinit: kmem_cache_create");
+  initlock(&proc_list_lock, "proc_list");
+  initlock(&shell_lock, "proc_shell");
+  initlock(&reap.lock, "reap");
+
+  sched_init();
+  initlock(&sleepq_lock, "sleepq");
   initlock(&wait_lock, "wait");
+  initlock(&futex_lock, "futex");
   klog_info("进程子系统初始化完成");
 }
 
-// 初始化多级反馈队列的链表结构，所有指针重置为空即可
-static void mlfq_init(void)
+// 获取当前 hart 编号：start() 把 mhartid 存入 tp，内核态不会改写 tp，
+// 从用户态陷入时 uservec 再从 trapframe->kernel_hartid 恢复。
+// 调用者需关中断，否则返回后可能已被迁移到其他 hart
+int cpuid(void)
 {
-  push_off();
-  for(int level = 0; level < MLFQ_LEVELS; level++) {
-    mlfq_head[level] = 0;
-    mlfq_tail[level] = 0;
-  }
-  pop_off();
+  return r_tp();
 }
 
-// 在已关闭中断的前提下，将进程插入指定优先级队列的尾部
-static void mlfq_enqueue_locked(struct proc *p, int level, int reset_ticks)
-{
-  if(level < 0)
-    level = 0;
-  if(level >= MLFQ_LEVELS)
-    level = MLFQ_LEVELS - 1;
-
-  if(reset_ticks)
-    p->ticks_in_level = 0;
-
-  p->priority_level = level;
-  p->last_ready_tick = ticks;
-  p->mlfq_next = 0;
-  p->in_runqueue = 1;
-  p->exhausted_slice = 0;
-
-  if(mlfq_tail[level]) {
-    mlfq_tail[level]->mlfq_next = p;
-  } else {
-    mlfq_head[level] = p;
-  }
-  mlfq_tail[level] = p;
-}
-
-// 对外暴露的入队接口，自动关中断，避免与调度器抢占冲突
-static void mlfq_enqueue(struct proc *p, int level, int reset_ticks)
+// 获取当前 hart 的 cpu 结构
+struct cpu* mycpu(void)
 {
-  struct proc *current = 0;
-
-  push_off();
-  if(p->in_runqueue)
-    panic("mlfq_enqueue double");
-
-  current = mycpu()->proc;
-  if(current && current != p && current->state == RUNNING && level < current->priority_level) {
-    current->preempt_pending = 1;
-  }
-
-  mlfq_enqueue_locked(p, level, reset_ticks);
-  pop_off();
+  struct cpu *c = &cpus[cpuid()];
+  return c;
 }
 
-// 选择最高优先级的就绪进程并出队，调度器据此运行该进程
-static struct proc *mlfq_pick_next(void)
+// 获取当前进程
+struct proc* myproc(void)
 {
-  struct proc *p = 0;
-  push_off();
-  for(int level = 0; level < MLFQ_LEVELS; level++) {
-    if(mlfq_head[level] != 0) {
-      p = mlfq_head[level];
-      mlfq_head[level] = p->mlfq_next;
-      if(mlfq_tail[level] == p)
-        mlfq_tail[level] = 0;
-      p->mlfq_next = 0;
-      p->in_runqueue = 0;
-      p->ticks_in_level = 0;
-      p->exhausted_slice = 0;
-      p->preempt_pending = 0;
-      break;
-    }
-  }
-  pop_off();
+  struct proc *p = mycpu()->proc;
   return p;
 }
 
-// 周期性检查低优先级队列中的进程是否等待过久，必要时将其提升一层
-static void mlfq_promote_aged(void)
+static inline struct proc **pid_bucket(int pid)
 {
-  push_off();
-  uint64 now = ticks;
-  for(int level = 1; level < MLFQ_LEVELS; level++) {
-    struct proc *prev = 0;
-    struct proc *cur = mlfq_head[level];
-    while(cur) {
-      struct proc *next = cur->mlfq_next;
-      if(now - cur->last_ready_tick >= MLFQ_AGING_TICKS) {
-        if(prev) {
-          prev->mlfq_next = next;
-        } else {
-          mlfq_head[level] = next;
-        }
-        if(mlfq_tail[level] == cur)
-          mlfq_tail[level] = prev;
-
-        cur->mlfq_next = 0;
-        cur->in_runqueue = 0;
-        mlfq_enqueue_locked(cur, level - 1, 1);
-        cur = next;
-        continue;
-      }
-      prev = cur;
-      cur = next;
-    }
-  }
-  pop_off();
+  return &pidhash[(uint)pid % NPIDHASH];
 }
 
-//获取cpu
-struct cpu* mycpu(void)
+// 按 pid 查找已分配的进程（含僵尸），不存在时返回 0。
+// 调用者持有 proc_list_lock，释放前进程不会被回收
+struct proc* proc_find(int pid)
 {
-  struct cpu *c = &cpu;
-  return c;
+  for(struct proc *p = *pid_bucket(pid); p; p = p->hash_next) {
+    if(p->pid == pid)
+      return p;
+  }
+  return 0;
 }
 
-// 获取当前进程
-struct proc* myproc(void)
+// 已分配的进程数，只作遍历轮数等估计使用，读取时不加锁
+int proc_count(void)
 {
-  struct proc *p = mycpu()->proc;
-  return p;
+  return nproc;
 }
 
-// 分配新的PID
+// 分配新的PID：从 nextpid 起跳过仍在使用的值。调用者持有 proc_list_lock，
+// 且进程总数不超过 NPROC_MAX 远小于 PID_MAX，总能找到空闲值
 int allocpid()
 {
   int pid;
   for (;;) {
     pid = nextpid;
     nextpid++;
-    if (nextpid > NPROC) nextpid = 1;
+    if (nextpid >= PID_MAX) nextpid = 1;
 
-    struct proc *p = &proc[pid - 1];
-    // 如果此槽未被占用，则认为可用
-    if (p->state == UNUSED ) {
+    if (proc_find(pid) == 0) {
       return pid;
     }
     // 否则继续尝试下一个 pid
   }
 }
 
-// 分配进程结构体
+// ================= 进程外壳缓存 =================
+// 进程回收时不拆掉内核栈、陷阱帧、vDSO 进程页与页表：清空用户映射后（uvm_reset）
+// 连同已映射好 trampoline、陷阱帧与 vDSO 的页表骨架一起放进缓存，下一次 alloc_process
+// 整体取回，fork 省去这几次页分配以及建立顶端映射的页表遍历。
+// 控制块本身仍交还 slab。缓存满时照常释放
+#define PROC_SHELL_MAX 16
+
+struct proc_shell {
+  uint64 kstack;
+  struct trapframe *trapframe;
+  pagetable_t pagetable;        // 只剩顶端映射的页表骨架
+  struct vdso_proc *vdso;
+};
+
+static struct proc_shell shells[PROC_SHELL_MAX];
+static int nshell;
+
+// 从缓存取一个外壳装到 p 上，缓存为空时返回 0
+static int shell_take(struct proc *p)
+{
+  acquire(&shell_lock);
+  if(nshell == 0) {
+    release(&shell_lock);
+    return 0;
+  }
+  struct proc_shell *s = &shells[--nshell];
+  p->kstack = s->kstack;
+  p->trapframe = s->trapframe;
+  p->shell_pagetable = s->pagetable;
+  p->shell_vdso = s->vdso;
+  release(&shell_lock);
+  return 1;
+}
+
+// 把 p 尚未启用的外壳放回缓存，成功后 p 不再持有这些资源；缓存已满时返回 0
+static int shell_put(struct proc *p)
+{
+  if(p->shell_pagetable == 0 || p->trapframe == 0 || p->kstack == 0)
+    return 0;
+  acquire(&shell_lock);
+  if(nshell == PROC_SHELL_MAX) {
+    release(&shell_lock);
+    return 0;
+  }
+  struct proc_shell *s = &shells[nshell++];
+  s->kstack = p->kstack;
+  s->trapframe = p->trapframe;
+  s->pagetable = p->shell_pagetable;
+  s->vdso = p->shell_vdso;
+  release(&shell_lock);
+  p->kstack = 0;
+  p->trapframe = 0;
+  p->shell_pagetable = 0;
+  p->shell_vdso = 0;
+  return 1;
+}
+
+// 放不回缓存的外壳：页表骨架与其中映射的 vDSO 页一起释放
+static void shell_drop(struct proc *p)
+{
+  if(p->shell_pagetable) {
+    proc_freepagetable(p->shell_pagetable);
+    p->shell_pagetable = 0;
+  }
+  if(p->shell_vdso) {
+    free_page((void*)p->shell_vdso);
+    p->shell_vdso = 0;
+  }
+}
+
+// 分配进程控制块、PID 与内核栈，并设置从 forkret 开始执行的上下文。
+// 不分配陷阱帧：内核线程直接使用，用户进程由 alloc_process 另外补上。
 // 成功返回进程指针，失败返回0
-struct proc* alloc_process(void)
+static struct proc* alloc_slot(void)
 {
   struct proc *p;
 
-  // 遍历进程表寻找空闲槽位
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p->state == UNUSED) {
-      goto found;  // 找到空闲进程
-    }
+  // 控制块与内核栈在 proc_list_lock 之外分配（分配可能触发经该锁遍历进程的回收）
+  if((p = kmem_cache_alloc(proc_cache)) == 0) {
+    klog_error("alloc_process: 分配进程控制块失败");
+    return 0;
   }
-  klog_error("alloc_process: 没有可用的进程槽位");
-  return 0;  // 没有空闲进程
+  memset(p, 0, sizeof(*p));
 
-found:
-  // 初始化进程基本信息
-  p->pid = allocpid();
-  p->state = USED;
-  p->cwd = 0;
-  for(int i = 0; i < NOFILE; i++) {
-      p->ofile[i] = 0;
-  }
-  
-  // 分配一页内存用于陷阱帧
-  if((p->trapframe = (struct trapframe *)alloc_page()) == 0){
-    int failed_pid = p->pid;
-    free_process(p);
-    klog_error("alloc_process: pid=%d 分配陷阱帧失败", failed_pid);
+  // 优先取回缓存的外壳，否则为进程分配内核栈（栈内容总是先写后读，无需清零）
+  if(!shell_take(p) && (p->kstack = (uint64)alloc_page_nozero()) == 0) {
+    kmem_cache_free(proc_cache, p);
+    klog_error("alloc_process: 分配内核栈失败");
     return 0;
   }
-  
-  // 为进程分配内核栈
-  if((p->kstack = (uint64)alloc_page()) == 0) {
-    int failed_pid = p->pid;
-    free_page(p->trapframe);
-    p->trapframe = 0;
-    p->state = UNUSED;
-    klog_error("alloc_process: pid=%d 分配内核栈失败", failed_pid);
+
+  acquire(&proc_list_lock);
+  if(nproc >= NPROC_MAX) {
+    release(&proc_list_lock);
+    if(!shell_put(p)) {
+      shell_drop(p);
+      if(p->trapframe)
+        free_page((void*)p->trapframe);
+      free_page((void*)p->kstack);
+    }
+    kmem_cache_free(proc_cache, p);
+    klog_error("alloc_process: 进程数已达上限 %d", NPROC_MAX);
     return 0;
   }
+  p->pid = allocpid();
+  p->state = USED;
+  struct proc **bucket = pid_bucket(p->pid);
+  p->hash_next = *bucket;
+  *bucket = p;
+  p->all_next = proc_list;
+  if(proc_list)
+    proc_list->all_pprev = &p->all_next;
+  p->all_pprev = &proc_list;
+  proc_list = p;
+  nproc++;
+  release(&proc_list_lock);
+
+  fdtable_init(&p->fdtab);
+  p->fdt = &p->fdtab;
+  initsleeplock(&p->tg_mm_lock, "mm");
+  // ASID 可能刚被已退出的进程用过，TLB 中可能残留其条目，首次返回用户态前整体刷新
+  p->asid = asid_alloc();
+  tlb_reset(p);
+  p->fp_cpu = -1;
 
   // 设置执行上下文
-  memset(&p->context, 0, sizeof(p->context));
   p->context.ra = (uint64)forkret;      // 返回地址
   p->context.sp = p->kstack + PGSIZE;   // 栈指针（栈顶）
 
-  p->priority_level = 0;
-  p->ticks_in_level = 0;
-  p->last_ready_tick = 0;
-  p->exhausted_slice = 0;
-  p->preempt_pending = 0;
-  p->in_runqueue = 0;
-  p->mlfq_next = 0;
+  sched_proc_init(p);
+  return p;
+}
+
+// 陷阱帧中供 uservec 使用的内核页表、内核栈与 usertrap 入口在进程生命周期内不变，
+// 创建时（以及 fork/clone 整体复制陷阱帧之后）写一次，usertrapret 不再逐次重写
+static void trapframe_init_kernel(struct proc *p)
+{
+  p->trapframe->kernel_satp = MAKE_SATP(kernel_pagetable);
+  p->trapframe->kernel_sp = p->kstack + PGSIZE;
+  p->trapframe->kernel_trap = (uint64)usertrap;
+}
+
+// 分配进程结构体（含陷阱帧）
+// 成功返回进程指针，失败返回0
+struct proc* alloc_process(void)
+{
+  struct proc *p = alloc_slot();
+  if(p == 0)
+    return 0;
+
+  // 分配一页内存用于陷阱帧；取自外壳的陷阱帧残留上一个进程的寄存器，须清零
+  if(p->trapframe) {
+    memset(p->trapframe, 0, sizeof(*p->trapframe));
+  } else if((p->trapframe = (struct trapframe *)alloc_page()) == 0){
+    int failed_pid = p->pid;
+    free_process(p);
+    klog_error("alloc_process: pid=%d 分配陷阱帧失败", failed_pid);
+    return 0;
+  }
+  p->trapframe_va = TRAPFRAME;
+  trapframe_init_kernel(p);
 
-  klog_debug("alloc_process: pid=%d 分配完成", p->pid);
+  TRACE(PROC_ALLOC, p->pid);
   return p;
 }
 
-// 释放进程资源
+// 释放进程的全部资源，p 此后不再可用
 void free_process(struct proc *p)
 {
   int oldpid = p->pid;
 
+  // 退出的进程在另一个 hart 上切回调度器之前仍在使用自己的内核栈
+  while(__atomic_load_n(&p->on_cpu, __ATOMIC_ACQUIRE))
+    ;
+
+  if(p->tg_leader) {
+    // 线程：页表、映射区与打开文件都属于线程组，只解除自己的陷阱帧槽位。
+    // vma[] 与 lazy[] 只是组长映射区与按需加载区间的副本，不持有文件引用
+    if(p->pagetable) {
+      uvmunmap(p->pagetable, p->trapframe_va, 1, 0);
+      p->pagetable = 0;
+    }
+    memset(p->vma, 0, sizeof(p->vma));
+    p->nlazy = 0;
+    p->fdt = &p->fdtab;
+    p->tg_leader = 0;
+  }
+
+  // 解除 mmap 映射区并放弃映射文件的引用
+  mmap_release(p);
+  exec_lazy_release(p);
+  fpu_release(p);
+
+  // 进程（非线程）的页表映射着自己的陷阱帧与 vDSO 页：释放用户内存后留作外壳的页表骨架
+  if(p->pagetable && p->vdso && p->shell_pagetable == 0){
+    uvm_reset(p->pagetable);
+    p->shell_pagetable = p->pagetable;
+    p->shell_vdso = p->vdso;
+    p->pagetable = 0;
+    p->vdso = 0;
+  }
+  if(!shell_put(p))
+    shell_drop(p);
+
   //释放用户页表和用户内存
   if(p->pagetable){
     uvmfree(p->pagetable, p->sz);
     proc_freepagetable(p->pagetable);
     p->pagetable = 0;
   }
+  vdso_release(p);
   //释放陷阱帧
   if(p->trapframe){
     free_page((void*)p->trapframe);
@@ -297,33 +367,30 @@ void free_process(struct proc *p)
   }
   
   // 重置进程状态
-  for(int i = 0; i < NOFILE; i++) {
-    if(p->ofile[i]) {
-      fileclose(p->ofile[i]);
-      p->ofile[i] = 0;
-    }
-  }
+  fdtable_release(&p->fdtab);
   if(p->cwd) {
     iput(p->cwd);
     p->cwd = 0;
   }
 
-  p->pid = 0;
-  p->parent = 0;
-  p->name[0] = 0;
-  p->chan = 0;
-  p->killed = 0;
-  p->xstate = 0;
-  p->sz = 0;
-  p->priority_level = 0;
-  p->ticks_in_level = 0;
-  p->last_ready_tick = 0;
-  p->exhausted_slice = 0;
-  p->preempt_pending = 0;
-  p->in_runqueue = 0;
-  p->mlfq_next = 0;
+  asid_free(p->asid);
+
+  // 摘出全局进程链表与 pid 散列桶，控制块交还 slab。
+  // 调用者（wait 或 thread_reap）已把它从父进程的子进程链表或线程组中摘除
+  acquire(&proc_list_lock);
+  struct proc **pp = pid_bucket(p->pid);
+  while(*pp != p)
+    pp = &(*pp)->hash_next;
+  *pp = p->hash_next;
+  *p->all_pprev = p->all_next;
+  if(p->all_next)
+    p->all_next->all_pprev = p->all_pprev;
+  nproc--;
+  release(&proc_list_lock);
+
   p->state = UNUSED;
-  klog_debug("free_process: pid=%d 资源已释放", oldpid);
+  kmem_cache_free(proc_cache, p);
+  TRACE(PROC_FREE, oldpid);
 }
 
 // 为指定进程创建一个用户页表，初始时没有用户内存，
@@ -332,6 +399,17 @@ pagetable_t proc_pagetable(struct proc *p)
 {
   pagetable_t pagetable;
 
+  // 外壳自带的页表骨架已映射 p 的陷阱帧与 vDSO 页，只需更新其中的 pid
+  if(p->shell_pagetable){
+    pagetable = p->shell_pagetable;
+    p->vdso = p->shell_vdso;
+    p->shell_pagetable = 0;
+    p->shell_vdso = 0;
+    memset(p->vdso, 0, sizeof(*p->vdso));
+    p->vdso->pid = p->pid;
+    return pagetable;
+  }
+
   // 创建一个空的页表。
   pagetable = create_pagetable();
   if(pagetable == 0)
@@ -353,6 +431,14 @@ pagetable_t proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // 映射用户态只读的 vDSO 页（ticks、pid 等无需陷入即可读取）
+  if(vdso_map(pagetable, p) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    destroy_pagetable(pagetable);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -363,39 +449,131 @@ void proc_freepagetable(pagetable_t pagetable)
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   // 解除 trapframe 页面映射。
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  // 解除 vDSO 映射，物理页不随页表释放
+  vdso_unmap(pagetable);
   // 释放整个页表及其映射的用户空间物理内存。
   destroy_pagetable(pagetable);
 }
 
-// 创建新进程
-// entry: 进程入口函数
-int create_process(void (*entry)(void))
+// 把 child 挂到 parent 的子进程链表上并设置其父进程，调用者持有 wait_lock
+static void child_link(struct proc *parent, struct proc *child)
 {
-  struct proc *p;
-  
-  // 分配进程结构体
-  if((p = alloc_process()) == 0) {
-    return -1;
+  child->parent = parent;
+  child->sibling_next = parent->children;
+  if(parent->children)
+    parent->children->sibling_pprev = &child->sibling_next;
+  child->sibling_pprev = &parent->children;
+  parent->children = child;
+}
+
+// 把 child 从其父进程的子进程链表上摘除，调用者持有 wait_lock
+static void child_unlink(struct proc *child)
+{
+  *child->sibling_pprev = child->sibling_next;
+  if(child->sibling_next)
+    child->sibling_next->sibling_pprev = child->sibling_pprev;
+  child->sibling_next = 0;
+  child->sibling_pprev = 0;
+  child->parent = 0;
+}
+
+// 子进程退出时挂到父进程的僵尸队列尾部，调用者持有 wait_lock
+static void zombie_enqueue(struct proc *parent, struct proc *child)
+{
+  child->zombie_next = 0;
+  if(parent->zombie_tail)
+    parent->zombie_tail->zombie_next = child;
+  else
+    parent->zombies = child;
+  parent->zombie_tail = child;
+}
+
+// 从父进程的僵尸队列中取出 child，调用者持有 wait_lock
+static void zombie_remove(struct proc *parent, struct proc *child)
+{
+  struct proc *prev = 0;
+  struct proc **pp = &parent->zombies;
+  while(*pp != child) {
+    prev = *pp;
+    pp = &(*pp)->zombie_next;
   }
-  
-  // 设置进程上下文，使其从指定入口开始执行
-  p->context.ra = (uint64)entry;
-  
-  // 初始化进程名
-  safestrcpy(p->name, "userprocess", sizeof(p->name));
-  
-  // 设置父进程为当前进程
-  p->parent = myproc() ? myproc() : initproc;
+  *pp = child->zombie_next;
+  if(parent->zombie_tail == child)
+    parent->zombie_tail = prev;
+  child->zombie_next = 0;
+}
 
-  // 设置进程为可运行状态
-  p->state = RUNNABLE;
-  mlfq_enqueue(p, 0, 1);   // 新进程从最高优先级开始调度
+// 为新建进程设置父进程
+static void set_parent(struct proc *child, struct proc *parent)
+{
+  acquire(&wait_lock);
+  child_link(parent, child);
+  release(&wait_lock);
+}
+
+// 内核线程的第一条执行路径：调度器切换进来时中断是关闭的，先打开再进入线程函数，
+// 线程函数返回即退出。开机早期创建、没有父进程的线程交给 init 回收
+static void kthread_start(void)
+{
+  struct proc *p = myproc();
+
+  intr_on();
+  p->kthread_fn(p->kthread_arg);
+
+  if(p->parent == 0)
+    set_parent(p, initproc);
+  exit_process(0);
+}
+
+// kthread_create: 创建只在内核态运行的线程，返回其 PID，失败返回 -1。
+// 线程只占用一个进程槽位和一页内核栈，没有用户页表与陷阱帧，与其他进程一样参与调度；
+// 线程函数应在合适的位置检查 kthread_should_stop()，以便响应 kill。
+int kthread_create(void (*fn)(void *), void *arg, const char *name)
+{
+  struct proc *p = alloc_slot();
+  if(p == 0)
+    return -1;
+
+  p->context.ra = (uint64)kthread_start;
+  p->kthread_fn = fn;
+  p->kthread_arg = arg;
+  safestrcpy(p->name, name, sizeof(p->name));
+  struct proc *parent = myproc() ? myproc() : initproc;
+  if(parent)
+    set_parent(p, parent);
 
-  printf("Created process %d with entry %p\n", p->pid, entry);
+  p->state = RUNNABLE;
+  sched_enqueue(p);   // 新线程从最高优先级开始调度
 
+  TRACE(KTHREAD, p->pid);
   return p->pid;
 }
 
+// 内核线程是否已被要求退出
+int kthread_should_stop(void)
+{
+  return killed(myproc());
+}
+
+// create_process 的入口适配：内核测试任务没有参数
+static void run_task(void *entry)
+{
+  ((void (*)(void))entry)();
+}
+
+// 创建新进程（内核测试使用）
+// entry: 进程入口函数，以内核线程方式运行
+int create_process(void (*entry)(void))
+{
+  int pid = kthread_create(run_task, (void *)entry, "userprocess");
+  if(pid < 0)
+    return -1;
+
+  printf("Created process %d with entry %p\n", pid, entry);
+
+  return pid;
+}
+
 // 复制当前进程，创建一个拥有独立用户地址空间的子进程
 int fork_process(void)
 {
@@ -430,45 +608,342 @@ int fork_process(void)
   }
 
   np->sz = p->sz;
+  np->heap_base = p->heap_base;
+  np->nlazy = p->nlazy;
+  for(int i = 0; i < p->nlazy; i++)
+    np->lazy[i] = p->lazy[i];
+  exec_lazy_dup(np);
+
+  // 复制 mmap 映射区：共享区父子映射同一物理页，私有区按写时复制处理
+  if(mmap_fork(p, np) < 0){
+    klog_error("fork: parent=%d child=%d 复制映射区失败", p->pid, np->pid);
+    free_process(np);
+    return -1;
+  }
   // 复制陷阱帧，使得子进程从和父进程相同的位置恢复
   *(np->trapframe) = *(p->trapframe);
+  trapframe_init_kernel(np);
   // 子进程在用户态看到的 fork 返回值为 0
   np->trapframe->a0 = 0;  // 子进程返回0
+  fpu_fork(p, np);
 
-  for(int i = 0; i < NOFILE; i++) {
-    if(p->ofile[i]) {
-      np->ofile[i] = filedup(p->ofile[i]);
-    } else {
-      np->ofile[i] = 0;
-    }
+  if(fdtable_copy(np->fdt, p->fdt) < 0){
+    klog_error("fork: parent=%d child=%d 复制打开文件表失败", p->pid, np->pid);
+    free_process(np);
+    return -1;
   }
-  if(p->cwd) {
-    np->cwd = idup(p->cwd);
-  } else {
-    np->cwd = 0;
+  np->cwd = proc_cwd(p);   // 线程使用组长的当前目录
+
+  safestrcpy(np->name, p->name, sizeof(np->name));
+  np->trace_mask = p->trace_mask;
+  set_parent(np, p);
+  sched_fork(p, np);
+  np->state = RUNNABLE;
+  sched_enqueue(np);   // fork后的子进程同样回到最高优先级
+
+  TRACE(FORK, p->pid, np->pid);
+  return np->pid;
+}
+
+// spawn_process: 直接从 ELF 文件为新进程建立地址空间并使其就绪，返回子进程 PID。
+// 与 fork+exec 相比，不复制父进程页表，也不做随后就被 exec 丢弃的 COW 标记。
+// 子进程继承父进程的打开文件与当前目录，argv 为内核态参数数组（以 0 结尾）。
+int spawn_process(char *path, char **argv)
+{
+  struct proc *p = myproc();
+  struct proc *np;
+
+  if((np = alloc_process()) == 0) {
+    klog_error("spawn: pid=%d 分配子进程失败", p->pid);
+    return -1;
+  }
+
+  if(fdtable_copy(np->fdt, p->fdt) < 0) {
+    free_process(np);
+    return -1;
+  }
+  np->cwd = proc_cwd(p);
+
+  int argc = exec_into(np, path, argv);
+  if(argc < 0) {
+    free_process(np);
+    return -1;
+  }
+  np->trapframe->a0 = argc;   // 与 exec 一致，argc 作为 main 的第一个参数
+  np->trace_mask = p->trace_mask;
+
+  set_parent(np, p);
+  sched_fork(p, np);
+  np->state = RUNNABLE;
+  sched_enqueue(np);
+
+  TRACE(SPAWN, p->pid, np->pid);
+  return np->pid;
+}
+
+// clone_thread: 在当前进程的地址空间中创建一个用户线程，返回其 PID，失败返回 -1。
+// 线程与调用者共享页表、打开文件与当前目录（归线程组组长所有），
+// 拥有自己的内核栈与陷阱帧，陷阱帧映射在共享页表中 TRAPFRAME 之下按槽位划分的一页。
+// 线程从 fn 开始执行，sp 为 stack，a0 为 arg；它没有父进程，退出后由调度器直接回收。
+int clone_thread(uint64 fn, uint64 stack, int flags, uint64 arg)
+{
+  struct proc *p = myproc();
+  struct proc *leader = proc_group(p);
+  struct proc *np;
+
+  if(flags != CLONE_THREAD_FLAGS || p->pagetable == 0)
+    return -1;
+  if(killed(leader))
+    return -1;   // 组长正在退出，不再接受新线程
+
+  if((np = alloc_process()) == 0) {
+    klog_error("clone: pid=%d 分配线程失败", p->pid);
+    return -1;
   }
 
+  // 在线程组内分配陷阱帧槽位
+  acquire(&wait_lock);
+  int slot = leader->tg_slots == ~0ULL ? -1 : ctz64(~leader->tg_slots);
+  if(slot >= 0)
+    leader->tg_slots |= 1ULL << slot;
+  release(&wait_lock);
+  if(slot < 0) {
+    klog_error("clone: pid=%d 线程数已达上限 %d", p->pid, NTRAPFRAME_SLOT);
+    free_process(np);
+    return -1;
+  }
+  np->tg_slot = slot;
+  np->trapframe_va = TRAPFRAME_SLOT(slot);
+  if(map_region(p->pagetable, np->trapframe_va, (uint64)np->trapframe, PGSIZE, PTE_R | PTE_W) < 0) {
+    klog_error("clone: pid=%d 映射线程陷阱帧失败", p->pid);
+    acquire(&wait_lock);
+    leader->tg_slots &= ~(1ULL << slot);
+    release(&wait_lock);
+    free_process(np);
+    return -1;
+  }
+  np->pagetable = p->pagetable;
+  np->tg_leader = leader;
+  leader->vdso->threaded = 1;   // 组内各线程 pid 不同，用户态 getpid 改走系统调用
+  np->fdt = &leader->fdtab;
+
+  // 持有地址空间锁直到新线程挂入线程链表，此后的修改都会经 tgroup_sync 同步给它
+  tgroup_mm_lock(p);
+  np->sz = p->sz;
+  np->heap_base = p->heap_base;
+  np->nlazy = p->nlazy;
+  for(int i = 0; i < p->nlazy; i++)
+    np->lazy[i] = p->lazy[i];
+  for(int i = 0; i < NVMA; i++)
+    np->vma[i] = p->vma[i];
+
+  *(np->trapframe) = *(p->trapframe);
+  trapframe_init_kernel(np);
+  np->trapframe->epc = fn;
+  np->trapframe->sp = stack;
+  np->trapframe->a0 = arg;
+  np->trapframe->ra = 0;   // fn 不应返回，线程结束时须调用 exit
+  fpu_fork(p, np);
+
   safestrcpy(np->name, p->name, sizeof(np->name));
-  np->parent = p;
+  np->trace_mask = p->trace_mask;
+  np->parent = 0;
+  acquire(&wait_lock);
+  leader->tg_nthreads++;
+  np->tg_next = leader->tg_threads;
+  leader->tg_threads = np;
+  release(&wait_lock);
+  tgroup_mm_unlock(p);
+
+  sched_fork(p, np);
   np->state = RUNNABLE;
-  mlfq_enqueue(np, 0, 1);   // fork后的子进程同样回到最高优先级
+  sched_enqueue(np);
 
-  klog_info("fork: parent=%d child=%d 就绪", p->pid, np->pid);
+  TRACE(CLONE, p->pid, np->pid);
   return np->pid;
 }
 
-// 将被遗弃的子进程重新父级到init进程
+// 对 p 所在线程组中除 p 以外的每个成员调用 fn(q, p)，期间持有 wait_lock，成员不会被回收。
+// 不属于任何线程组的进程直接返回
+void tgroup_each_other(struct proc *p, void (*fn)(struct proc *q, struct proc *p))
+{
+  struct proc *leader = proc_group(p);
+  if(leader->tg_threads == 0)
+    return;
+
+  acquire(&wait_lock);
+  if(leader != p)
+    fn(leader, p);
+  for(struct proc *q = leader->tg_threads; q; q = q->tg_next) {
+    if(q != p)
+      fn(q, p);
+  }
+  release(&wait_lock);
+}
+
+static void tgroup_copy(struct proc *q, struct proc *p)
+{
+  q->sz = p->sz;
+  q->heap_base = p->heap_base;
+  for(int i = 0; i < NVMA; i++)
+    q->vma[i] = p->vma[i];
+}
+
+// tgroup_sync: p 修改了 sz、堆或映射区后，把这些描述复制给同一线程组的其他成员，
+// 使它们的缺页处理与 copyin/copyout 范围检查看到同一份地址空间
+// 当前目录归组长所有，组内任一线程都可能 chdir：读取与替换都在组长的 p->lock 下进行，
+// 读者取得的目录带一次引用，替换者在锁外放弃旧目录，旧目录不会在读者 idup 之前被释放
+struct inode *proc_cwd(struct proc *p)
+{
+  struct proc *g = proc_group(p);
+  acquire(&g->lock);
+  struct inode *ip = g->cwd ? idup(g->cwd) : 0;
+  release(&g->lock);
+  return ip;
+}
+
+// 把组的当前目录换成 ip（引用转交给进程），返回旧目录，由调用者 iput
+struct inode *proc_set_cwd(struct proc *p, struct inode *ip)
+{
+  struct proc *g = proc_group(p);
+  acquire(&g->lock);
+  struct inode *old = g->cwd;
+  g->cwd = ip;
+  release(&g->lock);
+  return old;
+}
+
+void tgroup_sync(struct proc *p)
+{
+  tgroup_each_other(p, tgroup_copy);
+}
+
+// 组内线程可能同时 sbrk/mmap/munmap：各自读到同一个旧 sz 会得到重叠的堆，其中一次修改
+// 也会被另一次的 tgroup_sync 覆盖。修改者在读取之前取得组长的 tg_mm_lock，并从组长的副本
+// 刷新自己的副本，到 tgroup_sync 同步之后才释放，读改写整体串行。
+// 锁是睡眠锁：持有期间的 uvmalloc 与映射建立可能等待回收或读盘
+void tgroup_mm_lock(struct proc *p)
+{
+  struct proc *g = proc_group(p);
+  acquiresleep(&g->tg_mm_lock);
+  if(g != p)
+    tgroup_copy(p, g);   // 组长的副本只在持锁时修改
+}
+
+void tgroup_mm_unlock(struct proc *p)
+{
+  releasesleep(&proc_group(p)->tg_mm_lock);
+}
+
+static void proc_kill(struct proc *p);
+
+// 组长退出前结束同组的全部线程，并等到它们都被回收，之后才能释放共享的资源
+static void tgroup_stop(struct proc *p)
+{
+  setkilled(p);   // 阻止组内线程继续 clone
+
+  acquire(&wait_lock);
+  for(struct proc *q = p->tg_threads; q; q = q->tg_next) {
+    if(q->state != ZOMBIE)
+      proc_kill(q);
+  }
+  while(p->tg_nthreads > 0)
+    sleep(&p->tg_nthreads, &wait_lock);
+  release(&wait_lock);
+}
+
+// 回收已退出的线程：调度器在离开其内核栈后调用。
+// 先摘出线程链表，使 tgroup_each_other 不再看到它；槽位在解除映射之后才归还
+static void thread_reap(struct proc *t)
+{
+  struct proc *leader = t->tg_leader;
+  int slot = t->tg_slot;
+
+  acquire(&wait_lock);
+  struct proc **pp = &leader->tg_threads;
+  while(*pp != t)
+    pp = &(*pp)->tg_next;
+  *pp = t->tg_next;
+  release(&wait_lock);
+
+  free_process(t);
+  acquire(&wait_lock);
+  leader->tg_slots &= ~(1ULL << slot);
+  leader->tg_nthreads--;
+  wakeup(&leader->tg_nthreads);
+  release(&wait_lock);
+}
+
+// 将被遗弃的子进程重新父级到init进程：只需遍历 p 自己的子进程链表，
+// 尚未回收的僵尸子进程整体接到 init 的僵尸队列尾部。调用者持有 wait_lock
 void reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++) {
-    if(pp->parent == p) {
-      pp->parent = initproc;
-      // 唤醒init进程来处理这些子进程
-      wakeup(initproc);
+  if(p->children == 0)
+    return;
+  while((pp = p->children) != 0) {
+    child_unlink(pp);
+    child_link(initproc, pp);
+  }
+  if(p->zombies) {
+    if(initproc->zombie_tail)
+      initproc->zombie_tail->zombie_next = p->zombies;
+    else
+      initproc->zombies = p->zombies;
+    initproc->zombie_tail = p->zombie_tail;
+    p->zombies = p->zombie_tail = 0;
+    // 唤醒init进程来处理这些子进程
+    wakeup(initproc);
+  }
+}
+
+// kreaper：取出摘下的地址空间并释放，用户页经 unmap_batch 批量归还页分配器
+static void kreaper(void *arg)
+{
+  (void)arg;
+  for(;;) {
+    acquire(&reap.lock);
+    while(reap.n == 0 && !kthread_should_stop())
+      sleep(&reap, &reap.lock);
+    if(reap.n == 0) {
+      release(&reap.lock);
+      return;
     }
+    pagetable_t pt = reap.queue[reap.head];
+    reap.head = (reap.head + 1) % REAP_QUEUE_MAX;
+    reap.n--;
+    release(&reap.lock);
+    destroy_pagetable(pt);
+  }
+}
+
+// 进程子系统与 init 就绪后调用
+void reaper_init(void)
+{
+  if(kthread_create(kreaper, 0, "kreaper") < 0)
+    panic("reaper_init");
+  reap.started = 1;
+}
+
+// 退出时把 p 的用户内存交给 kreaper。p 此后不再访问用户地址空间
+static void reap_mm(struct proc *p)
+{
+  if(p->pagetable == 0 || !reap.started)
+    return;
+  pagetable_t det = uvm_detach(p->pagetable);
+  if(det == 0)
+    return;
+  acquire(&reap.lock);
+  if(reap.n < REAP_QUEUE_MAX) {
+    reap.queue[(reap.head + reap.n) % REAP_QUEUE_MAX] = det;
+    reap.n++;
+    wakeup(&reap);
+    det = 0;
   }
+  release(&reap.lock);
+  if(det)
+    destroy_pagetable(det);   // 回收线程积压过多：退出者自己释放，不再增加积压
 }
 
 // 退出当前进程
@@ -476,32 +951,39 @@ void exit_process(int status)
 {
   struct proc *p = myproc();
 
-  klog_info("exit: pid=%d 状态=%d", p->pid, status);
+  TRACE(EXIT, p->pid, status);
   if(p == initproc)
     panic("init exiting");
 
-  for(int fd = 0; fd < NOFILE; fd++) {
-    if(p->ofile[fd]) {
-      fileclose(p->ofile[fd]);
-      p->ofile[fd] = 0;
-    }
+  if(p->tg_nthreads > 0)
+    tgroup_stop(p);
+
+  // 线程借用组长的打开文件表，不在这里关闭
+  if(p->tg_leader == 0) {
+    fdtable_release(p->fdt);
   }
   if(p->cwd) {
     iput(p->cwd);
     p->cwd = 0;
   }
 
-  // 将任何子进程交给init进程
-  reparent(p);
+  // 线程组的地址空间由组长带走；此时同组线程都已结束
+  if(p->tg_leader == 0)
+    reap_mm(p);
 
-  // 父进程可能在wait()中睡眠
+  // 将任何子进程交给init进程，再把自己挂到父进程的僵尸队列并只唤醒父进程。
+  // 转为僵尸与入队在同一临界区内完成，父进程在 wait 中不会错过这次唤醒。
+  // 线程没有父进程，由调度器回收
   acquire(&wait_lock);
-  wakeup(p->parent);
-  release(&wait_lock);
-
+  reparent(p);
   p->xstate = status;
   p->state = ZOMBIE;
-  klog_info("exit: pid=%d 已转为僵尸态", p->pid);
+  if(p->parent) {
+    zombie_enqueue(p->parent, p);
+    wakeup(p->parent);
+  }
+  release(&wait_lock);
+  TRACE(ZOMBIE, p->pid);
 
   // 跳入调度器，永不返回
   intr_off();
@@ -509,40 +991,155 @@ void exit_process(int status)
   panic("zombie exit");
 }
 
-// 等待子进程退出
+// 等待任意子进程退出
 int wait_process(int *status)
+{
+  return waitpid_process(-1, status, 0);
+}
+
+// 等待子进程退出并回收：pid 不大于 0 时取僵尸队列中最早退出的子进程，否则只等待该子进程。
+// 成功返回子进程 PID 并写入 *status；options 含 WNOHANG 且目标尚未退出时返回 0；
+// 没有（对应的）子进程或当前进程已被杀死时返回 -1。
+// 退出的子进程会把自己挂到僵尸队列并只唤醒父进程，这里无需扫描子进程
+int waitpid_process(int pid, int *status, int options)
+{
+  return wait4_process(pid, status, options, 0);
+}
+
+static void rusage_add(struct rusage *dst, const struct rusage *src)
+{
+  dst->utime += src->utime;
+  dst->stime += src->stime;
+  dst->wtime += src->wtime;
+  dst->slptime += src->slptime;
+  dst->nvcsw += src->nvcsw;
+  dst->nivcsw += src->nivcsw;
+  dst->cow_faults += src->cow_faults;
+  dst->lazy_faults += src->lazy_faults;
+  dst->minflt += src->minflt;
+  dst->majflt += src->majflt;
+  dst->uaccess_faults += src->uaccess_faults;
+}
+
+// p 自身的资源使用（不含子进程）
+static void rusage_self(struct proc *p, struct rusage *ru)
+{
+  ru->utime = p->utime;
+  ru->stime = p->stime;
+  ru->wtime = p->run_delay;
+  ru->slptime = p->slptime;
+  ru->nvcsw = p->nvcsw;
+  ru->nivcsw = p->nivcsw;
+  ru->cow_faults = p->cow_faults;
+  ru->lazy_faults = p->lazy_faults;
+  ru->minflt = p->minflt;
+  ru->majflt = p->majflt;
+  ru->uaccess_faults = p->uaccess_faults;
+}
+
+// 读取本 hart 的硬件计数器
+static void perf_sample(struct perfcount *pc)
+{
+  pc->cycles = r_cycle();
+  pc->instret = r_instret();
+  pc->hpm[0] = r_hpmcounter3();
+  pc->hpm[1] = r_hpmcounter4();
+  pc->hpm[2] = r_hpmcounter5();
+}
+
+static void perf_add(struct perfcount *dst, const struct perfcount *src)
+{
+  dst->cycles += src->cycles;
+  dst->instret += src->instret;
+  for(int i = 0; i < PERF_NHPM; i++)
+    dst->hpm[i] += src->hpm[i];
+}
+
+// dst += 当前计数 - p->perf_mark，须在 p 切入的同一个 hart 上调用
+static void perf_add_running(struct perfcount *dst, struct proc *p)
+{
+  struct perfcount now;
+  perf_sample(&now);
+  dst->cycles += now.cycles - p->perf_mark.cycles;
+  dst->instret += now.instret - p->perf_mark.instret;
+  for(int i = 0; i < PERF_NHPM; i++)
+    dst->hpm[i] += now.hpm[i] - p->perf_mark.hpm[i];
+}
+
+static void iostat_add(struct proc_iostat *dst, const struct proc_iostat *src)
+{
+  dst->rchar += src->rchar;
+  dst->wchar += src->wchar;
+  dst->cache_hits += src->cache_hits;
+  dst->cache_misses += src->cache_misses;
+  dst->read_blocks += src->read_blocks;
+  dst->write_blocks += src->write_blocks;
+  dst->log_blocks += src->log_blocks;
+  dst->iowait += src->iowait;
+}
+
+// 同 waitpid_process；ru 非 0 时写入被回收子进程的资源使用（含其已回收的后代），
+// 这份累计同时并入当前进程的 cru，硬件计数并入 cperf，I/O 统计并入 cio
+int wait4_process(int pid, int *status, int options, struct rusage *ru)
 {
   struct proc *pp;
-  int havekids, pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;) {
-    // 扫描进程表寻找退出的子进程
-    havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++) {
-      if(pp->parent == p) {
-        havekids = 1;
-        if(pp->state == ZOMBIE) {
-          // 找到一个僵尸进程
-          pid = pp->pid;
-          
-          // 复制退出状态
-          if(status != 0) {
-            *status = pp->xstate;
-          }
-
-          klog_info("wait: pid=%d 收割子进程 pid=%d 状态=%d", p->pid, pp->pid, pp->xstate);
-          release(&wait_lock);
-          free_process(pp);
-          return pid;
-        }
+    if(pid > 0) {
+      // 只有自己的子进程才可等待；子进程的 parent 在持有 wait_lock 时不会变化
+      acquire(&proc_list_lock);
+      pp = proc_find(pid);
+      if(pp && pp->parent != p)
+        pp = 0;
+      release(&proc_list_lock);
+      if(pp == 0) {
+        release(&wait_lock);
+        return -1;
       }
+      if(pp->state != ZOMBIE)
+        pp = 0;
+    } else {
+      if(p->children == 0) {
+        release(&wait_lock);
+        return -1;
+      }
+      pp = p->zombies;
+    }
+
+    if(pp) {
+      int cpid = pp->pid;
+      // 复制退出状态
+      if(status != 0) {
+        *status = pp->xstate;
+      }
+
+      TRACE(WAIT, p->pid, cpid, pp->xstate);
+      struct rusage cru;
+      rusage_self(pp, &cru);
+      rusage_add(&cru, &pp->cru);
+      rusage_add(&p->cru, &cru);
+      perf_add(&p->cperf, &pp->perf);
+      perf_add(&p->cperf, &pp->cperf);
+      iostat_add(&p->cio, &pp->io);
+      iostat_add(&p->cio, &pp->cio);
+      if(ru)
+        *ru = cru;
+      zombie_remove(p, pp);
+      child_unlink(pp);
+      release(&wait_lock);
+      free_process(pp);
+      return cpid;
     }
 
-    // 如果没有子进程或当前进程已被杀死，则无需等待
-    if(!havekids || p->killed) {
+    if(options & WNOHANG) {
+      release(&wait_lock);
+      return 0;
+    }
+    // 当前进程已被杀死，则无需等待
+    if(p->killed) {
       release(&wait_lock);
       return -1;
     }
@@ -552,7 +1149,166 @@ int wait_process(int *status)
   }
 }
 
-// 进程调度器：结合多级反馈队列，优先调度高优先级且等待时间短的进程
+// 取资源使用统计：who 为 RUSAGE_SELF 时取当前进程（含本次陷入以来的内核态时间），
+// RUSAGE_CHILDREN 时取已回收子进程的累计，正数时取该 pid 的存活进程自身。不存在时返回 -1
+int proc_getrusage(int who, struct rusage *ru)
+{
+  struct proc *p = myproc();
+
+  if(who == RUSAGE_SELF) {
+    rusage_self(p, ru);
+    ru->stime += get_time() - p->acct_time;
+    return 0;
+  }
+  if(who == RUSAGE_CHILDREN) {
+    acquire(&wait_lock);
+    *ru = p->cru;
+    release(&wait_lock);
+    return 0;
+  }
+  if(who < 0)
+    return -1;
+  acquire(&proc_list_lock);
+  struct proc *q = proc_find(who);
+  if(q == 0 || q->state == UNUSED) {
+    release(&proc_list_lock);
+    return -1;
+  }
+  rusage_self(q, ru);
+  release(&proc_list_lock);
+  return 0;
+}
+
+// 取硬件计数，who 的含义同 proc_getrusage。当前进程的计数含本次切入以来的部分
+int proc_perf_read(int who, struct perfcount *pc)
+{
+  struct proc *p = myproc();
+
+  if(who == PERF_SELF) {
+    push_off();   // 取样期间不能被迁移到别的 hart
+    *pc = p->perf;
+    perf_add_running(pc, p);
+    pop_off();
+    return 0;
+  }
+  if(who == PERF_CHILDREN) {
+    acquire(&wait_lock);
+    *pc = p->cperf;
+    release(&wait_lock);
+    return 0;
+  }
+  if(who < 0)
+    return -1;
+  acquire(&proc_list_lock);
+  struct proc *q = proc_find(who);
+  if(q == 0 || q->state == UNUSED) {
+    release(&proc_list_lock);
+    return -1;
+  }
+  *pc = q->perf;
+  release(&proc_list_lock);
+  return 0;
+}
+
+// 取 I/O 统计，who 的含义同 proc_getrusage
+int proc_iostat_read(int who, struct proc_iostat *st)
+{
+  struct proc *p = myproc();
+
+  if(who == IOSTAT_SELF) {
+    *st = p->io;
+    return 0;
+  }
+  if(who == IOSTAT_CHILDREN) {
+    acquire(&wait_lock);
+    *st = p->cio;
+    release(&wait_lock);
+    return 0;
+  }
+  if(who < 0)
+    return -1;
+  acquire(&proc_list_lock);
+  struct proc *q = proc_find(who);
+  if(q == 0 || q->state == UNUSED) {
+    release(&proc_list_lock);
+    return -1;
+  }
+  *st = q->io;
+  release(&proc_list_lock);
+  return 0;
+}
+
+// 把至多 max 个进程的快照写入 buf（内核地址），返回写入的项数。
+// 持有 wait_lock 读取父进程，持有 proc_list_lock 保证遍历期间进程不被回收
+int proc_snapshot(struct procinfo *buf, int max)
+{
+  static const char states[] = { [UNUSED] = '?', [USED] = 'U', [SLEEPING] = 'S',
+                                 [RUNNABLE] = 'r', [RUNNING] = 'R', [ZOMBIE] = 'Z' };
+  struct proc *p;
+  int n = 0;
+
+  acquire(&wait_lock);
+  acquire(&proc_list_lock);
+  for_each_proc(p) {
+    if(n >= max)
+      break;
+    if(p->state == UNUSED)
+      continue;
+    struct procinfo *pi = &buf[n++];
+    pi->pid = p->pid;
+    pi->ppid = p->parent ? p->parent->pid : 0;
+    pi->state = states[p->state];
+    safestrcpy(pi->name, p->name, sizeof(pi->name));
+    rusage_self(p, &pi->ru);
+  }
+  release(&proc_list_lock);
+  release(&wait_lock);
+  return n;
+}
+
+// 全局停顿：内存规整迁移用户页时，要求其他 hart 都停在调度器里、不运行任何进程，
+// 这样页表项与页面内容都不会在迁移途中被修改。停下的 hart 保持开中断，照常处理设备中断
+#define STOP_WAIT_TIME (TIMEBASE_FREQ / 100)   // 等待其他 hart 停下的上限（10ms）
+static int stop_req;
+static int parked[NCPU];
+
+static void sched_park(void)
+{
+  int id = cpuid();
+  __atomic_store_n(&parked[id], 1, __ATOMIC_RELEASE);
+  while(__atomic_load_n(&stop_req, __ATOMIC_ACQUIRE))
+    cpu_relax();
+  __atomic_store_n(&parked[id], 0, __ATOMIC_RELEASE);
+}
+
+// 在调度器（空闲循环）或关闭了抢占的进程上下文中调用：请求其他 hart 停下并等待它们确认。已有其他 hart 发起停顿，
+// 或有 hart 在 STOP_WAIT_TIME 内没有回到调度器（例如长时间运行的 FIFO 进程）时放弃并返回 -1
+int sched_stop_others(void)
+{
+  if(__atomic_exchange_n(&stop_req, 1, __ATOMIC_ACQ_REL))
+    return -1;
+  int self = cpuid();
+  uint64 deadline = get_time() + STOP_WAIT_TIME;
+  for(int i = 0; i < NCPU; i++) {
+    if(i == self)
+      continue;
+    while(!__atomic_load_n(&parked[i], __ATOMIC_ACQUIRE)) {
+      if(get_time() > deadline) {
+        __atomic_store_n(&stop_req, 0, __ATOMIC_RELEASE);
+        return -1;
+      }
+      cpu_relax();
+    }
+  }
+  return 0;
+}
+
+void sched_resume_others(void)
+{
+  __atomic_store_n(&stop_req, 0, __ATOMIC_RELEASE);
+}
+
+// 进程调度器：按调度类顺序（FIFO、MLFQ、公平类）挑选下一个就绪进程
 void scheduler(void)
 {
   struct cpu *c = mycpu();
@@ -561,43 +1317,47 @@ void scheduler(void)
 
   for(;;) {
     intr_on();
-    mlfq_promote_aged();         // 调度前先做一次老化处理，防止长时间等待
+    if(__atomic_load_n(&stop_req, __ATOMIC_ACQUIRE)) {
+      sched_park();
+      continue;
+    }
+    sched_age();                 // 调度前先做一次老化处理，防止长时间等待
 
-    struct proc *p = mlfq_pick_next();
+    struct proc *p = sched_pick_next();
     if(p == 0) {
       intr_on();                 // 没有可运行进程时允许中断并进入低功耗等待
-      asm volatile("wfi");
+      // 先利用空闲时间回收内存、预清零页面，都无事可做时才真正 wfi
+      if(pmm_idle_reclaim() > 0 || pmm_idle_zero() > 0 || pmm_idle_compact() > 0)
+        continue;
+      cpu_idle(&stop_req);       // 短暂轮询就绪队列，落空后才 wfi
       continue;
     }
 
     intr_off();                   // 正式切换上下文前关闭中断，保持状态一致
+    // p 刚在别的 hart 上睡眠或让出时，那边可能还没执行完 swtch 保存 context
+    while(__atomic_load_n(&p->on_cpu, __ATOMIC_ACQUIRE))
+      ;
+    p->on_cpu = 1;
     p->state = RUNNING;
+    p->acct_time = get_time();    // 从这里起重新计入 p 的内核态时间
+    perf_sample(&p->perf_mark);
     c->proc = p;
+    timer_reprogram();            // 按新进程的时间片设置下一次时钟中断
+    TRACE(SCHED_SWITCH, p->pid, p->sched_policy);
 
     swtch(&c->context, &p->context);
 
     c->proc = 0;
+    c->preempt_count = 0;   // 换出的进程可能在抢占点内让出，它的计数已存进自己的上下文
+    // 退出的线程没有父进程等待它，已经离开其内核栈，在此直接回收。
+    // 清除 on_cpu 之后 p 可能立即被其他 hart 回收，须先读出状态
+    int reap = p->state == ZOMBIE && p->tg_leader;
+    __atomic_store_n(&p->on_cpu, 0, __ATOMIC_RELEASE);
+    if(reap)
+      thread_reap(p);
   }
 }
 
-// 时钟中断调用：累计当前进程时间片，并在超时时标记需要抢占
-void scheduler_tick(void)
-{
-  struct proc *p = mycpu()->proc;
-  if(p == 0 || p->state != RUNNING)
-    return;
-
-  int level = p->priority_level;
-  if(level < 0)
-    level = 0;
-  else if(level >= MLFQ_LEVELS)
-    level = MLFQ_LEVELS - 1;
-
-  p->ticks_in_level++;
-  if(p->ticks_in_level >= mlfq_time_slices[level])
-    p->exhausted_slice = 1;
-}
-
 // 切换到调度器
 void sched(void)
 {
@@ -610,10 +1370,17 @@ void sched(void)
   if(intr_get())
     panic("sched interruptible");
   
-  // 保存中断状态并切换到调度器
+  // 只有本次运行中写过浮点寄存器的进程才需保存浮点现场，纯整数进程的切换开销不变
+  fpu_switch_out(p);
+  p->stime += get_time() - p->acct_time;
+  perf_add_running(&p->perf, p);
+
+  // 保存中断状态与抢占计数并切换到调度器
   intena = mycpu()->intena;
+  int preempt_count = mycpu()->preempt_count;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
+  mycpu()->preempt_count = preempt_count;
 }
 
 // 让出CPU
@@ -625,17 +1392,12 @@ void yield(void)
   if(p->state != RUNNING)
     panic("yield: not running");
 
-  int level = p->priority_level;
-  if(p->exhausted_slice && level < MLFQ_LEVELS - 1)
-    level++;
-
-  if(p->in_runqueue)
-    panic("yield double enqueue");
-
-  int reset_ticks = p->preempt_pending ? 0 : 1;
+  if(p->exhausted_slice || p->preempt_pending)
+    p->nivcsw++;
+  else
+    p->nvcsw++;   // 内核任务主动调用 yield
   p->state = RUNNABLE;
-  mlfq_enqueue_locked(p, level, reset_ticks); // 被更高优先级抢占时保留剩余时间片
-  p->preempt_pending = 0;
+  sched_requeue(p);   // 由所属调度类决定回到队列的位置（MLFQ 在用完时间片时降级）
   sched();
   intr_on();
 }
@@ -646,6 +1408,25 @@ void forkret(void)
   usertrapret();
 }
 
+// 等待通道对应的睡眠桶
+static struct proc **sleepq_bucket(void *chan)
+{
+  uint64 x = (uint64)chan;
+  return &sleepq[((x >> 3) ^ (x >> 12)) % NSLEEPQ];
+}
+
+// 在持有 sleepq_lock 的前提下把 p 从其睡眠桶中摘下
+static void sleepq_remove_locked(struct proc *p)
+{
+  for(struct proc **pp = sleepq_bucket(p->chan); *pp; pp = &(*pp)->sleep_next) {
+    if(*pp == p) {
+      *pp = p->sleep_next;
+      break;
+    }
+  }
+  p->sleep_next = 0;
+}
+
 // 进程睡眠
 void sleep(void *chan, struct spinlock *lk)
 {
@@ -656,54 +1437,216 @@ void sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // 假设调用者已持有 lk，先标记睡眠状态
+  // 假设调用者已持有 lk，先标记睡眠状态并挂入通道对应的桶
+  acquire(&sleepq_lock);
+  struct proc **bucket = sleepq_bucket(chan);
   p->chan = chan;
   p->state = SLEEPING;
   p->preempt_pending = 0;
+  p->sleep_next = *bucket;
+  *bucket = p;
+  // 在 sleepq_lock 内计费并记下睡眠起点，唤醒方入队前一定能看到
+  sched_charge(p);
+  p->sleep_start = get_time();
+  release(&sleepq_lock);
+  p->nvcsw++;
 
   // 释放外部锁，并让出 CPU
   release(lk);
   push_off();
   sched();
   pop_off();
+  // 唤醒时入队的时刻即睡眠结束，之后的就绪等待计入 run_delay
+  if(p->ready_time > p->sleep_start)
+    p->slptime += p->ready_time - p->sleep_start;
 
   // 返回前重新加锁并清理通道
   acquire(lk);
   p->chan = 0;
 }
 
+// 唤醒在指定通道上睡眠的至多 max 个进程，返回唤醒的个数：只遍历该通道散列到的桶，
+// 先在锁内把命中的进程摘到本地链表，释放锁后再逐个入队
+static int wakeup_n(void *chan, int max)
+{
+  struct proc *woken = 0;
+  struct proc *self = myproc();
+  int n = 0;
+
+  acquire(&sleepq_lock);
+  struct proc **pp = sleepq_bucket(chan);
+  while(*pp && n < max) {
+    struct proc *p = *pp;
+    if(p != self && p->state == SLEEPING && p->chan == chan) {
+      *pp = p->sleep_next;
+      p->state = RUNNABLE;
+      p->sleep_next = woken;
+      woken = p;
+      n++;
+    } else {
+      pp = &p->sleep_next;
+    }
+  }
+  release(&sleepq_lock);
+
+  while(woken) {
+    struct proc *next = woken->sleep_next;
+    woken->sleep_next = 0;
+    sched_enqueue(woken); // I/O唤醒的进程恢复最高优先级
+    woken = next;
+  }
+  return n;
+}
+
 // 唤醒在指定通道上睡眠的所有进程
 void wakeup(void *chan)
 {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()) {
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-        mlfq_enqueue(p, 0, 1); // I/O唤醒的进程恢复最高优先级
-      }
-    }
+  wakeup_n(chan, NPROC_MAX);
+}
+
+// futex 等待的超时状态，位于 futex_timedwait 调用者的栈上
+struct futex_timeout {
+  uint64 pa;      // 睡眠通道
+  int expired;    // 定时器回调已执行完
+};
+
+// 超时定时器到期：在 futex_lock 下置位并唤醒同一通道，睡在该字上的其他等待者
+// 也会被唤醒，与 futex 允许的虚假唤醒一样由用户态重新检查条件
+static void futex_timer_expired(void *arg)
+{
+  struct futex_timeout *ft = arg;
+
+  acquire(&futex_lock);
+  ft->expired = 1;
+  wakeup((void *)ft->pa);
+  release(&futex_lock);
+}
+
+// futex_wait: 若用户地址 uaddr 处的 int 仍等于 val，则睡眠直到 futex_wake。
+// 以该字的物理地址作为睡眠通道，同一进程的线程与映射同一共享页的进程都能互相唤醒。
+// 取地址时按写访问翻译，先完成写时复制，保证等待期间该字不会再换到别的物理页。
+// 值不相等、地址无效或被 kill 唤醒时返回 -1，调用者应重新检查条件。
+int futex_wait(uint64 uaddr, int val)
+{
+  return futex_timedwait(uaddr, val, -1);
+}
+
+// futex_timedwait: 同 futex_wait，但最多等待 us 微秒（hrtimer，不受 tick 精度限制），
+// 超时也返回 -1；us 为 0 时不睡眠，值相等也立即返回 -1，us 为负数时一直等待
+int futex_timedwait(uint64 uaddr, int val, long us)
+{
+  struct proc *p = myproc();
+  struct futex_timeout ft = {0};
+  struct hrtimer timer = {0};
+
+  if(uaddr % sizeof(int))
+    return -1;
+  // 先在锁外完成可能需要读文件的缺页处理，锁内的翻译只查已有映射
+  if(uvm_user_pa(p->pagetable, uaddr, 1) == 0)
+    return -1;
+
+  acquire(&futex_lock);
+  uint64 pa = uvm_user_pa(p->pagetable, uaddr, 1);
+  if(pa == 0 || *(volatile int *)pa != val || killed(p)) {
+    release(&futex_lock);
+    return -1;
   }
+  if(us == 0) {
+    release(&futex_lock);
+    return -1;
+  }
+  // 睡眠通道是物理地址：等待期间持有该页的一次引用，内存规整不会把它迁走
+  page_incref((void *)PGROUNDDOWN(pa));
+  ft.pa = pa;
+  if(us > 0)
+    hrtimer_start(&timer, get_time() + us_to_time(us), futex_timer_expired, &ft);
+  sleep((void *)pa, &futex_lock);
+  // 定时器已被摘下时回调可能仍在其他 hart 上执行，等它置位 expired 后 ft 才能出栈
+  if(us > 0 && !hrtimer_cancel(&timer)) {
+    while(!ft.expired)
+      sleep((void *)pa, &futex_lock);
+  }
+  release(&futex_lock);
+  free_page((void *)PGROUNDDOWN(pa));
+  return killed(p) || ft.expired ? -1 : 0;
+}
+
+// futex_wake: 唤醒在 uaddr 上等待的至多 n 个进程，返回唤醒的个数
+int futex_wake(uint64 uaddr, int n)
+{
+  struct proc *p = myproc();
+
+  if(uaddr % sizeof(int) || n <= 0)
+    return -1;
+  uint64 pa = uvm_user_pa(p->pagetable, uaddr, 1);
+  if(pa == 0)
+    return -1;
+
+  acquire(&futex_lock);
+  int woken = wakeup_n((void *)pa, n);
+  release(&futex_lock);
+  return woken;
 }
 
 // 杀死指定PID的进程
 int kill_process(int pid)
+{
+  acquire(&proc_list_lock);
+  struct proc *p = proc_find(pid);
+  if(p)
+    proc_kill(p);
+  release(&proc_list_lock);
+  return p ? 0 : -1;
+}
+
+// 标记 p 已被杀死，正在睡眠则立即唤醒。调用者保证 p 在此期间不会被回收
+static void proc_kill(struct proc *p)
+{
+  p->killed = 1;
+  acquire(&sleepq_lock);
+  int was_sleeping = p->state == SLEEPING;
+  if(was_sleeping) {
+    // 从睡眠中唤醒进程
+    sleepq_remove_locked(p);
+    p->state = RUNNABLE;
+  }
+  release(&sleepq_lock);
+  if(was_sleeping)
+    sched_enqueue(p); // 被kill唤醒后也需进入调度队列
+}
+
+// 查询进程的常驻页数，pid 为 0 表示当前进程；进程不存在时返回 -1
+int proc_rss(int pid, uint64 *rss)
 {
   struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p->pid == pid) {
-      p->killed = 1;
-      if(p->state == SLEEPING) {
-        // 从睡眠中唤醒进程
-        p->state = RUNNABLE;
-        mlfq_enqueue(p, 0, 1); // 被kill唤醒后也需进入调度队列
-      }
-      return 0;
-    }
+
+  if(pid == 0) {
+    *rss = uvm_rss(myproc()->pagetable);
+    return 0;
+  }
+  acquire(&proc_list_lock);
+  p = proc_find(pid);
+  if(p)
+    *rss = uvm_rss(p->pagetable);
+  release(&proc_list_lock);
+  return p ? 0 : -1;
+}
+
+// proc_set_trace: 设置进程 pid（0 表示自身）的系统调用跟踪掩码
+int proc_set_trace(int pid, uint64 mask)
+{
+  struct proc *p;
+
+  if(pid == 0) {
+    myproc()->trace_mask = mask;
+    return 0;
   }
-  return -1;
+  acquire(&proc_list_lock);
+  p = proc_find(pid);
+  if(p)
+    p->trace_mask = mask;
+  release(&proc_list_lock);
+  return p ? 0 : -1;
 }
 
 // 设置进程为已杀死状态
@@ -744,6 +1687,7 @@ void userinit(void)
   if(new_sz == 0)
     panic("userinit: stack alloc");
   p->sz = new_sz;
+  p->heap_base = new_sz;
 
   struct file *f0 = filealloc();
   struct file *f1 = filealloc();
@@ -766,9 +1710,10 @@ void userinit(void)
   f2->writable = 1;
   f2->major = CONSOLE;
 
-  p->ofile[0] = f0;
-  p->ofile[1] = f1;
-  p->ofile[2] = f2;
+  // 空表按顺序分配，得到描述符 0、1、2
+  fd_alloc(p->fdt, f0);
+  fd_alloc(p->fdt, f1);
+  fd_alloc(p->fdt, f2);
 
   // 设置用户态初始寄存器
   p->trapframe->epc = 0;           // 用户程序入口
@@ -779,7 +1724,7 @@ void userinit(void)
   klog_info("userinit: 初始化用户进程 pid=%d", p->pid);
 
   p->state = RUNNABLE;
-  mlfq_enqueue(p, 0, 1);   // init进程触发调度时应优先获得CPU
+  sched_enqueue(p);   // init进程触发调度时应优先获得CPU
 }
 
 // 简单测试任务函数
@@ -795,18 +1740,18 @@ void test_process_creation(void) {
   // 测试基本的进程创建
   int pid = create_process(simple_task);
   assert(pid > 0);
-  // 测试进程表限制
-  int pids[NPROC];
+  // 进程控制块按需分配，同时存在的进程数可以超过早期固定进程表的 64 个槽位
   int count = 0;
-  for (int i = 0; i < NPROC + 5; i++) {
+  for (int i = 0; i < 64 + 5; i++) {
     int pid = create_process(simple_task);
     if (pid > 0) {
-      pids[count++] = pid;
+      count++;
     } else {
       break;
     }
   }
   printf("Created %d processes\n", count);
+  assert(count == 64 + 5);
   // 清理测试进程
   for (int i = 0; i < count; i++) {
     wait_process(0);
@@ -966,19 +1911,24 @@ void consumer_task(void) {
     // 等待完成
     wait_process(0);
     wait_process(0);
+
+    // 缓冲区已被取空：限时等待应超时，补上一个计数后应立即成功
+    assert(sem_timedwait(&buffer_full, 2) == -1);
+    sem_signal(&buffer_full);
+    assert(sem_timedwait(&buffer_full, 2) == 0);
     printf("Synchronization test completed\n");
  }
 
  //进程状态调试
 void debug_proc_table(void) {
   printf("=== Process Table ===\n");
-  for (int i = 0; i < NPROC; i++) {
-    struct proc *p = &proc[i];
-    if (p->state != UNUSED) {
-      printf("PID:%d State:%d Name:%s\n", 
-        p->pid, p->state, p->name);
-    }
+  struct proc *p;
+  acquire(&proc_list_lock);
+  for_each_proc(p) {
+    printf("PID:%d State:%d Name:%s\n",
+      p->pid, p->state, p->name);
   }
+  release(&proc_list_lock);
 }
 
 int run_kernel_tests(void)
@@ -993,6 +1943,7 @@ int run_kernel_tests(void)
   tests_executed = 1;
 
   printf("[kernel-test] begin\n");
+#if KTEST_AT_BOOT
   test_process_creation();
 
   uint64 start = get_time();
@@ -1005,6 +1956,22 @@ int run_kernel_tests(void)
   while(get_time() - start < 500000);
   printf("\n");
   test_synchronization();
+  printf("\n");
+  test_memops_performance();
+  printf("\n");
+  test_htable();
+  printf("\n");
+  test_radix();
+#endif
+#if BENCH_AT_BOOT
+  printf("\n");
+  {
+    static struct bench_result res[BENCH_MAX];
+    int n = bench_run(0, res, BENCH_MAX);
+    for(int i = 0; i < n; i++)
+      bench_report(&res[i]);
+  }
+#endif
   //printf("\n");
   //test_preemptive_scheduler();
   printf("[kernel-test] end\n");
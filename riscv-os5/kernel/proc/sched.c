@@ -0,0 +1,901 @@
+// sched.c: 调度类与各 hart 的运行队列。
+// 调度类按固定的先后顺序排列，调度器总是先从排在前面的类中挑选进程：
+//   - SCHED_FIFO：实时 FIFO，按静态优先级排序，同优先级先来先服务；没有时间片，
+//     一直运行到阻塞、让出或被更高优先级的 FIFO 进程抢占为止；
+//   - SCHED_MLFQ：默认的多级反馈队列，交互型进程保持高优先级，CPU 密集型逐级下沉；
+//   - SCHED_FAIR：按虚拟运行时间排序的公平类，nice 值决定权重，面向吞吐型批处理任务，
+//     只使用前两类剩下的 CPU 时间。
+// 每个 hart 一个运行队列，各自持锁：入队落在进程最近运行的 hart 上以保持缓存亲和，
+// 本地队列为空时调度器从就绪进程最多的队列窃取一个，避免某个 hart 空转而其他 hart 排队。
+// 进程的 cpumask 限定它可以运行的 hart：入队只会落在允许的 hart 上，窃取时跳过不允许在本 hart
+// 运行的进程，因此每个队列中的进程都可以在该队列所属的 hart 上运行。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "trap.h"
+#include "printf.h"
+#include "sched.h"
+#include "string.h"
+#include "metrics.h"
+#include "bitops.h"
+
+extern volatile uint64 ticks;      // 计时器滴答，由时钟中断更新
+
+// 多级反馈队列参数配置
+#define MLFQ_LEVELS SCHED_MLFQ_LEVELS            // 队列数量：0~4共五级优先级
+static const int mlfq_time_slices[MLFQ_LEVELS] = {1, 2, 4, 8, 16}; // 各级队列对应的时间片长度（单位：时钟滴答）
+#define MLFQ_AGING_TICKS 50                      // 队列老化阈值，超过该滴答数未运行则向上提升
+// 配额（allotment）：进程在某一级累计运行满该级时间片才降级，睡眠与让出不清零，
+// 否则每次在时间片用完前睡一下的进程就能永远留在最高级。计费按实际运行时间而非
+// tick 采样，睡眠前不足一个 tick 的运行同样计入。MLFQ_WAKE_BOOST=1 恢复唤醒即回到 0 级
+#ifndef MLFQ_WAKE_BOOST
+#define MLFQ_WAKE_BOOST 0
+#endif
+
+// 公平类参数：vruntime 以 nice 0 进程运行 1 个 tick 为 FAIR_VSCALE
+#define FAIR_SLICE 4                             // 公平类时间片（时钟滴答）
+#define FAIR_VSCALE 1024
+#define FAIR_WAKEUP_CREDIT (FAIR_SLICE * FAIR_VSCALE / 2) // 睡眠后回到队列时最多领先 min_vruntime 的量
+
+// nice -20~19 对应的权重，相邻两级约差 1.25 倍，nice 0 为 1024
+static const int fair_weights[SCHED_NICE_MAX - SCHED_NICE_MIN + 1] = {
+  88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,   335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+struct runqueue {
+  struct spinlock lock;
+  int nready;                  // 队列中就绪进程总数，窃取时据此挑选最忙的队列
+
+  struct proc *fifo_head;      // SCHED_FIFO：按 rt_priority 从高到低排列
+
+  struct proc *head[MLFQ_LEVELS]; // SCHED_MLFQ：每级一个先进先出链表
+  struct proc *tail[MLFQ_LEVELS];
+  uint32 nonempty;             // 第 level 位为 1 表示该级队列非空
+  uint64 aged_tick;            // 最近一次老化检查时的 ticks
+
+  struct proc *fair_head;      // SCHED_FAIR：按 vruntime 从小到大排列
+  uint64 min_vruntime;         // 公平类已运行进程中的最小 vruntime，单调不减
+
+  uint64 lat_hist[SCHED_LAT_BUCKETS]; // 本队列出队进程的调度延迟直方图（log2 分桶）
+  uint64 lat_total;            // 调度延迟之和
+  uint64 nr_switches;          // 本队列出队的总次数
+};
+static struct runqueue runqueues[NCPU];
+static struct spinlock pi_lock;    // 保护各进程的 pi_level 与 pi_nlocks（优先级继承）
+
+// mlfq_lowest[bits] 为位图 bits 中最低的置位编号（bits 非 0），出队时据此 O(1) 定位最高优先级
+static uint8 mlfq_lowest[1 << MLFQ_LEVELS];
+
+// 入队原因
+#define ENQUEUE_WAKEUP 1   // 新建或被唤醒的进程
+#define ENQUEUE_YIELD  2   // 当前进程让出 CPU（时间片用完或被抢占）
+
+// 调度类接口：队列操作均在持有 rq->lock 时调用，通用字段（in_runqueue、nready 等）由调用者维护
+struct sched_class {
+  void (*enqueue)(struct runqueue *rq, struct proc *p, int flags);
+  void (*dequeue)(struct runqueue *rq, struct proc *p);  // 从队列中摘除指定进程
+  struct proc *(*pick)(struct runqueue *rq);            // 取出下一个运行的进程，队列为空返回 0
+  struct proc *(*steal)(struct runqueue *rq, int cpu);  // 按 pick 的顺序取出首个允许在 cpu 上运行的进程
+  void (*tick)(struct proc *p, int nticks);             // 累计运行时间，时间片用完时置 exhausted_slice
+  int (*ticks_left)(struct proc *p);                    // 距时间片结束的 tick 数，-1 表示没有时间片
+  int (*preempt)(struct proc *p, struct proc *curr);    // 同类进程 p 就绪时是否应抢占 curr
+};
+
+// 从单链表中摘除 p
+static void list_remove(struct proc **head, struct proc *p)
+{
+  for(struct proc **pp = head; *pp; pp = &(*pp)->rq_next) {
+    if(*pp == p) {
+      *pp = p->rq_next;
+      break;
+    }
+  }
+  p->rq_next = 0;
+}
+
+// 取出单链表的首个进程
+static struct proc *list_pop(struct proc **head)
+{
+  struct proc *p = *head;
+  if(p) {
+    *head = p->rq_next;
+    p->rq_next = 0;
+  }
+  return p;
+}
+
+// p 是否允许在 hart cpu 上运行
+static int cpu_allowed(struct proc *p, int cpu)
+{
+  return (p->cpumask >> cpu) & 1;
+}
+
+// 取出单链表中首个允许在 cpu 上运行的进程
+static struct proc *list_steal(struct proc **head, int cpu)
+{
+  for(struct proc **pp = head; *pp; pp = &(*pp)->rq_next) {
+    struct proc *p = *pp;
+    if(cpu_allowed(p, cpu)) {
+      *pp = p->rq_next;
+      p->rq_next = 0;
+      return p;
+    }
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------- SCHED_FIFO
+
+static void fifo_enqueue(struct runqueue *rq, struct proc *p, int flags)
+{
+  // 排在所有优先级不低于自己的进程之后，同优先级先来先服务
+  struct proc **pp = &rq->fifo_head;
+  while(*pp && (*pp)->rt_priority >= p->rt_priority)
+    pp = &(*pp)->rq_next;
+  p->rq_next = *pp;
+  *pp = p;
+}
+
+static void fifo_dequeue(struct runqueue *rq, struct proc *p)
+{
+  list_remove(&rq->fifo_head, p);
+}
+
+static struct proc *fifo_pick(struct runqueue *rq)
+{
+  return list_pop(&rq->fifo_head);
+}
+
+static struct proc *fifo_steal(struct runqueue *rq, int cpu)
+{
+  return list_steal(&rq->fifo_head, cpu);
+}
+
+static void fifo_tick(struct proc *p, int nticks)
+{
+  // 没有时间片
+}
+
+static int fifo_ticks_left(struct proc *p)
+{
+  return -1;
+}
+
+static int fifo_preempt(struct proc *p, struct proc *curr)
+{
+  return p->rt_priority > curr->rt_priority;
+}
+
+// ---------------------------------------------------------------- SCHED_MLFQ
+
+// 调度时使用的级别：被优先级继承提升时取提升后的级别
+static int mlfq_eff_level(struct proc *p)
+{
+  if(p->pi_level >= 0 && p->pi_level < p->priority_level)
+    return p->pi_level;
+  return p->priority_level;
+}
+
+// 将进程的级别设为 level，并插入其调度级别对应队列的尾部
+static void mlfq_insert(struct runqueue *rq, struct proc *p, int level, int reset_ticks)
+{
+  if(level < 0)
+    level = 0;
+  if(level >= MLFQ_LEVELS)
+    level = MLFQ_LEVELS - 1;
+
+  if(reset_ticks)
+    p->mlfq_used = 0;
+
+  p->priority_level = level;
+  level = mlfq_eff_level(p);
+  p->rq_level = level;
+  p->last_ready_tick = ticks;
+  p->rq_next = 0;
+
+  if(rq->tail[level]) {
+    rq->tail[level]->rq_next = p;
+  } else {
+    rq->head[level] = p;
+  }
+  rq->tail[level] = p;
+  rq->nonempty |= 1 << level;
+}
+
+// 从 level 级队列中摘下 p（prev 为其前驱，队首时为 0）
+static void mlfq_unlink(struct runqueue *rq, struct proc *p, struct proc *prev, int level)
+{
+  if(prev) {
+    prev->rq_next = p->rq_next;
+  } else {
+    rq->head[level] = p->rq_next;
+  }
+  if(rq->tail[level] == p)
+    rq->tail[level] = prev;
+  if(rq->head[level] == 0)
+    rq->nonempty &= ~(1 << level);
+  p->rq_next = 0;
+}
+
+// p 在当前级别的配额（get_time 单位）
+static uint64 mlfq_allot(struct proc *p)
+{
+  int level = p->priority_level;
+  if(level < 0)
+    level = 0;
+  else if(level >= MLFQ_LEVELS)
+    level = MLFQ_LEVELS - 1;
+  return (uint64)mlfq_time_slices[level] * TICK_INTERVAL;
+}
+
+// 把 slice_start 以来的运行时间计入配额，用满时置 exhausted_slice
+static void mlfq_charge(struct proc *p)
+{
+  uint64 now = get_time();
+  p->mlfq_used += now - p->slice_start;
+  p->slice_start = now;
+  if(p->mlfq_used >= mlfq_allot(p))
+    p->exhausted_slice = 1;
+}
+
+static void mlfq_enqueue(struct runqueue *rq, struct proc *p, int flags)
+{
+  if(flags & ENQUEUE_YIELD) {
+    mlfq_charge(p);               // 补记最近一个 tick 以来的运行时间
+  } else if(MLFQ_WAKE_BOOST) {
+    mlfq_insert(rq, p, 0, 1);     // 旧策略：被唤醒的进程从最高优先级重新开始
+    return;
+  }
+  // 新进程配额为 0，从 0 级开始；被唤醒、抢占或主动让出的进程留在原级别继续消耗
+  // 剩余配额，用满后降一级并重新计配额（最低级只重新计配额）
+  if(p->mlfq_used >= mlfq_allot(p))
+    mlfq_insert(rq, p, p->priority_level + 1, 1);
+  else
+    mlfq_insert(rq, p, p->priority_level, 0);
+}
+
+static void mlfq_dequeue(struct runqueue *rq, struct proc *p)
+{
+  int level = p->rq_level;
+  struct proc *prev = 0;
+  for(struct proc *cur = rq->head[level]; cur; prev = cur, cur = cur->rq_next) {
+    if(cur == p) {
+      mlfq_unlink(rq, p, prev, level);
+      return;
+    }
+  }
+}
+
+static struct proc *mlfq_pick(struct runqueue *rq)
+{
+  if(rq->nonempty == 0)
+    return 0;
+  int level = mlfq_lowest[rq->nonempty];
+  struct proc *p = rq->head[level];
+  mlfq_unlink(rq, p, 0, level);
+  return p;
+}
+
+static struct proc *mlfq_steal(struct runqueue *rq, int cpu)
+{
+  for(int level = 0; level < MLFQ_LEVELS; level++) {
+    struct proc *prev = 0;
+    for(struct proc *cur = rq->head[level]; cur; prev = cur, cur = cur->rq_next) {
+      if(cpu_allowed(cur, cpu)) {
+        mlfq_unlink(rq, cur, prev, level);
+        return cur;
+      }
+    }
+  }
+  return 0;
+}
+
+static void mlfq_tick(struct proc *p, int nticks)
+{
+  p->level_ticks[p->priority_level] += nticks;
+  mlfq_charge(p);
+}
+
+// 剩余配额向上取整到 tick
+static int mlfq_ticks_left(struct proc *p)
+{
+  uint64 allot = mlfq_allot(p);
+  if(p->mlfq_used >= allot)
+    return 1;
+  return (allot - p->mlfq_used + TICK_INTERVAL - 1) / TICK_INTERVAL;
+}
+
+static int mlfq_preempt(struct proc *p, struct proc *curr)
+{
+  return mlfq_eff_level(p) < mlfq_eff_level(curr);
+}
+
+// 检查 rq 低优先级队列中的进程是否等待过久，必要时将其提升一层。
+// 每级队列都从队尾入队且入队时刷新 last_ready_tick，队首总是等待最久的进程，
+// 因此只需检查各级队首：开销为 O(级数 + 本次提升的进程数)，与就绪进程总数无关
+static void mlfq_promote_aged(struct runqueue *rq)
+{
+  uint64 now = ticks;
+  if(rq->aged_tick == now)
+    return;     // 同一个 tick 内已经检查过
+  rq->aged_tick = now;
+
+  for(int level = 1; level < MLFQ_LEVELS; level++) {
+    struct proc *head;
+    while((head = rq->head[level]) != 0 && now - head->last_ready_tick >= MLFQ_AGING_TICKS) {
+      mlfq_unlink(rq, head, 0, level);
+      mlfq_insert(rq, head, level - 1, 1);
+    }
+  }
+}
+
+// ---------------------------------------------------------------- SCHED_FAIR
+
+static int fair_weight(struct proc *p)
+{
+  return fair_weights[p->nice - SCHED_NICE_MIN];
+}
+
+static void fair_enqueue(struct runqueue *rq, struct proc *p, int flags)
+{
+  // 长时间睡眠（或来自其他 hart）的进程不能凭过小的 vruntime 长期独占 CPU，
+  // 最多让它领先当前 min_vruntime 半个时间片
+  uint64 floor = rq->min_vruntime > FAIR_WAKEUP_CREDIT ? rq->min_vruntime - FAIR_WAKEUP_CREDIT : 0;
+  if(p->vruntime < floor)
+    p->vruntime = floor;
+
+  struct proc **pp = &rq->fair_head;
+  while(*pp && (*pp)->vruntime <= p->vruntime)
+    pp = &(*pp)->rq_next;
+  p->rq_next = *pp;
+  *pp = p;
+}
+
+static void fair_dequeue(struct runqueue *rq, struct proc *p)
+{
+  list_remove(&rq->fair_head, p);
+}
+
+static struct proc *fair_pick(struct runqueue *rq)
+{
+  struct proc *p = list_pop(&rq->fair_head);
+  if(p && p->vruntime > rq->min_vruntime)
+    rq->min_vruntime = p->vruntime;
+  return p;
+}
+
+// 被窃取的进程离开本队列，不推进本队列的 min_vruntime
+static struct proc *fair_steal(struct runqueue *rq, int cpu)
+{
+  return list_steal(&rq->fair_head, cpu);
+}
+
+static void fair_tick(struct proc *p, int nticks)
+{
+  p->vruntime += (uint64)nticks * FAIR_VSCALE * 1024 / fair_weight(p);
+  p->ticks_in_level += nticks;
+  if(p->ticks_in_level >= FAIR_SLICE)
+    p->exhausted_slice = 1;
+}
+
+static int fair_ticks_left(struct proc *p)
+{
+  int left = FAIR_SLICE - p->ticks_in_level;
+  return left > 0 ? left : 1;
+}
+
+static int fair_preempt(struct proc *p, struct proc *curr)
+{
+  return 0;   // 吞吐型任务之间不做唤醒抢占，等当前进程用完时间片
+}
+
+// ---------------------------------------------------------------- 通用部分
+
+static const struct sched_class fifo_class = {
+  fifo_enqueue, fifo_dequeue, fifo_pick, fifo_steal, fifo_tick, fifo_ticks_left, fifo_preempt,
+};
+static const struct sched_class mlfq_class = {
+  mlfq_enqueue, mlfq_dequeue, mlfq_pick, mlfq_steal, mlfq_tick, mlfq_ticks_left, mlfq_preempt,
+};
+static const struct sched_class fair_class = {
+  fair_enqueue, fair_dequeue, fair_pick, fair_steal, fair_tick, fair_ticks_left, fair_preempt,
+};
+
+// 按挑选顺序排列的调度类，以及各策略在其中的位置
+static const struct sched_class *const sched_classes[] = { &fifo_class, &mlfq_class, &fair_class };
+#define NSCHED_CLASSES (sizeof(sched_classes) / sizeof(sched_classes[0]))
+static const int policy_rank[] = {
+  [SCHED_FIFO] = 0,
+  [SCHED_MLFQ] = 1,
+  [SCHED_FAIR] = 2,
+};
+
+static const struct sched_class *class_of(struct proc *p)
+{
+  return sched_classes[policy_rank[p->sched_policy]];
+}
+
+// 在持有 rq->lock 的前提下入队
+static void rq_enqueue_locked(struct runqueue *rq, struct proc *p, int flags)
+{
+  class_of(p)->enqueue(rq, p, flags);
+  p->ready_time = get_time();
+  p->last_ready_tick = ticks;
+  p->in_runqueue = 1;
+  p->exhausted_slice = 0;
+  p->rq_cpu = rq - runqueues;
+  rq->nready++;
+}
+
+// 在持有 rq->lock 的前提下把尚未运行的 p 从队列中摘除
+static void rq_dequeue_locked(struct runqueue *rq, struct proc *p)
+{
+  class_of(p)->dequeue(rq, p);
+  p->in_runqueue = 0;
+  rq->nready--;
+}
+
+// 新就绪的 p 是否应抢占 curr：排在前面的调度类总是抢占后面的，同类由调度类决定
+static int should_preempt(struct proc *p, struct proc *curr)
+{
+  int rp = policy_rank[p->sched_policy], rc = policy_rank[curr->sched_policy];
+  if(rp != rc)
+    return rp < rc;
+  return class_of(p)->preempt(p, curr);
+}
+
+// p 入队时应落在哪个 hart：优先 pref（通常是最近运行的 hart，缓存仍是热的），
+// 其次当前 hart，都不允许时取 cpumask 中编号最小的 hart
+static int affine_target(struct proc *p, int pref)
+{
+  if(pref >= 0 && pref < NCPU && cpu_allowed(p, pref))
+    return pref;
+  if(cpu_allowed(p, cpuid()))
+    return cpuid();
+  return ctz64(p->cpumask);
+}
+
+// 初始化各 hart 的运行队列
+// 指标只读出各队列的统计，不持锁，与同时进行的出队之间可能差一两次
+static void metric_switches(struct metric_stat *st)
+{
+  for(int i = 0; i < NCPU; i++)
+    st->value += runqueues[i].nr_switches;
+}
+
+static void metric_nready(struct metric_stat *st)
+{
+  for(int i = 0; i < NCPU; i++)
+    st->value += __atomic_load_n(&runqueues[i].nready, __ATOMIC_RELAXED);
+}
+
+static void metric_latency(struct metric_stat *st)
+{
+  _Static_assert(SCHED_LAT_BUCKETS == METRIC_HIST_BUCKETS, "sched.latency buckets");
+  for(int i = 0; i < NCPU; i++) {
+    st->sum += runqueues[i].lat_total;
+    for(int b = 0; b < SCHED_LAT_BUCKETS; b++)
+      st->buckets[b] += runqueues[i].lat_hist[b];
+  }
+  for(int b = 0; b < SCHED_LAT_BUCKETS; b++)
+    st->value += st->buckets[b];
+}
+
+static struct metric sched_metrics[] = {
+  { .name = "sched.switches", .kind = METRIC_COUNTER, .read = metric_switches },
+  { .name = "sched.nr_ready", .kind = METRIC_GAUGE, .read = metric_nready },
+  { .name = "sched.latency", .kind = METRIC_HIST, .read = metric_latency },
+};
+
+void sched_init(void)
+{
+  initlock(&pi_lock, "sched_pi");
+  for(int i = 0; i < NCPU; i++) {
+    struct runqueue *rq = &runqueues[i];
+    initlock(&rq->lock, "runqueue");
+    rq->nready = 0;
+    rq->fifo_head = 0;
+    for(int level = 0; level < MLFQ_LEVELS; level++) {
+      rq->head[level] = 0;
+      rq->tail[level] = 0;
+    }
+    rq->nonempty = 0;
+    rq->aged_tick = 0;
+    rq->fair_head = 0;
+    rq->min_vruntime = 0;
+    memset(rq->lat_hist, 0, sizeof(rq->lat_hist));
+    rq->lat_total = 0;
+    rq->nr_switches = 0;
+  }
+  METRICS_REGISTER(sched_metrics);
+
+  for(int bits = 1; bits < (1 << MLFQ_LEVELS); bits++) {
+    int level = 0;
+    while(!(bits & (1 << level)))
+      level++;
+    mlfq_lowest[bits] = level;
+  }
+}
+
+// 重置进程的调度字段（进程槽位分配与回收时调用），新进程默认属于 MLFQ
+void sched_proc_init(struct proc *p)
+{
+  p->sched_policy = SCHED_MLFQ;
+  p->rt_priority = 0;
+  p->nice = 0;
+  p->vruntime = 0;
+  p->priority_level = 0;
+  p->rq_level = 0;
+  p->pi_level = -1;
+  p->pi_nlocks = 0;
+  p->ticks_in_level = 0;
+  p->mlfq_used = 0;
+  p->slice_start = 0;
+  p->last_ready_tick = 0;
+  p->exhausted_slice = 0;
+  p->preempt_pending = 0;
+  p->in_runqueue = 0;
+  p->rq_next = 0;
+  p->rq_cpu = -1;
+  p->cpumask = CPUMASK_ALL;
+  p->ready_time = 0;
+  p->run_delay = 0;
+  p->nr_runs = 0;
+  p->nvcsw = 0;
+  p->nivcsw = 0;
+  memset(p->level_ticks, 0, sizeof(p->level_ticks));
+}
+
+// fork/spawn 时子进程继承父进程的调度类与参数
+void sched_fork(struct proc *parent, struct proc *child)
+{
+  child->sched_policy = parent->sched_policy;
+  child->rt_priority = parent->rt_priority;
+  child->nice = parent->nice;
+  child->vruntime = parent->vruntime;
+  child->cpumask = parent->cpumask;
+  child->rq_cpu = parent->rq_cpu;   // 从父进程所在的 hart 开始，共享的页面多半还在其缓存中
+}
+
+// 新建或被唤醒的进程入队：放入其最近运行过的 hart 的队列（不在 cpumask 内时改投允许的 hart），
+// 若该 hart 当前运行的进程应被抢占则请求其尽快让出
+void sched_enqueue(struct proc *p)
+{
+  int target = affine_target(p, p->rq_cpu);
+  struct runqueue *rq = &runqueues[target];
+
+  acquire(&rq->lock);
+  if(p->in_runqueue)
+    panic("sched_enqueue double");
+  rq_enqueue_locked(rq, p, ENQUEUE_WAKEUP);
+
+  struct proc *current = cpus[target].proc;
+  if(current && current != p && current->state == RUNNING && should_preempt(p, current)) {
+    current->preempt_pending = 1;
+    if(target == cpuid())
+      timer_reprogram();   // 时钟可能设在较远的时间片末尾，提前到下一个 tick 以便抢占
+  }
+  release(&rq->lock);
+}
+
+// yield 调用：当前进程回到本 hart 的队列，调用者已关中断。
+// 运行期间 cpumask 被改为不含本 hart 时，改投允许的 hart
+void sched_requeue(struct proc *p)
+{
+  struct runqueue *rq = &runqueues[affine_target(p, cpuid())];
+
+  acquire(&rq->lock);
+  if(p->in_runqueue)
+    panic("yield double enqueue");
+  rq_enqueue_locked(rq, p, ENQUEUE_YIELD);
+  p->preempt_pending = 0;
+  release(&rq->lock);
+}
+
+// 延迟所在的 log2 桶：桶 i 覆盖 [2^i, 2^(i+1))，0 与 1 都落在桶 0
+static int lat_bucket(uint64 delay)
+{
+  int b = 0;
+  while(delay > 1 && b < SCHED_LAT_BUCKETS - 1) {
+    delay >>= 1;
+    b++;
+  }
+  return b;
+}
+
+// 按调度类顺序取出 rq 中下一个将在 hart cpu 上运行的进程，没有合适的进程返回 0。
+// 本地队列中的进程都允许在本 hart 运行，直接 pick；窃取其他队列时只取 cpumask 包含 cpu 的进程
+static struct proc *rq_pick(struct runqueue *rq, int cpu)
+{
+  struct proc *p = 0;
+  int local = rq == &runqueues[cpu];
+
+  acquire(&rq->lock);
+  for(int i = 0; i < NSCHED_CLASSES && p == 0; i++)
+    p = local ? sched_classes[i]->pick(rq) : sched_classes[i]->steal(rq, cpu);
+  if(p) {
+    p->in_runqueue = 0;
+    p->rq_cpu = cpu;   // 记录实际运行的 hart，下次唤醒回到这里
+    rq->nready--;
+    p->ticks_in_level = 0;
+    p->exhausted_slice = 0;
+    p->preempt_pending = 0;
+
+    uint64 now = get_time();
+    p->slice_start = now;
+    uint64 delay = now - p->ready_time;
+    p->run_delay += delay;
+    p->nr_runs++;
+    rq->lat_hist[lat_bucket(delay)]++;
+    rq->lat_total += delay;
+    rq->nr_switches++;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// 选择下一个运行的进程：先取本 hart 的队列，为空时从最忙的其他队列窃取。
+// 挑选最忙队列时不加锁读取 nready，只作提示，真正出队时再持锁确认
+struct proc *sched_pick_next(void)
+{
+  int self = cpuid();
+  struct proc *p = rq_pick(&runqueues[self], self);
+  if(p)
+    return p;
+
+  int victim = -1, most = 0;
+  for(int i = 0; i < NCPU; i++) {
+    if(i != self && runqueues[i].nready > most) {
+      most = runqueues[i].nready;
+      victim = i;
+    }
+  }
+  if(victim < 0)
+    return 0;
+  if((p = rq_pick(&runqueues[victim], self)) != 0)
+    return p;
+
+  // 最忙的队列中没有允许在本 hart 运行的进程时，再依次尝试其他非空队列
+  for(int i = 0; i < NCPU && p == 0; i++) {
+    if(i != self && i != victim && runqueues[i].nready > 0)
+      p = rq_pick(&runqueues[i], self);
+  }
+  return p;
+}
+
+// 空闲轮询用的提示：返回本 hart 队列的就绪数，*remote 为其他队列的就绪数之和。
+// 不持锁读取，只用来决定是否结束轮询，真正挑选仍由 sched_pick_next 完成
+int sched_idle_hint(int *remote)
+{
+  int self = cpuid(), sum = 0;
+  for(int i = 0; i < NCPU; i++) {
+    if(i != self)
+      sum += __atomic_load_n(&runqueues[i].nready, __ATOMIC_RELAXED);
+  }
+  *remote = sum;
+  return __atomic_load_n(&runqueues[self].nready, __ATOMIC_RELAXED);
+}
+
+// 进程停止运行（睡眠）前调用：把不足一个 tick 的运行时间计入 MLFQ 配额
+void sched_charge(struct proc *p)
+{
+  if(p->sched_policy == SCHED_MLFQ)
+    mlfq_charge(p);
+}
+
+// 优先级继承，只在 MLFQ 进程之间进行。
+// 持有多把被等待的锁时，全部释放后才撤销提升；持有者自己又在等其他锁时不继续向下传递
+
+// 等待者 waiter 在 owner 持有的睡眠锁上睡眠前调用（调用者持有该锁的 lk->lk，owner 不会离开）。
+// newlock 表示该锁此前没有提升过 owner。提升了 owner 时返回 1
+int sched_pi_boost(struct proc *owner, struct proc *waiter, int newlock)
+{
+  if(owner->sched_policy != SCHED_MLFQ || waiter->sched_policy != SCHED_MLFQ)
+    return 0;
+
+  acquire(&pi_lock);
+  int level = mlfq_eff_level(waiter);
+  if(level >= mlfq_eff_level(owner)) {
+    release(&pi_lock);
+    return 0;
+  }
+  owner->pi_level = level;
+  if(newlock)
+    owner->pi_nlocks++;
+  release(&pi_lock);
+
+  // 已在就绪队列中的持有者移到提升后的队列，必要时抢占该 hart 上的进程
+  int cpu = owner->rq_cpu;
+  if(owner->in_runqueue && cpu >= 0) {
+    struct runqueue *rq = &runqueues[cpu];
+    acquire(&rq->lock);
+    if(owner->in_runqueue && owner->rq_cpu == cpu && owner->sched_policy == SCHED_MLFQ) {
+      mlfq_dequeue(rq, owner);
+      mlfq_insert(rq, owner, owner->priority_level, 0);
+      struct proc *current = cpus[cpu].proc;
+      if(current && current->state == RUNNING && should_preempt(owner, current))
+        current->preempt_pending = 1;
+    }
+    release(&rq->lock);
+  }
+  return 1;
+}
+
+// 释放一把提升过持有者 p 的睡眠锁时调用。p 通常就是当前进程；已挂在提升后队列中的 p
+// 在下次入队时回到自己的级别
+void sched_pi_unboost(struct proc *p)
+{
+  acquire(&pi_lock);
+  if(p->pi_nlocks > 0 && --p->pi_nlocks == 0)
+    p->pi_level = -1;
+  release(&pi_lock);
+}
+
+// 周期性检查本 hart 的 MLFQ 队列，把等待过久的进程提升一层。
+// 被窃取走的进程会在新 hart 的队列里继续老化，每个 hart 只需照看自己的队列
+void sched_age(void)
+{
+  struct runqueue *rq = &runqueues[cpuid()];
+
+  acquire(&rq->lock);
+  mlfq_promote_aged(rq);
+  release(&rq->lock);
+}
+
+// 时钟中断调用：累计当前进程时间片，并在超时时标记需要抢占。
+// 无滴答模式下两次中断之间可能经过多个 tick，nticks 为本次补记的数量
+void scheduler_tick(int nticks)
+{
+  struct proc *p = mycpu()->proc;
+  if(p == 0 || p->state != RUNNING)
+    return;
+  class_of(p)->tick(p, nticks);
+}
+
+// 当前进程距离需要重新调度还剩多少 tick，用于设置下一次时钟中断；
+// 没有进程运行或当前进程没有时间片（FIFO）时返回 -1。
+// 已用完时间片或有更高优先级进程等待抢占时返回 1，使下一个 tick 照常检查
+int scheduler_ticks_left(void)
+{
+  struct proc *p = mycpu()->proc;
+  if(p == 0 || p->state != RUNNING)
+    return -1;
+  if(p->exhausted_slice || p->preempt_pending)
+    return 1;
+  return class_of(p)->ticks_left(p);
+}
+
+// 查找 pid 对应的存活进程，0 表示当前进程。调用者持有 proc_list_lock，保证进程不会在使用期间被回收
+static struct proc *sched_find(int pid)
+{
+  if(pid == 0)
+    return myproc();
+  struct proc *q = proc_find(pid);
+  if(q && q->state != ZOMBIE)
+    return q;
+  return 0;
+}
+
+// 修改进程 pid（0 表示当前进程）的调度类与参数。参数非法或进程不存在时返回 -1。
+// 就绪的进程立即移到新调度类的队列；正在运行的进程在下一个 tick 按新调度类重新调度
+int sched_setattr(int pid, int policy, int priority)
+{
+  if(policy == SCHED_FIFO) {
+    if(priority < SCHED_FIFO_PRIO_MIN || priority > SCHED_FIFO_PRIO_MAX)
+      return -1;
+  } else if(policy == SCHED_FAIR) {
+    if(priority < SCHED_NICE_MIN || priority > SCHED_NICE_MAX)
+      return -1;
+  } else if(policy != SCHED_MLFQ) {
+    return -1;
+  }
+
+  acquire(&proc_list_lock);
+  struct proc *p = sched_find(pid);
+  if(p == 0) {
+    release(&proc_list_lock);
+    return -1;
+  }
+
+  struct runqueue *rq = 0;
+  if(p->in_runqueue && p->rq_cpu >= 0) {
+    rq = &runqueues[p->rq_cpu];
+    acquire(&rq->lock);
+    if(p->in_runqueue)
+      rq_dequeue_locked(rq, p);
+    else {
+      release(&rq->lock);
+      rq = 0;
+    }
+  }
+
+  p->sched_policy = policy;
+  p->rt_priority = policy == SCHED_FIFO ? priority : 0;
+  p->nice = policy == SCHED_FAIR ? priority : 0;
+
+  if(rq) {
+    rq_enqueue_locked(rq, p, ENQUEUE_WAKEUP);
+    release(&rq->lock);
+  } else if(p->state == RUNNING) {
+    p->preempt_pending = 1;
+  }
+  release(&proc_list_lock);
+  return 0;
+}
+
+// 汇总全局调度延迟直方图，并填入进程 pid（0 表示当前进程）的调度计数。进程不存在时返回 -1。
+// 计数只会增长，读取时不加锁
+int sched_getstat(int pid, struct schedstat *st)
+{
+  acquire(&proc_list_lock);
+  struct proc *p = sched_find(pid);
+  if(p == 0) {
+    release(&proc_list_lock);
+    return -1;
+  }
+
+  memset(st, 0, sizeof(*st));
+  for(int i = 0; i < NCPU; i++) {
+    for(int b = 0; b < SCHED_LAT_BUCKETS; b++)
+      st->lat_hist[b] += runqueues[i].lat_hist[b];
+    st->nr_switches += runqueues[i].nr_switches;
+  }
+
+  st->run_delay = p->run_delay;
+  st->nr_runs = p->nr_runs;
+  st->nvcsw = p->nvcsw;
+  st->nivcsw = p->nivcsw;
+  for(int level = 0; level < MLFQ_LEVELS; level++)
+    st->level_ticks[level] = p->level_ticks[level];
+  release(&proc_list_lock);
+  return 0;
+}
+
+// 设置进程 pid（0 表示当前进程）允许运行的 hart 位图，不存在的 hart 被忽略，
+// 剩余为空或进程不存在时返回 -1。就绪在不允许的 hart 上的进程立即移走；
+// 正在不允许的 hart 上运行的进程在下一个 tick 让出，随后回到允许的 hart
+int sched_setaffinity(int pid, uint64 mask)
+{
+  mask &= CPUMASK_ALL;
+  if(mask == 0)
+    return -1;
+
+  acquire(&proc_list_lock);
+  struct proc *p = sched_find(pid);
+  if(p == 0) {
+    release(&proc_list_lock);
+    return -1;
+  }
+
+  p->cpumask = mask;
+  if(p->in_runqueue && p->rq_cpu >= 0 && !cpu_allowed(p, p->rq_cpu)) {
+    struct runqueue *rq = &runqueues[p->rq_cpu];
+    acquire(&rq->lock);
+    int moved = p->in_runqueue;
+    if(moved)
+      rq_dequeue_locked(rq, p);
+    release(&rq->lock);
+    if(moved)
+      sched_enqueue(p);
+  } else if(p->state == RUNNING && !cpu_allowed(p, p->rq_cpu)) {
+    p->preempt_pending = 1;
+  }
+  release(&proc_list_lock);
+  return 0;
+}
+
+// 读取进程 pid（0 表示当前进程）允许运行的 hart 位图，进程不存在时返回 -1
+int sched_getaffinity(int pid, uint64 *mask)
+{
+  acquire(&proc_list_lock);
+  struct proc *p = sched_find(pid);
+  if(p)
+    *mask = p->cpumask;
+  release(&proc_list_lock);
+  return p ? 0 : -1;
+}
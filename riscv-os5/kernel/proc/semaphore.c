@@ -1,27 +1,133 @@
 #include "types.h"
 #include "semaphore.h"
 #include "proc.h"
+#include "trap.h"
+#include "hrtimer.h"
 
 void sem_init(struct semaphore *sem, int value, char *name)
 {
   initlock(&sem->lock, name);
   sem->value = value;
+  sem->head = 0;
+  sem->tail = 0;
+}
+
+// 在持有 sem->lock 的前提下把 w 挂到等待队列尾部
+static void sem_enqueue(struct semaphore *sem, struct sem_waiter *w)
+{
+  w->next = 0;
+  w->sem = sem;
+  if(sem->tail)
+    sem->tail->next = w;
+  else
+    sem->head = w;
+  sem->tail = w;
+}
+
+// 在持有 sem->lock 的前提下把尚未被 sem_signal 取走的 w 从队列中摘下（超时时调用）
+static void sem_unlink(struct semaphore *sem, struct sem_waiter *w)
+{
+  struct sem_waiter *prev = 0;
+  for(struct sem_waiter *q = sem->head; q; prev = q, q = q->next) {
+    if(q != w)
+      continue;
+    if(prev)
+      prev->next = w->next;
+    else
+      sem->head = w->next;
+    if(sem->tail == w)
+      sem->tail = prev;
+    return;
+  }
+}
+
+// 有余量且没有人排在前面时直接取走一个计数，否则调用者需要排队
+static int sem_trydown(struct semaphore *sem)
+{
+  if(sem->value > 0 && sem->head == 0) {
+    sem->value--;
+    return 1;
+  }
+  return 0;
 }
 
 void sem_wait(struct semaphore *sem)
 {
+  struct sem_waiter w = {0};
+
+  acquire(&sem->lock);
+  if(!sem_trydown(sem)) {
+    sem_enqueue(sem, &w);
+    while(!w.granted)
+      sleep(&w, &sem->lock);   // 以各自的节点为通道，sem_signal 只会唤醒这一个
+  }
+  release(&sem->lock);
+}
+
+// 定时器到期：与 sem_signal 一样在 sem->lock 下修改等待者，避免唤醒丢失
+static void sem_timer_expired(void *arg)
+{
+  struct sem_waiter *w = arg;
+
+  acquire(&w->sem->lock);
+  w->expired = 1;
+  wakeup(w);
+  release(&w->sem->lock);
+}
+
+// sem_timedwait: 与 sem_wait 相同，但最多等待 nticks 个时钟滴答。
+// 获得计数返回 0，超时返回 -1；nticks <= 0 时只尝试一次，不睡眠
+int sem_timedwait(struct semaphore *sem, int nticks)
+{
+  return sem_timedwait_us(sem, nticks > 0 ? (long)nticks * TICK_US : 0);
+}
+
+// sem_timedwait_us: 同 sem_timedwait，超时以微秒计，由 hrtimer 计时
+int sem_timedwait_us(struct semaphore *sem, long us)
+{
+  struct sem_waiter w = {0};
+  struct hrtimer timer = {0};
+  uint64 deadline = get_time() + us_to_time(us > 0 ? us : 0);
+
   acquire(&sem->lock);
-  while (sem->value == 0) {
-    sleep(sem, &sem->lock);
+  if(sem_trydown(sem)) {
+    release(&sem->lock);
+    return 0;
+  }
+  if(us <= 0) {
+    release(&sem->lock);
+    return -1;
+  }
+
+  sem_enqueue(sem, &w);
+  hrtimer_start(&timer, deadline, sem_timer_expired, &w);
+  while(!w.granted && !w.expired)
+    sleep(&w, &sem->lock);
+  if(!w.granted)
+    sem_unlink(sem, &w);
+  // 先拿到计数时定时器仍在队列中；已被摘下则回调可能正在其他 hart 上执行，
+  // 等它置位 expired 后 w 才能出栈
+  if(!hrtimer_cancel(&timer)) {
+    while(!w.expired)
+      sleep(&w, &sem->lock);
   }
-  sem->value--;
   release(&sem->lock);
+  return w.granted ? 0 : -1;
 }
 
+// 有等待者时把计数直接交给队首，否则计数加一
 void sem_signal(struct semaphore *sem)
 {
   acquire(&sem->lock);
-  sem->value++;
-  wakeup(sem);
+  struct sem_waiter *w = sem->head;
+  if(w) {
+    sem->head = w->next;
+    if(sem->head == 0)
+      sem->tail = 0;
+    w->granted = 1;
+    wakeup(w);
+  } else {
+    sem->value++;
+  }
   release(&sem->lock);
 }
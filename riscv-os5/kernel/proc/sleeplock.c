@@ -2,26 +2,71 @@
 #include "proc.h"
 #include "sleeplock.h"
 #include "spinlock.h"
+#include "printf.h"
 
 // 初始化睡眠锁：设置名称，并初始化内部自旋锁
 void initsleeplock(struct sleeplock *lk, char *name)
 {
     lk->name = name;
     lk->locked = 0;
+    lk->readers = 0;
+    lk->writers = 0;
     lk->owner = 0;
+    lk->pi_boosted = 0;
     initlock(&lk->lk, "sleeplock");
+#if LOCKSTAT
+    lk->cls = lockstat_class(name, 1);
+#endif
 }
 
-// 获取睡眠锁：若锁忙，则让当前进程睡眠，避免无谓自旋
+// 持有者仍在运行时最多自旋的轮数，超过后改为睡眠
+#define SLEEPLOCK_SPIN_MAX 1000
+
+// 持有者是否正在另一个 hart 上运行：此时临界区多半很快结束，值得先自旋
+static int owner_running(struct sleeplock *lk)
+{
+    struct proc *owner = *(struct proc * volatile *)&lk->owner;
+    return owner && owner != myproc() && owner->state == RUNNING;
+}
+
+// 获取睡眠锁（自适应）：持有者正在其他 hart 上运行时先短暂自旋等它释放，
+// 省去一次睡眠与唤醒；持有者已睡眠、被换下或自旋超过上限时再让当前进程睡眠。
+// 单 hart 时持有者不可能与等待者同时运行，总是直接睡眠。共享持有者没有记录，直接睡眠
 void acquiresleep(struct sleeplock *lk)
 {
     acquire(&lk->lk);
-    while(lk->locked){
-        sleep(lk, &lk->lk);   // 释放 lk->lk，并挂起当前进程
-        acquire(&lk->lk);     // 被唤醒后重新获取自旋锁检查状态
+    int spun = 0, contended = lk->locked || lk->readers;
+    uint64 spins = 0;
+    while(lk->locked || lk->readers){
+        if(!spun && owner_running(lk)) {
+            spun = 1;
+            release(&lk->lk);
+            for(int i = 0; i < SLEEPLOCK_SPIN_MAX && *(volatile int *)&lk->locked && owner_running(lk); i++) {
+                cpu_relax();
+                spins++;
+            }
+            acquire(&lk->lk);
+            continue;
+        }
+#if LOCKSTAT
+        if(lk->cls)
+            __sync_fetch_and_add(&lk->cls->sleeps, 1);
+#endif
+        // 优先级继承：持有者所在的 MLFQ 级别低于当前进程时，把它临时提到当前进程的级别，
+        // 避免低级别的持有者被中间级别的进程压住、当前进程跟着一起等
+        if(lk->owner && sched_pi_boost(lk->owner, myproc(), !lk->pi_boosted))
+            lk->pi_boosted = 1;
+        lk->writers++;
+        sleep(lk, &lk->lk);   // 释放 lk->lk 并挂起，返回时已重新持有 lk->lk
+        lk->writers--;
+        spun = 0;
     }
     lk->locked = 1;
     lk->owner = myproc();
+#if LOCKSTAT
+    lockstat_acquired(lk->cls, contended, spins);
+    lk->acquired_at = r_time();
+#endif
     release(&lk->lk);
 }
 
@@ -29,12 +74,58 @@ void acquiresleep(struct sleeplock *lk)
 void releasesleep(struct sleeplock *lk)
 {
     acquire(&lk->lk);
+#if LOCKSTAT
+    lockstat_released(lk->cls, r_time() - lk->acquired_at);
+#endif
+    // 先撤销提升再唤醒，被唤醒的高级别等待者入队时即可据此抢占
+    if(lk->pi_boosted) {
+        lk->pi_boosted = 0;
+        sched_pi_unboost(lk->owner);
+    }
     lk->locked = 0;
     lk->owner = 0;
     wakeup(lk);
     release(&lk->lk);
 }
 
+// 共享获取睡眠锁：没有独占持有者时与其他读者同时持有。有写者等待时新的读者先让路，
+// 但已共享持有某把睡眠锁的进程不让（例如读文件时缺页又要读可执行文件），
+// 否则它等写者、写者等它持有的锁，两边都无法前进
+void acquiresleep_shared(struct sleeplock *lk)
+{
+    struct proc *p = myproc();
+
+    acquire(&lk->lk);
+    int contended = lk->locked || lk->writers;
+    while(lk->locked || (lk->writers && !(p && p->shared_locks > 0))) {
+        if(lk->owner && sched_pi_boost(lk->owner, p, !lk->pi_boosted))
+            lk->pi_boosted = 1;
+        sleep(lk, &lk->lk);
+    }
+    lk->readers++;
+    if(p)
+        p->shared_locks++;
+#if LOCKSTAT
+    lockstat_acquired(lk->cls, contended, 0);
+#endif
+    release(&lk->lk);
+}
+
+// 放弃共享持有，最后一个读者离开时唤醒等待的写者
+void releasesleep_shared(struct sleeplock *lk)
+{
+    struct proc *p = myproc();
+
+    acquire(&lk->lk);
+    if(lk->readers < 1)
+        panic("releasesleep_shared");
+    if(--lk->readers == 0)
+        wakeup(lk);
+    if(p)
+        p->shared_locks--;
+    release(&lk->lk);
+}
+
 // 判断当前进程是否持有睡眠锁，仅用于调试断言
 int holdingsleep(struct sleeplock *lk)
 {
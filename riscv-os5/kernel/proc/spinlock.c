@@ -4,76 +4,168 @@
 #include "riscv.h"
 #include "proc.h"
 #include "printf.h"
+#include "atomic.h"
+#include "irqsoff.h"
+
+// 等待者每排后一位，每轮多空转的次数：前面的持有者与等待者越多，重读 serving 的间隔越长，
+// 减少对锁所在缓存行的争抢。按排队位置成比例退避而不是指数退避，
+// 轮到自己时最多多等一个间隔，不会像指数退避那样打乱票号的先后顺序
+#define SPIN_BACKOFF_UNIT 16
 
 // 初始化锁
 void initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;    // 锁的名称（调试用）
-  lk->locked = 0;     // 锁状态：0-未锁定，1-已锁定
+  lk->next = 0;
+  lk->serving = 0;
+  lk->cpu = 0;
+#if LOCKSTAT
+  lk->cls = lockstat_class(name, 0);
+#endif
 }
 
-// 循环自旋直到获得锁
+static void push_off_ra(uint64 ra);
+static void pop_off_ra(uint64 ra);
+
+// 领取票号并自旋直到轮到自己
 void acquire(struct spinlock *lk)
 {
-  push_off(); // 禁用中断，避免死锁
+  push_off_ra((uint64)__builtin_return_address(0)); // 禁用中断，避免死锁
   if(holding(lk)){
     printf("panic: acquire, lock name=%s\n", lk->name);
     panic("acquire");
   }
 
-  // RISC-V原子交换操作：将lk->locked设为1，返回原值
-  // 如果原值为1（已锁定），则循环等待
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  // 原子地取号，票号回绕不影响相等比较与差值计算。取号本身不需要排序，
+  // 临界区的顺序由下面读到 serving 后的获取屏障保证
+  uint ticket = atomic_fetch_add(&lk->next, 1);
+  uint64 spins = 0;
+  for(;;) {
+    uint cur = *(volatile uint *)&lk->serving;
+    if(cur == ticket)
+      break;
+    spins++;
+    for(uint i = (ticket - cur) * SPIN_BACKOFF_UNIT; i > 0; i--)
+      cpu_relax();
+  }
 
-  // 内存屏障：确保临界区内存访问在获得锁之后执行
-  __sync_synchronize();
+  // 获取屏障：临界区内的访存不会提前到读到 serving 之前
+  smp_acquire();
+  lk->cpu = mycpu();
+#if LOCKSTAT
+  lockstat_acquired(lk->cls, spins > 0, spins);
+  lk->acquired_at = r_time();
+#endif
 }
 
-// 释放锁
+// 释放锁：把 serving 推进到下一张票号
 void release(struct spinlock *lk)
 {
   if(!holding(lk))
     panic("release");
 
-  // 内存屏障：确保临界区所有存储操作在释放锁前对其他CPU可见
-  __sync_synchronize();
+  lk->cpu = 0;
+#if LOCKSTAT
+  lockstat_released(lk->cls, r_time() - lk->acquired_at);
+#endif
 
-  // 原子释放锁，相当于lk->locked = 0
-  __sync_lock_release(&lk->locked);
+  // 只有持有者会修改 serving，带释放语义的普通写入即可：
+  // 临界区内的访存都在下一个持有者看到新 serving 之前完成
+  store_release(&lk->serving, lk->serving + 1);
 
-  pop_off();
+  pop_off_ra((uint64)__builtin_return_address(0));
 }
 
-// 检查当前是否持有该锁
+// 检查当前 hart 是否持有该锁
 // 必须在中断禁用状态下调用
 int holding(struct spinlock *lk)
 {
-  return lk->locked;
+  return lk->next != lk->serving && lk->cpu == mycpu();
 }
 
 // push_off/pop_off用于管理中断禁用状态的嵌套
 // 多个push_off需要相同数量的pop_off来恢复
 // 如果初始时中断已禁用，push_off/pop_off后仍保持禁用
 
-void push_off(void)
+// ra 为关中断的调用者，经 acquire/release 进入时记录锁的使用者而不是 acquire 本身
+static void push_off_ra(uint64 ra)
 {
   int old = intr_get();  // 保存当前中断状态
 
   intr_off();  // 禁用中断
 
-  if(mycpu()->noff == 0)
+  if(mycpu()->noff == 0) {
     mycpu()->intena = old;  // 记录初始中断使能状态
+#if IRQSOFF_TRACE
+    if(old) {
+      mycpu()->irqsoff_start = r_time();
+      mycpu()->irqsoff_ra = ra;
+    }
+#endif
+  }
   mycpu()->noff += 1;       // 增加嵌套深度
 }
 
-void pop_off(void)
+static void pop_off_ra(uint64 ra)
 {
   if(intr_get())
     panic("pop_off - interruptible");
   if(mycpu()->noff < 1)
     panic("pop_off");
   mycpu()->noff -= 1;  // 减少嵌套深度
-  if(mycpu()->noff == 0 && mycpu()->intena)
+  if(mycpu()->noff == 0 && mycpu()->intena) {
+#if IRQSOFF_TRACE
+    struct cpu *c = mycpu();
+    irqsoff_record(r_time() - c->irqsoff_start, c->irqsoff_ra, ra);
+#endif
+    // 放开最后一把自旋锁时若有更高优先级的进程在等（常见于刚唤醒了它），立即让出，
+    // 不必等到下一次时钟中断或返回用户态
+    preempt_point();
     intr_on();   // 如果回到最外层且原本中断使能，则重新启用中断
+  }
+}
+
+// 内核抢占点：当前进程被要求让出（时间片用完或有更高优先级进程就绪）、且不在
+// preempt_disable 区间与中断处理函数中时调用 yield。调用者已关中断，且没有持有自旋锁
+// （所有中断开着的位置本来就可能被时钟中断切走，在这里让出不会引入新的交错）。
+// 调度器自身运行时 c->proc 为 0，不会在这里让出。返回是否让出过
+int preempt_point(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *p = c->proc;
+
+  if(c->preempt_count || c->nested_level || p == 0 || p->state != RUNNING ||
+     !(p->exhausted_slice || p->preempt_pending))
+    return 0;
+  c->preempt_count++;   // yield 内部的 push_off/pop_off 不再递归进入这里
+  yield();
+  intr_off();           // yield 返回时开着中断；可能已换到别的 hart，计数随上下文恢复
+  mycpu()->preempt_count--;
+  return 1;
+}
+
+void preempt_disable(void)
+{
+  push_off();
+  mycpu()->preempt_count++;
+  pop_off();
+}
+
+void preempt_enable(void)
+{
+  push_off();
+  if(mycpu()->preempt_count < 1)
+    panic("preempt_enable");
+  mycpu()->preempt_count--;
+  pop_off();   // 计数回到 0 且中断将重新打开时在这里检查抢占
+}
+
+void push_off(void)
+{
+  push_off_ra((uint64)__builtin_return_address(0));
+}
+
+void pop_off(void)
+{
+  pop_off_ra((uint64)__builtin_return_address(0));
 }
\ No newline at end of file
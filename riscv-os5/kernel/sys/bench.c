@@ -0,0 +1,225 @@
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "semaphore.h"
+#include "proc.h"
+#include "kalloc.h"
+#include "vm.h"
+#include "buf.h"
+#include "fs.h"
+#include "string.h"
+#include "printf.h"
+#include "bench.h"
+
+// bench.c: 内核微基准的运行框架与常用路径的基准。基准描述由 BENCH 放入 benchtab 段，
+// 链接脚本导出段的起止地址，其他文件同样可以就近定义自己的基准。
+// 运行期间持有 bench_lock，同一时刻只有一个调用者，基准可以使用静态状态。
+
+extern const struct bench _bench_start[], _bench_end[];
+
+#define BENCH_TOTAL (BENCH_WARMUP + BENCH_ITERS)
+
+static struct sleeplock bench_lock;
+
+void bench_init(void)
+{
+    initsleeplock(&bench_lock, "bench");
+}
+
+// 插入排序：样本只有 BENCH_ITERS 个
+static void sort_samples(uint64 *s, int n)
+{
+    for(int i = 1; i < n; i++) {
+        uint64 v = s[i];
+        int j = i;
+        for(; j > 0 && s[j - 1] > v; j--)
+            s[j] = s[j - 1];
+        s[j] = v;
+    }
+}
+
+static int bench_one(const struct bench *b, uint64 *samples, struct bench_result *r)
+{
+    if(b->setup && b->setup(BENCH_TOTAL) < 0)
+        return -1;
+    for(int i = 0; i < BENCH_TOTAL; i++) {
+        uint64 start = r_cycle();
+        b->run(i);
+        uint64 t = r_cycle() - start;
+        if(i >= BENCH_WARMUP)
+            samples[i - BENCH_WARMUP] = t;
+        if(b->reset)
+            b->reset(i);
+    }
+    if(b->teardown)
+        b->teardown();
+
+    sort_samples(samples, BENCH_ITERS);
+    safestrcpy(r->name, b->name, sizeof(r->name));
+    r->iters = BENCH_ITERS;
+    r->min = samples[0];
+    r->median = samples[BENCH_ITERS / 2];
+    r->p99 = samples[BENCH_ITERS * 99 / 100];
+    r->max = samples[BENCH_ITERS - 1];
+    return 0;
+}
+
+int bench_run(const char *name, struct bench_result *res, int max)
+{
+    uint64 *samples = alloc_page_nozero();
+    int n = 0;
+
+    if(samples == 0)
+        return 0;
+    acquiresleep(&bench_lock);
+    for(const struct bench *b = _bench_start; b < _bench_end && n < max; b++) {
+        if(name && name[0] && memcmp(name, b->name, strlen(b->name) + 1) != 0)
+            continue;
+        if(bench_one(b, samples, &res[n]) == 0)
+            n++;
+        else
+            printf("[bench] name=%s skipped\n", b->name);
+    }
+    releasesleep(&bench_lock);
+    free_page(samples);
+    return n;
+}
+
+void bench_report(const struct bench_result *r)
+{
+    printf(BENCH_REPORT_FMT, r->name, r->iters, r->min, r->median, r->p99, r->max);
+}
+
+// ========== alloc_page：每次分配后立即释放，测量每 hart 缓存上的快速路径 ==========
+
+static void *bench_page;
+
+static void alloc_page_run(int i)
+{
+    bench_page = alloc_page();
+}
+
+static void alloc_page_reset(int i)
+{
+    if(bench_page)
+        free_page(bench_page);
+}
+
+BENCH(alloc_page, .run = alloc_page_run, .reset = alloc_page_reset);
+
+// ========== bread：反复读同一块（命中），与逐块读入后立即作废（未命中） ==========
+
+static uint bench_block;
+static struct buf *bench_buf;
+
+static int bread_hit_setup(int n)
+{
+    bench_block = 1;   // 超级块
+    brelse(bread(ROOTDEV, bench_block));
+    return 0;
+}
+
+static void bread_hit_run(int i)
+{
+    brelse(bread(ROOTDEV, bench_block));
+}
+
+BENCH(bread_hit, .setup = bread_hit_setup, .run = bread_hit_run);
+
+// 使用磁盘末尾的 n 个块：作废未修改的块只会让下次读取重新访问磁盘
+static int bread_miss_setup(int n)
+{
+    const struct superblock *sb = fs_superblock();
+    if(sb->size < (uint)n + SB_DATASTART(*sb))
+        return -1;
+    bench_block = sb->size - n;
+    return 0;
+}
+
+static void bread_miss_run(int i)
+{
+    bench_buf = bread(ROOTDEV, bench_block + i);
+}
+
+static void bread_miss_reset(int i)
+{
+    binvalidate(bench_buf);
+    brelse(bench_buf);
+}
+
+BENCH(bread_miss, .setup = bread_miss_setup, .run = bread_miss_run, .reset = bread_miss_reset);
+
+// ========== cow_fault：父页表分配 n 页后复制给子页表，每次迭代对子页表的一页做写时复制 ==========
+
+static pagetable_t cow_parent, cow_child;
+
+static void cow_teardown(void)
+{
+    destroy_pagetable(cow_child);
+    destroy_pagetable(cow_parent);
+    cow_child = cow_parent = 0;
+}
+
+static int cow_setup(int n)
+{
+    uint64 sz = (uint64)n * PGSIZE;
+
+    cow_parent = create_pagetable();
+    cow_child = create_pagetable();
+    if(cow_parent == 0 || cow_child == 0 || uvmalloc(cow_parent, 0, sz) != sz ||
+       uvmcopy(cow_parent, cow_child, sz) < 0) {
+        cow_teardown();
+        return -1;
+    }
+    return 0;
+}
+
+static void cow_fault_run(int i)
+{
+    if(cow_resolve(cow_child, (uint64)i * PGSIZE) < 0)
+        panic("bench cow_fault: cow_resolve");
+}
+
+BENCH(cow_fault, .setup = cow_setup, .run = cow_fault_run, .teardown = cow_teardown);
+
+// ========== ctxsw：与内核线程经两个信号量往返一次，包含两次唤醒与两次上下文切换 ==========
+
+static struct semaphore ping, pong;
+static volatile int pong_stop;
+static int pong_pid;
+
+static void pong_thread(void *arg)
+{
+    for(;;) {
+        sem_wait(&ping);
+        if(pong_stop)
+            break;
+        sem_signal(&pong);
+    }
+}
+
+static int ctxsw_setup(int n)
+{
+    sem_init(&ping, 0, "bench_ping");
+    sem_init(&pong, 0, "bench_pong");
+    pong_stop = 0;
+    if((pong_pid = kthread_create(pong_thread, 0, "bench_pong")) < 0)
+        return -1;
+    return 0;
+}
+
+static void ctxsw_run(int i)
+{
+    sem_signal(&ping);
+    sem_wait(&pong);
+}
+
+static void ctxsw_teardown(void)
+{
+    pong_stop = 1;
+    sem_signal(&ping);
+    waitpid_process(pong_pid, 0, 0);
+}
+
+BENCH(ctxsw, .setup = ctxsw_setup, .run = ctxsw_run, .teardown = ctxsw_teardown);
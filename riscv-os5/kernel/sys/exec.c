@@ -12,9 +12,142 @@
 #include "string.h"
 #include "printf.h"
 #include "klog.h"
+#include "trace.h"
+#include "kalloc.h"
+#include "sleeplock.h"
+
+// 解析后的 ELF 镜像缓存：按 (dev, inum) 保存已校验的文件头与 LOAD 段，重复 exec 同一程序时
+// 不再读取、校验程序头。文件被写入或截断时由 fs.c 调用 exec_cache_invalidate 作废
+#define EXEC_CACHE_SLOTS 16
+#define EXEC_MAXLOAD     4    // 缓存的 LOAD 段上限，更多的程序照常解析但不缓存
+
+// 程序段按需加载：缺页时顺带读入同一 EXEC_FAULT_AROUND 页对齐簇内尚未映射的文件页，
+// 顺序执行的代码不必每页陷入一次
+#define EXEC_FAULT_AROUND 8
+
+struct exec_image {
+  uint32 dev;
+  uint32 inum;              // 0 表示空槽
+  uint32 size;              // 解析时的文件长度
+  uint64 entry;
+  int nload;
+  struct proghdr load[EXEC_MAXLOAD];
+  uint64 stamp;             // 最近使用时间，满时淘汰最旧的槽
+};
+
+static struct {
+  struct spinlock lock;
+  uint64 clock;
+  struct exec_image slot[EXEC_CACHE_SLOTS];
+} ecache;
 
 // 静态函数声明
 static int loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz);
+static uint64 mapseg_shared(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz, int perm);
+
+void exec_cache_init(void)
+{
+  initlock(&ecache.lock, "execcache");
+}
+
+// 查找 ip 的解析结果并拷贝到 im，命中返回 0
+static int exec_cache_get(struct inode *ip, struct exec_image *im)
+{
+  int ret = -1;
+  acquire(&ecache.lock);
+  for(int i = 0; i < EXEC_CACHE_SLOTS; i++){
+    struct exec_image *e = &ecache.slot[i];
+    if(e->inum == ip->inum && e->dev == ip->dev && e->size == ip->size){
+      e->stamp = ++ecache.clock;
+      *im = *e;
+      ret = 0;
+      break;
+    }
+  }
+  release(&ecache.lock);
+  return ret;
+}
+
+static void exec_cache_put(struct exec_image *im)
+{
+  acquire(&ecache.lock);
+  struct exec_image *victim = &ecache.slot[0];
+  for(int i = 0; i < EXEC_CACHE_SLOTS; i++){
+    struct exec_image *e = &ecache.slot[i];
+    if(e->inum == im->inum && e->dev == im->dev){
+      victim = e;
+      break;
+    }
+    if(e->stamp < victim->stamp)
+      victim = e;
+  }
+  *victim = *im;
+  victim->stamp = ++ecache.clock;
+  release(&ecache.lock);
+}
+
+// exec_cache_invalidate: 普通文件内容改变时作废其解析结果
+void exec_cache_invalidate(uint32 dev, uint32 inum)
+{
+  acquire(&ecache.lock);
+  for(int i = 0; i < EXEC_CACHE_SLOTS; i++){
+    struct exec_image *e = &ecache.slot[i];
+    if(e->inum == inum && e->dev == dev)
+      e->inum = 0;
+  }
+  release(&ecache.lock);
+}
+
+// 读取并校验 ELF 文件头与 LOAD 段，结果存入 im。段过多时返回 1（不可缓存，
+// 由调用者逐个读取程序头），校验失败返回 -1 并设置 *reason。调用者持有 ip 的锁
+static int exec_parse(struct inode *ip, struct elfhdr *elf, struct exec_image *im, const char **reason)
+{
+  struct proghdr ph;
+
+  if(readi(ip, 0, (uint64)elf, 0, sizeof(*elf)) != sizeof(*elf)) {
+    *reason = "读取ELF头失败";
+    return -1;
+  }
+  // 检查ELF魔数，确认是有效的ELF文件
+  if(elf->magic != ELF_MAGIC) {
+    *reason = "ELF 魔数无效";
+    return -1;
+  }
+
+  im->dev = ip->dev;
+  im->inum = ip->inum;
+  im->size = ip->size;
+  im->entry = elf->entry;
+  im->nload = 0;
+  for(uint64 i = 0, off = elf->phoff; i < elf->phnum; i++, off += sizeof(ph)){
+    if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph)) {
+      *reason = "读取程序段头失败";
+      return -1;
+    }
+    // 只处理LOAD类型的段（需要加载到内存的段）
+    if(ph.type != PT_LOAD)
+      continue;
+    // 参数检查：内存大小不能小于文件大小
+    if(ph.memsz < ph.filesz) {
+      *reason = "程序段 memsz 小于 filesz";
+      return -1;
+    }
+    // 地址溢出检查
+    if(ph.vaddr + ph.memsz < ph.vaddr) {
+      *reason = "程序段虚拟地址溢出";
+      return -1;
+    }
+    // 虚拟地址必须页面对齐
+    if(ph.vaddr % PGSIZE != 0) {
+      *reason = "程序段虚拟地址未对齐";
+      return -1;
+    }
+    if(im->nload < EXEC_MAXLOAD)
+      im->load[im->nload] = ph;
+    im->nload++;
+  }
+  return im->nload > EXEC_MAXLOAD;
+}
 
 /*
  * 将ELF段标志转换为页表权限位
@@ -45,6 +178,20 @@ int flags2perm(int flags)
  * 返回值：成功时不返回（跳转到用户程序），失败返回-1
  */
 int kernel_exec(char *path, char **argv)
+{
+  struct proc *p = myproc();
+  // 其他线程仍在使用当前页表与陷阱帧槽位，多线程进程暂不支持 exec
+  if(p->tg_leader || p->tg_nthreads)
+    return -1;
+  return exec_into(p, path, argv);
+}
+
+/*
+ * 为进程 p 加载可执行文件并替换其地址空间。p 可以是当前进程（exec），
+ * 也可以是尚未运行的新进程（spawn，此时 p 还没有用户页表）。
+ * 路径按当前进程的工作目录解析。成功返回 argc，失败返回 -1 且不修改 p。
+ */
+int exec_into(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i;
@@ -52,14 +199,17 @@ int kernel_exec(char *path, char **argv)
   uint64 argc, sz = 0, sp;
   uint64 ustack[MAXARG];  // 用户栈参数数组
   struct elfhdr elf;      // ELF文件头
+  struct exec_image im;   // 校验过的入口与 LOAD 段
   struct inode *ip;       // 文件inode
   struct proghdr ph;      // 程序头
+  int many = 0;           // LOAD 段超出缓存容量，需逐个重读程序头
   pagetable_t pagetable = 0;  // 新页表
-  struct proc *p = myproc();  // 当前进程
+  struct lazy_region lazy[NLAZY];  // 新镜像中按需加载的程序段
+  int nlazy = 0;
+  struct vma ulib_vma[2];     // 共享运行库的代码段与数据段
   const char *fail_reason = "unknown";
 
-  klog_info("exec: pid=%d 请求加载 %s", p->pid, path);
-  begin_transaction();
+  begin_transaction_blocks(ifree_log_blocks());   // 只读镜像，仅可能因 iput 写日志
 
   // 步骤1: 打开并锁定可执行文件
   if((ip = namei(path)) == 0){
@@ -67,18 +217,14 @@ int kernel_exec(char *path, char **argv)
     klog_warn("exec: pid=%d 找不到文件 %s", p->pid, path);
     return -1;  // 文件不存在
   }
-  ilock(ip);
-
-  // 步骤2: 读取并验证ELF文件头
-  if(readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf)) {
-    fail_reason = "读取ELF头失败";
-    goto bad;  // 读取ELF头失败
-  }
+  ilock_shared(ip);   // 只读取镜像，多个进程可同时 exec 同一个程序
 
-  // 检查ELF魔数，确认是有效的ELF文件
-  if(elf.magic != ELF_MAGIC) {
-    fail_reason = "ELF 魔数无效";
-    goto bad;  // 不是有效的ELF文件
+  // 步骤2: 取得校验过的ELF文件头与程序段，优先使用解析缓存
+  if(exec_cache_get(ip, &im) < 0) {
+    if((many = exec_parse(ip, &elf, &im, &fail_reason)) < 0)
+      goto bad;
+    if(!many)
+      exec_cache_put(&im);
   }
 
   // 步骤3: 创建新的进程页表
@@ -87,38 +233,47 @@ int kernel_exec(char *path, char **argv)
     goto bad;  // 页表创建失败
   }
 
-  // 步骤4: 加载所有程序段到内存
-  for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
-    // 读取程序头
-    if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph)) {
+  // 步骤4: 加载所有程序段到内存。段数超出缓存容量时按原样逐个读取程序头（exec_parse 已校验过）
+  for(i = 0, off = many ? elf.phoff : 0; i < (many ? elf.phnum : im.nload); i++, off += sizeof(ph)){
+    if(!many)
+      ph = im.load[i];
+    else if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph)) {
       fail_reason = "读取程序段头失败";
       goto bad;
-    }
-    // 只处理LOAD类型的段（需要加载到内存的段）
-    if(ph.type != PT_LOAD)
+    } else if(ph.type != PT_LOAD)
+      continue;
+    uint64 seg_end = ph.vaddr + ph.memsz;
+#if LAZY_ALLOC
+    // 只记下段与文件位置的对应关系，页在首次访问时由 exec_fault 读入（或映射页缓存页）
+    if(nlazy < NLAZY) {
+      lazy[nlazy].start = ph.vaddr;
+      lazy[nlazy].end = PGROUNDUP(seg_end);
+      lazy[nlazy].perm = flags2perm(ph.flags);
+      lazy[nlazy].ip = ph.filesz ? idup(ip) : 0;
+      lazy[nlazy].off = ph.off;
+      lazy[nlazy].filesz = ph.filesz;
+      nlazy++;
+      if(seg_end > sz)
+        sz = seg_end;
       continue;
-    // 参数检查：内存大小不能小于文件大小
-    if(ph.memsz < ph.filesz) {
-      fail_reason = "程序段 memsz 小于 filesz";
-      goto bad;
-    }
-    // 地址溢出检查  
-    if(ph.vaddr + ph.memsz < ph.vaddr) {
-      fail_reason = "程序段虚拟地址溢出";
-      goto bad;
     }
-    // 虚拟地址必须页面对齐
-    if(ph.vaddr % PGSIZE != 0) {
-      fail_reason = "程序段虚拟地址未对齐";
-      goto bad;
+#endif
+    // 区间用完时照原样立即加载。
+    // 只读段中完整落在文件内容里的页直接映射页缓存页，由各进程共享
+    if(!(ph.flags & 0x2) && ph.vaddr == sz && ph.off % PGSIZE == 0) {
+      sz = mapseg_shared(pagetable, ph.vaddr, ip, ph.off, ph.filesz, flags2perm(ph.flags));
+      uint64 done = sz - ph.vaddr;
+      ph.vaddr = sz;
+      ph.off += done;
+      ph.filesz -= done;
+      ph.memsz -= done;
     }
     // 为当前段分配虚拟内存空间
-    uint64 newsz;
-    if((newsz = uvmalloc_perm(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0) {
+    if(seg_end > sz &&
+       (sz = uvmalloc_perm(pagetable, sz, seg_end, flags2perm(ph.flags))) == 0) {
       fail_reason = "为程序段分配内存失败";
       goto bad;
     }
-    sz = newsz;
     // 将段内容从文件加载到内存
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0) {
       fail_reason = "加载程序段数据失败";
@@ -126,13 +281,11 @@ int kernel_exec(char *path, char **argv)
     }
   }
   // 文件加载完成，释放文件锁和inode
-  iunlockput(ip);
+  iunlock_shared(ip);
+  iput(ip);
   end_transaction();
   ip = 0;
 
-  // 重新获取当前进程指针（防止在加载过程中被切换）
-  p = myproc();
-
   // 步骤5: 设置用户栈
   // 将当前大小向上取整到页面边界
   sz = PGROUNDUP(sz);
@@ -141,6 +294,10 @@ int kernel_exec(char *path, char **argv)
   // 假设用户栈大小为1个页面，保护页面1个，共2个页面
   uint64 stacksize = 2 * PGSIZE;  // 1个栈页面 + 1个保护页面
   uint64 newsz;
+  if(sz + stacksize > ULIB_TEXT) {
+    fail_reason = "程序映像与共享运行库的地址重叠";
+    goto bad;
+  }
   if((newsz = uvmalloc_perm(pagetable, sz, sz + stacksize, PTE_R | PTE_W | PTE_U)) == 0) {
     fail_reason = "分配用户栈失败";
     goto bad;
@@ -160,6 +317,12 @@ int kernel_exec(char *path, char **argv)
   
   sp = stackbottom;  // 初始栈指针指向栈底部
 
+  // 映射共享运行库：只增加引用，不拷贝
+  if(ulib_map(pagetable, ulib_vma) < 0) {
+    fail_reason = "映射共享运行库失败";
+    goto bad;
+  }
+
   // 步骤6: 将命令行参数拷贝到用户栈
   for(argc = 0; argv[argc]; argc++) {
     if(argc >= MAXARG) {
@@ -215,27 +378,43 @@ int kernel_exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // 步骤9: 提交新的用户镜像
+  mmap_release(p);  // 旧镜像的 mmap 映射区不保留到新程序
+  p->vma[0] = ulib_vma[0];
+  p->vma[1] = ulib_vma[1];
   pagetable_t oldpagetable = p->pagetable;  // 保存旧页表
   p->pagetable = pagetable;  // 切换为新页表
   p->sz = sz;  // 更新进程大小
+  p->heap_base = sz;  // 之后 sbrk 扩展的部分均为堆
+  tlb_reset(p);  // 换用新页表，旧镜像在本 ASID 下的 TLB 条目与转换缓存全部作废
+  exec_lazy_release(p);
+  p->nlazy = nlazy;
+  for(i = 0; i < nlazy; i++)
+    p->lazy[i] = lazy[i];
+  fpu_release(p);  // 新程序从未用过浮点，首次使用时重新启用
+  p->uring = 0;    // 提交环位于旧地址空间
   
   // 设置程序计数器和栈指针
-  p->trapframe->epc = elf.entry;  // 程序入口地址（通常是main函数）
+  p->trapframe->epc = im.entry;   // 程序入口地址（通常是main函数）
   p->trapframe->sp = sp;         // 用户栈指针
   
   // 释放旧页表和地址空间
-  proc_freepagetable(oldpagetable);
+  if(oldpagetable)
+    proc_freepagetable(oldpagetable);
 
   // 返回argc（在RISC-V中通过a0寄存器返回）
-  klog_info("exec: pid=%d 成功加载 %s, argc=%d", p->pid, last, (int)argc);
+  TRACE(EXEC, p->pid, argc);
   return argc;  
 
 // 错误处理标签
 bad:
+  for(i = 0; i < nlazy; i++)
+    if(lazy[i].ip)
+      iput(lazy[i].ip);   // 调用者仍持有 ip 的引用，这里只是计数减一
   if(pagetable)
     proc_freepagetable(pagetable);  // 释放新建的页表
   if(ip){
-    iunlockput(ip);  // 释放文件锁和inode
+    iunlock_shared(ip);  // 释放文件锁和inode
+    iput(ip);
     end_transaction();
   }
   klog_error("exec: pid=%d 加载 %s 失败: %s", p->pid, path, fail_reason);
@@ -280,6 +459,119 @@ loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz
   return 0;
 }
 
+/*
+ * 将只读段 [va, va+sz) 中整页落在文件内容里的部分直接映射到页缓存页，不分配、不拷贝。
+ * 每个映射持有一次页引用（ipage_map），随页表释放归还；页缓存页与文件内容保持一致，
+ * 段中剩余的尾页与 BSS 由调用者照常分配并读入。
+ * 返回已映射部分的结束地址；页缓存不可用或映射失败时提前停止
+ */
+static uint64
+mapseg_shared(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz, int perm)
+{
+  uint64 i;
+
+  for(i = 0; i + PGSIZE <= sz; i += PGSIZE){
+    void *pa = ipage_map(ip, (offset + i) / PGSIZE);
+    if(pa == 0)
+      break;
+    if(map_page(pagetable, va + i, (uint64)pa, perm) < 0){
+      free_page(pa);
+      break;
+    }
+  }
+  return va + i;
+}
+
+// 把区间 r 中 va 所在的文件页映射进 pagetable：只读的整页直接映射页缓存页，
+// 其余（可写页、文件内容的尾页）分配新页读入，超出 filesz 的部分保持为零。调用者持有 ip 的锁
+static int
+exec_fault_page(pagetable_t pagetable, struct lazy_region *r, uint64 va)
+{
+  uint64 off = r->off + (va - r->start);
+  uint64 n = r->start + r->filesz - va;
+  void *mem = 0;
+
+  if(n > PGSIZE)
+    n = PGSIZE;
+  if(!(r->perm & PTE_W) && n == PGSIZE && off % PGSIZE == 0)
+    mem = ipage_map(r->ip, off / PGSIZE);
+  if(mem == 0){
+    if((mem = alloc_page()) == 0)
+      return -1;
+    if(readi(r->ip, 0, (uint64)mem, off, n) != n){
+      free_page(mem);
+      return -1;   // 可执行文件在运行期间被截断
+    }
+  }
+  if(map_page(pagetable, va, (uint64)mem, r->perm | PTE_U) < 0){
+    free_page(mem);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * exec_fault: 按需加载区间 r 中的缺页 va0（尚未映射）。
+ * va0 不含文件内容时返回 1，由调用者分配清零页；成功返回 0，失败返回 -1。
+ * 成功后再尽力补上同一簇内、仍在文件内容范围中的其他未映射页。
+ * copyin/copyout 可能在 readi 持有同一可执行文件的锁时缺页，此时不再加锁
+ */
+int
+exec_fault(struct proc *p, struct lazy_region *r, uint64 va0)
+{
+  uint64 fend = PGROUNDUP(r->start + r->filesz);
+  if(va0 >= fend)
+    return 1;
+
+  // 独占持有时（写入该文件时从用户缓冲区缺页）直接读；已共享持有时再次共享加锁不会等写者
+  int locked = holdingsleep(&r->ip->lock);
+  if(!locked)
+    ilock_shared(r->ip);
+  // 近旁页顺带读入，不单独计数
+  int cached = ipage_cached(r->ip, (r->off + (va0 - r->start)) / PGSIZE);
+  int ret = exec_fault_page(p->pagetable, r, va0);
+  if(ret == 0){
+    fault_note(cached ? FAULT_MINOR : FAULT_MAJOR);
+    uint64 lo = va0 & ~((uint64)EXEC_FAULT_AROUND * PGSIZE - 1);
+    uint64 hi = lo + (uint64)EXEC_FAULT_AROUND * PGSIZE;
+    if(lo < r->start)
+      lo = r->start;
+    if(hi > fend)
+      hi = fend;
+    for(uint64 va = lo; va < hi; va += PGSIZE){
+      pte_t *pte = walk_lookup(p->pagetable, va);
+      if(va == va0 || (pte && (*pte & PTE_V)))
+        continue;
+      if(exec_fault_page(p->pagetable, r, va) < 0)
+        break;
+    }
+  }
+  if(!locked)
+    iunlock_shared(r->ip);
+  return ret;
+}
+
+// exec_lazy_dup: fork 整体复制区间后调用，子进程的每个文件区间各持有一次引用
+void
+exec_lazy_dup(struct proc *np)
+{
+  for(int i = 0; i < np->nlazy; i++)
+    if(np->lazy[i].ip)
+      idup(np->lazy[i].ip);
+}
+
+// exec_lazy_release: 旧镜像被替换或进程回收时放弃区间的文件引用
+void
+exec_lazy_release(struct proc *p)
+{
+  for(int i = 0; i < p->nlazy; i++){
+    if(p->lazy[i].ip)
+      iput(p->lazy[i].ip);
+    p->lazy[i].ip = 0;
+  }
+  p->nlazy = 0;
+}
+
 /*
  * 通过页表查找虚拟地址对应的物理地址
  * 参数：
@@ -296,13 +588,14 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if(va >= MAXVA)
     return 0;
 
-  pte = walk_lookup(pagetable, va);
+  int level;
+  pte = walk_lookup_level(pagetable, va, &level);
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = LEAF_PA(*pte, va, level);
   return pa;
 }
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include "string.h"
 #include "printf.h"
 #include "klog.h"
+#include "proc.h"
+#include "vm.h"
+#include "file.h"
 
 // ========================= 最小化内核日志实现 =========================
 // 设计说明（单核场景）：
@@ -13,6 +16,8 @@
 // 3. 每条日志记录时间戳（ticks）、级别和预格式化好的字符串，便于快速打印。
 // 4. 为了保持实现轻量，我们自定义了一个简单的 snprintf，仅支持核心占位符。
 // 5. 默认保留所有级别的日志，但只将 WARN 及以上级别同步输出到控制台，以免刷屏。
+// 6. 每条日志按写入顺序编号，klog 设备的每个打开实例保存自己的读游标，
+//    read 只取出游标之后的新日志；游标落后到已被覆盖的位置时先返回一条丢失记录。
 
 // -------------------------- 配置常量区域 ---------------------------
 // 单条日志允许的最大字符数（包含结尾的 '\0'）。
@@ -33,12 +38,15 @@ typedef struct {
   klog_entry_t entries[KLOG_CAPACITY];
   int head;                        // 指向下一条可写入位置的索引
   int count;                       // 当前已存储的日志条目数量（不会超过 KLOG_CAPACITY）
-  klog_level_t record_threshold;   // 写入缓存的最低级别（数值越小越严格）
+  uint64 seq;                      // 已写入的日志总条数，第 s 条位于 entries[s % KLOG_CAPACITY]
   klog_level_t console_threshold;  // 同步打印到控制台的最低级别
 } klog_state_t;
 
 static klog_state_t g_klog;
 
+// 写入缓存的最低级别（数值越小越严格），便捷宏据此在调用前过滤
+klog_level_t klog_record_level = KLOG_LEVEL_DEBUG;
+
 // ticks 由时钟中断递增，这里仅引用即可。
 extern volatile uint64 ticks;
 
@@ -89,7 +97,8 @@ static void klog_write_unsigned(klog_buf_t *dst, unsigned long long x, int base)
   }
 }
 
-static void klog_vsnprintf(char *out, int out_sz, const char *fmt, va_list ap)
+// 返回写入的字符数（不含结尾的 '\0'）
+static int klog_vsnprintf(char *out, int out_sz, const char *fmt, va_list ap)
 {
   klog_buf_t buf = {
     .buf = out,
@@ -166,7 +175,8 @@ static void klog_vsnprintf(char *out, int out_sz, const char *fmt, va_list ap)
   }
 
   // 确保字符串以 '\0' 结尾
-  buf.buf[(buf.index < buf.capacity) ? buf.index : (buf.capacity - 1)] = '\0';
+  buf.buf[buf.index] = '\0';
+  return buf.index;
 }
 
 // -------------------------- 对外可见函数 --------------------------
@@ -176,39 +186,42 @@ void klog_init(void)
   initlock(&g_klog.lock, "klog");
   g_klog.head = 0;
   g_klog.count = 0;
-  g_klog.record_threshold = KLOG_LEVEL_DEBUG;  // 默认记录所有信息
+  klog_record_level = KLOG_LEVEL_DEBUG;        // 默认记录所有信息
   g_klog.console_threshold = KLOG_LEVEL_WARN;  // 控制台仅输出警告及以上
 }
 
 void klog_set_threshold(klog_level_t record_level, klog_level_t console_level)
 {
   acquire(&g_klog.lock);
-  g_klog.record_threshold = record_level;
+  klog_record_level = record_level;
   g_klog.console_threshold = console_level;
   release(&g_klog.lock);
 }
 
 void klog_log(klog_level_t level, const char *fmt, ...)
 {
-  if(level > g_klog.record_threshold) {
+  if(level > klog_record_level) {
     return; // 级别低于记录阈值则直接忽略
   }
 
+  // 只在锁外格式化一次：缓存与控制台都使用这份文本，入缓存时按长度复制
+  klog_entry_t e;
   va_list ap;
   va_start(ap, fmt);
-
-  char local_msg[KLOG_LINE_MAX];
-  klog_vsnprintf(local_msg, sizeof(local_msg), fmt, ap);
+  int len = klog_vsnprintf(e.message, sizeof(e.message), fmt, ap);
   va_end(ap);
+  e.timestamp = ticks;
+  e.level = level;
 
   acquire(&g_klog.lock);
 
   klog_entry_t *slot = &g_klog.entries[g_klog.head];
-  slot->timestamp = ticks;
-  slot->level = level;
-  safestrcpy(slot->message, local_msg, sizeof(slot->message));
+  slot->timestamp = e.timestamp;
+  slot->level = e.level;
+  memmove(slot->message, e.message, len + 1);
 
   g_klog.head = (g_klog.head + 1) % KLOG_CAPACITY;
+  g_klog.seq++;
   if(g_klog.count < KLOG_CAPACITY) {
     g_klog.count++;
   }
@@ -219,23 +232,89 @@ void klog_log(klog_level_t level, const char *fmt, ...)
   // 根据阈值决定是否同步打印到控制台
   if(level <= console_threshold) {
     printf("[KLOG][%s][%lu] %s\n",
-           klog_level_name[level], (uint64)ticks, local_msg);
+           klog_level_name[level], e.timestamp, e.message);
   }
 }
 
+// 每次只在锁内复制一条日志，打印时不持有日志锁；转储期间被覆盖的旧日志直接跳过
 void klog_dump(void)
 {
-  acquire(&g_klog.lock);
+  klog_entry_t e;
 
-  int entries_to_show = g_klog.count;
-  int start = (g_klog.head - g_klog.count + KLOG_CAPACITY) % KLOG_CAPACITY;
+  acquire(&g_klog.lock);
+  uint64 s = g_klog.seq - g_klog.count;
+  uint64 end = g_klog.seq;
+  release(&g_klog.lock);
 
-  for(int i = 0; i < entries_to_show; i++) {
-    int idx = (start + i) % KLOG_CAPACITY;
-    klog_entry_t *e = &g_klog.entries[idx];
-    printf("[KLOG][%s][%lu] %s\n",
-           klog_level_name[e->level], e->timestamp, e->message);
+  for(; s < end; s++) {
+    acquire(&g_klog.lock);
+    int live = s >= g_klog.seq - g_klog.count;
+    if(live)
+      e = g_klog.entries[s % KLOG_CAPACITY];
+    release(&g_klog.lock);
+    if(live)
+      printf("[KLOG][%s][%lu] %s\n",
+             klog_level_name[e.level], e.timestamp, e.message);
   }
+}
 
-  release(&g_klog.lock);
+static void klog_buf_puts(klog_buf_t *dst, const char *s)
+{
+  while(*s)
+    klog_buf_putc(dst, *s++);
+}
+
+// klogread: klog 设备的读回调。从 f->seq 起把日志按行（与 klog_dump 同格式）拷贝到 dst，
+// 只返回完整的行，除非 n 容不下一行（此时截断该行）。游标之前的日志已被覆盖时，
+// 先返回一行 "[KLOG][DROP][ticks] dropped=N"。没有新日志时返回 0，不等待
+int klogread(struct file *f, int user_dst, uint64 dst, int n)
+{
+  char line[KLOG_LINE_MAX + 32];
+  int tot = 0;
+
+  while(tot < n) {
+    klog_buf_t buf = { .buf = line, .capacity = sizeof(line), .index = 0 };
+    uint64 next;
+
+    acquire(&g_klog.lock);
+    uint64 oldest = g_klog.seq - g_klog.count;
+    if(f->seq >= g_klog.seq) {
+      release(&g_klog.lock);
+      break;
+    }
+    if(f->seq < oldest) {
+      klog_buf_puts(&buf, "[KLOG][DROP][");
+      klog_write_unsigned(&buf, ticks, 10);
+      klog_buf_puts(&buf, "] dropped=");
+      klog_write_unsigned(&buf, oldest - f->seq, 10);
+      next = oldest;
+    } else {
+      klog_entry_t *e = &g_klog.entries[f->seq % KLOG_CAPACITY];
+      klog_buf_puts(&buf, "[KLOG][");
+      klog_buf_puts(&buf, klog_level_name[e->level]);
+      klog_buf_puts(&buf, "][");
+      klog_write_unsigned(&buf, e->timestamp, 10);
+      klog_buf_puts(&buf, "] ");
+      klog_buf_puts(&buf, e->message);
+      next = f->seq + 1;
+    }
+    release(&g_klog.lock);
+    line[buf.index++] = '\n';    // klog_buf_putc 为结尾的 '\0' 预留了这一字节
+
+    int len = buf.index;
+    if(len > n - tot) {
+      if(tot > 0)
+        break;                   // 留到下次读取
+      len = n;
+    }
+    if(user_dst) {
+      if(copyout(myproc()->pagetable, dst + tot, line, len) < 0)
+        return tot ? tot : -1;
+    } else {
+      memmove((char *)dst + tot, line, len);
+    }
+    f->seq = next;
+    tot += len;
+  }
+  return tot;
 }
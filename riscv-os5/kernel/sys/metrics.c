@@ -0,0 +1,63 @@
+// metrics.c: 指标登记表与快照。
+// 登记表是一条只增不减的单链表，追加用 CAS 接在链尾，保持登记顺序；
+// 读取者不加锁遍历，各指标的值在遍历中逐个读出，快照只是某一时刻附近的近似值。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "vm.h"
+#include "string.h"
+#include "metrics.h"
+
+static struct metric *metrics_head;
+
+void metrics_register(struct metric *m, int n)
+{
+  for(int i = 0; i < n; i++) {
+    m[i].next = 0;
+    struct metric **pp = &metrics_head;
+    for(;;) {
+      struct metric *expected = 0;
+      if(__atomic_compare_exchange_n(pp, &expected, &m[i], 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        break;
+      pp = &expected->next;
+    }
+  }
+}
+
+static void metric_snapshot(struct metric *m, struct metric_stat *st)
+{
+  memset(st, 0, sizeof(*st));
+  safestrcpy(st->name, m->name, sizeof(st->name));
+  st->kind = m->kind;
+
+  if(m->counter) {
+    st->value = pcpu_read(m->counter);
+  } else if(m->hist) {
+    for(int i = 0; i < NCPU; i++) {
+      st->sum += m->hist->slot[i].sum;
+      for(int b = 0; b < METRIC_HIST_BUCKETS; b++)
+        st->buckets[b] += m->hist->slot[i].b[b];
+    }
+    for(int b = 0; b < METRIC_HIST_BUCKETS; b++)
+      st->value += st->buckets[b];
+  } else if(m->read) {
+    m->read(st);
+  }
+}
+
+int metrics_read(uint64 addr, int n)
+{
+  struct metric_stat st;
+  int got = 0;
+
+  for(struct metric *m = __atomic_load_n(&metrics_head, __ATOMIC_ACQUIRE); m && got < n;
+      m = __atomic_load_n(&m->next, __ATOMIC_ACQUIRE)) {
+    metric_snapshot(m, &st);
+    if(copyout(myproc()->pagetable, addr + got * sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+    got++;
+  }
+  return got;
+}
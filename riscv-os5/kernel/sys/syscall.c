@@ -19,11 +19,19 @@
 #include "string.h"
 #include "memlayout.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "trap.h"
+#include "scstat.h"
+#include "prof.h"
+#include "metrics.h"
 
 uint64 sys_getpid(void);
 uint64 sys_fork(void);
 uint64 sys_exit(void);
 uint64 sys_wait(void);
+uint64 sys_waitpid(void);
+uint64 sys_sched_setaffinity(void);
+uint64 sys_sched_getaffinity(void);
 uint64 sys_kill(void);
 uint64 sys_write(void);
 uint64 sys_read(void);
@@ -45,12 +53,68 @@ uint64 sys_getpriority(void);
 uint64 sys_klog_dump(void);
 uint64 sys_klog_set_threshold(void);
 uint64 sys_sleep(void);
+uint64 sys_spawn(void);
+uint64 sys_mmap(void);
+uint64 sys_munmap(void);
+uint64 sys_meminfo(void);
+uint64 sys_sched_setattr(void);
+uint64 sys_schedstat(void);
+uint64 sys_clone(void);
+uint64 sys_futex_wait(void);
+uint64 sys_futex_wake(void);
+uint64 sys_lockstat(void);
+uint64 sys_allocprof(void);
+uint64 sys_irqstat(void);
+uint64 sys_idlestat(void);
+uint64 sys_idlepoll(void);
+uint64 sys_metrics_read(void);
+uint64 sys_uring_setup(void);
+uint64 sys_uring_enter(void);
+uint64 sys_bcachestat(void);
+uint64 sys_pipe(void);
+uint64 sys_splice(void);
+uint64 sys_fsync(void);
+uint64 sys_fdatasync(void);
+uint64 sys_scstat(void);
+uint64 sys_strace(void);
+uint64 sys_straceread(void);
+uint64 sys_readv(void);
+uint64 sys_writev(void);
+uint64 sys_pread(void);
+uint64 sys_pwrite(void);
+uint64 sys_sendfile(void);
+uint64 sys_poll(void);
+uint64 sys_kbench(void);
+uint64 sys_prof(void);
+uint64 sys_profread(void);
+uint64 sys_tracedump(void);
+uint64 sys_socket(void);
+uint64 sys_bind(void);
+uint64 sys_sendto(void);
+uint64 sys_recvfrom(void);
+uint64 sys_getrusage(void);
+uint64 sys_wait4(void);
+uint64 sys_procinfo(void);
+uint64 sys_poweroff(void);
+uint64 sys_perf_read(void);
+uint64 sys_getdents(void);
+uint64 sys_fallocate(void);
+uint64 sys_clone_file(void);
+uint64 sys_nanosleep(void);
+uint64 sys_poll_us(void);
+uint64 sys_futex_timedwait(void);
+uint64 sys_iostat(void);
 
 // 系统调用描述符
 struct syscall_desc {
     uint64 (*func)(void);      // 对应的内核实现入口
     char *name;             // 调试使用的名称
     int arg_count;          // 需要读取的参数数量（位于 a0~a5）
+    // 以下为运行统计，由 syscall_dispatch 以原子操作累加，scstat 读出
+    uint64 calls;
+    uint64 errors;
+    uint64 time_total;
+    uint64 time_max;
     // 可扩展：参数类型描述、权限控制等元数据
 };
 
@@ -81,54 +145,121 @@ struct syscall_desc syscall_table[] = {
     [SYS_klog_dump] = { sys_klog_dump, "klog_dump", 0 },
     [SYS_klog_set_threshold] = { sys_klog_set_threshold, "klog_set_threshold", 2 },
     [SYS_sleep] = { sys_sleep, "sleep", 1 },
+    [SYS_spawn] = { sys_spawn, "spawn", 2 },
+    [SYS_mmap] = { sys_mmap, "mmap", 6 },
+    [SYS_munmap] = { sys_munmap, "munmap", 2 },
+    [SYS_meminfo] = { sys_meminfo, "meminfo", 2 },
+    [SYS_sched_setattr] = { sys_sched_setattr, "sched_setattr", 2 },
+    [SYS_schedstat] = { sys_schedstat, "schedstat", 2 },
+    [SYS_clone] = { sys_clone, "clone", 4 },
+    [SYS_futex_wait] = { sys_futex_wait, "futex_wait", 2 },
+    [SYS_futex_wake] = { sys_futex_wake, "futex_wake", 2 },
+    [SYS_lockstat] = { sys_lockstat, "lockstat", 1 },
+    [SYS_waitpid] = { sys_waitpid, "waitpid", 3 },
+    [SYS_sched_setaffinity] = { sys_sched_setaffinity, "sched_setaffinity", 2 },
+    [SYS_sched_getaffinity] = { sys_sched_getaffinity, "sched_getaffinity", 2 },
+    [SYS_uring_setup] = { sys_uring_setup, "uring_setup", 1 },
+    [SYS_uring_enter] = { sys_uring_enter, "uring_enter", 0 },
+    [SYS_bcachestat] = { sys_bcachestat, "bcachestat", 1 },
+    [SYS_pipe] = { sys_pipe, "pipe", 1 },
+    [SYS_splice] = { sys_splice, "splice", 3 },
+    [SYS_fsync] = { sys_fsync, "fsync", 1 },
+    [SYS_fdatasync] = { sys_fdatasync, "fdatasync", 1 },
+    [SYS_scstat] = { sys_scstat, "scstat", 3 },
+    [SYS_strace] = { sys_strace, "strace", 2 },
+    [SYS_straceread] = { sys_straceread, "straceread", 2 },
+    [SYS_readv] = { sys_readv, "readv", 3 },
+    [SYS_writev] = { sys_writev, "writev", 3 },
+    [SYS_pread] = { sys_pread, "pread", 4 },
+    [SYS_pwrite] = { sys_pwrite, "pwrite", 4 },
+    [SYS_sendfile] = { sys_sendfile, "sendfile", 4 },
+    [SYS_poll] = { sys_poll, "poll", 3 },
+    [SYS_kbench] = { sys_kbench, "kbench", 3 },
+    [SYS_prof] = { sys_prof, "prof", 1 },
+    [SYS_profread] = { sys_profread, "profread", 2 },
+    [SYS_tracedump] = { sys_tracedump, "tracedump", 0 },
+    [SYS_socket] = { sys_socket, "socket", 3 },
+    [SYS_bind] = { sys_bind, "bind", 2 },
+    [SYS_sendto] = { sys_sendto, "sendto", 5 },
+    [SYS_recvfrom] = { sys_recvfrom, "recvfrom", 5 },
+    [SYS_getrusage] = { sys_getrusage, "getrusage", 2 },
+    [SYS_wait4] = { sys_wait4, "wait4", 4 },
+    [SYS_procinfo] = { sys_procinfo, "procinfo", 2 },
+    [SYS_poweroff] = { sys_poweroff, "poweroff", 1 },
+    [SYS_perf_read] = { sys_perf_read, "perf_read", 2 },
+    [SYS_getdents] = { sys_getdents, "getdents", 4 },
+    [SYS_fallocate] = { sys_fallocate, "fallocate", 3 },
+    [SYS_allocprof] = { sys_allocprof, "allocprof", 1 },
+    [SYS_irqstat] = { sys_irqstat, "irqstat", 3 },
+    [SYS_idlestat] = { sys_idlestat, "idlestat", 3 },
+    [SYS_idlepoll] = { sys_idlepoll, "idlepoll", 1 },
+    [SYS_metrics_read] = { sys_metrics_read, "metrics_read", 2 },
+    [SYS_clone_file] = { sys_clone_file, "clone_file", 2 },
+    [SYS_nanosleep] = { sys_nanosleep, "nanosleep", 1 },
+    [SYS_poll_us] = { sys_poll_us, "poll_us", 3 },
+    [SYS_futex_timedwait] = { sys_futex_timedwait, "futex_timedwait", 3 },
+    [SYS_iostat] = { sys_iostat, "iostat", 2 },
 };
 
+#define NSYSCALL ((int)(sizeof(syscall_table) / sizeof(syscall_table[0])))
+
+// 跟踪记录环：被跟踪进程的系统调用完成时追加，满时覆盖最旧的记录
+#define STRACE_RING 128
+
+static struct {
+    struct spinlock lock;
+    uint64 head;                 // 下一条写入的序号
+    uint64 tail;                 // 下一条读出的序号
+    struct strace_rec rec[STRACE_RING];
+} strace_ring;
+
+static void strace_record(int pid, int num, long *args, uint64 ret, uint64 start, uint64 dur);
+
+static struct pcpu_hist syscall_latency;   // 全部系统调用的耗时（含期间的睡眠）
+
+static void metric_calls(struct metric_stat *st)
+{
+    for(int i = 0; i < NSYSCALL; i++)
+        st->value += syscall_table[i].calls;
+}
+
+static void metric_errors(struct metric_stat *st)
+{
+    for(int i = 0; i < NSYSCALL; i++)
+        st->value += syscall_table[i].errors;
+}
+
+static struct metric syscall_metrics[] = {
+    { .name = "syscall.calls", .kind = METRIC_COUNTER, .read = metric_calls },
+    { .name = "syscall.errors", .kind = METRIC_COUNTER, .read = metric_errors },
+    { .name = "syscall.latency", .kind = METRIC_HIST, .hist = &syscall_latency },
+};
+
+void syscall_init(void)
+{
+    initlock(&strace_ring.lock, "strace");
+    METRICS_REGISTER(syscall_metrics);
+}
+
 //
 // check_user_range
-//   确认用户态指针 [addr, addr+size) 对应的每个页面：
-//     1. 落在合法用户地址空间（MAXVA 以下）。
-//     2. 页表项存在且带有 PTE_U 标记。
-//     3. 若 write=1，则要求页面具备写权限。
-//   若全部满足返回 0，否则返回 -1。
+//   确认用户态指针 [addr, addr+size) 的每个页面都能被 copyin（write=1 时 copyout）访问，
+//   与拷贝原语共用 uvm_user_pa 的翻译缓存，可写检查会先完成写时复制。
+//   只在需要“先确认、后产生副作用”的地方使用（如 wait 回收子进程前），
+//   普通的指针参数直接交给拷贝原语校验。全部满足返回 0，否则返回 -1。
 //
 static int check_user_range(uint64 addr, int size, int write)
 {
-    struct proc *p = myproc();
-    pagetable_t pagetable = p->pagetable;
-    uint64 start = addr;
-    uint64 end;
+    pagetable_t pagetable = myproc()->pagetable;
 
-    if(size < 0)
+    if(size < 0 || addr + (uint64)size < addr)
         return -1;
     if(size == 0)
         return 0;
-
-    if(addr >= MAXVA)
-        return -1;
-
-    if(addr + (uint64)size < addr)
-        return -1;
-
-    end = addr + (uint64)size;
-    if(end > MAXVA)
-        return -1;
-
-    while(start < end) {
-        uint64 va0 = PGROUNDDOWN(start);
-        pte_t *pte = walk_lookup(pagetable, va0);
-        if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
-            return -1;
-        if(write && ((*pte & PTE_W) == 0))
+    for(uint64 va = PGROUNDDOWN(addr); va < addr + (uint64)size; va += PGSIZE) {
+        if(uvm_user_pa(pagetable, va, write) == 0)
             return -1;
-
-        uint64 next = va0 + PGSIZE;
-        if(next <= start)
-            return -1;
-        if(next > end)
-            next = end;
-        start = next;
     }
-
     return 0;
 }
 
@@ -177,23 +308,12 @@ fetchaddr(uint64 addr, uint64 *ip)
 //
 int fetchstr(uint64 addr, char *buf, int max)
 {
-    struct proc *p = myproc();
-    int i;
-    char c;
-
     if(max <= 0)
         return -1;
-
-    for(i = 0; i < max; i++) {
-        if(copyin(p->pagetable, &c, addr + i, 1) < 0)
-            return -1;
-        buf[i] = c;
-        if(c == '\0')
-            return i;
-    }
-
-    buf[max - 1] = '\0';
-    return -1;
+    int n = copyinstr(myproc()->pagetable, buf, addr, max);
+    if(n < 0)
+        buf[max - 1] = '\0';
+    return n;
 }
 
 // 读取第 n 个系统调用参数，并解析为 int
@@ -206,16 +326,13 @@ int argint(int n, int *ip)
     return 0;
 }
 
-// 读取第 n 个参数并验证它是合法的用户指针
+// 读取第 n 个参数作为用户地址。这里不做校验：copyin/copyout/copyinstr 在拷贝时
+// 逐页翻译并拒绝非法地址，预先再走一遍页表只会让每个指针参数付出两次开销
 int argaddr(int n, uint64 *ip)
 {
     long val;
     if(get_syscall_arg(n, &val) < 0)
         return -1;
-    if(val != 0) {
-        if(check_user_ptr((const void*)val, 1) < 0)
-            return -1;
-    }
     *ip = (uint64)val;
     return 0;
 }
@@ -240,9 +357,151 @@ void syscall_dispatch(void) {
         return;
     }
 
-    // 调用实现函数
+    struct syscall_desc *d = &syscall_table[num];
+    long args[STRACE_NARGS] = { 0 };
+    int traced = (p->trace_mask >> num) & 1;
+    if(traced) {
+        for(int i = 0; i < d->arg_count && i < STRACE_NARGS; i++)
+            get_syscall_arg(i, &args[i]);
+    }
+
+    // 调用实现函数。exit 不返回，只计入调用次数
+    __sync_fetch_and_add(&d->calls, 1);
+    uint64 start = get_time();
     uint64 ret = syscall_table[num].func();
+    uint64 dur = get_time() - start;
+    p = myproc();
     p->trapframe->a0 = ret;
+    if(p->fd_nheld)
+        fd_put_borrowed(p);
+
+    if((long)ret < 0)
+        __sync_fetch_and_add(&d->errors, 1);
+    __sync_fetch_and_add(&d->time_total, dur);
+    pcpu_hist_add(&syscall_latency, dur);
+    for(uint64 old = d->time_max; dur > old; old = d->time_max) {
+        if(__sync_bool_compare_and_swap(&d->time_max, old, dur))
+            break;
+    }
+    if(traced)
+        strace_record(p->pid, num, args, ret, start, dur);
+}
+
+// 追加一条跟踪记录
+static void strace_record(int pid, int num, long *args, uint64 ret, uint64 start, uint64 dur)
+{
+    acquire(&strace_ring.lock);
+    if(strace_ring.head - strace_ring.tail == STRACE_RING)
+        strace_ring.tail++;                       // 环满，丢弃最旧的一条
+    struct strace_rec *r = &strace_ring.rec[strace_ring.head++ % STRACE_RING];
+    r->pid = pid;
+    r->num = num;
+    memmove(r->args, args, sizeof(r->args));
+    r->ret = (long)ret;
+    r->start = start;
+    r->dur = dur;
+    release(&strace_ring.lock);
+}
+
+// scstat(st, n, reset): 把至多 n 个系统调用（按编号）的统计写入用户数组 st，返回写入的个数。
+// reset 非 0 时随后清零计数
+uint64 sys_scstat(void)
+{
+    uint64 addr;
+    int n, reset;
+    struct syscall_stat st;
+
+    if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0)
+        return -1;
+    if(n > NSYSCALL)
+        n = NSYSCALL;
+    for(int i = 0; i < n; i++) {
+        struct syscall_desc *d = &syscall_table[i];
+        memset(&st, 0, sizeof(st));
+        if(d->func) {
+            safestrcpy(st.name, d->name, sizeof(st.name));
+            st.calls = d->calls;
+            st.errors = d->errors;
+            st.time_total = d->time_total;
+            st.time_max = d->time_max;
+        }
+        if(copyout(myproc()->pagetable, addr + i * sizeof(st), (char *)&st, sizeof(st)) < 0)
+            return -1;
+    }
+    if(reset) {
+        for(int i = 0; i < NSYSCALL; i++) {
+            struct syscall_desc *d = &syscall_table[i];
+            d->calls = d->errors = d->time_total = d->time_max = 0;
+        }
+    }
+    return n;
+}
+
+// strace(pid, mask): 设置进程 pid（0 表示自身）的跟踪掩码，第 i 位对应系统调用 i，0 表示停止跟踪
+uint64 sys_strace(void)
+{
+    int pid;
+    uint64 mask;
+
+    if(argint(0, &pid) < 0 || argaddr(1, &mask) < 0)
+        return -1;
+    return proc_set_trace(pid, mask);
+}
+
+// straceread(buf, n): 取出至多 n 条最旧的跟踪记录写入用户数组 buf，返回取出的条数
+uint64 sys_straceread(void)
+{
+    uint64 addr;
+    int n, got = 0;
+    struct strace_rec batch[4];
+
+    if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+        return -1;
+    // copyout 可能因缺页而睡眠，分批在锁外拷贝
+    while(got < n) {
+        int k = 0;
+        acquire(&strace_ring.lock);
+        while(k < 4 && got + k < n && strace_ring.tail != strace_ring.head)
+            batch[k++] = strace_ring.rec[strace_ring.tail++ % STRACE_RING];
+        release(&strace_ring.lock);
+        if(k == 0)
+            break;
+        if(copyout(myproc()->pagetable, addr + got * sizeof(batch[0]), (char *)batch, k * sizeof(batch[0])) < 0)
+            return -1;
+        got += k;
+    }
+    return got;
+}
+
+// prof(hz): 以每秒 hz 次的频率在每个 hart 上采样（0 关闭），返回此前丢弃的样本数
+uint64 sys_prof(void)
+{
+    int hz;
+
+    if(argint(0, &hz) < 0)
+        return -1;
+    return prof_set_rate(hz);
+}
+
+// profread(buf, n): 取出至多 n 个样本写入用户数组 buf，返回取出的个数
+uint64 sys_profread(void)
+{
+    uint64 addr;
+    int n, got = 0;
+    struct prof_sample batch[4];
+
+    if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+        return -1;
+    // 与 straceread 相同，分批在锁外拷贝
+    while(got < n) {
+        int k = prof_drain(batch, n - got < 4 ? n - got : 4);
+        if(k == 0)
+            break;
+        if(copyout(myproc()->pagetable, addr + got * sizeof(batch[0]), (char *)batch, k * sizeof(batch[0])) < 0)
+            return -1;
+        got += k;
+    }
+    return got;
 }
 
 // 对外提供的系统调用入口，由内核陷入路径调用
@@ -9,6 +9,13 @@
 #include "syscall.h"
 #include "exec.h"
 #include "kalloc.h"
+#include "vm.h"
+#include "uring.h"
+#include "pipe.h"
+#include "pollwait.h"
+#include "hrtimer.h"
+#include "socket.h"
+#include "net.h"
 
 // sysfile.c 实现与文件系统相关的系统调用：open/read/write/close/unlink 等。
 // 这些接口在用户态通过 ulib.c 的封装访问，内核态则依赖 fs.c 提供的原语。
@@ -25,15 +32,13 @@ static int strequal(const char *a, const char *b)
 
 // argfd: 解析第 n 个系统调用参数并返回文件指针。若调用者需要文件描述符，
 // 可通过 pfd 输出。边界检查/空指针检查失败时返回 0。
+// 文件经 fd_borrow 取得，在本次系统调用返回前一直有效。
 static struct file *argfd(int n, int *pfd)
 {
     int fd;
     if(argint(n, &fd) < 0)
         return 0;
-    if(fd < 0 || fd >= NOFILE)
-        return 0;
-    struct proc *p = myproc();
-    struct file *f = p->ofile[fd];
+    struct file *f = fd_borrow(myproc(), fd);
     if(f == 0)
         return 0;
     if(pfd)
@@ -41,18 +46,11 @@ static struct file *argfd(int n, int *pfd)
     return f;
 }
 
-// fdalloc: 在当前进程的 ofile[] 中找一个空槽，并将 f 绑定到该槽位。
+// fdalloc: 把 f 绑定到当前进程最低的空闲描述符，表满时自动扩展（至多 NOFILE 个）。
 // 与 filealloc 搭配使用，确保每个打开的文件都有一个描述符可供用户态引用。
 static int fdalloc(struct file *f)
 {
-    struct proc *p = myproc();
-    for(int fd = 0; fd < NOFILE; fd++) {
-        if(p->ofile[fd] == 0) {
-            p->ofile[fd] = f;
-            return fd;
-        }
-    }
-    return -1;
+    return fd_alloc(myproc()->fdt, f);
 }
 
 // create: open(O_CREATE)、mkdir、symlink 等操作的公共入口。
@@ -80,8 +78,10 @@ static struct inode *create(char *path, short type, short major, short minor)
         return 0;
     }
 
-    if((ip = ialloc(dp->dev, type)) == 0)
-        panic("create: ialloc");
+    if((ip = ialloc(dp->dev, type, dp->inum)) == 0) {
+        iunlockput(dp);
+        return 0;   // tmpfs 的 inode 已用尽（磁盘文件系统用尽时在 ialloc 中 panic）
+    }
 
     ilock(ip);
     ip->major = major;
@@ -103,6 +103,9 @@ static struct inode *create(char *path, short type, short major, short minor)
     return ip;
 }
 
+static int do_open(char *path, int omode);
+static int do_close(int fd);
+
 // sys_open: 解析路径和模式，支持三类场景：
 //   1) 打开 console 设备：特殊路径映射到设备表；
 //   2) O_CREATE：调用 create 分配新的 inode；
@@ -111,14 +114,20 @@ uint64 sys_open(void)
 {
     char path[MAXPATH];
     int omode;
+
+    if(argstr(0, path, sizeof(path)) < 0 || argint(1, &omode) < 0)
+        return -1; // 参数 0 为文件路径，1 为打开模式，任一解析失败立刻返回。
+    return do_open(path, omode);
+}
+
+// do_open: sys_open 与提交环共用的打开逻辑，成功返回新的文件描述符
+static int do_open(char *path, int omode)
+{
     struct inode *ip;
     struct file *f;
     int fd;
     struct proc *p = myproc();
 
-    if(argstr(0, path, sizeof(path)) < 0 || argint(1, &omode) < 0)
-        return -1; // 参数 0 为文件路径，1 为打开模式，任一解析失败立刻返回。
-
     if(strequal(path, "console") || strequal(path, "/dev/console")) {
         // 特殊路径映射到内置控制台设备，跳过 inode 流程。
         if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0) {
@@ -135,17 +144,19 @@ uint64 sys_open(void)
         f->major = CONSOLE;
         if((f->readable && devsw[CONSOLE].read == 0) || (f->writable && devsw[CONSOLE].write == 0)) {
             // 设备驱动不支持所需方向时撤销打开操作。
-            myproc()->ofile[fd] = 0; // 释放 ofile 槽位，避免悬挂引用。
+            fd_remove(myproc()->fdt, fd); // 释放描述符槽位，避免悬挂引用。
             fileclose(f);
             return -1;
         }
         return fd;
     }
 
-    // 仅当涉及写操作或创建时才包事务
+    // 仅当涉及写操作或创建时才包事务；不创建时只可能因 iput 释放 inode 而写日志
     int need_tx = (omode & (O_CREATE | O_WRONLY | O_RDWR));
-    if(need_tx)
+    if(omode & O_CREATE)
         begin_transaction();
+    else if(need_tx)
+        begin_transaction_blocks(ifree_log_blocks());
 
     if(omode & O_CREATE) {
         // O_CREATE 走 create() 分支，新建或覆盖普通文件。
@@ -182,6 +193,7 @@ uint64 sys_open(void)
     f->off = 0;
     f->ip = ip;
     f->major = ip->major;
+    f->direct = (omode & O_DIRECT) && f->type == FD_INODE;
 
     if(f->type == FD_DEVICE) {
         int major = f->major;
@@ -191,7 +203,7 @@ uint64 sys_open(void)
            (need_read && devsw[major].read == 0) ||
            (need_write && devsw[major].write == 0)) {
             // 检查设备号与驱动能力是否满足需求。
-            p->ofile[fd] = 0;
+            fd_remove(p->fdt, fd);
             fileclose(f);
             iunlockput(ip);
             if(need_tx) end_transaction();
@@ -230,40 +242,292 @@ uint64 sys_write(void)
         return -1;   // 验证文件描述符有效并取得 struct file。
     if(argaddr(1, &addr) < 0 || argint(2, &n) < 0)
         return -1;   // 第二个参数是用户缓冲区指针，第三个为长度。
-    if(f->type == FD_DEVICE)
-        return filewrite(f, addr, n);
-    begin_transaction();
-    int ret = filewrite(f, addr, n);
-    end_transaction();
-    return ret;
+    // 普通文件的事务由 filewrite 按批开启，这里不能再包一层：
+    // end_transaction 会等待所在事务提交，嵌套时外层未结束的操作会令其永远等不到
+    return filewrite(f, addr, n);
+}
+
+// sys_getdents(fd, buf, n, flags): 读出至多 n 个目录项到 buf，见 filegetdents
+uint64 sys_getdents(void)
+{
+    struct file *f;
+    uint64 addr;
+    int n, flags;
+
+    if((f = argfd(0, 0)) == 0)
+        return -1;
+    if(argaddr(1, &addr) < 0 || argint(2, &n) < 0 || argint(3, &flags) < 0)
+        return -1;
+    return filegetdents(f, addr, n, flags);
+}
+
+// 把用户态的 iovec 数组拷入内核 iov[IOV_MAX]，并检查总长不超过 int 范围
+static int fetch_iov(uint64 uiov, int cnt, struct iovec *iov)
+{
+    if(cnt < 0 || cnt > IOV_MAX)
+        return -1;
+    if(copyin(myproc()->pagetable, (char *)iov, uiov, cnt * sizeof(struct iovec)) < 0)
+        return -1;
+    uint64 tot = 0;
+    for(int i = 0; i < cnt; i++) {
+        tot += iov[i].iov_len;
+        if(iov[i].iov_len > 0x7fffffff || tot > 0x7fffffff)
+            return -1;
+    }
+    return 0;
+}
+
+// sys_readv(fd, iov, cnt)/sys_writev(fd, iov, cnt): 分散读、集中写，整个请求经一次 filereadv/filewritev
+uint64 sys_readv(void)
+{
+    struct file *f;
+    uint64 uiov;
+    int cnt;
+    struct iovec iov[IOV_MAX];
+
+    if((f = argfd(0, 0)) == 0 || argaddr(1, &uiov) < 0 || argint(2, &cnt) < 0)
+        return -1;
+    if(fetch_iov(uiov, cnt, iov) < 0)
+        return -1;
+    return filereadv(f, 1, iov, cnt, -1);
+}
+
+uint64 sys_writev(void)
+{
+    struct file *f;
+    uint64 uiov;
+    int cnt;
+    struct iovec iov[IOV_MAX];
+
+    if((f = argfd(0, 0)) == 0 || argaddr(1, &uiov) < 0 || argint(2, &cnt) < 0)
+        return -1;
+    if(fetch_iov(uiov, cnt, iov) < 0)
+        return -1;
+    return filewritev(f, 1, iov, cnt, -1);
+}
+
+// sys_pread(fd, buf, n, off)/sys_pwrite(fd, buf, n, off): 在 off 处读写普通文件，不改变文件偏移
+uint64 sys_pread(void)
+{
+    struct file *f;
+    uint64 addr;
+    int n;
+    long off;
+
+    if((f = argfd(0, 0)) == 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0 ||
+       get_syscall_arg(3, &off) < 0 || n < 0 || off < 0)
+        return -1;
+    struct iovec iov = { (void *)addr, n };
+    return filereadv(f, 1, &iov, 1, off);
+}
+
+uint64 sys_pwrite(void)
+{
+    struct file *f;
+    uint64 addr;
+    int n;
+    long off;
+
+    if((f = argfd(0, 0)) == 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0 ||
+       get_syscall_arg(3, &off) < 0 || n < 0 || off < 0)
+        return -1;
+    struct iovec iov = { (void *)addr, n };
+    return filewritev(f, 1, &iov, 1, off);
+}
+
+// sys_sendfile(out_fd, in_fd, off, n): 在内核中把 in_fd 的数据搬到 out_fd，off 为 -1 时
+// 使用并推进 in_fd 的当前偏移，否则从 off 处读取
+uint64 sys_sendfile(void)
+{
+    struct file *out, *in;
+    long off;
+    int n;
+
+    if((out = argfd(0, 0)) == 0 || (in = argfd(1, 0)) == 0 ||
+       get_syscall_arg(2, &off) < 0 || argint(3, &n) < 0 || n < 0 || off < -1)
+        return -1;
+    return filesendfile(out, in, off, n);
+}
+
+// sys_poll(fds, nfds, timeout): 等待多个描述符之一就绪，超时以 tick 计，负数表示一直等待
+uint64 sys_poll(void)
+{
+    uint64 fds;
+    int nfds, timeout;
+
+    if(argaddr(0, &fds) < 0 || argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+        return -1;
+    return do_poll(fds, nfds, timeout > 0 ? (long)timeout * TICK_US : timeout);
+}
+
+// sys_poll_us(fds, nfds, timeout_us): 同 poll，超时以微秒计，负数表示一直等待
+uint64 sys_poll_us(void)
+{
+    uint64 fds;
+    int nfds;
+    long timeout_us;
+
+    if(argaddr(0, &fds) < 0 || argint(1, &nfds) < 0 || get_syscall_arg(2, &timeout_us) < 0)
+        return -1;
+    return do_poll(fds, nfds, timeout_us);
 }
 
 // sys_close: 将文件描述符从进程表中移除，随后调用 fileclose 回收资源。
 uint64 sys_close(void)
 {
     int fd;
-    struct file *f;
 
-    if((f = argfd(0, &fd)) == 0)
-        return -1;   // 解析 fd 并返回文件对象，顺便带回 fd 值。
+    if(argint(0, &fd) < 0)
+        return -1;
+    return do_close(fd);
+}
+
+// fd_lookup: 取得当前进程 fd 对应的文件对象并增加引用，无效时返回 0。
+// 一次 uring_enter 可能涉及任意多个描述符，每个提交项用完即 fileclose，不经 fd_borrow
+static struct file *fd_lookup(int fd)
+{
+    return fd_get_ref(myproc()->fdt, fd);
+}
 
-    myproc()->ofile[fd] = 0; // 释放 ofile 槽位，避免悬挂引用。
+static int do_close(int fd)
+{
+    struct file *f = fd_remove(myproc()->fdt, fd); // 释放描述符槽位，避免悬挂引用。
+
+    if(f == 0)
+        return -1;
     fileclose(f);
     return 0;
 }
 
-// isdirempty: 用于 unlink 删除目录时检查目录是否为空。
-// 目录的前两个条目固定为 '.' 和 '..'，因此从偏移 2*sizeof(dirent) 开始检查。
-static int isdirempty(struct inode *dp)
+
+// 能否放进批量事务：写普通文件且长度在单个操作的额度之内
+static int uring_batchable(struct uring_sqe *sqe)
 {
-    struct dirent de;
-    for(uint32 off = 2 * sizeof(de); off < dp->size; off += sizeof(de)) {
-        if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-            panic("isdirempty: read");
-        if(de.inum != 0)
-            return 0;
+    struct file *f;
+    if(sqe->op != URING_OP_WRITE || sqe->len < 0 || sqe->len > FILEWRITE_MAX ||
+       (f = fd_lookup(sqe->fd)) == 0)
+        return 0;
+    int ok = f->type == FD_INODE;
+    fileclose(f);
+    return ok;
+}
+
+// 执行一个提交项，返回值写入完成项。批量事务中的写入由调用者负责开启与提交事务
+static long uring_exec(struct uring_sqe *sqe, int in_tx)
+{
+    struct file *f;
+    char path[MAXPATH];
+    long ret;
+
+    switch(sqe->op) {
+    case URING_OP_NOP:
+        return 0;
+    case URING_OP_READ:
+        if((f = fd_lookup(sqe->fd)) == 0)
+            return -1;
+        ret = fileread(f, sqe->addr, sqe->len);
+        fileclose(f);
+        return ret;
+    case URING_OP_WRITE:
+        if((f = fd_lookup(sqe->fd)) == 0)
+            return -1;
+        if(in_tx)
+            ret = filewrite_intx(f, sqe->addr, sqe->len);
+        else
+            ret = filewrite(f, sqe->addr, sqe->len);
+        fileclose(f);   // 若其他线程已关闭，在事务内执行的 iput 也是允许的
+        return ret;
+    case URING_OP_OPEN:
+        if(fetchstr(sqe->addr, path, sizeof(path)) < 0)
+            return -1;
+        return do_open(path, sqe->flags);
+    case URING_OP_CLOSE:
+        return do_close(sqe->fd);
+    case URING_OP_FSYNC:
+        if((f = fd_lookup(sqe->fd)) == 0)
+            return -1;
+        fileclose(f);
+        log_force();
+        return 0;
+    default:
+        return -1;
     }
-    return 1;
+}
+
+// sys_uring_setup: 登记当前进程的提交环（用户地址，须可读写），不随 fork 继承，exec 后失效
+uint64 sys_uring_setup(void)
+{
+    uint64 addr;
+    unsigned int idx[4] = { 0, 0, 0, 0 };
+
+    if(argaddr(0, &addr) < 0)
+        return -1;
+    // 清零四个下标；环的其余部分在使用时逐项校验
+    if(copyout(myproc()->pagetable, addr, (char *)idx, sizeof(idx)) < 0)
+        return -1;
+    myproc()->uring = addr;
+    return 0;
+}
+
+// sys_uring_enter: 按顺序执行全部已提交的提交项（完成队列满时提前停止），返回本次处理的个数。
+// 连续的小块普通文件写入合并进同一个事务，每个写入预留一个操作的额度，
+// 至多 log_max_ops() 个共用一次日志提交
+uint64 sys_uring_enter(void)
+{
+    struct proc *p = myproc();
+    uint64 ring = p->uring;
+    unsigned int idx[4];   // sq_head, sq_tail, cq_head, cq_tail
+    struct uring_sqe sqe;
+    struct uring_cqe cqe;
+    int done = 0;
+    int tx_ops = 0;        // 当前批量事务中已执行的写入数，0 表示未开启
+    int max_ops = log_max_ops();
+
+    if(ring == 0 || copyin(p->pagetable, (char *)idx, ring, sizeof(idx)) < 0)
+        return -1;
+    unsigned int sq_head = idx[0], sq_tail = idx[1], cq_head = idx[2], cq_tail = idx[3];
+    if(sq_tail - sq_head > URING_ENTRIES || cq_tail - cq_head > URING_ENTRIES)
+        return -1;
+
+    while(sq_head != sq_tail && cq_tail - cq_head < URING_ENTRIES) {
+        uint64 sqe_va = ring + __builtin_offsetof(struct uring, sq) + (sq_head % URING_ENTRIES) * sizeof(sqe);
+        if(copyin(p->pagetable, (char *)&sqe, sqe_va, sizeof(sqe)) < 0)
+            break;
+
+        if(uring_batchable(&sqe)) {
+            if(tx_ops == 0)
+                begin_transaction_n(max_ops);
+            cqe.res = uring_exec(&sqe, 1);
+            if(++tx_ops == max_ops) {
+                end_transaction_n(max_ops);
+                tx_ops = 0;
+            }
+        } else {
+            // 其他操作可能自行开启事务，先提交已合并的写入
+            if(tx_ops) {
+                end_transaction_n(max_ops);
+                tx_ops = 0;
+            }
+            cqe.res = uring_exec(&sqe, 0);
+        }
+        cqe.user_data = sqe.user_data;
+
+        uint64 cqe_va = ring + __builtin_offsetof(struct uring, cq) + (cq_tail % URING_ENTRIES) * sizeof(cqe);
+        if(copyout(p->pagetable, cqe_va, (char *)&cqe, sizeof(cqe)) < 0)
+            break;
+        sq_head++;
+        cq_tail++;
+        done++;
+    }
+    if(tx_ops)
+        end_transaction_n(max_ops);
+
+    // 完成项全部写入后才发布新的 cq_tail，用户态看到的完成项总是完整的
+    __sync_synchronize();
+    if(copyout(p->pagetable, ring + __builtin_offsetof(struct uring, sq_head), (char *)&sq_head, sizeof(sq_head)) < 0 ||
+       copyout(p->pagetable, ring + __builtin_offsetof(struct uring, cq_tail), (char *)&cq_tail, sizeof(cq_tail)) < 0)
+        return -1;
+    return done;
 }
 
 // 判断是否为 '.' 或 '..'，避免删除特殊目录项。
@@ -290,7 +554,7 @@ uint64 sys_unlink(void)
     if(argstr(0, path, sizeof(path)) < 0)
         return -1;   // 解析待删除路径。
 
-    begin_transaction();
+    begin_transaction_blocks(LOG_OP_UNLINK);
 
     if((dp = nameiparent(path, name)) == 0) {
         end_transaction();
@@ -315,7 +579,7 @@ uint64 sys_unlink(void)
 
     if(ip->nlink < 1)
         panic("sys_unlink: nlink < 1"); // nlink 异常说明文件系统损坏。
-    if(ip->type == T_DIR && !isdirempty(ip)) {
+    if(ip->type == T_DIR && !dirempty(ip)) {
         iunlockput(ip);
         iunlockput(dp);
         end_transaction();
@@ -326,6 +590,7 @@ uint64 sys_unlink(void)
     memset(&de, 0, sizeof(de));
     if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
         panic("sys_unlink: writei"); // 将目录项清零失败意味着磁盘状态异常。
+    dcache_forget(dp, name);
 
     if(ip->type == T_DIR) {
         dp->nlink--;          // 父目录丢失一个子目录链接。
@@ -336,9 +601,13 @@ uint64 sys_unlink(void)
 
     ip->nlink--;           // 目标 inode 链接计数减一。
     iupdate(ip);
-    iunlockput(ip);
+    iunlock(ip);
 
     end_transaction();
+    // 操作结束后才放开最后一个引用：iput 通常把 inode 记入孤儿表交给回收线程，孤儿表满时
+    // 自行开启操作当场释放，大文件的块可分批提交。两者之间崩溃留下的 nlink 为 0 的 inode
+    // 在下次挂载时扫描 inode 表找回
+    iput(ip);
     return 0;
 }
 // sys_symlink: 创建符号链接，将目标路径字符串写入新 inode。
@@ -370,18 +639,23 @@ uint64 sys_symlink(void)
     return 0;
 }
 
-uint64 sys_exec(void)
+// 释放 fetch_argv 分配的参数页：全部字符串依次存放在 argv[0] 起始的同一页中
+static void free_argv(char **argv)
 {
-    char path[MAXPATH];
-    uint64 uargv;
-    if(argstr(0, path, sizeof(path)) < 0)
-        return -1;
-    if(argaddr(1, &uargv) < 0)
-        return -1;
-    // 从用户空间拷贝argv
-    char *argv[MAXARG];
-    memset(argv, 0, sizeof(argv));
-    
+    if(argv[0])
+        free_page(argv[0]);
+}
+
+// 从用户空间拷贝以 0 结尾的 argv 数组到内核。各字符串紧挨着存放在一页中，
+// 总长（含结尾的 '\0'）不能超过一页——新程序的用户栈也只有一页，更长的参数本来就放不下。
+// 失败返回 -1 并释放已分配的页。
+static int fetch_argv(uint64 uargv, char **argv)
+{
+    char *buf = 0;
+    int used = 0;
+
+    memset(argv, 0, MAXARG * sizeof(char *));
+
     for(int i = 0; i < MAXARG; i++) {
         uint64 uarg;
         // 获取argv[i]的指针
@@ -390,26 +664,104 @@ uint64 sys_exec(void)
         }
         if(uarg == 0) {
             argv[i] = 0;
-            break;
+            return 0;
         }
-        // 分配内核内存并拷贝字符串
-        argv[i] = alloc_page();
-        if(fetchstr(uarg, argv[i], PGSIZE) < 0) {
+        // 第一个参数时才分配页（fetchstr 负责写入结尾的 '\0'，无需清零）
+        if(buf == 0 && (buf = alloc_page_nozero()) == 0) {
             goto bad;
         }
+        argv[i] = buf + used;
+        int n = fetchstr(uarg, argv[i], PGSIZE - used);
+        if(n < 0) {
+            goto bad;
+        }
+        used += n + 1;
     }
+    return 0;
+
+bad:
+    if(buf)
+        free_page(buf);
+    return -1;
+}
+
+uint64 sys_exec(void)
+{
+    char path[MAXPATH];
+    uint64 uargv;
+    if(argstr(0, path, sizeof(path)) < 0)
+        return -1;
+    if(argaddr(1, &uargv) < 0)
+        return -1;
+    // 从用户空间拷贝argv
+    char *argv[MAXARG];
+    if(fetch_argv(uargv, argv) < 0)
+        return -1;
+
     int ret = kernel_exec(path, argv);
     // 清理分配的内核内存
-    for(int i = 0; i < MAXARG && argv[i] != 0; i++) {
-        free_page(argv[i]);
-    }
+    free_argv(argv);
     return ret;
+}
 
-bad:
-    for(int i = 0; i < MAXARG && argv[i] != 0; i++) {
-        free_page(argv[i]);
+// sys_spawn: 创建子进程并直接加载 path 指定的程序，父进程返回子进程 PID。
+// 相当于 fork 后立即 exec，但不复制父进程地址空间。
+uint64 sys_spawn(void)
+{
+    char path[MAXPATH];
+    uint64 uargv;
+    if(argstr(0, path, sizeof(path)) < 0)
+        return -1;
+    if(argaddr(1, &uargv) < 0)
+        return -1;
+    char *argv[MAXARG];
+    if(fetch_argv(uargv, argv) < 0)
+        return -1;
+
+    int pid = spawn_process(path, argv);
+    free_argv(argv);
+    return pid;
+}
+
+// sys_mmap(addr, length, prot, flags, fd, offset): 建立映射区，返回起始地址。
+// addr 仅作提示，映射区总是由内核在 MMAP_BASE 以上选择；匿名映射忽略 fd。
+uint64 sys_mmap(void)
+{
+    long addr, off;
+    int len, prot, flags;
+    struct file *f = 0;
+
+    if(get_syscall_arg(0, &addr) < 0 || argint(1, &len) < 0 ||
+       argint(2, &prot) < 0 || argint(3, &flags) < 0 || get_syscall_arg(5, &off) < 0)
+        return -1;
+    if(len <= 0 || off < 0)
+        return -1;
+    if(!(flags & MAP_ANONYMOUS)) {
+        if((f = argfd(4, 0)) == 0)
+            return -1;
+        if(f->type != FD_INODE || f->readable == 0)
+            return -1;   // 只支持可读的普通文件
     }
-    return -1;
+    struct proc *p = myproc();
+    tgroup_mm_lock(p);   // 与同组线程的 sbrk/mmap/munmap 串行
+    uint64 ret = mmap_create((uint64)len, prot, flags, f, (uint64)off);
+    tgroup_mm_unlock(p);
+    return ret;
+}
+
+// sys_munmap(addr, length): 解除映射区中的一段地址
+uint64 sys_munmap(void)
+{
+    long addr;
+    int len;
+
+    if(get_syscall_arg(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+        return -1;
+    struct proc *p = myproc();
+    tgroup_mm_lock(p);
+    int ret = mmap_remove((uint64)addr, (uint64)len);
+    tgroup_mm_unlock(p);
+    return ret;
 }
 
 uint64 sys_dup(void)
@@ -426,6 +778,165 @@ uint64 sys_dup(void)
     return fd;
 }
 
+// sys_pipe(fds): 创建管道，把读端与写端的描述符写入用户数组 fds[0]、fds[1]
+uint64 sys_pipe(void)
+{
+    struct proc *p = myproc();
+    struct file *rf, *wf;
+    uint64 addr;
+    int fds[2];
+
+    if(argaddr(0, &addr) < 0 || pipealloc(&rf, &wf) < 0)
+        return -1;
+    fds[0] = fdalloc(rf);
+    fds[1] = fds[0] < 0 ? -1 : fdalloc(wf);
+    if(fds[1] < 0 || copyout(p->pagetable, addr, (char *)fds, sizeof(fds)) < 0) {
+        if(fds[0] >= 0)
+            fd_remove(p->fdt, fds[0]);
+        if(fds[1] >= 0)
+            fd_remove(p->fdt, fds[1]);
+        fileclose(rf);
+        fileclose(wf);
+        return -1;
+    }
+    return 0;
+}
+
+// sys_socket(domain, type, protocol): 创建 UDP 套接字并返回描述符
+uint64 sys_socket(void)
+{
+    struct file *f;
+    int domain, type, protocol, fd;
+
+    if(argint(0, &domain) < 0 || argint(1, &type) < 0 || argint(2, &protocol) < 0)
+        return -1;
+    if(sockalloc(&f, domain, type, protocol) < 0)
+        return -1;
+    if((fd = fdalloc(f)) < 0) {
+        fileclose(f);
+        return -1;
+    }
+    return fd;
+}
+
+// 读取用户的 sockaddr_in，地址与端口转换为主机字节序
+static int fetch_sockaddr(uint64 uaddr, uint32 *addr, uint16 *port)
+{
+    struct sockaddr_in sin;
+
+    if(copyin(myproc()->pagetable, (char *)&sin, uaddr, sizeof(sin)) < 0 || sin.sin_family != AF_INET)
+        return -1;
+    *addr = ntohl(sin.sin_addr);
+    *port = ntohs(sin.sin_port);
+    return 0;
+}
+
+static struct file *argsock(int n)
+{
+    struct file *f = argfd(n, 0);
+    return f && f->type == FD_SOCKET ? f : 0;
+}
+
+// sys_bind(fd, addr): 把套接字绑定到 addr 给出的本地端口
+uint64 sys_bind(void)
+{
+    struct file *f;
+    uint64 uaddr;
+    uint32 addr;
+    uint16 port;
+
+    if((f = argsock(0)) == 0 || argaddr(1, &uaddr) < 0 || fetch_sockaddr(uaddr, &addr, &port) < 0)
+        return -1;
+    return sockbind(f->sock, addr, port);
+}
+
+// sys_sendto(fd, buf, n, flags, to): 向 to 发送一个数据报
+uint64 sys_sendto(void)
+{
+    struct file *f;
+    uint64 buf, uaddr;
+    int n, flags;
+    uint32 addr;
+    uint16 port;
+
+    if((f = argsock(0)) == 0 || argaddr(1, &buf) < 0 || argint(2, &n) < 0 || argint(3, &flags) < 0 ||
+       argaddr(4, &uaddr) < 0 || fetch_sockaddr(uaddr, &addr, &port) < 0)
+        return -1;
+    return socksendto(f->sock, 1, buf, n, addr, port);
+}
+
+// sys_recvfrom(fd, buf, n, flags, from): 接收一个数据报，from 不为 0 时写回来源地址
+uint64 sys_recvfrom(void)
+{
+    struct file *f;
+    uint64 buf, uaddr;
+    int n, flags, r;
+    uint32 addr;
+    uint16 port;
+
+    if((f = argsock(0)) == 0 || argaddr(1, &buf) < 0 || argint(2, &n) < 0 || argint(3, &flags) < 0 ||
+       argaddr(4, &uaddr) < 0 || n < 0)
+        return -1;
+    if((r = sockrecvfrom(f->sock, 1, buf, n, flags, &addr, &port)) < 0)
+        return -1;
+    if(uaddr) {
+        struct sockaddr_in sin = { AF_INET, htons(port), htonl(addr), {0} };
+        if(copyout(myproc()->pagetable, uaddr, (char *)&sin, sizeof(sin)) < 0)
+            return -1;
+    }
+    return r;
+}
+
+// sys_splice(fd_in, fd_out, n): 从普通文件向管道搬运数据，内核直接把文件内容读入管道缓冲区
+uint64 sys_splice(void)
+{
+    struct file *in, *out;
+    int n;
+
+    if((in = argfd(0, 0)) == 0 || (out = argfd(1, 0)) == 0 || argint(2, &n) < 0 || n < 0)
+        return -1;
+    if(in->type != FD_INODE || !in->readable || out->type != FD_PIPE || !out->writable)
+        return -1;
+    return pipe_splice(out->pipe, in, n);
+}
+
+// sys_fsync(fd): 等待此前结束的全部文件系统操作提交到日志。日志不区分文件，
+// 提交的是整个当前事务
+uint64 sys_fsync(void)
+{
+    if(argfd(0, 0) == 0)
+        return -1;
+    log_force();
+    return 0;
+}
+
+// sys_fdatasync(fd): 文件数据与元数据经同一个日志提交，无法只提交数据，语义同 fsync
+uint64 sys_fdatasync(void)
+{
+    return sys_fsync();
+}
+
+// sys_fallocate(fd, off, len): 预留 [off, off + len) 涉及的磁盘块，文件大小不变，见 filefallocate
+uint64 sys_fallocate(void)
+{
+    struct file *f;
+    long off, len;
+
+    if((f = argfd(0, 0)) == 0 || get_syscall_arg(1, &off) < 0 || get_syscall_arg(2, &len) < 0)
+        return -1;
+    return filefallocate(f, off, len);
+}
+
+// sys_clone_file(src_fd, dst_fd): 让 dst 成为 src 的副本，两者共享数据块，见 fileclone
+uint64 sys_clone_file(void)
+{
+    struct file *src, *dst;
+
+    if((src = argfd(0, 0)) == 0 || (dst = argfd(1, 0)) == 0)
+        return -1;
+    return fileclone(dst, src);
+}
+
 uint64 sys_mknod(void)
 {
   struct inode *ip;
@@ -450,7 +961,7 @@ uint64 sys_chdir(void)
   struct inode *ip;
   struct proc *p = myproc();
   
-  begin_transaction();
+  begin_transaction_blocks(ifree_log_blocks());   // 只会因 iput 旧目录而写日志
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
     end_transaction();
     return -1;
@@ -462,8 +973,10 @@ uint64 sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  // 线程组共用组长的当前目录：先换上新目录，再放弃旧目录，其他线程不会看到已放弃的 inode
+  struct inode *old = proc_set_cwd(p, ip);
+  if(old)
+    iput(old);
   end_transaction();
-  p->cwd = ip;
   return 0;
 }
\ No newline at end of file
@@ -2,11 +2,32 @@
 
 #include "types.h"
 #include "proc.h"
+#include "memlayout.h"
 #include "syscall.h"
 #include "vm.h"
 #include "trap.h"
 #include "log.h"
 #include "klog.h"
+#include "kalloc.h"
+#include "string.h"
+#include "meminfo.h"
+#include "swap.h"
+#include "timer.h"
+#include "hrtimer.h"
+#include "sched.h"
+#include "lockstat.h"
+#include "lockstat_flags.h"
+#include "irqsoff.h"
+#include "allocprof.h"
+#include "allocprof_flags.h"
+#include "irqstat.h"
+#include "idlestat.h"
+#include "metrics.h"
+#include "bcachestat.h"
+#include "printf.h"
+#include "wait.h"
+#include "bench.h"
+#include "trace.h"
 
 extern volatile uint64 ticks;
 extern struct spinlock tickslock;
@@ -30,25 +51,125 @@ uint64 sys_exit(void) {
     return 0; // 不会返回
 }
 
-// wait: 等待任意子进程结束，可选写回退出状态
-uint64 sys_wait(void) {
-    uint64 addr = 0;
-    if(argaddr(0, &addr) < 0)
-        return -1;   // 解析用户态指针，非法输入立即返回。
-
+// wait/waitpid/wait4 的公共部分：等待子进程结束，addr 非 0 时写回退出状态，ruaddr 非 0 时写回资源使用
+static uint64 wait_common(int pid, uint64 addr, int options, uint64 ruaddr) {
     int status = 0;
     int *status_ptr = addr ? &status : 0;
+    struct rusage ru;
 
     if(addr && check_user_ptr_rw((void*)addr, sizeof(status), 1) < 0)
         return -1;   // 确认用户缓冲区可写，阻止越界/非法页访问。
+    if(ruaddr && check_user_ptr_rw((void*)ruaddr, sizeof(ru), 1) < 0)
+        return -1;
 
-    int pid = wait_process(status_ptr);
+    int cpid = wait4_process(pid, status_ptr, options, ruaddr ? &ru : 0);
 
-    if(pid >= 0 && addr) {
+    if(cpid > 0 && addr) {
         if(copyout(myproc()->pagetable, (uint64)addr, (const char*)&status, sizeof(status)) < 0)
             return -1;   // 将退出码写回用户缓冲区可能失败，需返回错误。
     }
-    return pid;
+    if(cpid > 0 && ruaddr) {
+        if(copyout(myproc()->pagetable, ruaddr, (const char*)&ru, sizeof(ru)) < 0)
+            return -1;
+    }
+    return cpid;
+}
+
+// wait: 等待任意子进程结束，可选写回退出状态
+uint64 sys_wait(void) {
+    uint64 addr = 0;
+    if(argaddr(0, &addr) < 0)
+        return -1;   // 解析用户态指针，非法输入立即返回。
+    return wait_common(-1, addr, 0, 0);
+}
+
+// waitpid(pid, status, options): pid 大于 0 时只等待该子进程，options 可含 WNOHANG
+uint64 sys_waitpid(void) {
+    int pid = 0, options = 0;
+    uint64 addr = 0;
+    if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0 || argint(2, &options) < 0)
+        return -1;
+    if(options & ~WNOHANG)
+        return -1;   // 不支持的选项
+    return wait_common(pid, addr, options, 0);
+}
+
+// wait4(pid, status, options, ru): 同 waitpid，并写回被回收子进程的资源使用
+uint64 sys_wait4(void) {
+    int pid = 0, options = 0;
+    uint64 addr = 0, ruaddr = 0;
+    if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0 || argint(2, &options) < 0 ||
+       argaddr(3, &ruaddr) < 0)
+        return -1;
+    if(options & ~WNOHANG)
+        return -1;
+    return wait_common(pid, addr, options, ruaddr);
+}
+
+// getrusage(who, ru): 读取当前进程、已回收子进程或进程 who 的资源使用
+uint64 sys_getrusage(void) {
+    int who = 0;
+    uint64 addr = 0;
+    if(argint(0, &who) < 0 || argaddr(1, &addr) < 0 || addr == 0)
+        return -1;
+
+    struct rusage ru;
+    if(proc_getrusage(who, &ru) < 0)
+        return -1;
+    if(copyout(myproc()->pagetable, addr, (const char*)&ru, sizeof(ru)) < 0)
+        return -1;
+    return 0;
+}
+
+// perf_read(who, pc): 读取当前进程、已回收子进程或进程 who 的硬件性能计数
+uint64 sys_perf_read(void) {
+    int who = 0;
+    uint64 addr = 0;
+    if(argint(0, &who) < 0 || argaddr(1, &addr) < 0 || addr == 0)
+        return -1;
+
+    struct perfcount pc;
+    if(proc_perf_read(who, &pc) < 0)
+        return -1;
+    if(copyout(myproc()->pagetable, addr, (const char*)&pc, sizeof(pc)) < 0)
+        return -1;
+    return 0;
+}
+
+// iostat(who, st): 读取当前进程、已回收子进程或进程 who 的 I/O 统计
+uint64 sys_iostat(void) {
+    int who = 0;
+    uint64 addr = 0;
+    if(argint(0, &who) < 0 || argaddr(1, &addr) < 0 || addr == 0)
+        return -1;
+
+    struct proc_iostat st;
+    if(proc_iostat_read(who, &st) < 0)
+        return -1;
+    if(copyout(myproc()->pagetable, addr, (const char*)&st, sizeof(st)) < 0)
+        return -1;
+    return 0;
+}
+
+// procinfo(buf, n): 写回至多 n 个进程的快照。快照先在内核页中生成（持锁期间不能访问用户内存）
+uint64 sys_procinfo(void) {
+    int n = 0;
+    uint64 addr = 0;
+    if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0 || addr == 0)
+        return -1;
+
+    int max = PGSIZE / sizeof(struct procinfo);
+    if(n > max)
+        n = max;
+    struct procinfo *buf = alloc_page();
+    if(buf == 0)
+        return -1;
+    int cnt = proc_snapshot(buf, n);
+    int r = cnt;
+    if(copyout(myproc()->pagetable, addr, (const char*)buf, cnt * sizeof(struct procinfo)) < 0)
+        r = -1;
+    free_page(buf);
+    return r;
 }
 
 // kill: 向目标 PID 设置 killed 标记
@@ -64,12 +185,20 @@ uint64 sys_time(void) {
 }
 
 uint64 sys_ticks(void) {
+    ticks_sync();
     acquire(&tickslock);
     uint64 value = ticks;
     release(&tickslock);
     return value;
 }
 
+// 睡眠定时器到期：以定时器自身地址为等待通道唤醒睡眠者
+static void sleep_timer_expired(void *chan) {
+    acquire(&tickslock);
+    wakeup(chan);
+    release(&tickslock);
+}
+
 uint64 sys_sleep(void) {
     int ticks_to_sleep = 0;
     if(argint(0, &ticks_to_sleep) < 0)
@@ -77,19 +206,174 @@ uint64 sys_sleep(void) {
     if(ticks_to_sleep <= 0)
         return 0;
 
+    // 每个睡眠者挂一个到期定时器，时钟中断只唤醒到期的进程
+    struct ktimer timer = {0};
+    int ret = 0;
+    ticks_sync();
     acquire(&tickslock);
-    uint64 start = ticks;
-    while(ticks - start < (uint64)ticks_to_sleep) {
+    uint64 deadline = ticks + (uint64)ticks_to_sleep;
+    ktimer_add(&timer, deadline, sleep_timer_expired, &timer);
+    while(ticks < deadline) {
         if(killed(myproc())) {
-            release(&tickslock);
-            return -1;
+            ret = -1;
+            break;
+        }
+        sleep(&timer, &tickslock);
+    }
+    release(&tickslock);
+    ktimer_cancel(&timer);   // 被 kill 提前返回时定时器仍在时间轮中
+    return ret;
+}
+
+// nanosleep(ns): 睡眠至少 ns 纳秒，精度为 time 计数（100ns）加上时钟中断延迟，不受 tick 限制。
+// 与 sys_sleep 一样以定时器地址为通道，被 kill 时提前返回 -1
+uint64 sys_nanosleep(void) {
+    uint64 ns = 0;
+    if(argaddr(0, &ns) < 0)
+        return -1;
+    if(ns == 0)
+        return 0;
+
+    struct hrtimer timer = {0};
+    int ret = 0;
+    uint64 deadline = get_time() + ns_to_time(ns);
+    acquire(&tickslock);
+    hrtimer_start(&timer, deadline, sleep_timer_expired, &timer);
+    while(get_time() < deadline) {
+        if(killed(myproc())) {
+            ret = -1;
+            break;
         }
-        sleep((void*)&ticks, &tickslock);
+        sleep(&timer, &tickslock);
     }
     release(&tickslock);
+    hrtimer_cancel(&timer);
+    return ret;
+}
+
+// poweroff(code): 提交日志中尚未落盘的事务后关机，code 作为 QEMU 的退出码（0 为正常）。不返回
+uint64 sys_poweroff(void) {
+    int code = 0;
+    if(argint(0, &code) < 0)
+        return -1;
+    log_force();
+    klog_info("poweroff: pid=%d code=%d", myproc()->pid, code);
+    poweroff(code);
+    return 0;
+}
+
+// meminfo(pid, info): 汇总物理内存、页表与缺页统计写入用户缓冲区，
+// rss_pages 为 pid 指定进程的常驻页数，pid 为 0 表示调用者自身。
+uint64 sys_meminfo(void) {
+    int pid = 0;
+    uint64 addr = 0;
+    if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0 || addr == 0)
+        return -1;
+
+    struct meminfo mi;
+    memset(&mi, 0, sizeof(mi));
+    pmm_meminfo(&mi);
+    vm_meminfo(&mi);
+    swap_meminfo(&mi);
+    if(proc_rss(pid, &mi.rss_pages) < 0)
+        return -1;   // 目标进程不存在。
+
+    if(copyout(myproc()->pagetable, addr, (const char*)&mi, sizeof(mi)) < 0)
+        return -1;
+    return 0;
+}
+
+// sched_setattr(pid, attr): 设置进程 pid（0 表示自身）的调度类与参数
+uint64 sys_sched_setattr(void) {
+    int pid = 0;
+    uint64 addr = 0;
+    if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0 || addr == 0)
+        return -1;
+
+    struct sched_attr attr;
+    if(copyin(myproc()->pagetable, (char*)&attr, addr, sizeof(attr)) < 0)
+        return -1;
+    return sched_setattr(pid, attr.policy, attr.priority);
+}
+
+// schedstat(pid, st): 读取全局调度延迟直方图与进程 pid（0 表示自身）的调度计数
+uint64 sys_schedstat(void) {
+    int pid = 0;
+    uint64 addr = 0;
+    if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0 || addr == 0)
+        return -1;
+
+    struct schedstat st;
+    if(sched_getstat(pid, &st) < 0)
+        return -1;
+    if(copyout(myproc()->pagetable, addr, (const char*)&st, sizeof(st)) < 0)
+        return -1;
+    return 0;
+}
+
+// sched_setaffinity(pid, mask): 限定进程 pid（0 表示自身）只在 mask 中的 hart 上运行
+uint64 sys_sched_setaffinity(void) {
+    int pid = 0;
+    uint64 mask = 0;
+    if(argint(0, &pid) < 0 || argaddr(1, &mask) < 0)
+        return -1;
+    return sched_setaffinity(pid, mask);
+}
+
+// sched_getaffinity(pid, mask): 把进程 pid（0 表示自身）允许运行的 hart 位图写入 *mask
+uint64 sys_sched_getaffinity(void) {
+    int pid = 0;
+    uint64 addr = 0;
+    if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0 || addr == 0)
+        return -1;
+
+    uint64 mask;
+    if(sched_getaffinity(pid, &mask) < 0)
+        return -1;
+    if(copyout(myproc()->pagetable, addr, (const char*)&mask, sizeof(mask)) < 0)
+        return -1;
     return 0;
 }
 
+// clone(fn, stack, flags, arg): 创建共享当前地址空间的线程，从 fn(arg) 开始、以 stack 为栈顶运行
+uint64 sys_clone(void) {
+    uint64 fn = 0, stack = 0, arg = 0;
+    int flags = 0;
+    if(argaddr(0, &fn) < 0 || argaddr(1, &stack) < 0 || argint(2, &flags) < 0 || argaddr(3, &arg) < 0)
+        return -1;
+    if(stack == 0 || stack % 16)
+        return -1;   // RISC-V 调用约定要求栈指针 16 字节对齐
+    return clone_thread(fn, stack, flags, arg);
+}
+
+// futex_wait(addr, val): *addr 仍等于 val 时睡眠，直到有人对同一地址调用 futex_wake
+uint64 sys_futex_wait(void) {
+    uint64 addr = 0;
+    int val = 0;
+    if(argaddr(0, &addr) < 0 || argint(1, &val) < 0)
+        return -1;
+    return futex_wait(addr, val);
+}
+
+// futex_wake(addr, n): 唤醒在 addr 上等待的至多 n 个进程，返回唤醒的个数
+uint64 sys_futex_wake(void) {
+    uint64 addr = 0;
+    int n = 0;
+    if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+        return -1;
+    return futex_wake(addr, n);
+}
+
+// futex_timedwait(addr, val, us): 同 futex_wait，但最多等待 us 微秒，超时返回 -1；us 为负数时一直等待
+uint64 sys_futex_timedwait(void) {
+    uint64 addr = 0;
+    int val = 0;
+    long us = 0;
+    if(argaddr(0, &addr) < 0 || argint(1, &val) < 0 || get_syscall_arg(2, &us) < 0)
+        return -1;
+    return futex_timedwait(addr, val, us);
+}
+
 uint64 sys_getpriority(void) {
     struct proc *p = myproc();
     if(p == 0)
@@ -98,21 +382,23 @@ uint64 sys_getpriority(void) {
 }
 
 // sys_sbrk: 调整当前进程的用户空间大小，返回旧的堆顶地址。
-//   - n > 0: 逐页申请并零填充新页面；
+//   - n > 0: LAZY_ALLOC 下只抬高 sz，页面在首次访问时分配；否则逐页申请并零填充新页面；
 //   - n < 0: 释放多余页面，最小收缩到 0。
 //   - 失败时返回 -1。
-uint64 sys_sbrk(void) {
-    int n = 0;
-    if(argint(0, &n) < 0)
-        return -1;   // 获取堆增量失败。
-
-    struct proc *p = myproc();
+static uint64 sbrk_locked(struct proc *p, int n) {
     uint64 oldsz = p->sz;
 
     if(n > 0) {
         uint64 newsz = oldsz + (uint64)n;
         if(newsz < oldsz)
             return -1; // 检测溢出，防止地址空间回绕。
+        if(newsz > ULIB_TEXT)
+            return -1; // 不能与共享运行库及其上的 mmap 映射区、trapframe/trampoline 重叠。
+#if LAZY_ALLOC
+        p->sz = newsz; // 只预留地址空间，缺页时再分配。
+        tgroup_sync(p);
+        return (int)oldsz;
+#endif
         uint64 res = uvmalloc(p->pagetable, oldsz, newsz); // 按页分配物理内存并建立映射。
         if(res == 0)
             return -1;   // 分配失败，保持旧的 break。
@@ -121,12 +407,27 @@ uint64 sys_sbrk(void) {
         long target = (long)oldsz + (long)n;
         if(target < 0)
             target = 0; // 不允许收缩到负地址。
-        p->sz = uvmdealloc(p->pagetable, oldsz, (uint64)target); // 释放多余页面并更新记录。
+        if(uvmdealloc(p->pagetable, oldsz, (uint64)target) != (uint64)target)
+            return -1;   // 拆分页表时内存不足，保持旧的 break。
+        p->sz = (uint64)target; // 释放多余页面并更新记录。
     }
+    tgroup_sync(p);   // 同组线程共享这个堆
 
     return (int)oldsz;
 }
 
+uint64 sys_sbrk(void) {
+    int n = 0;
+    if(argint(0, &n) < 0)
+        return -1;   // 获取堆增量失败。
+
+    struct proc *p = myproc();
+    tgroup_mm_lock(p);   // 同组线程的 sbrk/mmap 不能在读取 sz 与写回之间插入
+    uint64 ret = sbrk_locked(p, n);
+    tgroup_mm_unlock(p);
+    return ret;
+}
+
 uint64 sys_set_crash_stage(void) {
     int stage;
     if(argint(0, &stage) < 0)
@@ -142,17 +443,147 @@ uint64 sys_recover_log(void) {
 }
 
 extern void clear_cache(void);
+void bcache_getstat(struct bcachestat *st);
 
 uint64 sys_clear_cache(void) {
     clear_cache();
     return 0;
 }
 
+// bcachestat(st): 读取块缓存的命中、换出与队列统计
+uint64 sys_bcachestat(void) {
+    uint64 addr = 0;
+    if(argaddr(0, &addr) < 0 || addr == 0)
+        return -1;
+
+    struct bcachestat st;
+    bcache_getstat(&st);
+    if(copyout(myproc()->pagetable, addr, (const char*)&st, sizeof(st)) < 0)
+        return -1;
+    return 0;
+}
+
+// kbench(name, res, max): 运行名称为 name 的内核微基准（name 为 0 时运行全部），
+// 把至多 max 个结果写入用户数组 res，返回运行的基准个数
+uint64 sys_kbench(void) {
+    uint64 uname = 0, addr = 0;
+    int max = 0;
+    char name[BENCH_NAME_LEN];
+    struct bench_result *res;
+
+    if(argaddr(0, &uname) < 0 || argaddr(1, &addr) < 0 || argint(2, &max) < 0 || max < 0)
+        return -1;
+    name[0] = 0;
+    if(uname && argstr(0, name, sizeof(name)) < 0)
+        return -1;
+    if(max > BENCH_MAX)
+        max = BENCH_MAX;
+    if((res = alloc_page_nozero()) == 0)
+        return -1;
+    int n = bench_run(name, res, max);
+    if(n > 0 && copyout(myproc()->pagetable, addr, (const char*)res, n * sizeof(res[0])) < 0)
+        n = -1;
+    free_page(res);
+    return n;
+}
+
 uint64 sys_klog_dump(void) {
     klog_dump();
     return 0;
 }
 
+// tracedump(): 把各 hart 跟踪环中的记录按时间顺序打印到控制台，返回打印的条数
+uint64 sys_tracedump(void) {
+    return trace_dump();
+}
+
+// lockstat(flags): 在控制台打印各锁类的竞争统计；flags 含 LOCKSTAT_IRQSOFF 时改为把
+// 最长的关中断区间写入 klog。含 LOCKSTAT_RESET 时随后清零对应的统计
+uint64 sys_lockstat(void) {
+    int flags = 0;
+    if(argint(0, &flags) < 0)
+        return -1;
+    if(flags & LOCKSTAT_IRQSOFF) {
+        irqsoff_dump();
+        if(flags & LOCKSTAT_RESET)
+            irqsoff_reset();
+        return 0;
+    }
+    lockstat_dump();
+    if(flags & LOCKSTAT_RESET)
+        lockstat_reset();
+    return 0;
+}
+
+// allocprof(flags): 在控制台按现存字节数打印各分配调用点的用量（内核以 ALLOC_PROF=1 编译时）；
+// 含 ALLOCPROF_RESET 时随后清零累计分配次数并重置高水位
+uint64 sys_allocprof(void) {
+    int flags = 0;
+    if(argint(0, &flags) < 0)
+        return -1;
+    allocprof_dump();
+    if(flags & ALLOCPROF_RESET)
+        allocprof_reset();
+    return 0;
+}
+
+// irqstat(st, n, reset): 把至多 n 项在用的中断统计写入用户数组 st，返回写入的项数。
+// reset 非 0 时随后清零
+uint64 sys_irqstat(void) {
+    uint64 addr;
+    int n, reset, got = 0;
+    struct irq_stat st;
+
+    if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0)
+        return -1;
+    for(int i = 0, r; got < n && (r = irqstat_read(i, &st)) >= 0; i++) {
+        if(r == 0)
+            continue;
+        if(copyout(myproc()->pagetable, addr + got * sizeof(st), (char *)&st, sizeof(st)) < 0)
+            return -1;
+        got++;
+    }
+    if(reset)
+        irqstat_reset();
+    return got;
+}
+
+// idlestat(st, n, reset): 读取至多 n 个 hart 的空闲统计，返回写入的项数
+uint64 sys_idlestat(void) {
+    uint64 addr;
+    int n, reset, got = 0;
+    struct idle_stat st;
+
+    if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0)
+        return -1;
+    for(; got < n && idle_stat_read(got, &st) == 0; got++) {
+        if(copyout(myproc()->pagetable, addr + got * sizeof(st), (char *)&st, sizeof(st)) < 0)
+            return -1;
+    }
+    if(reset)
+        idle_stat_reset();
+    return got;
+}
+
+// idlepoll(us): us >= 0 时把空闲轮询窗口设为 us 微秒，返回当前窗口
+uint64 sys_idlepoll(void) {
+    int us;
+
+    if(argint(0, &us) < 0)
+        return -1;
+    return idle_set_poll(us);
+}
+
+// metrics_read(buf, n): 把至多 n 项内核指标的快照写入用户数组 buf，返回写入的项数
+uint64 sys_metrics_read(void) {
+    uint64 addr;
+    int n;
+
+    if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+        return -1;
+    return metrics_read(addr, n);
+}
+
 uint64 sys_klog_set_threshold(void) {
     int record_level = 0;
     int console_level = 0;
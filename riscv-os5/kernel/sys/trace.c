@@ -0,0 +1,99 @@
+// trace.c: 每个 hart 一个的二进制跟踪环。写者只有本 hart（关中断期间），
+// 因此写入路径不加锁；转储可能与其他 hart 的写者并发，靠每条记录的 seq 校验
+// 丢弃读到一半被改写的记录。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "printf.h"
+#include "trap.h"
+#include "trace.h"
+
+struct trace_ring {
+  uint64 head;                       // 已写入的记录总数，只由本 hart 修改
+  struct trace_rec rec[TRACE_RING];
+};
+
+static struct trace_ring rings[NCPU];
+
+#define TRACE_FMT(name, fmt) fmt,
+static char *const trace_fmt[TR_NEVENTS] = { TRACE_EVENTS(TRACE_FMT) };
+#undef TRACE_FMT
+
+void trace_emit(int event, uint64 a0, uint64 a1, uint64 a2, uint64 a3)
+{
+  push_off();
+  struct cpu *c = mycpu();
+  struct trace_ring *t = &rings[cpuid()];
+  uint64 i = t->head;
+  struct trace_rec *r = &t->rec[i & (TRACE_RING - 1)];
+
+  r->seq = 0;                  // 先作废旧内容，转储方不会把半条新记录当作旧记录
+  __sync_synchronize();
+  r->time = get_time();
+  r->event = event;
+  r->pid = c->proc ? c->proc->pid : 0;
+  r->args[0] = a0;
+  r->args[1] = a1;
+  r->args[2] = a2;
+  r->args[3] = a3;
+  __sync_synchronize();
+  r->seq = i + 1;
+  t->head = i + 1;
+  pop_off();
+}
+
+// 从 hart 的第 idx 条记录取一份快照，记录已被覆盖或正在写时返回 0
+static int trace_read(struct trace_ring *t, uint64 idx, struct trace_rec *out)
+{
+  struct trace_rec *r = &t->rec[idx & (TRACE_RING - 1)];
+  uint64 seq = r->seq;
+  __sync_synchronize();
+  *out = *r;
+  __sync_synchronize();
+  return seq == idx + 1 && r->seq == seq;
+}
+
+// 按时间戳合并各 hart 的记录并格式化输出到控制台，返回输出的条数
+int trace_dump(void)
+{
+  uint64 pos[NCPU], end[NCPU];
+  struct trace_rec cur[NCPU];
+  int valid[NCPU];
+  int n = 0;
+
+  // 只转储开始时已写完的记录；转储期间继续写入的记录可能把未读的记录覆盖掉
+  for(int i = 0; i < NCPU; i++) {
+    end[i] = __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE);
+    pos[i] = end[i] > TRACE_RING ? end[i] - TRACE_RING : 0;
+    valid[i] = 0;
+  }
+
+  for(;;) {
+    int best = -1;
+    for(int i = 0; i < NCPU; i++) {
+      while(!valid[i] && pos[i] < end[i]) {
+        valid[i] = trace_read(&rings[i], pos[i], &cur[i]);
+        if(!valid[i])
+          pos[i]++;
+      }
+      if(valid[i] && (best < 0 || cur[i].time < cur[best].time))
+        best = i;
+    }
+    if(best < 0)
+      break;
+
+    struct trace_rec *r = &cur[best];
+    printf("[trace] %lu cpu%d pid=%d ", r->time, best, r->pid);
+    if(r->event < TR_NEVENTS)
+      printf(trace_fmt[r->event], r->args[0], r->args[1], r->args[2], r->args[3]);
+    else
+      printf("event=%d", r->event);
+    printf("\n");
+    valid[best] = 0;
+    pos[best]++;
+    n++;
+  }
+  return n;
+}
@@ -0,0 +1,100 @@
+// ulibrt.c: 共享运行库，布局见 ulibrt.h。
+// 启动时把嵌入内核的代码段与已初始化数据拷贝到物理页，这些页由内核一直持有一个引用；
+// exec 时把代码页原样映射（只读可执行），数据页以写时复制方式映射，进程改写时才得到私有副本，
+// 其余的 bss 页按需清零。两段各占一个映射区，fork、munmap 与进程回收都按映射区的规则处理，
+// 物理页凭引用计数在最后一个映射者放弃之前保留。
+
+#include "types.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "vm.h"
+#include "kalloc.h"
+#include "string.h"
+#include "printf.h"
+#include "proc.h"
+#include "klog.h"
+#include "ulibrt.h"
+
+#define ULIB_TEXT_PAGES ((ULIB_DATA_VA - ULIB_TEXT_VA) / PGSIZE)
+#define ULIB_DATA_PAGES ((ULIB_END_VA - ULIB_DATA_VA) / PGSIZE)
+
+// 内核与用户态各自计算的地址必须一致
+_Static_assert(ULIB_TEXT == ULIB_TEXT_VA, "ulib layout");
+_Static_assert(sizeof(struct ulib_header) == ULIB_HDR_SIZE, "ulib header");
+
+extern char ulib_text[], ulib_text_end[];
+extern char ulib_data[], ulib_data_end[];
+
+static struct {
+    char *text[ULIB_TEXT_PAGES];   // 代码页，所有进程共享
+    char *data[ULIB_DATA_PAGES];   // 已初始化数据的模板页，进程写入前共享
+    int ntext;
+    int ndata;
+    uint64 memsz;                  // 数据段映射区长度（页对齐，含 bss）
+} ulib;
+
+// 依次拷贝 n 字节到新分配的页中，末页剩余部分为零。内存不足时 panic（只在启动时调用）
+static int ulib_load(char **pages, const char *src, uint64 n)
+{
+    int npages = 0;
+    for(uint64 off = 0; off < n; off += PGSIZE) {
+        char *mem = alloc_page();
+        if(mem == 0)
+            panic("ulib_init: out of memory");
+        memmove(mem, src + off, n - off < PGSIZE ? n - off : PGSIZE);
+        pages[npages++] = mem;
+    }
+    return npages;
+}
+
+void ulib_init(void)
+{
+    uint64 tsz = ulib_text_end - ulib_text;
+    uint64 dsz = ulib_data_end - ulib_data;
+    struct ulib_header *h = (struct ulib_header *)ulib_text;
+
+    if(tsz < sizeof(*h) || h->magic != ULIB_MAGIC || h->text_size != tsz ||
+       h->data_size != dsz || h->mem_size < dsz ||
+       tsz < ULIB_HDR_SIZE + (uint64)h->nslot * ULIB_SLOT_SIZE ||
+       tsz > ULIB_TEXT_PAGES * PGSIZE || h->mem_size > ULIB_DATA_PAGES * PGSIZE)
+        panic("ulib_init: bad image");
+
+    ulib.ntext = ulib_load(ulib.text, ulib_text, tsz);
+    ulib.ndata = ulib_load(ulib.data, ulib_data, dsz);
+    ulib.memsz = PGROUNDUP(h->mem_size);
+    klog_info("ulib: 共享运行库 %d 个入口，代码 %d 页，数据 %d 页（另 %d 页 bss）",
+              h->nslot, ulib.ntext, ulib.ndata, (int)(ulib.memsz / PGSIZE) - ulib.ndata);
+}
+
+// 把共享运行库映射进新页表 pagetable，并在 v[0]、v[1] 中填好代码段与数据段的映射区，
+// 由调用者放入进程的 vma[]。失败返回 -1，已建立的映射随调用者释放新页表时一并解除
+int ulib_map(pagetable_t pagetable, struct vma v[2])
+{
+    memset(v, 0, 2 * sizeof(*v));
+    v[0].start = ULIB_TEXT_VA;
+    v[0].end = ULIB_TEXT_VA + (uint64)ulib.ntext * PGSIZE;
+    v[0].perm = PTE_R | PTE_X | PTE_U;
+    v[0].shared = 1;
+    v[1].start = ULIB_DATA_VA;
+    v[1].end = ULIB_DATA_VA + ulib.memsz;
+    v[1].perm = PTE_R | PTE_W | PTE_U;
+
+    // 先加引用再建映射，理由同 mmap_fork
+    for(int i = 0; i < ulib.ntext; i++) {
+        page_incref(ulib.text[i]);
+        if(map_page(pagetable, ULIB_TEXT_VA + (uint64)i * PGSIZE, (uint64)ulib.text[i], v[0].perm) < 0) {
+            page_decref(ulib.text[i]);
+            return -1;
+        }
+    }
+    // 模板页只读映射并标记 COW：首次写入时 cow_resolve 复制出私有页，模板本身不会被改写
+    for(int i = 0; i < ulib.ndata; i++) {
+        page_incref(ulib.data[i]);
+        if(map_page(pagetable, ULIB_DATA_VA + (uint64)i * PGSIZE, (uint64)ulib.data[i],
+                    (v[1].perm & ~PTE_W) | PTE_COW) < 0) {
+            page_decref(ulib.data[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+// vdso.c: 向用户态导出只读的 vDSO 数据页，布局见 vdso.h。
+// 全局页只有一份物理页，映射进所有用户页表；进程页随进程分配，fork 的子进程各有一页，
+// 线程与组长共享页表，因而共享组长的进程页。
+
+#include "types.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "vm.h"
+#include "kalloc.h"
+#include "printf.h"
+#include "proc.h"
+#include "vdso.h"
+#include "trap.h"
+
+// 内核与用户态各自计算的地址必须一致
+_Static_assert(VDSO_DATA == VDSO_DATA_VA && VDSO_PROC == VDSO_PROC_VA, "vdso layout");
+
+static struct vdso_data *vdso_data;
+
+void vdso_init(void)
+{
+    if((vdso_data = (struct vdso_data *)alloc_page()) == 0)
+        panic("vdso_init");
+    vdso_data->timebase_freq = TIMEBASE_FREQ;
+}
+
+// 在持有 tickslock 时由时钟路径调用，唯一的写者，用顺序锁保证用户态读到一致的一对值
+void vdso_update_ticks(uint64 ticks, uint64 tick_time, uint64 interval)
+{
+    struct vdso_data *vd = vdso_data;
+    vd->seq++;
+    __sync_synchronize();
+    vd->ticks = ticks;
+    vd->tick_time = tick_time;
+    vd->tick_interval = interval;
+    __sync_synchronize();
+    vd->seq++;
+}
+
+// 把两页 vDSO 映射进 p 的新页表，进程页在首次映射时分配（exec 复用原有的一页）
+int vdso_map(pagetable_t pagetable, struct proc *p)
+{
+    if(p->vdso == 0){
+        if((p->vdso = (struct vdso_proc *)alloc_page()) == 0)
+            return -1;
+        p->vdso->pid = p->pid;
+    }
+    if(map_region(pagetable, VDSO_DATA, (uint64)vdso_data, PGSIZE, PTE_R | PTE_U) < 0)
+        return -1;
+    if(map_region(pagetable, VDSO_PROC, (uint64)p->vdso, PGSIZE, PTE_R | PTE_U) < 0){
+        uvmunmap(pagetable, VDSO_DATA, 1, 0);
+        return -1;
+    }
+    return 0;
+}
+
+// 解除映射但不释放物理页：全局页常驻，进程页由 vdso_release 释放
+void vdso_unmap(pagetable_t pagetable)
+{
+    uvmunmap(pagetable, VDSO_DATA, 2, 0);
+}
+
+void vdso_release(struct proc *p)
+{
+    if(p->vdso){
+        free_page((void *)p->vdso);
+        p->vdso = 0;
+    }
+}
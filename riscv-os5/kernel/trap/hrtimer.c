@@ -0,0 +1,118 @@
+// hrtimer.c: 高精度定时器，按到期时间（time CSR）排序的双向链表。
+// 挂起的定时器个数与睡眠中的进程数同一量级，插入时顺序查找位置即可；
+// 到期处理与查询最早到期时间都只看表头。
+// 新定时器成为表头时，当前 hart 立即重设时钟中断；其他 hart 在各自下一次
+// timer_reprogram 时看到它，最早的 hrtimer 总有一个 hart 按时处理。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "printf.h"
+#include "percpu.h"
+#include "metrics.h"
+#include "trap.h"
+#include "hrtimer.h"
+
+static struct hrtimer *hrtimer_head;
+static struct spinlock hrtimer_lock;
+
+static struct pcpu_counter hrtimer_expired;   // 已到期的定时器个数
+static struct pcpu_hist hrtimer_late;         // 回调执行时距到期时间的延迟（微秒）
+
+static struct metric hrtimer_metrics[] = {
+  { .name = "hrtimer.expired", .kind = METRIC_COUNTER, .counter = &hrtimer_expired },
+  { .name = "hrtimer.late_us", .kind = METRIC_HIST, .hist = &hrtimer_late },
+};
+
+void hrtimer_init(void)
+{
+  initlock(&hrtimer_lock, "hrtimer");
+  hrtimer_head = 0;
+  METRICS_REGISTER(hrtimer_metrics);
+}
+
+static void hrtimer_unlink(struct hrtimer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+void hrtimer_start(struct hrtimer *t, uint64 expires, void (*fn)(void *), void *arg)
+{
+  acquire(&hrtimer_lock);
+  if(t->pending)
+    panic("hrtimer_start: already pending");
+  t->expires = expires;
+  t->fn = fn;
+  t->arg = arg;
+  t->pending = 1;
+
+  // 到期时间相同的定时器按加入顺序排列
+  struct hrtimer **pp = &hrtimer_head;
+  while(*pp && (*pp)->expires <= expires)
+    pp = &(*pp)->next;
+  t->next = *pp;
+  if(*pp)
+    (*pp)->pprev = &t->next;
+  *pp = t;
+  t->pprev = pp;
+  int first = (pp == &hrtimer_head);
+  release(&hrtimer_lock);
+
+  // 时钟可能设在更晚的 tick 或时间片末尾
+  if(first) {
+    push_off();
+    timer_reprogram();
+    pop_off();
+  }
+}
+
+int hrtimer_cancel(struct hrtimer *t)
+{
+  int was_pending;
+
+  acquire(&hrtimer_lock);
+  was_pending = t->pending;
+  if(was_pending) {
+    hrtimer_unlink(t);
+    t->pending = 0;
+  }
+  release(&hrtimer_lock);
+  return was_pending;
+}
+
+int hrtimer_next(uint64 *expires)
+{
+  int found = 0;
+
+  acquire(&hrtimer_lock);
+  if(hrtimer_head) {
+    *expires = hrtimer_head->expires;
+    found = 1;
+  }
+  release(&hrtimer_lock);
+  return found;
+}
+
+// 逐个摘下表头已到期的定时器，调用回调前释放锁；回调中重新加入的定时器
+// 若已到期会在本次循环中处理
+void hrtimer_run(uint64 now)
+{
+  acquire(&hrtimer_lock);
+  while(hrtimer_head && hrtimer_head->expires <= now) {
+    struct hrtimer *t = hrtimer_head;
+    hrtimer_unlink(t);
+    t->pending = 0;
+    pcpu_inc(&hrtimer_expired);
+    pcpu_hist_add(&hrtimer_late, (now - t->expires) / TIME_PER_US);
+    void (*fn)(void *) = t->fn;
+    void *arg = t->arg;
+    release(&hrtimer_lock);
+    fn(arg);
+    acquire(&hrtimer_lock);
+  }
+  release(&hrtimer_lock);
+}
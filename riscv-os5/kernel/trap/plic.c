@@ -0,0 +1,81 @@
+// plic.c: PLIC 驱动。中断源的优先级是全局的，使能位与阈值按 hart 的 S 模式上下文设置。
+// 外部中断到来时，从本 hart 的 claim 寄存器读出优先级最高的待处理源，
+// 调用其处理函数后写回同一编号表示完成，PLIC 才会再次投递该源的中断。
+
+#include "types.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "printf.h"
+#include "proc.h"
+#include "plic.h"
+#include "string.h"
+#include "softirq.h"
+#include "irqstat.h"
+
+#define PLIC_REG(addr) (*(volatile uint32 *)(addr))
+
+static void (*plic_handlers[PLIC_NSRC])(void);
+static const char *plic_names[PLIC_NSRC];
+static struct irq_acct plic_acct[NCPU][PLIC_NSRC];   // 各中断源处理函数的耗时，irqstat 读出
+static uint32 plic_enabled;        // 已登记的中断源位图，各 hart 的使能寄存器与之一致
+static uint64 plic_spurious;       // 没有找到处理函数的中断次数
+
+void plic_init(void)
+{
+    for(int irq = 1; irq < PLIC_NSRC; irq++)
+        PLIC_REG(PLIC_PRIORITY + irq * 4) = 0;   // 优先级 0 表示屏蔽
+    plic_enabled = 0;
+}
+
+// 每个 hart 启动时调用：同步使能位，并把阈值设为 0，接受全部优先级大于 0 的中断
+void plic_inithart(void)
+{
+    int hart = cpuid();
+    PLIC_REG(PLIC_SENABLE(hart)) = plic_enabled;
+    PLIC_REG(PLIC_SPRIORITY(hart)) = 0;
+}
+
+// 登记中断源 irq 的处理函数与优先级（1~7），并在所有 hart 上使能该源。name 用于 irqstat
+void plic_register(int irq, const char *name, void (*handler)(void), int priority)
+{
+    if(irq <= 0 || irq >= PLIC_NSRC || priority <= 0)
+        panic("plic_register");
+    plic_handlers[irq] = handler;
+    plic_names[irq] = name;
+    PLIC_REG(PLIC_PRIORITY + irq * 4) = priority;
+    plic_enabled |= 1U << irq;
+    for(int hart = 0; hart < NCPU; hart++)
+        PLIC_REG(PLIC_SENABLE(hart)) = plic_enabled;
+}
+
+// S 模式外部中断处理：处理完所有已投递给本 hart 的中断源再返回
+void plic_intr(void)
+{
+    int hart = cpuid();
+    uint32 irq;
+    while((irq = PLIC_REG(PLIC_SCLAIM(hart))) != 0){
+        if(irq < PLIC_NSRC && plic_handlers[irq]) {
+            uint64 start = r_time();
+            plic_handlers[irq]();
+            irq_account(&plic_acct[hart][irq], r_time() - start);
+        } else if(plic_spurious++ == 0)
+            printf("plic: 未登记的中断源 %d\n", irq);
+        PLIC_REG(PLIC_SCLAIM(hart)) = irq;
+    }
+}
+
+// 读出中断源 irq 的处理耗时，未登记时返回 -1
+int plic_stat(int irq, struct irq_stat *st)
+{
+    if(irq <= 0 || irq >= PLIC_NSRC || plic_handlers[irq] == 0)
+        return -1;
+    memset(st, 0, sizeof(*st));
+    safestrcpy(st->name, plic_names[irq], sizeof(st->name));
+    irq_acct_read(&plic_acct[0][irq], sizeof(plic_acct[0]), st);
+    return 0;
+}
+
+void plic_stat_reset(void)
+{
+    memset(plic_acct, 0, sizeof(plic_acct));
+}
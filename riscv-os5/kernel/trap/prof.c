@@ -0,0 +1,106 @@
+// prof.c: 由时钟中断驱动的采样分析器。开启后 timer_reprogram 把下一次时钟中断
+// 提前到本 hart 的下一个采样时刻，陷入路径在时钟中断时调用 prof_sample 记录
+// 被中断处的 sepc 与 ra。样本放在每个 hart 自己的环形缓冲区中，环满时丢弃新样本并计数，
+// 由 profread 系统调用取出。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "string.h"
+#include "trap.h"
+#include "prof.h"
+
+extern struct spinlock tickslock;
+
+#define PROF_RING 512   // 每个 hart 的样本数
+
+struct prof_ring {
+  struct spinlock lock;
+  uint head;            // 下一个写入位置
+  uint tail;            // 最旧的未读样本
+  uint64 next;          // 下一个采样时刻（time CSR）
+  struct prof_sample buf[PROF_RING];
+};
+
+static struct prof_ring rings[NCPU];
+static uint64 prof_period;     // 采样间隔（time 计数），0 表示关闭
+static uint64 prof_dropped;    // 环满而丢弃的样本数
+
+void prof_init(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&rings[i].lock, "prof");
+}
+
+// 设置采样频率 hz（0 关闭），返回自上次调用以来丢弃的样本数。
+// 当前 hart 立即按新频率重设时钟，其他 hart 在各自的下一次时钟中断时生效
+int prof_set_rate(int hz)
+{
+  if(hz < 0 || hz > PROF_HZ_MAX)
+    return -1;
+  uint64 now = get_time();
+  for(int i = 0; i < NCPU; i++) {
+    acquire(&rings[i].lock);
+    rings[i].next = now;
+    release(&rings[i].lock);
+  }
+  prof_period = hz ? TIMEBASE_FREQ / hz : 0;
+  acquire(&tickslock);
+  timer_reprogram();
+  release(&tickslock);
+  return __sync_lock_test_and_set(&prof_dropped, 0);
+}
+
+// 本 hart 的下一个采样时刻，未开启时返回 0。调用者已关中断
+int prof_next(uint64 *when)
+{
+  if(prof_period == 0)
+    return 0;
+  *when = rings[cpuid()].next;
+  return 1;
+}
+
+// 时钟中断中调用：到达采样时刻时记录一个样本。user 为 1 表示中断发生在用户态
+void prof_sample(int user, uint64 pc, uint64 ra)
+{
+  uint64 period = prof_period;
+  if(period == 0)
+    return;
+
+  struct prof_ring *r = &rings[cpuid()];
+  uint64 now = get_time();
+  acquire(&r->lock);
+  if(now < r->next) {
+    release(&r->lock);
+    return;   // 因其他原因提前到来的时钟中断
+  }
+  r->next = now + period;
+  if(r->head - r->tail == PROF_RING) {
+    __sync_fetch_and_add(&prof_dropped, 1);
+  } else {
+    struct proc *p = myproc();
+    struct prof_sample *s = &r->buf[r->head++ % PROF_RING];
+    s->pid = p ? p->pid : 0;
+    s->mode = user ? PROF_MODE_USER : PROF_MODE_KERNEL;
+    s->pc = pc;
+    s->ra = ra;
+    safestrcpy(s->name, p ? p->name : "idle", sizeof(s->name));
+  }
+  release(&r->lock);
+}
+
+// 依次从各 hart 的环中取出至多 max 个样本，返回取出的个数
+int prof_drain(struct prof_sample *dst, int max)
+{
+  int n = 0;
+
+  for(int i = 0; i < NCPU && n < max; i++) {
+    struct prof_ring *r = &rings[i];
+    acquire(&r->lock);
+    while(n < max && r->tail != r->head)
+      dst[n++] = r->buf[r->tail++ % PROF_RING];
+    release(&r->lock);
+  }
+  return n;
+}
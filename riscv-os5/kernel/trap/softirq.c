@@ -0,0 +1,220 @@
+// softirq.c: 中断下半部。每个 hart 一条工作链表，上半部把工作项挂到自己所在 hart 的链表，
+// 中断返回前（kerneltrap/usertrap 调用 softirq_run）以开中断、禁止抢占的状态逐项执行。
+// 执行期间到来的中断照常处理，但不会再嵌套执行下半部；一次执行的项数或时间超出预算，
+// 或链表已交给 ksoftirqd 时，中断返回路径不再执行，由 ksoftirqd 处理完整条链表后
+// 再交还给中断返回路径。ksoftirqd 固定在自己的 hart 上，只处理本 hart 的链表。
+//
+// 工作项状态：PENDING 表示已挂入某条链表（或执行期间被再次请求），RUNNING 表示正在执行。
+// 挂入时置 PENDING，原本已 PENDING 则合并为一次；原本 RUNNING 则不挂入，由执行者
+// 在回调返回后发现 PENDING 再挂回自己的链表，因此同一工作项不会并发执行。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "percpu.h"
+#include "printf.h"
+#include "string.h"
+#include "trap.h"
+#include "softirq.h"
+#include "irqstat.h"
+
+#define SOFTWORK_PENDING 0x1
+#define SOFTWORK_RUNNING 0x2
+
+#define SOFTIRQ_BUDGET 16                          // 中断返回时一次最多执行的工作项数
+#define SOFTIRQ_TIME_BUDGET (TICK_INTERVAL / 10)   // 以及最长执行时间
+
+struct softirq_cpu {
+  struct spinlock lock;       // 保护链表与 threaded
+  struct softwork *head;
+  struct softwork **tail;
+  int running;                // 中断返回路径正在执行工作项，嵌套的中断不再执行
+  int threaded;               // 链表已交给 ksoftirqd，处理完之前中断返回路径不执行
+  int pid;                    // 本 hart 的 ksoftirqd，尚未创建时为 0
+  struct irq_acct acct[2];    // [0] 中断返回路径，[1] ksoftirqd
+} __attribute__((aligned(CACHELINE)));
+
+static struct softirq_cpu softirq_cpus[NCPU];
+
+static const char *const softirq_names[2] = { "softirq", "ksoftirqd" };
+
+// 挂到 sc 的链表尾，调用者持有 sc->lock
+static void softwork_append(struct softirq_cpu *sc, struct softwork *w)
+{
+  w->next = 0;
+  *sc->tail = w;
+  sc->tail = &w->next;
+}
+
+static struct softwork *softwork_pop(struct softirq_cpu *sc)
+{
+  acquire(&sc->lock);
+  struct softwork *w = sc->head;
+  if(w) {
+    sc->head = w->next;
+    if(sc->head == 0)
+      sc->tail = &sc->head;
+    w->next = 0;
+  }
+  release(&sc->lock);
+  return w;
+}
+
+int softwork_queue(struct softwork *w)
+{
+  uint old = __atomic_fetch_or(&w->state, SOFTWORK_PENDING, __ATOMIC_ACQ_REL);
+  if(old & (SOFTWORK_PENDING | SOFTWORK_RUNNING))
+    return (old & SOFTWORK_PENDING) == 0;   // 正在执行：执行者返回后补做
+
+  push_off();
+  struct softirq_cpu *sc = &softirq_cpus[cpuid()];
+  acquire(&sc->lock);
+  softwork_append(sc, w);
+  release(&sc->lock);
+  pop_off();
+  return 1;
+}
+
+// 执行一个已摘下的工作项并记入 acct，执行期间被再次请求时挂回 sc。调用者已禁止抢占
+static void softwork_call(struct softirq_cpu *sc, struct softwork *w, struct irq_acct *acct)
+{
+  // 链表上的工作项只有 PENDING 位，其他 hart 只会再置一次 PENDING，直接改写不会丢失请求：
+  // 改写前置的并入这次执行，改写后置的在下面补做
+  __atomic_store_n(&w->state, SOFTWORK_RUNNING, __ATOMIC_RELEASE);
+  uint64 start = r_time();
+  w->fn(w->arg);
+  uint64 len = r_time() - start;
+
+  push_off();
+  irq_account(acct, len);
+  if(__atomic_fetch_and(&w->state, ~SOFTWORK_RUNNING, __ATOMIC_ACQ_REL) & SOFTWORK_PENDING) {
+    acquire(&sc->lock);
+    softwork_append(sc, w);
+    release(&sc->lock);
+  }
+  pop_off();
+}
+
+// 把剩余的工作交给 ksoftirqd，调用者关中断
+static void softirq_defer(struct softirq_cpu *sc)
+{
+  acquire(&sc->lock);
+  if(sc->head && !sc->threaded) {
+    sc->threaded = 1;
+    wakeup(&sc->threaded);
+  }
+  release(&sc->lock);
+}
+
+void softirq_run(void)
+{
+  struct cpu *c = mycpu();
+  struct softirq_cpu *sc = &softirq_cpus[cpuid()];
+
+  // 只读链表头作为提示：挂入总在本 hart 关中断时进行，这里读到空就一定没有工作
+  if(sc->head == 0 || sc->running || sc->threaded || c->nested_level > 0)
+    return;
+
+  sc->running = 1;
+  c->preempt_count++;   // 借用被中断者的栈执行，不能在这里被切走
+  intr_on();
+
+  uint64 start = r_time();
+  struct softwork *w;
+  for(int n = 0; (w = softwork_pop(sc)) != 0; ) {
+    softwork_call(sc, w, &sc->acct[0]);
+    if(++n >= SOFTIRQ_BUDGET || r_time() - start >= SOFTIRQ_TIME_BUDGET)
+      break;
+  }
+
+  intr_off();
+  c->preempt_count--;
+  sc->running = 0;
+  if(sc->head && sc->pid > 0)
+    softirq_defer(sc);
+}
+
+// ksoftirqd：处理完本 hart 链表上的全部工作后交还给中断返回路径并睡眠。
+// 工作项之间允许抢占，负载高时下半部与普通进程一起按调度策略分享 CPU
+static void ksoftirqd(void *arg)
+{
+  struct softirq_cpu *sc = arg;
+
+  for(;;) {
+    acquire(&sc->lock);
+    while(!sc->threaded && !kthread_should_stop())
+      sleep(&sc->threaded, &sc->lock);
+    release(&sc->lock);
+    if(kthread_should_stop())
+      return;
+
+    struct softwork *w;
+    for(;;) {
+      preempt_disable();
+      w = softwork_pop(sc);
+      if(w)
+        softwork_call(sc, w, &sc->acct[1]);
+      preempt_enable();
+      if(w == 0)
+        break;
+    }
+
+    acquire(&sc->lock);
+    if(sc->head == 0)
+      sc->threaded = 0;
+    release(&sc->lock);
+  }
+}
+
+void softirq_init(void)
+{
+  for(int i = 0; i < NCPU; i++) {
+    struct softirq_cpu *sc = &softirq_cpus[i];
+    initlock(&sc->lock, "softirq");
+    sc->tail = &sc->head;
+  }
+}
+
+// 进程子系统就绪后为每个 hart 创建 ksoftirqd 并固定在该 hart 上。
+// 创建之前中断返回路径超出预算时把剩余工作留在链表上，下一次中断返回时继续
+void softirq_start(void)
+{
+  for(int i = 0; i < NCPU; i++) {
+    struct softirq_cpu *sc = &softirq_cpus[i];
+    int pid = kthread_create(ksoftirqd, sc, "ksoftirqd");
+    if(pid < 0 || sched_setaffinity(pid, 1ULL << i) < 0)
+      panic("softirq_start");
+    sc->pid = pid;
+  }
+}
+
+// 把 NCPU 份相隔 stride 字节存放的计数累加到 st
+void irq_acct_read(struct irq_acct *a, int stride, struct irq_stat *st)
+{
+  st->count = st->time_total = st->time_max = 0;
+  for(int i = 0; i < NCPU; i++, a = (struct irq_acct *)((char *)a + stride)) {
+    st->count += a->count;
+    st->time_total += a->time_total;
+    if(a->time_max > st->time_max)
+      st->time_max = a->time_max;
+  }
+}
+
+// 读出第 i 项下半部统计（0 为中断返回路径，1 为 ksoftirqd），i 越界时返回 -1
+int softirq_stat(int i, struct irq_stat *st)
+{
+  if(i < 0 || i >= 2)
+    return -1;
+  memset(st, 0, sizeof(*st));
+  safestrcpy(st->name, softirq_names[i], sizeof(st->name));
+  irq_acct_read(&softirq_cpus[0].acct[i], sizeof(struct softirq_cpu), st);
+  return 0;
+}
+
+// 清零，与并发的更新之间没有同步，仅用于测量前
+void softirq_stat_reset(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    memset(softirq_cpus[i].acct, 0, sizeof(softirq_cpus[i].acct));
+}
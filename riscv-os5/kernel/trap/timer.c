@@ -0,0 +1,163 @@
+// timer.c: 两级时间轮实现的内核定时器。
+// 第 0 级 64 个槽，每槽对应 1 个 tick，存放 64 tick 内到期的定时器；
+// 第 1 级 64 个槽，每槽对应 64 个 tick，存放 4096 tick 内到期的定时器，
+// 更远的定时器暂放在第 1 级最远的槽中。时间轮每走完一圈第 0 级，
+// 就把第 1 级当前槽中的定时器按真实到期时间重新分配（级联）。
+// 每个 tick 只处理一个第 0 级槽，开销与到期定时器个数成正比，与定时器总数无关。
+
+#include "types.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "printf.h"
+#include "timer.h"
+
+#define TVR_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_SIZE 64
+#define TVN_MASK (TVN_SIZE - 1)
+#define WHEEL_SPAN ((uint64)TVR_SIZE * TVN_SIZE)
+
+static struct ktimer *tv1[TVR_SIZE];
+static struct ktimer *tv2[TVN_SIZE];
+static uint64 wheel_base;          // 下一个待处理的 tick
+static struct spinlock ktimer_lock;
+
+void ktimer_init(void)
+{
+  initlock(&ktimer_lock, "ktimer");
+  wheel_base = 0;
+}
+
+static void bucket_insert(struct ktimer **head, struct ktimer *t)
+{
+  t->next = *head;
+  if(*head)
+    (*head)->pprev = &t->next;
+  *head = t;
+  t->pprev = head;
+}
+
+static void bucket_remove(struct ktimer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// 在持有 ktimer_lock 的前提下按到期时间把定时器放入对应的槽
+static void wheel_place(struct ktimer *t)
+{
+  uint64 expires = t->expires;
+  if(expires < wheel_base)
+    expires = wheel_base;        // 已经过期：下一次推进时处理
+
+  uint64 delta = expires - wheel_base;
+  if(delta < TVR_SIZE) {
+    bucket_insert(&tv1[expires & TVR_MASK], t);
+  } else {
+    if(delta >= WHEEL_SPAN)
+      expires = wheel_base + WHEEL_SPAN - 1;   // 超出范围，级联时再重新分配
+    bucket_insert(&tv2[(expires >> TVR_BITS) & TVN_MASK], t);
+  }
+}
+
+void ktimer_add(struct ktimer *t, uint64 expires, void (*fn)(void *), void *arg)
+{
+  acquire(&ktimer_lock);
+  if(t->pending)
+    panic("ktimer_add: already pending");
+  t->expires = expires;
+  t->fn = fn;
+  t->arg = arg;
+  t->pending = 1;
+  wheel_place(t);
+  release(&ktimer_lock);
+}
+
+int ktimer_cancel(struct ktimer *t)
+{
+  int was_pending;
+
+  acquire(&ktimer_lock);
+  was_pending = t->pending;
+  if(was_pending) {
+    bucket_remove(t);
+    t->pending = 0;
+  }
+  release(&ktimer_lock);
+  return was_pending;
+}
+
+// 查询最早的到期时间，用于无滴答空闲时设置下一次时钟中断。没有定时器时返回 0。
+// 第 0 级中按槽顺序第一个非空槽即最早到期；第 0 级为空时再取第 1 级中的最小值
+int ktimer_next(uint64 *expires)
+{
+  int found = 0;
+
+  acquire(&ktimer_lock);
+  for(int i = 0; i < TVR_SIZE; i++) {
+    if(tv1[(wheel_base + i) & TVR_MASK]) {
+      *expires = wheel_base + i;
+      found = 1;
+      break;
+    }
+  }
+  for(int i = 0; !found && i < TVN_SIZE; i++) {
+    for(struct ktimer *t = tv2[i]; t; t = t->next) {
+      if(!found || t->expires < *expires) {
+        *expires = t->expires;
+        found = 1;
+      }
+    }
+  }
+  release(&ktimer_lock);
+  return found;
+}
+
+// 把第 1 级对应槽中的定时器按真实到期时间重新放入时间轮
+static void cascade(int index)
+{
+  struct ktimer *t = tv2[index];
+  tv2[index] = 0;
+  while(t) {
+    struct ktimer *next = t->next;
+    t->next = 0;
+    t->pprev = 0;
+    wheel_place(t);
+    t = next;
+  }
+}
+
+void ktimer_run(uint64 now)
+{
+  acquire(&ktimer_lock);
+  while(wheel_base <= now) {
+    int index = wheel_base & TVR_MASK;
+    if(index == 0)
+      cascade((wheel_base >> TVR_BITS) & TVN_MASK);
+
+    // 先把本槽整体摘到局部链表并推进 wheel_base，回调中重新添加的定时器
+    // 不会落回正在处理的槽；链表仍保持 pprev 关系，期间可以被正常取消
+    struct ktimer *expired = tv1[index];
+    tv1[index] = 0;
+    if(expired)
+      expired->pprev = &expired;
+    wheel_base++;
+
+    // 逐个摘下到期的定时器，调用回调前释放锁
+    while(expired) {
+      struct ktimer *t = expired;
+      bucket_remove(t);
+      t->pending = 0;
+      void (*fn)(void *) = t->fn;
+      void *arg = t->arg;
+      release(&ktimer_lock);
+      fn(arg);
+      acquire(&ktimer_lock);
+    }
+  }
+  release(&ktimer_lock);
+}
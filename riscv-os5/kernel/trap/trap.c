@@ -9,6 +9,15 @@
 #include "kalloc.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "timer.h"
+#include "hrtimer.h"
+#include "plic.h"
+#include "percpu.h"
+#include "swap.h"
+#include "softirq.h"
+#include "irqstat.h"
+#include "metrics.h"
+#include "string.h"
 
 extern void kernelvec();
 extern char trampoline[];
@@ -27,6 +36,10 @@ typedef void (*interrupt_handler_t)(void);
 // 中断向量表 - 存储所有中断处理函数指针
 static interrupt_handler_t interrupt_handlers[64] = {0};
 
+// 注册时带 IRQF_NESTABLE 的中断：处理期间屏蔽自身、打开全局中断，允许更高优先级的中断嵌套。
+// 其余中断（时钟等默认情况）走快速路径，在关中断状态下直接调用处理函数，不读写 sie
+static uint8 irq_nestable[64];
+
 // 中断优先级表
 static int irq_priorities[64] = {
     [1] = IRQ_PRIORITY_LOW,
@@ -34,21 +47,70 @@ static int irq_priorities[64] = {
     [9] = IRQ_PRIORITY_HIGH,
 };
 
-// 嵌套中断管理
-static int nested_level = 0;
-static int current_priority = IRQ_PRIORITY_NONE;
+// 嵌套中断管理：层数与当前优先级按 hart 记录在 struct cpu 中
+
+// 各 CPU 中断（scause 中的中断号）处理函数的耗时，irqstat 读出
+#define NIRQ_ACCT 16
+static struct irq_acct irq_acct[NCPU][NIRQ_ACCT];
+static const char *const irq_names[NIRQ_ACCT] = {
+    [1] = "ipi",
+    [5] = "timer",
+    [9] = "external",
+};
+
+// 时钟中断的下半部，每个 hart 一项
+static void timer_softirq(void *arg);
+static struct softwork timer_work[NCPU];
 
 // 系统时间变量
 volatile uint64 ticks = 0;
 struct spinlock tickslock;
 
+// 无滴答时钟：时钟中断不再固定每个 tick 触发，而是按下一个截止点设置 stimecmp，
+// ticks 在中断（或 ticks_sync）中按真实经过的时间补齐
+#define TICKLESS_MAX_TICKS 1000     // 空闲时两次时钟中断之间的最大间隔
+static uint64 tick_time;            // 最近一个 tick 边界对应的 time 值
+static uint64 accounted_ticks[NCPU]; // 各 hart 已计入 scheduler_tick 的 ticks
+
 // 测试用中断计数器
-volatile int interrupt_count = 0;
+struct pcpu_counter interrupt_count;   // 时钟中断次数，每个 hart 各计各的
 volatile int software_interrupt_count = 0;
-volatile int external_interrupt_count = 0;
+static struct pcpu_counter external_interrupt_count;
+
+static struct metric trap_metrics[] = {
+    { .name = "irq.timer", .kind = METRIC_COUNTER, .counter = &interrupt_count },
+    { .name = "irq.external", .kind = METRIC_COUNTER, .counter = &external_interrupt_count },
+};
 
 // 初始化中断系统
 void trap_init(void)
+{
+    initlock(&tickslock, "ticks");
+    ktimer_init();
+    hrtimer_init();
+    softirq_init();
+    for(int i = 0; i < NCPU; i++)
+        timer_work[i] = (struct softwork)SOFTWORK_INIT(timer_softirq, 0);
+
+    //时钟中断
+    register_interrupt(5, timer_interrupt_handler, 0);
+
+    // 外部中断经 PLIC 分发到各设备驱动
+    register_interrupt(9, external_interrupt_handler, 0);
+
+    // S 态软件中断用作核间中断
+    register_interrupt(1, ipi_interrupt_handler, 0);
+    METRICS_REGISTER(trap_metrics);
+
+    tick_time = get_time();
+    vdso_update_ticks(ticks, tick_time, TICK_INTERVAL);
+    trap_inithart();
+    //printf("trap_init: 中断系统初始化完成\n");
+}
+
+// 每个 hart 的陷阱设置：中断向量、sie 中的中断使能与计数器访问权限都是 hart 私有的 CSR，
+// 第一次时钟中断也由各 hart 自己设置。hart 0 在 trap_init 末尾调用，其余 hart 启动时调用
+void trap_inithart(void)
 {
     // 设置中断向量表基地址为 kernelvec
     w_stvec((uint64)kernelvec);
@@ -59,25 +121,25 @@ void trap_init(void)
     // 允许用户态读取 cycle/time/instret 计数器
     w_scounteren(SCOUNTEREN_CY | SCOUNTEREN_TM | SCOUNTEREN_IR);
 
-    initlock(&tickslock, "ticks");
+    mycpu()->nested_level = 0;
+    mycpu()->current_priority = IRQ_PRIORITY_NONE;
+    accounted_ticks[cpuid()] = ticks;
 
     // 全局启用中断
     intr_on();
-
-    //启用时钟中断
-    register_interrupt(5, timer_interrupt_handler);
+    enable_interrupt(1);
     enable_interrupt(5);
+    enable_interrupt(9);
 
-    uint64 now = get_time();
-    sbi_set_timer(now + 1000000); // 约 1ms，可按需调整
-    //printf("trap_init: 中断系统初始化完成\n");
+    sbi_set_timer(get_time() + TICK_INTERVAL);
 }
 
-// 注册中断处理函数
-void register_interrupt(int irq, interrupt_handler_t handler)
+// 注册中断处理函数，flags 为 IRQF_NESTABLE 时该中断的处理函数允许被更高优先级的中断打断
+void register_interrupt(int irq, interrupt_handler_t handler, int flags)
 {
     if (irq >= 0 && irq < 64) {
         interrupt_handlers[irq] = handler;
+        irq_nestable[irq] = (flags & IRQF_NESTABLE) != 0;
         //printf("register_interrupt: 已注册IRQ %d 的处理函数\n", irq);
     }
 }
@@ -87,6 +149,7 @@ void unregister_interrupt(int irq)
 {
     if (irq >= 0 && irq < 64) {
         interrupt_handlers[irq] = 0;
+        irq_nestable[irq] = 0;
         //printf("unregister_interrupt: 已注销IRQ %d 的处理函数\n", irq);
     }
 }
@@ -154,13 +217,48 @@ void disable_interrupt(int irq)
 // 获取嵌套层级
 int get_nested_level(void)
 {
-    return nested_level;
+    return mycpu()->nested_level;
 }
 
 // 获取当前优先级
 int get_current_priority(void)
 {
-    return current_priority;
+    return mycpu()->current_priority;
+}
+
+// 读出第 i 项中断统计：先是登记过处理函数的 CPU 中断，再是 PLIC 的中断源，最后是下半部。
+// 该项未使用时返回 0，i 越界时返回 -1
+int irqstat_read(int i, struct irq_stat *st)
+{
+    if (i < 0)
+        return -1;
+    if (i < NIRQ_ACCT) {
+        if (!interrupt_handlers[i] && irq_acct[0][i].count == 0)
+            return 0;
+        memset(st, 0, sizeof(*st));
+        if (irq_names[i]) {
+            safestrcpy(st->name, irq_names[i], sizeof(st->name));
+        } else {
+            safestrcpy(st->name, "irq00", sizeof(st->name));   // 测试中临时登记的中断
+            st->name[3] = '0' + i / 10;
+            st->name[4] = '0' + i % 10;
+        }
+        irq_acct_read(&irq_acct[0][i], sizeof(irq_acct[0]), st);
+        return 1;
+    }
+    i -= NIRQ_ACCT;
+    if (i < PLIC_NSRC)
+        return plic_stat(i, st) == 0;
+    i -= PLIC_NSRC;
+    return softirq_stat(i, st) == 0 ? 1 : -1;
+}
+
+// 清零全部中断统计，与并发的更新之间没有同步，仅用于测量前
+void irqstat_reset(void)
+{
+    memset(irq_acct, 0, sizeof(irq_acct));
+    plic_stat_reset();
+    softirq_stat_reset();
 }
 
 // 获取当前时间
@@ -178,29 +276,43 @@ void sbi_set_timer(uint64 time)
 // 中断处理链，支持优先级和嵌套
 void handle_interrupt_chain(int irq)
 {
-    if (!interrupt_handlers[irq]) {
+    interrupt_handler_t handler = interrupt_handlers[irq];
+    if (!handler) {
+        return;
+    }
+
+    // 获取当前中断的优先级。处理期间不会切换进程，一直在同一个 hart 上
+    struct cpu *c = mycpu();
+    int irq_priority = irq_priorities[irq];
+
+    // 快速路径：不可嵌套的中断直接在关中断状态下处理，不改写 sie，也不维护嵌套层级。
+    // 只有在某个可嵌套中断的处理期间到来时，才需要按优先级判断是否放行
+    if (!irq_nestable[irq]) {
+        if (c->nested_level > 0 && irq_priority <= c->current_priority)
+            return;
+        uint64 start = r_time();
+        handler();
+        if (irq < NIRQ_ACCT)
+            irq_account(&irq_acct[cpuid()][irq], r_time() - start);
         return;
     }
 
-    // 获取当前中断的优先级
-    int irq_priority = get_interrupt_priority(irq);
-    
     // 检查是否允许嵌套：只有更高优先级的中断才能嵌套
-    if (irq_priority <= current_priority && nested_level > 0) {
+    if (irq_priority <= c->current_priority && c->nested_level > 0) {
         //printf("handle_interrupt_chain: IRQ %d (优先级 %d) 被当前 IRQ (优先级 %d) 阻塞\n", 
-               //irq, irq_priority, current_priority);
+               //irq, irq_priority, c->current_priority);
         return;
     }
 
     // 保存旧状态
-    int old_priority = current_priority;
+    int old_priority = c->current_priority;
     
     // 更新当前状态
-    current_priority = irq_priority;
-    nested_level++;
+    c->current_priority = irq_priority;
+    c->nested_level++;
 
     //printf("handle_interrupt_chain: 开始处理 IRQ %d, 优先级 %d, 嵌套层级 %d\n", 
-           //irq, irq_priority, nested_level);
+           //irq, irq_priority, c->nested_level);
 
     // 禁用当前IRQ以防止重复中断，但允许全局中断以实现嵌套
     disable_interrupt(irq);
@@ -209,18 +321,21 @@ void handle_interrupt_chain(int irq)
     intr_on();
 
     // 执行中断处理函数
-    interrupt_handlers[irq]();
+    uint64 start = r_time();
+    handler();
 
     // 恢复中断状态
     intr_off();
     enable_interrupt(irq);
+    if (irq < NIRQ_ACCT)
+        irq_account(&irq_acct[cpuid()][irq], r_time() - start);
     
     // 恢复优先级
-    current_priority = old_priority;
-    nested_level--;
+    c->current_priority = old_priority;
+    c->nested_level--;
 
     //printf("handle_interrupt_chain: 完成处理 IRQ %d, 恢复优先级 %d, 嵌套层级 %d\n", 
-           //irq, current_priority, nested_level);
+           //irq, c->current_priority, c->nested_level);
 }
 
 
@@ -229,7 +344,7 @@ void software_interrupt_handler(void)
 {
     software_interrupt_count++;
     printf("software_interrupt_handler: 第 %d 次软件中断，嵌套层级 %d\n", 
-           software_interrupt_count, nested_level);
+           software_interrupt_count, mycpu()->nested_level);
     
     // 清除软件中断挂起位
     w_sip(r_sip() & ~(1 << 1));
@@ -239,7 +354,7 @@ void software_interrupt_handler2(void)
 {
     software_interrupt_count++;
     printf("software_interrupt_handler: 第 %d 次软件中断，嵌套层级 %d\n", 
-           software_interrupt_count, nested_level);
+           software_interrupt_count, mycpu()->nested_level);
 
     // 在软件中断处理期间主动触发时钟中断，实现嵌套测试
     uint64 current_time = get_time();
@@ -255,48 +370,113 @@ void software_interrupt_handler2(void)
     w_sip(r_sip() & ~(1 << 1));
 }
 
+// 在持有 tickslock 的前提下，按距上一个 tick 边界经过的时间推进 ticks
+static void ticks_advance_locked(void)
+{
+    uint64 elapsed = (get_time() - tick_time) / TICK_INTERVAL;
+    ticks += elapsed;
+    tick_time += elapsed * TICK_INTERVAL;
+    if(elapsed)
+        vdso_update_ticks(ticks, tick_time, TICK_INTERVAL);
+}
+
+// 读取 ticks 前调用：时钟中断可能间隔多个 tick 才到来，先按真实时间补齐
+void ticks_sync(void)
+{
+    acquire(&tickslock);
+    ticks_advance_locked();
+    release(&tickslock);
+}
+
+// 设置下一次时钟中断：有进程运行时取其时间片末尾，空闲时取最早的定时器，
+// 两者都不存在时最多间隔 TICKLESS_MAX_TICKS；不足一个 tick 的 hrtimer 与采样时刻再把它提前。
+// 会在持有 tickslock 时被调用，因此不加锁
+void timer_reprogram(void)
+{
+    uint64 now = ticks;
+    int left = scheduler_ticks_left();
+    uint64 deadline = now + (left > 0 ? left : TICKLESS_MAX_TICKS);
+
+    uint64 next;
+    if(ktimer_next(&next) && next < deadline)
+        deadline = next;
+    if(deadline <= now)
+        deadline = now + 1;
+
+    // 采样分析开启时，不晚于本 hart 的下一个采样时刻
+    uint64 when = tick_time + (deadline - now) * TICK_INTERVAL;
+    uint64 sample;
+    if(prof_next(&sample) && sample < when)
+        when = sample;
+    uint64 hr;
+    if(hrtimer_next(&hr) && hr < when)
+        when = hr;
+    sbi_set_timer(when);
+}
+
 // 时钟中断处理函数
 void timer_interrupt_handler(void)
 {
-    // 1. 更新系统时间
+    // 1. 更新系统时间（可能一次补上多个 tick；提前到来的中断不推进）
     acquire(&tickslock);
-    ticks++;
-    wakeup((void*)&ticks);
+    ticks_advance_locked();
+    uint64 now = ticks;
+    int elapsed = now - accounted_ticks[cpuid()];
+    accounted_ticks[cpuid()] = now;
     release(&tickslock);
-    scheduler_tick();        // 同步时间片消耗，必要时触发抢占
+    if(elapsed > 0)
+        scheduler_tick(elapsed);  // 同步时间片消耗，必要时触发抢占
+    // 到期定时器的回调（唤醒睡眠者等）放到下半部，中断返回前执行
+    softwork_queue(&timer_work[cpuid()]);
     
     // 2. 增加中断计数（用于测试）
-    interrupt_count++;
+    pcpu_inc(&interrupt_count);
     
     //printf("timer_interrupt_handler: 第 %d 次中断，总ticks = %lu，嵌套层级 %d\n", 
-           //interrupt_count, ticks, nested_level);
+           //interrupt_count, ticks, mycpu()->nested_level);
 
     // 3. 设置下次中断时间
-    uint64 current_time = get_time();
-    uint64 next_time = current_time + 1000000; 
-    sbi_set_timer(next_time);
-    
-   // printf("timer_interrupt_handler: 设置下次中断时间 current=%lu, next=%lu\n", current_time, next_time);
+    timer_reprogram();
 
     // 清除中断挂起位
     w_sip(r_sip() & ~(1 << 5));
 }
 
-// 外部中断处理函数
+// 时钟中断的下半部：处理到期的定时器。回调可能唤醒进程或添加新的定时器，
+// 之后按新的最早到期时间重新设置本 hart 的时钟中断
+static void timer_softirq(void *arg)
+{
+    (void)arg;
+    hrtimer_run(get_time());
+    ktimer_run(ticks);   // 只唤醒到期的定时器，而不是所有睡眠者
+    push_off();
+    timer_reprogram();
+    pop_off();
+}
+
+// 向 hart 发送核间中断
+void ipi_send(int hart)
+{
+    *(volatile uint32 *)SSWI_SETSSIP(hart) = 1;
+}
+
+// 核间中断处理：先清除挂起位再处理请求，处理期间新到的请求会再次置位、再进一次中断
+void ipi_interrupt_handler(void)
+{
+    w_sip(r_sip() & ~SIP_SSIP);
+    tlb_ipi_service();
+}
+
+// 外部中断处理函数：向 PLIC claim 具体的中断源并交给对应驱动。
+// sip.SEIP 由 PLIC 驱动，complete 之后自动撤销，无需软件清除
 void external_interrupt_handler(void)
 {
-    external_interrupt_count++;
-    printf("external_interrupt_handler: 第 %d 次外部中断，嵌套层级 %d\n", 
-           external_interrupt_count, nested_level);    
-    // 注意：实际的外部中断需要查询PLIC来确定具体设备
-    // 这里简化处理，假设只有一个外部中断源
-    
-    // 清除外部中断挂起位
-    w_sip(r_sip() & ~(1 << 9));
+    pcpu_inc(&external_interrupt_count);
+    plic_intr();
 }
 
-// 主中断处理函数（从汇编调用）
-void kerneltrap(void) {
+// 主中断处理函数（从汇编调用），regs 为 kernelvec 在栈上保存的寄存器
+void kerneltrap(uint64 *regs) {
     // 保存上下文
     uint64 sepc = r_sepc();
     uint64 sstatus = r_sstatus();
@@ -313,12 +493,13 @@ void kerneltrap(void) {
         if(interrupt_handlers[interrupt_code]) {
             //interrupt_handlers[interrupt_code]();
             handle_interrupt_chain(interrupt_code);
+            softirq_run();
 
             if(interrupt_code == 5) {
-                struct proc *p = mycpu()->proc;
-                if(p && p->state == RUNNING && (p->exhausted_slice || p->preempt_pending)) {
-                    yield();
-                }
+                prof_sample(0, sepc, regs[0]);
+                // 被打断的内核代码没有持有自旋锁（否则中断是关着的），可以就地抢占；
+                // preempt_disable 区间与被嵌套的中断处理函数除外
+                preempt_point();
             }
         } else {
             printf("未知中断: %lu\n", interrupt_code);
@@ -351,33 +532,64 @@ void usertrap(void)
     // 切换 stvec 到内核常驻入口，避免嵌套用户态入口
     w_stvec((uint64)kernelvec);
 
-    // 记录用户态下一条指令地址（可能被系统调用调整）
-    p->trapframe->epc = sepc;
+    // 上次返回用户态以来的时间记为用户态时间
+    uint64 now = get_time();
+    p->utime += now - p->acct_time;
+    p->acct_time = now;
+
+    // 记录浮点寄存器是否被写过，内核中关闭 FPU
+    fpu_trap_entry(p, sstatus);
 
     if(scause == 8) {
-        // 系统调用
+        // 系统调用快速路径：跳过 ecall 后直接执行并返回，不经过下面的中断/异常分派
         if(p->killed) {
             exit_process(-1);
             return;
         }
 
-        p->trapframe->epc += 4;   // 跳过 ecall
+        p->trapframe->epc = sepc + 4;
         intr_on();                // 允许在系统调用执行期间响应中断
         syscall();
-    } else if(scause & (1ULL << 63)) {
+
+        if(p->killed)
+            exit_process(-1);
+        usertrapret();
+        return;
+    }
+
+    // 记录用户态下一条指令地址
+    p->trapframe->epc = sepc;
+
+    if(scause & (1ULL << 63)) {
         // 外设中断
         uint64 irq = scause & ~(1ULL << 63);
         handle_interrupt_chain(irq);
+        softirq_run();
+        if(irq == 5)
+            prof_sample(1, sepc, p->trapframe->ra);
 
-        // 简化调度策略：时钟中断触发一次主动让出 CPU
-        if(irq == 5 && p->state == RUNNING && p->exhausted_slice)
+        // 时钟中断时检查时间片是否用完，或是否有更高优先级（如 SCHED_FIFO）的进程等待抢占
+        if(irq == 5 && p->state == RUNNING && (p->exhausted_slice || p->preempt_pending))
             yield();
     } else {
         int handled = 0;
-        if(scause == 15 || scause == 13){
-            if(cow_resolve(p->pagetable, stval) == 0){
+        if(scause == 15 || scause == 13 || scause == 12){
+            // 先尝试写时复制，再尝试按需分配（sbrk 堆与 exec BSS）与换入，
+            // 最后检查是否只是本 hart 的 TLB 中还留着权限更窄的旧条目。
+            // 因内存不足而失败时先同步换出一批页，返回用户态重新执行该指令
+            unsigned long failures = pmm_alloc_failures();
+            uint64 start = fault_begin();
+            if(cow_resolve(p->pagetable, stval) == 0 ||
+               lazy_resolve(p->pagetable, stval, scause == 15) == 0 ||
+               (scause != 12 && uvm_spurious_fault(p->pagetable, stval, scause == 15) == 0)){
+                handled = 1;
+                fault_end(stval, sepc, start, 0);
+            } else if(pmm_alloc_failures() != failures && swap_reclaim_direct() > 0) {
                 handled = 1;
             }
+        } else if(scause == 2 && fpu_first_use(p) == 0) {
+            // 首次执行浮点指令：启用 FPU 后不前进 epc，返回时重新执行该指令
+            handled = 1;
         }
         if(!handled){
             // 无法通过写时复制修复的异常，按原逻辑终止进程
@@ -408,31 +620,38 @@ void usertrapret(void)
 
     intr_off();
 
+    // 陷入（或切换回来）以来的时间记为内核态时间
+    uint64 now = get_time();
+    p->stime += now - p->acct_time;
+    p->acct_time = now;
+
     // 设置 stvec 指向 trampoline 中的 uservec
     w_stvec(TRAMPOLINE + ((uint64)uservec - (uint64)trampoline));
 
-    // 准备 trapframe 中供 trampoline 使用的几个关键字段
-    tf->kernel_satp = MAKE_SATP(kernel_pagetable);
-    tf->kernel_sp = p->kstack + PGSIZE;
-    tf->kernel_trap = (uint64)usertrap;
+    // kernel_satp/kernel_sp/kernel_trap 在创建进程时已写入陷阱帧；
+    // 只有 hart 编号会因迁移而变化，下次陷入时 uservec 据此恢复 tp
+    tf->kernel_hartid = r_tp();
 
     // 配置 sstatus：清除 SPP，设置 SPIE，使得 sret 返回到用户态并开启中断
     uint64 sstatus = r_sstatus();
     sstatus &= ~SSTATUS_SPP;
     sstatus |= SSTATUS_SPIE;
+    // 使用过浮点的进程按需装载浮点寄存器并以 Clean 返回，其余进程保持 FPU 关闭
+    sstatus = (sstatus & ~SSTATUS_FS_MASK) | fpu_user_return(p);
     w_sstatus(sstatus);
 
     // sepc 指向用户态下一条需要执行的指令
     w_sepc(tf->epc);
 
-    // 切换到用户页表并跳转到 trampoline 的 userret
-    satp = MAKE_SATP(p->pagetable);
+    // 执行本次陷入期间累计的 TLB 刷新，再带上进程 ASID 切换到用户页表
+    tlb_sync(p);
+    satp = MAKE_SATP_ASID(p->pagetable, p->asid);
     fn = TRAMPOLINE + ((uint64)userret - (uint64)trampoline);
 
     // 调试：即将跳转到 trampoline
     //printf("[usertrapret] 即将跳转到 trampoline userret...\n");
 
-    ((void (*)(uint64, uint64))fn)(satp, (uint64)tf);
+    ((void (*)(uint64, uint64))fn)(satp, p->trapframe_va);
 
     // 如果没有跳转成功，输出错误
     printf("[usertrapret] 跳转到用户态失败，返回到内核！\n");
@@ -543,10 +762,10 @@ void test_timer_interrupt(void)
     
     // 记录中断前的时间
     uint64 start_time = get_time();
-    int initial_count = interrupt_count;
+    int initial_count = (int)pcpu_read(&interrupt_count);
     
     // 注册时钟中断处理函数
-    register_interrupt(5, timer_interrupt_handler);
+    register_interrupt(5, timer_interrupt_handler, 0);
     enable_interrupt(5);
     
     printf("sie = 0x%lx, sip = 0x%lx\n", r_sie(), r_sip());
@@ -559,9 +778,9 @@ void test_timer_interrupt(void)
     printf("等待5次中断...\n");
     
     // 等待几次中断
-    while (interrupt_count < initial_count + 5) {
+    while ((int)pcpu_read(&interrupt_count) < initial_count + 5) {
         // 可以在这里执行其他任务
-        printf("等待中断 %d... 当前时间: %lu\n", interrupt_count - initial_count + 1, get_time());
+        printf("等待中断 %d... 当前时间: %lu\n", (int)pcpu_read(&interrupt_count) - initial_count + 1, get_time());
         
         // 简单延时
         for (volatile int i = 0; i < 1000000; i++);
@@ -569,7 +788,7 @@ void test_timer_interrupt(void)
     
     uint64 end_time = get_time();
     printf("时钟中断测试完成: %d 次中断，用时 %lu 周期\n", 
-           interrupt_count - initial_count, end_time - start_time);
+           (int)pcpu_read(&interrupt_count) - initial_count, end_time - start_time);
     
     // 清理
     disable_interrupt(5);
@@ -581,7 +800,7 @@ void test_software_interrupt(void)
     printf("测试软件中断...\n");
     
     // 注册软件中断处理函数
-    register_interrupt(1, software_interrupt_handler);
+    register_interrupt(1, software_interrupt_handler, 0);
     enable_interrupt(1);
     
     int initial_count = software_interrupt_count;
@@ -601,7 +820,7 @@ void test_software_interrupt(void)
            3, software_interrupt_count - initial_count);
     
     // 清理
-    disable_interrupt(1);
+    register_interrupt(1, ipi_interrupt_handler, 0);   // 软件中断仍留作核间中断
 }
 
 void test_exception_handling(void) { 
@@ -652,21 +871,42 @@ void test_exception_handling(void) {
         w_sip(r_sip() & ~(1 << 1));
     }
 
+static volatile int dispatch_count = 0;
+static void dispatch_handler(void) {
+    dispatch_count++;
+    w_sip(r_sip() & ~(1 << 1));
+}
+
+// 连续触发 n 次软件中断，返回平均每次从置位到处理完成的耗时
+static uint64 measure_dispatch(int flags, int n) {
+    register_interrupt(1, dispatch_handler, flags);
+    enable_interrupt(1);
+    dispatch_count = 0;
+    uint64 start = get_time();
+    for (int i = 0; i < n; i++) {
+        w_sip(r_sip() | (1 << 1));
+        while (dispatch_count <= i);
+    }
+    uint64 total = get_time() - start;
+    register_interrupt(1, ipi_interrupt_handler, 0);   // 软件中断仍留作核间中断
+    return total / n;
+}
+
 //待扩充，等实现其他中断后再来
 void test_interrupt_overhead(void) {
     printf("测试中断处理开销...\n");
 
     // 1. 测量中断处理的时间开销
-    register_interrupt(5, timer_interrupt_handler);
+    register_interrupt(5, timer_interrupt_handler, 0);
     enable_interrupt(5);
 
     uint64 interval = 10000;
     int test_count = 100;
-    interrupt_count = 0;
+    pcpu_reset(&interrupt_count);
     uint64 start_time = get_time();
     sbi_set_timer(start_time + interval);
 
-    while (interrupt_count < test_count) {
+    while ((int)pcpu_read(&interrupt_count) < test_count) {
         // 等待中断
     }
     uint64 end_time = get_time();
@@ -679,7 +919,7 @@ void test_interrupt_overhead(void) {
     disable_interrupt(5);
 
     // 2. 测量上下文切换的成本（模拟：主循环和中断处理函数各读一次时间戳）
-    register_interrupt(1, ctx_switch_handler);
+    register_interrupt(1, ctx_switch_handler, 0);
     enable_interrupt(1);
 
     ctx_switch_start = get_time();
@@ -687,20 +927,20 @@ void test_interrupt_overhead(void) {
     while (ctx_switch_end == 0); // 等待中断处理完成
     printf("[2] 上下文切换成本: %lu 周期\n", ctx_switch_end - ctx_switch_start);
 
-    disable_interrupt(1);
+    register_interrupt(1, ipi_interrupt_handler, 0);   // 软件中断仍留作核间中断
 
     // 3. 分析中断频率对系统性能的影响
     uint64 intervals[] = {100000, 10000, 1000};
     for (int i = 0; i < 3; i++) {
         interval = intervals[i];
-        interrupt_count = 0;
-        register_interrupt(5, timer_interrupt_handler);
+        pcpu_reset(&interrupt_count);
+        register_interrupt(5, timer_interrupt_handler, 0);
         enable_interrupt(5);
 
         start_time = get_time();
         sbi_set_timer(start_time + interval);
 
-        while (interrupt_count < test_count) {
+        while ((int)pcpu_read(&interrupt_count) < test_count) {
             // 等待中断
         }
         end_time = get_time();
@@ -711,13 +951,18 @@ void test_interrupt_overhead(void) {
         disable_interrupt(5);
     }
 
+    // 4. 中断分发路径的开销：不可嵌套的快速路径与可嵌套路径（额外改写 sie、开关全局中断）
+    uint64 fast = measure_dispatch(0, 1000);
+    uint64 nested = measure_dispatch(IRQF_NESTABLE, 1000);
+    printf("[4] 平均每次软件中断: 快速路径=%lu, 可嵌套路径=%lu\n", fast, nested);
+
     printf("中断处理性能测试完成。\n");
 }
 
 // 新增低优先级中断处理函数
 void high_priority_interrupt_handler(void)
 {
-    printf("high_priority_interrupt_handler: 进入高优先级中断，嵌套层级 %d\n", nested_level);
+    printf("high_priority_interrupt_handler: 进入高优先级中断，嵌套层级 %d\n", mycpu()->nested_level);
     // 清除虚拟低优先级中断挂起位（假设用第10号中断）
     w_sip(r_sip() & ~(1 << 10));
 }
@@ -733,19 +978,19 @@ void test_nested_interrupts(void)
     set_interrupt_priority(10, IRQ_PRIORITY_NONE);
 
     // 注册中断处理函数
-    register_interrupt(1, software_interrupt_handler2);
-    register_interrupt(5, timer_interrupt_handler);
-    register_interrupt(10, high_priority_interrupt_handler);
+    register_interrupt(1, software_interrupt_handler2, IRQF_NESTABLE);   // 处理期间允许时钟中断嵌套
+    register_interrupt(5, timer_interrupt_handler, 0);
+    register_interrupt(10, high_priority_interrupt_handler, 0);
 
     // 启用中断
     enable_interrupt(1);
     enable_interrupt(5);
     enable_interrupt(10);
 
-    printf("初始状态: 嵌套层级=%d, 当前优先级=%d\n", nested_level, current_priority);
+    printf("初始状态: 嵌套层级=%d, 当前优先级=%d\n", mycpu()->nested_level, mycpu()->current_priority);
 
     int initial_software_count = software_interrupt_count;
-    int initial_timer_count = interrupt_count;
+    int initial_timer_count = (int)pcpu_read(&interrupt_count);
 
     // 触发软件中断
     printf("触发低优先级软件中断...\n");
@@ -753,7 +998,7 @@ void test_nested_interrupts(void)
 
     // 等待嵌套的中断发生
     int timeout = 1000000;
-    while (interrupt_count == initial_timer_count && timeout-- > 0) {
+    while ((int)pcpu_read(&interrupt_count) == initial_timer_count && timeout-- > 0) {
         for (volatile int i = 0; i < 1000; i++);
     }
 
@@ -763,11 +1008,11 @@ void test_nested_interrupts(void)
 
     printf("测试完成统计:\n");
     printf("  软件中断: %d 次 (优先级: 低)\n", software_interrupt_count - initial_software_count);
-    printf("  时钟中断: %d 次 (优先级: 中)\n", interrupt_count - initial_timer_count);
-    printf("  最终嵌套层级: %d\n", nested_level);
+    printf("  时钟中断: %d 次 (优先级: 中)\n", (int)pcpu_read(&interrupt_count) - initial_timer_count);
+    printf("  最终嵌套层级: %d\n", mycpu()->nested_level);
 
     // 清理
-    disable_interrupt(1);
+    register_interrupt(1, ipi_interrupt_handler, 0);   // 软件中断仍留作核间中断
     disable_interrupt(5);
     disable_interrupt(10);
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+
+use Cwd qw(abs_path);
+use File::Basename qw(dirname);
+
+my $script_dir = dirname(abs_path($0));
+my $repo_root  = abs_path("$script_dir/..");
+my $sym_file   = "$repo_root/user/ulib.syms";
+my $jump_file  = "$repo_root/user/ulibjmp.S";
+my $stub_file  = "$repo_root/user/ulibstub.S";
+
+open my $sym_fh, '<', $sym_file
+  or die "Failed to open $sym_file: $!\n";
+
+my @syms;
+my %seen;
+while (my $line = <$sym_fh>) {
+    $line =~ s/#.*//;
+    $line =~ s/^\s+|\s+$//g;
+    next if $line eq '';
+    die "Bad symbol name '$line' in $sym_file\n" unless $line =~ /^\w+$/;
+    die "Duplicate symbol '$line' in $sym_file\n" if $seen{$line}++;
+    push @syms, $line;
+}
+close $sym_fh;
+
+die "No symbols found in $sym_file\n" unless @syms;
+
+my $nslot = scalar @syms;
+
+my @jump = (
+    "# generated by scripts/gen_ulib.pl - do not edit",
+    "# based on user/ulib.syms; slot i jumps to the i-th exported function",
+    "",
+    "#include \"ulibrt.h\"",
+    "",
+    "# image header checked by the kernel (struct ulib_header)",
+    "\t.section .ulib.header, \"a\"",
+    "\t.word ULIB_MAGIC",
+    "\t.word $nslot",
+    "\t.word __ulib_text_size",
+    "\t.word __ulib_data_size",
+    "\t.word __ulib_mem_size",
+    "\t.word 0, 0, 0",
+    "",
+    "# every slot is exactly ULIB_SLOT_SIZE bytes: no relaxation may shrink it",
+    "\t.section .ulib.jump, \"ax\"",
+    "\t.option push",
+    "\t.option norelax",
+);
+for my $i (0 .. $#syms) {
+    push @jump, "\ttail $syms[$i]\t\t# slot $i";
+}
+push @jump, "\t.option pop";
+
+my @stub = (
+    "# generated by scripts/gen_ulib.pl - do not edit",
+    "# based on user/ulib.syms; programs call the shared runtime through",
+    "# these fixed jump table addresses instead of linking the library.",
+    "",
+    "#include \"ulibrt.h\"",
+    "",
+    "\t.globl errno",
+    "\t.equ errno, ULIB_ERRNO_VA",
+    "",
+);
+for my $i (0 .. $#syms) {
+    push @stub,
+        "\t.globl $syms[$i]",
+        "\t.equ $syms[$i], ULIB_JUMP_VA + $i * ULIB_SLOT_SIZE";
+}
+
+for my $out ([$jump_file, \@jump], [$stub_file, \@stub]) {
+    my ($file, $lines) = @$out;
+    open my $out_fh, '>', $file
+      or die "Failed to write $file: $!\n";
+    print {$out_fh} join("\n", @$lines) . "\n";
+    close $out_fh;
+}
+
+printf "Generated user/ulibjmp.S and user/ulibstub.S for %d slots\n", $nslot;
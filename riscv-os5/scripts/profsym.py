@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# profsym.py: 把 user/prof 打印到控制台的样本对照 kernel.elf 与用户程序的 ELF 符号化，
+# 输出平面剖析（按函数统计样本数）以及供 flamegraph.pl 使用的折叠栈。
+#
+#   python3 scripts/profsym.py console.log                  # 平面剖析
+#   python3 scripts/profsym.py --folded out.folded console.log
+#   flamegraph.pl out.folded > prof.svg
+#
+# 样本只含被中断处的 pc 与 ra，折叠栈因此只有“调用者;函数”两层；
+# ra 在非叶函数中可能已被覆盖，调用者一层仅供参考。
+
+import argparse
+import bisect
+import os
+import re
+import shutil
+import subprocess
+import sys
+from collections import Counter
+
+SAMPLE_RE = re.compile(r'\[prof\] (\d+) (\S+) ([uk]) ([0-9a-f]+) ([0-9a-f]+)\s*$')
+NM_CANDIDATES = ['riscv64-unknown-elf-nm', 'riscv64-elf-nm', 'riscv64-linux-gnu-nm', 'nm']
+
+
+class Symtab:
+    def __init__(self, nm, path):
+        self.addrs, self.names = [], []
+        if path is None or not os.path.exists(path):
+            return
+        out = subprocess.run([nm, '-n', '--defined-only', path],
+                             capture_output=True, text=True, check=True).stdout
+        for line in out.splitlines():
+            parts = line.split()
+            if len(parts) == 3 and parts[1] in 'TtWw':
+                self.addrs.append(int(parts[0], 16))
+                self.names.append(parts[2])
+
+    def lookup(self, addr, tag):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i < 0:
+            return '[%s]+0x%x' % (tag, addr)
+        return self.names[i]
+
+
+def find_user_elf(user_dir, name):
+    for root, _, files in os.walk(user_dir):
+        if name + '.elf' in files:
+            return os.path.join(root, name + '.elf')
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description='符号化 user/prof 的采样输出')
+    ap.add_argument('log', help='包含 [prof] 行的控制台输出')
+    ap.add_argument('--kernel', default='kernel.elf')
+    ap.add_argument('--user-dir', default='user')
+    ap.add_argument('--nm', default=os.environ.get('NM'))
+    ap.add_argument('--folded', help='把折叠栈写入该文件')
+    ap.add_argument('--top', type=int, default=30, help='平面剖析列出的函数数')
+    args = ap.parse_args()
+
+    nm = args.nm or next((c for c in NM_CANDIDATES if shutil.which(c)), None)
+    if nm is None:
+        sys.exit('profsym: 找不到 nm，请用 --nm 指定')
+
+    kernel = Symtab(nm, args.kernel)
+    users = {}
+    flat, folded = Counter(), Counter()
+    total = 0
+
+    with open(args.log, errors='replace') as f:
+        for line in f:
+            m = SAMPLE_RE.search(line)
+            if not m:
+                continue
+            _, name, mode, pc, ra = m.groups()
+            pc, ra = int(pc, 16), int(ra, 16)
+            if mode == 'k':
+                tab, tag = kernel, 'kernel'
+            else:
+                if name not in users:
+                    users[name] = Symtab(nm, find_user_elf(args.user_dir, name))
+                tab, tag = users[name], name
+            func = tab.lookup(pc, tag)
+            caller = tab.lookup(ra, tag)
+            flat[(mode, func)] += 1
+            stack = [name, 'kernel' if mode == 'k' else 'user']
+            if caller != func:
+                stack.append(caller)
+            stack.append(func)
+            folded[';'.join(stack)] += 1
+            total += 1
+
+    if total == 0:
+        sys.exit('profsym: 日志中没有样本')
+
+    print('%8s %6s  %s' % ('samples', '%', 'function'))
+    for (mode, func), n in flat.most_common(args.top):
+        print('%8d %5.1f%%  %s [%s]' % (n, 100.0 * n / total, func, mode))
+    print('%8d total' % total)
+
+    if args.folded:
+        with open(args.folded, 'w') as out:
+            for stack, n in sorted(folded.items()):
+                out.write('%s %d\n' % (stack, n))
+
+
+if __name__ == '__main__':
+    main()
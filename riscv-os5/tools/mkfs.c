@@ -4,150 +4,65 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
-#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 磁盘格式与内核共用 include/fsformat.h（Makefile 以 -iquote include 编译本工具，
+// include/ 下内核自己的 string.h 等不会遮住主机的系统头文件）
+#include "types.h"
+#include "fsformat.h"
 
 // ============================================================================
-// 文件系统常量定义 - 必须与内核中的定义完全一致
+// 默认几何参数，均可在命令行指定
 // ============================================================================
 
-#define BLOCK_SIZE 4096           // 块大小
-#define FS_TOTAL_BLOCKS 2000      // 文件系统总块数
-
-// Inode类型
-#define T_DIR  1   // 目录
-#define T_FILE 2   // 文件
-#define T_DEV  3   // 设备
-#define T_SYMLINK 4 // 符号链接
-
-// 目录项大小
-#define DIRSIZ 14
+#define FS_TOTAL_BLOCKS 8192      // 默认总块数（32MB），-s
+#define NINODES 1024              // 默认 inode 数，-i
+// 默认日志块数，-l。日志区全部清零即可：两份头部的魔数都无效，内核不会重放
+#define LOG_SIZE 126
 
-// 文件系统魔数
-#define FS_MAGIC 0x20241031
-
-// 每个块中的inode数
-#define IPB (BLOCK_SIZE / sizeof(struct dinode))
-
-// 每个块中的目录项数  
+// 每个块中的目录项数
 #define DPB (BLOCK_SIZE / sizeof(struct dirent))
 
-// 每个位图块管理的块数
-#define BPB (BLOCK_SIZE * 8)
-
-// 日志块数
-#define LOG_SIZE 30
-
-// 最大inode数
-#define NINODES 50
-
-// 根inode号
-#define ROOTINO 1
-
-// 直接块数
-#define NDIRECT 12
-// 间接块数
-#define NINDIRECT (BLOCK_SIZE / sizeof(uint32_t))
-#define NDOUBLE (NINDIRECT * NINDIRECT)
-#define MAXFILE (NDIRECT + NINDIRECT + NDOUBLE)
-
-// 文件系统布局常量
-#define SUPERBLOCK_BLOCKNO 1
-#define SUPERBLOCK_NUM 1
-#define LOG_START (SUPERBLOCK_BLOCKNO + SUPERBLOCK_NUM)
-#define INODE_START (LOG_START + LOG_SIZE)
-#define INODE_BLOCKS 13
-#define BMAP_START (INODE_START + INODE_BLOCKS)
-#define BMAP_BLOCKS 1
-#define DATA_START (BMAP_START + BMAP_BLOCKS)
-
-// ============================================================================
-// 文件系统数据结构定义 - 必须与内核中的定义完全一致
-// ============================================================================
-
-// 目录项结构
-struct dirent {
-  uint16_t inum;
-  char name[DIRSIZ];
-};
-
-// 磁盘inode结构 - 与fs.h完全一致
-struct dinode {
-  short type;                   // 文件类型
-  short major;                  // 设备主编号
-  short minor;                  // 设备次编号
-  short nlink;                  // 链接数
-  uint32_t size;                // 文件大小（字节）
-  uint32_t addrs[NDIRECT + 2];  // 数据块地址（直接块 + 一级间接 + 二级间接）
-};
-
-// 超级块结构 - 与fs.h完全一致
-struct superblock {
-  uint32_t magic;        // 魔数
-  uint32_t size;         // 文件系统映像大小（块数）
-  uint32_t nblocks;      // 数据块数
-  uint32_t ninodes;      // inode数
-  uint32_t nlog;         // 日志块数
-  uint32_t logstart;     // 第一个日志块
-  uint32_t inodestart;   // 第一个inode块
-  uint32_t bmapstart;    // 第一个位图块
-};
+// 根目录最多的目录项数（含 "." 与 ".."）
+#define MAX_ROOT_ENTRIES 4096
 
 // ============================================================================
 // 全局变量
 // ============================================================================
 
 int nbitmap;              // 位图块数量
-int ninodeblocks;         // inode块数量  
+int ninodeblocks;         // inode块数量
 int nlog;                 // 日志块数量
 int nmeta;                // 元数据块总数
 int nblocks;              // 数据块总数
+int fsblocks;             // 文件系统总块数
 
-int fsfd;                 // 文件系统镜像文件描述符
+// 镜像以 MAP_SHARED 整体映射进来：ftruncate 出的文件读起来全为 0，无需逐块清零，
+// 各块的读写都是内存访问，文件内容直接 read 进映射区，不经中间缓冲
+char *img;
 struct superblock sb;     // 超级块
-char zeroes[BLOCK_SIZE];  // 全零块，用于初始化
-uint32_t freeinode = 1;   // 下一个空闲inode编号
-uint32_t freeblock;       // 下一个空闲数据块编号
-
-// ============================================================================
-// 函数声明
-// ============================================================================
-
-void balloc(int used);
-void wsect(uint32_t sec, void *buf);
-void winode(uint32_t inum, struct dinode *ip);
-void rinode(uint32_t inum, struct dinode *ip);
-void rsect(uint32_t sec, void *buf);
-uint32_t ialloc(short type);
-void iappend(uint32_t inum, void *p, int n);
-void die(const char *s);
+uint32 freeinode = 1;     // 下一个空闲inode编号
+uint32 freeblock;         // 下一个空闲数据块编号
+int hashdir;              // 根目录是否使用散列格式
 
-// 计算inode所在的块号
-#define IBLOCK(i, sb) ((i) / IPB + (sb).inodestart)
-#define BBLOCK(b, sb) ((b) / BPB + (sb).bmapstart)
+// 根目录的目录项先收集起来，全部文件写完后一次性写入，目录块因此不会夹在文件数据之间
+struct dirent rootents[MAX_ROOT_ENTRIES];
+int nrootents;
 
-// 取最小值
-#define min(a, b) ((a) < (b) ? (a) : (b))
+// 块号 b 在映射区中的地址
+#define BLK(b) (img + (uint64)(b) * BLOCK_SIZE)
 
 // ============================================================================
 // 工具函数
 // ============================================================================
 
 // 字节序转换：主机字节序 -> 小端字节序
-uint16_t xshort(uint16_t x) {
-  uint16_t y;
-  unsigned char *a = (unsigned char*)&y;
-  a[0] = x;
-  a[1] = x >> 8;
-  return y;
-}
-
-uint32_t xint(uint32_t x) {
-  uint32_t y;
+uint16 xshort(uint16 x) {
+  uint16 y;
   unsigned char *a = (unsigned char*)&y;
   a[0] = x;
   a[1] = x >> 8;
-  a[2] = x >> 16;
-  a[3] = x >> 24;
   return y;
 }
 
@@ -157,170 +72,169 @@ void die(const char *s) {
   exit(1);
 }
 
-// ============================================================================
-// 磁盘操作函数
-// ============================================================================
-
-// 写入指定扇区
-void wsect(uint32_t sec, void *buf) {
-  if (lseek(fsfd, sec * BLOCK_SIZE, 0) != sec * BLOCK_SIZE)
-    die("lseek");
-  if (write(fsfd, buf, BLOCK_SIZE) != BLOCK_SIZE)
-    die("write");
+// 从数据区连续分配 n 块，返回首块号。映射区初始为 0，新块无需清零
+uint32 alloc_blocks(uint32 n) {
+  if (freeblock + n > (uint32)fsblocks) {
+    fprintf(stderr, "镜像空间不足: 还需 %u 块，剩余 %u 块\n", n, fsblocks - freeblock);
+    exit(1);
+  }
+  uint32 b = freeblock;
+  freeblock += n;
+  return b;
 }
 
-// 读取指定扇区
-void rsect(uint32_t sec, void *buf) {
-  if (lseek(fsfd, sec * BLOCK_SIZE, 0) != sec * BLOCK_SIZE)
-    die("lseek");
-  if (read(fsfd, buf, BLOCK_SIZE) != BLOCK_SIZE)
-    die("read");
+// inode 在映射区中的位置
+struct dinode *iptr(uint32 inum) {
+  return (struct dinode *)BLK(IBLOCK(inum, sb)) + inum % IPB;
 }
 
-// 写入inode
-void winode(uint32_t inum, struct dinode *ip) {
-  char buf[BLOCK_SIZE];
-  uint32_t bn;
-  struct dinode *dip;
-
-  bn = IBLOCK(inum, sb);
-  rsect(bn, buf);
-  dip = ((struct dinode*)buf) + (inum % IPB);
-  *dip = *ip;
-  wsect(bn, buf);
+// 分配inode：新建的普通文件与内核一致，超级块带 FS_FEAT_EXTENTS 时使用区段格式
+uint32 ialloc(short type) {
+  uint32 inum = freeinode++;
+  struct dinode *din;
+
+  if (inum >= sb.ninodes) {
+    fprintf(stderr, "inode 不足: 共 %u 个\n", sb.ninodes);
+    exit(1);
+  }
+  din = iptr(inum);
+  memset(din, 0, sizeof(*din));
+  din->type = type;
+  din->nlink = 1;
+  if (type == T_FILE && (sb.features & FS_FEAT_EXTENTS))
+    din->flags = DI_EXTENTS;
+  return inum;
 }
 
-// 读取inode
-void rinode(uint32_t inum, struct dinode *ip) {
-  char buf[BLOCK_SIZE];
-  uint32_t bn;
-  struct dinode *dip;
+// 把文件的第 fbn 块映射到物理块 pblk（间接块格式），间接块按需从数据区分配
+void imap(struct dinode *din, uint32 fbn, uint32 pblk) {
+  uint32 *ind;
 
-  bn = IBLOCK(inum, sb);
-  rsect(bn, buf);
-  dip = ((struct dinode*)buf) + (inum % IPB);
-  *ip = *dip;
+  assert(fbn < MAX_FILE_BLOCKS);
+  if (fbn < NDIRECT) {
+    din->addrs[fbn] = pblk;
+    return;
+  }
+  fbn -= NDIRECT;
+  if (fbn < NINDIRECT) {
+    if (din->addrs[NDIRECT] == 0)
+      din->addrs[NDIRECT] = alloc_blocks(1);
+    ind = (uint32 *)BLK(din->addrs[NDIRECT]);
+    ind[fbn] = pblk;
+    return;
+  }
+  fbn -= NINDIRECT;
+  if (din->addrs[NDIRECT + 1] == 0)
+    din->addrs[NDIRECT + 1] = alloc_blocks(1);
+  ind = (uint32 *)BLK(din->addrs[NDIRECT + 1]);
+  if (ind[fbn / NINDIRECT] == 0)
+    ind[fbn / NINDIRECT] = alloc_blocks(1);
+  ind = (uint32 *)BLK(ind[fbn / NINDIRECT]);
+  ind[fbn % NINDIRECT] = pblk;
 }
 
-// ============================================================================
-// 分配函数
-// ============================================================================
+// 让 inode 引用从 start 起物理连续的 n 块。区段格式只需一个内联区段；
+// 间接块格式的间接块排在数据块之后，不打断数据的连续性
+void ilayout(struct dinode *din, uint32 start, uint32 n) {
+  if (din->flags & DI_EXTENTS) {
+    struct extent *e = (struct extent *)din->addrs;
+    if (n > 0) {
+      e[0].lblk = 0;
+      e[0].pblk = start;
+      e[0].len = n;
+    }
+    din->addrs[NDIRECT + 1] = n > 0;
+    return;
+  }
+  for (uint32 i = 0; i < n; i++)
+    imap(din, i, start + i);
+}
 
-// 分配inode
-uint32_t ialloc(short type) {
-  uint32_t inum = freeinode++;
-  struct dinode din;
-
-  memset(&din, 0, sizeof(din));
-  din.type = type;
-  din.major = 0;
-  din.minor = 0;
-  din.nlink = 1;
-  din.size = 0;
-  winode(inum, &din);
-  return inum;
+// 把 fd 中的 size 字节写入 inode：数据块一次性连续分配，内容直接读进映射区
+void iwrite_file(uint32 inum, int fd, uint64 size) {
+  struct dinode *din = iptr(inum);
+  uint32 n = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+  if (n > MAX_FILE_BLOCKS) {
+    fprintf(stderr, "文件过大: %lu 字节\n", size);
+    exit(1);
+  }
+  uint32 start = alloc_blocks(n);
+  char *p = BLK(start);
+  for (uint64 off = 0; off < size; ) {
+    ssize_t cc = read(fd, p + off, size - off);
+    if (cc <= 0)
+      die("read");
+    off += cc;
+  }
+  ilayout(din, start, n);
+  din->size = size;
 }
 
-// 分配数据块（在位图中标记已使用的块）
+// 在位图中标记已使用的块：位图按绝对块号索引，[0, used) 含全部元数据块与已写入的数据块
 void balloc(int used) {
-  unsigned char buf[BLOCK_SIZE];
-  int i;
+  unsigned char *bmap = (unsigned char *)BLK(sb.bmapstart);
 
   printf("balloc: 前 %d 个块已被分配\n", used);
-  assert(used < BPB);  // 确保使用的块数不超过一个位图块能管理的数量
-  memset(buf, 0, BLOCK_SIZE);
-  
-  // 设置位图中已使用块的位
-  for (i = 0; i < used; i++) {
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  memset(bmap, 0xff, used / 8);
+  for (int i = used / 8 * 8; i < used; i++)
+    bmap[i / 8] |= 1 << (i % 8);
+  printf("balloc: 在位图块 %d~%d 写入位图\n", sb.bmapstart, sb.bmapstart + nbitmap - 1);
+}
+
+// 向根目录的待写列表追加目录项
+void dirent_add(uint32 inum, const char *name) {
+  struct dirent *de;
+
+  if (nrootents >= MAX_ROOT_ENTRIES) {
+    fprintf(stderr, "根目录已满\n");
+    exit(1);
   }
-  
-  printf("balloc: 在位图块 %d 写入位图\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
+  de = &rootents[nrootents++];
+  memset(de, 0, sizeof(*de));
+  de->inum = xshort(inum);
+  strncpy(de->name, name, DIRSIZ);
 }
 
-// 向inode追加数据（支持二级间接块）
-void iappend(uint32_t inum, void *xp, int n) {
-  char *p = (char*)xp;
-  uint32_t fbn, off, n1;
-  struct dinode din;
-  char buf[BLOCK_SIZE];
-  uint32_t indirect[NINDIRECT];
-  uint32_t double_indirect[NINDIRECT];
-  uint32_t x;
-
-  rinode(inum, &din);
-  off = din.size;
-  
-  while (n > 0) {
-    fbn = off / BLOCK_SIZE;  // 文件内的块号
-    assert(fbn < MAXFILE);
-    
-    // 直接块
-    if (fbn < NDIRECT) {
-      if (din.addrs[fbn] == 0) {
-        din.addrs[fbn] = freeblock++;
-      }
-      x = din.addrs[fbn];
-    } 
-    // 一级间接块
-    else if (fbn < NDIRECT + NINDIRECT) {
-      if (din.addrs[NDIRECT] == 0) {
-        din.addrs[NDIRECT] = freeblock++;
-        memset(indirect, 0, sizeof(indirect));
-        wsect(din.addrs[NDIRECT], (char*)indirect);
-      } else {
-        rsect(din.addrs[NDIRECT], (char*)indirect);
-      }
-      if (indirect[fbn - NDIRECT] == 0) {
-        indirect[fbn - NDIRECT] = freeblock++;
-        wsect(din.addrs[NDIRECT], (char*)indirect);
+// 写入根目录。普通格式：目录项依次排在连续的块中，长度对齐到块边界；
+// 散列格式：目录项放入名称所在的桶（桶满时顺延并在原桶头标记溢出），用到的桶块按需分配
+void write_root(uint32 root) {
+  struct dinode *din = iptr(root);
+
+  if (!hashdir) {
+    uint32 n = (nrootents + DPB - 1) / DPB;
+    uint32 start = alloc_blocks(n);
+    memcpy(BLK(start), rootents, nrootents * sizeof(struct dirent));
+    ilayout(din, start, n);
+    din->size = n * BLOCK_SIZE;
+    return;
+  }
+
+  din->flags = DI_HASHDIR;
+  din->size = DIRHASH_BUCKETS * BLOCK_SIZE;   // 未使用的桶是空洞
+  for (int i = 0; i < nrootents; i++) {
+    uint32 h = dirhash(rootents[i].name);
+    int placed = 0;
+    for (int j = 0; j < DIRHASH_BUCKETS && !placed; j++) {
+      uint32 b = (h + j) % DIRHASH_BUCKETS;
+      if (din->addrs[b] == 0)
+        din->addrs[b] = alloc_blocks(1);
+      struct dirent *bucket = (struct dirent *)BLK(din->addrs[b]);
+      for (uint32 slot = 1; slot < DPB; slot++) {
+        if (bucket[slot].inum == 0) {
+          bucket[slot] = rootents[i];
+          placed = 1;
+          break;
+        }
       }
-      x = indirect[fbn - NDIRECT];
+      if (!placed)
+        bucket[0].name[0] = 1;   // 桶已满，后续桶中有顺延的目录项
     }
-    // 二级间接块
-    else {
-      uint32_t dindex = (fbn - NDIRECT - NINDIRECT) / NINDIRECT;
-      uint32_t sindex = (fbn - NDIRECT - NINDIRECT) % NINDIRECT;
-      
-      if (din.addrs[NDIRECT + 1] == 0) {
-        din.addrs[NDIRECT + 1] = freeblock++;
-        memset(double_indirect, 0, sizeof(double_indirect));
-        wsect(din.addrs[NDIRECT + 1], (char*)double_indirect);
-      } else {
-        rsect(din.addrs[NDIRECT + 1], (char*)double_indirect);
-      }
-      
-      if (double_indirect[dindex] == 0) {
-        double_indirect[dindex] = freeblock++;
-        memset(indirect, 0, sizeof(indirect));
-        wsect(double_indirect[dindex], (char*)indirect);
-        wsect(din.addrs[NDIRECT + 1], (char*)double_indirect);
-      } else {
-        rsect(double_indirect[dindex], (char*)indirect);
-      }
-      
-      if (indirect[sindex] == 0) {
-        indirect[sindex] = freeblock++;
-        wsect(double_indirect[dindex], (char*)indirect);
-      }
-      x = indirect[sindex];
+    if (!placed) {
+      fprintf(stderr, "根目录已满\n");
+      exit(1);
     }
-    
-    // 写入数据
-    n1 = min(n, (fbn + 1) * BLOCK_SIZE - off);
-    rsect(x, buf);
-    memcpy(buf + off - (fbn * BLOCK_SIZE), p, n1);
-    wsect(x, buf);
-    
-    n -= n1;
-    off += n1;
-    p += n1;
   }
-  
-  // 更新inode大小
-  din.size = off;
-  winode(inum, &din);
 }
 
 // ============================================================================
@@ -328,91 +242,173 @@ void iappend(uint32_t inum, void *xp, int n) {
 // ============================================================================
 
 int main(int argc, char *argv[]) {
-  int i, cc, fd;
-  uint32_t rootino, inum, off;
-  struct dirent de;
-  char buf[BLOCK_SIZE];
-  struct dinode din;
+  int i, fd;
+  uint32 rootino, inum;
+  struct stat st;
 
   // 确保整数为4字节
   static_assert(sizeof(int) == 4, "整数必须为4字节!");
 
-  if (argc < 2) {
-    fprintf(stderr, "用法: mkfs fs.img 文件...\n");
+  // 解析选项：-s 总块数，-i inode 数，-l 日志块数，-e 启用区段格式，-H 启用散列目录，
+  // -a 以异步提交模式挂载，-g 块组数，-I 启用内联小文件，-o 以顺序数据模式挂载，
+  // -w 在文件系统之后预留的交换区块数，-r 预留块引用计数区以支持 clone_file
+  nlog = LOG_SIZE;
+  fsblocks = FS_TOTAL_BLOCKS;
+  int ninodes = NINODES;
+  uint32 features = 0;
+  int ngroups = 0;
+  int nswap = 0;
+  int argi = 1;
+  for (;;) {
+    if (argi + 1 < argc && strcmp(argv[argi], "-l") == 0) {
+      nlog = atoi(argv[argi + 1]);
+      argi += 2;
+    } else if (argi + 1 < argc && strcmp(argv[argi], "-s") == 0) {
+      fsblocks = atoi(argv[argi + 1]);
+      argi += 2;
+    } else if (argi + 1 < argc && strcmp(argv[argi], "-i") == 0) {
+      ninodes = atoi(argv[argi + 1]);
+      argi += 2;
+    } else if (argi < argc && strcmp(argv[argi], "-e") == 0) {
+      features |= FS_FEAT_EXTENTS;
+      argi++;
+    } else if (argi < argc && strcmp(argv[argi], "-H") == 0) {
+      features |= FS_FEAT_HASHDIR;
+      hashdir = 1;
+      argi++;
+    } else if (argi < argc && strcmp(argv[argi], "-a") == 0) {
+      features |= FS_FEAT_ASYNC;
+      argi++;
+    } else if (argi < argc && strcmp(argv[argi], "-I") == 0) {
+      features |= FS_FEAT_INLINE;
+      argi++;
+    } else if (argi < argc && strcmp(argv[argi], "-o") == 0) {
+      features |= FS_FEAT_ORDERED;
+      argi++;
+    } else if (argi < argc && strcmp(argv[argi], "-r") == 0) {
+      features |= FS_FEAT_REFLINK;
+      argi++;
+    } else if (argi + 1 < argc && strcmp(argv[argi], "-g") == 0) {
+      ngroups = atoi(argv[argi + 1]);
+      features |= FS_FEAT_GROUPS;
+      argi += 2;
+    } else if (argi + 1 < argc && strcmp(argv[argi], "-w") == 0) {
+      nswap = atoi(argv[argi + 1]);
+      argi += 2;
+    } else {
+      break;
+    }
+  }
+  if (argi >= argc) {
+    fprintf(stderr, "用法: mkfs [-s 总块数] [-i inode数] [-l 日志块数] [-e] [-H] [-a] [-I] [-o] [-r] [-g 块组数] [-w 交换区块数] fs.img 文件...\n");
+    exit(1);
+  }
+  if (ninodes < 2 || ninodes > FS_MAX_INODES) {
+    fprintf(stderr, "inode 数须在 2~%d 之间: %d\n", FS_MAX_INODES, ninodes);
+    exit(1);
+  }
+  if (nlog < LOG_MIN || nlog > (int)LOG_MAX) {
+    fprintf(stderr, "日志块数须在 %d~%d 之间: %d\n", LOG_MIN, (int)LOG_MAX, nlog);
+    exit(1);
+  }
+  if ((features & FS_FEAT_GROUPS) && (ngroups < 1 || ngroups > FS_MAX_GROUPS)) {
+    fprintf(stderr, "块组数须在 1~%d 之间: %d\n", FS_MAX_GROUPS, ngroups);
+    exit(1);
+  }
+  if (nswap < 0) {
+    fprintf(stderr, "交换区块数不能为负: %d\n", nswap);
     exit(1);
   }
+  char *image = argv[argi++];
 
   // 验证块大小与数据结构对齐
-  //assert((BLOCK_SIZE % sizeof(struct dinode)) == 0);
   assert((BLOCK_SIZE % sizeof(struct dirent)) == 0);
 
-  // 打开或创建文件系统镜像
-  fsfd = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0666);
-  if (fsfd < 0)
-    die(argv[1]);
-
   // 计算文件系统布局参数 - 使用与内核一致的布局
-  nlog = LOG_SIZE;
-  ninodeblocks = INODE_BLOCKS;
-  nbitmap = BMAP_BLOCKS;
-  nmeta = SUPERBLOCK_NUM + nlog + ninodeblocks + nbitmap;
-  nblocks = FS_TOTAL_BLOCKS - nmeta;
+  ninodeblocks = (ninodes + IPB - 1) / IPB;
+  // 分组时每组的 inode 占整数个 inode 块
+  uint32 ipg = 0;
+  if (ngroups > 0) {
+    ipg = ((ninodes + ngroups - 1) / ngroups + IPB - 1) / IPB * IPB;
+    ninodeblocks = ngroups * ipg / IPB;
+  }
+  nbitmap = fsblocks / BPB + 1;          // 与内核 SB_DATASTART 一致
+  nmeta = SUPERBLOCK_BLOCKNO + SUPERBLOCK_NUM + nlog + ninodeblocks + nbitmap;  // 含 0 号引导块
+  nblocks = fsblocks - nmeta;
+  if (nblocks < 1) {
+    fprintf(stderr, "总块数 %d 放不下元数据（%d 块）\n", fsblocks, nmeta);
+    exit(1);
+  }
 
   // 初始化超级块 - 使用与内核一致的布局
   sb.magic = FS_MAGIC;
-  sb.size = FS_TOTAL_BLOCKS;
+  sb.size = fsblocks;
   sb.nblocks = nblocks;
-  sb.ninodes = ninodeblocks * IPB;  // 13 * 64 = 832个inode
+  sb.ninodes = ninodeblocks * IPB < FS_MAX_INODES ? ninodeblocks * IPB : FS_MAX_INODES;
   sb.nlog = nlog;
-  sb.logstart = LOG_START;
-  sb.inodestart = INODE_START;
-  sb.bmapstart = BMAP_START;
+  sb.logstart = SUPERBLOCK_BLOCKNO + SUPERBLOCK_NUM;
+  sb.inodestart = sb.logstart + nlog;
+  sb.bmapstart = sb.inodestart + ninodeblocks;
+  sb.features = features;
+  if (ngroups > 0) {
+    sb.ngroups = ngroups;
+    sb.ipg = ipg;
+    sb.bpg = (nblocks + ngroups - 1) / ngroups;
+  }
+  if (nswap > 0) {
+    sb.swapstart = fsblocks;
+    sb.nswap = nswap;
+  }
 
   printf("创建文件系统:\n");
-  printf("  总块数: %d\n", FS_TOTAL_BLOCKS);
-  printf("  元数据块: %d (超级块 %d, 日志块 %d, inode块 %d, 位图块 %d)\n", 
+  printf("  总块数: %d\n", fsblocks);
+  printf("  元数据块: %d (超级块 %d, 日志块 %d, inode块 %d, 位图块 %d)\n",
          nmeta, SUPERBLOCK_NUM, nlog, ninodeblocks, nbitmap);
   printf("  数据块: %d\n", nblocks);
-  printf("  布局: 超级块[%d], 日志[%d-%d], inode[%d-%d], 位图[%d], 数据[%d-%d]\n",
-         SUPERBLOCK_BLOCKNO, 
-         LOG_START, LOG_START + nlog - 1,
-         INODE_START, INODE_START + ninodeblocks - 1,
-         BMAP_START,
-         DATA_START, FS_TOTAL_BLOCKS - 1);
-
-  freeblock = DATA_START;  // 第一个可分配的数据块
+  printf("  布局: 超级块[%d], 日志[%d-%d], inode[%d-%d], 位图[%d-%d], 数据[%d-%d]\n",
+         SUPERBLOCK_BLOCKNO,
+         sb.logstart, sb.logstart + nlog - 1,
+         sb.inodestart, sb.inodestart + ninodeblocks - 1,
+         sb.bmapstart, sb.bmapstart + nbitmap - 1,
+         SB_DATASTART(sb), fsblocks - 1);
+  if (ngroups > 0)
+    printf("  块组: %d 组，每组 %u 个 inode、%u 个数据块\n", ngroups, sb.ipg, sb.bpg);
+  if (nswap > 0)
+    printf("  交换区: [%u-%u]\n", sb.swapstart, sb.swapstart + sb.nswap - 1);
+
+  freeblock = SB_DATASTART(sb);  // 第一个可分配的数据块
+
+  // 引用计数区占数据区开头的若干块，在位图中与文件数据一样标记为已用；镜像全 0，计数即为 0
+  if (features & FS_FEAT_REFLINK) {
+    sb.nref = (fsblocks + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    sb.refstart = alloc_blocks(sb.nref);
+    printf("  引用计数区: [%u-%u]\n", sb.refstart, sb.refstart + sb.nref - 1);
+  }
 
-  // 初始化整个文件系统为0
-  memset(zeroes, 0, BLOCK_SIZE);
-  for (i = 0; i < FS_TOTAL_BLOCKS; i++)
-    wsect(i, zeroes);
+  // 创建镜像并整体映射：截断到目标大小即得到全 0 的镜像。交换区只占镜像尾部的空间，不必映射
+  int fsfd = open(image, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fsfd < 0)
+    die(image);
+  if (ftruncate(fsfd, (off_t)(fsblocks + nswap) * BLOCK_SIZE) < 0)
+    die("ftruncate");
+  img = mmap(0, (size_t)fsblocks * BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fsfd, 0);
+  if (img == MAP_FAILED)
+    die("mmap");
 
   // 写入超级块到块1
-  memset(buf, 0, sizeof(buf));
-  memcpy(buf, &sb, sizeof(sb));
-  wsect(SUPERBLOCK_BLOCKNO, buf);
+  memcpy(BLK(SUPERBLOCK_BLOCKNO), &sb, sizeof(sb));
 
   // 创建根目录
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
+  dirent_add(rootino, ".");
+  dirent_add(rootino, "..");
 
-  // 在根目录中添加 "." 条目
-  memset(&de, 0, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  // 在根目录中添加 ".." 条目
-  memset(&de, 0, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
-
-  // 添加用户提供的文件到文件系统
-  for (i = 2; i < argc; i++) {
+  // 添加用户提供的文件到文件系统：每个文件的数据块连续排列
+  for (i = argi; i < argc; i++) {
     char *original_name = argv[i];  // 保存原始文件名
     char shortname[DIRSIZ + 1];     // 存储短名称的缓冲区
-    
+
     // 提取文件名（去掉路径）
     char *slash = strrchr(original_name, '/');
     if (slash) {
@@ -421,13 +417,13 @@ int main(int argc, char *argv[]) {
         strncpy(shortname, original_name, DIRSIZ);
     }
     shortname[DIRSIZ] = '\0';  // 确保以null结尾
-    
+
     // 去掉.elf扩展名（如果存在）
     char *dot = strrchr(shortname, '.');
     if (dot && (strcmp(dot, ".elf") == 0 || strcmp(dot, ".bin") == 0)) {
         *dot = '\0'; // 去掉扩展名
     }
-    
+
     // 确保文件名不包含路径分隔符
     assert(strchr(shortname, '/') == 0);
 
@@ -436,49 +432,36 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "无法打开文件: %s\n", original_name);
         die(original_name);
     }
+    if (fstat(fd, &st) < 0)
+        die(original_name);
 
     // 跳过文件名中的前导下划线（如果存在）
     if (shortname[0] == '_') {
         memmove(shortname, shortname + 1, strlen(shortname));
     }
 
-    // 验证文件名长度
-    if (strlen(shortname) > DIRSIZ) {
-      fprintf(stderr, "文件名太长: %s\n", shortname);
-      exit(1);
-    }
-    
-    // 分配inode
+    // 分配inode，目录项名称保证以null结尾
     inum = ialloc(T_FILE);
-
-    // 在根目录中创建目录条目
-    memset(&de, 0, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    de.name[DIRSIZ - 1] = '\0'; // 保证目录项字符串以null结尾
-    iappend(rootino, &de, sizeof(de));
+    shortname[DIRSIZ - 1] = '\0';
+    dirent_add(inum, shortname);
 
     // 将文件内容写入inode
     printf("添加文件: %s -> /%s (inode %d)\n", original_name, shortname, inum);
-    while ((cc = read(fd, buf, sizeof(buf))) > 0) {
-      iappend(inum, buf, cc);
-    }
+    iwrite_file(inum, fd, st.st_size);
 
     close(fd);
   }
 
-  // 修正根目录inode的大小（对齐到块边界）
-  rinode(rootino, &din);
-  off = din.size;
-  off = ((off / BLOCK_SIZE) + 1) * BLOCK_SIZE;
-  din.size = off;
-  winode(rootino, &din);
+  write_root(rootino);
 
   // 分配已使用的数据块到位图中
-  balloc(freeblock - DATA_START);
+  balloc(freeblock);
 
+  if (msync(img, (size_t)fsblocks * BLOCK_SIZE, MS_SYNC) < 0)
+    die("msync");
+  munmap(img, (size_t)fsblocks * BLOCK_SIZE);
   close(fsfd);
-  printf("文件系统镜像 %s 创建成功\n", argv[1]);
-  printf("已使用数据块: %d/%d\n", freeblock - DATA_START, nblocks);
+  printf("文件系统镜像 %s 创建成功\n", image);
+  printf("已使用数据块: %d/%d\n", freeblock - SB_DATASTART(sb), nblocks);
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,16 @@
+#include "user.h"
+
+// allocprof [-r]: 按现存字节数打印内核各分配调用点（alloc_page/alloc_pages 与 slab）的
+// 分配次数、现存个数、现存字节与高水位，-r 在打印后重置。需内核以 ALLOC_PROF=1 编译
+int main(int argc, char *argv[]) {
+    int flags = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'r')
+            flags |= ALLOCPROF_RESET;
+    }
+    if (allocprof(flags) < 0) {
+        printf("allocprof: 读取分配统计失败\n");
+        exit(-1);
+    }
+    exit(0);
+}
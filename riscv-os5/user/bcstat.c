@@ -0,0 +1,21 @@
+#include "user.h"
+
+// bcstat: 打印块缓存的容量、命中率与置换统计
+int main(void) {
+    struct bcachestat st;
+    if (bcachestat(&st) < 0) {
+        printf("bcstat: 读取块缓存统计失败\n");
+        exit(-1);
+    }
+
+    unsigned long total = st.hits + st.misses;
+    printf("buffers:          %lu (protected %lu)\n", st.nbuf, st.nprotected);
+    printf("hits:             %lu\n", st.hits);
+    printf("misses:           %lu\n", st.misses);
+    if (total)
+        printf("hit rate:         %lu%%\n", st.hits * 100 / total);
+    printf("prefetches:       %lu\n", st.prefetches);
+    printf("evictions:        %lu (protected %lu)\n", st.evictions, st.evict_protected);
+    printf("ghost hits:       %lu\n", st.ghost_hits);
+    exit(0);
+}
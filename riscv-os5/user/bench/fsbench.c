@@ -0,0 +1,148 @@
+#include "ubench.h"
+
+// fsbench: 文件系统吞吐量——以不同的请求大小顺序/随机读写同一个 FILE_SIZE 的文件，
+// 多个进程同时读同一个文件（共享 inode 锁），以及小文件的创建与删除速率
+
+#define FILE_SIZE (1024 * 1024)
+#define NSMALL 100
+#define NREADERS 4
+#define TEST_FILE "fsbench.dat"
+
+static char buf[65536];
+static const int sizes[] = { 512, 4096, 65536 };
+#define NSIZES ((int)(sizeof(sizes) / sizeof(sizes[0])))
+
+static int xopen(const char *path, int mode) {
+    int fd = open(path, mode);
+    if (fd < 0) {
+        printf("fsbench: 打开 %s 失败\n", path);
+        exit(-1);
+    }
+    return fd;
+}
+
+static void bench_seq(int size) {
+    int fd = xopen(TEST_FILE, O_CREATE | O_RDWR);
+    unsigned long start = get_time();
+    for (int off = 0; off < FILE_SIZE; off += size) {
+        if (write(fd, buf, size) != size) {
+            printf("fsbench: 顺序写失败\n");
+            exit(-1);
+        }
+    }
+    ubench_report("seq_write", ubench_size_name(size), FILE_SIZE / size, FILE_SIZE, get_time() - start);
+    close(fd);
+
+    fd = xopen(TEST_FILE, O_RDONLY);
+    start = get_time();
+    for (int off = 0; off < FILE_SIZE; off += size) {
+        if (read(fd, buf, size) != size) {
+            printf("fsbench: 顺序读失败\n");
+            exit(-1);
+        }
+    }
+    ubench_report("seq_read", ubench_size_name(size), FILE_SIZE / size, FILE_SIZE, get_time() - start);
+    close(fd);
+}
+
+// 在已写满的文件中按请求大小对齐的随机偏移读写，总量与顺序读写相同
+static void bench_rand(int size) {
+    int fd = xopen(TEST_FILE, O_RDWR);
+    int n = FILE_SIZE / size;
+    unsigned int seed = 1;
+
+    unsigned long start = get_time();
+    for (int i = 0; i < n; i++) {
+        long off = (long)(ubench_rand(&seed) % n) * size;
+        if (pwrite(fd, buf, size, off) != size) {
+            printf("fsbench: 随机写失败\n");
+            exit(-1);
+        }
+    }
+    ubench_report("rand_write", ubench_size_name(size), n, FILE_SIZE, get_time() - start);
+
+    start = get_time();
+    for (int i = 0; i < n; i++) {
+        long off = (long)(ubench_rand(&seed) % n) * size;
+        if (pread(fd, buf, size, off) != size) {
+            printf("fsbench: 随机读失败\n");
+            exit(-1);
+        }
+    }
+    ubench_report("rand_read", ubench_size_name(size), n, FILE_SIZE, get_time() - start);
+    close(fd);
+}
+
+// NREADERS 个子进程各自打开同一个文件，以 4K 请求同时把它从头读到尾
+static void bench_shared_read(void) {
+    int fd = xopen(TEST_FILE, O_CREATE | O_RDWR);
+    for (int off = 0; off < FILE_SIZE; off += 4096)
+        write(fd, buf, 4096);
+    close(fd);
+
+    unsigned long start = get_time();
+    for (int i = 0; i < NREADERS; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("fsbench: fork 失败\n");
+            exit(-1);
+        }
+        if (pid == 0) {
+            fd = xopen(TEST_FILE, O_RDONLY);
+            for (int off = 0; off < FILE_SIZE; off += 4096)
+                read(fd, buf, 4096);
+            exit(0);
+        }
+    }
+    for (int i = 0; i < NREADERS; i++)
+        wait(0);
+    ubench_report("shared_read", "4K", NREADERS * (FILE_SIZE / 4096), NREADERS * FILE_SIZE,
+                  get_time() - start);
+    unlink(TEST_FILE);
+}
+
+// 文件名 sf00 ~ sf99
+static void small_name(char *name, int i) {
+    name[0] = 's';
+    name[1] = 'f';
+    name[2] = '0' + i / 10;
+    name[3] = '0' + i % 10;
+    name[4] = 0;
+}
+
+static void bench_small_files(void) {
+    char name[8];
+
+    unsigned long start = get_time();
+    for (int i = 0; i < NSMALL; i++) {
+        small_name(name, i);
+        int fd = xopen(name, O_CREATE | O_RDWR);
+        write(fd, buf, 16);
+        close(fd);
+    }
+    ubench_report("small_create", "16", NSMALL, 0, get_time() - start);
+
+    start = get_time();
+    for (int i = 0; i < NSMALL; i++) {
+        small_name(name, i);
+        if (unlink(name) < 0) {
+            printf("fsbench: 删除 %s 失败\n", name);
+            exit(-1);
+        }
+    }
+    ubench_report("small_unlink", "16", NSMALL, 0, get_time() - start);
+}
+
+int main(void) {
+    for (int i = 0; i < (int)sizeof(buf); i++)
+        buf[i] = (char)i;
+
+    for (int i = 0; i < NSIZES; i++) {
+        bench_seq(sizes[i]);
+        bench_rand(sizes[i]);
+        unlink(TEST_FILE);
+    }
+    bench_shared_read();
+    bench_small_files();
+    exit(0);
+}
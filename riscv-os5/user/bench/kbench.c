@@ -0,0 +1,71 @@
+#include "user.h"
+
+#define WARMUP 16
+#define ITERS 256
+#define MAXBENCH 16
+
+// kbench [name]: 运行内核微基准并按 BENCH_REPORT_FMT 逐行输出；name 为 syscall 或缺省时
+// 另在用户态测量一次最小系统调用的往返开销，格式相同。getpid 由 vDSO 直接返回，
+// 这里用 close(-1)：真正陷入内核，参数检查后即返回
+
+static inline unsigned long rdcycle(void) {
+    unsigned long x;
+    asm volatile("csrr %0, cycle" : "=r"(x));
+    return x;
+}
+
+static void sort(unsigned long *s, int n) {
+    for (int i = 1; i < n; i++) {
+        unsigned long v = s[i];
+        int j = i;
+        for (; j > 0 && s[j - 1] > v; j--)
+            s[j] = s[j - 1];
+        s[j] = v;
+    }
+}
+
+static int streq(const char *a, const char *b) {
+    while (*a && *a == *b)
+        a++, b++;
+    return *a == *b;
+}
+
+static void report(const struct bench_result *r) {
+    printf(BENCH_REPORT_FMT, r->name, r->iters, r->min, r->median, r->p99, r->max);
+}
+
+static void bench_syscall(void) {
+    static unsigned long samples[ITERS];
+    for (int i = 0; i < WARMUP + ITERS; i++) {
+        unsigned long start = rdcycle();
+        close(-1);
+        unsigned long t = rdcycle() - start;
+        if (i >= WARMUP)
+            samples[i - WARMUP] = t;
+    }
+    sort(samples, ITERS);
+
+    struct bench_result r = { "syscall", ITERS, samples[0], samples[ITERS / 2],
+                              samples[ITERS * 99 / 100], samples[ITERS - 1] };
+    report(&r);
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = argc > 1 ? argv[1] : 0;
+
+    if (name == 0 || streq(name, "syscall")) {
+        bench_syscall();
+        if (name)
+            exit(0);
+    }
+
+    static struct bench_result res[MAXBENCH];
+    int n = kbench(name, res, MAXBENCH);
+    if (n <= 0) {
+        printf("kbench: 没有运行任何内核基准\n");
+        exit(-1);
+    }
+    for (int i = 0; i < n; i++)
+        report(&res[i]);
+    exit(0);
+}
@@ -0,0 +1,71 @@
+#include "ubench.h"
+
+// mallocbench: malloc/free 的吞吐量——固定大小的分配释放对、
+// 先全部分配再全部释放，以及多种大小随机交错的工作集
+
+#define NPAIR 20000
+#define NBATCH 2000
+#define NSLOT 512
+#define NRANDOM 20000
+
+static void *slots[NBATCH];
+
+static void *xmalloc(unsigned int n) {
+    void *p = malloc(n);
+    if (p == 0) {
+        printf("mallocbench: malloc(%d) 失败\n", n);
+        exit(-1);
+    }
+    return p;
+}
+
+static void bench_pair(int size) {
+    unsigned long start = get_time();
+    for (int i = 0; i < NPAIR; i++)
+        free(xmalloc(size));
+    ubench_report("malloc_free", ubench_size_name(size), NPAIR, 0, get_time() - start);
+}
+
+static void bench_batch(int size) {
+    unsigned long start = get_time();
+    for (int i = 0; i < NBATCH; i++)
+        slots[i] = xmalloc(size);
+    for (int i = 0; i < NBATCH; i++)
+        free(slots[i]);
+    ubench_report("malloc_batch", ubench_size_name(size), NBATCH, 0, get_time() - start);
+}
+
+// NSLOT 个槽位随机地分配或释放，大小在 16 字节到 8K 之间，并检查内容未被破坏
+static void bench_random(void) {
+    unsigned int seed = 1;
+    unsigned long start = get_time();
+    for (int i = 0; i < NRANDOM; i++) {
+        int k = ubench_rand(&seed) % NSLOT;
+        if (slots[k]) {
+            if (*(int *)slots[k] != k) {
+                printf("mallocbench: 槽位 %d 的内容被破坏\n", k);
+                exit(-1);
+            }
+            free(slots[k]);
+            slots[k] = 0;
+        } else {
+            unsigned int r = ubench_rand(&seed);
+            slots[k] = xmalloc(r % 8 ? 16 + r % 240 : 16 + r % 8192);
+            *(int *)slots[k] = k;
+        }
+    }
+    for (int k = 0; k < NSLOT; k++) {
+        free(slots[k]);
+        slots[k] = 0;
+    }
+    ubench_report("malloc_random", "16-8K", NRANDOM, 0, get_time() - start);
+}
+
+int main(void) {
+    bench_pair(512);
+    bench_pair(4096);
+    bench_batch(512);
+    bench_batch(4096);
+    bench_random();
+    exit(0);
+}
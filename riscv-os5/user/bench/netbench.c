@@ -0,0 +1,80 @@
+#include "ubench.h"
+
+// netbench: UDP 数据报速率——经本机回环的收发往返，以及经网卡发往 QEMU 网关的发送速率。
+// 1K 的负载超过零拷贝发送的阈值，可与 64 字节的拷贝路径对比
+
+#define NPKT 2048
+#define BATCH 32          // 回环时每发 BATCH 个就收回来，不超过套接字的接收队列上限
+#define LOOP_PORT 7000
+#define DISCARD_PORT 9
+
+static char buf[1024];
+static const int sizes[] = { 64, 1024 };
+static const char *const size_names[] = { "64", "1K" };
+#define NSIZES ((int)(sizeof(sizes) / sizeof(sizes[0])))
+
+static int xsocket(void) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        printf("netbench: socket 失败\n");
+        exit(-1);
+    }
+    return fd;
+}
+
+static void bench_loopback(int size, const char *name) {
+    int rx = xsocket(), tx = xsocket();
+    struct sockaddr_in addr = { AF_INET, htons(LOOP_PORT), htonl(IPADDR(127, 0, 0, 1)), {0} };
+    if (bind(rx, &addr) < 0) {
+        printf("netbench: bind 失败\n");
+        exit(-1);
+    }
+
+    unsigned long start = get_time();
+    for (int i = 0; i < NPKT; i += BATCH) {
+        for (int j = 0; j < BATCH; j++) {
+            if (sendto(tx, buf, size, 0, &addr) != size) {
+                printf("netbench: 回环发送失败\n");
+                exit(-1);
+            }
+        }
+        for (int j = 0; j < BATCH; j++) {
+            if (recvfrom(rx, buf, size, 0, 0) != size) {
+                printf("netbench: 回环接收失败\n");
+                exit(-1);
+            }
+        }
+    }
+    ubench_report("udp_loopback", name, NPKT, 0, get_time() - start);
+    close(rx);
+    close(tx);
+}
+
+static void bench_tx(int size, const char *name) {
+    int fd = xsocket();
+    struct sockaddr_in addr = { AF_INET, htons(DISCARD_PORT), htonl(IPADDR(10, 0, 2, 2)), {0} };
+
+    // 第一个包顺带完成 ARP 解析，不计入时间
+    if (sendto(fd, buf, size, 0, &addr) != size) {
+        printf("netbench: 没有可用的网卡，跳过发送测试\n");
+        close(fd);
+        return;
+    }
+    unsigned long start = get_time();
+    for (int i = 0; i < NPKT; i++) {
+        if (sendto(fd, buf, size, 0, &addr) != size) {
+            printf("netbench: 发送失败\n");
+            exit(-1);
+        }
+    }
+    ubench_report("udp_tx", name, NPKT, 0, get_time() - start);
+    close(fd);
+}
+
+int main(void) {
+    for (int i = 0; i < NSIZES; i++)
+        bench_loopback(sizes[i], size_names[i]);
+    for (int i = 0; i < NSIZES; i++)
+        bench_tx(sizes[i], size_names[i]);
+    exit(0);
+}
@@ -0,0 +1,6 @@
+#include "user.h"
+
+// nop: 立即退出，供 procbench 测量 fork+exec+wait 与 spawn+wait 的开销
+int main(void) {
+    exit(0);
+}
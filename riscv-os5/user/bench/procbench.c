@@ -0,0 +1,130 @@
+#include "ubench.h"
+
+// procbench: 进程与内存相关的吞吐量——fork+exit、fork+exec+wait、spawn+wait、
+// 占用大量内存的子进程从退出到被 wait 回收的延迟、sbrk 扩展（含首次访问补页）与最小系统调用的往返
+
+#define NFORK 64
+#define NEXEC 32
+#define SBRK_PAGES 1024
+#define NEXIT_BIG 8
+#define EXIT_BIG_PAGES 2048
+#define NSYSCALL 10000
+
+static void bench_fork_exit(void) {
+    unsigned long start = get_time();
+    for (int i = 0; i < NFORK; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("procbench: fork 失败\n");
+            exit(-1);
+        }
+        if (pid == 0)
+            exit(0);
+        wait(0);
+    }
+    ubench_report("fork_exit", "-", NFORK, 0, get_time() - start);
+}
+
+static void bench_fork_exec(void) {
+    char *argv[] = { "nop", 0 };
+    unsigned long start = get_time();
+    for (int i = 0; i < NEXEC; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("procbench: fork 失败\n");
+            exit(-1);
+        }
+        if (pid == 0) {
+            exec("nop", argv);
+            printf("procbench: exec nop 失败\n");
+            exit(-1);
+        }
+        wait(0);
+    }
+    ubench_report("fork_exec_wait", "nop", NEXEC, 0, get_time() - start);
+}
+
+static void bench_spawn(void) {
+    char *argv[] = { "nop", 0 };
+    unsigned long start = get_time();
+    for (int i = 0; i < NEXEC; i++) {
+        if (spawn("nop", argv) < 0) {
+            printf("procbench: spawn nop 失败\n");
+            exit(-1);
+        }
+        wait(0);
+    }
+    ubench_report("spawn_wait", "nop", NEXEC, 0, get_time() - start);
+}
+
+// 子进程扩展堆并写满每一页后通知父进程再退出，计时从收到通知到 wait 返回，
+// 其中主要是子进程拆除地址空间的开销
+static void bench_exit_big(void) {
+    unsigned long total = 0;
+    for (int i = 0; i < NEXIT_BIG; i++) {
+        int fds[2];
+        char c = 0;
+        if (pipe(fds) < 0) {
+            printf("procbench: pipe 失败\n");
+            exit(-1);
+        }
+        int pid = fork();
+        if (pid < 0) {
+            printf("procbench: fork 失败\n");
+            exit(-1);
+        }
+        if (pid == 0) {
+            char *p = sbrk(EXIT_BIG_PAGES * UBENCH_PAGE);
+            if (p == SBRK_ERROR)
+                exit(-1);
+            for (int k = 0; k < EXIT_BIG_PAGES; k++)
+                p[k * UBENCH_PAGE] = 1;
+            write(fds[1], &c, 1);
+            exit(0);
+        }
+        close(fds[1]);
+        if (read(fds[0], &c, 1) != 1) {
+            printf("procbench: 子进程分配内存失败\n");
+            exit(-1);
+        }
+        unsigned long start = get_time();
+        wait(0);
+        total += get_time() - start;
+        close(fds[0]);
+    }
+    ubench_report("exit_wait", "8M", NEXIT_BIG, 0, total);
+}
+
+// 逐页扩展堆并写入一个字节，最后整体归还
+static void bench_sbrk(void) {
+    unsigned long start = get_time();
+    for (int i = 0; i < SBRK_PAGES; i++) {
+        char *p = sbrk(UBENCH_PAGE);
+        if (p == SBRK_ERROR) {
+            printf("procbench: sbrk 失败\n");
+            exit(-1);
+        }
+        p[0] = 1;
+    }
+    unsigned long t = get_time() - start;
+    sbrk(-SBRK_PAGES * UBENCH_PAGE);
+    ubench_report("sbrk_touch", "4K", SBRK_PAGES, (unsigned long)SBRK_PAGES * UBENCH_PAGE, t);
+}
+
+// getpid 由 vDSO 直接返回，这里用 close(-1)：真正陷入内核，参数检查后即返回
+static void bench_syscall(void) {
+    unsigned long start = get_time();
+    for (int i = 0; i < NSYSCALL; i++)
+        close(-1);
+    ubench_report("syscall", "close(-1)", NSYSCALL, 0, get_time() - start);
+}
+
+int main(void) {
+    bench_fork_exit();
+    bench_fork_exec();
+    bench_spawn();
+    bench_exit_big();
+    bench_sbrk();
+    bench_syscall();
+    exit(0);
+}
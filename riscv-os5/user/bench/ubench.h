@@ -0,0 +1,39 @@
+#pragma once
+
+#include "user.h"
+
+// 用户态基准套件的公共部分。每项结果输出一行，字段顺序固定，便于在不同内核构建之间 diff：
+//   [ubench] name=<项目> arg=<参数> ops=<次数> bytes=<字节数> time=<get_time 计数> rate=<r> unit=<u>
+// 有字节数时 rate 为 KB/s，否则为每秒操作数；time 为整组操作的总耗时
+
+#define UBENCH_PAGE 4096
+
+static inline unsigned long ubench_freq(void) {
+    return ((const struct vdso_data *)VDSO_DATA_VA)->timebase_freq;
+}
+
+static inline void ubench_report(const char *name, const char *arg, unsigned long ops,
+                                 unsigned long bytes, unsigned long time) {
+    if (time == 0)
+        time = 1;
+    unsigned long rate = bytes ? bytes / 1024 * ubench_freq() / time : ops * ubench_freq() / time;
+    printf("[ubench] name=%s arg=%s ops=%lu bytes=%lu time=%lu rate=%lu unit=%s\n",
+           name, arg, ops, bytes, time, rate, bytes ? "KB/s" : "ops/s");
+}
+
+// 与 sizes[] 配套的参数名，避免在用户态格式化数字
+static inline const char *ubench_size_name(int size) {
+    switch (size) {
+    case 512: return "512";
+    case 4096: return "4K";
+    case 65536: return "64K";
+    case 1048576: return "1M";
+    default: return "?";
+    }
+}
+
+// 伪随机数（线性同余），各次运行序列相同，结果可比
+static inline unsigned int ubench_rand(unsigned int *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 16;
+}
@@ -9,9 +9,140 @@ static void fill_pattern(char *buf, int value) {
     }
 }
 
+// 新扩展的堆只读不写时应共享零页：读遍 ZERO_PAGES 页几乎不消耗空闲页，
+// 随后的写入经写时复制换成私有页，写入的值互不影响
+#define ZERO_PAGES 64
+static int zero_page_test(void) {
+    struct meminfo before, after;
+    struct rusage ru0, ru1;
+    char *heap = sbrk(ZERO_PAGES * PAGE_SIZE);
+    if (heap == SBRK_ERROR) {
+        printf("cowtest: sbrk 失败\n");
+        return -1;
+    }
+    meminfo(0, &before);
+    getrusage(RUSAGE_SELF, &ru0);
+    int sum = 0;
+    for (int i = 0; i < ZERO_PAGES; i++)
+        sum += heap[i * PAGE_SIZE];
+    meminfo(0, &after);
+    if (sum != 0) {
+        printf("cowtest: 新堆页读出非零数据\n");
+        return -1;
+    }
+    if (after.zero_page_faults - before.zero_page_faults < ZERO_PAGES ||
+        before.free_pages - after.free_pages > ZERO_PAGES / 4) {
+        printf("cowtest: 读缺页没有使用共享零页（零页缺页 %lu，空闲页减少 %lu）\n",
+               after.zero_page_faults - before.zero_page_faults,
+               before.free_pages - after.free_pages);
+        return -1;
+    }
+    for (int i = 0; i < ZERO_PAGES; i++)
+        heap[i * PAGE_SIZE] = (char)(i + 1);
+    for (int i = 0; i < ZERO_PAGES; i++) {
+        if (heap[i * PAGE_SIZE] != (char)(i + 1) || heap[i * PAGE_SIZE + 1] != 0) {
+            printf("cowtest: 零页写时复制后数据错误，页 %d\n", i);
+            return -1;
+        }
+    }
+    getrusage(RUSAGE_SELF, &ru1);
+    if (ru1.lazy_faults - ru0.lazy_faults < ZERO_PAGES || ru1.cow_faults - ru0.cow_faults < ZERO_PAGES) {
+        printf("cowtest: 缺页计数不符（按需分配 %lu，写时复制 %lu）\n",
+               ru1.lazy_faults - ru0.lazy_faults, ru1.cow_faults - ru0.cow_faults);
+        return -1;
+    }
+    printf("cowtest: 共享零页测试通过，按需分配缺页 %lu 次，写时复制缺页 %lu 次\n",
+           ru1.lazy_faults - ru0.lazy_faults, ru1.cow_faults - ru0.cow_faults);
+    return 0;
+}
+
+// 内核 copyout 写入尚未分配的堆页时在内核中缺页，计入 uaccess_faults；
+// 只读映射可执行文件后逐页访问，计为文件页缺页（页缓存命中为 minor，否则为 major）
+#define UACCESS_PAGES 2
+static int fault_kind_test(void) {
+    struct rusage ru0, ru1;
+    char *heap = sbrk(UACCESS_PAGES * PAGE_SIZE);
+    int fd = open("cowtest", O_RDONLY);
+    if (heap == SBRK_ERROR || fd < 0) {
+        printf("cowtest: 准备缺页分类测试失败\n");
+        return -1;
+    }
+    getrusage(RUSAGE_SELF, &ru0);
+    int n = read(fd, heap, UACCESS_PAGES * PAGE_SIZE);
+    char *map = mmap(0, UACCESS_PAGES * PAGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    volatile int sum = 0;
+    if (map != MAP_FAILED) {
+        for (int i = 0; i < UACCESS_PAGES; i++)
+            sum += map[i * PAGE_SIZE];
+    }
+    getrusage(RUSAGE_SELF, &ru1);
+    close(fd);
+    if (map != MAP_FAILED)
+        munmap(map, UACCESS_PAGES * PAGE_SIZE);
+    sbrk(-(UACCESS_PAGES * PAGE_SIZE));
+
+    unsigned long uaccess = ru1.uaccess_faults - ru0.uaccess_faults;
+    unsigned long minflt = ru1.minflt - ru0.minflt, majflt = ru1.majflt - ru0.majflt;
+    if (n != UACCESS_PAGES * PAGE_SIZE || map == MAP_FAILED || uaccess < UACCESS_PAGES || minflt + majflt < UACCESS_PAGES) {
+        printf("cowtest: 缺页分类不符（copyout 中 %lu，文件页 minor %lu major %lu）\n",
+               uaccess, minflt, majflt);
+        return -1;
+    }
+    printf("cowtest: 缺页分类测试通过，copyout 中缺页 %lu 次，文件页 minor %lu 次、major %lu 次\n",
+           uaccess, minflt, majflt);
+    return 0;
+}
+
+// 交换区：堆逐页扩展并立即写入（每次缺页时 2MB 区间都还没被 sbrk 覆盖满，只会分配 4KB 页），
+// 总量超过空闲页 SWAP_EXTRA 页（页缓存让出的页之外），迫使较早写入的页换出；随后逐页读回核对内容
+#define SWAP_EXTRA 2048
+static int swap_test(void) {
+    struct meminfo before, after;
+    meminfo(0, &before);
+    if (before.swap_total == 0) {
+        printf("cowtest: 没有交换区，跳过换出测试\n");
+        return 0;
+    }
+    unsigned long npages = before.free_pages + SWAP_EXTRA;
+    if (SWAP_EXTRA * 2 > before.swap_free) {
+        printf("cowtest: 交换区空闲槽不足，跳过换出测试\n");
+        return 0;
+    }
+    char *heap = sbrk(0);
+    for (unsigned long i = 0; i < npages; i++) {
+        char *page = sbrk(PAGE_SIZE);
+        if (page == SBRK_ERROR) {
+            printf("cowtest: sbrk 失败，页 %lu\n", i);
+            return -1;
+        }
+        *(unsigned long *)page = i;
+        *(unsigned long *)(page + PAGE_SIZE - sizeof(unsigned long)) = ~i;
+    }
+    for (unsigned long i = 0; i < npages; i++) {
+        char *page = heap + i * PAGE_SIZE;
+        if (*(unsigned long *)page != i ||
+            *(unsigned long *)(page + PAGE_SIZE - sizeof(unsigned long)) != ~i) {
+            printf("cowtest: 换回的页 %lu 内容错误\n", i);
+            return -1;
+        }
+    }
+    meminfo(0, &after);
+    sbrk(-(int)(npages * PAGE_SIZE));
+    if (after.swap_outs == before.swap_outs) {
+        printf("cowtest: 超出空闲内存后没有页被换出\n");
+        return -1;
+    }
+    printf("cowtest: 换出测试通过，换出 %lu 页，换入 %lu 页\n",
+           after.swap_outs - before.swap_outs, after.swap_ins - before.swap_ins);
+    return 0;
+}
+
 int main(void) {
     printf("cowtest: 写时复制功能验证开始\n");
 
+    if (zero_page_test() < 0)
+        exit(-1);
+
     char *buf = (char *)malloc(TEST_PAGES * PAGE_SIZE);
     if (buf == 0) {
         printf("cowtest: malloc 失败\n");
@@ -29,11 +160,14 @@ int main(void) {
 
     if (pid == 0) {
         // 子进程：逐页写入不同的标记，触发写时复制
+        struct rusage ru0, ru1;
+        getrusage(RUSAGE_SELF, &ru0);
         for (int i = 0; i < TEST_PAGES; i++) {
             buf[i * PAGE_SIZE] = 'a' + i;
         }
-        printf("cowtest: 子进程完成写入，触发 COW\n");
-        exit(0);
+        getrusage(RUSAGE_SELF, &ru1);
+        printf("cowtest: 子进程完成写入，写时复制缺页 %lu 次\n", ru1.cow_faults - ru0.cow_faults);
+        exit(ru1.cow_faults - ru0.cow_faults >= TEST_PAGES ? 0 : 1);
     }
 
     int status = 0;
@@ -62,5 +196,9 @@ int main(void) {
     printf("cowtest: 测试通过，fork+写操作耗时 %lu us\n", end - start);
 
     free(buf);
+    if (fault_kind_test() < 0)
+        exit(-1);
+    if (swap_test() < 0)
+        exit(-1);
     exit(0);
 }
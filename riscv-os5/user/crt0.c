@@ -0,0 +1,14 @@
+#include "user.h"
+
+// 用户程序入口。与运行库分开编译：共享运行库（ULIB_SHARED=1）时库不随程序链接，
+// 只有入口与 main 留在程序自己的镜像里。
+
+extern int main(void);
+
+// _start 是所有用户程序的入口。内核加载 ELF 后从该符号开始执行，
+// 负责调用 main() 并将返回值作为 exit 的退出码。放入 .text.boot 以便链接脚本控制位置。
+void _start(void) __attribute__((noreturn, section(".text.boot")));
+void _start(void)
+{
+    exit(main());
+}
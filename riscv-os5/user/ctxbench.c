@@ -0,0 +1,103 @@
+#include "user.h"
+
+#define PAGE_SIZE 4096
+#define ROUNDS 2000
+
+// 父子进程共享的一页：turn 为 1 时轮到子进程，0 时轮到父进程，2 表示结束
+struct shared {
+    volatile int turn;
+    volatile unsigned long child_fp;   // 子进程浮点累加结果的位模式
+};
+
+static struct shared *sh;
+// 浮点累加器放在数据段：只有 use_fp 的路径才会访问，保证整数测试不执行任何浮点指令。
+// fork 时子进程继承初值 1.0，两边各自累加
+static volatile double acc = 1.0;
+
+// 每轮推进一步的浮点计算；寄存器现场若在切换中丢失，结果会与预期不一致
+static double fp_step(double x) {
+    return x * 1.0000001 + 0.5;
+}
+
+static unsigned long fp_bits(double x) {
+    union { double d; unsigned long u; } v;
+    v.d = x;
+    return v.u;
+}
+
+static void child_loop(int use_fp) {
+    int t;
+    for (;;) {
+        while ((t = sh->turn) == 0)
+            futex_wait(&sh->turn, 0);
+        if (t == 2)
+            break;
+        if (use_fp)
+            acc = fp_step(acc);
+        sh->turn = 0;
+        futex_wake(&sh->turn, 1);
+    }
+    if (use_fp)
+        sh->child_fp = fp_bits(acc);
+    exit(0);
+}
+
+// 父子进程通过 futex 轮流运行 ROUNDS 轮，每轮两次上下文切换。
+// use_fp 为 1 时双方每轮都写浮点寄存器，迫使每次切换都保存/恢复浮点现场。
+// 返回平均每次切换的 get_time 计数，失败返回 -1。只能以 use_fp 为 0、1 的顺序各调用一次
+static long run(int use_fp) {
+    sh->turn = 0;
+    sh->child_fp = 0;
+    int pid = fork();
+    if (pid < 0) {
+        printf("ctxbench: fork 失败\n");
+        return -1;
+    }
+    if (pid == 0)
+        child_loop(use_fp);
+
+    int t;
+    uint64_t start = get_time();
+    for (int i = 0; i < ROUNDS; i++) {
+        sh->turn = 1;
+        futex_wake(&sh->turn, 1);
+        while ((t = sh->turn) == 1)
+            futex_wait(&sh->turn, 1);
+        if (use_fp)
+            acc = fp_step(acc);
+    }
+    uint64_t elapsed = get_time() - start;
+
+    sh->turn = 2;
+    futex_wake(&sh->turn, 1);
+    wait(0);
+
+    // 两边做了相同次数的相同计算，结果必须逐位一致
+    if (use_fp && sh->child_fp != fp_bits(acc)) {
+        printf("ctxbench: 浮点寄存器在上下文切换中被破坏\n");
+        return -1;
+    }
+    return (long)(elapsed / (2 * ROUNDS));
+}
+
+int main(void) {
+    sh = (struct shared *)mmap(0, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED) {
+        printf("ctxbench: 共享映射失败\n");
+        exit(-1);
+    }
+
+    long integer = run(0);
+    long fp = run(1);
+    if (integer < 0 || fp < 0) {
+        printf("ctxbench: 失败\n");
+        exit(-1);
+    }
+
+    printf("ctxbench: %d 轮乒乓，每次切换耗时（get_time 计数）\n", ROUNDS);
+    printf("  integer only: %d\n", (int)integer);
+    printf("  fp in use:    %d\n", (int)fp);
+    printf("ctxbench: 测试通过\n");
+    exit(0);
+}
@@ -3,6 +3,8 @@
 #define PAGE_SIZE 4096
 #define TEST_PAGES 1024   // 约 4 MB 内存，便于放大差异
 #define ITERATIONS 32     // 每种场景循环次数
+#define NCHILD 200        // 同时存活的子进程数，超过早期固定进程表的 64 个槽位
+#define NGEN 3            // 孤儿测试：子进程再 fork 的个数
 
 static char *buffer;
 
@@ -49,7 +51,135 @@ static void run_scenario(const char *label, int child_writes) {
            label, total / ITERATIONS, worst);
 }
 
+// 父子进程共享的一页：子进程在 release 变为 1 之前保持存活
+struct shared {
+    volatile int release;
+};
+
+static struct shared *sh;
+
+static void child(void) {
+    while (sh->release == 0)
+        futex_wait(&sh->release, 0);
+    exit(getpid() & 0xff);
+}
+
+// NCHILD 个子进程同时存活，随后全部被 wait 回收，退出状态与 pid 对应
+static int test_many_children(void) {
+    int pids[NCHILD];
+    sh->release = 0;
+
+    for (int i = 0; i < NCHILD; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            printf("forktest: 第 %d 个 fork 失败\n", i);
+            return -1;
+        }
+        if (pids[i] == 0)
+            child();
+    }
+
+    sh->release = 1;
+    futex_wake(&sh->release, NCHILD);
+
+    for (int n = 0; n < NCHILD; n++) {
+        int status;
+        int pid = wait(&status);
+        int found = 0;
+        for (int i = 0; i < NCHILD; i++) {
+            if (pids[i] == pid) {
+                pids[i] = 0;
+                found = 1;
+                break;
+            }
+        }
+        if (!found || status != (pid & 0xff)) {
+            printf("forktest: wait 返回 pid=%d status=%d 不符\n", pid, status);
+            return -1;
+        }
+    }
+    if (wait(0) != -1) {
+        printf("forktest: 子进程已全部回收，wait 应返回 -1\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 子进程 fork 出孙进程后不等待就退出，孙进程交给 init 回收；父进程只应收到子进程
+static int test_orphans(void) {
+    int pid = fork();
+    if (pid < 0) {
+        printf("forktest: fork 失败\n");
+        return -1;
+    }
+    if (pid == 0) {
+        for (int i = 0; i < NGEN; i++) {
+            if (fork() == 0)
+                exit(0);
+        }
+        exit(7);
+    }
+    int status;
+    if (wait(&status) != pid || status != 7 || wait(0) != -1) {
+        printf("forktest: 孤儿进程测试失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// waitpid：WNOHANG 在子进程存活时立即返回 0；指定 pid 时只回收该子进程
+static int test_waitpid(void) {
+    sh->release = 0;
+    int blocked = fork();
+    if (blocked == 0)
+        child();
+    int quick = fork();
+    if (quick == 0)
+        exit(3);
+    if (blocked < 0 || quick < 0) {
+        printf("forktest: fork 失败\n");
+        return -1;
+    }
+
+    int status;
+    if (waitpid(blocked, &status, WNOHANG) != 0) {
+        printf("forktest: WNOHANG 未立即返回 0\n");
+        return -1;
+    }
+    if (waitpid(quick, &status, 0) != quick || status != 3) {
+        printf("forktest: waitpid 未回收指定子进程\n");
+        return -1;
+    }
+    if (waitpid(quick, &status, 0) != -1 || waitpid(getpid(), &status, WNOHANG) != -1) {
+        printf("forktest: waitpid 接受了非子进程\n");
+        return -1;
+    }
+
+    sh->release = 1;
+    futex_wake(&sh->release, 1);
+    if (waitpid(blocked, &status, 0) != blocked || status != (blocked & 0xff)) {
+        printf("forktest: waitpid 等待阻塞的子进程失败\n");
+        return -1;
+    }
+    return 0;
+}
+
 int main(void) {
+    sh = (struct shared *)mmap(0, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED) {
+        printf("forktest: 共享映射失败\n");
+        exit(-1);
+    }
+
+    // 先在地址空间较小时测试大量并发子进程与孤儿回收
+    uint64_t start = get_time();
+    if (test_many_children() < 0 || test_orphans() < 0 || test_waitpid() < 0) {
+        printf("forktest: 失败\n");
+        exit(-1);
+    }
+    printf("forktest: %d 个并发子进程的创建与回收耗时 %lu us\n", NCHILD, get_time() - start);
+
     printf("forktest: COW 对比测试开始 (总内存=%d KB)\n",
            (TEST_PAGES * PAGE_SIZE) / 1024);
 
@@ -190,7 +190,7 @@ static int test_crash_recovery(void)
     int fd = open(path, O_CREATE | O_RDWR);
     if(fd < 0)
         return fail("create crash file stage1");
-    if(write_full(fd, payload, strlen(payload)) < 0){
+    if(write_full(fd, payload, strlen(payload)) < 0 || fsync(fd) < 0){
         close(fd);
         return fail("write crash payload stage1");
     }
@@ -204,13 +204,19 @@ static int test_crash_recovery(void)
         return -1;
     }
     unlink(path);
+    // 异步提交模式下先让删除提交，否则它会与下面的修改一起在 crash_stage 2 中丢失
+    if((fd = open(".", O_RDONLY)) >= 0){
+        fsync(fd);
+        close(fd);
+    }
 
     if(set_crash_stage(2) < 0)
         return fail("set crash stage 2");
     fd = open(path, O_CREATE | O_RDWR);
     if(fd < 0)
         return fail("create crash file stage2");
-    if(write_full(fd, payload, strlen(payload)) < 0){
+    // 异步提交模式下 fsync 在 crash_stage 2 期间触发提交，使头部同样被丢弃
+    if(write_full(fd, payload, strlen(payload)) < 0 || fsync(fd) < 0){
         close(fd);
         return fail("write crash payload stage2");
     }
@@ -230,6 +236,63 @@ static int test_crash_recovery(void)
     return 0;
 }
 
+// 崩溃前删除的文件：删除在崩溃前没有提交，恢复后文件仍在，内容必须是原来的。
+// 顺序数据模式下新文件的数据块在提交头部之前就写回原位置，若分到了删除释放的块，
+// 恢复出的旧文件就会读到新文件的内容，因此这些块在删除提交前不能重新分配
+#define OCRASH_OLD_BLOCKS 4
+#define OCRASH_NEW_BLOCKS 16
+
+static char ocrash_buf[OCRASH_NEW_BLOCKS * BLOCK_SIZE];
+
+static int test_ordered_crash(void)
+{
+    const char *path = "fs_ocrash", *other = "fs_ocrash_new";
+    int fd, ok;
+
+    unlink(path);
+    unlink(other);
+    memset(ocrash_buf, 'o', OCRASH_OLD_BLOCKS * BLOCK_SIZE);
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0)
+        return fail("create ordered crash file");
+    ok = write_full(fd, ocrash_buf, OCRASH_OLD_BLOCKS * BLOCK_SIZE) == 0 && fsync(fd) == 0;
+    close(fd);
+    if(!ok)
+        return fail("write ordered crash file");
+
+    if(set_crash_stage(2) < 0)
+        return fail("set crash stage 2");
+    ok = unlink(path) == 0;
+    sleep(10);   // 让回收线程释放被删文件的块（同样不会提交）
+    memset(ocrash_buf, 'n', sizeof(ocrash_buf));
+    if(ok && (fd = open(other, O_CREATE | O_RDWR)) >= 0) {
+        ok = write_full(fd, ocrash_buf, sizeof(ocrash_buf)) == 0 && fsync(fd) == 0;
+        close(fd);
+    } else {
+        ok = 0;
+    }
+    if(set_crash_stage(0) < 0)
+        return fail("restore crash stage from 2");
+    if(!ok)
+        return fail("ordered crash stage2 operations");
+    if(simulate_restart() < 0)
+        return -1;
+
+    memset(ocrash_buf, 0, sizeof(ocrash_buf));
+    if((fd = open(path, O_RDONLY)) < 0)
+        return fail("deleted file lost after crash");
+    int n = read_full(fd, ocrash_buf, sizeof(ocrash_buf));
+    close(fd);
+    unlink(path);
+    unlink(other);
+    if(n != OCRASH_OLD_BLOCKS * BLOCK_SIZE)
+        return fail("ordered crash file length");
+    for(int i = 0; i < n; i++) {
+        if(ocrash_buf[i] != 'o')
+            return fail("ordered crash file overwritten by new data");
+    }
+    return 0;
+}
+
 // 手册要求：性能测试（统计小文件与大文件写入耗时）
 static int test_filesystem_performance(void)
 {
@@ -282,11 +345,661 @@ static int test_filesystem_performance(void)
     return 0;
 }
 
+// 交替逐块追加两个文件，使各自的块不连续、区段数超出 inode 内联的个数，再读回校验
+#define INTERLEAVE_BLOCKS 16
+
+static int test_interleaved_files(void)
+{
+    const char *names[2] = { "ileave_a", "ileave_b" };
+    int fds[2];
+    static char block[BLOCK_SIZE], expect[BLOCK_SIZE];
+
+    for(int f = 0; f < 2; f++){
+        if((fds[f] = open(names[f], O_CREATE | O_RDWR)) < 0)
+            return fail("open interleaved file");
+    }
+    for(int i = 0; i < INTERLEAVE_BLOCKS; i++){
+        for(int f = 0; f < 2; f++){
+            memset(block, 'a' + f * INTERLEAVE_BLOCKS + i, sizeof(block));
+            if(write_full(fds[f], block, sizeof(block)) < 0)
+                return fail("write interleaved block");
+        }
+    }
+    for(int f = 0; f < 2; f++)
+        close(fds[f]);
+
+    for(int f = 0; f < 2; f++){
+        int fd = open(names[f], O_RDONLY);
+        if(fd < 0)
+            return fail("reopen interleaved file");
+        for(int i = 0; i < INTERLEAVE_BLOCKS; i++){
+            memset(expect, 'a' + f * INTERLEAVE_BLOCKS + i, sizeof(expect));
+            if(read_full(fd, block, sizeof(block)) != (int)sizeof(block) ||
+               !buffer_equals(block, expect, sizeof(block))){
+                close(fd);
+                return fail("interleaved content");
+            }
+        }
+        close(fd);
+        unlink(names[f]);
+    }
+    return 0;
+}
+
+// 页缓存直写：先读入使两块进入页缓存，再从头覆盖一段并跨越块边界，重新读取应看到新内容
+static int test_page_cache_coherence(void)
+{
+    const char *path = "pcache_file";
+    static char buf[2 * BLOCK_SIZE], expect[2 * BLOCK_SIZE];
+    int fd, patch = BLOCK_SIZE + 100;
+
+    memset(expect, 'x', sizeof(expect));
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0)
+        return fail("open pcache_file");
+    if(write_full(fd, expect, sizeof(expect)) < 0){
+        close(fd);
+        return fail("write pcache_file");
+    }
+    close(fd);
+
+    for(int pass = 0; pass < 2; pass++){
+        if((fd = open(path, O_RDONLY)) < 0)
+            return fail("reopen pcache_file");
+        int n = read_full(fd, buf, sizeof(buf));
+        close(fd);
+        if(n != (int)sizeof(buf) || !buffer_equals(buf, expect, sizeof(buf)))
+            return fail("pcache_file content");
+        if(pass == 1)
+            break;
+
+        // 打开时偏移为 0，写入覆盖文件开头
+        memset(expect, 'y', patch);
+        if((fd = open(path, O_RDWR)) < 0)
+            return fail("reopen pcache_file for write");
+        if(write_full(fd, expect, patch) < 0){
+            close(fd);
+            return fail("overwrite pcache_file");
+        }
+        close(fd);
+    }
+    unlink(path);
+    return 0;
+}
+
+// 批量提交环：一次 uring_enter 完成打开、逐行追加与关闭，再用普通 read 校验内容
+#define URING_LINES 24
+#define URING_LINE "uring line\n"
+
+static struct uring ring;
+
+static void uring_push(int op, int fd, const void *addr, int len, int flags)
+{
+    struct uring_sqe *sqe = &ring.sq[ring.sq_tail % URING_ENTRIES];
+    sqe->op = op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)addr;
+    sqe->len = len;
+    sqe->flags = flags;
+    sqe->user_data = ring.sq_tail;
+    __sync_synchronize();
+    ring.sq_tail++;
+}
+
+// 收割一个完成项：返回其结果，环为空时返回 -2
+static long uring_pop(void)
+{
+    if(ring.cq_head == ring.cq_tail)
+        return -2;
+    long res = ring.cq[ring.cq_head % URING_ENTRIES].res;
+    ring.cq_head++;
+    return res;
+}
+
+static int test_uring_batch(void)
+{
+    const char *path = "uring_file";
+    int len = sizeof(URING_LINE) - 1;
+    unlink(path);
+
+    if(uring_setup(&ring) < 0)
+        return fail("uring_setup");
+
+    uring_push(URING_OP_OPEN, 0, path, 0, O_CREATE | O_RDWR);
+    if(uring_enter() != 1)
+        return fail("uring_enter open");
+    long fd = uring_pop();
+    if(fd < 0)
+        return fail("uring open");
+
+    for(int i = 0; i < URING_LINES; i++)
+        uring_push(URING_OP_WRITE, fd, URING_LINE, len, 0);
+    uring_push(URING_OP_FSYNC, fd, 0, 0, 0);
+    uring_push(URING_OP_CLOSE, fd, 0, 0, 0);
+
+    uint64_t start = get_time();
+    if(uring_enter() != URING_LINES + 2)
+        return fail("uring_enter batch");
+    uint64_t elapsed = get_time() - start;
+
+    for(int i = 0; i < URING_LINES + 2; i++){
+        long res = uring_pop();
+        if(res != (i < URING_LINES ? len : 0))
+            return fail("uring completion");
+    }
+    if(uring_pop() != -2)
+        return fail("uring extra completion");
+    printf("    %d appends in one uring_enter: %lu cycles\n", URING_LINES, elapsed);
+
+    char buf[URING_LINES * (sizeof(URING_LINE) - 1)];
+    int rfd = open(path, O_RDONLY);
+    if(rfd < 0)
+        return fail("open uring_file");
+    int n = read_full(rfd, buf, sizeof(buf));
+    int extra = read(rfd, buf, 1);
+    close(rfd);
+    if(n != (int)sizeof(buf) || extra != 0)
+        return fail("uring_file size");
+    for(int i = 0; i < URING_LINES; i++){
+        if(!buffer_equals(buf + i * len, URING_LINE, len))
+            return fail("uring_file content");
+    }
+    unlink(path);
+    return 0;
+}
+
+// 集中写三段后用 pread/pwrite 在中间读改，确认文件偏移未动；再用 sendfile 复制到另一文件校验
+static int test_vectored_io(void)
+{
+    const char *path = "iov_file", *copy = "iov_copy";
+    static char a[100], b[BLOCK_SIZE], c[300], buf[BLOCK_SIZE + 400];
+    struct iovec iov[3] = { { a, sizeof(a) }, { b, sizeof(b) }, { c, sizeof(c) } };
+    int total = sizeof(a) + sizeof(b) + sizeof(c);
+    int fd, out;
+
+    memset(a, 'a', sizeof(a));
+    memset(b, 'b', sizeof(b));
+    memset(c, 'c', sizeof(c));
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0)
+        return fail("open iov_file");
+    if(writev(fd, iov, 3) != total){
+        close(fd);
+        return fail("writev iov_file");
+    }
+    if(pwrite(fd, "PQ", 2, sizeof(a) - 1) != 2 || pread(fd, buf, 4, sizeof(a) - 2) != 4 ||
+       !buffer_equals(buf, "aPQb", 4)){
+        close(fd);
+        return fail("pread/pwrite iov_file");
+    }
+    // 偏移仍在文件末尾
+    if(read(fd, buf, 1) != 0){
+        close(fd);
+        return fail("pwrite moved offset");
+    }
+    close(fd);
+
+    if((fd = open(path, O_RDONLY)) < 0 || (out = open(copy, O_CREATE | O_RDWR)) < 0)
+        return fail("open iov_copy");
+    int n = sendfile(out, fd, -1, total + 10);
+    close(fd);
+    close(out);
+    if(n != total)
+        return fail("sendfile iov_copy");
+
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    memset(c, 0, sizeof(c));
+    if((fd = open(copy, O_RDONLY)) < 0)
+        return fail("reopen iov_copy");
+    n = readv(fd, iov, 3);
+    close(fd);
+    unlink(path);
+    unlink(copy);
+    if(n != total || a[0] != 'a' || a[sizeof(a) - 1] != 'P' || b[0] != 'Q' || b[1] != 'b' ||
+       c[sizeof(c) - 1] != 'c')
+        return fail("iov_copy content");
+    return 0;
+}
+
+// 复制描述符超过内联槽数以触发扩展，检查总是分配最低空闲号，且 fork 后子进程看到相同的描述符
+#define FD_GROW_COUNT 40
+
+static int test_fd_table(void)
+{
+    int fds[FD_GROW_COUNT];
+    int n = 0, ret = 0;
+
+    for(; n < FD_GROW_COUNT; n++){
+        if((fds[n] = dup(1)) < 0)
+            break;
+        if(n > 0 && fds[n] != fds[n - 1] + 1){
+            n++;
+            ret = fail("fd not lowest");
+            goto out;
+        }
+    }
+    if(n != FD_GROW_COUNT){
+        ret = fail("dup beyond inline table");
+        goto out;
+    }
+    close(fds[5]);
+    close(fds[30]);
+    if(dup(1) != fds[5] || dup(1) != fds[30]){
+        ret = fail("lowest fd reuse");
+        goto out;
+    }
+
+    int pid = fork();
+    if(pid < 0){
+        ret = fail("fork fd table");
+        goto out;
+    }
+    if(pid == 0){
+        // 子进程的最后一个描述符应当可写，且下一个分配号紧随其后
+        int next = dup(1);
+        exit(write(fds[FD_GROW_COUNT - 1], "", 0) == 0 && next == fds[FD_GROW_COUNT - 1] + 1 ? 0 : 1);
+    }
+    int status = -1;
+    wait(&status);
+    if(status != 0)
+        ret = fail("child fd table");
+out:
+    for(int i = 0; i < n; i++)
+        close(fds[i]);
+    return ret;
+}
+
+// 普通文件全缓冲：fprintf 的内容在 fflush 或 close 之前不落到文件里；snprintf 截断但返回完整长度
+static int test_buffered_stdio(void)
+{
+    char buf[32];
+    int ret = 0;
+    int fd = open("stdiofile", O_CREATE | O_RDWR);
+    int rd = open("stdiofile", O_RDONLY);
+
+    if(fd < 0 || rd < 0)
+        return fail("open stdiofile");
+    fprintf(fd, "%d-%s\n", 42, "abc");
+    if(read(rd, buf, sizeof(buf)) != 0)
+        ret = fail("file output not buffered");
+    else if(fflush(fd) < 0 || read(rd, buf, sizeof(buf)) != 7 || buf[0] != '4' || buf[6] != '\n')
+        ret = fail("fflush");
+    fwrite(fd, "tail", 4);
+    close(fd);
+    if(ret == 0 && (read(rd, buf, sizeof(buf)) != 4 || buf[0] != 't'))
+        ret = fail("flush on close");
+    close(rd);
+    unlink("stdiofile");
+
+    if(ret == 0 && (snprintf(buf, 5, "%d", 123456) != 6 || buf[3] != '4' || buf[4] != 0))
+        ret = fail("snprintf truncation");
+    return ret;
+}
+
+// /tmp 下的文件只在内存中：跨页写入后读回，删除后不可再打开；经 /tmp/.. 回到根目录
+static int test_tmpfs(void)
+{
+    static char buf[BLOCK_SIZE * 2 + 100], back[sizeof(buf)];
+    int fd;
+
+    for(int i = 0; i < (int)sizeof(buf); i++)
+        buf[i] = 'a' + i % 26;
+    if((fd = open("/tmp/scratch", O_CREATE | O_RDWR)) < 0)
+        return fail("open /tmp/scratch");
+    if(write_full(fd, buf, sizeof(buf)) < 0){
+        close(fd);
+        return fail("write /tmp/scratch");
+    }
+    if(pread(fd, back, sizeof(back), 0) != (int)sizeof(back) || !buffer_equals(buf, back, sizeof(buf))){
+        close(fd);
+        return fail("read back /tmp/scratch");
+    }
+    close(fd);
+    if(open("scratch", O_RDONLY) >= 0)
+        return fail("tmpfs file visible on disk");
+
+    if(unlink("/tmp/scratch") < 0 || open("/tmp/scratch", O_RDONLY) >= 0)
+        return fail("unlink /tmp/scratch");
+
+    if(chdir("/tmp") < 0 || (fd = open("rel", O_CREATE | O_RDWR)) < 0)
+        return fail("chdir /tmp");
+    close(fd);
+    int ok = chdir("..") == 0 && (fd = open("fstest", O_RDONLY)) >= 0;
+    if(ok)
+        close(fd);
+    chdir("/");
+    if(unlink("/tmp/rel") < 0)
+        return fail("unlink /tmp/rel");
+    return ok ? 0 : fail("tmpfs parent");
+}
+
+// 小文件先内联在 inode 中，追加到超过内联上限后转换为块格式，内容保持不变
+static int test_inline(void)
+{
+    static char buf[BLOCK_SIZE + 100], back[sizeof(buf)];
+    int fd;
+
+    for(int i = 0; i < (int)sizeof(buf); i++)
+        buf[i] = 'A' + i % 23;
+    unlink("inline");
+    if((fd = open("inline", O_CREATE | O_RDWR)) < 0)
+        return fail("open inline");
+    int ok = write_full(fd, buf, 20) == 0 && write_full(fd, buf + 20, 20) == 0 &&
+             pread(fd, back, 40, 0) == 40 && buffer_equals(buf, back, 40);
+    if(ok)
+        ok = write_full(fd, buf + 40, sizeof(buf) - 40) == 0 &&
+             pread(fd, back, sizeof(back), 0) == (int)sizeof(back) && buffer_equals(buf, back, sizeof(buf));
+    close(fd);
+    unlink("inline");
+    if(!ok)
+        return fail("inline file contents");
+
+    unlink("inline_ln");
+    if(symlink("fstest", "inline_ln") < 0 || (fd = open("inline_ln", O_RDONLY)) < 0)
+        return fail("symlink to fstest");
+    close(fd);
+    unlink("inline_ln");
+    return 0;
+}
+
+// getdents 分批列出目录：每个文件恰好出现一次，GETDENTS_STAT 给出的类型与大小正确
+#define GETDENTS_FILES 300
+#define GETDENTS_BATCH 64
+
+static int test_getdents(void)
+{
+    static char seen[GETDENTS_FILES];
+    static struct dirent_info ents[GETDENTS_BATCH];
+    char name[16];
+    int fd, n, found = 0, calls = 0, ok = 1;
+
+    for(int i = 0; i < GETDENTS_FILES; i++){
+        snprintf(name, sizeof(name), "gd%d", i);
+        if((fd = open(name, O_CREATE | O_RDWR)) < 0)
+            return fail("create gd file");
+        int w = write_full(fd, "xxxx", i % 5);
+        close(fd);
+        if(w < 0)
+            return fail("write gd file");
+    }
+
+    if((fd = open(".", O_RDONLY)) < 0)
+        return fail("open .");
+    while((n = getdents(fd, ents, GETDENTS_BATCH, GETDENTS_STAT)) > 0){
+        calls++;
+        for(int j = 0; j < n; j++){
+            struct dirent_info *d = &ents[j];
+            if(d->name[0] != 'g' || d->name[1] != 'd' || d->name[2] == '\0')
+                continue;
+            int i = 0;
+            for(char *p = d->name + 2; *p >= '0' && *p <= '9'; p++)
+                i = i * 10 + (*p - '0');
+            if(i >= GETDENTS_FILES || seen[i] || d->type != 2 || d->size != (unsigned)(i % 5))
+                ok = 0;
+            else
+                seen[i] = 1;
+            found++;
+        }
+    }
+    close(fd);
+    for(int i = 0; i < GETDENTS_FILES; i++){
+        snprintf(name, sizeof(name), "gd%d", i);
+        unlink(name);
+    }
+    if(n < 0)
+        return fail("getdents");
+    if(!ok || found != GETDENTS_FILES)
+        return fail("getdents entries");
+    printf("[fstest] getdents: %d entries in %d calls\n", found, calls);
+    return 0;
+}
+
+// 在当前目录中查找 name，返回 getdents 给出的文件大小，找不到时返回 -1
+static int dir_size_of(const char *name)
+{
+    static struct dirent_info ents[GETDENTS_BATCH];
+    int fd = open(".", O_RDONLY), n, size = -1;
+    if(fd < 0)
+        return -1;
+    while(size < 0 && (n = getdents(fd, ents, GETDENTS_BATCH, GETDENTS_STAT)) > 0){
+        for(int j = 0; j < n; j++){
+            int k = 0;
+            while(name[k] && name[k] == ents[j].name[k])
+                k++;
+            if(name[k] == '\0' && ents[j].name[k] == '\0')
+                size = ents[j].size;
+        }
+    }
+    close(fd);
+    return size;
+}
+
+// fallocate 预留块后文件大小不变；随后的小块追加写入读回正确，未写到的部分不会露出
+#define FALLOC_BLOCKS 64
+
+static int test_fallocate(void)
+{
+    static char buf[100], back[sizeof(buf)];
+    int fd;
+
+    unlink("falloc");
+    if((fd = open("falloc", O_CREATE | O_RDWR)) < 0)
+        return fail("open falloc");
+    if(fallocate(fd, 0, FALLOC_BLOCKS * BLOCK_SIZE) < 0){
+        close(fd);
+        unlink("falloc");
+        return fail("fallocate");
+    }
+    int ok = dir_size_of("falloc") == 0;
+    int total = 0;
+    for(int i = 0; ok && i < 500; i++){
+        for(int j = 0; j < (int)sizeof(buf); j++)
+            buf[j] = (char)(i + j);
+        ok = write_full(fd, buf, sizeof(buf)) == 0;
+        total += sizeof(buf);
+    }
+    ok = ok && dir_size_of("falloc") == total;
+    for(int i = 0; ok && i < 500; i += 37){
+        for(int j = 0; j < (int)sizeof(buf); j++)
+            buf[j] = (char)(i + j);
+        ok = pread(fd, back, sizeof(back), i * sizeof(buf)) == (int)sizeof(back) &&
+             buffer_equals(buf, back, sizeof(buf));
+    }
+    ok = ok && pread(fd, back, sizeof(back), total) == 0;
+    ok = ok && fallocate(fd, 0, 0) < 0;
+    close(fd);
+    unlink("falloc");
+    return ok ? 0 : fail("fallocate contents");
+}
+
+// 打开着删除的大文件在关闭时交给回收线程释放：反复占用大半个磁盘，
+// 空间迟迟不归还时后一轮的 fallocate 会失败，等一会儿再试
+#define ORPHAN_BLOCKS 3000
+#define ORPHAN_ROUNDS 4
+
+static int test_orphan_reclaim(void)
+{
+    for(int round = 0; round < ORPHAN_ROUNDS; round++){
+        int fd = open("orphan", O_CREATE | O_RDWR);
+        if(fd < 0)
+            return fail("open orphan");
+        if(unlink("orphan") < 0){
+            close(fd);
+            return fail("unlink open file");
+        }
+        int tries = 0;
+        while(fallocate(fd, 0, ORPHAN_BLOCKS * BLOCK_SIZE) < 0 && ++tries < 100)
+            sleep(5);
+        if(write_full(fd, "x", 1) < 0 || tries == 100){
+            close(fd);
+            return fail("space of deleted file not reclaimed");
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+// O_DIRECT：对齐的整块直接读写与普通读写看到同一份内容，带不足一块的尾部的请求照常完成。
+// 先经普通写入把开头的块读进缓存，再用 O_DIRECT 覆盖，校验缓存中的副本没有被写回的旧内容盖掉
+#define DIRECT_BLOCKS 24
+#define DIRECT_TAIL 100
+
+static char direct_buf[DIRECT_BLOCKS * BLOCK_SIZE + DIRECT_TAIL] __attribute__((aligned(BLOCK_SIZE)));
+static char direct_back[sizeof(direct_buf)] __attribute__((aligned(BLOCK_SIZE)));
+
+static int test_direct_io(void)
+{
+    int fd, ok;
+
+    unlink("direct");
+    if((fd = open("direct", O_CREATE | O_RDWR)) < 0)
+        return fail("open direct");
+    memset(direct_buf, 'a', 2 * BLOCK_SIZE);
+    ok = write_full(fd, direct_buf, 2 * BLOCK_SIZE) == 0;
+    close(fd);
+    if(!ok)
+        return fail("buffered write before direct");
+
+    for(int i = 0; i < (int)sizeof(direct_buf); i++)
+        direct_buf[i] = (char)(i / BLOCK_SIZE + i * 7);
+    if((fd = open("direct", O_RDWR | O_DIRECT)) < 0)
+        return fail("open O_DIRECT");
+    ok = write(fd, direct_buf, sizeof(direct_buf)) == (int)sizeof(direct_buf);
+    close(fd);
+
+    if(ok && (fd = open("direct", O_RDONLY)) >= 0){
+        ok = read_full(fd, direct_back, sizeof(direct_back)) == (int)sizeof(direct_back) &&
+             buffer_equals(direct_buf, direct_back, sizeof(direct_buf));
+        close(fd);
+    }
+    // 普通写入改动中间一块的一部分，O_DIRECT 读取须看到它
+    memset(direct_buf + 5 * BLOCK_SIZE + 10, 'z', 300);
+    if(ok && (fd = open("direct", O_RDWR)) >= 0){
+        ok = pwrite(fd, direct_buf + 5 * BLOCK_SIZE + 10, 300, 5 * BLOCK_SIZE + 10) == 300;
+        close(fd);
+    }
+    if(ok && (fd = open("direct", O_RDONLY | O_DIRECT)) >= 0){
+        memset(direct_back, 0, sizeof(direct_back));
+        ok = read(fd, direct_back, sizeof(direct_back)) == (int)sizeof(direct_back) &&
+             buffer_equals(direct_buf, direct_back, sizeof(direct_buf)) &&
+             read(fd, direct_back, BLOCK_SIZE) == 0;
+        close(fd);
+    }
+    unlink("direct");
+    return ok ? 0 : fail("O_DIRECT contents");
+}
+
+// clone_file：副本读出与原文件相同的内容；之后两边各自改写（副本改一块的一部分，
+// 原文件整块覆盖另一块），各自只看到自己的修改，共享的块在改写时才复制
+#define CLONE_BLOCKS 40
+#define CLONE_TAIL 123
+#define CLONE_SIZE (CLONE_BLOCKS * BLOCK_SIZE + CLONE_TAIL)
+
+static char clone_src[CLONE_SIZE], clone_dst[CLONE_SIZE], clone_back[CLONE_SIZE];
+
+static int check_contents(const char *path, const char *want, int n)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+    int ok = read_full(fd, clone_back, n) == n && buffer_equals(want, clone_back, n) &&
+             read(fd, clone_back, 1) == 0;
+    close(fd);
+    return ok;
+}
+
+static int test_clone_file(void)
+{
+    int src, dst, ok;
+
+    unlink("clone_a");
+    unlink("clone_b");
+    for(int i = 0; i < CLONE_SIZE; i++)
+        clone_src[i] = (char)(i / BLOCK_SIZE * 3 + i * 5);
+    if((src = open("clone_a", O_CREATE | O_RDWR)) < 0)
+        return fail("open clone_a");
+    ok = write_full(src, clone_src, CLONE_SIZE) == 0;
+    if(ok && (dst = open("clone_b", O_CREATE | O_RDWR)) >= 0){
+        ok = write_full(dst, "stale", 5) == 0 && clone_file(src, dst) == 0;
+        close(dst);
+    } else {
+        ok = 0;
+    }
+    ok = ok && check_contents("clone_b", clone_src, CLONE_SIZE);
+
+    for(int i = 0; i < CLONE_SIZE; i++)
+        clone_dst[i] = clone_src[i];
+    memset(clone_dst + 7 * BLOCK_SIZE + 100, 'd', 500);
+    if(ok && (dst = open("clone_b", O_RDWR)) >= 0){
+        ok = pwrite(dst, clone_dst + 7 * BLOCK_SIZE + 100, 500, 7 * BLOCK_SIZE + 100) == 500;
+        close(dst);
+    }
+    memset(clone_src + 20 * BLOCK_SIZE, 's', BLOCK_SIZE);
+    ok = ok && pwrite(src, clone_src + 20 * BLOCK_SIZE, BLOCK_SIZE, 20 * BLOCK_SIZE) == BLOCK_SIZE;
+    close(src);
+
+    ok = ok && check_contents("clone_a", clone_src, CLONE_SIZE) &&
+         check_contents("clone_b", clone_dst, CLONE_SIZE);
+    unlink("clone_a");
+    ok = ok && check_contents("clone_b", clone_dst, CLONE_SIZE);
+    unlink("clone_b");
+    return ok ? 0 : fail("clone_file contents");
+}
+
+// 读写的字节数与记入日志的块数计入当前进程，子进程的统计在回收后并入 IOSTAT_CHILDREN
+static int test_io_accounting(void)
+{
+    struct proc_iostat before, after, cbefore, cafter;
+    int fd, ok;
+
+    unlink("iostat_f");
+    for(int i = 0; i < CLONE_SIZE; i++)
+        clone_src[i] = (char)(i * 7);
+    if(iostat(IOSTAT_SELF, &before) < 0 || iostat(IOSTAT_CHILDREN, &cbefore) < 0)
+        return fail("iostat");
+    if((fd = open("iostat_f", O_CREATE | O_RDWR)) < 0)
+        return fail("open iostat_f");
+    ok = write_full(fd, clone_src, CLONE_SIZE) == 0 &&
+         pread(fd, clone_back, CLONE_SIZE, 0) == CLONE_SIZE;
+    close(fd);
+    ok = ok && iostat(IOSTAT_SELF, &after) == 0;
+    if(!ok || after.wchar - before.wchar != CLONE_SIZE || after.rchar - before.rchar != CLONE_SIZE ||
+       after.log_blocks == before.log_blocks){
+        unlink("iostat_f");
+        return fail("iostat self counters");
+    }
+
+    int pid = fork();
+    if(pid == 0){
+        fd = open("iostat_f", O_RDONLY);
+        exit(fd >= 0 && read_full(fd, clone_back, CLONE_SIZE) == CLONE_SIZE ? 0 : 1);
+    }
+    int status = -1;
+    ok = pid > 0 && waitpid(pid, &status, 0) == pid && status == 0 &&
+         iostat(IOSTAT_CHILDREN, &cafter) == 0 && cafter.rchar - cbefore.rchar >= CLONE_SIZE;
+    unlink("iostat_f");
+    return ok ? 0 : fail("iostat children counters");
+}
+
 static struct fstest_case cases[] = {
     { "filesystem integrity", test_filesystem_integrity },
     { "concurrent access", test_concurrent_access },
     { "crash recovery", test_crash_recovery },
+    { "ordered crash", test_ordered_crash },
     { "filesystem performance", test_filesystem_performance },
+    { "uring batch", test_uring_batch },
+    { "interleaved files", test_interleaved_files },
+    { "page cache coherence", test_page_cache_coherence },
+    { "vectored io", test_vectored_io },
+    { "fd table", test_fd_table },
+    { "buffered stdio", test_buffered_stdio },
+    { "tmpfs", test_tmpfs },
+    { "inline files", test_inline },
+    { "getdents", test_getdents },
+    { "fallocate", test_fallocate },
+    { "orphan reclaim", test_orphan_reclaim },
+    { "direct io", test_direct_io },
+    { "clone file", test_clone_file },
+    { "io accounting", test_io_accounting },
 };
 
 int main(void)
@@ -0,0 +1,41 @@
+#include "user.h"
+
+#define MAXCPU 64
+
+// idlestat [-r] [-p us]: 打印各 hart 的空闲统计（时间为 time CSR 计数），
+// -p 先把空闲轮询窗口设为 us 微秒，-r 在打印后清零统计
+int main(int argc, char *argv[]) {
+    int reset = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'r') {
+            reset = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'p' && i + 1 < argc) {
+            int us = 0;
+            for (char *s = argv[++i]; *s >= '0' && *s <= '9'; s++)
+                us = us * 10 + (*s - '0');
+            if (idlepoll(us) < 0) {
+                printf("idlestat: 设置轮询窗口失败\n");
+                exit(-1);
+            }
+        } else {
+            printf("用法: idlestat [-r] [-p us]\n");
+            exit(-1);
+        }
+    }
+
+    static struct idle_stat st[MAXCPU];
+    int n = idlestat(st, MAXCPU, reset);
+    if (n < 0) {
+        printf("idlestat: 读取空闲统计失败\n");
+        exit(-1);
+    }
+
+    printf("poll window: %d us\n", idlepoll(-1));
+    printf("hart idle poll-hit wfi poll-time wfi-time\n");
+    for (int i = 0; i < n; i++) {
+        struct idle_stat *s = &st[i];
+        printf("%d %lu %lu %lu %lu %lu\n", i, s->idle_entries, s->poll_hits, s->wfi_entries,
+               s->poll_time, s->wfi_time);
+    }
+    exit(0);
+}
@@ -0,0 +1,90 @@
+#include "user.h"
+
+// iostat: 按块缓存未命中次数从多到少列出各进程的 I/O 统计，找出把块缓存挤满的进程。
+// iostat prog [args...]: 运行 prog，结束后打印它（含其子进程）的 I/O 统计。
+// rchar/wchar 为读写的字节数，hit/miss 为块缓存命中与未命中次数，rblk/wblk 为提交给磁盘的块数，
+// log 为记入日志的块数，iowait 为等待磁盘的毫秒数
+
+#define TIME_PER_MS 10000   // time CSR 为 10MHz（见 trap.h）
+#define NPROCINFO 64
+
+static struct procinfo procs[NPROCINFO];
+static struct proc_iostat stats[NPROCINFO];
+
+static void print_io(const struct proc_iostat *st) {
+    printf("%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+           st->rchar, st->wchar, st->cache_hits, st->cache_misses,
+           st->read_blocks, st->write_blocks, st->log_blocks, st->iowait / TIME_PER_MS);
+}
+
+static int run(char *argv[]) {
+    struct proc_iostat before, after;
+    if (iostat(IOSTAT_CHILDREN, &before) < 0) {
+        printf("iostat: 读取统计失败\n");
+        return -1;
+    }
+    int pid = fork();
+    if (pid < 0) {
+        printf("iostat: fork 失败\n");
+        return -1;
+    }
+    if (pid == 0) {
+        exec(argv[0], argv);
+        printf("iostat: 无法执行 %s\n", argv[0]);
+        exit(-1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    iostat(IOSTAT_CHILDREN, &after);
+
+    after.rchar -= before.rchar;
+    after.wchar -= before.wchar;
+    after.cache_hits -= before.cache_hits;
+    after.cache_misses -= before.cache_misses;
+    after.read_blocks -= before.read_blocks;
+    after.write_blocks -= before.write_blocks;
+    after.log_blocks -= before.log_blocks;
+    after.iowait -= before.iowait;
+    printf("iostat: %s 退出，状态 %d\n", argv[0], status);
+    printf("rchar\twchar\thit\tmiss\trblk\twblk\tlog\tiowait\n");
+    print_io(&after);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1)
+        exit(run(argv + 1) < 0 ? -1 : 0);
+
+    int n = procinfo(procs, NPROCINFO);
+    if (n < 0) {
+        printf("iostat: 读取进程信息失败\n");
+        exit(-1);
+    }
+    // 进程可能在两次系统调用之间退出，读不到的跳过
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (iostat(procs[i].pid, &stats[m]) < 0)
+            continue;
+        procs[m++] = procs[i];
+    }
+    // 按未命中次数插入排序
+    for (int i = 1; i < m; i++) {
+        struct procinfo pi = procs[i];
+        struct proc_iostat st = stats[i];
+        int j = i - 1;
+        while (j >= 0 && stats[j].cache_misses < st.cache_misses) {
+            procs[j + 1] = procs[j];
+            stats[j + 1] = stats[j];
+            j--;
+        }
+        procs[j + 1] = pi;
+        stats[j + 1] = st;
+    }
+
+    printf("PID\tNAME\trchar\twchar\thit\tmiss\trblk\twblk\tlog\tiowait\n");
+    for (int i = 0; i < m; i++) {
+        printf("%d\t%s\t", procs[i].pid, procs[i].name);
+        print_io(&stats[i]);
+    }
+    exit(0);
+}
@@ -0,0 +1,24 @@
+#include "user.h"
+
+#define MAXIRQ 64
+
+// irqstat [-r]: 列出各中断处理函数（上半部）与下半部工作项的次数与耗时（time CSR 计数），
+// -r 在打印后清零统计
+int main(int argc, char *argv[]) {
+    int reset = argc > 1 && argv[1][0] == '-' && argv[1][1] == 'r';
+
+    static struct irq_stat st[MAXIRQ];
+    int n = irqstat(st, MAXIRQ, reset);
+    if (n < 0) {
+        printf("irqstat: 读取中断统计失败\n");
+        exit(-1);
+    }
+
+    printf("name count total max avg\n");
+    for (int i = 0; i < n; i++) {
+        struct irq_stat *s = &st[i];
+        printf("%s %lu %lu %lu %lu\n", s->name, s->count, s->time_total, s->time_max,
+               s->count ? s->time_total / s->count : 0);
+    }
+    exit(0);
+}
@@ -1,5 +1,45 @@
 #include "user.h"
 
+// 读完 fd 上的全部日志，返回读到的字节数；每次读取都应以完整的日志行结束
+static int drain_klog(int fd)
+{
+    char buf[512];
+    int n, tot = 0;
+
+    while((n = read(fd, buf, sizeof(buf))) > 0) {
+        if(buf[n - 1] != '\n' || buf[0] != '[') {
+            printf("[klogtest] klog 读取返回了不完整的行\n");
+            return -1;
+        }
+        tot += n;
+    }
+    return n < 0 ? -1 : tot;
+}
+
+// klog 设备按打开实例保存游标：读完后再读返回 0，产生新日志后只读到新的部分
+static int test_klog_device(void)
+{
+    char *argv[] = { "no-such-program", 0 };
+    int fd = open("klog", O_RDONLY);
+
+    if(fd < 0) {
+        printf("[klogtest] 无法打开 klog 设备\n");
+        return -1;
+    }
+    if(drain_klog(fd) <= 0 || drain_klog(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    exec(argv[0], argv);            // 找不到文件，内核记录一条警告
+    int n = drain_klog(fd);
+    close(fd);
+    if(n <= 0) {
+        printf("[klogtest] 未读到新产生的日志\n");
+        return -1;
+    }
+    return 0;
+}
+
 int main(void)
 {
     printf("[klogtest] 设置日志阈值：记录 DEBUG，控制台 INFO\n");
@@ -15,5 +55,11 @@ int main(void)
     }
 
     printf("[klogtest] 转储完成，可在控制台查看输出\n");
+
+    if(test_klog_device() < 0) {
+        printf("[klogtest] klog 设备测试失败\n");
+        return -1;
+    }
+    printf("[klogtest] klog 设备测试通过\n");
     return 0;
 }
@@ -0,0 +1,18 @@
+#include "user.h"
+
+// lockstat [-r] [-i]: 打印内核各锁类的获取、竞争与持有时间统计，-r 在打印后清零。
+// -i 改为输出各 hart 最长的关中断区间（内核以 IRQSOFF_TRACE=1 编译时），结果写入 klog
+int main(int argc, char *argv[]) {
+    int flags = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'r')
+            flags |= LOCKSTAT_RESET;
+        else if (argv[i][0] == '-' && argv[i][1] == 'i')
+            flags |= LOCKSTAT_IRQSOFF;
+    }
+    if (lockstat(flags) < 0) {
+        printf("lockstat: 读取锁统计失败\n");
+        exit(-1);
+    }
+    exit(0);
+}
@@ -0,0 +1,35 @@
+#include "user.h"
+
+#define BATCH 128
+
+// 类型字母，下标为 fsformat.h 的 T_*（T_DIR 1 ~ T_SYMLINK 4）
+static const char types[] = "?d-cl";
+
+static void ls(const char *path) {
+    static struct dirent_info ents[BATCH];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("ls: 无法打开 %s\n", path);
+        return;
+    }
+    int n;
+    while ((n = getdents(fd, ents, BATCH, GETDENTS_STAT)) > 0) {
+        for (int i = 0; i < n; i++) {
+            struct dirent_info *d = &ents[i];
+            char t = d->type >= 1 && d->type <= 4 ? types[d->type] : types[0];
+            printf("%c\t%d\t%d\t%d\t%s\n", t, d->inum, d->nlink, d->size, d->name);
+        }
+    }
+    if (n < 0)
+        printf("ls: %s 不是目录\n", path);
+    close(fd);
+}
+
+// ls [dir...]: 列出目录（缺省为当前目录）中每一项的类型、inode 号、链接数、大小与名称
+int main(int argc, char *argv[]) {
+    if (argc < 2)
+        ls(".");
+    for (int i = 1; i < argc; i++)
+        ls(argv[i]);
+    exit(0);
+}
@@ -0,0 +1,37 @@
+#include "user.h"
+
+// memstat [pid]: 打印内核内存统计，RSS 对应指定进程（缺省为 memstat 自身）
+int main(int argc, char *argv[]) {
+    int pid = 0;
+    if (argc > 1) {
+        for (char *s = argv[1]; *s >= '0' && *s <= '9'; s++)
+            pid = pid * 10 + (*s - '0');
+    }
+
+    struct meminfo mi;
+    if (meminfo(pid, &mi) < 0) {
+        printf("memstat: 读取 pid=%d 的内存统计失败\n", pid);
+        exit(-1);
+    }
+
+    printf("total pages:      %lu\n", mi.total_pages);
+    printf("free pages:       %lu\n", mi.free_pages);
+    printf("shared pages:     %lu\n", mi.shared_pages);
+    printf("page-table pages: %lu\n", mi.pagetable_pages);
+    printf("largest free run: %lu\n", mi.largest_free_run);
+    printf("rss pages:        %lu\n", mi.rss_pages);
+    printf("cow faults:       %lu (reused %lu, copied %lu)\n",
+           mi.cow_faults, mi.cow_reused, mi.cow_copied);
+    printf("lazy faults:      %lu\n", mi.lazy_faults);
+    printf("zero-page faults: %lu\n", mi.zero_page_faults);
+    printf("alloc failures:   %lu\n", mi.alloc_failures);
+    printf("zero-fill time:   %lu\n", mi.zero_fill_time);
+    printf("idle-zeroed:      %lu\n", mi.idle_zeroed_pages);
+    printf("compaction:       %lu runs (%lu ok), %lu pages moved, time %lu\n",
+           mi.compact_runs, mi.compact_success, mi.compact_moved, mi.compact_time);
+    printf("swap:             %lu/%lu slots used, %lu out, %lu in\n",
+           mi.swap_total - mi.swap_free, mi.swap_total, mi.swap_outs, mi.swap_ins);
+    printf("cma:              %lu pages, %lu dma, %lu lent, %lu free, %lu migrated, %lu failures\n",
+           mi.cma_total, mi.cma_dma, mi.cma_lent, mi.cma_free, mi.cma_migrated, mi.cma_failures);
+    exit(0);
+}
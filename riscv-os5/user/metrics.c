@@ -0,0 +1,59 @@
+#include "user.h"
+
+#define MAXMETRICS 128
+
+static const char *const kind_names[] = { "?", "counter", "gauge", "hist" };
+
+// 名称以 prefix 开头
+static int has_prefix(const char *name, const char *prefix) {
+    while (*prefix) {
+        if (*name++ != *prefix++)
+            return 0;
+    }
+    return 1;
+}
+
+// 直方图的 pct 分位数的上界：累计样本数首次达到 pct% 的那个桶的右端点
+static unsigned long hist_percentile(const struct metric_stat *m, int pct) {
+    unsigned long want = (m->value * pct + 99) / 100, seen = 0;
+    for (int b = 0; b < METRIC_HIST_BUCKETS; b++) {
+        seen += m->buckets[b];
+        if (seen >= want)
+            return 1UL << (b + 1);
+    }
+    return 1UL << METRIC_HIST_BUCKETS;
+}
+
+// metrics [prefix]: 打印内核指标快照（时间为 time CSR 计数），prefix 只列出名称以其开头的指标，
+// 如 "bio." 或 "syscall."；直方图另列出 p50/p90/p99 的上界与非空的 log2 桶
+int main(int argc, char *argv[]) {
+    const char *prefix = argc > 1 ? argv[1] : "";
+
+    static struct metric_stat st[MAXMETRICS];
+    int n = metrics_read(st, MAXMETRICS);
+    if (n < 0) {
+        printf("metrics: 读取指标失败\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct metric_stat *m = &st[i];
+        if (!has_prefix(m->name, prefix))
+            continue;
+        printf("%s %s %lu", m->name, kind_names[m->kind <= METRIC_HIST ? m->kind : 0], m->value);
+        if (m->kind == METRIC_HIST) {
+            printf(" sum %lu avg %lu", m->sum, m->value ? m->sum / m->value : 0UL);
+            if (m->value)
+                printf(" p50 <%lu p90 <%lu p99 <%lu", hist_percentile(m, 50), hist_percentile(m, 90),
+                       hist_percentile(m, 99));
+            printf("\n");
+            for (int b = 0; b < METRIC_HIST_BUCKETS; b++) {
+                if (m->buckets[b])
+                    printf("  [%lu, %lu): %lu\n", b == 0 ? 0UL : 1UL << b, 1UL << (b + 1), m->buckets[b]);
+            }
+        } else {
+            printf("\n");
+        }
+    }
+    exit(0);
+}
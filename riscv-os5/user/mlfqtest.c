@@ -3,6 +3,7 @@
 // 本测试程序通过同时启动多类典型进程，观察多级反馈队列（MLFQ）的调度行为。
 // 每类进程会打印自身的阶段完成时刻（以 ticks 为单位），便于对比谁获得了优先的 CPU 时间。
 // 由于用户态暂未提供真正的 sleep/IO 系统调用，这里通过忙等待模拟计算与思考间歇。
+// mlfqtest -g 改为测量对抗性睡眠模式下 CPU 密集任务的吞吐（见 game_test）。
 
 typedef void (*task_entry_t)(void);
 
@@ -123,8 +124,77 @@ static struct scenario scenarios[] = {
   {"老化观察",      aging_probe_worker,   "经历降级后等待老化提升"},
 };
 
-int main(void)
+// ---- mlfqtest -g：对抗性 I/O 模式下 CPU 密集任务的吞吐
+// 若干“投机”进程每次运行不到一个 tick（时间片用完前）就 sleep(1)，按旧策略每次唤醒都
+// 回到最高优先级，能一直压住同一 hart 上的 CPU 密集进程；配额跨睡眠累计后它们会逐级下沉。
+// 全部进程限定在 hart 0 上，比较两种内核配置（MLFQ_WAKE_BOOST=0/1）下 CPU 密集进程的 CPU 占比
+
+#define GAME_TICKS 200            // 测量窗口（ticks）
+#define GAME_NGAMERS 3
+#define TIME_PER_TICK 1000000     // get_time 单位，见 trap.h 的 TICK_INTERVAL
+
+static void gamer_worker(void)
 {
+  uint64_t end = get_ticks() + GAME_TICKS;
+  while(get_ticks() < end) {
+    uint64_t t0 = get_time();
+    while(get_time() - t0 < TIME_PER_TICK * 9 / 10)
+      compute_burn(1000);
+    sleep(1);
+  }
+  printf("[投机] PID=%d 结束时优先级=%d\n", getpid(), get_priority_level());
+  exit(0);
+}
+
+static void batch_game_worker(void)
+{
+  uint64_t end = get_ticks() + GAME_TICKS;
+  unsigned long rounds = 0;
+  while(get_ticks() < end) {
+    compute_burn(100000);
+    rounds++;
+  }
+  printf("[CPU密集] 窗口内完成 %lu 轮计算，结束时优先级=%d\n", rounds, get_priority_level());
+  exit(0);
+}
+
+static int game_test(void)
+{
+  if(sched_setaffinity(0, 1) < 0) {
+    printf("[MLFQ测试] sched_setaffinity 失败\n");
+    return -1;
+  }
+  int batch = fork();
+  if(batch == 0)
+    batch_game_worker();
+  for(int i = 0; i < GAME_NGAMERS; i++) {
+    if(fork() == 0)
+      gamer_worker();
+  }
+
+  unsigned long gamer_time = 0, batch_time = 0;
+  for(int i = 0; i < GAME_NGAMERS + 1; i++) {
+    struct rusage ru;
+    int pid = wait4(-1, 0, 0, &ru);
+    if(pid < 0)
+      break;
+    unsigned long t = ru.utime + ru.stime;
+    if(pid == batch)
+      batch_time = t;
+    else
+      gamer_time += t;
+  }
+  unsigned long total = batch_time + gamer_time;
+  printf("[MLFQ测试] CPU密集 %lu ms，投机进程合计 %lu ms，CPU密集占比 %lu%%\n",
+         batch_time / 10000, gamer_time / 10000, total ? batch_time * 100 / total : 0UL);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc > 1 && argv[1][0] == '-' && argv[1][1] == 'g')
+    exit(game_test() < 0 ? 1 : 0);
+
   int total = sizeof(scenarios) / sizeof(scenarios[0]);
   printf("[MLFQ测试] 启动 %d 个子进程，观察多级反馈队列行为\n", total);
   printf("[MLFQ测试] 全局时间起点 ticks=%lu (父进程初始优先级=%d)\n", (unsigned long)get_ticks(), get_priority_level());
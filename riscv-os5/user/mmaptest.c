@@ -0,0 +1,160 @@
+#include "user.h"
+#include "ulibrt.h"
+
+#define PAGE_SIZE 4096
+#define TEST_PAGES 4
+#define TEST_FILE "mmapfile"
+
+// 共享匿名映射：子进程写入的数据父进程可直接看到
+static int test_shared_anon(void) {
+    char *buf = (char *)mmap(0, TEST_PAGES * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        printf("mmaptest: 共享匿名映射失败\n");
+        return -1;
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("mmaptest: fork 失败\n");
+        return -1;
+    }
+    if (pid == 0) {
+        for (int i = 0; i < TEST_PAGES; i++)
+            buf[i * PAGE_SIZE] = 'a' + i;
+        exit(0);
+    }
+    wait(0);
+
+    for (int i = 0; i < TEST_PAGES; i++) {
+        if (buf[i * PAGE_SIZE] != 'a' + i) {
+            printf("mmaptest: 共享页 %d 未看到子进程写入\n", i);
+            return -1;
+        }
+    }
+    return munmap(buf, TEST_PAGES * PAGE_SIZE);
+}
+
+// 私有匿名映射：按需填零，fork 后子进程的写入不影响父进程
+static int test_private_anon(void) {
+    char *buf = (char *)mmap(0, TEST_PAGES * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        printf("mmaptest: 私有匿名映射失败\n");
+        return -1;
+    }
+    for (int i = 0; i < TEST_PAGES; i++) {
+        if (buf[i * PAGE_SIZE] != 0) {
+            printf("mmaptest: 私有页 %d 未清零\n", i);
+            return -1;
+        }
+        buf[i * PAGE_SIZE] = 'P';
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("mmaptest: fork 失败\n");
+        return -1;
+    }
+    if (pid == 0) {
+        for (int i = 0; i < TEST_PAGES; i++)
+            buf[i * PAGE_SIZE] = 'c';
+        exit(0);
+    }
+    wait(0);
+
+    for (int i = 0; i < TEST_PAGES; i++) {
+        if (buf[i * PAGE_SIZE] != 'P') {
+            printf("mmaptest: 私有页 %d 被子进程修改\n", i);
+            return -1;
+        }
+    }
+    return munmap(buf, TEST_PAGES * PAGE_SIZE);
+}
+
+// 只读文件映射：映射内容与文件一致，不足一页的尾部为 0
+static int test_file_map(void) {
+    static char data[PAGE_SIZE + 100];
+    for (int i = 0; i < (int)sizeof(data); i++)
+        data[i] = 'A' + i % 26;
+
+    int fd = open(TEST_FILE, O_CREATE | O_RDWR);
+    if (fd < 0 || write(fd, data, sizeof(data)) != sizeof(data)) {
+        printf("mmaptest: 创建测试文件失败\n");
+        return -1;
+    }
+    close(fd);
+
+    fd = open(TEST_FILE, O_RDONLY);
+    if (fd < 0) {
+        printf("mmaptest: 打开测试文件失败\n");
+        return -1;
+    }
+    char *map = (char *)mmap(0, 2 * PAGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);   // 映射区自行持有文件引用
+    if (map == MAP_FAILED) {
+        printf("mmaptest: 文件映射失败\n");
+        return -1;
+    }
+
+    int ok = 1;
+    for (int i = 0; i < (int)sizeof(data); i++) {
+        if (map[i] != data[i]) {
+            printf("mmaptest: 文件映射偏移 %d 内容不符\n", i);
+            ok = 0;
+            break;
+        }
+    }
+    if (ok && map[sizeof(data)] != 0) {
+        printf("mmaptest: 文件末尾之后未填零\n");
+        ok = 0;
+    }
+    munmap(map, 2 * PAGE_SIZE);
+    unlink(TEST_FILE);
+    return ok ? 0 : -1;
+}
+
+// 共享运行库：库函数经固定地址的跳转表调用，errno 位于库数据段开头。
+// 之前的映射都已解除，新的映射区仍能放下，说明运行库没有占用 mmap 可用的槽位
+static int test_ulib(void) {
+    unsigned long fn = (unsigned long)printf;
+    if (fn < ULIB_TEXT_VA) {
+        printf("mmaptest: 运行库为静态链接，跳过共享运行库检查\n");
+        return 0;
+    }
+    if (fn >= ULIB_DATA_VA || (unsigned long)malloc >= ULIB_DATA_VA || (fn - ULIB_JUMP_VA) % ULIB_SLOT_SIZE) {
+        printf("mmaptest: 库函数不在跳转表中\n");
+        return -1;
+    }
+    if ((unsigned long)&errno != ULIB_ERRNO_VA) {
+        printf("mmaptest: errno 不在固定地址\n");
+        return -1;
+    }
+
+    char *maps[8];
+    int ok = 1;
+    for (int i = 0; i < 8; i++) {
+        maps[i] = (char *)mmap(0, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (maps[i] == MAP_FAILED) {
+            printf("mmaptest: 第 %d 个映射区失败\n", i + 1);
+            ok = 0;
+            break;
+        }
+        maps[i][0] = 1;
+    }
+    for (int i = 0; i < 8 && maps[i] != MAP_FAILED; i++)
+        munmap(maps[i], PAGE_SIZE);
+    return ok ? 0 : -1;
+}
+
+int main(void) {
+    printf("mmaptest: mmap 功能验证开始\n");
+
+    if (test_shared_anon() < 0 || test_private_anon() < 0 || test_file_map() < 0 || test_ulib() < 0) {
+        printf("mmaptest: 失败\n");
+        exit(-1);
+    }
+
+    printf("mmaptest: 测试通过\n");
+    exit(0);
+}
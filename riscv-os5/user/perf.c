@@ -0,0 +1,43 @@
+#include "user.h"
+
+static const char *const event_names[PERF_NHPM] = PERF_EVENT_NAMES;
+
+// perf prog [args...]: 运行 prog，结束后打印它（含其子进程）的周期数、指令数与各硬件事件计数
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("用法: perf prog [args...]\n");
+        exit(-1);
+    }
+
+    struct perfcount before, after;
+    if (perf_read(PERF_CHILDREN, &before) < 0) {
+        printf("perf: 读取计数失败\n");
+        exit(-1);
+    }
+    unsigned long start = get_time();
+    int pid = fork();
+    if (pid < 0) {
+        printf("perf: fork 失败\n");
+        exit(-1);
+    }
+    if (pid == 0) {
+        exec(argv[1], argv + 1);
+        printf("perf: 无法执行 %s\n", argv[1]);
+        exit(-1);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    unsigned long elapsed = get_time() - start;
+    perf_read(PERF_CHILDREN, &after);
+
+    unsigned long cycles = after.cycles - before.cycles;
+    unsigned long instret = after.instret - before.instret;
+    unsigned long ipc = cycles ? instret * 100 / cycles : 0;
+    printf("perf: %s 退出，状态 %d，耗时 %lu\n", argv[1], status, elapsed);
+    printf("  %lu cycles\n", cycles);
+    printf("  %lu instructions  (IPC %lu.%lu%lu)\n", instret, ipc / 100, ipc / 10 % 10, ipc % 10);
+    for (int i = 0; i < PERF_NHPM; i++)
+        printf("  %lu %s\n", after.hpm[i] - before.hpm[i], event_names[i]);
+    exit(0);
+}
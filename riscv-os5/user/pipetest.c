@@ -0,0 +1,188 @@
+#include "user.h"
+
+#define PIPE_BUF_SIZE 4096
+#define TOTAL (3 * PIPE_BUF_SIZE + 123)   // 超过管道缓冲区，写者必然等待读者
+#define TEST_FILE "pipefile"
+
+static char buf[TOTAL];
+
+static char pattern(int i) {
+    return (char)(i * 7 + 3);
+}
+
+// 子进程写入超过缓冲区容量的数据，父进程分次读出并校验；写端关闭后读到文件结束
+static int test_stream(void) {
+    int p[2];
+    if (pipe(p) < 0) {
+        printf("pipetest: pipe 失败\n");
+        return -1;
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("pipetest: fork 失败\n");
+        return -1;
+    }
+    if (pid == 0) {
+        close(p[0]);
+        for (int i = 0; i < TOTAL; i++)
+            buf[i] = pattern(i);
+        // 分两次写入，第二次跨越环尾
+        int first = PIPE_BUF_SIZE - 100;
+        if (write(p[1], buf, first) != first ||
+            write(p[1], buf + first, TOTAL - first) != TOTAL - first)
+            exit(-1);
+        exit(0);
+    }
+
+    close(p[1]);
+    int got = 0, n;
+    while ((n = read(p[0], buf + got, 1000)) > 0)
+        got += n;
+    close(p[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (status != 0 || got != TOTAL) {
+        printf("pipetest: 读到 %d 字节，期望 %d（写者状态 %d）\n", got, TOTAL, status);
+        return -1;
+    }
+    for (int i = 0; i < TOTAL; i++) {
+        if (buf[i] != pattern(i)) {
+            printf("pipetest: 第 %d 字节内容错误\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 读端全部关闭后写入失败
+static int test_closed_reader(void) {
+    int p[2];
+    if (pipe(p) < 0)
+        return -1;
+    close(p[0]);
+    int r = write(p[1], "x", 1);
+    close(p[1]);
+    if (r != -1) {
+        printf("pipetest: 读端关闭后写入返回 %d\n", r);
+        return -1;
+    }
+    return 0;
+}
+
+// splice 把文件内容直接搬进管道
+static int test_splice(void) {
+    int fd = open(TEST_FILE, O_CREATE | O_RDWR);
+    if (fd < 0)
+        return -1;
+    for (int i = 0; i < 2000; i++)
+        buf[i] = pattern(i);
+    if (write(fd, buf, 2000) != 2000) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    int p[2];
+    if ((fd = open(TEST_FILE, O_RDONLY)) < 0 || pipe(p) < 0)
+        return -1;
+    int n1 = splice(fd, p[1], 1500);
+    int n2 = splice(fd, p[1], 1500);
+    int n3 = splice(fd, p[1], 1500);
+    close(fd);
+    close(p[1]);
+    unlink(TEST_FILE);
+    if (n1 != 1500 || n2 != 500 || n3 != 0) {
+        printf("pipetest: splice 返回 %d/%d/%d\n", n1, n2, n3);
+        return -1;
+    }
+
+    memset(buf, 0, 2000);
+    int got = 0, n;
+    while ((n = read(p[0], buf + got, 2000 - got)) > 0)
+        got += n;
+    close(p[0]);
+    for (int i = 0; i < 2000; i++) {
+        if (got != 2000 || buf[i] != pattern(i)) {
+            printf("pipetest: splice 后读出的数据错误\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// poll 同时等待两个管道：空管道超时返回 0，子进程稍后写入其中一个时被唤醒，
+// 关闭写端后报告 POLLHUP，无效描述符报告 POLLNVAL
+static int test_poll(void) {
+    int a[2], b[2];
+    if (pipe(a) < 0 || pipe(b) < 0)
+        return -1;
+
+    struct pollfd fds[3] = { { a[0], POLLIN, 0 }, { b[0], POLLIN, 0 }, { 1000, POLLIN, 0 } };
+    int n = poll(fds, 2, 2);
+    if (n != 0) {
+        printf("pipetest: 空管道 poll 返回 %d\n", n);
+        return -1;
+    }
+
+    int pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        sleep(5);
+        write(b[1], "p", 1);
+        exit(0);
+    }
+    n = poll(fds, 2, -1);
+    wait(0);
+    if (n != 1 || fds[0].revents != 0 || fds[1].revents != POLLIN) {
+        printf("pipetest: poll 返回 %d，revents %d/%d\n", n, fds[0].revents, fds[1].revents);
+        return -1;
+    }
+
+    close(a[1]);
+    close(b[1]);
+    n = poll(fds, 3, 0);
+    close(a[0]);
+    close(b[0]);
+    if (n != 3 || fds[0].revents != POLLHUP || fds[1].revents != (POLLIN | POLLHUP) ||
+        fds[2].revents != POLLNVAL) {
+        printf("pipetest: 写端关闭后 revents %d/%d/%d\n", fds[0].revents, fds[1].revents,
+               fds[2].revents);
+        return -1;
+    }
+    return 0;
+}
+
+// poll_us 的超时按微秒计：空管道等待 20ms 后返回 0，耗时不到一个 tick（100ms）
+static int test_poll_us(void) {
+    int a[2];
+    if (pipe(a) < 0)
+        return -1;
+
+    struct pollfd fds[1] = { { a[0], POLLIN, 0 } };
+    uint64_t start = get_time();
+    int n = poll_us(fds, 1, 20000);
+    uint64_t elapsed = get_time() - start;
+    close(a[0]);
+    close(a[1]);
+    if (n != 0 || elapsed < 200000 || elapsed >= 1000000) {
+        printf("pipetest: poll_us(20ms) 返回 %d，耗时 %lu\n", n, elapsed);
+        return -1;
+    }
+    return 0;
+}
+
+int main(void) {
+    printf("pipetest: 管道功能验证开始\n");
+
+    if (test_stream() < 0 || test_closed_reader() < 0 || test_splice() < 0 ||
+        test_poll() < 0 || test_poll_us() < 0) {
+        printf("pipetest: 失败\n");
+        exit(-1);
+    }
+
+    printf("pipetest: 测试通过\n");
+    exit(0);
+}
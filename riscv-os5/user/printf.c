@@ -5,49 +5,122 @@
 
 static const char digits[] = "0123456789abcdef";
 
-#define PUTC_BUFFER_SIZE 128
-static char putc_buffer[PUTC_BUFFER_SIZE];
-static int putc_buffer_len = 0;
-static int putc_buffer_fd = -1;
+// 带缓冲的输出流。写过的描述符各自对应一个流缓冲：描述符 0~2 通常是控制台，按行缓冲，
+// 遇到换行或缓冲写满时写出；其余描述符全缓冲，只在缓冲满、fflush、close、fork、exec
+// 与 exit 时写出。从标准输入读取前会先刷新标准输出与标准错误，提示符因此能及时出现。
+// snprintf 直接格式化到调用者的缓冲区。流表不加锁，多线程同时输出时需由调用者串行化
 
-static int putc_flush(void)
+#define STREAM_BUF 512
+#define NSTREAM 8
+
+struct stream {
+    int used;
+    int fd;
+    int line;                 // 1 为行缓冲，0 为全缓冲
+    int len;                  // buf 中尚未写出的字节数
+    char buf[STREAM_BUF];
+};
+
+static struct stream streams[NSTREAM];
+static int stream_victim;     // 流表满时轮流换出
+
+static int stream_flush(struct stream *s)
 {
-    if(putc_buffer_len == 0)
+    int len = s->len;
+    s->len = 0;
+    if(len == 0)
         return 0;
-    int fd = putc_buffer_fd;
-    int len = putc_buffer_len;
-    putc_buffer_len = 0;
-    putc_buffer_fd = -1;
-    int r = write(fd, putc_buffer, len);
-    if(r != len)
-        return -1;
+    return write(s->fd, s->buf, len) == len ? 0 : -1;
+}
+
+static struct stream *stream_get(int fd)
+{
+    struct stream *s, *free_slot = 0;
+
+    for(s = streams; s < streams + NSTREAM; s++) {
+        if(s->used && s->fd == fd)
+            return s;
+        if(!s->used && free_slot == 0)
+            free_slot = s;
+    }
+    if((s = free_slot) == 0) {
+        s = &streams[stream_victim];
+        stream_victim = (stream_victim + 1) % NSTREAM;
+        stream_flush(s);
+    }
+    s->used = 1;
+    s->fd = fd;
+    s->line = fd <= 2;
+    s->len = 0;
+    return s;
+}
+
+static int stream_putc(struct stream *s, char c)
+{
+    s->buf[s->len++] = c;
+    if(s->len == STREAM_BUF || (s->line && c == '\n'))
+        return stream_flush(s);
     return 0;
 }
 
-// 基础输出：写入单个字符
-static int putc(int fd, char c)
+// 刷新 fd 对应的流，fd 为负数时刷新全部流
+int fflush(int fd)
 {
-    if(fd < 0)
-        return -1;
+    int r = 0;
+    for(struct stream *s = streams; s < streams + NSTREAM; s++)
+        if(s->used && (fd < 0 || s->fd == fd) && stream_flush(s) < 0)
+            r = -1;
+    return r;
+}
 
-    if(putc_buffer_fd != -1 && putc_buffer_fd != fd) {
-        if(putc_flush() < 0)
+// 经流缓冲写入 n 个字节，不小于缓冲区的写入在刷新已有数据后直接写出
+int fwrite(int fd, const void *buf, int n)
+{
+    const char *p = buf;
+
+    if(fd < 0 || n < 0)
+        return -1;
+    struct stream *s = stream_get(fd);
+    if(n >= STREAM_BUF) {
+        if(stream_flush(s) < 0)
             return -1;
+        return write(fd, buf, n);
     }
+    int nl = 0;
+    for(int i = 0; i < n; i++) {
+        if(s->len == STREAM_BUF && stream_flush(s) < 0)
+            return -1;
+        s->buf[s->len++] = p[i];
+        nl |= p[i] == '\n';
+    }
+    if((s->line && nl) || s->len == STREAM_BUF)
+        if(stream_flush(s) < 0)
+            return -1;
+    return n;
+}
 
-    if(putc_buffer_fd == -1)
-        putc_buffer_fd = fd;
+// 格式化的输出目标：流，或 snprintf 的字符串
+struct out {
+    struct stream *s;   // 为 0 时写入 str
+    char *str;
+    int size;           // str 的容量（含结尾的 '\0'）
+    int n;              // 已输出的字符数，snprintf 截断时可能超过 size
+    int err;
+};
 
-    putc_buffer[putc_buffer_len++] = c;
-    if(putc_buffer_len == PUTC_BUFFER_SIZE || c == '\n') {
-        if(putc_flush() < 0)
-            return -1;
+static void out_putc(struct out *o, char c)
+{
+    if(o->s) {
+        if(stream_putc(o->s, c) < 0)
+            o->err = 1;
+    } else if(o->n < o->size - 1) {
+        o->str[o->n] = c;
     }
-    return 1;
+    o->n++;
 }
 
-// 输出有符号/无符号整数，返回写入的字节数
-static int printint(int fd, long long xx, int base, int sign)
+// 输出有符号/无符号整数
+static void printint(struct out *o, long long xx, int base, int sign)
 {
     char buf[32];
     int i = 0;
@@ -56,7 +129,7 @@ static int printint(int fd, long long xx, int base, int sign)
 
     if(sign && xx < 0) {
         neg = 1;
-        x = (unsigned long long)(-xx);
+        x = -(unsigned long long)xx;
     } else {
         x = (unsigned long long)xx;
     }
@@ -70,121 +143,109 @@ static int printint(int fd, long long xx, int base, int sign)
         buf[i++] = '-';
     }
 
-    int written = 0;
-    while(i > 0) {
-        if(putc(fd, buf[--i]) < 0)
-            return -1;
-        written++;
-    }
-    return written;
+    while(i > 0)
+        out_putc(o, buf[--i]);
 }
 
 // 输出指针（0x 前缀 + 固定宽度十六进制）
-static int printptr(int fd, uint64_t x)
+static void printptr(struct out *o, uint64_t x)
 {
-    int written = 0;
-    if(putc(fd, '0') < 0 || putc(fd, 'x') < 0)
-        return -1;
-    written += 2;
-
-    for(int i = 0; i < (int)(sizeof(uint64_t) * 2); i++, x <<= 4) {
-        char c = digits[x >> (sizeof(uint64_t) * 8 - 4)];
-        if(putc(fd, c) < 0)
-            return -1;
-        written++;
-    }
-    return written;
+    out_putc(o, '0');
+    out_putc(o, 'x');
+    for(int i = 0; i < (int)(sizeof(uint64_t) * 2); i++, x <<= 4)
+        out_putc(o, digits[x >> (sizeof(uint64_t) * 8 - 4)]);
 }
 
 // 输出字符串，忽略 NULL 指针（替换为 "(null)"）
-static int prints(int fd, const char *s)
+static void prints(struct out *o, const char *s)
 {
     const char *str = s ? s : "(null)";
-    int written = 0;
-    while(*str) {
-        if(putc(fd, *str++) < 0)
-            return -1;
-        written++;
-    }
-    return written;
+    while(*str)
+        out_putc(o, *str++);
 }
 
-// 迷你版 vprintf：支持 %d/%u/%x/%p/%c/%s/%%
-int vprintf(int fd, const char *fmt, va_list ap)
+// 迷你版格式化：支持 %d/%u/%x/%p/%c/%s/%% 以及 l、ll 修饰的 d/u/x
+static void format(struct out *o, const char *fmt, va_list ap)
 {
-    int written = 0;
-
     for(size_t i = 0; fmt[i]; i++) {
         if(fmt[i] != '%') {
-            if(putc(fd, fmt[i]) < 0)
-                return -1;
-            written++;
+            out_putc(o, fmt[i]);
             continue;
         }
 
         char c0 = fmt[++i] & 0xff;
         if(c0 == 0) break;
-        
+
         char c1 = 0, c2 = 0;
         if(fmt[i+1]) c1 = fmt[i+1] & 0xff;
-        if(fmt[i+2]) c2 = fmt[i+2] & 0xff;
+        if(c1 && fmt[i+2]) c2 = fmt[i+2] & 0xff;
 
-        int w = 0;
-        
         if(c0 == 'd'){
-            w = printint(fd, va_arg(ap, int), 10, 1);
+            printint(o, va_arg(ap, int), 10, 1);
         } else if(c0 == 'u'){
-            w = printint(fd, va_arg(ap, unsigned int), 10, 0);
+            printint(o, va_arg(ap, unsigned int), 10, 0);
         } else if(c0 == 'x'){
-            w = printint(fd, va_arg(ap, unsigned int), 16, 0);
+            printint(o, va_arg(ap, unsigned int), 16, 0);
         } else if(c0 == 'p'){
-            w = printptr(fd, va_arg(ap, uint64_t));
+            printptr(o, va_arg(ap, uint64_t));
         } else if(c0 == 'c'){
-            if(putc(fd, (char)va_arg(ap, int)) < 0)
-                return -1;
-            w = 1;
+            out_putc(o, (char)va_arg(ap, int));
         } else if(c0 == 's'){
-            w = prints(fd, va_arg(ap, const char *));
+            prints(o, va_arg(ap, const char *));
         } else if(c0 == '%'){
-            if(putc(fd, '%') < 0)
-                return -1;
-            w = 1;
-        } 
-        // 参考内核版本的 %lu 处理
-        else if(c0 == 'l' && c1 == 'u'){
-            // 关键修改：使用 uint64 而不是 unsigned long
-            w = printint(fd, va_arg(ap, uint64_t), 10, 0);
+            out_putc(o, '%');
+        } else if(c0 == 'l' && c1 == 'u'){
+            printint(o, va_arg(ap, uint64_t), 10, 0);
             i += 1;
         } else if(c0 == 'l' && c1 == 'd'){
-            w = printint(fd, va_arg(ap, uint64_t), 10, 1);
+            printint(o, va_arg(ap, uint64_t), 10, 1);
             i += 1;
         } else if(c0 == 'l' && c1 == 'x'){
-            w = printint(fd, va_arg(ap, uint64_t), 16, 0);
+            printint(o, va_arg(ap, uint64_t), 16, 0);
             i += 1;
         } else if(c0 == 'l' && c1 == 'l' && c2 == 'u'){
-            w = printint(fd, va_arg(ap, uint64_t), 10, 0);
+            printint(o, va_arg(ap, uint64_t), 10, 0);
             i += 2;
         } else if(c0 == 'l' && c1 == 'l' && c2 == 'd'){
-            w = printint(fd, va_arg(ap, uint64_t), 10, 1);
+            printint(o, va_arg(ap, uint64_t), 10, 1);
             i += 2;
         } else if(c0 == 'l' && c1 == 'l' && c2 == 'x'){
-            w = printint(fd, va_arg(ap, uint64_t), 16, 0);
+            printint(o, va_arg(ap, uint64_t), 16, 0);
             i += 2;
         } else {
-            if(putc(fd, '%') < 0 || putc(fd, c0) < 0)
-                return -1;
-            w = 2;
+            out_putc(o, '%');
+            out_putc(o, c0);
         }
-
-        if(w < 0)
-            return -1;
-        written += w;
     }
+}
 
-    if(putc_flush() < 0)
+// 格式化到 fd 的流缓冲，返回输出的字符数，写出失败时返回 -1
+int vprintf(int fd, const char *fmt, va_list ap)
+{
+    if(fd < 0)
         return -1;
+    struct out o = { .s = stream_get(fd) };
+    format(&o, fmt, ap);
+    return o.err ? -1 : o.n;
+}
+
+// 格式化到 buf，至多写入 size - 1 个字符并以 '\0' 结尾；返回完整输出所需的字符数
+int vsnprintf(char *buf, int size, const char *fmt, va_list ap)
+{
+    struct out o = { .str = buf, .size = size };
+    format(&o, fmt, ap);
+    if(size > 0)
+        buf[o.n < size ? o.n : size - 1] = 0;
+    return o.n;
+}
 
-    return written;
+int snprintf(char *buf, int size, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return ret;
 }
 
 int fprintf(int fd, const char *fmt, ...)
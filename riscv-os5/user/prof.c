@@ -0,0 +1,67 @@
+#include "user.h"
+
+#define BATCH 32
+#define DEFAULT_HZ 1000
+
+// 输出的每个样本一行，由主机端 scripts/profsym.py 解析并对照 kernel.elf 与用户程序符号化：
+//   [prof] <pid> <进程名> <u|k> <pc> <ra>
+static unsigned long total;
+static struct prof_sample s[BATCH];
+
+static int drain(void) {
+    int got = 0, n;
+    while ((n = profread(s, BATCH)) > 0) {
+        for (int i = 0; i < n; i++)
+            printf("[prof] %d %s %c %lx %lx\n", s[i].pid, s[i].name,
+                   s[i].mode == PROF_MODE_USER ? 'u' : 'k', s[i].pc, s[i].ra);
+        got += n;
+    }
+    total += got;
+    return got;
+}
+
+// prof [-f hz] prog [args...]: 运行 prog 期间对全部 hart 采样（缺省每秒 1000 次），
+// 样本包括其他进程与空闲循环，按 pid 与进程名区分
+int main(int argc, char *argv[]) {
+    int hz = DEFAULT_HZ, first = 1;
+    if (argc > 2 && argv[1][0] == '-' && argv[1][1] == 'f') {
+        hz = 0;
+        for (char *s = argv[2]; *s >= '0' && *s <= '9'; s++)
+            hz = hz * 10 + (*s - '0');
+        first = 3;
+    }
+    if (first >= argc) {
+        printf("用法: prof [-f hz] prog [args...]\n");
+        exit(-1);
+    }
+
+    prof(0);
+    while (profread(s, BATCH) > 0)
+        ;   // 丢弃之前遗留的样本
+    if (hz <= 0 || prof(hz) < 0) {
+        printf("prof: 采样频率 %d 无效\n", hz);
+        exit(-1);
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("prof: fork 失败\n");
+        prof(0);
+        exit(-1);
+    }
+    if (pid == 0) {
+        exec(argv[first], argv + first);
+        printf("prof: 无法执行 %s\n", argv[first]);
+        exit(-1);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, WNOHANG) == 0) {
+        if (drain() == 0)
+            usleep(10000);   // 10ms 取一次，不必等满一个 tick
+    }
+    int dropped = prof(0);
+    drain();
+    printf("[prof] done samples=%lu dropped=%d hz=%d status=%d\n", total, dropped, hz, status);
+    exit(0);
+}
@@ -0,0 +1,38 @@
+#include "user.h"
+
+// ps: 列出全部进程及其 CPU 时间（毫秒），wait 为就绪等待时间，slp 为睡眠时间。
+// 最后一行是 ps 自身的用量（含本次陷入以来的内核态时间）
+
+#define TIME_PER_MS 10000   // time CSR 为 10MHz（见 trap.h）
+#define NPROCINFO 64
+
+static struct procinfo procs[NPROCINFO];
+
+static void print_ru(const struct rusage *ru) {
+    printf("%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+           ru->utime / TIME_PER_MS, ru->stime / TIME_PER_MS,
+           ru->wtime / TIME_PER_MS, ru->slptime / TIME_PER_MS,
+           ru->nvcsw, ru->nivcsw);
+}
+
+int main(void) {
+    int n = procinfo(procs, NPROCINFO);
+    if (n < 0) {
+        printf("ps: 读取进程信息失败\n");
+        exit(-1);
+    }
+
+    printf("PID\tPPID\tS\tNAME\tuser\tsys\twait\tslp\tvcsw\tivcsw\n");
+    for (int i = 0; i < n; i++) {
+        struct procinfo *pi = &procs[i];
+        printf("%d\t%d\t%c\t%s\t", pi->pid, pi->ppid, pi->state, pi->name);
+        print_ru(&pi->ru);
+    }
+
+    struct rusage self;
+    if (getrusage(RUSAGE_SELF, &self) == 0) {
+        printf("ps self:\t\t\t\t");
+        print_ru(&self);
+    }
+    exit(0);
+}
@@ -1,6 +1,33 @@
 #include "user.h"
 #include "fcntl.h"
 
+#define ROUNDTRIP_ITERS 10000
+
+static inline uint64_t rdcycle(void)
+{
+    uint64_t c;
+    asm volatile("rdcycle %0" : "=r"(c));
+    return c;
+}
+
+// 系统调用往返开销：分别测量 getpid 与 ticks 的平均周期数，
+// 用于对比陷入/返回路径优化前后的差异
+static void test_syscall_roundtrip(void)
+{
+    uint64_t start = rdcycle();
+    for(int i = 0; i < ROUNDTRIP_ITERS; i++)
+        getpid();
+    uint64_t pid_cycles = (rdcycle() - start) / ROUNDTRIP_ITERS;
+
+    start = rdcycle();
+    for(int i = 0; i < ROUNDTRIP_ITERS; i++)
+        get_ticks();
+    uint64_t ticks_cycles = (rdcycle() - start) / ROUNDTRIP_ITERS;
+
+    printf("syscall round-trip: getpid %lu cycles, ticks %lu cycles\n",
+           (unsigned long)pid_cycles, (unsigned long)ticks_cycles);
+}
+
 int main(void)
 {
     printf("==== syscall validation suite ====\n");
@@ -9,6 +36,7 @@ int main(void)
     test_parameter_passing();
     test_security();
     test_syscall_performance();
+    test_syscall_roundtrip();
 
     printf("==== syscall validation suite finished ====\n");
     return 0;
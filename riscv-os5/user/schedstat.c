@@ -0,0 +1,33 @@
+#include "user.h"
+
+// schedstat [pid]: 打印调度延迟直方图与指定进程（缺省为 schedstat 自身）的调度计数
+int main(int argc, char *argv[]) {
+    int pid = 0;
+    if (argc > 1) {
+        for (char *s = argv[1]; *s >= '0' && *s <= '9'; s++)
+            pid = pid * 10 + (*s - '0');
+    }
+
+    struct schedstat st;
+    if (schedstat(pid, &st) < 0) {
+        printf("schedstat: 读取 pid=%d 的调度统计失败\n", pid);
+        exit(-1);
+    }
+
+    printf("switches:         %lu\n", st.nr_switches);
+    printf("latency histogram (time units):\n");
+    for (int i = 0; i < SCHED_LAT_BUCKETS; i++) {
+        if (st.lat_hist[i] == 0)
+            continue;
+        printf("  [%lu, %lu): %lu\n", i == 0 ? 0UL : 1UL << i, 1UL << (i + 1), st.lat_hist[i]);
+    }
+
+    printf("runs:             %lu\n", st.nr_runs);
+    printf("run delay:        %lu (avg %lu)\n", st.run_delay,
+           st.nr_runs ? st.run_delay / st.nr_runs : 0UL);
+    printf("voluntary sw:     %lu\n", st.nvcsw);
+    printf("involuntary sw:   %lu\n", st.nivcsw);
+    for (int level = 0; level < SCHED_MLFQ_LEVELS; level++)
+        printf("level %d ticks:    %lu\n", level, st.level_ticks[level]);
+    exit(0);
+}
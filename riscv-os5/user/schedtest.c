@@ -0,0 +1,114 @@
+#include "user.h"
+
+#define PAGE_SIZE 4096
+#define FAIR_WINDOW 30   // 两个公平类子进程并行运行的 tick 数
+
+// 非法参数应被拒绝
+static int test_invalid(void) {
+    struct sched_attr bad_policy = { 7, 0 };
+    struct sched_attr bad_fifo = { SCHED_FIFO, 0 };
+    struct sched_attr bad_nice = { SCHED_FAIR, 30 };
+    if (sched_setattr(0, &bad_policy) == 0 || sched_setattr(0, &bad_fifo) == 0 ||
+        sched_setattr(0, &bad_nice) == 0) {
+        printf("schedtest: 非法参数未被拒绝\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 公平类子进程：按指定 nice 值持续计数，直到父进程设置 stop
+static void fair_worker(volatile unsigned long *counter, volatile int *stop, int nice) {
+    struct sched_attr attr = { SCHED_FAIR, nice };
+    if (sched_setattr(0, &attr) < 0) {
+        printf("schedtest: 设置公平类失败\n");
+        exit(-1);
+    }
+    while (!*stop)
+        (*counter)++;
+    exit(0);
+}
+
+// nice 0 与 nice 10 的公平类进程竞争 CPU，前者应得到明显更多的运行时间
+static int test_fair_weight(void) {
+    char *shared = (char *)mmap(0, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        printf("schedtest: 共享映射失败\n");
+        return -1;
+    }
+    volatile unsigned long *counts = (volatile unsigned long *)shared;
+    volatile int *stop = (volatile int *)(shared + 64);
+
+    int nices[2] = { 0, 10 };
+    for (int i = 0; i < 2; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("schedtest: fork 失败\n");
+            return -1;
+        }
+        if (pid == 0)
+            fair_worker(&counts[i], stop, nices[i]);
+    }
+
+    // 父进程仍属于 MLFQ，醒来后优先于公平类进程运行，可以及时通知子进程结束
+    sleep(FAIR_WINDOW);
+    *stop = 1;
+    wait(0);
+    wait(0);
+
+    printf("schedtest: nice 0 计数 %lu，nice 10 计数 %lu\n", counts[0], counts[1]);
+    int ok = counts[0] > counts[1];
+    munmap(shared, PAGE_SIZE);
+    if (!ok) {
+        printf("schedtest: 公平类未按权重分配 CPU\n");
+        return -1;
+    }
+    return 0;
+}
+
+// CPU 亲和性：空位图被拒绝，不存在的 hart 被忽略，子进程继承父进程的位图
+static int test_affinity(void) {
+    unsigned long mask = 0;
+    if (sched_setaffinity(0, 0) == 0) {
+        printf("schedtest: 空亲和性位图未被拒绝\n");
+        return -1;
+    }
+    if (sched_setaffinity(0, ~0UL) < 0 || sched_getaffinity(0, &mask) < 0 || (mask & 1) == 0) {
+        printf("schedtest: 读取全部 hart 的亲和性失败\n");
+        return -1;
+    }
+    if (sched_setaffinity(0, 1) < 0 || sched_getaffinity(0, &mask) < 0 || mask != 1) {
+        printf("schedtest: 绑定到 hart 0 失败\n");
+        return -1;
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("schedtest: fork 失败\n");
+        return -1;
+    }
+    if (pid == 0) {
+        unsigned long child_mask = 0;
+        exit(sched_getaffinity(0, &child_mask) == 0 && child_mask == 1 ? 0 : 1);
+    }
+    int status = -1;
+    wait(&status);
+    sched_setaffinity(0, ~0UL);
+    if (status != 0) {
+        printf("schedtest: 子进程未继承亲和性\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(void) {
+    printf("schedtest: 调度类验证开始\n");
+
+    if (test_invalid() < 0 || test_fair_weight() < 0 || test_affinity() < 0) {
+        printf("schedtest: 失败\n");
+        exit(-1);
+    }
+
+    printf("schedtest: 测试通过\n");
+    exit(0);
+}
@@ -0,0 +1,44 @@
+#include "user.h"
+
+#define MAXSYS 128
+
+// sctop [-r] [n]: 按累计耗时列出最热的 n 个系统调用（缺省 10 个），-r 在打印后清零统计
+int main(int argc, char *argv[]) {
+    int reset = 0, top = 10;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'r') {
+            reset = 1;
+        } else {
+            top = 0;
+            for (char *s = argv[i]; *s >= '0' && *s <= '9'; s++)
+                top = top * 10 + (*s - '0');
+        }
+    }
+
+    static struct syscall_stat st[MAXSYS];
+    int n = scstat(st, MAXSYS, reset);
+    if (n < 0) {
+        printf("sctop: 读取系统调用统计失败\n");
+        exit(-1);
+    }
+
+    printf("num name calls errors total max avg\n");
+    // 每轮选出剩余项中累计耗时最大的一项，选中后标记为已输出
+    static char shown[MAXSYS];
+    for (int k = 0; k < top; k++) {
+        int best = -1;
+        for (int i = 0; i < n; i++) {
+            if (shown[i] || st[i].calls == 0)
+                continue;
+            if (best < 0 || st[i].time_total > st[best].time_total)
+                best = i;
+        }
+        if (best < 0)
+            break;
+        shown[best] = 1;
+        struct syscall_stat *s = &st[best];
+        printf("%d %s %lu %lu %lu %lu %lu\n", best, s->name, s->calls, s->errors,
+               s->time_total, s->time_max, s->time_total / s->calls);
+    }
+    exit(0);
+}
@@ -3,8 +3,11 @@
 
 // 命令类型定义
 #define EXEC  1  // 执行命令
+#define PIPE  2  // 管道：left 的标准输出接到 right 的标准输入
+#define BACK  3  // 后台运行：不等待 cmd 结束
 
 #define MAXARGS 10
+#define NJOBS 8
 
 // 基础命令结构体
 struct cmd {
@@ -18,37 +21,241 @@ struct execcmd {
   char *eargv[MAXARGS]; // 参数结束位置（用于字符串终止）
 };
 
+// 管道命令结构体
+struct pipecmd {
+  int type;           // 类型为PIPE
+  struct cmd *left;   // 管道左侧的简单命令
+  struct cmd *right;  // 管道右侧，可能仍是管道
+};
+
+// 后台命令结构体
+struct backcmd {
+  int type;           // 类型为BACK
+  struct cmd *cmd;    // 简单命令或管道
+};
+
+// 后台作业：一条命令启动的全部进程，都被回收后报告完成
+struct job {
+  int id;               // 作业号，0 表示空闲
+  int npids;            // 尚未回收的进程数
+  int pids[MAXARGS];    // 已回收的置 0
+};
+
+static struct job jobs[NJOBS];
+static int next_job_id = 1;
+
 struct cmd* parsecmd(char*);
-void runcmd(struct cmd*) __attribute__((noreturn));
+void runcmd(struct cmd*);
 void panic(char *s);
-int fork1(void);
 struct cmd* parseexec(char **ps, char *es);
+struct cmd* parsepipe(char **ps, char *es);
+struct cmd* parseline(char **ps, char *es);
 struct cmd* nulterminate(struct cmd *cmd);
 
 
-// 简化版命令执行函数
+// 把 fd 临时放到描述符 target 上，返回保存的原描述符；fd 小于 0 时不做改动
+static int redirect(int target, int fd)
+{
+  if(fd < 0)
+    return -1;
+  int saved = dup(target);
+  close(target);
+  dup(fd);  // 取最小的空闲描述符，即 target
+  return saved;
+}
+
+// 恢复 redirect 保存的描述符
+static void restore(int target, int saved)
+{
+  if(saved < 0)
+    return;
+  close(target);
+  dup(saved);
+  close(saved);
+}
+
+static int streq(const char *a, const char *b)
+{
+  while(*a && *a == *b)
+    a++, b++;
+  return *a == *b;
+}
+
+static inline uint64_t rdcycle(void)
+{
+  uint64_t c;
+  asm volatile("rdcycle %0" : "=r"(c));
+  return c;
+}
+
+// echo：参数以空格连接后一次写到 out
+static void echo(struct execcmd *ecmd, int out)
+{
+  char line[128];
+  int n = 0;
+
+  for(int i = 1; ecmd->argv[i]; i++) {
+    for(char *s = ecmd->argv[i]; *s && n < (int)sizeof(line) - 1; s++)
+      line[n++] = *s;
+    if(ecmd->argv[i + 1] && n < (int)sizeof(line) - 1)
+      line[n++] = ' ';
+  }
+  line[n++] = '\n';
+  write(out, line, n);
+}
+
+// 在 shell 进程内执行内建命令，不创建子进程；不是内建命令时返回 0
+static int builtin(struct execcmd *ecmd, int out)
+{
+  char *name = ecmd->argv[0];
+
+  if(streq(name, "cd")) {
+    if(ecmd->argv[1] == 0 || chdir(ecmd->argv[1]) < 0)
+      fprintf(2, "cannot cd %s\n", ecmd->argv[1] ? ecmd->argv[1] : "");
+    return 1;
+  }
+  if(streq(name, "echo")) {
+    echo(ecmd, out < 0 ? 1 : out);
+    return 1;
+  }
+  return 0;
+}
+
+// 以 in/out（小于 0 表示沿用 shell 的）作为标准输入输出 spawn 一条简单命令，返回子进程 PID；
+// 内建命令直接在 shell 中执行并返回 0。
+// spawn 让子进程继承当前的描述符表，因此在 shell 中临时调整 0、1 号描述符后立即恢复
+static int spawnexec(struct execcmd *ecmd, int in, int out)
+{
+  if(ecmd->argv[0] == 0)
+    return -1;  // 无命令名
+  if(builtin(ecmd, out))
+    return 0;
+  int sin = redirect(0, in);
+  int sout = redirect(1, out);
+  int pid = spawn(ecmd->argv[0], ecmd->argv);
+  restore(1, sout);
+  restore(0, sin);
+  if(pid < 0)
+    fprintf(2, "exec %s failed\n", ecmd->argv[0]);  // 程序不存在或无法加载
+  return pid;
+}
+
+// 释放命令树
+static void freecmd(struct cmd *cmd)
+{
+  if(cmd && cmd->type == PIPE) {
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+  } else if(cmd && cmd->type == BACK) {
+    freecmd(((struct backcmd*)cmd)->cmd);
+  }
+  free(cmd);
+}
+
+// 命令以 time 开头时去掉这个前缀并返回 1
+static int striptime(struct cmd *cmd)
+{
+  while(cmd->type == PIPE)
+    cmd = ((struct pipecmd*)cmd)->left;
+  struct execcmd *ecmd = (struct execcmd*)cmd;
+  if(ecmd->argv[0] == 0 || !streq(ecmd->argv[0], "time"))
+    return 0;
+  for(int i = 0; ecmd->argv[i]; i++)
+    ecmd->argv[i] = ecmd->argv[i + 1];
+  return 1;
+}
+
+// 把后台命令的进程登记为作业，作业表已满时返回 -1
+static int addjob(int *pids, int npids)
+{
+  for(int i = 0; i < NJOBS; i++) {
+    if(jobs[i].id == 0) {
+      jobs[i].id = next_job_id++;
+      jobs[i].npids = npids;
+      for(int k = 0; k < npids; k++)
+        jobs[i].pids[k] = pids[k];
+      fprintf(2, "[%d] %d\n", jobs[i].id, pids[npids - 1]);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// 不阻塞地回收已结束的后台进程，整个作业结束时报告
+static void reapjobs(void)
+{
+  for(int i = 0; i < NJOBS; i++) {
+    if(jobs[i].id == 0)
+      continue;
+    for(int k = 0; k < MAXARGS; k++) {
+      if(jobs[i].pids[k] > 0 && waitpid(jobs[i].pids[k], 0, WNOHANG) != 0) {
+        jobs[i].pids[k] = 0;
+        jobs[i].npids--;
+      }
+    }
+    if(jobs[i].npids == 0) {
+      fprintf(2, "[%d] done\n", jobs[i].id);
+      jobs[i].id = 0;
+    }
+  }
+}
+
+// 简化版命令执行函数：在父进程中解析命令，通过 spawn 直接创建运行目标程序的子进程并等待其结束，
+// 省去 fork 复制 shell 地址空间的开销；内建命令不创建进程。后台命令登记为作业后立即返回，
+// 由 reapjobs 回收。以 time 开头的命令结束后报告耗时的滴答数与 cycle 数。
+// 管道从左到右逐级建立：每启动一级就关闭 shell 持有的写端，使最后一个写者退出后读者能读到文件结束
 void runcmd(struct cmd *cmd)
 {
-  struct execcmd *ecmd;
+  struct cmd *c = cmd;
+  int pids[MAXARGS];
+  int npids = 0;
+  int in = -1;
+  int p[2];
+  int back = 0;
 
   if(cmd == 0)
-    exit(1);
+    return;
+  if(c->type == BACK) {
+    back = 1;
+    c = ((struct backcmd*)c)->cmd;
+  }
+  int timed = striptime(c);
+  uint64_t ticks0 = get_ticks(), cycles0 = rdcycle();
 
-  switch(cmd->type){
-  default:
-    panic("runcmd");
+  while(c->type == PIPE) {
+    struct pipecmd *pcmd = (struct pipecmd*)c;
+    if(pipe(p) < 0) {
+      fprintf(2, "pipe failed\n");
+      break;
+    }
+    int pid = spawnexec((struct execcmd*)pcmd->left, in, p[1]);
+    if(pid > 0 && npids < MAXARGS)
+      pids[npids++] = pid;
+    close(p[1]);
+    if(in >= 0)
+      close(in);
+    in = p[0];
+    c = pcmd->right;
+  }
+  if(c->type == EXEC) {
+    int pid = spawnexec((struct execcmd*)c, in, -1);
+    if(pid > 0 && npids < MAXARGS)
+      pids[npids++] = pid;
+  }
+  if(in >= 0)
+    close(in);
 
-  case EXEC:
-    ecmd = (struct execcmd*)cmd;
-    // 检查命令是否有效
-    if(ecmd->argv[0] == 0)
-      exit(1);  // 无命令名
-    exec(ecmd->argv[0], ecmd->argv);
-    // 如果exec返回，说明执行失败
-    fprintf(2, "exec %s failed\n", ecmd->argv[0]);
-    break;
+  if(back && npids > 0 && addjob(pids, npids) < 0) {
+    fprintf(2, "too many jobs, waiting\n");
+    back = 0;
   }
-  exit(0);
+  if(!back) {
+    for(int i = 0; i < npids; i++)
+      waitpid(pids[i], 0, 0);  // 只等待本条命令启动的子进程结束
+  }
+  if(timed)
+    fprintf(2, "real %lu ticks, %lu cycles\n", get_ticks() - ticks0, rdcycle() - cycles0);
+  freecmd(cmd);
 }
 
 // 获取用户输入
@@ -76,8 +283,8 @@ int main(void)
     }
   }
 
-  // 主循环：读取并执行命令
-  while(getcmd(buf, sizeof(buf)) >= 0){
+  // 主循环：回收已结束的后台作业，读取并执行命令
+  while(reapjobs(), getcmd(buf, sizeof(buf)) >= 0){
     char *cmd = buf;
     
     // 跳过前导空白字符
@@ -88,19 +295,7 @@ int main(void)
     if (*cmd == '\n')
       continue;
       
-    // 处理cd命令（需要在父进程执行）
-    if(cmd[0] == 'c' && cmd[1] == 'd' && cmd[2] == ' ') {
-      // 移除换行符
-      cmd[strlen(cmd)-1] = 0;
-      if(chdir(cmd+3) < 0) {
-        fprintf(2, "cannot cd %s\n", cmd+3);
-      }
-    } else {
-      // 其他命令：fork子进程执行
-      if(fork1() == 0)
-        runcmd(parsecmd(cmd));
-      wait(0);  // 等待子进程结束
-    }
+    runcmd(parsecmd(cmd));
   }
   exit(0);
 }
@@ -111,17 +306,6 @@ void panic(char *s)
   exit(1);
 }
 
-//安全fork函数
-int fork1(void)
-{
-  int pid;
-
-  pid = fork();
-  if(pid == -1)
-    panic("fork");
-  return pid;
-}
-
 // 构造函数 
 struct cmd* execcmd(void)
 {
@@ -133,10 +317,33 @@ struct cmd* execcmd(void)
   return (struct cmd*)cmd;
 }
 
+struct cmd* backcmd(struct cmd *subcmd)
+{
+  struct backcmd *cmd;
+
+  cmd = malloc(sizeof(*cmd));
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->type = BACK;
+  cmd->cmd = subcmd;
+  return (struct cmd*)cmd;
+}
+
+struct cmd* pipecmd(struct cmd *left, struct cmd *right)
+{
+  struct pipecmd *cmd;
+
+  cmd = malloc(sizeof(*cmd));
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->type = PIPE;
+  cmd->left = left;
+  cmd->right = right;
+  return (struct cmd*)cmd;
+}
+
 
 // 字符串分割符号和空白字符定义
 char whitespace[] = " \t\r\n\v";  // 空白字符
-char symbols[] = "<|>&;()";       // 特殊符号（保留用于后续扩展）
+char symbols[] = "<|>&;()";       // 特殊符号（目前只支持 | 与行尾的 &）
 
 // 获取token的函数
 int gettoken(char **ps, char *es, char **q, char **eq)
@@ -156,6 +363,10 @@ int gettoken(char **ps, char *es, char **q, char **eq)
   switch(*s){
   case 0:  // 字符串结束
     break;
+  case '|':  // 管道
+  case '&':  // 后台运行
+    s++;
+    break;
   default: // 普通字符（命令或参数）
     ret = 'a';
     while(s < es && !strchr(whitespace, *s) && !strchr(symbols, *s))
@@ -193,19 +404,54 @@ struct cmd* parsecmd(char *s)
   struct cmd *cmd;
 
   es = s + strlen(s);
-  cmd = parseexec(&s, es);
+  cmd = parseline(&s, es);
+  if(cmd == 0)
+    return 0;
   
-  // 检查是否解析完整个输入
+  // 检查是否解析完整个输入（解析在 shell 进程内进行，出错时只丢弃本条命令）
   peek(&s, es, "");
   if(s != es) {
     fprintf(2, "leftovers: %s\n", s);
     fprintf(2, "syntax error\n");
-    exit(1);
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
 }
 
+// 解析一行：管道之后可以跟一个 & 表示后台运行
+struct cmd* parseline(char **ps, char *es)
+{
+  struct cmd *cmd;
+
+  cmd = parsepipe(ps, es);
+  if(cmd && peek(ps, es, "&")) {
+    gettoken(ps, es, 0, 0);
+    cmd = backcmd(cmd);
+  }
+  return cmd;
+}
+
+// 解析管道：简单命令之间以 | 连接，右结合
+struct cmd* parsepipe(char **ps, char *es)
+{
+  struct cmd *cmd, *right;
+
+  cmd = parseexec(ps, es);
+  if(cmd == 0)
+    return 0;
+  if(peek(ps, es, "|")) {
+    gettoken(ps, es, 0, 0);
+    if((right = parsepipe(ps, es)) == 0) {
+      free(cmd);
+      return 0;
+    }
+    cmd = pipecmd(cmd, right);
+  }
+  return cmd;
+}
+
 // 解析执行命令
 struct cmd* parseexec(char **ps, char *es)
 {
@@ -227,7 +473,9 @@ struct cmd* parseexec(char **ps, char *es)
       
     if(tok != 'a') {
       // 简化版不支持特殊符号
-      panic("syntax");
+      fprintf(2, "syntax\n");
+      free(ret);
+      return 0;
     }
     
     // 保存参数
@@ -235,8 +483,11 @@ struct cmd* parseexec(char **ps, char *es)
     cmd->eargv[argc] = eq;
     argc++;
     
-    if(argc >= MAXARGS)
-      panic("too many args");
+    if(argc >= MAXARGS) {
+      fprintf(2, "too many args\n");
+      free(ret);
+      return 0;
+    }
 
   }
   
@@ -251,6 +502,7 @@ struct cmd* nulterminate(struct cmd *cmd)
 {
   int i;
   struct execcmd *ecmd;
+  struct pipecmd *pcmd;
 
   if(cmd == 0)
     return 0;
@@ -261,6 +513,14 @@ struct cmd* nulterminate(struct cmd *cmd)
     for(i=0; ecmd->argv[i]; i++)
       *ecmd->eargv[i] = 0; // 在每个参数结尾添加null终止
     break;
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    nulterminate(pcmd->left);
+    nulterminate(pcmd->right);
+    break;
+  case BACK:
+    nulterminate(((struct backcmd*)cmd)->cmd);
+    break;
   }
   return cmd;
 }
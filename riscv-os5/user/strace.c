@@ -0,0 +1,57 @@
+#include "user.h"
+
+#define MAXSYS 128
+#define BATCH  16
+
+static struct syscall_stat names[MAXSYS];
+static int nnames;
+
+// 打印取出的全部跟踪记录，返回条数
+static int drain(void) {
+    static struct strace_rec rec[BATCH];
+    int total = 0, n;
+    while ((n = straceread(rec, BATCH)) > 0) {
+        for (int i = 0; i < n; i++) {
+            struct strace_rec *r = &rec[i];
+            const char *name = r->num < nnames && names[r->num].name[0] ? names[r->num].name : "?";
+            printf("[%d] %s(%lx, %lx, %lx) = %ld  <%lu>\n", r->pid, name,
+                   r->args[0], r->args[1], r->args[2], r->ret, r->dur);
+        }
+        total += n;
+    }
+    return total;
+}
+
+// strace prog [args...]: 跟踪 prog 及其子进程的全部系统调用，打印参数、返回值与耗时
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("用法: strace prog [args...]\n");
+        exit(-1);
+    }
+    if ((nnames = scstat(names, MAXSYS, 0)) < 0) {
+        printf("strace: 读取系统调用表失败\n");
+        exit(-1);
+    }
+    drain();   // 丢弃之前遗留的记录
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("strace: fork 失败\n");
+        exit(-1);
+    }
+    if (pid == 0) {
+        strace(0, ~0UL);
+        exec(argv[1], argv + 1);
+        printf("strace: 无法执行 %s\n", argv[1]);
+        exit(-1);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, WNOHANG) == 0) {
+        if (drain() == 0)
+            usleep(10000);   // 10ms 取一次，不必等满一个 tick
+    }
+    drain();
+    printf("strace: %s 退出，状态 %d\n", argv[1], status);
+    exit(0);
+}
@@ -0,0 +1,135 @@
+#include "user.h"
+
+#define PAGE_SIZE 4096
+#define NTHREADS 4
+#define ITERS 1000
+#define TEST_FILE "threadfile"
+
+// 每个线程一个栈，不复用：线程计入 done 之后到 exit 之前仍在使用自己的栈
+static char stacks[NTHREADS + 1][PAGE_SIZE] __attribute__((aligned(16)));
+
+static volatile int mutex;      // 0 空闲，1 已加锁
+static volatile int counter;
+static volatile int done;       // 已结束的线程数，主线程在此 futex 上等待
+
+static void lock(volatile int *l) {
+    while (__sync_val_compare_and_swap(l, 0, 1) != 0)
+        futex_wait(l, 1);
+}
+
+static void unlock(volatile int *l) {
+    __sync_lock_release(l);
+    futex_wake(l, 1);
+}
+
+static void thread_done(void) {
+    __sync_fetch_and_add(&done, 1);
+    futex_wake(&done, 1);
+    exit(0);
+}
+
+// 等待 done 达到 n
+static void join(int n) {
+    int d;
+    while ((d = done) < n)
+        futex_wait(&done, d);
+}
+
+static void spawn_thread(int i, void (*fn)(void *), void *arg) {
+    if (clone(fn, stacks[i] + PAGE_SIZE, CLONE_THREAD_FLAGS, arg) < 0) {
+        printf("threadtest: clone 失败\n");
+        exit(-1);
+    }
+}
+
+// 多个线程在 futex 互斥锁保护下累加同一计数器
+static void add_worker(void *arg) {
+    (void)arg;
+    for (int i = 0; i < ITERS; i++) {
+        lock(&mutex);
+        counter++;
+        unlock(&mutex);
+    }
+    thread_done();
+}
+
+static int test_counter(void) {
+    done = 0;
+    for (int i = 0; i < NTHREADS; i++)
+        spawn_thread(i, add_worker, 0);
+    join(NTHREADS);
+    if (counter != NTHREADS * ITERS) {
+        printf("threadtest: 计数器为 %d，期望 %d\n", counter, NTHREADS * ITERS);
+        return -1;
+    }
+    return 0;
+}
+
+// 线程扩展的堆与打开的文件对主线程同样可见
+static char *heap;
+static int shared_fd;
+
+static void heap_file_worker(void *arg) {
+    (void)arg;
+    heap = sbrk(PAGE_SIZE);          // 只扩大地址空间，由主线程首次访问时补页
+    shared_fd = open(TEST_FILE, O_CREATE | O_RDWR);
+    thread_done();
+}
+
+static int test_heap_and_files(void) {
+    done = 0;
+    spawn_thread(NTHREADS, heap_file_worker, 0);
+    join(1);
+
+    if (heap == (char *)-1) {
+        printf("threadtest: 线程中 sbrk 失败\n");
+        return -1;
+    }
+    heap[0] = 'h';
+    heap[PAGE_SIZE - 1] = 'H';
+    if (heap[0] != 'h' || heap[PAGE_SIZE - 1] != 'H') {
+        printf("threadtest: 线程扩展的堆不可用\n");
+        return -1;
+    }
+
+    if (shared_fd < 0 || write(shared_fd, "ok", 2) != 2 || close(shared_fd) < 0) {
+        printf("threadtest: 线程打开的文件在主线程中不可用\n");
+        return -1;
+    }
+    unlink(TEST_FILE);
+    return 0;
+}
+
+// 不足一个 tick 的超时：futex_timedwait 等不到唤醒时超时返回 -1，usleep 睡够时长即返回，
+// 两者都不会凑整到 tick（time 计数 10MHz，一个 tick 为 1000000）
+static int test_timeouts(void) {
+    static volatile int word;
+    uint64_t start = get_time();
+    int r = futex_timedwait(&word, 0, 5000);
+    uint64_t elapsed = get_time() - start;
+    if (r != -1 || elapsed < 50000 || elapsed >= 1000000) {
+        printf("threadtest: futex_timedwait(5ms) 返回 %d，耗时 %lu\n", r, elapsed);
+        return -1;
+    }
+
+    start = get_time();
+    r = usleep(3000);
+    elapsed = get_time() - start;
+    if (r != 0 || elapsed < 30000 || elapsed >= 1000000) {
+        printf("threadtest: usleep(3ms) 返回 %d，耗时 %lu\n", r, elapsed);
+        return -1;
+    }
+    return 0;
+}
+
+int main(void) {
+    printf("threadtest: clone/futex 功能验证开始\n");
+
+    if (test_counter() < 0 || test_heap_and_files() < 0 || test_timeouts() < 0) {
+        printf("threadtest: 失败\n");
+        exit(-1);
+    }
+
+    printf("threadtest: 测试通过\n");
+    exit(0);
+}
@@ -0,0 +1,12 @@
+#include "user.h"
+
+// tracedump: 把内核跟踪点记录按时间顺序打印到控制台（格式见 include/trace.h）
+int main(void) {
+    int n = tracedump();
+    if (n < 0) {
+        printf("tracedump: 转储失败\n");
+        exit(-1);
+    }
+    printf("tracedump: 共 %d 条记录\n", n);
+    exit(0);
+}
@@ -1,21 +1,12 @@
 #include "user.h"
 #include <stdarg.h>
 
-// user 空间的 libc 精简实现。提供进程入口、系统调用封装以及若干测试例程。
+// user 空间的 libc 精简实现。提供系统调用封装以及若干测试例程，进程入口见 crt0.c。
+// 本文件同时是共享运行库的一部分，对外可见的函数须登记在 ulib.syms 中。
 
-// 前向声明：main 由用户程序实现，exit 在稍后定义。
-extern int main(void);
-int exit(int status) __attribute__((noreturn));
-
-// _start 是所有用户程序的入口。内核加载 ELF 后从该符号开始执行，
-// 负责调用 main() 并将返回值作为 exit 的退出码。放入 .text.boot 以便链接脚本控制位置。
-void _start(void) __attribute__((noreturn, section(".text.boot")));
-void _start(void)
-{
-    exit(main());
-}
-
-int errno = 0;  // 若系统调用返回错误，errno 保存正向错误码，方便测试代码打印。
+// 若系统调用返回错误，errno 保存正向错误码，方便测试代码打印。
+// 共享运行库按固定地址导出它（ULIB_ERRNO_VA），放在 .data.abi 使其位于数据段开头
+int errno __attribute__((section(".data.abi"))) = 0;
 
 // syscall_ret: 将内核返回值转换为 libc 语义。
 //   - ret >= 0: 直接返回；
@@ -89,17 +80,79 @@ extern int __sys_getpriority(void);
 extern int __sys_klog_dump(void);
 extern int __sys_klog_set_threshold(int, int);
 extern int __sys_sleep(int);
+extern int __sys_spawn(const char *, char **);
+extern long __sys_mmap(void *, size_t, int, int, int, long);
+extern int __sys_munmap(void *, size_t);
+extern int __sys_meminfo(int, struct meminfo *);
+extern int __sys_sched_setattr(int, const struct sched_attr *);
+extern int __sys_schedstat(int, struct schedstat *);
+extern int __sys_clone(void (*)(void *), void *, int, void *);
+extern int __sys_futex_wait(volatile int *, int);
+extern int __sys_futex_wake(volatile int *, int);
+extern int __sys_lockstat(int);
+extern int __sys_allocprof(int);
+extern int __sys_irqstat(struct irq_stat *, int, int);
+extern int __sys_idlestat(struct idle_stat *, int, int);
+extern int __sys_idlepoll(int);
+extern int __sys_metrics_read(struct metric_stat *, int);
+extern int __sys_waitpid(int, int *, int);
+extern int __sys_sched_setaffinity(int, unsigned long);
+extern int __sys_sched_getaffinity(int, unsigned long *);
+extern int __sys_uring_setup(struct uring *);
+extern int __sys_uring_enter(void);
+extern int __sys_bcachestat(struct bcachestat *);
+extern int __sys_pipe(int *);
+extern int __sys_splice(int, int, int);
+extern int __sys_fsync(int);
+extern int __sys_fdatasync(int);
+extern int __sys_scstat(struct syscall_stat *, int, int);
+extern int __sys_strace(int, unsigned long);
+extern int __sys_straceread(struct strace_rec *, int);
+extern int __sys_readv(int, const struct iovec *, int);
+extern int __sys_writev(int, const struct iovec *, int);
+extern int __sys_pread(int, void *, int, long);
+extern int __sys_pwrite(int, const void *, int, long);
+extern int __sys_sendfile(int, int, long, int);
+extern int __sys_poll(struct pollfd *, int, int);
+extern int __sys_kbench(const char *, struct bench_result *, int);
+extern int __sys_prof(int);
+extern int __sys_profread(struct prof_sample *, int);
+extern int __sys_tracedump(void);
+extern int __sys_socket(int, int, int);
+extern int __sys_bind(int, const struct sockaddr_in *);
+extern int __sys_sendto(int, const void *, int, int, const struct sockaddr_in *);
+extern int __sys_recvfrom(int, void *, int, int, struct sockaddr_in *);
+extern int __sys_getrusage(int, struct rusage *);
+extern int __sys_wait4(int, int *, int, struct rusage *);
+extern int __sys_procinfo(struct procinfo *, int);
+extern int __sys_poweroff(int);
+extern int __sys_perf_read(int, struct perfcount *);
+extern int __sys_iostat(int, struct proc_iostat *);
+extern int __sys_getdents(int, struct dirent_info *, int, int);
+extern int __sys_fallocate(int, long, long);
+extern int __sys_clone_file(int, int);
+extern int __sys_nanosleep(uint64_t);
+extern int __sys_poll_us(struct pollfd *, int, long);
+extern int __sys_futex_timedwait(volatile int *, int, long);
 
 // 系统调用封装 ------------------------------------------------------------------
 // 这些函数位于 ulib.c 中，便于用户程序直接调用，同时统一处理 errno。
 
+// 内核映射的只读 vDSO 页，见 vdso.h
+#define vdso_data ((const struct vdso_data *)VDSO_DATA_VA)
+#define vdso_proc ((const struct vdso_proc *)VDSO_PROC_VA)
+
+// pid 直接从进程页读取；创建过线程的进程各线程 pid 不同，仍走系统调用
 int getpid(void)
 {
+    if(!vdso_proc->threaded)
+        return vdso_proc->pid;
     return syscall_ret(__sys_getpid());
 }
 
 int fork(void)
 {
+    fflush(-1);        // 否则子进程会再写出一遍缓冲中的数据
     return syscall_ret(__sys_fork());
 }
 
@@ -108,6 +161,56 @@ int wait(int *status)
     return syscall_ret(__sys_wait(status));
 }
 
+int waitpid(int pid, int *status, int options)
+{
+    return syscall_ret(__sys_waitpid(pid, status, options));
+}
+
+int wait4(int pid, int *status, int options, struct rusage *ru)
+{
+    return syscall_ret(__sys_wait4(pid, status, options, ru));
+}
+
+int getrusage(int who, struct rusage *ru)
+{
+    return syscall_ret(__sys_getrusage(who, ru));
+}
+
+int procinfo(struct procinfo *buf, int n)
+{
+    return syscall_ret(__sys_procinfo(buf, n));
+}
+
+int poweroff(int code)
+{
+    return syscall_ret(__sys_poweroff(code));
+}
+
+int perf_read(int who, struct perfcount *pc)
+{
+    return syscall_ret(__sys_perf_read(who, pc));
+}
+
+int iostat(int who, struct proc_iostat *st)
+{
+    return syscall_ret(__sys_iostat(who, st));
+}
+
+int getdents(int fd, struct dirent_info *buf, int n, int flags)
+{
+    return syscall_ret(__sys_getdents(fd, buf, n, flags));
+}
+
+int fallocate(int fd, long off, long len)
+{
+    return syscall_ret(__sys_fallocate(fd, off, len));
+}
+
+int clone_file(int src_fd, int dst_fd)
+{
+    return syscall_ret(__sys_clone_file(src_fd, dst_fd));
+}
+
 int kill(int pid)
 {
     return syscall_ret(__sys_kill(pid));
@@ -120,6 +223,10 @@ int write(int fd, const void *buf, int len)
 
 int read(int fd, void *buf, int len)
 {
+    if(fd == 0) {
+        fflush(1);     // 让等待输入前的提示先显示出来
+        fflush(2);
+    }
     return syscall_ret(__sys_read(fd, buf, len));
 }
 
@@ -130,6 +237,7 @@ int open(const char *path, int mode)
 
 int close(int fd)
 {
+    fflush(fd);
     return syscall_ret(__sys_close(fd));
 }
 
@@ -163,6 +271,221 @@ void *sbrk(int increment)
     return (void*)(uint64_t)ret;
 }
 
+// mmap: 建立匿名或只读文件映射，返回映射起始地址；失败返回 MAP_FAILED。addr 仅作提示，当前忽略。
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset)
+{
+    long ret = syscall_ret_long(__sys_mmap(addr, length, prot, flags, fd, offset));
+    if(ret < 0)
+        return MAP_FAILED;
+    return (void*)(uint64_t)ret;
+}
+
+int munmap(void *addr, size_t length)
+{
+    return syscall_ret(__sys_munmap(addr, length));
+}
+
+int meminfo(int pid, struct meminfo *info)
+{
+    return syscall_ret(__sys_meminfo(pid, info));
+}
+
+int sched_setattr(int pid, const struct sched_attr *attr)
+{
+    return syscall_ret(__sys_sched_setattr(pid, attr));
+}
+
+int schedstat(int pid, struct schedstat *st)
+{
+    return syscall_ret(__sys_schedstat(pid, st));
+}
+
+int sched_setaffinity(int pid, unsigned long mask)
+{
+    return syscall_ret(__sys_sched_setaffinity(pid, mask));
+}
+
+int sched_getaffinity(int pid, unsigned long *mask)
+{
+    return syscall_ret(__sys_sched_getaffinity(pid, mask));
+}
+
+int uring_setup(struct uring *ring)
+{
+    return syscall_ret(__sys_uring_setup(ring));
+}
+
+int uring_enter(void)
+{
+    return syscall_ret(__sys_uring_enter());
+}
+
+int bcachestat(struct bcachestat *st)
+{
+    return syscall_ret(__sys_bcachestat(st));
+}
+
+int pipe(int fds[2])
+{
+    return syscall_ret(__sys_pipe(fds));
+}
+
+int splice(int fd_in, int fd_out, int n)
+{
+    return syscall_ret(__sys_splice(fd_in, fd_out, n));
+}
+
+int fsync(int fd)
+{
+    return syscall_ret(__sys_fsync(fd));
+}
+
+int fdatasync(int fd)
+{
+    return syscall_ret(__sys_fdatasync(fd));
+}
+
+int scstat(struct syscall_stat *st, int n, int reset)
+{
+    return syscall_ret(__sys_scstat(st, n, reset));
+}
+
+int strace(int pid, unsigned long mask)
+{
+    return syscall_ret(__sys_strace(pid, mask));
+}
+
+int straceread(struct strace_rec *buf, int n)
+{
+    return syscall_ret(__sys_straceread(buf, n));
+}
+
+int readv(int fd, const struct iovec *iov, int cnt)
+{
+    return syscall_ret(__sys_readv(fd, iov, cnt));
+}
+
+int writev(int fd, const struct iovec *iov, int cnt)
+{
+    return syscall_ret(__sys_writev(fd, iov, cnt));
+}
+
+int pread(int fd, void *buf, int n, long off)
+{
+    return syscall_ret(__sys_pread(fd, buf, n, off));
+}
+
+int pwrite(int fd, const void *buf, int n, long off)
+{
+    return syscall_ret(__sys_pwrite(fd, buf, n, off));
+}
+
+int sendfile(int out_fd, int in_fd, long off, int n)
+{
+    return syscall_ret(__sys_sendfile(out_fd, in_fd, off, n));
+}
+
+int poll(struct pollfd *fds, int nfds, int timeout)
+{
+    return syscall_ret(__sys_poll(fds, nfds, timeout));
+}
+
+int poll_us(struct pollfd *fds, int nfds, long timeout_us)
+{
+    return syscall_ret(__sys_poll_us(fds, nfds, timeout_us));
+}
+
+int kbench(const char *name, struct bench_result *res, int max)
+{
+    return syscall_ret(__sys_kbench(name, res, max));
+}
+
+int prof(int hz)
+{
+    return syscall_ret(__sys_prof(hz));
+}
+
+int profread(struct prof_sample *buf, int n)
+{
+    return syscall_ret(__sys_profread(buf, n));
+}
+
+int tracedump(void)
+{
+    return syscall_ret(__sys_tracedump());
+}
+
+int socket(int domain, int type, int protocol)
+{
+    return syscall_ret(__sys_socket(domain, type, protocol));
+}
+
+int bind(int fd, const struct sockaddr_in *addr)
+{
+    return syscall_ret(__sys_bind(fd, addr));
+}
+
+int sendto(int fd, const void *buf, int n, int flags, const struct sockaddr_in *to)
+{
+    return syscall_ret(__sys_sendto(fd, buf, n, flags, to));
+}
+
+int recvfrom(int fd, void *buf, int n, int flags, struct sockaddr_in *from)
+{
+    return syscall_ret(__sys_recvfrom(fd, buf, n, flags, from));
+}
+
+// clone: 创建共享地址空间的线程，stack 为新线程栈顶（16 字节对齐），fn 不能返回，结束时调用 exit
+int clone(void (*fn)(void *), void *stack, int flags, void *arg)
+{
+    return syscall_ret(__sys_clone(fn, stack, flags, arg));
+}
+
+int futex_wait(volatile int *addr, int val)
+{
+    return syscall_ret(__sys_futex_wait(addr, val));
+}
+
+int futex_timedwait(volatile int *addr, int val, long timeout_us)
+{
+    return syscall_ret(__sys_futex_timedwait(addr, val, timeout_us));
+}
+
+int futex_wake(volatile int *addr, int n)
+{
+    return syscall_ret(__sys_futex_wake(addr, n));
+}
+
+int lockstat(int flags)
+{
+    return syscall_ret(__sys_lockstat(flags));
+}
+
+int allocprof(int flags)
+{
+    return syscall_ret(__sys_allocprof(flags));
+}
+
+int irqstat(struct irq_stat *st, int n, int reset)
+{
+    return syscall_ret(__sys_irqstat(st, n, reset));
+}
+
+int idlestat(struct idle_stat *st, int n, int reset)
+{
+    return syscall_ret(__sys_idlestat(st, n, reset));
+}
+
+int idlepoll(int us)
+{
+    return syscall_ret(__sys_idlepoll(us));
+}
+
+int metrics_read(struct metric_stat *buf, int n)
+{
+    return syscall_ret(__sys_metrics_read(buf, n));
+}
+
 int chdir(const char *path)
 {
     return syscall_ret(__sys_chdir(path));
@@ -170,9 +493,15 @@ int chdir(const char *path)
 
 int exec(const char *path, char *const argv[])
 {
+    fflush(-1);
     return syscall_ret(__sys_exec(path, (char **)argv));
 }
 
+int spawn(const char *path, char *const argv[])
+{
+    return syscall_ret(__sys_spawn(path, (char **)argv));
+}
+
 int set_crash_stage(int stage)
 {
     return syscall_ret(__sys_set_crash_stage(stage));
@@ -202,27 +531,35 @@ int klog_set_threshold(int record_level, int console_level)
 // 避免继续执行未定义行为导致内存破坏。
 int exit(int status)
 {
+    fflush(-1);
     __sys_exit(status);
     for(;;) {
         // 正常情况下不会执行到这里。
     }
 }
 
-// 通过系统调用获取时间计数器，与其他封装保持一致的错误处理。
+// 时间计数器即 time CSR，内核已通过 scounteren 允许用户态直接读取
 uint64_t get_time(void)
 {
-    long ret = syscall_ret_long(__sys_time());
-    if(ret < 0)
-        return (uint64_t)-1;
-    return (uint64_t)ret;
+    uint64_t t;
+    asm volatile("rdtime %0" : "=r"(t));
+    return t;
 }
 
+// 与内核 ticks_sync 相同的算法：最近一个 tick 边界的 ticks 加上此后经过的整 tick 数。
+// 内核更新期间 seq 为奇数，读到不一致的一对值时重试
 uint64_t get_ticks(void)
 {
-    long ret = syscall_ret_long(__sys_ticks());
-    if(ret < 0)
-        return (uint64_t)-1;
-    return (uint64_t)ret;
+    unsigned long seq, ticks, tick_time, interval;
+    do {
+        seq = vdso_data->seq;
+        __sync_synchronize();
+        ticks = vdso_data->ticks;
+        tick_time = vdso_data->tick_time;
+        interval = vdso_data->tick_interval;
+        __sync_synchronize();
+    } while((seq & 1) || seq != vdso_data->seq);
+    return ticks + (get_time() - tick_time) / interval;
 }
 
 int get_priority_level(void)
@@ -235,6 +572,16 @@ int sleep(int ticks)
     return syscall_ret(__sys_sleep(ticks));
 }
 
+int nanosleep(uint64_t ns)
+{
+    return syscall_ret(__sys_nanosleep(ns));
+}
+
+int usleep(unsigned int us)
+{
+    return nanosleep((uint64_t)us * 1000);
+}
+
 // -------------------------------------------------------------
 // 以下为测试辅助函数，便于在用户态验证系统调用行为。
 // -------------------------------------------------------------
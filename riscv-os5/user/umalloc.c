@@ -1,86 +1,289 @@
 #include "types.h"
 #include "user.h"
 
-typedef long Align; // 强制内存块按 long 对齐
-
-union header {
-  struct {
-    union header *ptr; // 下一个空闲块
-    unsigned int size;         // 当前块大小（单位：Header）
-  } s;
-  Align x;
+// 用户态内存分配器：
+// - 块大小（含块头）不超过 SMALL_CHUNK_MAX 的小块按大小精确分箱，释放时压回对应的单链表，
+//   分配时直接弹出，均为 O(1)。小箱里的块在相邻块看来仍在使用，不参与合并；
+//   只有在堆无法再扩展时才把它们全部归还并合并。
+// - 其余空闲块放在按 log2 大小分组的双向链表中。每个块头记录本块大小与前一块是否在用，
+//   空闲块把自己的大小写入后一块的 prev_size，释放时与前后空闲块 O(1) 合并；
+//   分配时在所属组内首次适配，找不到则取更大组中的第一个块。
+// - 堆尾的 top 块用 sbrk 按 HEAP_GROW 的整数倍扩展；不小于 MMAP_THRESHOLD 的请求单独用匿名 mmap。
+// 全部状态放在 struct arena 中并由其中的锁保护。目前所有线程共用 main_arena，
+// 以后按线程分配 arena 或加线程缓存时只需修改 arena_get。
+
+#define HDR             16          // 块头大小，也是对齐单位
+#define MINCHUNK        32          // 能独立存在的最小块：块头加空闲链表的两个指针
+#define SMALL_CHUNK_MAX 1040        // 小箱管理的最大块（用户区 1024 字节）
+#define NSMALL          (SMALL_CHUNK_MAX / HDR + 1)
+#define NLARGE          24          // 第 i 组为 [2^(i+10), 2^(i+11))，第 0 组含更小的块
+#define HEAP_GROW       (64 * 1024)
+#define MMAP_THRESHOLD  (128 * 1024)
+#define PAGE            4096
+
+#define PINUSE  1UL   // 前一块在用（或本块是段内第一块）
+#define CINUSE  2UL   // 本块在用
+#define MMAPPED 4UL   // 本块由 mmap 单独映射
+#define FLAGS   (PINUSE | CINUSE | MMAPPED)
+
+struct chunk {
+  unsigned long prev_size;  // 前一块空闲时为其大小，否则无意义
+  unsigned long head;       // 本块大小（含块头，HDR 的倍数）| 标志位
+  struct chunk *next;       // 以下两项只在空闲时使用，与用户区重叠
+  struct chunk *prev;
 };
 
-typedef union header Header;
+#define CSIZE(c)      ((c)->head & ~FLAGS)
+#define CHUNK_AT(c, off) ((struct chunk *)((char *)(c) + (off)))
+#define NEXTC(c)      CHUNK_AT(c, CSIZE(c))
+#define MEM2CHUNK(p)  ((struct chunk *)((char *)(p) - HDR))
+#define CHUNK2MEM(c)  ((void *)((char *)(c) + HDR))
 
-static Header base;     // 空闲链表起点
-static Header *freep;   // 当前空闲链表指针
+struct arena {
+  volatile int lock;                // 0 空闲，1 已加锁，2 已加锁且有等待者
+  struct chunk *small[NSMALL];      // 按块大小 / HDR 索引，单链表
+  struct chunk *large[NLARGE];      // 双向链表
+  struct chunk *top;                // 堆尾可扩展的块，0 表示尚未建立
+};
 
-// 释放用户空间内存
-void free(void *ap)
+static struct arena main_arena;
+
+static struct arena *arena_get(void)
+{
+  return &main_arena;
+}
+
+// 三态 futex 锁：无竞争时加锁与解锁都不进入内核
+static void arena_lock(struct arena *a)
+{
+  int c = __sync_val_compare_and_swap(&a->lock, 0, 1);
+  while(c != 0) {
+    if(c == 2 || __sync_val_compare_and_swap(&a->lock, 1, 2) != 0)
+      futex_wait(&a->lock, 2);
+    c = __sync_val_compare_and_swap(&a->lock, 0, 2);
+  }
+}
+
+static void arena_unlock(struct arena *a)
+{
+  if(__sync_fetch_and_sub(&a->lock, 1) != 1) {
+    a->lock = 0;
+    futex_wake(&a->lock, 1);
+  }
+}
+
+static int large_index(unsigned long size)
+{
+  int i = 0;
+  for(size >>= 11; size && i < NLARGE - 1; size >>= 1)
+    i++;
+  return i;
+}
+
+static void large_insert(struct arena *a, struct chunk *c)
+{
+  int i = large_index(CSIZE(c));
+  c->prev = 0;
+  c->next = a->large[i];
+  if(c->next)
+    c->next->prev = c;
+  a->large[i] = c;
+}
+
+static void large_unlink(struct arena *a, struct chunk *c)
+{
+  if(c->prev)
+    c->prev->next = c->next;
+  else
+    a->large[large_index(CSIZE(c))] = c->next;
+  if(c->next)
+    c->next->prev = c->prev;
+}
+
+// 把空闲块 c 标记为占用 size 字节，剩余部分足够大时拆出来重新挂回空闲链表
+static void use_chunk(struct arena *a, struct chunk *c, unsigned long size)
+{
+  unsigned long rest = CSIZE(c) - size;
+
+  if(rest >= MINCHUNK) {
+    struct chunk *r = CHUNK_AT(c, size);
+    r->head = rest | PINUSE;
+    NEXTC(r)->prev_size = rest;
+    large_insert(a, r);
+    c->head = size | CINUSE | (c->head & PINUSE);
+  } else {
+    c->head |= CINUSE;
+    NEXTC(c)->head |= PINUSE;
+  }
+}
+
+// 把在用块 c 归还给空闲链表，与前后空闲块及 top 合并
+static void chunk_release(struct arena *a, struct chunk *c)
+{
+  unsigned long size = CSIZE(c);
+
+  if(!(c->head & PINUSE)) {
+    struct chunk *p = (struct chunk *)((char *)c - c->prev_size);
+    large_unlink(a, p);
+    size += CSIZE(p);
+    c = p;
+  }
+  struct chunk *n = CHUNK_AT(c, size);
+  if(n == a->top) {
+    c->head = (size + CSIZE(n)) | (c->head & PINUSE);
+    a->top = c;
+    return;
+  }
+  if(!(n->head & CINUSE)) {
+    large_unlink(a, n);
+    size += CSIZE(n);
+  }
+  c->head = size | (c->head & PINUSE);
+  n = NEXTC(c);
+  n->prev_size = size;
+  n->head &= ~PINUSE;
+  large_insert(a, c);
+}
+
+// 在空闲链表中找一个不小于 size 的块
+static struct chunk *large_take(struct arena *a, unsigned long size)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1; // 获取头部
-  // 合并相邻空闲块
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  for(int i = large_index(size); i < NLARGE; i++) {
+    for(struct chunk *c = a->large[i]; c; c = c->next) {
+      if(CSIZE(c) >= size) {
+        large_unlink(a, c);
+        use_chunk(a, c, size);
+        return c;
+      }
+    }
+  }
+  return 0;
 }
 
-// 扩展堆空间
-static Header* morecore(unsigned int nu)
+// 用 sbrk 扩展堆，使 top 至少有 need 字节。新内存与 top 不相邻（有人直接调用过 sbrk）时，
+// 旧 top 的最后 HDR 字节留作永久在用的栅栏，其余部分作为普通空闲块，合并不会越过段尾
+static int grow_top(struct arena *a, unsigned long need)
 {
-  char *p;
-  Header *hp;
+  struct chunk *t = a->top;
+  unsigned long have = t ? CSIZE(t) : 0;
+  unsigned long incr = (need - have + HEAP_GROW - 1) / HEAP_GROW * HEAP_GROW;
+  char *p = sbrk(incr);
 
-  if(nu < 4096)
-    nu = 4096; // 最小分配单位
-  p = sbrk(nu * sizeof(Header));
   if(p == SBRK_ERROR)
+    return -1;
+  if(t && p == (char *)t + have) {
+    t->head += incr;
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  }
+
+  if(t) {
+    struct chunk *fence = CHUNK_AT(t, have - HDR);
+    if(have - HDR >= MINCHUNK) {
+      t->head = (have - HDR) | (t->head & PINUSE);
+      fence->prev_size = have - HDR;
+      fence->head = HDR | CINUSE;
+      large_insert(a, t);
+    } else {
+      t->head |= CINUSE;   // 太小，整块留作栅栏
+    }
+  }
+  unsigned long pad = -(unsigned long)p & (HDR - 1);
+  t = (struct chunk *)(p + pad);
+  t->head = ((incr - pad) & ~(unsigned long)(HDR - 1)) | PINUSE;
+  a->top = t;
+  return CSIZE(t) >= need ? 0 : grow_top(a, need);
+}
+
+// 从 top 切出 size 字节，top 始终保留至少 MINCHUNK 字节
+static struct chunk *top_take(struct arena *a, unsigned long size)
+{
+  struct chunk *c = a->top;
+
+  if(c == 0 || CSIZE(c) < size + MINCHUNK)
+    return 0;
+  struct chunk *t = CHUNK_AT(c, size);
+  t->head = (CSIZE(c) - size) | PINUSE;
+  c->head = size | CINUSE | (c->head & PINUSE);
+  a->top = t;
+  return c;
+}
+
+// 把小箱中缓存的块全部归还合并，返回是否归还了块
+static int consolidate(struct arena *a)
+{
+  int any = 0;
+  for(int i = 0; i < NSMALL; i++) {
+    while(a->small[i]) {
+      struct chunk *c = a->small[i];
+      a->small[i] = c->next;
+      chunk_release(a, c);
+      any = 1;
+    }
+  }
+  return any;
+}
+
+static struct chunk *arena_alloc(struct arena *a, unsigned long size)
+{
+  struct chunk *c;
+
+  if(size <= SMALL_CHUNK_MAX && (c = a->small[size / HDR]) != 0) {
+    a->small[size / HDR] = c->next;
+    return c;
+  }
+  if((c = large_take(a, size)) != 0 || (c = top_take(a, size)) != 0)
+    return c;
+  if(grow_top(a, size + MINCHUNK) == 0)
+    return top_take(a, size);
+  if(consolidate(a) && ((c = large_take(a, size)) != 0 || (c = top_take(a, size)) != 0))
+    return c;
+  return 0;
+}
+
+// 释放用户空间内存
+void free(void *ap)
+{
+  if(ap == 0)
+    return;
+
+  struct chunk *c = MEM2CHUNK(ap);
+  if(c->head & MMAPPED) {
+    munmap(c, CSIZE(c));
+    return;
+  }
+
+  struct arena *a = arena_get();
+  unsigned long size = CSIZE(c);
+  arena_lock(a);
+  if(size <= SMALL_CHUNK_MAX) {
+    c->next = a->small[size / HDR];
+    a->small[size / HDR] = c;
+  } else {
+    chunk_release(a, c);
+  }
+  arena_unlock(a);
 }
 
 // 分配用户空间内存
 void* malloc(unsigned int nbytes)
 {
-  Header *p, *prevp;
-  unsigned int nunits;
+  unsigned long size = ((unsigned long)nbytes + HDR + HDR - 1) & ~(unsigned long)(HDR - 1);
+  struct chunk *c;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
-  }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
-    }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+  if(size < MINCHUNK)
+    size = MINCHUNK;
+  if(size >= MMAP_THRESHOLD) {
+    size = (size + PAGE - 1) & ~(unsigned long)(PAGE - 1);
+    c = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(c == MAP_FAILED)
+      return 0;
+    c->head = size | CINUSE | MMAPPED | PINUSE;
+    return CHUNK2MEM(c);
   }
+
+  struct arena *a = arena_get();
+  arena_lock(a);
+  c = arena_alloc(a, size);
+  arena_unlock(a);
+  return c ? CHUNK2MEM(c) : 0;
 }